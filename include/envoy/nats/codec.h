@@ -1,15 +1,28 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "envoy/buffer/buffer.h"
 #include "envoy/common/exception.h"
 
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
 namespace Envoy {
 namespace Nats {
 
 class Message {
 public:
+  /**
+   * The operation of a decoded message, as far as the clients tell them
+   * apart, which tokenize() finds once so that the message is routed without
+   * comparing strings again.
+   */
+  enum class Type { Other, Info, Msg, Ping, Pong, Ok, Err };
+
   Message() {}
 
   explicit Message(const std::string &string) : string_(string) {}
@@ -27,8 +40,41 @@ public:
   std::string &asString();
   const std::string &asString() const;
 
+  /**
+   * The operation of a decoded message, e.g. MSG, and its arguments. The
+   * tokens are found once, by tokenize(), and are views of the message, that
+   * are valid as long as it is not modified.
+   */
+  absl::string_view operation() const;
+  size_t argumentCount() const;
+  absl::string_view argument(size_t index) const;
+  Type type() const { return type_; }
+  void tokenize();
+
+  /**
+   * The payload that followed the operation line of a decoded MSG, or that
+   * follows the one of a PUB, if any. The payload holds the slices of the
+   * input it was read from, or of the string it was built from, rather than a
+   * copy of them, and is shared by the copies of the message. The output a
+   * message is encoded to references the slices of its payload, which must
+   * not be modified from then on.
+   */
+  Buffer::Instance *payload() const { return payload_.get(); }
+  const std::shared_ptr<Buffer::Instance> &sharedPayload() const {
+    return payload_;
+  }
+  void setPayload(std::shared_ptr<Buffer::Instance> payload) {
+    payload_ = std::move(payload);
+  }
+
 private:
+  absl::string_view token(size_t index) const;
+
   std::string string_;
+  // the offset and the length of each token of string_.
+  absl::InlinedVector<std::pair<uint32_t, uint32_t>, 5> tokens_;
+  Type type_{Type::Other};
+  std::shared_ptr<Buffer::Instance> payload_;
 };
 
 typedef std::unique_ptr<Message> MessagePtr;
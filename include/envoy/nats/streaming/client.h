@@ -37,6 +37,14 @@ public:
    */
   virtual void onResponse() PURE;
 
+  /**
+   * Called instead of onResponse() when the request is answered with a reply,
+   * as on a request/reply subject. The callbacks of the requests that take no
+   * reply see a response.
+   * @param reply supplies the payload of the reply.
+   */
+  virtual void onReply(Buffer::InstancePtr &&) { onResponse(); }
+
   /**
    * Called when a network/protocol error occurs and there is no response.
    */
@@ -46,6 +54,13 @@ public:
    * Called when a timeout occurs and there is no response.
    */
   virtual void onTimeout() PURE;
+
+  /**
+   * Called when the request is rejected, before it is made, as the connection
+   * it would be written to has more data waiting to be sent than its buffer
+   * allows, or as the circuit breakers of the cluster are open.
+   */
+  virtual void onOverflow() PURE;
 };
 
 /**
@@ -65,20 +80,46 @@ public:
    * @param discover_prefix supplies the prefix subject used to connect to the
    * NATS Streaming server.
    * @param payload supplies the fully buffered payload as buffered by this
-   * filter or previous ones in the filter chain.
+   * filter or previous ones in the filter chain. Its slices are written to the
+   * connection as they are.
    * @param callbacks supplies the request completion callbacks.
    * @return PublishRequestPtr a handle to the active request or nullptr if the
-   * request could not be made for some reason.
+   * request could not be made for some reason, in which case the callbacks were
+   * already called.
    */
   virtual PublishRequestPtr makeRequest(const std::string &subject,
                                         const std::string &cluster_id,
                                         const std::string &discover_prefix,
-                                        std::string &&payload,
+                                        Buffer::InstancePtr &&payload,
                                         PublishCallbacks &callbacks) PURE;
 };
 
 typedef std::shared_ptr<Client> ClientPtr;
 
+/**
+ * A client over a single connection, that a pool chooses among others by its
+ * load.
+ */
+class PooledClient : public Client {
+public:
+  /**
+   * @return the requests waiting for the connection or for their ack.
+   */
+  virtual size_t outstandingRequests() const PURE;
+
+  /**
+   * @return whether new requests overflow, until the connection drains.
+   */
+  virtual bool aboveWriteBufferHighWatermark() const PURE;
+
+  /**
+   * Opens the connection ahead of the first request, if it isn't yet.
+   */
+  virtual void connect() PURE;
+};
+
+typedef std::unique_ptr<PooledClient> PooledClientPtr;
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace Envoy
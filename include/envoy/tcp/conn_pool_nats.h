@@ -29,6 +29,18 @@ public:
    * Called when close event occurs on a connection.
    */
   virtual void onClose() PURE;
+
+  /**
+   * Called when the data written to the connection and not yet sent goes over
+   * the high watermark of its buffer.
+   */
+  virtual void onAboveWriteBufferHighWatermark() PURE;
+
+  /**
+   * Called when the data written to the connection and not yet sent goes back
+   * under the low watermark of its buffer.
+   */
+  virtual void onBelowWriteBufferLowWatermark() PURE;
 };
 
 /**
@@ -76,6 +88,13 @@ public:
    * counting active healthcheck operations as passive healthcheck operations.
    */
   virtual bool disableOutlierEvents() const PURE;
+
+  /**
+   * @return uint32_t the number of bytes of encoded requests that are written
+   * right away. Fewer bytes are written together at the end of the iteration
+   * of the event loop the requests are made in.
+   */
+  virtual uint32_t maxBufferSizeBeforeFlush() const PURE;
 };
 
 /**
@@ -118,6 +137,12 @@ public:
    * @param request supplies the request to make.
    */
   virtual void makeRequest(const std::string &hash_key, const T &request) PURE;
+
+  /**
+   * @return the cluster the requests are made to, whose circuit breakers they
+   * are counted against, or nullptr if the cluster was removed.
+   */
+  virtual Upstream::ClusterInfoConstSharedPtr clusterInfo() PURE;
 };
 
 template <typename T> using InstancePtr = std::unique_ptr<Instance<T>>;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/common/pure.h"
+#include "include/envoy/tcp/codec.h"
+#include "include/envoy/tcp/conn_pool_nats.h"
+
+namespace Envoy {
+namespace Tcp {
+namespace PipelinedClient {
+
+/**
+ * The callbacks of a single request, one of which is called once.
+ */
+template <typename T> class RequestCallbacks {
+public:
+  virtual ~RequestCallbacks() {}
+
+  /**
+   * Called when the response to the request is received.
+   * @param value supplies the response which is now owned by the callee.
+   */
+  virtual void onResponse(MessagePtr<T> &&value) PURE;
+
+  /**
+   * Called when the connection of the request closed before its response was
+   * received.
+   */
+  virtual void onFailure() PURE;
+};
+
+/**
+ * A request waiting for its response.
+ */
+class PendingRequest {
+public:
+  virtual ~PendingRequest() {}
+
+  /**
+   * Cancels the request. None of its callbacks is called afterwards. The
+   * response is still read, to keep the responses that follow in order.
+   */
+  virtual void cancel() PURE;
+};
+
+/**
+ * Configuration for a pipelined client.
+ */
+class Config : public ConnPoolNats::Config {
+public:
+  /**
+   * @return uint32_t the number of connections opened to each host at most.
+   */
+  virtual uint32_t connectionsPerHost() const PURE;
+
+  /**
+   * @return uint32_t the number of requests waiting for their response on a
+   * connection at most.
+   */
+  virtual uint32_t maxOutstandingRequestsPerConnection() const PURE;
+};
+
+/**
+ * A client of a request/response line protocol, whose server answers the
+ * requests of a connection in their order. The requests are pipelined over a
+ * few connections to each of the hosts of a cluster, the host being chosen by
+ * the load balancer of the cluster.
+ */
+template <typename T> class Instance {
+public:
+  virtual ~Instance() {}
+
+  /**
+   * Makes a request.
+   * @param hash_key supplies the key to use for consistent hashing.
+   * @param request supplies the request to make.
+   * @param callbacks supplies the callbacks of the request.
+   * @return PendingRequest* a handle to the request, which is valid until one
+   * of its callbacks is called, or nullptr if there is no host to make the
+   * request to or the connections of the host are full, in which case no
+   * callback is called.
+   */
+  virtual PendingRequest *makeRequest(const std::string &hash_key,
+                                      const T &request,
+                                      RequestCallbacks<T> &callbacks) PURE;
+};
+
+template <typename T> using InstancePtr = std::unique_ptr<Instance<T>>;
+
+} // namespace PipelinedClient
+} // namespace Tcp
+} // namespace Envoy
@@ -0,0 +1,49 @@
+#include "source/common/buffer/body_budget.h"
+
+#include "source/common/common/macros.h"
+
+namespace Envoy {
+namespace Buffer {
+
+BodyBudget &BodyBudget::get() { MUTABLE_CONSTRUCT_ON_FIRST_USE(BodyBudget); }
+
+double BodyBudget::pressure() const {
+  const uint64_t limit = this->limit();
+  if (limit == 0) {
+    return 0;
+  }
+  return static_cast<double>(used()) / limit;
+}
+
+bool BodyBudget::tryReserve(uint64_t bytes) {
+  uint64_t used = used_.load(std::memory_order_relaxed);
+  do {
+    const uint64_t limit = this->limit();
+    if (limit != 0 && used + bytes > limit) {
+      return false;
+    }
+  } while (!used_.compare_exchange_weak(used, used + bytes,
+                                        std::memory_order_relaxed));
+  return true;
+}
+
+bool BodyBudget::Reservation::reserveTo(uint64_t length) {
+  if (length <= bytes_) {
+    return true;
+  }
+  if (!BodyBudget::get().tryReserve(length - bytes_)) {
+    return false;
+  }
+  bytes_ = length;
+  return true;
+}
+
+void BodyBudget::Reservation::release() {
+  if (bytes_ != 0) {
+    BodyBudget::get().release(bytes_);
+    bytes_ = 0;
+  }
+}
+
+} // namespace Buffer
+} // namespace Envoy
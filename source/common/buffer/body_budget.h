@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace Envoy {
+namespace Buffer {
+
+/**
+ * The bytes of the bodies that the gloo filters buffer, across all the streams
+ * of the process. The budget has no limit until the buffered bodies resource
+ * monitor of the overload manager sets one, which also reports the pressure of
+ * the budget to the overload manager, so that its actions can shed load
+ * before the process runs out of memory. Past the limit, the filters reject
+ * the streams that would buffer more.
+ */
+class BodyBudget {
+public:
+  static BodyBudget &get();
+
+  /**
+   * @param limit the bytes the bodies may take, or 0 for no limit.
+   */
+  void setLimit(uint64_t limit) {
+    limit_.store(limit, std::memory_order_relaxed);
+  }
+  uint64_t limit() const { return limit_.load(std::memory_order_relaxed); }
+  uint64_t used() const { return used_.load(std::memory_order_relaxed); }
+
+  // the fraction of the limit that is used, 0 without a limit.
+  double pressure() const;
+
+  /**
+   * The bytes of the budget that a body of a stream holds, until it is
+   * released or destroyed.
+   */
+  class Reservation {
+  public:
+    Reservation() = default;
+    ~Reservation() { release(); }
+    Reservation(const Reservation &) = delete;
+    Reservation &operator=(const Reservation &) = delete;
+
+    /**
+     * Grows the reservation to the length of the body.
+     * @return false, reserving nothing more, if that exceeds the budget.
+     */
+    bool reserveTo(uint64_t length);
+    void release();
+    uint64_t bytes() const { return bytes_; }
+
+  private:
+    uint64_t bytes_{};
+  };
+
+private:
+  bool tryReserve(uint64_t bytes);
+  void release(uint64_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> limit_{};
+  std::atomic<uint64_t> used_{};
+};
+
+} // namespace Buffer
+} // namespace Envoy
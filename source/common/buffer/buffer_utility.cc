@@ -9,5 +9,62 @@ std::string BufferUtility::drainBufferToString(Buffer::Instance &buffer) {
   return output;
 }
 
+BufferOutputStream::BufferOutputStream(Buffer::Instance &buffer,
+                                       const WriteObserver *observer)
+    : std::ostream(nullptr), stream_buffer_(buffer, observer) {
+  rdbuf(&stream_buffer_);
+}
+
+BufferOutputStream::~BufferOutputStream() { flush(); }
+
+BufferOutputStream::StreamBuffer::StreamBuffer(Buffer::Instance &buffer,
+                                               const WriteObserver *observer)
+    : buffer_(buffer), observer_(observer) {
+  setp(staged_.data(), staged_.data() + staged_.size());
+}
+
+BufferOutputStream::StreamBuffer::int_type
+BufferOutputStream::StreamBuffer::overflow(int_type ch) {
+  flushStaged();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+std::streamsize
+BufferOutputStream::StreamBuffer::xsputn(const char *s,
+                                         std::streamsize count) {
+  if (count <= epptr() - pptr()) {
+    std::copy(s, s + count, pptr());
+    pbump(count);
+    return count;
+  }
+  // large writes go straight to the buffer.
+  flushStaged();
+  append(s, count);
+  return count;
+}
+
+int BufferOutputStream::StreamBuffer::sync() {
+  flushStaged();
+  return 0;
+}
+
+void BufferOutputStream::StreamBuffer::flushStaged() {
+  if (pptr() != pbase()) {
+    append(pbase(), pptr() - pbase());
+  }
+  setp(staged_.data(), staged_.data() + staged_.size());
+}
+
+void BufferOutputStream::StreamBuffer::append(const char *data, size_t size) {
+  if (observer_ != nullptr) {
+    (*observer_)(absl::string_view(data, size));
+  }
+  buffer_.add(data, size);
+}
+
 } // namespace Buffer
 } // namespace Envoy
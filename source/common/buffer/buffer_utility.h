@@ -1,9 +1,14 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <ostream>
 #include <string>
 
 #include "envoy/buffer/buffer.h"
 
+#include "absl/strings/string_view.h"
+
 namespace Envoy {
 namespace Buffer {
 
@@ -20,5 +25,42 @@ public:
   static std::string drainBufferToString(Buffer::Instance &buffer);
 };
 
+/**
+ * An output stream that appends what is written to it to a buffer. Writes are
+ * staged in a small local area and appended to the buffer in chunks, so the
+ * stream must be flushed (or destroyed) before the buffer is read. An optional
+ * observer sees every chunk as it is appended, in order.
+ */
+class BufferOutputStream : public std::ostream {
+public:
+  using WriteObserver = std::function<void(absl::string_view)>;
+
+  explicit BufferOutputStream(Buffer::Instance &buffer,
+                              const WriteObserver *observer = nullptr);
+  ~BufferOutputStream() override;
+
+private:
+  class StreamBuffer : public std::streambuf {
+  public:
+    StreamBuffer(Buffer::Instance &buffer, const WriteObserver *observer);
+
+  protected:
+    // std::streambuf
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char *s, std::streamsize count) override;
+    int sync() override;
+
+  private:
+    void flushStaged();
+    void append(const char *data, size_t size);
+
+    Buffer::Instance &buffer_;
+    const WriteObserver *observer_;
+    std::array<char, 1024> staged_;
+  };
+
+  StreamBuffer stream_buffer_;
+};
+
 } // namespace Buffer
 } // namespace Envoy
@@ -0,0 +1,441 @@
+#include "source/common/http/alb_response_parser.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/base64.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Http {
+
+namespace {
+
+// the nesting of the values that are skipped, as the scanner recurses into
+// them. Protobuf, that used to parse the responses, has the same limit.
+constexpr int MaxDepth = 100;
+
+/**
+ * A forward only scanner of a json document. The values are read as they are
+ * reached, and the ones that aren't needed are skipped without being copied.
+ */
+class JsonScanner {
+public:
+  enum class Type { Null, Boolean, Number, String, Object, Array, Invalid };
+
+  explicit JsonScanner(absl::string_view json) : json_(json) {}
+
+  // the type of the next value.
+  Type peek() {
+    skipWhitespace();
+    if (pos_ == json_.size()) {
+      return Type::Invalid;
+    }
+    switch (json_[pos_]) {
+    case 'n':
+      return Type::Null;
+    case 't':
+    case 'f':
+      return Type::Boolean;
+    case '"':
+      return Type::String;
+    case '{':
+      return Type::Object;
+    case '[':
+      return Type::Array;
+    case '-':
+      return Type::Number;
+    default:
+      return absl::ascii_isdigit(json_[pos_]) ? Type::Number : Type::Invalid;
+    }
+  }
+
+  bool readBoolean(bool &value) {
+    if (consumeLiteral("true")) {
+      value = true;
+      return true;
+    }
+    value = false;
+    return consumeLiteral("false");
+  }
+
+  bool readNumber(double &value) {
+    skipWhitespace();
+    const size_t start = pos_;
+    while (pos_ < json_.size() && isNumberChar(json_[pos_])) {
+      ++pos_;
+    }
+    return absl::SimpleAtod(json_.substr(start, pos_ - start), &value);
+  }
+
+  // reads a string into the value, which is skipped if the value is null.
+  bool readString(std::string *value) {
+    skipWhitespace();
+    if (!consume('"')) {
+      return false;
+    }
+    while (true) {
+      // the runs of plain characters are copied at once.
+      const size_t special = json_.find_first_of("\"\\", pos_);
+      if (special == absl::string_view::npos) {
+        return false;
+      }
+      if (value != nullptr) {
+        value->append(json_.data() + pos_, special - pos_);
+      }
+      pos_ = special + 1;
+      if (json_[special] == '"') {
+        return true;
+      }
+      if (!readEscape(value)) {
+        return false;
+      }
+    }
+  }
+
+  // calls on_member with the key of each member, which then reads its value.
+  template <class OnMember> bool readObject(const OnMember &on_member) {
+    skipWhitespace();
+    if (!consume('{') || ++depth_ > MaxDepth) {
+      return false;
+    }
+    skipWhitespace();
+    std::string key;
+    while (!consume('}')) {
+      key.clear();
+      if (!readString(&key)) {
+        return false;
+      }
+      skipWhitespace();
+      if (!consume(':') || !on_member(key)) {
+        return false;
+      }
+      if (!endOfElement('}')) {
+        return false;
+      }
+    }
+    --depth_;
+    return true;
+  }
+
+  // calls on_element to read each element.
+  template <class OnElement> bool readArray(const OnElement &on_element) {
+    skipWhitespace();
+    if (!consume('[') || ++depth_ > MaxDepth) {
+      return false;
+    }
+    skipWhitespace();
+    while (!consume(']')) {
+      if (!on_element() || !endOfElement(']')) {
+        return false;
+      }
+    }
+    --depth_;
+    return true;
+  }
+
+  bool skipValue() {
+    switch (peek()) {
+    case Type::Null:
+      return consumeLiteral("null");
+    case Type::Boolean: {
+      bool value;
+      return readBoolean(value);
+    }
+    case Type::Number: {
+      double value;
+      return readNumber(value);
+    }
+    case Type::String:
+      return readString(nullptr);
+    case Type::Object:
+      return readObject([this](std::string &) { return skipValue(); });
+    case Type::Array:
+      return readArray([this]() { return skipValue(); });
+    case Type::Invalid:
+      break;
+    }
+    return false;
+  }
+
+  // true if nothing but whitespace is left.
+  bool done() {
+    skipWhitespace();
+    return pos_ == json_.size();
+  }
+
+private:
+  static bool isNumberChar(char c) {
+    return absl::ascii_isdigit(c) || c == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E';
+  }
+
+  void skipWhitespace() {
+    while (pos_ < json_.size() &&
+           (json_[pos_] == ' ' || json_[pos_] == '\n' || json_[pos_] == '\r' ||
+            json_[pos_] == '\t')) {
+      ++pos_;
+    }
+  }
+
+  bool consume(char c) {
+    if (pos_ < json_.size() && json_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool consumeLiteral(absl::string_view literal) {
+    skipWhitespace();
+    if (!absl::StartsWith(json_.substr(pos_), literal)) {
+      return false;
+    }
+    pos_ += literal.size();
+    return true;
+  }
+
+  // consumes the comma after an element, leaving the closing character of
+  // the container, if any, to the caller. A trailing comma is accepted.
+  bool endOfElement(char close) {
+    skipWhitespace();
+    if (consume(',')) {
+      skipWhitespace();
+      return true;
+    }
+    return pos_ < json_.size() && json_[pos_] == close;
+  }
+
+  bool readEscape(std::string *value) {
+    if (pos_ == json_.size()) {
+      return false;
+    }
+    char decoded;
+    switch (json_[pos_++]) {
+    case '"':
+      decoded = '"';
+      break;
+    case '\\':
+      decoded = '\\';
+      break;
+    case '/':
+      decoded = '/';
+      break;
+    case 'b':
+      decoded = '\b';
+      break;
+    case 'f':
+      decoded = '\f';
+      break;
+    case 'n':
+      decoded = '\n';
+      break;
+    case 'r':
+      decoded = '\r';
+      break;
+    case 't':
+      decoded = '\t';
+      break;
+    case 'u':
+      return readUnicodeEscape(value);
+    default:
+      return false;
+    }
+    if (value != nullptr) {
+      value->push_back(decoded);
+    }
+    return true;
+  }
+
+  bool readUnicodeEscape(std::string *value) {
+    uint32_t code;
+    if (!readHex(code)) {
+      return false;
+    }
+    if (code >= 0xD800 && code <= 0xDBFF) {
+      // a high surrogate, that the low one must follow.
+      uint32_t low;
+      if (!absl::StartsWith(json_.substr(pos_), "\\u")) {
+        return false;
+      }
+      pos_ += 2;
+      if (!readHex(low) || low < 0xDC00 || low > 0xDFFF) {
+        return false;
+      }
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+    if (value != nullptr) {
+      appendUtf8(code, *value);
+    }
+    return true;
+  }
+
+  // reads the 4 hex digits of a \u escape.
+  bool readHex(uint32_t &code) {
+    if (json_.size() - pos_ < 4) {
+      return false;
+    }
+    code = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = json_[pos_++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static void appendUtf8(uint32_t code, std::string &value) {
+    if (code < 0x80) {
+      value.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      value.push_back(static_cast<char>(0xC0 | (code >> 6)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      value.push_back(static_cast<char>(0xE0 | (code >> 12)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      value.push_back(static_cast<char>(0xF0 | (code >> 18)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+  }
+
+  const absl::string_view json_;
+  size_t pos_{};
+  int depth_{};
+};
+
+// hands the string over to the buffer without copying it.
+void moveToBuffer(std::string &&data, Buffer::Instance &buffer) {
+  if (data.empty()) {
+    return;
+  }
+  auto *owned = new std::string(std::move(data));
+  auto *fragment = new Buffer::BufferFragmentImpl(
+      owned->data(), owned->size(),
+      [owned](const void *, size_t,
+              const Buffer::BufferFragmentImpl *fragment) {
+        delete owned;
+        delete fragment;
+      });
+  buffer.addBufferFragment(*fragment);
+}
+
+} // namespace
+
+bool AlbResponseParser::parse(Buffer::Instance &json,
+                              RequestOrResponseHeaderMap &headers,
+                              Buffer::Instance &body, bool replace_headers) {
+  using Type = JsonScanner::Type;
+  const uint64_t length = json.length();
+  JsonScanner scanner(absl::string_view(
+      static_cast<const char *>(json.linearize(length)), length));
+
+  // the headers are only applied once the whole response is known to be
+  // valid.
+  std::vector<std::pair<LowerCaseString, std::string>> response_headers;
+  absl::optional<double> status;
+  std::string unwrapped_body;
+  bool has_body = false;
+  bool base64_encoded = false;
+  bool base64_flag_valid = true;
+
+  // header values that are not strings are added empty, as they were when
+  // the response was parsed to a Struct.
+  const auto read_header = [&scanner,
+                            &response_headers](const std::string &name) {
+    std::string value;
+    const bool read = scanner.peek() == Type::String
+                          ? scanner.readString(&value)
+                          : scanner.skipValue();
+    if (read) {
+      response_headers.emplace_back(LowerCaseString(name), std::move(value));
+    }
+    return read;
+  };
+
+  const auto read_member = [&](std::string &key) {
+    const Type type = scanner.peek();
+    if (key == "body") {
+      has_body = true;
+      unwrapped_body.clear();
+      return type == Type::String ? scanner.readString(&unwrapped_body)
+                                  : scanner.skipValue();
+    }
+    if (key == "isBase64Encoded") {
+      base64_flag_valid = type == Type::Boolean;
+      return base64_flag_valid ? scanner.readBoolean(base64_encoded)
+                               : scanner.skipValue();
+    }
+    if (key == "statusCode") {
+      // a status that is not a number fails the whole response.
+      double code;
+      if (type != Type::Number || !scanner.readNumber(code)) {
+        return false;
+      }
+      status = code;
+      return true;
+    }
+    if (key == "headers" && type == Type::Object) {
+      return scanner.readObject(read_header);
+    }
+    // While ALB would refuse to parse something with headers + multivalue
+    // Being more permissive in this case was determined to be better.
+    if (key == "multiValueHeaders" && type == Type::Object) {
+      return scanner.readObject([&scanner, &read_header](std::string &name) {
+        if (scanner.peek() != Type::Array) {
+          return scanner.skipValue();
+        }
+        return scanner.readArray(
+            [&read_header, &name]() { return read_header(name); });
+      });
+    }
+    return scanner.skipValue();
+  };
+
+  if (!scanner.readObject(read_member) || !scanner.done() ||
+      (has_body && !base64_flag_valid)) {
+    return false;
+  }
+
+  if (status.has_value()) {
+    if (auto *status_headers = dynamic_cast<ResponseHeaderMap *>(&headers)) {
+      status_headers->setStatus(static_cast<uint64_t>(status.value()));
+    }
+  }
+  if (replace_headers) {
+    // all the values of a multi value header are kept.
+    for (const auto &header : response_headers) {
+      headers.remove(header.first);
+    }
+  }
+  for (const auto &header : response_headers) {
+    headers.addCopy(header.first, header.second);
+  }
+  if (has_body && base64_encoded) {
+    unwrapped_body = Base64::decode(unwrapped_body);
+  }
+  moveToBuffer(std::move(unwrapped_body), body);
+  return true;
+}
+
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/http/header_map.h"
+
+namespace Envoy {
+namespace Http {
+
+class AlbResponseParser {
+public:
+  /**
+   * Unwraps the json response of a lambda that answers as it would to an ALB,
+   * in a single pass over the json and without building a document of it.
+   * Like the protobuf json parser, trailing commas are accepted.
+   * @param json the lambda response, which is linearized.
+   * @param headers receives the headers and multiValueHeaders, and the
+   * statusCode when they are response headers.
+   * @param body receives the body, base64 decoded if isBase64Encoded is set,
+   * which is handed over without copying it again.
+   * @param replace_headers whether the headers of the response replace the
+   * ones of the same name, rather than being added to them.
+   * @return false if the response is not valid, in which case neither the
+   * headers nor the body are modified.
+   */
+  static bool parse(Buffer::Instance &json,
+                    RequestOrResponseHeaderMap &headers, Buffer::Instance &body,
+                    bool replace_headers = false);
+};
+
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+
+/**
+ * Makes the filters of a type in blocks that each worker keeps on a free list
+ * of its own once the streams they served end, for the filters of the next
+ * streams. A filter and the control block of its shared_ptr take a single
+ * block, in which it is constructed anew, so that none of the state of the
+ * previous stream is left in it. A block is freed on the list of the thread
+ * that releases it, which is the worker of the stream, and each list keeps at
+ * most MaxFreeBlocks of them.
+ */
+template <class T> class FilterPool {
+public:
+  static constexpr size_t MaxFreeBlocks = 1024;
+
+  template <class... Args> static std::shared_ptr<T> make(Args &&...args) {
+    return std::allocate_shared<T>(Allocator<T>(),
+                                   std::forward<Args>(args)...);
+  }
+
+  // the number of free blocks the calling thread keeps for the filters.
+  static size_t freeBlocks() { return freeList().blocks_.size(); }
+
+  // the allocator that allocate_shared rebinds to the type of its block.
+  template <class U> class Allocator {
+  public:
+    using value_type = U;
+
+    Allocator() = default;
+    template <class V> Allocator(const Allocator<V> &) {}
+
+    U *allocate(size_t n) {
+      return static_cast<U *>(allocateBlock(n * sizeof(U)));
+    }
+    void deallocate(U *block, size_t n) {
+      deallocateBlock(block, n * sizeof(U));
+    }
+
+    template <class V> bool operator==(const Allocator<V> &) const {
+      return true;
+    }
+    template <class V> bool operator!=(const Allocator<V> &) const {
+      return false;
+    }
+
+  private:
+    static_assert(alignof(U) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                  "the blocks are aligned as operator new aligns them");
+  };
+
+private:
+  struct FreeList {
+    ~FreeList() {
+      for (void *block : blocks_) {
+        ::operator delete(block);
+      }
+    }
+    // the size of the blocks on the list, that of the first one pooled.
+    size_t block_size_{};
+    std::vector<void *> blocks_;
+  };
+
+  // the list of the calling thread, which frees its blocks when it exits.
+  static FreeList &freeList() {
+    static thread_local FreeList list;
+    return list;
+  }
+
+  static void *allocateBlock(size_t size) {
+    FreeList &list = freeList();
+    if (size != list.block_size_ || list.blocks_.empty()) {
+      return ::operator new(size);
+    }
+    void *block = list.blocks_.back();
+    list.blocks_.pop_back();
+    return block;
+  }
+
+  static void deallocateBlock(void *block, size_t size) {
+    FreeList &list = freeList();
+    if (list.block_size_ == 0) {
+      list.block_size_ = size;
+    }
+    if (size != list.block_size_ || list.blocks_.size() >= MaxFreeBlocks) {
+      ::operator delete(block);
+      return;
+    }
+    list.blocks_.push_back(block);
+  }
+};
+
+} // namespace Http
+} // namespace Envoy
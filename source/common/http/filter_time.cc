@@ -0,0 +1,70 @@
+#include "source/common/http/filter_time.h"
+
+#include <time.h>
+
+#include "source/common/protobuf/protobuf.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Http {
+
+namespace {
+
+int64_t microseconds(std::chrono::nanoseconds time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+}
+
+} // namespace
+
+FilterTime &FilterTime::forStream(StreamInfo::FilterState &filter_state,
+                                  absl::string_view filter_name,
+                                  TimeSource &time_source) {
+  const std::string key = absl::StrCat(filter_name, ".time");
+  auto *time = filter_state.getDataMutable<FilterTime>(key);
+  if (time == nullptr) {
+    auto created = std::make_shared<FilterTime>(time_source);
+    time = created.get();
+    filter_state.setData(key, std::move(created),
+                         StreamInfo::FilterState::StateType::Mutable,
+                         StreamInfo::FilterState::LifeSpan::FilterChain);
+  }
+  return *time;
+}
+
+FilterTime::Scope::Scope(FilterTime *time) : time_(time) {
+  if (time_ != nullptr && time_->open_scopes_++ == 0) {
+    wall_start_ = time_->time_source_.monotonicTime();
+    cpu_start_ = threadCpuTime();
+  }
+}
+
+FilterTime::Scope::~Scope() {
+  if (time_ != nullptr && --time_->open_scopes_ == 0) {
+    time_->add(time_->time_source_.monotonicTime() - wall_start_,
+               threadCpuTime() - cpu_start_);
+  }
+}
+
+std::chrono::nanoseconds FilterTime::threadCpuTime() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return {};
+  }
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+ProtobufTypes::MessagePtr FilterTime::serializeAsProto() const {
+  auto time = std::make_unique<ProtobufWkt::Struct>();
+  (*time->mutable_fields())["wall_us"].set_number_value(microseconds(wall_));
+  (*time->mutable_fields())["cpu_us"].set_number_value(microseconds(cpu_));
+  return time;
+}
+
+absl::optional<std::string> FilterTime::serializeAsString() const {
+  return absl::StrCat("wall_us=", microseconds(wall_),
+                      " cpu_us=", microseconds(cpu_));
+}
+
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "envoy/common/time.h"
+#include "envoy/stream_info/filter_state.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Http {
+
+/**
+ * The wall and cpu time a filter spent on a stream, kept in the filter state
+ * of the stream under the name of the filter followed by ".time", so that
+ * the access log can report it, e.g. with
+ * %FILTER_STATE(io.solo.transformation.time:PLAIN)%. Only the callbacks of
+ * the filter on the worker thread are timed. The filters of a chain that
+ * share a name, such as the stages of a filter, add up to the same time.
+ */
+class FilterTime : public StreamInfo::FilterState::Object {
+public:
+  explicit FilterTime(TimeSource &time_source) : time_source_(time_source) {}
+
+  /**
+   * @return the time of the filter on the stream, which is created the first
+   * time it is asked for.
+   */
+  static FilterTime &forStream(StreamInfo::FilterState &filter_state,
+                               absl::string_view filter_name,
+                               TimeSource &time_source);
+
+  /**
+   * Adds the time from its construction to its destruction to the time of the
+   * filter, unless there is none, e.g. when the filter doesn't record it. The
+   * scopes nested in another one of the same time, such as the callbacks of a
+   * local reply sent by the filter, are already counted by it.
+   */
+  class Scope {
+  public:
+    explicit Scope(FilterTime *time);
+    ~Scope();
+
+  private:
+    FilterTime *const time_;
+    MonotonicTime wall_start_;
+    std::chrono::nanoseconds cpu_start_{};
+  };
+
+  void add(std::chrono::nanoseconds wall, std::chrono::nanoseconds cpu) {
+    wall_ += wall;
+    cpu_ += cpu;
+  }
+  std::chrono::nanoseconds wall() const { return wall_; }
+  std::chrono::nanoseconds cpu() const { return cpu_; }
+
+  // the cpu time the calling thread has used so far.
+  static std::chrono::nanoseconds threadCpuTime();
+
+  // StreamInfo::FilterState::Object
+  ProtobufTypes::MessagePtr serializeAsProto() const override;
+  absl::optional<std::string> serializeAsString() const override;
+
+private:
+  TimeSource &time_source_;
+  std::chrono::nanoseconds wall_{};
+  std::chrono::nanoseconds cpu_{};
+  // the number of scopes of the time that are open.
+  uint32_t open_scopes_{};
+};
+
+} // namespace Http
+} // namespace Envoy
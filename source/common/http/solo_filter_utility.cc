@@ -1,5 +1,7 @@
 #include "source/common/http/solo_filter_utility.h"
 
+#include "absl/strings/numbers.h"
+
 namespace Envoy {
 namespace Http {
 
@@ -24,5 +26,13 @@ SoloFilterUtility::resolveClusterName(StreamFilterCallbacks *filter_callbacks) {
   return &route_entry->clusterName();
 }
 
+bool SoloFilterUtility::contentLengthExceeds(
+    const RequestOrResponseHeaderMap &headers, uint64_t buffer_limit) {
+  uint64_t content_length;
+  return buffer_limit != 0 &&
+         absl::SimpleAtoi(headers.getContentLengthValue(), &content_length) &&
+         content_length > buffer_limit;
+}
+
 } // namespace Http
 } // namespace Envoy
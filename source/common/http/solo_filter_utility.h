@@ -37,6 +37,17 @@ public:
   static const std::string *
   resolveClusterName(StreamFilterCallbacks *filter_callbacks);
 
+  /**
+   * Whether the body announced by the content-length of the headers is
+   * larger than a buffer limit, so that it can be rejected before any of it
+   * is buffered.
+   * @param headers supplies the headers of the request or response.
+   * @param buffer_limit supplies the buffer limit, 0 standing for none.
+   * @return true if the content-length is set and exceeds the limit.
+   */
+  static bool contentLengthExceeds(const RequestOrResponseHeaderMap &headers,
+                                   uint64_t buffer_limit);
+
   template <class ConfigType>
   static std::shared_ptr<const ConfigType>
   resolveProtocolOptions(const std::string &filter_name,
@@ -0,0 +1,131 @@
+#include "source/common/matcher/matcher_index.h"
+
+#include <algorithm>
+
+#include "source/common/http/utility.h"
+
+namespace Envoy {
+namespace Matcher {
+
+void MatcherIndex::add(MatcherConstPtr matcher) {
+  const size_t position = matchers_.size();
+  Matcher::PathRequirement requirement = matcher->pathRequirement();
+  matchers_.push_back(std::move(matcher));
+
+  switch (requirement.type_) {
+  case Matcher::PathRequirement::Type::Prefix: {
+    const size_t length = requirement.value_.size();
+    auto it = std::lower_bound(prefix_lengths_.begin(), prefix_lengths_.end(),
+                               length);
+    if (it == prefix_lengths_.end() || *it != length) {
+      prefix_lengths_.insert(it, length);
+    }
+    prefixes_[std::move(requirement.value_)].push_back(position);
+    break;
+  }
+  case Matcher::PathRequirement::Type::Exact:
+    exact_paths_[std::move(requirement.value_)].push_back(position);
+    break;
+  case Matcher::PathRequirement::Type::Regex:
+    regexes_.push_back(std::move(requirement.value_));
+    regex_positions_.push_back(position);
+    break;
+  case Matcher::PathRequirement::Type::None:
+    unindexed_.push_back(position);
+    break;
+  }
+}
+
+void MatcherIndex::build() {
+  regex_set_.reset();
+  regex_set_size_ = 0;
+  if (regexes_.empty()) {
+    return;
+  }
+  // the same options as the google_re2 matchers, which match the whole path.
+  auto regex_set = std::make_unique<re2::RE2::Set>(re2::RE2::Quiet,
+                                                   re2::RE2::ANCHOR_BOTH);
+  for (const std::string &regex : regexes_) {
+    if (regex_set->Add(regex, nullptr) < 0) {
+      // the regexes stay evaluated one by one.
+      return;
+    }
+  }
+  if (!regex_set->Compile()) {
+    return;
+  }
+  regex_set_ = std::move(regex_set);
+  regex_set_size_ = regexes_.size();
+}
+
+absl::optional<size_t>
+MatcherIndex::findFirst(const Http::RequestHeaderMap &headers) const {
+  LazyQueryParams query_params(headers);
+  if (headers.Path() == nullptr) {
+    // nothing to look up, so evaluate every matcher.
+    for (size_t i = 0; i < matchers_.size(); i++) {
+      if (matchers_[i]->matches(headers, query_params)) {
+        return i;
+      }
+    }
+    return absl::nullopt;
+  }
+
+  const Http::HeaderString &path_header = headers.Path()->value();
+  const absl::string_view path = path_header.getStringView();
+  absl::InlinedVector<size_t, 16> candidates(unindexed_.begin(),
+                                             unindexed_.end());
+  for (size_t length : prefix_lengths_) {
+    if (length > path.size()) {
+      break;
+    }
+    auto it = prefixes_.find(path.substr(0, length));
+    if (it != prefixes_.end()) {
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+  }
+  if (!exact_paths_.empty() || !regexes_.empty()) {
+    const absl::string_view query_string =
+        Http::Utility::findQueryStringStart(path_header);
+    const absl::string_view path_without_query =
+        path.substr(0, path.size() - query_string.size());
+    auto it = exact_paths_.find(path_without_query);
+    if (it != exact_paths_.end()) {
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    }
+    addRegexCandidates(path_without_query, candidates);
+  }
+
+  // first match wins, so evaluate the candidates in the order they were added.
+  std::sort(candidates.begin(), candidates.end());
+  for (size_t candidate : candidates) {
+    if (matchers_[candidate]->matches(headers, query_params)) {
+      return candidate;
+    }
+  }
+  return absl::nullopt;
+}
+
+void MatcherIndex::addRegexCandidates(
+    absl::string_view path, absl::InlinedVector<size_t, 16> &candidates) const {
+  size_t first_unset = 0;
+  if (regex_set_ != nullptr) {
+    std::vector<int> matched;
+    re2::RE2::Set::ErrorInfo error_info;
+    const bool any = regex_set_->Match(
+        re2::StringPiece(path.data(), path.size()), &matched, &error_info);
+    // the set fails when it runs out of memory, and its matchers are then
+    // evaluated one by one.
+    if (any || error_info.kind == re2::RE2::Set::kNoError) {
+      for (int index : matched) {
+        candidates.push_back(regex_positions_[index]);
+      }
+      first_unset = regex_set_size_;
+    }
+  }
+  candidates.insert(candidates.end(), regex_positions_.begin() + first_unset,
+                    regex_positions_.end());
+}
+
+} // namespace Matcher
+} // namespace Envoy
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/http/header_map.h"
+
+#include "source/common/matcher/solo_matcher.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "re2/set.h"
+
+namespace Envoy {
+namespace Matcher {
+
+/**
+ * An ordered list of matchers, indexed on their path requirements. Finding the
+ * first matcher that matches a request only evaluates the matchers whose
+ * prefix or exact path can match, along with the matchers that can't be
+ * indexed, in the order they were added. The regexes of the regex matchers
+ * are looked up together once build() compiled them into a single set.
+ */
+class MatcherIndex {
+public:
+  /**
+   * Adds a matcher after the ones already added.
+   */
+  void add(MatcherConstPtr matcher);
+
+  /**
+   * Compiles the regexes of the matchers added so far into a set, which finds
+   * the ones the path matches in a single pass. The regexes of the matchers
+   * added afterwards are evaluated one by one, until the next build().
+   */
+  void build();
+
+  /**
+   * @param headers the request headers to match.
+   * @return the position of the first matcher that matches the request.
+   */
+  absl::optional<size_t> findFirst(const Http::RequestHeaderMap &headers) const;
+
+  size_t size() const { return matchers_.size(); }
+
+private:
+  // adds the positions of the regex matchers the path can match.
+  void addRegexCandidates(absl::string_view path,
+                          absl::InlinedVector<size_t, 16> &candidates) const;
+
+  std::vector<MatcherConstPtr> matchers_;
+  // the positions of the prefix matchers, by prefix. The prefixes are looked
+  // up by length, so that a lookup costs one hash per distinct length.
+  absl::flat_hash_map<std::string, std::vector<size_t>> prefixes_;
+  std::vector<size_t> prefix_lengths_;
+  absl::flat_hash_map<std::string, std::vector<size_t>> exact_paths_;
+  // the regexes, and the positions of their matchers. The first
+  // regex_set_size_ of them are in regex_set_, in the same order.
+  std::vector<std::string> regexes_;
+  std::vector<size_t> regex_positions_;
+  std::unique_ptr<re2::RE2::Set> regex_set_;
+  size_t regex_set_size_{};
+  // matchers that can't be indexed, and are always evaluated.
+  std::vector<size_t> unindexed_;
+};
+
+} // namespace Matcher
+} // namespace Envoy
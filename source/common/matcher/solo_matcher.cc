@@ -32,16 +32,14 @@ public:
   }
 
   // Check match for HeaderMatcher and QueryParameterMatcher
-  bool matchRoute(const Http::RequestHeaderMap &headers) const {
+  bool matchRoute(const Http::RequestHeaderMap &headers,
+                  LazyQueryParams &query_params) const {
     bool matches = true;
     // TODO(potatop): matching on RouteMatch runtime is not implemented.
 
     matches &= Http::HeaderUtility::matchHeaders(headers, config_headers_);
     if (!config_query_parameters_.empty()) {
-      Http::Utility::QueryParams query_parameters =
-          Http::Utility::parseQueryString(
-              headers.Path()->value().getStringView());
-      matches &= ConfigUtility::matchQueryParams(query_parameters,
+      matches &= ConfigUtility::matchQueryParams(query_params.get(),
                                                  config_query_parameters_);
     }
     return matches;
@@ -64,8 +62,9 @@ public:
   PrefixMatcherImpl(const ::RouteMatch &match)
       : BaseMatcherImpl(match), prefix_(match.prefix()) {}
 
-  bool matches(const Http::RequestHeaderMap &headers) const override {
-    if (BaseMatcherImpl::matchRoute(headers) &&
+  bool matches(const Http::RequestHeaderMap &headers,
+               LazyQueryParams &query_params) const override {
+    if (BaseMatcherImpl::matchRoute(headers, query_params) &&
         (case_sensitive_
              ? absl::StartsWith(headers.Path()->value().getStringView(),
                                 prefix_)
@@ -77,6 +76,13 @@ public:
     return false;
   }
 
+  PathRequirement pathRequirement() const override {
+    if (!case_sensitive_) {
+      return {};
+    }
+    return {PathRequirement::Type::Prefix, prefix_};
+  }
+
 private:
   // prefix string
   const std::string prefix_;
@@ -90,8 +96,9 @@ public:
   PathMatcherImpl(const ::RouteMatch &match)
       : BaseMatcherImpl(match), path_(match.path()) {}
 
-  bool matches(const Http::RequestHeaderMap &headers) const override {
-    if (BaseMatcherImpl::matchRoute(headers)) {
+  bool matches(const Http::RequestHeaderMap &headers,
+               LazyQueryParams &query_params) const override {
+    if (BaseMatcherImpl::matchRoute(headers, query_params)) {
       const Http::HeaderString &path = headers.Path()->value();
       const size_t compare_length =
           path.getStringView().length() -
@@ -107,6 +114,13 @@ public:
     return false;
   }
 
+  PathRequirement pathRequirement() const override {
+    if (!case_sensitive_) {
+      return {};
+    }
+    return {PathRequirement::Type::Exact, path_};
+  }
+
 private:
   // path string.
   const std::string path_;
@@ -124,8 +138,9 @@ public:
     regex_str_ = match.safe_regex().regex();
   }
 
-  bool matches(const Http::RequestHeaderMap &headers) const override {
-    if (BaseMatcherImpl::matchRoute(headers)) {
+  bool matches(const Http::RequestHeaderMap &headers,
+               LazyQueryParams &query_params) const override {
+    if (BaseMatcherImpl::matchRoute(headers, query_params)) {
       const Http::HeaderString &path = headers.Path()->value();
       const absl::string_view query_string =
           Http::Utility::findQueryStringStart(path);
@@ -139,6 +154,10 @@ public:
     return false;
   }
 
+  PathRequirement pathRequirement() const override {
+    return {PathRequirement::Type::Regex, regex_str_};
+  }
+
 private:
 
 static Regex::CompiledMatcherPtr parseStdRegexAsCompiledMatcher(const std::string& regex,
@@ -3,12 +3,38 @@
 #include "envoy/config/route/v3/route.pb.h"
 #include "envoy/http/header_map.h"
 
+#include "source/common/http/utility.h"
+
+#include "absl/types/optional.h"
+
 namespace Envoy {
 namespace Matcher {
 
 class Matcher;
 using MatcherConstPtr = std::shared_ptr<const Matcher>;
 
+/**
+ * The query parameters of a request, parsed on first use so that matchers
+ * evaluated against the same request share one parse.
+ */
+class LazyQueryParams {
+public:
+  explicit LazyQueryParams(const Http::RequestHeaderMap &headers)
+      : headers_(headers) {}
+
+  const Http::Utility::QueryParams &get() {
+    if (!query_params_.has_value()) {
+      query_params_.emplace(Http::Utility::parseQueryString(
+          headers_.Path()->value().getStringView()));
+    }
+    return query_params_.value();
+  }
+
+private:
+  const Http::RequestHeaderMap &headers_;
+  absl::optional<Http::Utility::QueryParams> query_params_;
+};
+
 /**
  * Supports matching a HTTP requests with JWT requirements.
  */
@@ -23,7 +49,44 @@ public:
    * should be used if there are none headers available.
    * @return  true if request is a match, false otherwise.
    */
-  virtual bool matches(const Http::RequestHeaderMap &headers) const PURE;
+  bool matches(const Http::RequestHeaderMap &headers) const {
+    LazyQueryParams query_params(headers);
+    return matches(headers, query_params);
+  }
+
+  /**
+   * Same as above, for evaluating several matchers against the same request.
+   *
+   * @param query_params the query parameters of the request.
+   */
+  virtual bool matches(const Http::RequestHeaderMap &headers,
+                       LazyQueryParams &query_params) const PURE;
+
+  /**
+   * The path requirement of a matcher, which lets a MatcherIndex skip matchers
+   * whose path can't match without evaluating them.
+   */
+  struct PathRequirement {
+    enum class Type {
+      // the path requirement can't be indexed.
+      None,
+      // the path, including the query string, starts with value_.
+      Prefix,
+      // the path, without the query string, is value_.
+      Exact,
+      // the path, without the query string, fully matches the RE2 regex
+      // value_.
+      Regex,
+    };
+    Type type_{Type::None};
+    std::string value_;
+  };
+
+  /**
+   * @return the case sensitive path requirement the request must meet to
+   * match, in addition to the other requirements.
+   */
+  virtual PathRequirement pathRequirement() const { return {}; }
 
   /**
    * Factory method to create a shared instance of a matcher based on the rule
@@ -0,0 +1,62 @@
+#include "source/common/nats/circuit_breakers.h"
+
+namespace Envoy {
+namespace Nats {
+
+CircuitBreakers::CircuitBreakers(
+    Tcp::ConnPoolNats::Instance<Message> &conn_pool)
+    : conn_pool_(conn_pool) {}
+
+CircuitBreakers::~CircuitBreakers() { update(0, 0); }
+
+bool CircuitBreakers::admit(bool queued) {
+  const Upstream::ClusterInfoConstSharedPtr cluster =
+      cluster_ != nullptr ? cluster_ : conn_pool_.clusterInfo();
+  // the pool drops the requests to a cluster that was removed.
+  if (cluster == nullptr) {
+    return true;
+  }
+  Upstream::ResourceManager &resources =
+      cluster->resourceManager(Upstream::ResourcePriority::Default);
+  if ((queued && !resources.pendingRequests().canCreate()) ||
+      !resources.requests().canCreate()) {
+    cluster->stats().upstream_rq_pending_overflow_.inc();
+    return false;
+  }
+  return true;
+}
+
+void CircuitBreakers::update(uint64_t pending, uint64_t requests) {
+  if (cluster_ == nullptr) {
+    if (pending == 0 && requests == 0) {
+      return;
+    }
+    cluster_ = conn_pool_.clusterInfo();
+    if (cluster_ == nullptr) {
+      return;
+    }
+  }
+  Upstream::ResourceManager &resources =
+      cluster_->resourceManager(Upstream::ResourcePriority::Default);
+  adjust(resources.pendingRequests(), pending_, pending);
+  adjust(resources.requests(), requests_, requests);
+  if (pending_ == 0 && requests_ == 0) {
+    cluster_.reset();
+  }
+}
+
+void CircuitBreakers::adjust(Upstream::Resource &resource, uint64_t &from,
+                             uint64_t to) {
+  // the counts change by one request at a time, but for the queue that is
+  // published at once.
+  for (; from < to; ++from) {
+    resource.inc();
+  }
+  if (from > to) {
+    resource.decBy(from - to);
+    from = to;
+  }
+}
+
+} // namespace Nats
+} // namespace Envoy
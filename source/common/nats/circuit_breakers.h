@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include "envoy/upstream/upstream.h"
+
+#include "include/envoy/nats/codec.h"
+#include "include/envoy/tcp/conn_pool_nats.h"
+
+namespace Envoy {
+namespace Nats {
+
+/**
+ * Counts the requests of a client against the circuit breakers of the cluster
+ * of its pool, which the clients of all the workers share. The requests
+ * queued until the connection is ready are pending, and the ones waiting to
+ * be written or acked are counted as requests too, so that max_pending_requests
+ * bounds the queue while the cluster is unreachable and max_requests bounds
+ * all of them.
+ */
+class CircuitBreakers {
+public:
+  explicit CircuitBreakers(Tcp::ConnPoolNats::Instance<Message> &conn_pool);
+  ~CircuitBreakers();
+
+  /**
+   * @param queued whether the request waits for the connection.
+   * @return whether the request fits under the thresholds. A request that
+   * doesn't is counted as an overflow of the cluster.
+   */
+  bool admit(bool queued);
+
+  /**
+   * Brings the counts of the cluster in line with those of the client.
+   */
+  void update(uint64_t pending, uint64_t requests);
+
+private:
+  static void adjust(Upstream::Resource &resource, uint64_t &from,
+                     uint64_t to);
+
+  Tcp::ConnPoolNats::Instance<Message> &conn_pool_;
+  // the cluster the counts were taken on, which a cluster update replaces in
+  // the pool, so that they are released on the same one.
+  Upstream::ClusterInfoConstSharedPtr cluster_;
+  uint64_t pending_{};
+  uint64_t requests_{};
+};
+
+} // namespace Nats
+} // namespace Envoy
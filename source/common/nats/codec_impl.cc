@@ -1,10 +1,50 @@
 #include "source/common/nats/codec_impl.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "include/envoy/nats/codec.h"
 
+#include "source/common/buffer/buffer_impl.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+
 namespace Envoy {
 namespace Nats {
 
+namespace {
+
+// the operations are case insensitive, and told apart by their length first.
+Message::Type typeOf(absl::string_view operation) {
+  switch (operation.size()) {
+  case 3:
+    if (absl::EqualsIgnoreCase(operation, "MSG")) {
+      return Message::Type::Msg;
+    }
+    return absl::EqualsIgnoreCase(operation, "+OK") ? Message::Type::Ok
+                                                    : Message::Type::Other;
+  case 4:
+    if (absl::EqualsIgnoreCase(operation, "PING")) {
+      return Message::Type::Ping;
+    }
+    if (absl::EqualsIgnoreCase(operation, "PONG")) {
+      return Message::Type::Pong;
+    }
+    if (absl::EqualsIgnoreCase(operation, "INFO")) {
+      return Message::Type::Info;
+    }
+    if (absl::EqualsIgnoreCase(operation, "-ERR")) {
+      return Message::Type::Err;
+    }
+    return Message::Type::Other;
+  default:
+    return Message::Type::Other;
+  }
+}
+
+} // namespace
+
 std::string Message::toString() const {
   return fmt::format("\"{}\"", asString());
 }
@@ -13,68 +53,153 @@ std::string &Message::asString() { return string_; }
 
 const std::string &Message::asString() const { return string_; }
 
-void DecoderImpl::decode(Buffer::Instance &data) {
-  for (const Buffer::RawSlice &slice : data.getRawSlices()) {
-    parseSlice(slice);
-  }
+absl::string_view Message::operation() const {
+  return tokens_.empty() ? absl::string_view() : token(0);
+}
 
-  data.drain(data.length());
+size_t Message::argumentCount() const {
+  return tokens_.empty() ? 0 : tokens_.size() - 1;
 }
 
-void DecoderImpl::parseSlice(const Buffer::RawSlice &slice) {
-  const char *buffer = reinterpret_cast<const char *>(slice.mem_);
-  uint64_t remaining = slice.len_;
+absl::string_view Message::argument(size_t index) const {
+  return token(index + 1);
+}
 
-  while (remaining || state_ == State::ValueComplete) {
-    ENVOY_LOG(trace, "parse slice: {} remaining", remaining);
-    switch (state_) {
-    case State::ValueRootStart: {
-      ENVOY_LOG(trace, "parse slice: ValueRootStart");
-      pending_value_root_.reset(new Message());
-      state_ = State::SimpleString;
+absl::string_view Message::token(size_t index) const {
+  const auto &token = tokens_[index];
+  return absl::string_view(string_).substr(token.first, token.second);
+}
+
+void Message::tokenize() {
+  tokens_.clear();
+  const size_t length = string_.size();
+  size_t pos = 0;
+  while (true) {
+    pos = string_.find_first_not_of(" \t", pos);
+    if (pos == std::string::npos) {
       break;
     }
+    size_t end = string_.find_first_of(" \t", pos);
+    if (end == std::string::npos) {
+      end = length;
+    }
+    tokens_.emplace_back(pos, end - pos);
+    pos = end;
+  }
+  type_ = typeOf(operation());
+}
 
-    case State::SimpleString: {
-      ENVOY_LOG(trace, "parse slice: SimpleString: {}", buffer[0]);
-      if (buffer[0] == '\r') {
-        state_ = State::LF;
-      } else {
-        pending_value_root_->asString().push_back(buffer[0]);
-      }
+void DecoderImpl::decode(Buffer::Instance &data) {
+  while (data.length() != 0) {
+    if (pending_value_root_ == nullptr) {
+      pending_value_root_ = std::make_unique<Message>();
+    }
 
-      remaining--;
-      buffer++;
+    switch (state_) {
+    case State::SimpleString:
+      parseLine(data);
       break;
-    }
 
-    case State::LF: {
-      ENVOY_LOG(trace, "parse slice: LF");
-      if (buffer[0] != '\n') {
-        // TODO(talnordan): Consider gracefully ignoring this error.
-        throw ProtocolError("expected new line");
-      }
+    case State::LF:
+      consume(data, '\n');
+      onLine();
+      break;
 
-      remaining--;
-      buffer++;
-      state_ = State::ValueComplete;
+    case State::Payload: {
+      const uint64_t length = std::min(payload_remaining_, data.length());
+      pending_value_root_->payload()->move(data, length);
+      payload_remaining_ -= length;
+      if (payload_remaining_ == 0) {
+        state_ = State::PayloadCR;
+      }
       break;
     }
 
-    case State::ValueComplete: {
-      ENVOY_LOG(trace, "parse slice: ValueComplete");
-      callbacks_.onValue(std::move(pending_value_root_));
-      state_ = State::ValueRootStart;
-
+    case State::PayloadCR:
+      consume(data, '\r');
+      state_ = State::LF;
       break;
     }
-    }
   }
 }
 
+void DecoderImpl::parseLine(Buffer::Instance &data) {
+  // the line up to its CR, if it is in the first slice, is appended at once.
+  const Buffer::RawSlice slice = data.frontSlice();
+  const char *begin = static_cast<const char *>(slice.mem_);
+  const char *cr = static_cast<const char *>(memchr(begin, '\r', slice.len_));
+  if (cr == nullptr) {
+    pending_value_root_->asString().append(begin, slice.len_);
+    data.drain(slice.len_);
+    return;
+  }
+  pending_value_root_->asString().append(begin, cr - begin);
+  data.drain(cr - begin + 1);
+  state_ = State::LF;
+}
+
+void DecoderImpl::onLine() {
+  Message &value = *pending_value_root_;
+  if (value.payload() != nullptr) {
+    // the CRLF that ends the payload.
+    completeValue();
+    return;
+  }
+
+  value.tokenize();
+  if (value.type() != Message::Type::Msg) {
+    completeValue();
+    return;
+  }
+  // MSG <subject> <sid> [reply-to] <#bytes>
+  const size_t arguments = value.argumentCount();
+  if ((arguments != 3 && arguments != 4) ||
+      !absl::SimpleAtoi(value.argument(arguments - 1), &payload_remaining_)) {
+    throw ProtocolError("invalid MSG");
+  }
+  if (payload_remaining_ > MaxPayloadBytes) {
+    throw ProtocolError("MSG payload too large");
+  }
+  value.setPayload(std::make_shared<Buffer::OwnedImpl>());
+  state_ = payload_remaining_ == 0 ? State::PayloadCR : State::Payload;
+}
+
+void DecoderImpl::consume(Buffer::Instance &data, char expected) {
+  if (data.peekInt<char>() != expected) {
+    // TODO(talnordan): Consider gracefully ignoring this error.
+    throw ProtocolError(expected == '\n' ? "expected new line"
+                                          : "expected carriage return");
+  }
+  data.drain(1);
+}
+
+void DecoderImpl::completeValue() {
+  ENVOY_LOG(trace, "decoded a value of {} bytes",
+            pending_value_root_->asString().size());
+  state_ = State::SimpleString;
+  callbacks_.onValue(std::move(pending_value_root_));
+}
+
 void EncoderImpl::encode(const Message &value, Buffer::Instance &out) {
   out.add(value.asString());
   out.add("\r\n", 2);
+
+  const std::shared_ptr<Buffer::Instance> &payload = value.sharedPayload();
+  if (payload == nullptr) {
+    return;
+  }
+  // the slices of the payload are referenced rather than copied, and the
+  // fragments keep the payload alive until they are written.
+  for (const Buffer::RawSlice &slice : payload->getRawSlices()) {
+    auto *fragment = new Buffer::BufferFragmentImpl(
+        slice.mem_, slice.len_,
+        [payload](const void *, size_t,
+                  const Buffer::BufferFragmentImpl *fragment) {
+          delete fragment;
+        });
+    out.addBufferFragment(*fragment);
+  }
+  out.add("\r\n", 2);
 }
 
 } // namespace Nats
@@ -17,7 +17,9 @@ using Tcp::Encoder;
  * https://nats.io/documentation/internals/nats-protocol/
  *
  * This implementation buffers when needed and will always consume all bytes
- * passed for decoding.
+ * passed for decoding. The operation line of a MSG and its payload are
+ * decoded as a single message, whose payload is moved out of the input
+ * rather than copied.
  */
 class DecoderImpl : public Decoder, Logger::Loggable<Logger::Id::tracing> {
 public:
@@ -26,14 +28,27 @@ public:
   // Tcp::Decoder
   void decode(Buffer::Instance &data) override;
 
+  // the largest max_payload a NATS server can be configured with. A MSG that
+  // announces a larger payload is a protocol error rather than something to
+  // buffer.
+  static constexpr uint64_t MaxPayloadBytes = 64 * 1024 * 1024;
+
 private:
-  enum class State { ValueRootStart, SimpleString, LF, ValueComplete };
+  // a line or a payload that is split across decodes is kept in
+  // pending_value_root_. LF is the state once the CR of a line was
+  // consumed, and PayloadCR once the payload was.
+  enum class State { SimpleString, LF, Payload, PayloadCR };
 
-  void parseSlice(const Buffer::RawSlice &slice);
+  void parseLine(Buffer::Instance &data);
+  void onLine();
+  void consume(Buffer::Instance &data, char expected);
+  void completeValue();
 
   DecoderCallbacks<Message> &callbacks_;
-  State state_{State::ValueRootStart};
+  State state_{State::SimpleString};
   MessagePtr pending_value_root_;
+  // the bytes of the payload of the pending MSG that are yet to arrive.
+  uint64_t payload_remaining_{};
 };
 
 /**
@@ -0,0 +1,170 @@
+#include "source/common/nats/core/client_impl.h"
+
+#include "source/common/nats/message_builder.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+namespace {
+constexpr uint64_t ReconnectBaseIntervalMs = 100;
+constexpr uint64_t ReconnectMaxIntervalMs = 10000;
+} // namespace
+
+ClientImpl::ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+                       Random::RandomGenerator &random,
+                       Event::Dispatcher &dispatcher,
+                       const std::string &hash_key)
+    : conn_pool_(std::move(conn_pool)), circuit_breakers_(*conn_pool_),
+      dispatcher_(dispatcher), hash_key_(hash_key),
+      reconnect_backoff_(std::make_unique<JitteredExponentialBackOffStrategy>(
+          ReconnectBaseIntervalMs, ReconnectMaxIntervalMs, random)) {}
+
+PublishRequestPtr ClientImpl::makeRequest(const std::string &subject,
+                                          const std::string &,
+                                          const std::string &,
+                                          Buffer::InstancePtr &&payload,
+                                          PublishCallbacks &callbacks) {
+  if (above_write_buffer_high_watermark_) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+  // the requests made while connecting are queued, and count as pending.
+  if (!circuit_breakers_.admit(state_ != State::Connected)) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+
+  const uint64_t sequence = next_sequence_++;
+  switch (state_) {
+  case State::NotConnected:
+    pending_requests_.emplace(
+        sequence, PendingRequest{subject, std::move(payload), &callbacks});
+    connect();
+    break;
+  case State::Connecting:
+  case State::WaitingToReconnect:
+    pending_requests_.emplace(
+        sequence, PendingRequest{subject, std::move(payload), &callbacks});
+    break;
+  case State::Connected:
+    // a request made while the pending ones are published waits for them.
+    pending_requests_.emplace(
+        sequence, PendingRequest{subject, std::move(payload), &callbacks});
+    if (pending_requests_.size() == 1) {
+      publishPendingRequests();
+    }
+    break;
+  }
+  updateCircuitBreakers();
+
+  // the handle is returned even when the publish was written right away, as
+  // no handle means that it overflowed.
+  return std::make_unique<PublishRequestCanceler>(*this, sequence);
+}
+
+void ClientImpl::connect() {
+  if (state_ != State::NotConnected) {
+    return;
+  }
+  conn_pool_->setPoolCallbacks(*this);
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void ClientImpl::onResponse(Nats::MessagePtr &&value) {
+  ENVOY_LOG(trace, "on response: value is\n[{}]", value->asString());
+
+  switch (value->type()) {
+  case Message::Type::Ping:
+    sendNatsMessage(MessageBuilder::pongMessage());
+    break;
+  case Message::Type::Info:
+    onInfo();
+    break;
+  case Message::Type::Ok:
+    ENVOY_LOG(error, "on response: op is [{}], not throwing",
+              value->operation());
+    break;
+  default:
+    ENVOY_LOG(error, "on response: op is [{}], throwing", value->operation());
+    throw ProtocolError("invalid message");
+  }
+  updateCircuitBreakers();
+}
+
+void ClientImpl::onClose() {
+  // the publishes that were written may or may not have reached the server,
+  // which core NATS doesn't tell. The pending ones are published once
+  // reconnected.
+  above_write_buffer_high_watermark_ = false;
+  state_ = State::WaitingToReconnect;
+
+  if (reconnect_timer_ == nullptr) {
+    reconnect_timer_ = dispatcher_.createTimer([this]() { reconnect(); });
+  }
+  reconnect_timer_->enableTimer(
+      std::chrono::milliseconds(reconnect_backoff_->nextBackOffMs()));
+}
+
+void ClientImpl::onAboveWriteBufferHighWatermark() {
+  above_write_buffer_high_watermark_ = true;
+}
+
+void ClientImpl::onBelowWriteBufferLowWatermark() {
+  above_write_buffer_high_watermark_ = false;
+}
+
+void ClientImpl::cancel(uint64_t sequence) {
+  pending_requests_.erase(sequence);
+  updateCircuitBreakers();
+}
+
+ClientImpl::PublishRequestCanceler::PublishRequestCanceler(ClientImpl &parent,
+                                                           uint64_t sequence)
+    : parent_(parent), sequence_(sequence) {}
+
+void ClientImpl::PublishRequestCanceler::cancel() { parent_.cancel(sequence_); }
+
+void ClientImpl::onInfo() {
+  // the server sends INFO again when the cluster changes.
+  if (state_ != State::Connecting) {
+    return;
+  }
+  state_ = State::Connected;
+  reconnect_backoff_->reset();
+  publishPendingRequests();
+}
+
+void ClientImpl::reconnect() {
+  ENVOY_LOG(debug, "reconnecting with {} pending requests",
+            pending_requests_.size());
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void ClientImpl::publishPendingRequests() {
+  // a publish succeeds once written. Its callbacks may make new requests, which
+  // are published after the pending ones, or cancel pending ones.
+  while (state_ == State::Connected && !pending_requests_.empty()) {
+    auto it = pending_requests_.begin();
+    PublishCallbacks &callbacks = *it->second.callbacks;
+    sendNatsMessage(MessageBuilder::createPubMessage(
+        it->second.subject, std::move(it->second.payload)));
+    pending_requests_.erase(it);
+    callbacks.onResponse();
+  }
+}
+
+void ClientImpl::updateCircuitBreakers() {
+  // a publish is done once written, so the pending ones are all there is.
+  circuit_breakers_.update(pending_requests_.size(), pending_requests_.size());
+}
+
+void ClientImpl::sendNatsMessage(const Message &message) {
+  conn_pool_->makeRequest(hash_key_, message);
+}
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
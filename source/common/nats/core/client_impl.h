@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "envoy/common/random_generator.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "include/envoy/nats/codec.h"
+#include "include/envoy/nats/streaming/client.h"
+#include "include/envoy/tcp/conn_pool_nats.h"
+
+#include "source/common/common/backoff_strategy.h"
+#include "source/common/common/logger.h"
+#include "source/common/nats/circuit_breakers.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+using Streaming::PublishCallbacks;
+using Streaming::PublishRequest;
+using Streaming::PublishRequestPtr;
+
+/**
+ * A core NATS client, which publishes with a plain PUB and no reply subject,
+ * for subjects that need no persistence. There is no session to open, no inbox
+ * to subscribe to and no ack: a publish succeeds once it is written to the
+ * connection, and the requests made while connecting are published in their
+ * order once the server's INFO arrives.
+ */
+class ClientImpl : public Streaming::PooledClient,
+                   public Tcp::ConnPoolNats::PoolCallbacks<Message>,
+                   public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
+public:
+  ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+             Random::RandomGenerator &random, Event::Dispatcher &dispatcher,
+             const std::string &hash_key);
+
+  // Nats::Streaming::Client
+  PublishRequestPtr makeRequest(const std::string &subject,
+                                const std::string &cluster_id,
+                                const std::string &discover_prefix,
+                                Buffer::InstancePtr &&payload,
+                                PublishCallbacks &callbacks) override;
+
+  // Nats::Streaming::PooledClient
+  size_t outstandingRequests() const override {
+    return pending_requests_.size();
+  }
+  bool aboveWriteBufferHighWatermark() const override {
+    return above_write_buffer_high_watermark_;
+  }
+  void connect() override;
+
+  // Tcp::ConnPoolNats::PoolCallbacks
+  void onResponse(Nats::MessagePtr &&value) override;
+  void onClose() override;
+  void onAboveWriteBufferHighWatermark() override;
+  void onBelowWriteBufferLowWatermark() override;
+
+  void cancel(uint64_t sequence);
+
+private:
+  enum class State { NotConnected, Connecting, Connected, WaitingToReconnect };
+
+  struct PendingRequest {
+    std::string subject;
+    Buffer::InstancePtr payload;
+    PublishCallbacks *callbacks;
+  };
+
+  // the handle of a publish, which is of no use once it was written.
+  class PublishRequestCanceler : public PublishRequest {
+  public:
+    PublishRequestCanceler(ClientImpl &parent, uint64_t sequence);
+
+    // Nats::Streaming::PublishRequest
+    void cancel() override;
+
+  private:
+    ClientImpl &parent_;
+    const uint64_t sequence_;
+  };
+
+  void onInfo();
+  void reconnect();
+  void publishPendingRequests();
+  void updateCircuitBreakers();
+  void sendNatsMessage(const Message &message);
+
+  Tcp::ConnPoolNats::InstancePtr<Message> conn_pool_;
+  CircuitBreakers circuit_breakers_;
+  Event::Dispatcher &dispatcher_;
+  // the key the connection pool chooses the host of the client by.
+  const std::string hash_key_;
+  State state_{};
+  uint64_t next_sequence_{1};
+  std::map<uint64_t, PendingRequest> pending_requests_;
+  bool above_write_buffer_high_watermark_{};
+  BackOffStrategyPtr reconnect_backoff_;
+  Event::TimerPtr reconnect_timer_;
+};
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
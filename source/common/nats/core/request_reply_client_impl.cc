@@ -0,0 +1,233 @@
+#include "source/common/nats/core/request_reply_client_impl.h"
+
+#include "source/common/nats/message_builder.h"
+#include "source/common/nats/subject_utility.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+const std::string RequestReplyClientImpl::INBOX_PREFIX{"_INBOX"};
+
+namespace {
+constexpr uint64_t ReconnectBaseIntervalMs = 100;
+constexpr uint64_t ReconnectMaxIntervalMs = 10000;
+} // namespace
+
+RequestReplyClientImpl::RequestReplyClientImpl(
+    Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+    Random::RandomGenerator &random, Event::Dispatcher &dispatcher,
+    const std::chrono::milliseconds &op_timeout, const std::string &hash_key)
+    : conn_pool_(std::move(conn_pool)), circuit_breakers_(*conn_pool_),
+      token_generator_(random), dispatcher_(dispatcher), hash_key_(hash_key),
+      inbox_(SubjectUtility::randomChild(INBOX_PREFIX, token_generator_)),
+      timeouts_(dispatcher, dispatcher.timeSource(), op_timeout,
+                [this](uint64_t sequence) { onTimeout(sequence); }),
+      reconnect_backoff_(std::make_unique<JitteredExponentialBackOffStrategy>(
+          ReconnectBaseIntervalMs, ReconnectMaxIntervalMs, random)) {}
+
+PublishRequestPtr RequestReplyClientImpl::makeRequest(
+    const std::string &subject, const std::string &, const std::string &,
+    Buffer::InstancePtr &&payload, PublishCallbacks &callbacks) {
+  if (above_write_buffer_high_watermark_) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+  // the requests made while connecting are queued, and count as pending.
+  if (!circuit_breakers_.admit(state_ != State::Connected)) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+
+  const uint64_t sequence = next_sequence_++;
+  pending_requests_.emplace(
+      sequence, PendingRequest{subject, std::move(payload), &callbacks});
+
+  switch (state_) {
+  case State::NotConnected:
+    connect();
+    break;
+  case State::Connecting:
+  case State::WaitingToReconnect:
+    break;
+  case State::Connected:
+    publishPendingRequests();
+    break;
+  }
+  updateCircuitBreakers();
+
+  return std::make_unique<PublishRequestCanceler>(*this, sequence);
+}
+
+void RequestReplyClientImpl::connect() {
+  if (state_ != State::NotConnected) {
+    return;
+  }
+  conn_pool_->setPoolCallbacks(*this);
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void RequestReplyClientImpl::onResponse(Nats::MessagePtr &&value) {
+  ENVOY_LOG(trace, "on response: value is\n[{}]", value->asString());
+
+  switch (value->type()) {
+  case Message::Type::Msg:
+    onMsg(*value);
+    break;
+  case Message::Type::Ping:
+    sendNatsMessage(MessageBuilder::pongMessage());
+    break;
+  case Message::Type::Info:
+    onInfo();
+    break;
+  case Message::Type::Ok:
+    ENVOY_LOG(error, "on response: op is [{}], not throwing",
+              value->operation());
+    break;
+  default:
+    ENVOY_LOG(error, "on response: op is [{}], throwing", value->operation());
+    throw ProtocolError("invalid message");
+  }
+  updateCircuitBreakers();
+}
+
+void RequestReplyClientImpl::onClose() {
+  above_write_buffer_high_watermark_ = false;
+  state_ = State::WaitingToReconnect;
+
+  // the replies of the published requests would come back on the
+  // subscription of the connection, and fail right away. The pending ones are
+  // published once reconnected.
+  absl::flat_hash_map<uint64_t, PublishCallbacks *> in_flight;
+  in_flight.swap(in_flight_requests_);
+  for (auto &it : in_flight) {
+    it.second->onFailure();
+  }
+  updateCircuitBreakers();
+
+  if (reconnect_timer_ == nullptr) {
+    reconnect_timer_ = dispatcher_.createTimer([this]() { reconnect(); });
+  }
+  reconnect_timer_->enableTimer(
+      std::chrono::milliseconds(reconnect_backoff_->nextBackOffMs()));
+}
+
+void RequestReplyClientImpl::onAboveWriteBufferHighWatermark() {
+  above_write_buffer_high_watermark_ = true;
+}
+
+void RequestReplyClientImpl::onBelowWriteBufferLowWatermark() {
+  above_write_buffer_high_watermark_ = false;
+}
+
+void RequestReplyClientImpl::cancel(uint64_t sequence) {
+  // the reply of a canceled request finds nothing.
+  if (pending_requests_.erase(sequence) == 0) {
+    in_flight_requests_.erase(sequence);
+  }
+  updateCircuitBreakers();
+}
+
+RequestReplyClientImpl::PublishRequestCanceler::PublishRequestCanceler(
+    RequestReplyClientImpl &parent, uint64_t sequence)
+    : parent_(parent), sequence_(sequence) {}
+
+void RequestReplyClientImpl::PublishRequestCanceler::cancel() {
+  parent_.cancel(sequence_);
+}
+
+void RequestReplyClientImpl::onInfo() {
+  // the server sends INFO again when the cluster changes.
+  if (state_ != State::Connecting) {
+    return;
+  }
+  // a single subscription gets the replies of all the requests.
+  sendNatsMessage(MessageBuilder::createSubMessage(
+      SubjectUtility::childWildcard(inbox_), 1));
+  state_ = State::Connected;
+  reconnect_backoff_->reset();
+  publishPendingRequests();
+}
+
+void RequestReplyClientImpl::onMsg(Message &value) {
+  // only the first reply answers a request, the others finding nothing.
+  const absl::optional<uint64_t> sequence = replySequence(value.argument(0));
+  if (!sequence.has_value()) {
+    return;
+  }
+  auto it = in_flight_requests_.find(sequence.value());
+  if (it == in_flight_requests_.end()) {
+    return;
+  }
+  PublishCallbacks &callbacks = *it->second;
+  in_flight_requests_.erase(it);
+
+  // the slices the payload was read into are moved to the reply rather than
+  // copied.
+  auto reply = std::make_unique<Buffer::OwnedImpl>();
+  reply->move(*value.payload());
+  callbacks.onReply(std::move(reply));
+}
+
+void RequestReplyClientImpl::onTimeout(uint64_t sequence) {
+  // the timeout of a request that was answered or canceled first finds
+  // nothing.
+  auto it = in_flight_requests_.find(sequence);
+  if (it == in_flight_requests_.end()) {
+    return;
+  }
+  PublishCallbacks &callbacks = *it->second;
+  in_flight_requests_.erase(it);
+  updateCircuitBreakers();
+  callbacks.onTimeout();
+}
+
+void RequestReplyClientImpl::reconnect() {
+  ENVOY_LOG(debug, "reconnecting with {} pending requests",
+            pending_requests_.size());
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void RequestReplyClientImpl::publishPendingRequests() {
+  while (state_ == State::Connected && !pending_requests_.empty()) {
+    auto it = pending_requests_.begin();
+    const uint64_t sequence = it->first;
+    PendingRequest &pending_request = it->second;
+    in_flight_requests_.emplace(sequence, pending_request.callbacks);
+    timeouts_.add(sequence);
+    sendNatsMessage(MessageBuilder::createPubMessage(
+        pending_request.subject, inbox_, sequence,
+        std::move(pending_request.payload)));
+    pending_requests_.erase(it);
+  }
+}
+
+void RequestReplyClientImpl::updateCircuitBreakers() {
+  circuit_breakers_.update(pending_requests_.size(), outstandingRequests());
+}
+
+absl::optional<uint64_t>
+RequestReplyClientImpl::replySequence(absl::string_view subject) const {
+  if (subject.size() <= inbox_.size() || subject[inbox_.size()] != '.' ||
+      !absl::StartsWith(subject, inbox_)) {
+    return absl::nullopt;
+  }
+  uint64_t sequence;
+  if (!absl::SimpleAtoi(subject.substr(inbox_.size() + 1), &sequence)) {
+    return absl::nullopt;
+  }
+  return sequence;
+}
+
+void RequestReplyClientImpl::sendNatsMessage(const Message &message) {
+  conn_pool_->makeRequest(hash_key_, message);
+}
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "envoy/common/random_generator.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "include/envoy/nats/codec.h"
+#include "include/envoy/nats/streaming/client.h"
+#include "include/envoy/tcp/conn_pool_nats.h"
+
+#include "source/common/common/backoff_strategy.h"
+#include "source/common/common/logger.h"
+#include "source/common/nats/circuit_breakers.h"
+#include "source/common/nats/streaming/timeout_queue.h"
+#include "source/common/nats/token_generator_impl.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+using Streaming::PublishCallbacks;
+using Streaming::PublishRequest;
+using Streaming::PublishRequestPtr;
+
+/**
+ * A core NATS request/reply client, which publishes each request with a reply
+ * subject and answers it with the first reply that comes back on it. The reply
+ * subject of a request is the child of the inbox of the client named by its
+ * sequence number, and the client subscribes to all of them at once when it
+ * connects, so that a request costs no SUB or UNSUB of its own.
+ *
+ * The requests made while connecting are published in their order once the
+ * server's INFO arrives. A request that gets no reply within the op timeout,
+ * e.g. as no one subscribes to its subject, times out.
+ */
+class RequestReplyClientImpl
+    : public Streaming::PooledClient,
+      public Tcp::ConnPoolNats::PoolCallbacks<Message>,
+      public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
+public:
+  RequestReplyClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+                         Random::RandomGenerator &random,
+                         Event::Dispatcher &dispatcher,
+                         const std::chrono::milliseconds &op_timeout,
+                         const std::string &hash_key);
+
+  // Nats::Streaming::Client
+  PublishRequestPtr makeRequest(const std::string &subject,
+                                const std::string &cluster_id,
+                                const std::string &discover_prefix,
+                                Buffer::InstancePtr &&payload,
+                                PublishCallbacks &callbacks) override;
+
+  // Nats::Streaming::PooledClient
+  size_t outstandingRequests() const override {
+    return pending_requests_.size() + in_flight_requests_.size();
+  }
+  bool aboveWriteBufferHighWatermark() const override {
+    return above_write_buffer_high_watermark_;
+  }
+  void connect() override;
+
+  // Tcp::ConnPoolNats::PoolCallbacks
+  void onResponse(Nats::MessagePtr &&value) override;
+  void onClose() override;
+  void onAboveWriteBufferHighWatermark() override;
+  void onBelowWriteBufferLowWatermark() override;
+
+  void cancel(uint64_t sequence);
+
+private:
+  enum class State { NotConnected, Connecting, Connected, WaitingToReconnect };
+
+  struct PendingRequest {
+    std::string subject;
+    Buffer::InstancePtr payload;
+    PublishCallbacks *callbacks;
+  };
+
+  class PublishRequestCanceler : public PublishRequest {
+  public:
+    PublishRequestCanceler(RequestReplyClientImpl &parent, uint64_t sequence);
+
+    // Nats::Streaming::PublishRequest
+    void cancel() override;
+
+  private:
+    RequestReplyClientImpl &parent_;
+    const uint64_t sequence_;
+  };
+
+  void onInfo();
+  void onMsg(Message &value);
+  void onTimeout(uint64_t sequence);
+  void reconnect();
+  void publishPendingRequests();
+  void updateCircuitBreakers();
+
+  // the sequence number of the request the reply subject names, if any.
+  absl::optional<uint64_t> replySequence(absl::string_view subject) const;
+
+  void sendNatsMessage(const Message &message);
+
+  Tcp::ConnPoolNats::InstancePtr<Message> conn_pool_;
+  CircuitBreakers circuit_breakers_;
+  TokenGeneratorImpl token_generator_;
+  Event::Dispatcher &dispatcher_;
+  // the key the connection pool chooses the host of the client by.
+  const std::string hash_key_;
+  const std::string inbox_;
+  State state_{};
+  uint64_t next_sequence_{1};
+  std::map<uint64_t, PendingRequest> pending_requests_;
+  // the requests that were published and wait for their reply.
+  absl::flat_hash_map<uint64_t, PublishCallbacks *> in_flight_requests_;
+  Streaming::TimeoutQueue timeouts_;
+  bool above_write_buffer_high_watermark_{};
+  BackOffStrategyPtr reconnect_backoff_;
+  Event::TimerPtr reconnect_timer_;
+
+  static const std::string INBOX_PREFIX;
+};
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
@@ -0,0 +1,252 @@
+#include "source/common/nats/jetstream/client_impl.h"
+
+#include "source/common/nats/message_builder.h"
+#include "source/common/nats/subject_utility.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+
+namespace Envoy {
+namespace Nats {
+namespace JetStream {
+
+const std::string ClientImpl::INBOX_PREFIX{"_INBOX"};
+
+namespace {
+constexpr uint64_t ReconnectBaseIntervalMs = 100;
+constexpr uint64_t ReconnectMaxIntervalMs = 10000;
+} // namespace
+
+ClientImpl::ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+                       Random::RandomGenerator &random,
+                       Event::Dispatcher &dispatcher,
+                       const std::chrono::milliseconds &op_timeout,
+                       uint32_t max_pending_acks, const std::string &hash_key)
+    : conn_pool_(std::move(conn_pool)), circuit_breakers_(*conn_pool_),
+      token_generator_(random), dispatcher_(dispatcher),
+      max_pending_acks_(max_pending_acks), hash_key_(hash_key),
+      inbox_(SubjectUtility::randomChild(INBOX_PREFIX, token_generator_)),
+      timeouts_(dispatcher, dispatcher.timeSource(), op_timeout,
+                [this](uint64_t sequence) { onTimeout(sequence); }),
+      reconnect_backoff_(std::make_unique<JitteredExponentialBackOffStrategy>(
+          ReconnectBaseIntervalMs, ReconnectMaxIntervalMs, random)) {}
+
+PublishRequestPtr ClientImpl::makeRequest(const std::string &subject,
+                                          const std::string &,
+                                          const std::string &,
+                                          Buffer::InstancePtr &&payload,
+                                          PublishCallbacks &callbacks) {
+  if (above_write_buffer_high_watermark_) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+  // the requests beyond the window are queued too, and count as pending.
+  if (!circuit_breakers_.admit(state_ != State::Connected ||
+                               in_flight_requests_.size() >=
+                                   max_pending_acks_)) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+
+  const uint64_t sequence = next_sequence_++;
+  pending_requests_.emplace(
+      sequence, PendingRequest{subject, std::move(payload), &callbacks});
+
+  switch (state_) {
+  case State::NotConnected:
+    connect();
+    break;
+  case State::Connecting:
+  case State::WaitingToReconnect:
+    break;
+  case State::Connected:
+    publishPendingRequests();
+    break;
+  }
+  updateCircuitBreakers();
+
+  return std::make_unique<PublishRequestCanceler>(*this, sequence);
+}
+
+void ClientImpl::connect() {
+  if (state_ != State::NotConnected) {
+    return;
+  }
+  conn_pool_->setPoolCallbacks(*this);
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void ClientImpl::onResponse(Nats::MessagePtr &&value) {
+  ENVOY_LOG(trace, "on response: value is\n[{}]", value->asString());
+
+  // the acks come first, and the control messages are answered without
+  // building a message.
+  switch (value->type()) {
+  case Message::Type::Msg:
+    onMsg(*value);
+    break;
+  case Message::Type::Ping:
+    sendNatsMessage(MessageBuilder::pongMessage());
+    break;
+  case Message::Type::Info:
+    onInfo();
+    break;
+  case Message::Type::Ok:
+    ENVOY_LOG(error, "on response: op is [{}], not throwing",
+              value->operation());
+    break;
+  default:
+    ENVOY_LOG(error, "on response: op is [{}], throwing", value->operation());
+    throw ProtocolError("invalid message");
+  }
+  updateCircuitBreakers();
+}
+
+void ClientImpl::onClose() {
+  above_write_buffer_high_watermark_ = false;
+  state_ = State::WaitingToReconnect;
+
+  // the publishes that were written may or may not have reached the server,
+  // and fail right away. The pending ones are published once reconnected.
+  absl::flat_hash_map<uint64_t, PublishCallbacks *> in_flight;
+  in_flight.swap(in_flight_requests_);
+  for (auto &it : in_flight) {
+    it.second->onFailure();
+  }
+  updateCircuitBreakers();
+
+  if (reconnect_timer_ == nullptr) {
+    reconnect_timer_ = dispatcher_.createTimer([this]() { reconnect(); });
+  }
+  reconnect_timer_->enableTimer(
+      std::chrono::milliseconds(reconnect_backoff_->nextBackOffMs()));
+}
+
+void ClientImpl::onAboveWriteBufferHighWatermark() {
+  above_write_buffer_high_watermark_ = true;
+}
+
+void ClientImpl::onBelowWriteBufferLowWatermark() {
+  above_write_buffer_high_watermark_ = false;
+}
+
+void ClientImpl::cancel(uint64_t sequence) {
+  if (pending_requests_.erase(sequence) == 0 &&
+      in_flight_requests_.erase(sequence) != 0) {
+    // the ack of a canceled publish is ignored, and doesn't hold the window.
+    publishPendingRequests();
+  }
+  updateCircuitBreakers();
+}
+
+ClientImpl::PublishRequestCanceler::PublishRequestCanceler(ClientImpl &parent,
+                                                           uint64_t sequence)
+    : parent_(parent), sequence_(sequence) {}
+
+void ClientImpl::PublishRequestCanceler::cancel() { parent_.cancel(sequence_); }
+
+void ClientImpl::onInfo() {
+  // the server sends INFO again when the cluster changes.
+  if (state_ != State::Connecting) {
+    return;
+  }
+  sendNatsMessage(MessageBuilder::createSubMessage(
+      SubjectUtility::childWildcard(inbox_), 1));
+  state_ = State::Connected;
+  reconnect_backoff_->reset();
+  publishPendingRequests();
+}
+
+void ClientImpl::onMsg(const Message &value) {
+  const absl::optional<uint64_t> ack_sequence =
+      replySequence(value.argument(0));
+  if (!ack_sequence.has_value()) {
+    return;
+  }
+  Buffer::Instance &payload_buffer = *value.payload();
+  const uint64_t length = payload_buffer.length();
+  onAck(ack_sequence.value(),
+        absl::string_view(
+            static_cast<const char *>(payload_buffer.linearize(length)),
+            length));
+}
+
+void ClientImpl::onAck(uint64_t sequence, absl::string_view payload) {
+  auto it = in_flight_requests_.find(sequence);
+  if (it == in_flight_requests_.end()) {
+    return;
+  }
+  PublishCallbacks &callbacks = *it->second;
+  in_flight_requests_.erase(it);
+  publishPendingRequests();
+
+  // the ack is {"stream":...,"seq":...}, or {"error":{...}} when the stream
+  // rejected the publish, which tells them apart without parsing the JSON.
+  if (absl::StrContains(payload, "\"error\"")) {
+    ENVOY_LOG(debug, "on ack: error is\n[{}]", payload);
+    callbacks.onFailure();
+  } else {
+    callbacks.onResponse();
+  }
+}
+
+void ClientImpl::onTimeout(uint64_t sequence) {
+  // the timeout of a publish that was acked or canceled first finds nothing.
+  auto it = in_flight_requests_.find(sequence);
+  if (it == in_flight_requests_.end()) {
+    return;
+  }
+  PublishCallbacks &callbacks = *it->second;
+  in_flight_requests_.erase(it);
+  publishPendingRequests();
+  updateCircuitBreakers();
+  callbacks.onTimeout();
+}
+
+void ClientImpl::reconnect() {
+  ENVOY_LOG(debug, "reconnecting with {} pending requests",
+            pending_requests_.size());
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void ClientImpl::publishPendingRequests() {
+  while (state_ == State::Connected && !pending_requests_.empty() &&
+         in_flight_requests_.size() < max_pending_acks_) {
+    auto it = pending_requests_.begin();
+    const uint64_t sequence = it->first;
+    PendingRequest &pending_request = it->second;
+    in_flight_requests_.emplace(sequence, pending_request.callbacks);
+    timeouts_.add(sequence);
+    sendNatsMessage(MessageBuilder::createPubMessage(
+        pending_request.subject, inbox_, sequence,
+        std::move(pending_request.payload)));
+    pending_requests_.erase(it);
+  }
+}
+
+void ClientImpl::updateCircuitBreakers() {
+  circuit_breakers_.update(pending_requests_.size(), outstandingRequests());
+}
+
+absl::optional<uint64_t>
+ClientImpl::replySequence(absl::string_view subject) const {
+  if (subject.size() <= inbox_.size() || subject[inbox_.size()] != '.' ||
+      !absl::StartsWith(subject, inbox_)) {
+    return absl::nullopt;
+  }
+  uint64_t sequence;
+  if (!absl::SimpleAtoi(subject.substr(inbox_.size() + 1), &sequence)) {
+    return absl::nullopt;
+  }
+  return sequence;
+}
+
+void ClientImpl::sendNatsMessage(const Message &message) {
+  conn_pool_->makeRequest(hash_key_, message);
+}
+
+} // namespace JetStream
+} // namespace Nats
+} // namespace Envoy
@@ -1,6 +1,9 @@
 #include "source/common/nats/message_builder.h"
 
-#include <sstream>
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/macros.h"
+
+#include "absl/strings/str_cat.h"
 
 namespace Envoy {
 namespace Nats {
@@ -11,31 +14,65 @@ Message MessageBuilder::createConnectMessage() {
 }
 
 Message MessageBuilder::createPubMessage(const std::string &subject) {
-  std::stringstream ss;
-  ss << "PUB " << subject << " 0\r\n";
-  return Message(ss.str());
+  return Message(absl::StrCat("PUB ", subject, " 0\r\n"));
+}
+
+Message MessageBuilder::createPubMessage(const std::string &subject,
+                                         Buffer::InstancePtr &&payload) {
+  Message message(absl::StrCat("PUB ", subject, " ", payload->length()));
+  message.setPayload(std::move(payload));
+  return message;
+}
+
+Message MessageBuilder::createPubMessage(const std::string &subject,
+                                         const std::string &reply_to,
+                                         std::string payload) {
+  // the payload is handed over to the buffer, which frees it once it is
+  // written.
+  auto payload_buffer = std::make_unique<Buffer::OwnedImpl>();
+  if (!payload.empty()) {
+    auto *owned = new std::string(std::move(payload));
+    auto *fragment = new Buffer::BufferFragmentImpl(
+        owned->data(), owned->size(),
+        [owned](const void *, size_t,
+                const Buffer::BufferFragmentImpl *fragment) {
+          delete owned;
+          delete fragment;
+        });
+    payload_buffer->addBufferFragment(*fragment);
+  }
+  return createPubMessage(subject, reply_to, std::move(payload_buffer));
 }
 
 Message MessageBuilder::createPubMessage(const std::string &subject,
                                          const std::string &reply_to,
-                                         const std::string &payload) {
-  // TODO(talnordan): Consider introducing a more explicit way to construct and
-  // encode messages consisting of two lines.
-  std::stringstream ss;
-  ss << "PUB " << subject << " " << reply_to << " " << payload.length()
-     << "\r\n"
-     << payload;
-  return Message(ss.str());
+                                         Buffer::InstancePtr &&payload) {
+  Message message(
+      absl::StrCat("PUB ", subject, " ", reply_to, " ", payload->length()));
+  message.setPayload(std::move(payload));
+  return message;
+}
+
+Message MessageBuilder::createPubMessage(absl::string_view subject,
+                                         absl::string_view reply_to_inbox,
+                                         uint64_t reply_to_child,
+                                         Buffer::InstancePtr &&payload) {
+  Message message(absl::StrCat("PUB ", subject, " ", reply_to_inbox, ".",
+                               reply_to_child, " ", payload->length()));
+  message.setPayload(std::move(payload));
+  return message;
 }
 
 Message MessageBuilder::createSubMessage(const std::string &subject,
                                          uint64_t sid) {
-  std::stringstream ss;
-  ss << "SUB " << subject << " " << sid;
-  return Message(ss.str());
+  return Message(absl::StrCat("SUB ", subject, " ", sid));
 }
 
 Message MessageBuilder::createPongMessage() { return Message("PONG"); }
 
+const Message &MessageBuilder::pongMessage() {
+  CONSTRUCT_ON_FIRST_USE(Message, createPongMessage());
+}
+
 } // namespace Nats
 } // namespace Envoy
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include "include/envoy/nats/codec.h"
 
+#include "absl/strings/string_view.h"
+
 namespace Envoy {
 namespace Nats {
 
@@ -11,11 +14,26 @@ class MessageBuilder {
 public:
   static Message createConnectMessage();
   static Message createPubMessage(const std::string &subject);
+  // a publish with no reply subject.
+  static Message createPubMessage(const std::string &subject,
+                                  Buffer::InstancePtr &&payload);
+  // the payload is moved into the message rather than copied.
+  static Message createPubMessage(const std::string &subject,
+                                  const std::string &reply_to,
+                                  std::string payload);
   static Message createPubMessage(const std::string &subject,
                                   const std::string &reply_to,
-                                  const std::string &payload);
+                                  Buffer::InstancePtr &&payload);
+  // the reply subject is the child of the inbox named by the number, which is
+  // written with the rest of the operation rather than as a string of its own.
+  static Message createPubMessage(absl::string_view subject,
+                                  absl::string_view reply_to_inbox,
+                                  uint64_t reply_to_child,
+                                  Buffer::InstancePtr &&payload);
   static Message createSubMessage(const std::string &subject, uint64_t sid);
   static Message createPongMessage();
+  // the PONG every PING is answered with, which is built once.
+  static const Message &pongMessage();
 };
 
 } // namespace Nats
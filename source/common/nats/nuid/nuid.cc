@@ -4,6 +4,23 @@ namespace Envoy {
 namespace Nats {
 namespace Nuid {
 
+namespace {
+
+// the two base 62 digits of each number below BASE * BASE.
+struct DigitPairs {
+  constexpr DigitPairs() : pairs_() {
+    for (uint32_t i = 0; i < Nuid::BASE * Nuid::BASE; ++i) {
+      pairs_[2 * i] = Nuid::DIGITS[i / Nuid::BASE];
+      pairs_[2 * i + 1] = Nuid::DIGITS[i % Nuid::BASE];
+    }
+  }
+  char pairs_[2 * Nuid::BASE * Nuid::BASE];
+};
+
+constexpr DigitPairs DIGIT_PAIRS;
+
+} // namespace
+
 constexpr const char Nuid::DIGITS[];
 constexpr uint8_t Nuid::BASE;
 constexpr uint8_t Nuid::PRE_LEN;
@@ -29,6 +46,12 @@ Nuid::Nuid(Random::RandomGenerator &random_generator, uint64_t seq)
 }
 
 std::string Nuid::next() {
+  std::string result(TOTAL_LEN, '\0');
+  next(&result[0]);
+  return result;
+}
+
+void Nuid::next(char *output) {
   // Increment and capture.
   seq_ += inc_;
   if (seq_ >= MAX_SEQ) {
@@ -36,24 +59,12 @@ std::string Nuid::next() {
     resetSequential();
   }
 
-  // Convert the sequential into base62.
-  char seq_str[SEQ_LEN];
-  convert<SEQ_LEN>(seq_, seq_str);
-
-  // Instantiate a string.
-  std::string result;
-  result.reserve(TOTAL_LEN);
-
-  // Copy prefix.
-  result.append(pre_, PRE_LEN);
-
-  // Copy sequential in base62.
-  result.append(seq_str, SEQ_LEN);
-
-  return result;
+  // Convert the sequential into base62, after the prefix.
+  convert<SEQ_LEN>(seq_, buf_ + PRE_LEN);
+  memcpy(output, buf_, TOTAL_LEN);
 }
 
-std::string Nuid::pre() { return std::string(pre_, PRE_LEN); }
+std::string Nuid::pre() { return std::string(buf_, PRE_LEN); }
 
 uint64_t Nuid::int63_n(int64_t n) { return random_generator_.random() % n; }
 
@@ -63,18 +74,23 @@ void Nuid::resetSequential() {
 }
 
 void Nuid::randomizePrefix() {
-  convert<SEQ_LEN>(int63_n(MAX_SEQ), pre_);
+  convert<SEQ_LEN>(int63_n(MAX_SEQ), buf_);
 
   // BASE ^ (PRE_LEN - SEQ_LEN) == 62 ^ (12 - 10) == 62 ^ 2
   constexpr uint64_t max = BASE * BASE;
 
-  convert<PRE_LEN - SEQ_LEN>(int63_n(max), pre_ + SEQ_LEN);
+  convert<PRE_LEN - SEQ_LEN>(int63_n(max), buf_ + SEQ_LEN);
 }
 
 template <uint8_t len> void Nuid::convert(uint64_t n, char *output) {
   static_assert(len <= 10, "Output length should not exceed 10 characters");
-  for (uint64_t i = 1; i <= len; ++i, n /= BASE) {
-    output[len - i] = DIGITS[n % BASE];
+  constexpr uint32_t pair_base = BASE * BASE;
+  uint8_t i = len;
+  for (; i >= 2; i -= 2, n /= pair_base) {
+    memcpy(output + i - 2, DIGIT_PAIRS.pairs_ + 2 * (n % pair_base), 2);
+  }
+  if (i == 1) {
+    output[0] = DIGITS[n % BASE];
   }
 }
 
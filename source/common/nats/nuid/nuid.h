@@ -53,6 +53,12 @@ public:
    */
   std::string next();
 
+  /**
+   * Write the next NUID to the TOTAL_LEN characters of the output, with no
+   * allocation.
+   */
+  void next(char *output);
+
   std::string pre();
 
 private:
@@ -73,10 +79,15 @@ private:
    */
   inline void randomizePrefix();
 
+  /**
+   * Convert n to len base 62 digits, two digits at a time.
+   */
   template <uint8_t len> inline void convert(uint64_t n, char *output);
 
   Random::RandomGenerator &random_generator_;
-  char pre_[PRE_LEN];
+  // the prefix, followed by the sequential of the last NUID, so that the next
+  // one is copied out at once.
+  char buf_[TOTAL_LEN];
   uint64_t seq_;
   uint64_t inc_;
 };
@@ -8,6 +8,10 @@
 #include "source/common/common/utility.h"
 #include "source/common/nats/message_builder.h"
 
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
@@ -17,12 +21,27 @@ using Buffer::BufferUtility;
 const std::string ClientImpl::INBOX_PREFIX{"_INBOX"};
 const std::string ClientImpl::PUB_ACK_PREFIX{"_STAN.acks"};
 
-ClientImpl::ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool_,
+namespace {
+constexpr uint64_t ReconnectBaseIntervalMs = 100;
+constexpr uint64_t ReconnectMaxIntervalMs = 10000;
+
+// the size of the message on the wire: its operation line and its payload,
+// each followed by CRLF.
+uint64_t wireLength(const Message &message) {
+  const Buffer::Instance *payload = message.payload();
+  return message.asString().size() + 2 +
+         (payload == nullptr ? 0 : payload->length() + 2);
+}
+} // namespace
+
+ClientImpl::ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
                        Random::RandomGenerator &random,
                        Event::Dispatcher &dispatcher,
-                       const std::chrono::milliseconds &op_timeout)
-    : conn_pool_(std::move(conn_pool_)), token_generator_(random),
-      dispatcher_(dispatcher), op_timeout_(op_timeout),
+                       const std::chrono::milliseconds &op_timeout,
+                       const ClientStats &stats, const std::string &hash_key)
+    : conn_pool_(std::move(conn_pool)), circuit_breakers_(*conn_pool_),
+      token_generator_(random), dispatcher_(dispatcher), stats_(stats),
+      hash_key_(hash_key),
       heartbeat_inbox_(
           SubjectUtility::randomChild(INBOX_PREFIX, token_generator_)),
       root_inbox_(SubjectUtility::randomChild(INBOX_PREFIX, token_generator_)),
@@ -30,56 +49,129 @@ ClientImpl::ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool_,
           SubjectUtility::randomChild(PUB_ACK_PREFIX, token_generator_)),
       connect_response_inbox_(
           SubjectUtility::randomChild(root_inbox_, token_generator_)),
-      client_id_(token_generator_.random()), sid_(1) {}
+      client_id_(token_generator_.random()),
+      pub_request_timeouts_(
+          dispatcher, dispatcher.timeSource(), op_timeout,
+          [this](uint64_t pub_ack_inbox) { onTimeout(pub_ack_inbox); }),
+      sid_(1),
+      reconnect_backoff_(std::make_unique<JitteredExponentialBackOffStrategy>(
+          ReconnectBaseIntervalMs, ReconnectMaxIntervalMs, random)) {}
+
+ClientImpl::~ClientImpl() {
+  stats_.publish_in_flight_.sub(reported_in_flight_);
+  stats_.publish_pending_.sub(reported_pending_);
+}
+
+ClientStats ClientImpl::generateStats(const std::string &cluster_name,
+                                      Stats::Scope &scope) {
+  const std::string prefix =
+      absl::StrCat("cluster.", cluster_name, ".nats_streaming.");
+  return {ALL_NATS_STREAMING_CLIENT_STATS(
+      POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix),
+      POOL_HISTOGRAM_PREFIX(scope, prefix))};
+}
 
 PublishRequestPtr ClientImpl::makeRequest(const std::string &subject,
                                           const std::string &cluster_id,
                                           const std::string &discover_prefix,
-                                          std::string &&payload,
+                                          Buffer::InstancePtr &&payload,
                                           PublishCallbacks &callbacks) {
-  // TODO(talnordan): For a possible performance improvement, consider replacing
-  // the random child token with a counter.
-  std::string pub_ack_inbox{
-      SubjectUtility::randomChild(root_pub_ack_inbox_, token_generator_)};
+  // the data of the requests piles up in the connection's buffer, so new ones
+  // are rejected until the connection catches up.
+  if (above_write_buffer_high_watermark_) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
+  // the requests made while connecting are queued, and count as pending.
+  if (!circuit_breakers_.admit(state_ != State::Connected)) {
+    callbacks.onOverflow();
+    return nullptr;
+  }
 
-  switch (state_) {
-  case State::NotConnected:
-    enqueuePendingRequest(subject, payload, callbacks, pub_ack_inbox);
+  const uint64_t pub_ack_inbox = next_pub_ack_inbox_++;
+
+  // the first request names the cluster the session is opened with.
+  if (!cluster_id_.has_value()) {
     cluster_id_.emplace(cluster_id);
     discover_prefix_.emplace(discover_prefix);
-    conn_pool_->setPoolCallbacks(*this);
-    sendNatsMessage(MessageBuilder::createConnectMessage());
-    state_ = State::Connecting;
+  }
+
+  switch (state_) {
+  case State::NotConnected:
+    enqueuePendingRequest(subject, std::move(payload), callbacks,
+                          pub_ack_inbox);
+    connect();
     break;
   case State::Connecting:
-    enqueuePendingRequest(subject, payload, callbacks, pub_ack_inbox);
+  case State::WaitingToReconnect:
+    enqueuePendingRequest(subject, std::move(payload), callbacks,
+                          pub_ack_inbox);
+    break;
+  case State::WaitingForSession:
+    enqueuePendingRequest(subject, std::move(payload), callbacks,
+                          pub_ack_inbox);
+    pubConnectRequest();
+    state_ = State::Connecting;
     break;
   case State::Connected:
-    pubPubMsg(subject, payload, callbacks, pub_ack_inbox);
+    pubPubMsg(subject, *payload, callbacks, pub_ack_inbox);
     break;
   }
 
+  updateGauges();
+
   PublishRequestPtr request_ptr(
-      new PublishRequestCanceler(*this, std::move(pub_ack_inbox)));
+      new PublishRequestCanceler(*this, pub_ack_inbox));
   return request_ptr;
 }
 
+void ClientImpl::connect() {
+  if (state_ != State::NotConnected) {
+    return;
+  }
+  conn_pool_->setPoolCallbacks(*this);
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
 void ClientImpl::onResponse(Nats::MessagePtr &&value) {
   ENVOY_LOG(trace, "on response: value is\n[{}]", value->asString());
 
-  // Check whether a payload is expected prior to NATS operation extraction.
-  // TODO(talnordan): Eventually, we might want `onResponse()` to be passed a
-  // single decoded message consisting of both the `MSG` arguments and the
-  // payload.
-  if (isWaitingForPayload()) {
-    onPayload(std::move(value));
-  } else {
-    onOperation(std::move(value));
-  }
+  stats_.rx_bytes_.add(wireLength(*value));
+  onOperation(std::move(value));
+  updateGauges();
 }
 
 void ClientImpl::onClose() {
-  // TODO(talnordan)
+  above_write_buffer_high_watermark_ = false;
+  pub_prefix_.reset();
+  state_ = State::WaitingToReconnect;
+
+  // the publishes that were written may or may not have reached the server,
+  // and fail right away rather than once they time out. The ones that were
+  // not written yet are published once reconnected.
+  PubRequestMap in_flight;
+  in_flight.swap(pub_request_per_inbox_);
+  for (auto &it : in_flight) {
+    it.second.callbacks().onFailure();
+  }
+  updateGauges();
+
+  // the pool only opens a new connection once the closed one is released, so
+  // the client reconnects from a timer rather than right away.
+  if (reconnect_timer_ == nullptr) {
+    reconnect_timer_ = dispatcher_.createTimer([this]() { reconnect(); });
+  }
+  reconnect_timer_->enableTimer(
+      std::chrono::milliseconds(reconnect_backoff_->nextBackOffMs()));
+}
+
+void ClientImpl::onAboveWriteBufferHighWatermark() {
+  above_write_buffer_high_watermark_ = true;
+}
+
+void ClientImpl::onBelowWriteBufferLowWatermark() {
+  above_write_buffer_high_watermark_ = false;
 }
 
 void ClientImpl::onFailure(const std::string &error) {
@@ -94,32 +186,37 @@ void ClientImpl::onFailure(const std::string &error) {
 
 void ClientImpl::onConnected(const std::string &pub_prefix) {
   state_ = State::Connected;
+  reconnect_backoff_->reset();
 
   pub_prefix_.emplace(pub_prefix);
+  pub_subjects_.clear();
 
   for (auto it = pending_request_per_inbox_.begin();
        it != pending_request_per_inbox_.end(); ++it) {
     auto &&pub_ack_inbox = it->first;
     auto &&pending_request = it->second;
-    pubPubMsg(pending_request.subject, pending_request.payload,
+    pubPubMsg(pending_request.subject, *pending_request.payload,
               *pending_request.callbacks, pub_ack_inbox);
   }
   pending_request_per_inbox_.clear();
+  updateGauges();
 }
 
 void ClientImpl::send(const Message &message) { sendNatsMessage(message); }
 
-void ClientImpl::cancel(const std::string &pub_ack_inbox) {
+void ClientImpl::cancel(uint64_t pub_ack_inbox) {
+  stats_.publish_cancel_.inc();
   if (state_ == State::Connected) {
     PubRequestHandler::onCancel(pub_ack_inbox, pub_request_per_inbox_);
   } else {
     // Remove the pending request with the specified inbox, if such exists.
     pending_request_per_inbox_.erase(pub_ack_inbox);
   }
+  updateGauges();
 }
 
 ClientImpl::PublishRequestCanceler::PublishRequestCanceler(
-    ClientImpl &parent, std::string &&pub_ack_inbox)
+    ClientImpl &parent, uint64_t pub_ack_inbox)
     : parent_(parent), pub_ack_inbox_(pub_ack_inbox) {}
 
 void ClientImpl::PublishRequestCanceler::cancel() {
@@ -127,51 +224,30 @@ void ClientImpl::PublishRequestCanceler::cancel() {
 }
 
 void ClientImpl::onOperation(Nats::MessagePtr &&value) {
-  // TODO(talnordan): For better performance, a future decoder implementation
-  // might use zero allocation byte parsing. In such case, this function would
-  // need to switch over an `enum class` representing the message type. See:
-  // https://github.com/nats-io/go-nats/blob/master/parser.go
-  // https://youtu.be/ylRKac5kSOk?t=10m46s
-
-  auto delimiters = " \t";
-  auto keep_empty_string = false;
-  auto tokens =
-      StringUtil::splitToken(value->asString(), delimiters, keep_empty_string);
-
-  auto &&op = tokens[0];
-  if (absl::EqualsIgnoreCase(op, "INFO")) {
-    onInfo(std::move(value));
-  } else if (absl::EqualsIgnoreCase(op, "MSG")) {
-    onMsg(std::move(tokens));
-  } else if (absl::EqualsIgnoreCase(op, "PING")) {
+  // the decoder tokenized the operation line, which found its type, and read
+  // the payload of a MSG.
+  switch (value->type()) {
+  case Message::Type::Msg:
+    onMsg(*value);
+    break;
+  case Message::Type::Ping:
     onPing();
-  } else if (absl::EqualsIgnoreCase(op, "+OK")) {
-    ENVOY_LOG(error, "on operation: op is [{}], not throwing", op);
-  } else {
+    break;
+  case Message::Type::Info:
+    onInfo(std::move(value));
+    break;
+  case Message::Type::Ok:
+    ENVOY_LOG(error, "on operation: op is [{}], not throwing",
+              value->operation());
+    break;
+  default:
     // TODO(talnordan): Error handling.
     // TODO(talnordan): Increment error stats.
-    ENVOY_LOG(error, "on operation: op is [{}], throwing", op);
+    ENVOY_LOG(error, "on operation: op is [{}], throwing", value->operation());
     throw ProtocolError("invalid message");
   }
 }
 
-void ClientImpl::onPayload(Nats::MessagePtr &&value) {
-  std::string &subject = getSubjectWaitingForPayload();
-  absl::optional<std::string> &reply_to = getReplyToWaitingForPayload();
-  std::string &payload = value->asString();
-  if (subject == heartbeat_inbox_) {
-    HeartbeatHandler::onMessage(reply_to, payload, *this);
-  } else if (subject == connect_response_inbox_) {
-    ConnectResponseHandler::onMessage(reply_to, payload, *this);
-  } else {
-    PubRequestHandler::onMessage(subject, reply_to, payload, *this,
-                                 pub_request_per_inbox_);
-  }
-
-  // Mark that the payload has been received.
-  doneWaitingForPayload();
-}
-
 void ClientImpl::onInfo(Nats::MessagePtr &&value) {
   // TODO(talnordan): Process `INFO` options.
   UNREFERENCED_PARAMETER(value);
@@ -181,30 +257,83 @@ void ClientImpl::onInfo(Nats::MessagePtr &&value) {
   subHeartbeatInbox();
   subReplyInbox();
   subPubAckInbox();
+  // a client that connected ahead of the first request waits for it to name
+  // the cluster.
+  if (!cluster_id_.has_value()) {
+    state_ = State::WaitingForSession;
+    return;
+  }
   pubConnectRequest();
 }
 
-void ClientImpl::onMsg(std::vector<absl::string_view> &&tokens) {
-  auto num_tokens = tokens.size();
-  switch (num_tokens) {
-  case 4:
-    waitForPayload(std::string(tokens[1]), absl::optional<std::string>{});
-    break;
-  case 5:
-    waitForPayload(std::string(tokens[1]),
-                   absl::optional<std::string>(std::string(tokens[3])));
-    break;
-  default:
-    // TODO(talnordan): Error handling.
-    ENVOY_LOG(error, "on MSG: num_tokens is {}", num_tokens);
-    throw ProtocolError("invalid MSG");
+void ClientImpl::onMsg(const Message &value) {
+  // MSG <subject> <sid> [reply-to] <#bytes>, which the decoder checked.
+  const absl::string_view subject = value.argument(0);
+  absl::optional<std::string> reply_to;
+  if (value.argumentCount() == 4) {
+    reply_to.emplace(value.argument(2));
+  }
+  // the payload is parsed where it was read into, when it fits in a slice.
+  Buffer::Instance &payload_buffer = *value.payload();
+  const uint64_t length = payload_buffer.length();
+  const absl::string_view payload(
+      static_cast<const char *>(payload_buffer.linearize(length)), length);
+
+  if (subject == heartbeat_inbox_) {
+    HeartbeatHandler::onMessage(reply_to, payload, heartbeat_reply_, *this);
+  } else if (subject == connect_response_inbox_) {
+    ConnectResponseHandler::onMessage(reply_to, payload, *this);
+  } else {
+    // Gracefully ignore a message to an inbox of no request.
+    const absl::optional<uint64_t> pub_ack_inbox = pubAckInbox(subject);
+    if (pub_ack_inbox.has_value()) {
+      auto it = pub_request_per_inbox_.find(pub_ack_inbox.value());
+      if (it != pub_request_per_inbox_.end()) {
+        stats_.publish_ack_time_.recordValue(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                dispatcher_.timeSource().monotonicTime() -
+                it->second.sentAt())
+                .count());
+      }
+      PubRequestHandler::onMessage(pub_ack_inbox.value(), reply_to, payload,
+                                   *this, pub_request_per_inbox_);
+    }
   }
 }
 
 void ClientImpl::onPing() { pong(); }
 
-void ClientImpl::onTimeout(const std::string &pub_ack_inbox) {
+void ClientImpl::reconnect() {
+  ENVOY_LOG(debug, "reconnecting with {} pending requests",
+            pending_request_per_inbox_.size());
+  stats_.reconnect_.inc();
+  client_id_ = token_generator_.random();
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
+void ClientImpl::onTimeout(uint64_t pub_ack_inbox) {
+  // the timeout of a request that was acked or canceled first isn't counted.
+  if (pub_request_per_inbox_.contains(pub_ack_inbox)) {
+    stats_.publish_timeout_.inc();
+  }
   PubRequestHandler::onTimeout(pub_ack_inbox, pub_request_per_inbox_);
+  updateGauges();
+}
+
+absl::optional<uint64_t>
+ClientImpl::pubAckInbox(absl::string_view subject) const {
+  if (subject.size() <= root_pub_ack_inbox_.size() ||
+      subject[root_pub_ack_inbox_.size()] != '.' ||
+      !absl::StartsWith(subject, root_pub_ack_inbox_)) {
+    return absl::nullopt;
+  }
+  uint64_t pub_ack_inbox;
+  if (!absl::SimpleAtoi(subject.substr(root_pub_ack_inbox_.size() + 1),
+                        &pub_ack_inbox)) {
+    return absl::nullopt;
+  }
+  return pub_ack_inbox;
 }
 
 void ClientImpl::subInbox(const std::string &subject) {
@@ -229,66 +358,87 @@ void ClientImpl::pubConnectRequest() {
   const std::string subject{
       SubjectUtility::join(discover_prefix_.value(), cluster_id_.value())};
 
-  const std::string connect_request_message =
-      MessageUtility::createConnectRequestMessage(client_id_, heartbeat_inbox_);
+  Buffer::InstancePtr connect_request_message =
+      std::make_unique<Buffer::OwnedImpl>(
+          MessageUtility::createConnectRequestMessage(client_id_,
+                                                      heartbeat_inbox_));
 
   pubNatsStreamingMessage(subject, connect_response_inbox_,
-                          connect_request_message);
+                          std::move(connect_request_message));
 }
 
 void ClientImpl::enqueuePendingRequest(const std::string &subject,
-                                       const std::string &payload,
+                                       Buffer::InstancePtr &&payload,
                                        PublishCallbacks &callbacks,
-                                       const std::string &pub_ack_inbox) {
-  PendingRequest pending_request{subject, payload, &callbacks};
+                                       uint64_t pub_ack_inbox) {
+  PendingRequest pending_request{subject, std::move(payload), &callbacks};
   pending_request_per_inbox_.emplace(pub_ack_inbox, std::move(pending_request));
 }
 
 void ClientImpl::pubPubMsg(const std::string &subject,
-                           const std::string &payload,
+                           Buffer::Instance &payload,
                            PublishCallbacks &callbacks,
-                           const std::string &pub_ack_inbox) {
+                           uint64_t pub_ack_inbox) {
   // TODO(talnordan): Consider moving the following logic to
   // `PubRequestHandler`.
 
-  // TODO(talnordan): Consider making `PubRequest` use the RAII pattern, to make
-  // sure that the timer is disabled whenever a request is removed from the map,
-  // or if an exception is thrown. We might want the `PubRequest` isntance to
-  // keep being created on the stack even after such modififcation.
-  // TODO(talnordan): Can we create a timer on the stack rather than on the
-  // heap?
-  Event::TimerPtr timeout_timer = dispatcher_.createTimer(
-      [this, pub_ack_inbox]() -> void { onTimeout(pub_ack_inbox); });
-  timeout_timer->enableTimer(op_timeout_);
-  PubRequest pub_request(&callbacks, std::move(timeout_timer));
-  pub_request_per_inbox_.emplace(pub_ack_inbox, std::move(pub_request));
-
-  const std::string pub_subject{
-      SubjectUtility::join(pub_prefix_.value(), subject)};
+  // the timeout of a request that is acked or canceled first finds no request.
+  pub_request_per_inbox_.emplace(
+      pub_ack_inbox,
+      PubRequest(&callbacks, dispatcher_.timeSource().monotonicTime()));
+  pub_request_timeouts_.add(pub_ack_inbox);
 
   const std::string guid = token_generator_.random();
-  const std::string pub_msg_message =
+  Buffer::InstancePtr pub_msg_message =
       MessageUtility::createPubMsgMessage(client_id_, guid, subject, payload);
 
-  pubNatsStreamingMessage(pub_subject, pub_ack_inbox, pub_msg_message);
+  sendNatsMessage(MessageBuilder::createPubMessage(
+      pubSubject(subject), root_pub_ack_inbox_, pub_ack_inbox,
+      std::move(pub_msg_message)));
+}
+
+const std::string &ClientImpl::pubSubject(const std::string &subject) {
+  auto it = pub_subjects_.find(subject);
+  if (it == pub_subjects_.end()) {
+    it = pub_subjects_
+             .emplace(subject,
+                      SubjectUtility::join(pub_prefix_.value(), subject))
+             .first;
+  }
+  return it->second;
 }
 
 void ClientImpl::pong() {
-  sendNatsMessage(MessageBuilder::createPongMessage());
+  sendNatsMessage(MessageBuilder::pongMessage());
 }
 
-inline void ClientImpl::sendNatsMessage(const Message &message) {
-  // TODO(talnordan): Manage hash key computation.
-  const std::string hash_key;
+void ClientImpl::updateGauges() {
+  // the gauges are shared by the workers, and only touched when they change.
+  const uint64_t in_flight = pub_request_per_inbox_.size();
+  if (in_flight != reported_in_flight_) {
+    stats_.publish_in_flight_.add(in_flight);
+    stats_.publish_in_flight_.sub(reported_in_flight_);
+    reported_in_flight_ = in_flight;
+  }
+  const uint64_t pending = pending_request_per_inbox_.size();
+  if (pending != reported_pending_) {
+    stats_.publish_pending_.add(pending);
+    stats_.publish_pending_.sub(reported_pending_);
+    reported_pending_ = pending;
+  }
+  circuit_breakers_.update(pending, outstandingRequests());
+}
 
-  conn_pool_->makeRequest(hash_key, message);
+inline void ClientImpl::sendNatsMessage(const Message &message) {
+  stats_.tx_bytes_.add(wireLength(message));
+  conn_pool_->makeRequest(hash_key_, message);
 }
 
 inline void ClientImpl::pubNatsStreamingMessage(const std::string &subject,
                                                 const std::string &reply_to,
-                                                const std::string &message) {
+                                                Buffer::InstancePtr &&message) {
   const Message pubMessage =
-      MessageBuilder::createPubMessage(subject, reply_to, message);
+      MessageBuilder::createPubMessage(subject, reply_to, std::move(message));
   sendNatsMessage(pubMessage);
 }
 
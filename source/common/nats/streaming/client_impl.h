@@ -6,29 +6,57 @@
 #include "include/envoy/nats/codec.h"
 #include "include/envoy/nats/streaming/client.h"
 #include "envoy/runtime/runtime.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
 #include "include/envoy/tcp/conn_pool_nats.h"
 
+#include "source/common/common/backoff_strategy.h"
 #include "source/common/common/logger.h"
+#include "source/common/nats/circuit_breakers.h"
 #include "source/common/nats/streaming/connect_response_handler.h"
 #include "source/common/nats/streaming/heartbeat_handler.h"
 #include "source/common/nats/streaming/message_utility.h"
 #include "source/common/nats/streaming/pub_request_handler.h"
+#include "source/common/nats/streaming/timeout_queue.h"
 #include "source/common/nats/subject_utility.h"
 #include "source/common/nats/token_generator_impl.h"
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/types/optional.h"
 
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
 
+/**
+ * All stats for the NATS Streaming clients of a cluster. @see stats_macros.h
+ */
+#define ALL_NATS_STREAMING_CLIENT_STATS(COUNTER, GAUGE, HISTOGRAM)            \
+  COUNTER(publish_timeout)                                                     \
+  COUNTER(publish_cancel)                                                      \
+  COUNTER(reconnect)                                                           \
+  COUNTER(rx_bytes)                                                            \
+  COUNTER(tx_bytes)                                                            \
+  GAUGE(publish_in_flight, Accumulate)                                         \
+  GAUGE(publish_pending, Accumulate)                                           \
+  HISTOGRAM(publish_ack_time, Milliseconds)
+
+/**
+ * Wrapper struct for NATS Streaming client stats. @see stats_macros.h
+ */
+struct ClientStats {
+  ALL_NATS_STREAMING_CLIENT_STATS(GENERATE_COUNTER_STRUCT,
+                                  GENERATE_GAUGE_STRUCT,
+                                  GENERATE_HISTOGRAM_STRUCT)
+};
+
 // TODO(talnordan): Maintaining the state of multiple requests and multiple
 // inboxes in a single object is becoming cumbersome, error-prone and hard to
 // unit-test. Consider refactoring this code into an object hierarchy parallel
 // to the inbox hierarchy. After the refactoring, each object is going to be
 // responsible for changing its internal state upon incoming messages from a
 // particular inbox. Such design would be similar to an actor system.
-class ClientImpl : public Client,
+class ClientImpl : public PooledClient,
                    public Tcp::ConnPoolNats::PoolCallbacks<Message>,
                    public ConnectResponseHandler::Callbacks,
                    public HeartbeatHandler::Callbacks,
@@ -36,18 +64,27 @@ class ClientImpl : public Client,
 public:
   ClientImpl(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
              Random::RandomGenerator &random, Event::Dispatcher &dispatcher,
-             const std::chrono::milliseconds &op_timeout);
+             const std::chrono::milliseconds &op_timeout,
+             const ClientStats &stats, const std::string &hash_key);
+  ~ClientImpl() override;
+
+  // the stats of the clients of the cluster, which are shared by all of them,
+  // and named after it so that they are tagged with its name.
+  static ClientStats generateStats(const std::string &cluster_name,
+                                   Stats::Scope &scope);
 
   // Nats::Streaming::Client
   PublishRequestPtr makeRequest(const std::string &subject,
                                 const std::string &cluster_id,
                                 const std::string &discover_prefix,
-                                std::string &&payload,
+                                Buffer::InstancePtr &&payload,
                                 PublishCallbacks &callbacks) override;
 
   // Tcp::ConnPoolNats::PoolCallbacks
   void onResponse(Nats::MessagePtr &&value) override;
   void onClose() override;
+  void onAboveWriteBufferHighWatermark() override;
+  void onBelowWriteBufferLowWatermark() override;
 
   // Nats::Streaming::InboxCallbacks
   void onFailure(const std::string &error) override;
@@ -58,40 +95,61 @@ public:
   // Nats::Streaming::HeartbeatHandler::Callbacks
   void send(const Message &message) override;
 
-  void cancel(const std::string &pub_ack_inbox);
+  void cancel(uint64_t pub_ack_inbox);
+
+  // Nats::Streaming::PooledClient
+  size_t outstandingRequests() const override {
+    return pending_request_per_inbox_.size() + pub_request_per_inbox_.size();
+  }
+  bool aboveWriteBufferHighWatermark() const override {
+    return above_write_buffer_high_watermark_;
+  }
+  void connect() override;
 
 private:
-  enum class State { NotConnected, Connecting, Connected };
+  // a client that lost its connection waits to reconnect, with the requests
+  // made meanwhile queued as when connecting. One that connected ahead of the
+  // first request waits for it to open the session.
+  enum class State {
+    NotConnected,
+    Connecting,
+    WaitingForSession,
+    Connected,
+    WaitingToReconnect
+  };
 
   struct PendingRequest {
     std::string subject;
-    std::string payload;
+    Buffer::InstancePtr payload;
     PublishCallbacks *callbacks;
   };
 
   class PublishRequestCanceler : public PublishRequest {
   public:
-    PublishRequestCanceler(ClientImpl &parent, std::string &&pub_ack_inbox);
+    PublishRequestCanceler(ClientImpl &parent, uint64_t pub_ack_inbox);
 
     // Nats::Streaming::PublishRequest
     void cancel();
 
   private:
     ClientImpl &parent_;
-    const std::string pub_ack_inbox_;
+    const uint64_t pub_ack_inbox_;
   };
 
   inline void onOperation(Nats::MessagePtr &&value);
 
-  inline void onPayload(Nats::MessagePtr &&value);
-
   inline void onInfo(Nats::MessagePtr &&value);
 
-  inline void onMsg(std::vector<absl::string_view> &&tokens);
+  inline void onMsg(const Message &value);
 
   inline void onPing();
 
-  inline void onTimeout(const std::string &pub_ack_inbox);
+  inline void reconnect();
+
+  inline void onTimeout(uint64_t pub_ack_inbox);
+
+  // the sequence number of the pub ack inbox the subject names, if any.
+  inline absl::optional<uint64_t> pubAckInbox(absl::string_view subject) const;
 
   inline void subInbox(const std::string &subject);
 
@@ -106,65 +164,69 @@ private:
   inline void pubConnectRequest();
 
   inline void enqueuePendingRequest(const std::string &subject,
-                                    const std::string &payload,
+                                    Buffer::InstancePtr &&payload,
                                     PublishCallbacks &callbacks,
-                                    const std::string &pub_ack_inbox);
+                                    uint64_t pub_ack_inbox);
+
+  inline void pubPubMsg(const std::string &subject, Buffer::Instance &payload,
+                        PublishCallbacks &callbacks, uint64_t pub_ack_inbox);
 
-  inline void pubPubMsg(const std::string &subject, const std::string &payload,
-                        PublishCallbacks &callbacks,
-                        const std::string &pub_ack_inbox);
+  // the subject the PubMsg of a publish to the subject is sent to.
+  inline const std::string &pubSubject(const std::string &subject);
 
   inline void pong();
 
+  // brings the gauges and the circuit breakers in line with the requests this
+  // client holds.
+  inline void updateGauges();
+
   inline void sendNatsMessage(const Message &message);
 
   // TODO(talnordan): Consider introducing `Nats::streaming::Message` instead of
   // using `std::string`.
   inline void pubNatsStreamingMessage(const std::string &subject,
                                       const std::string &reply_to,
-                                      const std::string &message);
-
-  inline void waitForPayload(std::string subject,
-                             absl::optional<std::string> reply_to) {
-    subect_and_reply_to_waiting_for_payload_.emplace(
-        make_pair(subject, reply_to));
-  }
-
-  inline bool isWaitingForPayload() const {
-    return subect_and_reply_to_waiting_for_payload_.has_value();
-  }
-
-  inline std::string &getSubjectWaitingForPayload() {
-    return subect_and_reply_to_waiting_for_payload_.value().first;
-  }
-
-  inline absl::optional<std::string> &getReplyToWaitingForPayload() {
-    return subect_and_reply_to_waiting_for_payload_.value().second;
-  }
-
-  inline void doneWaitingForPayload() {
-    subect_and_reply_to_waiting_for_payload_ =
-        absl::optional<std::pair<std::string, absl::optional<std::string>>>{};
-  }
+                                      Buffer::InstancePtr &&message);
 
   Tcp::ConnPoolNats::InstancePtr<Message> conn_pool_;
+  CircuitBreakers circuit_breakers_;
   TokenGeneratorImpl token_generator_;
   Event::Dispatcher &dispatcher_;
-  const std::chrono::milliseconds op_timeout_;
+  ClientStats stats_;
+  // the part of the gauges this client accounts for.
+  uint64_t reported_in_flight_{};
+  uint64_t reported_pending_{};
+  // the key the connection pool chooses the host of the client by.
+  const std::string hash_key_;
   State state_{};
   const std::string heartbeat_inbox_;
   const std::string root_inbox_;
   const std::string root_pub_ack_inbox_;
   const std::string connect_response_inbox_;
-  const std::string client_id_;
-  std::map<std::string, PendingRequest> pending_request_per_inbox_;
-  std::map<std::string, PubRequest> pub_request_per_inbox_;
+  // a new one for each session, as the server may still hold the previous
+  // session of a client that reconnects.
+  std::string client_id_;
+  // the requests made while connecting are published in their order once
+  // connected.
+  std::map<uint64_t, PendingRequest> pending_request_per_inbox_;
+  PubRequestMap pub_request_per_inbox_;
+  TimeoutQueue pub_request_timeouts_;
+  // the pub ack inbox of a request is the child of the root pub ack inbox named
+  // by its sequence number.
+  uint64_t next_pub_ack_inbox_{1};
   uint64_t sid_;
+  bool above_write_buffer_high_watermark_{};
+  BackOffStrategyPtr reconnect_backoff_;
+  Event::TimerPtr reconnect_timer_;
   absl::optional<std::string> cluster_id_{};
   absl::optional<std::string> discover_prefix_{};
-  absl::optional<std::pair<std::string, absl::optional<std::string>>>
-      subect_and_reply_to_waiting_for_payload_{};
   absl::optional<std::string> pub_prefix_{};
+  // the subjects PubMsgs were sent to in this session, by the subjects they
+  // publish to, which the routes name, so that they are joined to the pub
+  // prefix once rather than for each publish.
+  absl::flat_hash_map<std::string, std::string> pub_subjects_;
+  // the reply to the last heartbeat, @see HeartbeatHandler.
+  Message heartbeat_reply_;
 
   static const std::string INBOX_PREFIX;
   static const std::string PUB_ACK_PREFIX;
@@ -1,46 +1,241 @@
 #include "source/common/nats/streaming/client_pool.h"
 
+#include "source/common/common/hash.h"
 #include "source/common/nats/codec_impl.h"
 #include "source/common/nats/streaming/client_impl.h"
 #include "source/common/tcp/conn_pool_impl.h"
 
+#include "absl/strings/str_cat.h"
+
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
 
+/**
+ * A publish a worker handed to an owner. The callbacks are only called on the
+ * worker, and not once it canceled the publish, while the request of the
+ * client is only touched on the owner.
+ */
+class ClientPool::SharedRequest
+    : public PublishCallbacks,
+      public std::enable_shared_from_this<SharedRequest> {
+public:
+  SharedRequest(Event::Dispatcher &dispatcher, const std::string &subject,
+                const std::string &cluster_id,
+                const std::string &discover_prefix,
+                Buffer::InstancePtr &&payload, PublishCallbacks &callbacks)
+      : dispatcher_(dispatcher), subject_(subject), cluster_id_(cluster_id),
+        discover_prefix_(discover_prefix), payload_(std::move(payload)),
+        callbacks_(callbacks) {}
+
+  // on the owner.
+  void makeRequest(ThreadLocalPool &owner) {
+    if (canceled_) {
+      return;
+    }
+    request_ = owner.getClient(subject_).makeRequest(
+        subject_, cluster_id_, discover_prefix_, std::move(payload_), *this);
+  }
+
+  // on the owner.
+  void cancelRequest() {
+    if (request_ != nullptr) {
+      request_->cancel();
+      request_.reset();
+    }
+  }
+
+  // on the worker.
+  void cancel() { canceled_ = true; }
+
+  // Nats::Streaming::PublishCallbacks
+  void onResponse() override { complete(&PublishCallbacks::onResponse); }
+  void onReply(Buffer::InstancePtr &&reply) override {
+    request_.reset();
+    // the reply is handed to the worker along with the callback.
+    std::shared_ptr<Buffer::Instance> shared_reply(std::move(reply));
+    std::shared_ptr<SharedRequest> self = shared_from_this();
+    dispatcher_.post([self, shared_reply]() {
+      if (!self->canceled_) {
+        auto reply = std::make_unique<Buffer::OwnedImpl>();
+        reply->move(*shared_reply);
+        self->callbacks_.onReply(std::move(reply));
+      }
+    });
+  }
+  void onFailure() override { complete(&PublishCallbacks::onFailure); }
+  void onTimeout() override { complete(&PublishCallbacks::onTimeout); }
+  void onOverflow() override { complete(&PublishCallbacks::onOverflow); }
+
+private:
+  void complete(void (PublishCallbacks::*callback)()) {
+    request_.reset();
+    std::shared_ptr<SharedRequest> self = shared_from_this();
+    dispatcher_.post([self, callback]() {
+      if (!self->canceled_) {
+        (self->callbacks_.*callback)();
+      }
+    });
+  }
+
+  Event::Dispatcher &dispatcher_;
+  const std::string subject_;
+  const std::string cluster_id_;
+  const std::string discover_prefix_;
+  Buffer::InstancePtr payload_;
+  PublishCallbacks &callbacks_;
+  std::atomic<bool> canceled_{false};
+  PublishRequestPtr request_;
+};
+
+namespace {
+
+class SharedRequestCanceler : public PublishRequest {
+public:
+  using Cancel = std::function<void()>;
+
+  explicit SharedRequestCanceler(Cancel cancel) : cancel_(std::move(cancel)) {}
+
+  // Nats::Streaming::PublishRequest
+  void cancel() override { cancel_(); }
+
+private:
+  const Cancel cancel_;
+};
+
+} // namespace
+
 ClientPool::ClientPool(
     const std::string &cluster_name, Upstream::ClusterManager &cm,
     Tcp::ConnPoolNats::ClientFactory<Message> &client_factory,
-    ThreadLocal::SlotAllocator &tls, Random::RandomGenerator &random,
-    const std::chrono::milliseconds &op_timeout)
+    ThreadLocal::SlotAllocator &tls, uint32_t max_connections,
+    bool shard_by_subject, bool eager_connect,
+    uint32_t shared_connection_workers,
+    PooledClientFactory pooled_client_factory)
     : cm_(cm), client_factory_(client_factory), slot_(tls.allocateSlot()),
-      random_(random), op_timeout_(op_timeout) {
+      max_connections_(max_connections), shard_by_subject_(shard_by_subject),
+      eager_connect_(eager_connect),
+      shared_connection_workers_(shared_connection_workers),
+      pooled_client_factory_(std::move(pooled_client_factory)) {
   slot_->set([this, cluster_name](Event::Dispatcher &dispatcher)
                  -> ThreadLocal::ThreadLocalObjectSharedPtr {
-    Tcp::ConnPoolNats::InstancePtr<Message> conn_pool(
-        new Tcp::ConnPoolNats::InstanceImpl<Message, DecoderImpl>(
-            cluster_name, cm_, client_factory_, dispatcher));
-    return std::make_shared<ThreadLocalPool>(std::move(conn_pool), random_,
-                                             dispatcher, op_timeout_);
+    return std::make_shared<ThreadLocalPool>(*this, cluster_name, dispatcher);
   });
 }
 
+ClientPool::PooledClientFactory ClientPool::streamingClientFactory(
+    Random::RandomGenerator &random,
+    const std::chrono::milliseconds &op_timeout, const ClientStats &stats) {
+  return [&random, op_timeout, stats](
+             Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+             Event::Dispatcher &dispatcher,
+             const std::string &hash_key) -> PooledClientPtr {
+    return std::make_unique<ClientImpl>(std::move(conn_pool), random,
+                                        dispatcher, op_timeout, stats,
+                                        hash_key);
+  };
+}
+
 PublishRequestPtr ClientPool::makeRequest(const std::string &subject,
                                           const std::string &cluster_id,
                                           const std::string &discover_prefix,
-                                          std::string &&payload,
+                                          Buffer::InstancePtr &&payload,
                                           PublishCallbacks &callbacks) {
-  return slot_->getTyped<ThreadLocalPool>().getClient().makeRequest(
+  return slot_->getTyped<ThreadLocalPool>().makeRequest(
       subject, cluster_id, discover_prefix, std::move(payload), callbacks);
 }
 
-ClientPool::ThreadLocalPool::ThreadLocalPool(
-    Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
-    Random::RandomGenerator &random, Event::Dispatcher &dispatcher,
-    const std::chrono::milliseconds &op_timeout)
-    : client_(std::move(conn_pool), random, dispatcher, op_timeout) {}
+ClientPool::ThreadLocalPool::ThreadLocalPool(ClientPool &parent,
+                                             const std::string &cluster_name,
+                                             Event::Dispatcher &dispatcher)
+    : parent_(parent), cluster_name_(cluster_name), dispatcher_(dispatcher),
+      shard_by_subject_(parent.shard_by_subject_) {
+  // the workers that share clients only make them once they own them.
+  if (!parent.shared()) {
+    makeClients();
+  }
+}
+
+PublishRequestPtr ClientPool::ThreadLocalPool::makeRequest(
+    const std::string &subject, const std::string &cluster_id,
+    const std::string &discover_prefix, Buffer::InstancePtr &&payload,
+    PublishCallbacks &callbacks) {
+  const Owner *owner = clients_.empty() ? getOwner(subject) : nullptr;
+  if (owner == nullptr) {
+    return getClient(subject).makeRequest(subject, cluster_id, discover_prefix,
+                                          std::move(payload), callbacks);
+  }
+
+  auto request = std::make_shared<SharedRequest>(
+      dispatcher_, subject, cluster_id, discover_prefix, std::move(payload),
+      callbacks);
+  Event::Dispatcher &owner_dispatcher = *owner->dispatcher_;
+  std::weak_ptr<ThreadLocalPool> owner_pool = owner->pool_;
+  owner_dispatcher.post([request, owner_pool]() {
+    std::shared_ptr<ThreadLocalPool> pool = owner_pool.lock();
+    if (pool == nullptr) {
+      request->onFailure();
+      return;
+    }
+    request->makeRequest(*pool);
+  });
+  return std::make_unique<SharedRequestCanceler>(
+      [request, &owner_dispatcher]() {
+        request->cancel();
+        owner_dispatcher.post([request]() { request->cancelRequest(); });
+      });
+}
 
-Client &ClientPool::ThreadLocalPool::getClient() { return client_; }
+void ClientPool::ThreadLocalPool::makeClients() {
+  // each client connects through a pool of its own, which holds a single
+  // connection to the host its index hashes to.
+  for (uint32_t i = 0; i < parent_.max_connections_; i++) {
+    Tcp::ConnPoolNats::InstancePtr<Message> conn_pool(
+        new Tcp::ConnPoolNats::InstanceImpl<Message, DecoderImpl>(
+            cluster_name_, parent_.cm_, parent_.client_factory_, dispatcher_));
+    clients_.emplace_back(parent_.pooled_client_factory_(
+        std::move(conn_pool), dispatcher_, absl::StrCat(i)));
+    if (parent_.eager_connect_) {
+      clients_.back()->connect();
+    }
+  }
+}
+
+const ClientPool::Owner *
+ClientPool::ThreadLocalPool::getOwner(const std::string &subject) {
+  if (owners_.size() < parent_.shared_connection_workers_) {
+    absl::MutexLock lock(&parent_.owners_mutex_);
+    if (parent_.owners_.size() < parent_.shared_connection_workers_) {
+      // the worker owns the clients it makes from now on.
+      parent_.owners_.push_back(Owner{&dispatcher_, weak_from_this()});
+      makeClients();
+      return nullptr;
+    }
+    owners_ = parent_.owners_;
+  }
+  // the publishes of a subject go to the same owner when sharding by subject,
+  // which keeps those of the worker in order.
+  const uint64_t index = shard_by_subject_ ? HashUtil::xxHash64(subject)
+                                           : next_owner_++;
+  return &owners_[index % owners_.size()];
+}
+
+Client &ClientPool::ThreadLocalPool::getClient(const std::string &subject) {
+  if (shard_by_subject_) {
+    return *clients_[HashUtil::xxHash64(subject) % clients_.size()];
+  }
+  // a client whose connection is backed up is only chosen when they all are.
+  PooledClient *least_loaded = clients_.front().get();
+  for (const PooledClientPtr &client : clients_) {
+    if (std::make_pair(client->aboveWriteBufferHighWatermark(),
+                       client->outstandingRequests()) <
+        std::make_pair(least_loaded->aboveWriteBufferHighWatermark(),
+                       least_loaded->outstandingRequests())) {
+      least_loaded = client.get();
+    }
+  }
+  return *least_loaded;
+}
 
 } // namespace Streaming
 } // namespace Nats
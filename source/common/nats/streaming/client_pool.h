@@ -1,5 +1,13 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/common/random_generator.h"
 #include "include/envoy/nats/codec.h"
 #include "include/envoy/nats/streaming/client.h"
 #include "include/envoy/tcp/conn_pool_nats.h"
@@ -8,41 +16,110 @@
 
 #include "source/common/nats/streaming/client_impl.h"
 
+#include "absl/synchronization/mutex.h"
+
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
 
+/**
+ * The clients of max_connections connections of each worker, of whichever
+ * protocol the factory makes them for.
+ *
+ * With shared_connection_workers, only the first workers to publish make
+ * clients, and the others post their publishes to the dispatcher of one of
+ * them, which posts the outcome back to the dispatcher of the publish. The
+ * dispatchers of the workers outlive their thread local pools, so that a post
+ * to a worker whose pool is gone finds nothing to do.
+ */
 class ClientPool : public Client {
 public:
+  // makes a client over the pool of a connection, which chooses its host by
+  // the hash key.
+  using PooledClientFactory = std::function<PooledClientPtr(
+      Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
+      Event::Dispatcher &dispatcher, const std::string &hash_key)>;
+
   ClientPool(const std::string &cluster_name, Upstream::ClusterManager &cm,
              Tcp::ConnPoolNats::ClientFactory<Message> &client_factory,
-             ThreadLocal::SlotAllocator &tls, Random::RandomGenerator &random,
-             const std::chrono::milliseconds &op_timeout);
+             ThreadLocal::SlotAllocator &tls, uint32_t max_connections,
+             bool shard_by_subject, bool eager_connect,
+             uint32_t shared_connection_workers,
+             PooledClientFactory pooled_client_factory);
+
+  // the factory of the NATS Streaming clients.
+  static PooledClientFactory
+  streamingClientFactory(Random::RandomGenerator &random,
+                         const std::chrono::milliseconds &op_timeout,
+                         const ClientStats &stats);
 
   // Nats::Streaming::Client
   PublishRequestPtr makeRequest(const std::string &subject,
                                 const std::string &cluster_id,
                                 const std::string &discover_prefix,
-                                std::string &&payload,
+                                Buffer::InstancePtr &&payload,
                                 PublishCallbacks &callbacks) override;
 
 private:
-  struct ThreadLocalPool : public ThreadLocal::ThreadLocalObject {
-    ThreadLocalPool(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
-                    Random::RandomGenerator &random,
-                    Event::Dispatcher &dispatcher,
-                    const std::chrono::milliseconds &op_timeout);
-    Client &getClient();
+  struct ThreadLocalPool;
+  class SharedRequest;
+
+  // a worker that makes clients for the others.
+  struct Owner {
+    Event::Dispatcher *dispatcher_;
+    // only locked on the thread of the worker.
+    std::weak_ptr<ThreadLocalPool> pool_;
+  };
+
+  struct ThreadLocalPool
+      : public ThreadLocal::ThreadLocalObject,
+        public std::enable_shared_from_this<ThreadLocalPool> {
+    ThreadLocalPool(ClientPool &parent, const std::string &cluster_name,
+                    Event::Dispatcher &dispatcher);
+
+    PublishRequestPtr makeRequest(const std::string &subject,
+                                  const std::string &cluster_id,
+                                  const std::string &discover_prefix,
+                                  Buffer::InstancePtr &&payload,
+                                  PublishCallbacks &callbacks);
+
+    // the client the subject hashes to when sharding by subject. Otherwise,
+    // the client with the fewest outstanding requests, the earlier one on
+    // ties, so that a connection is only opened once the others are busy.
+    Client &getClient(const std::string &subject);
 
   private:
-    ClientImpl client_;
+    void makeClients();
+
+    // the worker the publish of a worker that makes no clients goes to, if
+    // there is one yet.
+    const Owner *getOwner(const std::string &subject);
+
+    ClientPool &parent_;
+    const std::string cluster_name_;
+    Event::Dispatcher &dispatcher_;
+    const bool shard_by_subject_;
+    std::vector<PooledClientPtr> clients_;
+    // the owners this worker found once they were all there, which it then
+    // goes to without taking the lock.
+    std::vector<Owner> owners_;
+    uint64_t next_owner_{};
   };
 
+  // whether the workers share the clients of a few of them.
+  bool shared() const { return shared_connection_workers_ > 0; }
+
   Upstream::ClusterManager &cm_;
   Tcp::ConnPoolNats::ClientFactory<Message> &client_factory_;
   ThreadLocal::SlotPtr slot_;
-  Random::RandomGenerator &random_;
-  const std::chrono::milliseconds op_timeout_;
+  const uint32_t max_connections_;
+  const bool shard_by_subject_;
+  // whether the clients connect as soon as they are made.
+  const bool eager_connect_;
+  const uint32_t shared_connection_workers_;
+  const PooledClientFactory pooled_client_factory_;
+  absl::Mutex owners_mutex_;
+  std::vector<Owner> owners_ ABSL_GUARDED_BY(owners_mutex_);
 };
 
 } // namespace Streaming
@@ -9,7 +9,7 @@ namespace Nats {
 namespace Streaming {
 
 void ConnectResponseHandler::onMessage(absl::optional<std::string> &reply_to,
-                                       const std::string &payload,
+                                       absl::string_view payload,
                                        Callbacks &callbacks) {
   if (reply_to.has_value()) {
     callbacks.onFailure(
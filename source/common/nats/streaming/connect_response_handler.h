@@ -5,6 +5,7 @@
 #include "envoy/common/pure.h"
 #include "include/envoy/nats/streaming/inbox_handler.h"
 
+#include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 
 namespace Envoy {
@@ -20,7 +21,7 @@ public:
   };
 
   static void onMessage(absl::optional<std::string> &reply_to,
-                        const std::string &payload, Callbacks &callbacks);
+                        absl::string_view payload, Callbacks &callbacks);
 };
 
 } // namespace Streaming
@@ -2,14 +2,19 @@
 
 #include <string>
 
-#include "source/common/nats/message_builder.h"
-
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
 
 void HeartbeatHandler::onMessage(absl::optional<std::string> &reply_to,
-                                 const std::string &payload,
+                                 absl::string_view payload,
+                                 Callbacks &callbacks) {
+  Message reply;
+  onMessage(reply_to, payload, reply, callbacks);
+}
+
+void HeartbeatHandler::onMessage(absl::optional<std::string> &reply_to,
+                                 absl::string_view payload, Message &reply,
                                  Callbacks &callbacks) {
   if (!reply_to.has_value()) {
     callbacks.onFailure("incoming heartbeat without reply subject");
@@ -21,7 +26,13 @@ void HeartbeatHandler::onMessage(absl::optional<std::string> &reply_to,
     return;
   }
 
-  callbacks.send(MessageBuilder::createPubMessage(reply_to.value()));
+  // the reply is written over the previous one, whose storage it reuses, the
+  // way MessageBuilder::createPubMessage builds it.
+  std::string &string = reply.asString();
+  string.assign("PUB ");
+  string.append(reply_to.value());
+  string.append(" 0\r\n");
+  callbacks.send(reply);
 }
 
 } // namespace Streaming
@@ -6,6 +6,7 @@
 #include "include/envoy/nats/codec.h"
 #include "include/envoy/nats/streaming/inbox_handler.h"
 
+#include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 
 namespace Envoy {
@@ -23,7 +24,13 @@ public:
   // TODO(talnordan): For this handler, the payload is always empty. In the
   // genral case, use a NATS streaming message type instead of a raw payload.
   static void onMessage(absl::optional<std::string> &reply_to,
-                        const std::string &payload, Callbacks &callbacks);
+                        absl::string_view payload, Callbacks &callbacks);
+
+  // the reply is written into the message of the previous one, so that
+  // answering a heartbeat allocates nothing once the storage is large enough.
+  static void onMessage(absl::optional<std::string> &reply_to,
+                        absl::string_view payload, Message &reply,
+                        Callbacks &callbacks);
 };
 
 } // namespace Streaming
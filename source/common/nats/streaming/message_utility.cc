@@ -1,5 +1,10 @@
 #include "source/common/nats/streaming/message_utility.h"
 
+#include "source/common/buffer/buffer_impl.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
@@ -25,17 +30,18 @@ std::string MessageUtility::createConnectResponseMessage(
   return serializeToString(connect_response);
 }
 
-std::string MessageUtility::createPubMsgMessage(const std::string &client_id,
-                                                const std::string &guid,
-                                                const std::string &subject,
-                                                const std::string &data) {
+Buffer::InstancePtr MessageUtility::createPubMsgMessage(
+    const std::string &client_id, const std::string &guid,
+    const std::string &subject, Buffer::Instance &data) {
   pb::PubMsg pub_msg;
   pub_msg.set_clientid(client_id);
   pub_msg.set_guid(guid);
   pub_msg.set_subject(subject);
-  pub_msg.set_data(data);
 
-  return serializeToString(pub_msg);
+  auto message =
+      std::make_unique<Buffer::OwnedImpl>(serializeToString(pub_msg));
+  appendBytesField(pb::PubMsg::kDataFieldNumber, data, *message);
+  return message;
 }
 
 std::string MessageUtility::createPubAckMessage(const std::string &guid,
@@ -48,9 +54,9 @@ std::string MessageUtility::createPubAckMessage(const std::string &guid,
 }
 
 absl::optional<pb::PubAck>
-MessageUtility::parsePubAckMessage(const std::string &pub_ack_message) {
+MessageUtility::parsePubAckMessage(absl::string_view pub_ack_message) {
   pb::PubAck pub_ack;
-  if (pub_ack.ParseFromString(pub_ack_message)) {
+  if (pub_ack.ParseFromArray(pub_ack_message.data(), pub_ack_message.size())) {
     return pub_ack;
   }
 
@@ -58,12 +64,31 @@ MessageUtility::parsePubAckMessage(const std::string &pub_ack_message) {
 }
 
 std::string
-MessageUtility::getPubPrefix(const std::string &connect_response_message) {
+MessageUtility::getPubPrefix(absl::string_view connect_response_message) {
   pb::ConnectResponse connect_response;
-  connect_response.ParseFromString(connect_response_message);
+  connect_response.ParseFromArray(connect_response_message.data(),
+                                  connect_response_message.size());
   return connect_response.pubprefix();
 }
 
+void MessageUtility::appendBytesField(uint32_t field_number,
+                                      Buffer::Instance &value,
+                                      Buffer::Instance &out) {
+  if (value.length() == 0) {
+    return;
+  }
+  using google::protobuf::internal::WireFormatLite;
+  using google::protobuf::io::CodedOutputStream;
+  uint8_t header[2 * CodedOutputStream::kMaxVarint32Bytes];
+  uint8_t *end = CodedOutputStream::WriteVarint32ToArray(
+      WireFormatLite::MakeTag(field_number,
+                              WireFormatLite::WIRETYPE_LENGTH_DELIMITED),
+      header);
+  end = CodedOutputStream::WriteVarint32ToArray(value.length(), end);
+  out.add(header, end - header);
+  out.move(value);
+}
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace Envoy
@@ -3,6 +3,9 @@
 #include <string>
 #include <utility>
 
+#include "envoy/buffer/buffer.h"
+
+#include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "api/envoy/type/streaming/protocol.pb.h"
 
@@ -20,18 +23,32 @@ public:
       const std::string &pub_prefix, const std::string &sub_requests,
       const std::string &unsub_requests, const std::string &close_requests);
 
-  static std::string createPubMsgMessage(const std::string &client_id,
-                                         const std::string &guid,
-                                         const std::string &subject,
-                                         const std::string &data);
+  // the data is moved to the end of the message rather than copied into it.
+  static Buffer::InstancePtr createPubMsgMessage(const std::string &client_id,
+                                                 const std::string &guid,
+                                                 const std::string &subject,
+                                                 Buffer::Instance &data);
 
   static std::string createPubAckMessage(const std::string &guid,
                                          const std::string &error);
 
+  // the messages are parsed from views, so that they can be parsed from the
+  // payload they arrived in.
   static absl::optional<pb::PubAck>
-  parsePubAckMessage(const std::string &pub_ack_message);
+  parsePubAckMessage(absl::string_view pub_ack_message);
+
+  static std::string getPubPrefix(absl::string_view connect_response_message);
 
-  static std::string getPubPrefix(const std::string &connect_response_message);
+  /**
+   * Moves the value to the end of the serialized message as a bytes field,
+   * which parses as if the message was serialized with the field set. Like
+   * protobuf, an empty value is left out.
+   * @param field_number supplies the number of the field.
+   * @param value supplies the value of the field, which is drained.
+   * @param out supplies the serialized message.
+   */
+  static void appendBytesField(uint32_t field_number, Buffer::Instance &value,
+                               Buffer::Instance &out);
 
 private:
   template <typename T> static std::string serializeToString(T &&message) {
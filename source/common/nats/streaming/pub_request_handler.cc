@@ -8,7 +8,7 @@ namespace Nats {
 namespace Streaming {
 
 void PubRequestHandler::onMessage(const absl::optional<std::string> &reply_to,
-                                  const std::string &payload,
+                                  absl::string_view payload,
                                   InboxCallbacks &inbox_callbacks,
                                   PublishCallbacks &publish_callbacks) {
   if (reply_to.has_value()) {
@@ -29,10 +29,11 @@ void PubRequestHandler::onMessage(const absl::optional<std::string> &reply_to,
   }
 }
 
-void PubRequestHandler::onMessage(
-    const std::string &inbox, const absl::optional<std::string> &reply_to,
-    const std::string &payload, InboxCallbacks &inbox_callbacks,
-    std::map<std::string, PubRequest> &request_per_inbox) {
+void PubRequestHandler::onMessage(uint64_t inbox,
+                                  const absl::optional<std::string> &reply_to,
+                                  absl::string_view payload,
+                                  InboxCallbacks &inbox_callbacks,
+                                  PubRequestMap &request_per_inbox) {
   // Find the inbox in the map.
   auto it = request_per_inbox.find(inbox);
 
@@ -42,18 +43,17 @@ void PubRequestHandler::onMessage(
     return;
   }
 
+  // Remove the inbox from the map first, as the callbacks may make requests
+  // that move the entries of the map.
+  PublishCallbacks &publish_callbacks = it->second.callbacks();
+  request_per_inbox.erase(it);
+
   // Handle the message using the publish callbacks associated with the inbox.
-  PubRequest &request = it->second;
-  PublishCallbacks &publish_callbacks = request.callbacks();
   onMessage(reply_to, payload, inbox_callbacks, publish_callbacks);
-
-  // Remove the inbox from the map.
-  eraseRequest(request_per_inbox, it);
 }
 
-void PubRequestHandler::onTimeout(
-    const std::string &inbox,
-    std::map<std::string, PubRequest> &request_per_inbox) {
+void PubRequestHandler::onTimeout(uint64_t inbox,
+                                  PubRequestMap &request_per_inbox) {
   // Find the inbox in the map.
   auto it = request_per_inbox.find(inbox);
 
@@ -62,17 +62,17 @@ void PubRequestHandler::onTimeout(
     return;
   }
 
-  // Notify of a timeout using the publish callbacks associated with the inbox.
-  PubRequest &request = it->second;
-  request.callbacks().onTimeout();
+  // Remove the inbox from the map first, as the callbacks may make requests
+  // that move the entries of the map.
+  PublishCallbacks &publish_callbacks = it->second.callbacks();
+  request_per_inbox.erase(it);
 
-  // Remove the inbox from the map.
-  eraseRequest(request_per_inbox, it);
+  // Notify of a timeout using the publish callbacks associated with the inbox.
+  publish_callbacks.onTimeout();
 }
 
-void PubRequestHandler::onCancel(
-    const std::string &inbox,
-    std::map<std::string, PubRequest> &request_per_inbox) {
+void PubRequestHandler::onCancel(uint64_t inbox,
+                                 PubRequestMap &request_per_inbox) {
   // Find the inbox in the map.
   auto it = request_per_inbox.find(inbox);
 
@@ -82,15 +82,7 @@ void PubRequestHandler::onCancel(
   }
 
   // Remove the inbox from the map.
-  eraseRequest(request_per_inbox, it);
-}
-
-void PubRequestHandler::eraseRequest(
-    std::map<std::string, PubRequest> &request_per_inbox,
-    std::map<std::string, PubRequest>::iterator position) {
-  PubRequest &request = position->second;
-  request.onDestroy();
-  request_per_inbox.erase(position);
+  request_per_inbox.erase(it);
 }
 
 } // namespace Streaming
@@ -1,12 +1,14 @@
 #pragma once
 
-#include <map>
+#include <cstdint>
 #include <string>
 
-#include "envoy/event/timer.h"
+#include "envoy/common/time.h"
 #include "include/envoy/nats/streaming/client.h"
 #include "include/envoy/nats/streaming/inbox_handler.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 
 namespace Envoy {
@@ -14,46 +16,43 @@ namespace Nats {
 namespace Streaming {
 
 // TODO(talnordan): Consider moving to `include/envoy`.
+// The timeouts of the requests are kept apart, @see TimeoutQueue.
 class PubRequest {
 public:
-  PubRequest(PublishCallbacks *callbacks, Event::TimerPtr timeout_timer)
-      : callbacks_(callbacks), timeout_timer_(std::move(timeout_timer)) {}
+  explicit PubRequest(PublishCallbacks *callbacks,
+                      MonotonicTime sent_at = MonotonicTime())
+      : callbacks_(callbacks), sent_at_(sent_at) {}
 
   PublishCallbacks &callbacks() { return *callbacks_; }
 
-  void onDestroy() {
-    timeout_timer_->disableTimer();
-    timeout_timer_ = nullptr;
-  }
+  // when the PubMsg was written, which the latency of the PubAck is from.
+  MonotonicTime sentAt() const { return sent_at_; }
 
 private:
   PublishCallbacks *callbacks_;
-  Event::TimerPtr timeout_timer_;
+  MonotonicTime sent_at_;
 };
 
+// the requests awaiting their PubAck, by the sequence number that names
+// their inbox.
+using PubRequestMap = absl::flat_hash_map<uint64_t, PubRequest>;
+
 class PubRequestHandler {
 public:
   static void onMessage(const absl::optional<std::string> &reply_to,
-                        const std::string &payload,
+                        absl::string_view payload,
                         InboxCallbacks &inbox_callbacks,
                         PublishCallbacks &publish_callbacks);
 
-  static void onMessage(const std::string &inbox,
+  static void onMessage(uint64_t inbox,
                         const absl::optional<std::string> &reply_to,
-                        const std::string &payload,
+                        absl::string_view payload,
                         InboxCallbacks &inbox_callbacks,
-                        std::map<std::string, PubRequest> &request_per_inbox);
-
-  static void onTimeout(const std::string &inbox,
-                        std::map<std::string, PubRequest> &request_per_inbox);
+                        PubRequestMap &request_per_inbox);
 
-  static void onCancel(const std::string &inbox,
-                       std::map<std::string, PubRequest> &request_per_inbox);
+  static void onTimeout(uint64_t inbox, PubRequestMap &request_per_inbox);
 
-private:
-  static inline void
-  eraseRequest(std::map<std::string, PubRequest> &request_per_inbox,
-               std::map<std::string, PubRequest>::iterator position);
+  static void onCancel(uint64_t inbox, PubRequestMap &request_per_inbox);
 };
 
 } // namespace Streaming
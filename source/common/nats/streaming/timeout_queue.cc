@@ -0,0 +1,46 @@
+#include "source/common/nats/streaming/timeout_queue.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Streaming {
+
+TimeoutQueue::TimeoutQueue(Event::Dispatcher &dispatcher,
+                           TimeSource &time_source,
+                           std::chrono::milliseconds timeout,
+                           TimeoutCallback on_timeout)
+    : dispatcher_(dispatcher), time_source_(time_source), timeout_(timeout),
+      on_timeout_(std::move(on_timeout)) {}
+
+void TimeoutQueue::add(uint64_t id) {
+  deadlines_.emplace_back(time_source_.monotonicTime() + timeout_, id);
+  if (timer_ == nullptr) {
+    timer_ = dispatcher_.createTimer([this]() -> void { onTimer(); });
+  }
+  if (!timer_->enabled()) {
+    enableTimer();
+  }
+}
+
+void TimeoutQueue::onTimer() {
+  const MonotonicTime now = time_source_.monotonicTime();
+  // the callback may add requests, which are behind the expired ones.
+  while (!deadlines_.empty() && deadlines_.front().first <= now) {
+    const uint64_t id = deadlines_.front().second;
+    deadlines_.pop_front();
+    on_timeout_(id);
+  }
+  if (!deadlines_.empty() && !timer_->enabled()) {
+    enableTimer();
+  }
+}
+
+void TimeoutQueue::enableTimer() {
+  // rounded up, so that the timer doesn't fire before the deadline.
+  const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+      deadlines_.front().first - time_source_.monotonicTime());
+  timer_->enableTimer(std::max(remaining, std::chrono::milliseconds(0)));
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace Envoy
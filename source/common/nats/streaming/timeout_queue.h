@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Streaming {
+
+/**
+ * The timeouts of requests that all time out after the same duration, counted
+ * from when they are added. As their deadlines come in the order the requests
+ * are added, they are kept in a queue, and a single timer is armed for the
+ * earliest of them, rather than a timer for each request.
+ *
+ * A request that completes before its deadline is not removed from the queue:
+ * its timeout is still reported, and is expected to be ignored.
+ */
+class TimeoutQueue {
+public:
+  using TimeoutCallback = std::function<void(uint64_t id)>;
+
+  TimeoutQueue(Event::Dispatcher &dispatcher, TimeSource &time_source,
+               std::chrono::milliseconds timeout, TimeoutCallback on_timeout);
+
+  // starts the timeout of the request.
+  void add(uint64_t id);
+
+  size_t size() const { return deadlines_.size(); }
+
+private:
+  void onTimer();
+  void enableTimer();
+
+  Event::Dispatcher &dispatcher_;
+  TimeSource &time_source_;
+  const std::chrono::milliseconds timeout_;
+  const TimeoutCallback on_timeout_;
+  std::deque<std::pair<MonotonicTime, uint64_t>> deadlines_;
+  Event::TimerPtr timer_;
+};
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace Envoy
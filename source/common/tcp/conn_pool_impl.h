@@ -12,6 +12,7 @@
 
 #include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/assert.h"
+#include "source/common/common/hash.h"
 #include "source/common/network/filter_impl.h"
 #include "source/common/tcp/codec_impl.h"
 #include "source/common/upstream/load_balancer_impl.h"
@@ -23,6 +24,7 @@ namespace ConnPoolNats {
 class ConfigImpl : public Config {
 public:
   bool disableOutlierEvents() const override { return false; }
+  uint32_t maxBufferSizeBeforeFlush() const override { return 64 * 1024; }
 };
 
 template <typename T>
@@ -43,6 +45,10 @@ public:
         Network::ReadFilterSharedPtr{new UpstreamReadFilter(*client)});
     client->connection_->connect();
     client->connection_->noDelay(true);
+    client->flush_callback_ =
+        dispatcher.createSchedulableCallback([client = client.get()]() {
+          client->flush();
+        });
     return client;
   }
 
@@ -65,7 +71,13 @@ public:
 
     incRequestStats();
     encoder_->encode(request, encoder_buffer_);
-    connection_->write(encoder_buffer_, false);
+    // the requests made during an iteration of the event loop are written
+    // together, in a single write, once the iteration ends.
+    if (encoder_buffer_.length() >= config_.maxBufferSizeBeforeFlush()) {
+      flush();
+    } else if (!flush_callback_->enabled()) {
+      flush_callback_->scheduleCallbackCurrentIteration();
+    }
   }
   void cancel() override {
     // If we get a cancellation, we just mark all pending request as canceled,
@@ -110,6 +122,14 @@ private:
     host->stats().cx_total_.inc();
     host->stats().cx_active_.inc();
   }
+  void flush() {
+    flush_callback_->cancel();
+    // the requests of a connection that closed meanwhile are dropped.
+    if (encoder_buffer_.length() != 0 &&
+        connection_->state() == Network::Connection::State::Open) {
+      connection_->write(encoder_buffer_, false);
+    }
+  }
   void onData(Buffer::Instance &data) {
     try {
       decoder_->decode(data);
@@ -179,13 +199,18 @@ private:
       host_->stats().cx_connect_fail_.inc();
     }
   }
-  void onAboveWriteBufferHighWatermark() override {}
-  void onBelowWriteBufferLowWatermark() override {}
+  void onAboveWriteBufferHighWatermark() override {
+    callbacks_.onAboveWriteBufferHighWatermark();
+  }
+  void onBelowWriteBufferLowWatermark() override {
+    callbacks_.onBelowWriteBufferLowWatermark();
+  }
 
   Upstream::HostConstSharedPtr host_;
   Network::ClientConnectionPtr connection_;
   EncoderPtr<T> encoder_;
   Buffer::OwnedImpl encoder_buffer_;
+  Event::SchedulableCallbackPtr flush_callback_;
   DecoderPtr decoder_;
   PoolCallbacks<T> &callbacks_;
   const Config &config_;
@@ -236,6 +261,11 @@ public:
   void makeRequest(const std::string &hash_key, const T &request) override {
     thread_local_pool_->makeRequest(hash_key, request);
   }
+  Upstream::ClusterInfoConstSharedPtr clusterInfo() override {
+    auto *cluster =
+        cm_.getThreadLocalCluster(thread_local_pool_->cluster_name_);
+    return cluster == nullptr ? nullptr : cluster->info();
+  }
 
 private:
   struct ThreadLocalPool;
@@ -313,9 +343,8 @@ private:
 
   struct LbContextImpl : public Upstream::LoadBalancerContextBase {
     LbContextImpl(const std::string &hash_key)
-        : hash_key_(std::hash<std::string>()(hash_key)) {}
-    // TODO(danielhochman): convert to HashUtil::xxHash64 when we have a
-    // migration strategy. Upstream::LoadBalancerContext
+        : hash_key_(HashUtil::xxHash64(hash_key)) {}
+    // Upstream::LoadBalancerContext
     absl::optional<uint64_t> computeHashKey() override { return hash_key_; }
 
     const absl::optional<uint64_t> hash_key_;
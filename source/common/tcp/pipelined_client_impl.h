@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/common/callback.h"
+#include "envoy/event/deferred_deletable.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/network/connection.h"
+#include "include/envoy/tcp/conn_pool_nats.h"
+#include "include/envoy/tcp/pipelined_client.h"
+#include "envoy/upstream/cluster_manager.h"
+#include "envoy/upstream/thread_local_cluster.h"
+#include "envoy/upstream/upstream.h"
+
+#include "source/common/common/assert.h"
+#include "source/common/common/hash.h"
+#include "source/common/upstream/load_balancer_impl.h"
+
+#include "absl/container/flat_hash_map.h"
+
+namespace Envoy {
+namespace Tcp {
+namespace PipelinedClient {
+
+class ConfigImpl : public Config {
+public:
+  ConfigImpl(uint32_t connections_per_host,
+             uint32_t max_outstanding_requests_per_connection)
+      : connections_per_host_(connections_per_host),
+        max_outstanding_requests_per_connection_(
+            max_outstanding_requests_per_connection) {}
+
+  // Tcp::ConnPoolNats::Config
+  bool disableOutlierEvents() const override { return false; }
+  uint32_t maxBufferSizeBeforeFlush() const override { return 64 * 1024; }
+
+  // Tcp::PipelinedClient::Config
+  uint32_t connectionsPerHost() const override { return connections_per_host_; }
+  uint32_t maxOutstandingRequestsPerConnection() const override {
+    return max_outstanding_requests_per_connection_;
+  }
+
+private:
+  const uint32_t connections_per_host_;
+  const uint32_t max_outstanding_requests_per_connection_;
+};
+
+/**
+ * A pipelined client on a single dispatcher. The load balancer of the cluster
+ * chooses the host of each request, and leaves out the hosts that failed
+ * their health checks or were ejected as outliers, which the connections
+ * report their results to. A request goes to the connection of the host with
+ * the fewest outstanding requests, and a new connection is opened while that
+ * one is busy and the host has fewer than connectionsPerHost(). The responses
+ * of a connection are matched to its requests in the order they were made.
+ */
+template <typename T> class InstanceImpl : public Instance<T> {
+public:
+  InstanceImpl(const std::string &cluster_name, Upstream::ClusterManager &cm,
+               ConnPoolNats::ClientFactory<T> &client_factory,
+               Event::Dispatcher &dispatcher, const Config &config)
+      : cluster_name_(cluster_name), cm_(cm), client_factory_(client_factory),
+        dispatcher_(dispatcher), config_(config) {}
+
+  ~InstanceImpl() {
+    // the clients fail their requests as they close, and are deleted along
+    // with the map once none of them is left to find in clients_.
+    absl::flat_hash_map<Upstream::HostConstSharedPtr,
+                        std::vector<ActiveClientPtr>>
+        clients;
+    clients.swap(clients_);
+    for (auto &it : clients) {
+      for (ActiveClientPtr &client : it.second) {
+        client->client_->close();
+      }
+    }
+  }
+
+  // Tcp::PipelinedClient::Instance
+  PendingRequest *makeRequest(const std::string &hash_key, const T &request,
+                              RequestCallbacks<T> &callbacks) override {
+    Upstream::ThreadLocalCluster *cluster =
+        cm_.getThreadLocalCluster(cluster_name_);
+    if (cluster == nullptr) {
+      return nullptr;
+    }
+    if (cluster != cluster_) {
+      onClusterChanged(*cluster);
+    }
+
+    LbContextImpl lb_context(hash_key);
+    Upstream::HostConstSharedPtr host =
+        cluster->loadBalancer().chooseHost(&lb_context);
+    if (host == nullptr) {
+      cluster->info()->stats().upstream_cx_none_healthy_.inc();
+      return nullptr;
+    }
+
+    ActiveClient *client = chooseClient(host);
+    if (client == nullptr) {
+      host->cluster().stats().upstream_rq_pending_overflow_.inc();
+      return nullptr;
+    }
+    return client->makeRequest(request, callbacks);
+  }
+
+private:
+  struct ActiveRequest : public PendingRequest {
+    ActiveRequest(RequestCallbacks<T> &callbacks) : callbacks_(&callbacks) {}
+
+    // Tcp::PipelinedClient::PendingRequest
+    void cancel() override {
+      ASSERT(callbacks_ != nullptr);
+      callbacks_ = nullptr;
+    }
+
+    RequestCallbacks<T> *callbacks_;
+  };
+
+  struct ActiveClient : public ConnPoolNats::PoolCallbacks<T>,
+                        public Network::ConnectionCallbacks,
+                        public Event::DeferredDeletable {
+    ActiveClient(InstanceImpl &parent, Upstream::HostConstSharedPtr host)
+        : parent_(parent), host_(host) {}
+
+    PendingRequest *makeRequest(const T &request,
+                                RequestCallbacks<T> &callbacks) {
+      // the requests are only taken from the front, which leaves the others
+      // where they are.
+      pending_requests_.emplace_back(callbacks);
+      client_->makeRequest(request);
+      return &pending_requests_.back();
+    }
+
+    // Tcp::ConnPoolNats::PoolCallbacks
+    void onResponse(MessagePtr<T> &&value) override {
+      if (pending_requests_.empty()) {
+        // a response to no request leaves the others unmatched.
+        host_->cluster().stats().upstream_cx_protocol_error_.inc();
+        client_->close();
+        return;
+      }
+      RequestCallbacks<T> *callbacks = pending_requests_.front().callbacks_;
+      pending_requests_.pop_front();
+      if (callbacks != nullptr) {
+        callbacks->onResponse(std::move(value));
+      } else {
+        host_->cluster().stats().upstream_rq_cancelled_.inc();
+      }
+    }
+    void onClose() override {}
+    void onAboveWriteBufferHighWatermark() override {
+      above_write_buffer_high_watermark_ = true;
+    }
+    void onBelowWriteBufferLowWatermark() override {
+      above_write_buffer_high_watermark_ = false;
+    }
+
+    // Network::ConnectionCallbacks
+    void onEvent(Network::ConnectionEvent event) override {
+      if (event != Network::ConnectionEvent::RemoteClose &&
+          event != Network::ConnectionEvent::LocalClose) {
+        return;
+      }
+      if (!pending_requests_.empty()) {
+        host_->cluster().stats().upstream_cx_destroy_with_active_rq_.inc();
+      }
+      std::deque<ActiveRequest> pending_requests;
+      pending_requests.swap(pending_requests_);
+      for (ActiveRequest &request : pending_requests) {
+        if (request.callbacks_ != nullptr) {
+          request.callbacks_->onFailure();
+        }
+      }
+      parent_.onClientClosed(*this);
+    }
+
+    InstanceImpl &parent_;
+    Upstream::HostConstSharedPtr host_;
+    ConnPoolNats::ClientPtr<T> client_;
+    std::deque<ActiveRequest> pending_requests_;
+    bool above_write_buffer_high_watermark_{};
+  };
+
+  typedef std::unique_ptr<ActiveClient> ActiveClientPtr;
+
+  struct LbContextImpl : public Upstream::LoadBalancerContextBase {
+    LbContextImpl(const std::string &hash_key)
+        : hash_key_(HashUtil::xxHash64(hash_key)) {}
+    // Upstream::LoadBalancerContext
+    absl::optional<uint64_t> computeHashKey() override { return hash_key_; }
+
+    const absl::optional<uint64_t> hash_key_;
+  };
+
+  // the connection of the host with the fewest outstanding requests, or a new
+  // one if that one is busy and there is room for another, or nullptr if all
+  // of them are full.
+  ActiveClient *chooseClient(const Upstream::HostConstSharedPtr &host) {
+    std::vector<ActiveClientPtr> &clients = clients_[host];
+    ActiveClient *chosen = nullptr;
+    for (ActiveClientPtr &client : clients) {
+      if (!client->above_write_buffer_high_watermark_ &&
+          (chosen == nullptr || client->pending_requests_.size() <
+                                    chosen->pending_requests_.size())) {
+        chosen = client.get();
+      }
+    }
+    if ((chosen == nullptr || !chosen->pending_requests_.empty()) &&
+        clients.size() < config_.connectionsPerHost()) {
+      clients.push_back(std::make_unique<ActiveClient>(*this, host));
+      chosen = clients.back().get();
+      chosen->client_ =
+          client_factory_.create(host, dispatcher_, *chosen, config_);
+      chosen->client_->addConnectionCallbacks(*chosen);
+    }
+    if (chosen == nullptr ||
+        chosen->pending_requests_.size() >=
+            config_.maxOutstandingRequestsPerConnection()) {
+      return nullptr;
+    }
+    return chosen;
+  }
+
+  void onClientClosed(ActiveClient &client) {
+    auto it = clients_.find(client.host_);
+    if (it == clients_.end()) {
+      return;
+    }
+    std::vector<ActiveClientPtr> &clients = it->second;
+    for (auto client_it = clients.begin(); client_it != clients.end();
+         client_it++) {
+      if (client_it->get() == &client) {
+        dispatcher_.deferredDelete(std::move(*client_it));
+        clients.erase(client_it);
+        break;
+      }
+    }
+    if (clients.empty()) {
+      clients_.erase(it);
+    }
+  }
+
+  void onClusterChanged(Upstream::ThreadLocalCluster &cluster) {
+    cluster_ = &cluster;
+    member_update_cb_handle_ = cluster.prioritySet().addMemberUpdateCb(
+        [this](const Upstream::HostVector &,
+               const Upstream::HostVector &hosts_removed) -> void {
+          onHostsRemoved(hosts_removed);
+        });
+  }
+
+  void onHostsRemoved(const Upstream::HostVector &hosts_removed) {
+    for (const Upstream::HostSharedPtr &host : hosts_removed) {
+      auto it = clients_.find(Upstream::HostConstSharedPtr{host});
+      if (it == clients_.end()) {
+        continue;
+      }
+      std::vector<ActiveClientPtr> clients = std::move(it->second);
+      clients_.erase(it);
+      for (ActiveClientPtr &client : clients) {
+        client->client_->close();
+        dispatcher_.deferredDelete(std::move(client));
+      }
+    }
+  }
+
+  const std::string cluster_name_;
+  Upstream::ClusterManager &cm_;
+  ConnPoolNats::ClientFactory<T> &client_factory_;
+  Event::Dispatcher &dispatcher_;
+  const Config &config_;
+  Upstream::ThreadLocalCluster *cluster_{};
+  Common::CallbackHandlePtr member_update_cb_handle_;
+  absl::flat_hash_map<Upstream::HostConstSharedPtr,
+                      std::vector<ActiveClientPtr>>
+      clients_;
+};
+
+} // namespace PipelinedClient
+} // namespace Tcp
+} // namespace Envoy
@@ -0,0 +1,348 @@
+#include "source/extensions/filters/http/aws_lambda/api_gateway_transformer.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "envoy/registry/registry.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
+#include "source/common/protobuf/utility.h"
+#include "source/extensions/filters/http/transformation/body_base64.h"
+#include "source/extensions/filters/http/transformation/json_escape.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+using Transformation::appendJsonString;
+
+// the values of each name, with the names in the order they first appear.
+template <class Value> class OrderedMultiMap {
+public:
+  using Entry = std::pair<absl::string_view, std::vector<Value>>;
+
+  void add(absl::string_view name, Value value) {
+    auto inserted = index_.try_emplace(name, entries_.size());
+    if (inserted.second) {
+      entries_.emplace_back(name, std::vector<Value>());
+    }
+    entries_[inserted.first->second].second.push_back(std::move(value));
+  }
+
+  bool empty() const { return entries_.empty(); }
+  const std::vector<Entry> &entries() const { return entries_; }
+
+private:
+  absl::flat_hash_map<absl::string_view, size_t> index_;
+  std::vector<Entry> entries_;
+};
+
+// the decoded names and values of a query string. The names are kept in
+// names_, so that the map can refer to them.
+struct QueryParameters {
+  std::vector<std::string> names_;
+  OrderedMultiMap<std::string> values_;
+};
+
+void parseQuery(absl::string_view query, QueryParameters &parameters) {
+  std::vector<absl::string_view> pairs =
+      absl::StrSplit(query, '&', absl::SkipEmpty());
+  parameters.names_.reserve(pairs.size());
+  for (absl::string_view pair : pairs) {
+    const size_t equal = pair.find('=');
+    parameters.names_.push_back(
+        Http::Utility::PercentEncoding::decode(pair.substr(0, equal)));
+    parameters.values_.add(
+        parameters.names_.back(),
+        equal == absl::string_view::npos
+            ? std::string()
+            : Http::Utility::PercentEncoding::decode(pair.substr(equal + 1)));
+  }
+}
+
+void addKey(Buffer::Instance &event, absl::string_view name) {
+  appendJsonString(event, name);
+  event.add(":", 1);
+}
+
+void addField(Buffer::Instance &event, absl::string_view name,
+              absl::string_view value) {
+  addKey(event, name);
+  appendJsonString(event, value);
+  event.add(",", 1);
+}
+
+// writes an object with the last value of each name, as API Gateway does in
+// the single value fields of the v1 payload.
+template <class Value>
+void addLastValues(Buffer::Instance &event,
+                   const OrderedMultiMap<Value> &values) {
+  event.add("{", 1);
+  bool first = true;
+  for (const auto &entry : values.entries()) {
+    if (!first) {
+      event.add(",", 1);
+    }
+    first = false;
+    addKey(event, entry.first);
+    appendJsonString(event, entry.second.back());
+  }
+  event.add("}", 1);
+}
+
+template <class Value>
+void addAllValues(Buffer::Instance &event,
+                  const OrderedMultiMap<Value> &values) {
+  event.add("{", 1);
+  bool first = true;
+  for (const auto &entry : values.entries()) {
+    if (!first) {
+      event.add(",", 1);
+    }
+    first = false;
+    addKey(event, entry.first);
+    event.add("[", 1);
+    for (size_t i = 0; i < entry.second.size(); i++) {
+      if (i != 0) {
+        event.add(",", 1);
+      }
+      appendJsonString(event, entry.second[i]);
+    }
+    event.add("]", 1);
+  }
+  event.add("}", 1);
+}
+
+// writes an object with the values of each name joined with commas, as in the
+// v2 payload.
+template <class Value>
+void addJoinedValues(Buffer::Instance &event,
+                     const OrderedMultiMap<Value> &values) {
+  event.add("{", 1);
+  bool first = true;
+  for (const auto &entry : values.entries()) {
+    if (!first) {
+      event.add(",", 1);
+    }
+    first = false;
+    addKey(event, entry.first);
+    if (entry.second.size() == 1) {
+      appendJsonString(event, entry.second[0]);
+    } else {
+      appendJsonString(event, absl::StrJoin(entry.second, ","));
+    }
+  }
+  event.add("}", 1);
+}
+
+// the headers of the request, without the pseudo headers.
+OrderedMultiMap<absl::string_view>
+requestHeaders(const Http::RequestHeaderMap &headers,
+               std::vector<absl::string_view> *cookies) {
+  OrderedMultiMap<absl::string_view> values;
+  headers.iterate([&values, cookies](const Http::HeaderEntry &header) {
+    const absl::string_view name = header.key().getStringView();
+    const absl::string_view value = header.value().getStringView();
+    if (absl::StartsWith(name, ":")) {
+      return Http::HeaderMap::Iterate::Continue;
+    }
+    if (cookies != nullptr && name == Http::Headers::get().Cookie.get()) {
+      for (absl::string_view cookie :
+           absl::StrSplit(value, ';', absl::SkipWhitespace())) {
+        cookies->push_back(absl::StripAsciiWhitespace(cookie));
+      }
+      return Http::HeaderMap::Iterate::Continue;
+    }
+    values.add(name, value);
+    return Http::HeaderMap::Iterate::Continue;
+  });
+  return values;
+}
+
+} // namespace
+
+ApiGatewayTransformer::ApiGatewayTransformer(
+    const ApiGatewayTransformerProto &config)
+    : payload_version_(config.payload_version()),
+      base64_encode_body_(config.base64_encode_body()) {}
+
+void ApiGatewayTransformer::transform(
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+    Http::StreamFilterCallbacks &) const {
+  if (request_headers == nullptr) {
+    throw EnvoyException(
+        "the api gateway transformer only transforms requests");
+  }
+
+  Buffer::OwnedImpl event;
+  if (payload_version_ == ApiGatewayTransformerProto::V2) {
+    writeV2(*request_headers, body, event);
+  } else {
+    writeV1(*request_headers, body, event);
+  }
+
+  body.drain(body.length());
+  body.move(event);
+  header_map.setReferenceContentType(
+      Http::Headers::get().ContentTypeValues.Json);
+  header_map.setContentLength(body.length());
+}
+
+void ApiGatewayTransformer::writeV1(const Http::RequestHeaderMap &headers,
+                                    Buffer::Instance &body,
+                                    Buffer::Instance &event) const {
+  const absl::string_view path = headers.getPathValue();
+  const size_t query_start = path.find('?');
+  const absl::string_view raw_path = path.substr(0, query_start);
+  QueryParameters query;
+  if (query_start != absl::string_view::npos) {
+    parseQuery(path.substr(query_start + 1), query);
+  }
+  const OrderedMultiMap<absl::string_view> values =
+      requestHeaders(headers, nullptr);
+
+  event.add("{", 1);
+  addField(event, "path", raw_path);
+  addField(event, "httpMethod", headers.getMethodValue());
+  addKey(event, "headers");
+  addLastValues(event, values);
+  event.add(",", 1);
+  addKey(event, "multiValueHeaders");
+  addAllValues(event, values);
+  event.add(",", 1);
+  addKey(event, "queryStringParameters");
+  if (query.values_.empty()) {
+    event.add("null");
+  } else {
+    addLastValues(event, query.values_);
+  }
+  event.add(",", 1);
+  addKey(event, "multiValueQueryStringParameters");
+  if (query.values_.empty()) {
+    event.add("null");
+  } else {
+    addAllValues(event, query.values_);
+  }
+  event.add(",\"pathParameters\":null,\"stageVariables\":null,");
+  addKey(event, "requestContext");
+  event.add("{", 1);
+  addField(event, "path", raw_path);
+  addKey(event, "httpMethod");
+  appendJsonString(event, headers.getMethodValue());
+  event.add("},", 2);
+  writeBody(body, event);
+  event.add("}", 1);
+}
+
+void ApiGatewayTransformer::writeV2(const Http::RequestHeaderMap &headers,
+                                    Buffer::Instance &body,
+                                    Buffer::Instance &event) const {
+  const absl::string_view path = headers.getPathValue();
+  const size_t query_start = path.find('?');
+  const absl::string_view raw_path = path.substr(0, query_start);
+  const absl::string_view raw_query = query_start == absl::string_view::npos
+                                          ? absl::string_view()
+                                          : path.substr(query_start + 1);
+  QueryParameters query;
+  parseQuery(raw_query, query);
+  std::vector<absl::string_view> cookies;
+  const OrderedMultiMap<absl::string_view> values =
+      requestHeaders(headers, &cookies);
+
+  event.add("{\"version\":\"2.0\",\"routeKey\":\"$default\",");
+  addField(event, "rawPath", raw_path);
+  addField(event, "rawQueryString", raw_query);
+  if (!cookies.empty()) {
+    addKey(event, "cookies");
+    event.add("[", 1);
+    for (size_t i = 0; i < cookies.size(); i++) {
+      if (i != 0) {
+        event.add(",", 1);
+      }
+      appendJsonString(event, cookies[i]);
+    }
+    event.add("],", 2);
+  }
+  addKey(event, "headers");
+  addJoinedValues(event, values);
+  event.add(",", 1);
+  if (!query.values_.empty()) {
+    addKey(event, "queryStringParameters");
+    addJoinedValues(event, query.values_);
+    event.add(",", 1);
+  }
+  addKey(event, "requestContext");
+  event.add("{\"http\":{");
+  addField(event, "method", headers.getMethodValue());
+  addKey(event, "path");
+  appendJsonString(event, raw_path);
+  const absl::string_view user_agent = headers.getUserAgentValue();
+  if (!user_agent.empty()) {
+    event.add(",", 1);
+    addKey(event, "userAgent");
+    appendJsonString(event, user_agent);
+  }
+  event.add("}},", 3);
+  writeBody(body, event);
+  event.add("}", 1);
+}
+
+void ApiGatewayTransformer::writeBody(Buffer::Instance &body,
+                                      Buffer::Instance &event) const {
+  if (body.length() == 0) {
+    event.add("\"body\":null,\"isBase64Encoded\":false");
+    return;
+  }
+  if (!base64_encode_body_) {
+    // a body that is not valid UTF-8 can't be a json string, and is encoded
+    // instead.
+    Buffer::OwnedImpl escaped;
+    try {
+      appendJsonString(escaped,
+                       absl::string_view(static_cast<const char *>(
+                                             body.linearize(body.length())),
+                                         body.length()));
+      addKey(event, "body");
+      event.move(escaped);
+      event.add(",\"isBase64Encoded\":false");
+      return;
+    } catch (const EnvoyException &) {
+    }
+  }
+  addKey(event, "body");
+  event.add("\"", 1);
+  Transformation::base64EncodeBody(body, event);
+  event.add("\",\"isBase64Encoded\":true");
+}
+
+Transformation::TransformerConstSharedPtr
+ApiGatewayTransformerFactory::createTransformer(
+    const Protobuf::Message &config,
+    Server::Configuration::CommonFactoryContext &) {
+  return std::make_shared<ApiGatewayTransformer>(
+      dynamic_cast<const ApiGatewayTransformerProto &>(config));
+}
+
+/**
+ * Static registration for the API Gateway transformer. @see RegisterFactory.
+ */
+REGISTER_FACTORY(ApiGatewayTransformerFactory,
+                 Transformation::TransformerExtensionFactory);
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
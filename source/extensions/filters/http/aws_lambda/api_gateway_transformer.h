@@ -0,0 +1,61 @@
+#pragma once
+
+#include "source/extensions/filters/http/transformation/transformation_filter_config.h"
+
+#include "api/envoy/config/filter/http/aws_lambda/v2/api_gateway_transformer.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+using ApiGatewayTransformerProto =
+    envoy::config::filter::http::aws_lambda::v2::ApiGatewayTransformer;
+
+/**
+ * Replaces the body of a request with the API Gateway proxy event of the
+ * request. The event json is written into the body in one pass over the
+ * headers, the query string and the body, without building a json document.
+ */
+class ApiGatewayTransformer : public Transformation::Transformer {
+public:
+  explicit ApiGatewayTransformer(const ApiGatewayTransformerProto &config);
+
+  bool passthrough_body() const override { return false; }
+  void transform(Http::RequestOrResponseHeaderMap &header_map,
+                 Http::RequestHeaderMap *request_headers,
+                 Buffer::Instance &body,
+                 Http::StreamFilterCallbacks &callbacks) const override;
+
+private:
+  void writeV1(const Http::RequestHeaderMap &headers, Buffer::Instance &body,
+               Buffer::Instance &event) const;
+  void writeV2(const Http::RequestHeaderMap &headers, Buffer::Instance &body,
+               Buffer::Instance &event) const;
+  // writes the "body" and "isBase64Encoded" fields.
+  void writeBody(Buffer::Instance &body, Buffer::Instance &event) const;
+
+  const ApiGatewayTransformerProto::PayloadVersion payload_version_;
+  const bool base64_encode_body_;
+};
+
+class ApiGatewayTransformerFactory
+    : public Transformation::TransformerExtensionFactory {
+public:
+  std::string name() const override {
+    return "io.solo.transformer.aws_lambda_api_gateway";
+  }
+
+  Transformation::TransformerConstSharedPtr
+  createTransformer(const Protobuf::Message &config,
+                    Server::Configuration::CommonFactoryContext &) override;
+
+  ProtobufTypes::MessagePtr createEmptyConfigProto() override {
+    return std::make_unique<ApiGatewayTransformerProto>();
+  }
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
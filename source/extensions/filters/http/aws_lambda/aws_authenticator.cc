@@ -1,8 +1,8 @@
 #include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
 
 #include <algorithm>
-#include <list>
 #include <string>
+#include <utility>
 
 #include "envoy/http/header_map.h"
 
@@ -14,6 +14,8 @@
 #include "source/common/http/utility.h"
 #include "source/common/singleton/const_singleton.h"
 
+#include "absl/strings/str_cat.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -40,88 +42,87 @@ AwsAuthenticator::AwsAuthenticator(TimeSource &time_source,
 // call to authenticator. Data may be added prior to this call.
 void AwsAuthenticator::init(const std::string *access_key,
                             const std::string *secret_key,
-                            const std::string *session_token) {
+                            const std::string *session_token,
+                            SigningKeyCache *signing_keys,
+                            SigningTimeCache *signing_times) {
   access_key_ = access_key;
   session_token_ = session_token;
+  signing_keys_ = signing_keys;
+  signing_times_ = signing_times;
   const std::string &secret_key_ref = *secret_key;
   first_key_ = "AWS4" + secret_key_ref;
 }
 
 AwsAuthenticator::~AwsAuthenticator() {}
 
+HeaderList::HeaderList(std::vector<Http::LowerCaseString> headers)
+    : headers_(std::move(headers)) {
+  std::sort(headers_.begin(), headers_.end(),
+            [](const Http::LowerCaseString &i, const Http::LowerCaseString &j) {
+              return i.get() < j.get();
+            });
+  headers_.erase(std::unique(headers_.begin(), headers_.end()),
+                 headers_.end());
+  for (const Http::LowerCaseString &header : headers_) {
+    if (!signed_headers_.empty()) {
+      signed_headers_.push_back(';');
+    }
+    signed_headers_.append(header.get());
+  }
+}
+
 HeaderList AwsAuthenticator::createHeaderToSign(
     std::initializer_list<Http::LowerCaseString> headers) {
-  // A C++ set is sorted. which is required by AWS signature algorithm.
-  HeaderList ret(AwsAuthenticator::lowercasecompare);
-  ret.insert(headers);
-  ret.insert(AwsAuthenticatorConsts::get().DateHeader);
-  return ret;
+  std::vector<Http::LowerCaseString> list(headers);
+  list.push_back(AwsAuthenticatorConsts::get().DateHeader);
+  return HeaderList(std::move(list));
 }
 
 void AwsAuthenticator::updatePayloadHash(const Buffer::Instance &data) {
   body_sha_.update(data);
 }
 
-bool AwsAuthenticator::lowercasecompare(const Http::LowerCaseString &i,
-                                        const Http::LowerCaseString &j) {
-  return (i.get() < j.get());
+void AwsAuthenticator::updatePayloadHash(absl::string_view data) {
+  body_sha_.update(data);
 }
 
-std::string AwsAuthenticator::addDate(
-    std::chrono::time_point<std::chrono::system_clock> now) {
-  // TODO(yuval-k): This can be cached or optimized if needed
-  std::string request_date_time = DateFormatter("%Y%m%dT%H%M%SZ").fromTime(now);
+void AwsAuthenticator::addDate(const std::string &request_date_time) {
   request_headers_->addReferenceKey(AwsAuthenticatorConsts::get().DateHeader,
                                     request_date_time);
-  return request_date_time;
 }
 
-std::pair<std::string, std::string>
-AwsAuthenticator::prepareHeaders(const HeaderList &headers_to_sign) {
-  std::stringstream canonical_headers_stream;
-  std::stringstream signed_headers_stream;
-
-  for (auto header = headers_to_sign.begin(), end = headers_to_sign.end();
-       header != end; header++) {
-
+const std::string &
+AwsAuthenticator::prepareHeaders(const HeaderList &headers_to_sign,
+                                 HeaderEntries &entries,
+                                 std::string &signed_headers_storage) {
+  for (const Http::LowerCaseString &header : headers_to_sign) {
     const Http::HeaderEntry *headerEntry{};
-    if (*header == AwsAuthenticatorConsts::get().Host) {
+    if (header == AwsAuthenticatorConsts::get().Host) {
       headerEntry = request_headers_->Host();
     } else {
-      const auto getter = request_headers_->get(*header);
+      const auto getter = request_headers_->get(header);
       if (!getter.empty()) {
         headerEntry = getter[0];
       }
-      
     }
 
     // Should not happen, need to check now that envoy does not default header entries
     if (headerEntry == nullptr) {
       continue;
     }
+    entries.emplace_back(&header, headerEntry);
+  }
 
-    auto headerName = header->get();
-    canonical_headers_stream << headerName;
-    signed_headers_stream << headerName;
-
-    canonical_headers_stream << ':';
-    if (headerEntry != nullptr) {
-      canonical_headers_stream << headerEntry->value().getStringView();
-      // TODO: add warning if null
-    }
-    canonical_headers_stream << '\n';
-    HeaderList::const_iterator next = header;
-    next++;
-    if (next != end) {
-      signed_headers_stream << ";";
+  if (entries.size() == headers_to_sign.size()) {
+    return headers_to_sign.signedHeaders();
+  }
+  for (const auto &entry : entries) {
+    if (!signed_headers_storage.empty()) {
+      signed_headers_storage.push_back(';');
     }
+    signed_headers_storage.append(entry.first->get());
   }
-  std::string canonical_headers = canonical_headers_stream.str();
-  std::string signed_headers = signed_headers_stream.str();
-
-  std::pair<std::string, std::string> pair =
-      std::make_pair(std::move(canonical_headers), std::move(signed_headers));
-  return pair;
+  return signed_headers_storage;
 }
 
 std::string AwsAuthenticator::getBodyHexSha() {
@@ -144,7 +145,7 @@ void AwsAuthenticator::fetchUrl() {
 }
 
 std::string AwsAuthenticator::computeCanonicalRequestHash(
-    const std::string &request_method, const std::string &canonical_headers,
+    const std::string &request_method, const HeaderEntries &headers,
     const std::string &signed_headers, const std::string &hexpayload) {
 
   // Do iternal classes for sha and hmac.
@@ -158,7 +159,14 @@ std::string AwsAuthenticator::computeCanonicalRequestHash(
     canonicalRequestHash.update(query_string_);
   }
   canonicalRequestHash.update('\n');
-  canonicalRequestHash.update(canonical_headers);
+  // the canonical headers are hashed as they are read from the request,
+  // rather than joined into a string first.
+  for (const auto &header : headers) {
+    canonicalRequestHash.update(header.first->get());
+    canonicalRequestHash.update(':');
+    canonicalRequestHash.update(header.second->value().getStringView());
+    canonicalRequestHash.update('\n');
+  }
   canonicalRequestHash.update('\n');
   canonicalRequestHash.update(signed_headers);
   canonicalRequestHash.update('\n');
@@ -181,37 +189,61 @@ std::string
 AwsAuthenticator::getCredntialScope(const std::string &region,
                                     const std::string &credentials_scope_date) {
 
-  std::stringstream credential_scope_stream;
-  credential_scope_stream << credentials_scope_date << "/" << region << "/"
-                          << (*service_) << "/aws4_request";
-  return credential_scope_stream.str();
+  return absl::StrCat(credentials_scope_date, "/", region, "/", *service_,
+                      "/aws4_request");
 }
 
-std::string AwsAuthenticator::computeSignature(
-    const std::string &region, const std::string &credentials_scope_date,
-    const std::string &credential_scope, const std::string &request_date_time,
-    const std::string &hashed_canonical_request) {
+void AwsAuthenticator::deriveSigningKey(
+    const std::string &credentials_scope_date, const std::string &region,
+    SigningKeyCache::Key &out) {
   static const std::string aws_request = "aws4_request";
 
-  HMACSha256 sighmac;
-  unsigned int out_len = sighmac.length();
-  absl::FixedArray<uint8_t> out(out_len);
+  HMACSha256 keyhmac;
+  unsigned int out_len = keyhmac.length();
+  RELEASE_ASSERT(out_len == out.size(), "");
+  keyhmac.init(first_key_);
+  keyhmac.update(credentials_scope_date);
+  keyhmac.finalize(out.data(), &out_len);
 
-  sighmac.init(first_key_);
-  sighmac.update(credentials_scope_date);
-  sighmac.finalize(out.begin(), &out_len);
+  recusiveHmacHelper(keyhmac, out.data(), out_len, region);
+  recusiveHmacHelper(keyhmac, out.data(), out_len, *service_);
+  recusiveHmacHelper(keyhmac, out.data(), out_len, aws_request);
+}
 
-  recusiveHmacHelper(sighmac, out.begin(), out_len, region);
-  recusiveHmacHelper(sighmac, out.begin(), out_len, *service_);
-  recusiveHmacHelper(sighmac, out.begin(), out_len, aws_request);
+std::string AwsAuthenticator::computeSignature(
+    const std::string &region, const std::string &credentials_scope_date,
+    const std::string &credential_scope, const std::string &request_date_time,
+    const std::string &hashed_canonical_request) {
   const auto &nl = AwsAuthenticatorConsts::get().Newline;
+  const std::initializer_list<const std::string *> string_to_sign{
+      &AwsAuthenticatorConsts::get().Algorithm, &nl, &request_date_time, &nl,
+      &credential_scope, &nl, &hashed_canonical_request};
+
+  SigningKeyCache::Key out;
+  unsigned int out_len = out.size();
+  if (signing_keys_ == nullptr) {
+    deriveSigningKey(credentials_scope_date, region, out);
+    HMACSha256 sighmac;
+    recusiveHmacHelper(sighmac, out.data(), out_len, string_to_sign);
+    return Hex::encode(out.data(), out_len);
+  }
 
-  recusiveHmacHelper<std::initializer_list<const std::string *>>(
-      sighmac, out.begin(), out_len,
-      {&AwsAuthenticatorConsts::get().Algorithm, &nl, &request_date_time, &nl,
-       &credential_scope, &nl, &hashed_canonical_request});
-
-  return Hex::encode(out.begin(), out_len);
+  // the signing key only depends on the secret key and the credential scope,
+  // which the secret key is keyed by.
+  std::string scope = absl::StrCat(first_key_, "/", credential_scope);
+  const SigningKeyCache::KeyedHmac *keyed = signing_keys_->find(scope);
+  if (keyed == nullptr) {
+    deriveSigningKey(credentials_scope_date, region, out);
+    keyed = &signing_keys_->insert(std::move(scope), out);
+  }
+  // the pads of the key were hashed when it was cached, which leaves the
+  // string to sign.
+  HMACSha256 sighmac(signing_keys_->scratch());
+  sighmac.init(keyed->context());
+  sighmac.update(string_to_sign);
+  sighmac.finalize(out.data(), &out_len);
+
+  return Hex::encode(out.data(), out_len);
 }
 
 void AwsAuthenticator::sign(Http::RequestHeaderMap *request_headers,
@@ -233,44 +265,107 @@ std::string AwsAuthenticator::signWithTime(
     std::chrono::time_point<std::chrono::system_clock> now) {
   request_headers_ = request_headers;
 
-  std::string request_date_time = addDate(now);
+  // the date strings are formatted here when there is no cache to take them
+  // from.
+  std::string formatted_date_time;
+  std::string formatted_scope_date;
+  std::string formatted_scope;
+  const std::string *request_date_time = &formatted_date_time;
+  const std::string *credentials_scope_date = &formatted_scope_date;
+  const std::string *credential_scope = &formatted_scope;
+  if (signing_times_ != nullptr) {
+    signing_times_->refresh(now);
+    request_date_time = &signing_times_->requestDateTime();
+    credentials_scope_date = &signing_times_->scopeDate();
+    credential_scope = &signing_times_->scope(region, *service_);
+  } else {
+    formatted_date_time = DateFormatter("%Y%m%dT%H%M%SZ").fromTime(now);
+    formatted_scope_date = getCredntialScopeDate(now);
+    formatted_scope = getCredntialScope(region, formatted_scope_date);
+  }
+  addDate(*request_date_time);
 
   // Add session token header if present
   if (session_token_ != nullptr) {
     request_headers->addCopy(AwsAuthenticatorConsts::get().SecurityTokenHeader,
                              (*session_token_));
   }
+  if (unsigned_payload_) {
+    request_headers->setReferenceKey(
+        AwsAuthenticatorConsts::get().ContentSha256Header,
+        AwsAuthenticatorConsts::get().UnsignedPayload);
+  }
 
-  auto &&preparedHeaders = prepareHeaders(headers_to_sign);
-  std::string canonical_headers = std::move(preparedHeaders.first);
-  std::string signed_headers = std::move(preparedHeaders.second);
+  HeaderEntries header_entries;
+  std::string signed_headers_storage;
+  const std::string &signed_headers =
+      prepareHeaders(headers_to_sign, header_entries, signed_headers_storage);
 
-  std::string hexpayload = getBodyHexSha();
+  const std::string hexpayload =
+      unsigned_payload_ ? AwsAuthenticatorConsts::get().UnsignedPayload
+                        : getBodyHexSha();
 
   fetchUrl();
 
   std::string hashed_canonical_request = computeCanonicalRequestHash(
-      *method_, canonical_headers, signed_headers, hexpayload);
-  std::string credentials_scope_date = getCredntialScopeDate(now);
-  std::string CredentialScope =
-      getCredntialScope(region, credentials_scope_date);
-
+      *method_, header_entries, signed_headers, hexpayload);
   std::string signature =
-      computeSignature(region, credentials_scope_date, CredentialScope,
-                       request_date_time, hashed_canonical_request);
-
-  std::stringstream authorizationvalue;
+      computeSignature(region, *credentials_scope_date, *credential_scope,
+                       *request_date_time, hashed_canonical_request);
 
   // TODO(talnordan): Provide `DETAILS`.
   RELEASE_ASSERT(access_key_, "");
 
-  authorizationvalue << AwsAuthenticatorConsts::get().Algorithm
-                     << " Credential=" << (*access_key_) << "/"
-                     << CredentialScope << ", SignedHeaders=" << signed_headers
-                     << ", Signature=" << signature;
-  return authorizationvalue.str();
+  return absl::StrCat(AwsAuthenticatorConsts::get().Algorithm,
+                      " Credential=", *access_key_, "/", *credential_scope,
+                      ", SignedHeaders=", signed_headers,
+                      ", Signature=", signature);
 }
 
+void SigningTimeCache::refresh(SystemTime now) {
+  const int64_t second =
+      std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch())
+          .count();
+  if (second_ == second) {
+    return;
+  }
+  second_ = second;
+  request_date_time_ = DateFormatter("%Y%m%dT%H%M%SZ").fromTime(now);
+  // the scope date is the date part of the timestamp.
+  const absl::string_view date =
+      absl::string_view(request_date_time_).substr(0, 8);
+  if (date != scope_date_) {
+    scope_date_ = std::string(date);
+    scopes_.clear();
+  }
+}
+
+const std::string &SigningTimeCache::scope(absl::string_view region,
+                                           absl::string_view service) {
+  auto &regions = scopes_[service];
+  auto it = regions.find(region);
+  if (it == regions.end()) {
+    it = regions
+             .emplace(region, absl::StrCat(scope_date_, "/", region, "/",
+                                           service, "/aws4_request"))
+             .first;
+  }
+  return it->second;
+}
+
+SigningKeyCache::KeyedHmac::KeyedHmac(const Key &key) {
+  HMAC_CTX_init(&context_);
+  RELEASE_ASSERT(HMAC_Init_ex(&context_, key.data(), key.size(), EVP_sha256(),
+                              nullptr) == 1,
+                 "");
+}
+
+SigningKeyCache::KeyedHmac::~KeyedHmac() { HMAC_CTX_cleanup(&context_); }
+
+SigningKeyCache::SigningKeyCache() { HMAC_CTX_init(&scratch_); }
+
+SigningKeyCache::~SigningKeyCache() { HMAC_CTX_cleanup(&scratch_); }
+
 AwsAuthenticator::Sha256::Sha256() { SHA256_Init(&context_); }
 
 void AwsAuthenticator::Sha256::update(const Buffer::Instance &data) {
@@ -301,11 +396,20 @@ void AwsAuthenticator::Sha256::finalize(uint8_t *out) {
   SHA256_Final(out, &context_);
 }
 
-AwsAuthenticator::HMACSha256::HMACSha256() : evp_(EVP_sha256()) {
-  HMAC_CTX_init(&context_);
+AwsAuthenticator::HMACSha256::HMACSha256()
+    : context_(own_context_), evp_(EVP_sha256()) {
+  HMAC_CTX_init(&own_context_);
 }
 
-AwsAuthenticator::HMACSha256::~HMACSha256() { HMAC_CTX_cleanup(&context_); }
+AwsAuthenticator::HMACSha256::HMACSha256(HMAC_CTX &context)
+    : context_(context), evp_(EVP_sha256()) {
+  // left unused, and cleaned up as such.
+  HMAC_CTX_init(&own_context_);
+}
+
+AwsAuthenticator::HMACSha256::~HMACSha256() {
+  HMAC_CTX_cleanup(&own_context_);
+}
 
 size_t AwsAuthenticator::HMACSha256::length() const {
   return EVP_MD_size(evp_);
@@ -320,6 +424,13 @@ void AwsAuthenticator::HMACSha256::init(const uint8_t *bytes, size_t size) {
   firstinit = false;
 }
 
+void AwsAuthenticator::HMACSha256::init(const HMAC_CTX &keyed) {
+  // the digest states are copied into those of the context, which keeps
+  // their memory when it held the same digest before.
+  RELEASE_ASSERT(HMAC_CTX_copy_ex(&context_, &keyed) == 1, "");
+  firstinit = false;
+}
+
 void AwsAuthenticator::HMACSha256::update(const std::string &data) {
   update(reinterpret_cast<const uint8_t *>(data.c_str()), data.size());
 }
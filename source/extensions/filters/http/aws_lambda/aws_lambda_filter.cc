@@ -12,13 +12,18 @@
 #include "source/common/common/empty_string.h"
 #include "source/common/common/hex.h"
 #include "source/common/common/utility.h"
+#include "source/common/http/alb_response_parser.h"
+#include "source/common/http/header_map_impl.h"
 #include "source/common/http/headers.h"
 #include "source/common/http/solo_filter_utility.h"
 #include "source/common/http/utility.h"
 #include "source/common/singleton/const_singleton.h"
+#include "source/common/stats/timespan_impl.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
 
+#include "absl/strings/numbers.h"
+
 
 namespace Envoy {
 namespace Extensions {
@@ -33,6 +38,15 @@ struct RcDetailsValues {
   const std::string CredentialsNotFound = "aws_lambda_credentials_not_found";
   const std::string CredentialsNotFoundBody =
       "no credentials present for AWS upstream";
+  const std::string ConcurrencyLimited = "aws_lambda_concurrency_limited";
+  const std::string ConcurrencyLimitedBody =
+      "too many requests in flight to the function";
+  const std::string ResponseCached = "aws_lambda_response_cached";
+  const std::string PayloadTooLarge = "aws_lambda_payload_too_large";
+  const std::string PayloadTooLargeBody = "payload too large";
+  const std::string BodyBudgetExhausted = "aws_lambda_body_budget_exhausted";
+  const std::string BodyBudgetExhaustedBody = "buffered bodies over budget";
+  const std::string RespondedEarly = "aws_lambda_responded_early";
 };
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 } // namespace
@@ -54,12 +68,13 @@ const HeaderList AWSLambdaFilter::HeadersToSign =
     AwsAuthenticator::createHeaderToSign(
         {AWSLambdaHeaderNames::get().InvocationType,
          AWSLambdaHeaderNames::get().LogType, Http::Headers::get().HostLegacy,
-         Http::Headers::get().ContentType});
+         Http::Headers::get().ContentType,
+         AwsAuthenticatorConsts::get().ContentSha256Header});
 
 AWSLambdaFilter::AWSLambdaFilter(Upstream::ClusterManager &cluster_manager,
                                  Api::Api &api,
                                  AWSLambdaConfigConstSharedPtr filter_config)
-    : aws_authenticator_(api.timeSource()), cluster_manager_(cluster_manager),  
+    : time_source_(api.timeSource()), cluster_manager_(cluster_manager),
       filter_config_(filter_config){}
 
 AWSLambdaFilter::~AWSLambdaFilter() {}
@@ -67,10 +82,21 @@ AWSLambdaFilter::~AWSLambdaFilter() {}
 Http::FilterHeadersStatus
 AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
                                bool end_stream) {
-  protocol_options_ = Http::SoloFilterUtility::resolveProtocolOptions<
-      const AWSLambdaProtocolExtensionConfig>(
-      SoloHttpFilterNames::get().AwsLambda, decoder_callbacks_,
-      cluster_manager_);
+  const Http::FilterTime::Scope time(filter_time_);
+  ProtocolOptionsCache *protocol_options_cache =
+      filter_config_->protocolOptionsCache();
+  if (protocol_options_cache != nullptr) {
+    const std::string *cluster_name =
+        Http::SoloFilterUtility::resolveClusterName(decoder_callbacks_);
+    if (cluster_name != nullptr) {
+      protocol_options_ = protocol_options_cache->get(*cluster_name);
+    }
+  } else {
+    protocol_options_ = Http::SoloFilterUtility::resolveProtocolOptions<
+        const AWSLambdaProtocolExtensionConfig>(
+        SoloHttpFilterNames::get().AwsLambda, decoder_callbacks_,
+        cluster_manager_);
+  }
 
   if (!protocol_options_) {
     return Http::FilterHeadersStatus::Continue;
@@ -92,6 +118,49 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
         nullptr, absl::nullopt, RcDetails::get().FunctionNotFound);
     return Http::FilterHeadersStatus::StopIteration;
   }
+  aws_authenticator_ = std::make_unique<AwsAuthenticator>(time_source_);
+
+  if (function_on_route_->base64EncodeBody()) {
+    body_envelope_ = std::make_unique<BodyEnvelope>();
+    headers.setReferenceContentType(
+        Http::Headers::get().ContentTypeValues.Json);
+    // the length is known ahead when the body's is, so that a streamed body
+    // needn't be chunked.
+    uint64_t content_length;
+    if (absl::SimpleAtoi(headers.getContentLengthValue(), &content_length)) {
+      headers.setContentLength(BodyEnvelope::wrappedLength(content_length));
+    }
+  }
+
+  // the body is buffered to sign it, so one that won't fit in the buffer is
+  // rejected before it arrives.
+  if (!end_stream && !function_on_route_->unsignedPayload() &&
+      Http::SoloFilterUtility::contentLengthExceeds(
+          headers, decoder_callbacks_->decoderBufferLimit())) {
+    state_ = State::Responded;
+    decoder_callbacks_->sendLocalReply(
+        Http::Code::PayloadTooLarge, RcDetails::get().PayloadTooLargeBody,
+        nullptr, absl::nullopt, RcDetails::get().PayloadTooLarge);
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
+  if (end_stream && serveCachedResponse()) {
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
+  const ConcurrencyLimiterSharedPtr &concurrency_limiter =
+      function_on_route_->concurrencyLimiter();
+  if (concurrency_limiter != nullptr) {
+    if (!concurrency_limiter->tryAcquire(concurrency_epoch_)) {
+      // rejected right away, rather than adding to the throttling.
+      state_ = State::Responded;
+      decoder_callbacks_->sendLocalReply(
+          Http::Code::TooManyRequests, RcDetails::get().ConcurrencyLimitedBody,
+          nullptr, absl::nullopt, RcDetails::get().ConcurrencyLimited);
+      return Http::FilterHeadersStatus::StopIteration;
+    }
+    concurrency_limiter_ = concurrency_limiter;
+  }
 
   // If the state is still the initial, attempt to get credentials
   ASSERT(state_ == State::Init);
@@ -111,13 +180,17 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
       ENVOY_LOG(trace, "{}: stopping iteration to wait for STS credentials",
                 __func__);
       stopped_ = true;
+      waitForCredentials();
       return Http::FilterHeadersStatus::StopIteration;
     }
   }
 
-  if (end_stream) {
+  // with an unsigned payload the request can be signed before the body
+  // arrives, which then streams through.
+  if (end_stream || function_on_route_->unsignedPayload()) {
     lambdafy();
-    return Http::FilterHeadersStatus::Continue;
+    return respondEarly() ? Http::FilterHeadersStatus::StopIteration
+                          : Http::FilterHeadersStatus::Continue;
   }
 
   return Http::FilterHeadersStatus::StopIteration;
@@ -126,21 +199,55 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
 
 Http::FilterHeadersStatus 
 AWSLambdaFilter::encodeHeaders(Http::ResponseHeaderMap &headers, bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
+  if (served_from_cache_) {
+    // the cached response was unwrapped and transformed already.
+    return Http::FilterHeadersStatus::Continue;
+  }
 
-  if (!headers.get(AWSLambdaHeaderNames::get().FunctionError).empty()){
+  const bool function_error =
+      !headers.get(AWSLambdaHeaderNames::get().FunctionError).empty();
+  if (function_error){
     // We treat upstream function errors as if it was any other upstream error
     headers.setStatus(504);
   }
+  if (region_index_.has_value()) {
+    const uint64_t status = Http::Utility::getResponseStatus(headers);
+    recordRegion(function_error || status >= 500 ||
+                 status == enumToInt(Http::Code::TooManyRequests));
+  }
+  if (concurrency_limiter_ != nullptr) {
+    const uint64_t status = Http::Utility::getResponseStatus(headers);
+    if (function_error ||
+        status == enumToInt(Http::Code::TooManyRequests)) {
+      releaseConcurrency(ConcurrencyLimiter::Outcome::Throttled);
+    } else if (status >= 200 && status < 300) {
+      releaseConcurrency(ConcurrencyLimiter::Outcome::Success);
+    } else {
+      releaseConcurrency(ConcurrencyLimiter::Outcome::Ignored);
+    }
+  }
   response_headers_ = &headers;
+  if (functionOnRoute() != nullptr && functionOnRoute()->responseStreaming() &&
+      Http::Utility::getResponseStatus(headers) ==
+          enumToInt(Http::Code::OK)) {
+    // the payload that is forwarded is shorter than the framed stream.
+    headers.removeContentLength();
+    event_stream_decoder_ = std::make_unique<EventStreamDecoder>();
+  }
   if (isResponseTransformationNeeded() && !end_stream){
     // Stop iteration so that encodedata can mutate headers from alb json
     return Http::FilterHeadersStatus::StopIteration;
   }
+  if (end_stream) {
+    cacheResponse(Buffer::OwnedImpl());
+  }
   return Http::FilterHeadersStatus::Continue;
 }
 
 Http::FilterDataStatus AWSLambdaFilter::encodeData(
                                       Buffer::Instance &data, bool end_stream ){  
+  const Http::FilterTime::Scope time(filter_time_);
 
   if (state_ == State::Destroyed){
     // Safety against use after free if we exceed buffer limit 
@@ -149,8 +256,17 @@ Http::FilterDataStatus AWSLambdaFilter::encodeData(
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
 
+  if (served_from_cache_) {
+    return Http::FilterDataStatus::Continue;
+  }
+
+  if (event_stream_decoder_ != nullptr) {
+    return decodeEventStream(data, end_stream);
+  }
+
   if (!isResponseTransformationNeeded()){
     // return response as is if not configured for alb mode/transformation
+    bufferCachedResponse(data, end_stream);
     return Http::FilterDataStatus::Continue;
   }
 
@@ -167,8 +283,12 @@ Http::FilterDataStatus AWSLambdaFilter::encodeData(
 
 Http::FilterTrailersStatus 
 AWSLambdaFilter::encodeTrailers(Http::ResponseTrailerMap &) {
+  const Http::FilterTime::Scope time(filter_time_);
+  // the trailers are not cached, nor is the response they belong to.
+  cache_response_ = false;
+  cached_body_.reset();
 
-  if (!isResponseTransformationNeeded()){
+  if (served_from_cache_ || !isResponseTransformationNeeded()) {
    return Http::FilterTrailersStatus::Continue;
   }
   // Future proof against alb http2 support and finalize the data transform
@@ -177,18 +297,46 @@ AWSLambdaFilter::encodeTrailers(Http::ResponseTrailerMap &) {
   return Http::FilterTrailersStatus::Continue;
 }
 
+Http::FilterDataStatus
+AWSLambdaFilter::decodeEventStream(Buffer::Instance &data, bool end_stream) {
+  Buffer::OwnedImpl payload;
+  const bool decoded = event_stream_decoder_->decode(data, payload);
+  if (!decoded || (end_stream && !event_stream_decoder_->complete())) {
+    ENVOY_LOG(debug, "{}: lambda response stream failed: {}",
+              functionOnRoute()->path(),
+              decoded ? "ended before completing"
+                      : event_stream_decoder_->error());
+    // the headers are already on their way downstream, so resetting is the
+    // only way left to tell that the response is not whole.
+    encoder_callbacks_->resetStream();
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+  data.move(payload);
+  return Http::FilterDataStatus::Continue;
+}
+
 void AWSLambdaFilter::finalizeResponse(){
   // Now that the response is finished we know that the following is safe
   // as the following options will only make the resulting buffer smaller.
   const Buffer::Instance&  buff = *encoder_callbacks_->encodingBuffer();
+  Stats::CompletableTimespanPtr timer = startTimer(
+      [](const AwsLambdaFilterStats &stats) -> Stats::Histogram & {
+        return stats.response_transformation_time_;
+      });
   encoder_callbacks_->modifyEncodingBuffer([this](Buffer::Instance& enc_buf) {
-    Buffer::OwnedImpl body;
     if (functionOnRoute()->unwrapAsAlb()) {
-      if (parseResponseAsALB(*response_headers_, enc_buf, body)){
-        response_headers_->setStatus(static_cast<int>(Http::Code::InternalServerError));
-        body.drain(body.length());
+      Buffer::OwnedImpl body;
+      if (!Http::AlbResponseParser::parse(enc_buf, *response_headers_, body)) {
+        ENVOY_LOG(debug, "{}: alb_unwrap set but did not recieve a json payload",
+                  functionOnRoute()->path());
+        response_headers_->setStatus(
+            static_cast<int>(Http::Code::InternalServerError));
       }
+      enc_buf.drain(enc_buf.length());
+      enc_buf.move(body);
     } else if (functionOnRoute()->hasTransformerConfig()) {
+      // the transformer rewrites the encoding buffer in place, which is then
+      // passed on as is.
       auto transformer_config = functionOnRoute()->transformerConfig();
       transformer_config->transform(
         *response_headers_,
@@ -196,72 +344,154 @@ void AWSLambdaFilter::finalizeResponse(){
         enc_buf,
         *encoder_callbacks_
       );
-
-      body.add(enc_buf.toString().c_str());
     }
-    enc_buf.drain(enc_buf.length());
-    enc_buf.move(body);
   });
+  if (timer != nullptr) {
+    timer->complete();
+  }
   response_headers_->setContentLength(buff.length());
+  cacheResponse(buff);
 }
 
-bool AWSLambdaFilter::parseResponseAsALB(Http::ResponseHeaderMap& headers, 
-                const Buffer::Instance& json_buf, Buffer::Instance& body) {
+bool AWSLambdaFilter::serveCachedResponse() {
+  const ResponseCacheSharedPtr &cache = function_on_route_->responseCache();
+  if (cache == nullptr || request_headers_->getMethodValue() !=
+                              Http::Headers::get().MethodValues.Get) {
+    return false;
+  }
+  // the key is of the request the function would be invoked with.
+  prepareBody();
+  cache_key_ = cache->key(function_on_route_->path(), *request_headers_,
+                          decoder_callbacks_->decodingBuffer());
+  const ResponseCache::ResponseConstSharedPtr cached =
+      cache->lookup(cache_key_);
+  if (cached == nullptr) {
+    cache_response_ = true;
+    return false;
+  }
 
-  ProtobufWkt::Struct alb_response;                
-  try {
-    MessageUtil::loadFromJson(json_buf.toString(), alb_response);
-  } catch (EnvoyException& ex) {
-    ENVOY_LOG(debug, "{}: alb_unwrap set but did not recieve a json payload", 
-                                                   functionOnRoute()->path());
-    headers.setStatus(static_cast<int>(Http::Code::InternalServerError));
-    return true;
+  ENVOY_LOG(trace, "{}: serving the response of {} from the cache", __func__,
+            function_on_route_->path());
+  state_ = State::Responded;
+  served_from_cache_ = true;
+  Http::ResponseHeaderMapPtr headers = Http::ResponseHeaderMapImpl::create();
+  headers->setStatus(cached->status_);
+  for (const auto &header : cached->headers_) {
+    headers->addCopy(Http::LowerCaseString(header.first), header.second);
   }
-  
-  const auto& flds = alb_response.fields();
-  if (flds.contains("body")) {
-    auto rawBody = flds.at("body").string_value();
-    if (flds.contains("isBase64Encoded")){
-      if (!flds.at("isBase64Encoded").has_bool_value()){
-        return true;
-      }
-      if (flds.at("isBase64Encoded").bool_value()){
-        rawBody = Base64::decode(rawBody);
-      }
-    }
-    body.add(rawBody);
+  headers->setContentLength(cached->body_.size());
+  const bool end_stream = cached->body_.empty();
+  decoder_callbacks_->encodeHeaders(std::move(headers), end_stream,
+                                    RcDetails::get().ResponseCached);
+  if (!end_stream) {
+    Buffer::OwnedImpl body(cached->body_);
+    decoder_callbacks_->encodeData(body, true);
   }
+  return true;
+}
 
-  if (flds.contains("statusCode")){
-    headers.setStatus(flds.at("statusCode").number_value());
-    if (!flds.at("statusCode").has_number_value()){
-      return true;
-    }
+void AWSLambdaFilter::bufferCachedResponse(const Buffer::Instance &data,
+                                           bool end_stream) {
+  if (!cache_response_) {
+    return;
   }
-  if (flds.contains("headers")){
-    const auto& hds = flds.at("headers").struct_value();
-    const auto& hdsFields = hds.fields();
-    for (auto const& hdrEntry : hdsFields) { 
-      headers.addCopy(Http::LowerCaseString(hdrEntry.first),
-                             hdrEntry.second.string_value());
-    }
+  if (cached_body_ == nullptr) {
+    cached_body_ = std::make_unique<Buffer::OwnedImpl>();
   }
-  // While ALB would refuse to parse something with headers + multivalue
-  // Being more permissive in this case was determined to be better.
-  if (flds.contains("multiValueHeaders")){
-    const auto& hds = flds.at("multiValueHeaders").struct_value();
-    const auto& hdsFields = hds.fields();
-    for (auto const& hdrEntry : hdsFields) { 
-      const auto& list = hdrEntry.second.list_value();
-      for (auto const& val : list.values()){
-        headers.addCopy(Http::LowerCaseString(hdrEntry.first),
-                                                            val.string_value());
-      }
-    }
+  if (cached_body_->length() + data.length() >
+      function_on_route_->responseCache()->maxBodyBytes()) {
+    // too large to be cached, so it isn't copied any further.
+    cache_response_ = false;
+    cached_body_.reset();
+    return;
+  }
+  cached_body_->add(data);
+  if (end_stream) {
+    cacheResponse(*cached_body_);
+    cached_body_.reset();
   }
+}
+
+void AWSLambdaFilter::cacheResponse(const Buffer::Instance &body) {
+  if (!cache_response_) {
+    return;
+  }
+  cache_response_ = false;
+  if (Http::Utility::getResponseStatus(*response_headers_) !=
+      enumToInt(Http::Code::OK)) {
+    return;
+  }
+  function_on_route_->responseCache()->insert(cache_key_, *response_headers_,
+                                              body);
+}
+
+Stats::CompletableTimespanPtr AWSLambdaFilter::startTimer(
+    Stats::Histogram &(*histogram)(const AwsLambdaFilterStats &)) const {
+  const AwsLambdaFilterStats *stats = filter_config_->stats();
+  if (stats == nullptr) {
+    return nullptr;
+  }
+  return std::make_unique<Stats::HistogramCompletableTimespanImpl>(
+      histogram(*stats), time_source_);
+}
+
+bool AWSLambdaFilter::reserveBody(const Buffer::Instance &data) {
+  const Buffer::Instance *buffered = decoder_callbacks_->decodingBuffer();
+  uint64_t length = data.length();
+  if (buffered != nullptr && buffered != &data) {
+    length += buffered->length();
+  }
+  if (body_reservation_.reserveTo(length)) {
+    return true;
+  }
+  const AwsLambdaFilterStats *filter_stats = filter_config_->stats();
+  if (filter_stats != nullptr) {
+    filter_stats->body_budget_exhausted_.inc();
+  }
+  // the credentials aren't waited for anymore.
+  if (context_ != nullptr) {
+    context_->cancel();
+    context_ = nullptr;
+  }
+  doneWaitingForCredentials(false);
+  state_ = State::Responded;
+  decoder_callbacks_->sendLocalReply(
+      Http::Code::ServiceUnavailable, RcDetails::get().BodyBudgetExhaustedBody,
+      nullptr, absl::nullopt, RcDetails::get().BodyBudgetExhausted);
   return false;
 }
 
+void AWSLambdaFilter::waitForCredentials() {
+  const AwsLambdaFilterStats *filter_stats = filter_config_->stats();
+  if (filter_stats == nullptr) {
+    return;
+  }
+  filter_stats->streams_waiting_for_credentials_.inc();
+  credentials_wait_ = startTimer(
+      [](const AwsLambdaFilterStats &stats) -> Stats::Histogram & {
+        return stats.credentials_wait_time_;
+      });
+}
+
+void AWSLambdaFilter::doneWaitingForCredentials(bool record) {
+  if (credentials_wait_ == nullptr) {
+    return;
+  }
+  if (record) {
+    credentials_wait_->complete();
+  }
+  credentials_wait_.reset();
+  filter_config_->stats()->streams_waiting_for_credentials_.dec();
+}
+
+void AWSLambdaFilter::releaseConcurrency(
+    ConcurrencyLimiter::Outcome outcome) {
+  if (concurrency_limiter_ != nullptr) {
+    concurrency_limiter_->release(concurrency_epoch_, outcome);
+    concurrency_limiter_ = nullptr;
+  }
+}
+
 bool AWSLambdaFilter::isResponseTransformationNeeded() {
   return functionOnRoute() != nullptr && (functionOnRoute()->unwrapAsAlb() || functionOnRoute()->hasTransformerConfig());
 }
@@ -270,12 +500,31 @@ bool AWSLambdaFilter::isRequestTransformationNeeded() {
   return functionOnRoute() != nullptr && functionOnRoute()->hasRequestTransformerConfig();
 }
 
+bool AWSLambdaFilter::isRequestBodyTransformed() {
+  // a passthrough transformation leaves the body as it arrived.
+  return isRequestTransformationNeeded() &&
+         !functionOnRoute()->requestTransformerConfig()->passthrough_body();
+}
+
+void AWSLambdaFilter::recordRegion(bool error) {
+  ASSERT(region_index_.has_value());
+  protocol_options_->regionSelector()->record(
+      *region_index_,
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          time_source_.monotonicTime() - region_sent_at_),
+      error);
+  region_index_.reset();
+}
+
 void AWSLambdaFilter::onSuccess(
     std::shared_ptr<const Envoy::Extensions::Common::Aws::Credentials>
         credentials) {
+  absl::optional<Http::FilterTime::Scope> time;
+  time.emplace(filter_time_);
   credentials_ = credentials;
   context_ = nullptr;
   state_ = State::Complete;
+  doneWaitingForCredentials(true);
 
   const std::string *access_key{};
   const std::string *secret_key{};
@@ -301,7 +550,12 @@ void AWSLambdaFilter::onSuccess(
                                        RcDetails::get().CredentialsNotFound);
     return;
   }
-  aws_authenticator_.init(access_key, secret_key, session_token);
+  aws_authenticator_->init(access_key, secret_key, session_token,
+                           filter_config_->signingKeyCache(),
+                           filter_config_->signingTimeCache());
+  if (function_on_route_->unsignedPayload()) {
+    aws_authenticator_->setUnsignedPayload();
+  }
 
   if (filter_config_->propagateOriginalRouting()){
     request_headers_->setEnvoyOriginalPath(request_headers_->getPathValue());
@@ -314,21 +568,31 @@ void AWSLambdaFilter::onSuccess(
   request_headers_->setReferencePath(function_on_route_->path());
 
   if (stopped_) {
-    if (end_stream_) {
+    bool responded = false;
+    if (end_stream_ || function_on_route_->unsignedPayload()) {
       // edge case where header only request was stopped, but now needs to be
       // lambdafied.
       lambdafy();
+      responded = respondEarly();
     }
     stopped_ = false;
+    body_reservation_.release();
+    if (responded) {
+      return;
+    }
+    // the later filters that the stream continues to aren't timed.
+    time.reset();
     decoder_callbacks_->continueDecoding();
   }
 }
 
 // TODO: Use the failure status in the local reply
 void AWSLambdaFilter::onFailure(CredentialsFailureStatus) {
+  const Http::FilterTime::Scope time(filter_time_);
   // cancel mustn't be called
   context_ = nullptr;
   state_ = State::Responded;
+  doneWaitingForCredentials(true);
   decoder_callbacks_->sendLocalReply(
       Http::Code::InternalServerError, RcDetails::get().CredentialsNotFoundBody,
       nullptr, absl::nullopt, RcDetails::get().CredentialsNotFound);
@@ -336,6 +600,7 @@ void AWSLambdaFilter::onFailure(CredentialsFailureStatus) {
 
 Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
                                                    bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
   if (!function_on_route_) {
     return Http::FilterDataStatus::Continue;
   }
@@ -344,51 +609,70 @@ Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
   if (data.length() != 0) {
     has_body_ = true;
   }
+  if (body_envelope_ != nullptr) {
+    body_envelope_->wrap(data, end_stream);
+  }
 
-  // If we are not transforming the request, then update the payload hash according to the incoming data
-  // If we are transforming the request, then we will update the payload hash after the transformation
-  if (!isRequestTransformationNeeded()) {
-    aws_authenticator_.updatePayloadHash(data);
+  // If the request body is not transformed, then update the payload hash according to the incoming data
+  // If it is transformed, then we will update the payload hash after the transformation
+  if (!isRequestBodyTransformed() &&
+      !function_on_route_->unsignedPayload()) {
+    aws_authenticator_->updatePayloadHash(data);
   }
 
   if (state_ == Calling) {
-    return Http::FilterDataStatus::StopIterationAndBuffer;
+    return reserveBody(data) ? Http::FilterDataStatus::StopIterationAndBuffer
+                             : Http::FilterDataStatus::StopIterationNoBuffer;
   } else if (state_ == Responded) {
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
 
+  if (function_on_route_->unsignedPayload()) {
+    // the request was signed along with its headers.
+    return Http::FilterDataStatus::Continue;
+  }
+
   if (end_stream) {
-    if (has_body_ && isRequestTransformationNeeded()) {
+    // the invocation that responds early is sent with the whole body.
+    if ((has_body_ && isRequestTransformationNeeded()) ||
+        function_on_route_->respondEarly()) {
       decoder_callbacks_->addDecodedData(data, false);
     }
     lambdafy();
-    return Http::FilterDataStatus::Continue;
+    body_reservation_.release();
+    return respondEarly() ? Http::FilterDataStatus::StopIterationNoBuffer
+                          : Http::FilterDataStatus::Continue;
   }
 
-  return Http::FilterDataStatus::StopIterationAndBuffer;
+  return reserveBody(data) ? Http::FilterDataStatus::StopIterationAndBuffer
+                           : Http::FilterDataStatus::StopIterationNoBuffer;
 }
 
 Http::FilterTrailersStatus
 AWSLambdaFilter::decodeTrailers(Http::RequestTrailerMap &) {
+  const Http::FilterTime::Scope time(filter_time_);
   end_stream_ = true;
+  if (function_on_route_ != nullptr) {
+    finishBodyEnvelope(function_on_route_->unsignedPayload());
+  }
   if (state_ == State::Calling) {
     return Http::FilterTrailersStatus::StopIteration;
   } else if (state_ == Responded) {
     return Http::FilterTrailersStatus::StopIteration;
   }
 
-  if (function_on_route_ != nullptr) {
+  if (function_on_route_ != nullptr && !function_on_route_->unsignedPayload()) {
     lambdafy();
+    if (respondEarly()) {
+      return Http::FilterTrailersStatus::StopIteration;
+    }
   }
 
   return Http::FilterTrailersStatus::Continue;
 }
 
 void AWSLambdaFilter::lambdafy() {
-  handleDefaultBody();
-  if (isRequestTransformationNeeded()) {
-      transformRequest();
-  }
+  prepareBody();
 
   const std::string &invocation_type =
       function_on_route_->async()
@@ -398,10 +682,84 @@ void AWSLambdaFilter::lambdafy() {
                                  invocation_type);
   request_headers_->addReference(AWSLambdaHeaderNames::get().LogType,
                                  AWSLambdaHeaderNames::get().LogNone);
-  request_headers_->setReferenceHost(protocol_options_->host());
+  const std::string *host = &protocol_options_->host();
+  const std::string *region = &protocol_options_->region();
+  RegionSelector *region_selector = protocol_options_->regionSelector();
+  if (region_selector != nullptr) {
+    region_index_ = region_selector->select();
+    region_sent_at_ = time_source_.monotonicTime();
+    host = &region_selector->region(*region_index_).host_;
+    region = &region_selector->region(*region_index_).region_;
+  }
+  request_headers_->setReferenceHost(*host);
+
+  Stats::CompletableTimespanPtr timer = startTimer(
+      [](const AwsLambdaFilterStats &stats) -> Stats::Histogram & {
+        return stats.signing_time_;
+      });
+  aws_authenticator_->sign(request_headers_, HeadersToSign, *region);
+  if (timer != nullptr) {
+    timer->complete();
+  }
+}
 
-  aws_authenticator_.sign(request_headers_, HeadersToSign,
-                          protocol_options_->region());
+bool AWSLambdaFilter::respondEarly() {
+  if (!function_on_route_->respondEarly()) {
+    return false;
+  }
+  DetachedInvocations *invocations = filter_config_->detachedInvocations();
+  const std::string *cluster_name =
+      Http::SoloFilterUtility::resolveClusterName(decoder_callbacks_);
+  if (invocations == nullptr || cluster_name == nullptr ||
+      !invocations->invoke(*cluster_name, *request_headers_,
+                           decoder_callbacks_->decodingBuffer())) {
+    return false;
+  }
+  ENVOY_LOG(trace, "{}: invoking {} detached", __func__,
+            function_on_route_->path());
+  state_ = State::Responded;
+  // nothing of the function is known to the stream.
+  releaseConcurrency(ConcurrencyLimiter::Outcome::Ignored);
+  region_index_.reset();
+  decoder_callbacks_->sendLocalReply(Http::Code::Accepted, "", nullptr,
+                                     absl::nullopt,
+                                     RcDetails::get().RespondedEarly);
+  return true;
+}
+
+void AWSLambdaFilter::prepareBody() {
+  // a cached function prepares the body ahead, to look up its response.
+  if (body_prepared_) {
+    return;
+  }
+  body_prepared_ = true;
+  if (body_envelope_ != nullptr && end_stream_) {
+    finishBodyEnvelope(false);
+    request_headers_->setContentLength(body_envelope_->length());
+  }
+  handleDefaultBody();
+  if (isRequestTransformationNeeded()) {
+    Stats::CompletableTimespanPtr timer = startTimer(
+        [](const AwsLambdaFilterStats &stats) -> Stats::Histogram & {
+          return stats.request_transformation_time_;
+        });
+    transformRequest();
+    if (timer != nullptr) {
+      timer->complete();
+    }
+  }
+}
+
+void AWSLambdaFilter::finishBodyEnvelope(bool streaming) {
+  if (body_envelope_ == nullptr || body_envelope_->done()) {
+    return;
+  }
+  Buffer::OwnedImpl rest;
+  body_envelope_->wrap(rest, true);
+  if (!function_on_route_->unsignedPayload()) {
+    aws_authenticator_->updatePayloadHash(rest);
+  }
+  decoder_callbacks_->addDecodedData(rest, streaming);
 }
 
 void AWSLambdaFilter::handleDefaultBody() {
@@ -410,32 +768,47 @@ void AWSLambdaFilter::handleDefaultBody() {
     request_headers_->setReferenceContentType(
         Http::Headers::get().ContentTypeValues.Json);
     request_headers_->setContentLength(data.length());
-    aws_authenticator_.updatePayloadHash(data);
+    aws_authenticator_->updatePayloadHash(data);
     decoder_callbacks_->addDecodedData(data, false);
   }
 }
 
 void AWSLambdaFilter::transformRequest() {
   auto request_transformer_config = functionOnRoute()->requestTransformerConfig();
+  // the body of a passthrough transformation was hashed as it arrived, and a
+  // transformed one is hashed as it is rendered, without a second pass.
+  const bool hash_body = isRequestBodyTransformed();
+  const Transformation::Transformer::BodyObserver hash_payload =
+      [this](absl::string_view data) {
+        aws_authenticator_->updatePayloadHash(data);
+      };
+  auto transform = [this, &request_transformer_config, hash_body,
+                    &hash_payload](Buffer::Instance &buffer) {
+    if (hash_body) {
+      request_transformer_config->transformObserved(
+          *request_headers_, request_headers_, buffer, *decoder_callbacks_,
+          hash_payload);
+    } else {
+      request_transformer_config->transform(*request_headers_,
+                                            request_headers_, buffer,
+                                            *decoder_callbacks_);
+    }
+    request_headers_->setContentLength(buffer.length());
+  };
+
   // if we're processing a headers-only request, the decoding buffer does not exist,
   // so we need to transform an empty buffer and then create the decoding buffer from it
   if (!has_body_) {
     ENVOY_LOG(debug, "Performing request transformation on empty buffer");
     Buffer::OwnedImpl body_buffer("");
-    request_transformer_config->transform(*request_headers_, request_headers_, body_buffer, *decoder_callbacks_);
-    request_headers_->setContentLength(body_buffer.length());
-    aws_authenticator_.updatePayloadHash(body_buffer);
+    transform(body_buffer);
     decoder_callbacks_->addDecodedData(body_buffer, false); // set the decoding buffer to the transformed buffer
     return;
   }
 
   // if we're processing a request with a body, we modify the decoding buffer directly
   ENVOY_LOG(debug, "Performing request transformation on non-empty buffer");
-  decoder_callbacks_->modifyDecodingBuffer([this, &request_transformer_config](Buffer::Instance &buffer) {
-    request_transformer_config->transform(*request_headers_, request_headers_, buffer, *decoder_callbacks_);
-    request_headers_->setContentLength(buffer.length());
-    aws_authenticator_.updatePayloadHash(buffer);
-  });
+  decoder_callbacks_->modifyDecodingBuffer(transform);
 }
 
 } // namespace AwsLambda
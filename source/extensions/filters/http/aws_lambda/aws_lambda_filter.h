@@ -5,13 +5,19 @@
 
 #include "envoy/server/filter_config.h"
 #include "envoy/http/filter.h"
+#include "envoy/stats/timespan.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "source/common/common/base64.h"
+#include "source/common/buffer/body_budget.h"
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/filter_time.h"
 
 #include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
+#include "source/extensions/filters/http/aws_lambda/body_envelope.h"
 #include "source/extensions/filters/http/aws_lambda/config.h"
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
 #include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
 
 #include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
 
@@ -35,6 +41,11 @@ public:
   // Http::StreamFilterBase
   void onDestroy() override {
     state_ = State::Destroyed;
+    // the request ended before its response told anything of the function.
+    releaseConcurrency(ConcurrencyLimiter::Outcome::Ignored);
+    // a stream that went away while waiting has no wait time to tell.
+    doneWaitingForCredentials(false);
+    body_reservation_.release();
     // If context is still around, make sure to cancel it
     if (context_ != nullptr) {
       context_->cancel();
@@ -49,6 +60,11 @@ public:
   void setDecoderFilterCallbacks(
       Http::StreamDecoderFilterCallbacks &decoder_callbacks) override {
     decoder_callbacks_ = &decoder_callbacks;
+    if (filter_config_->recordFilterTime()) {
+      filter_time_ = &Http::FilterTime::forStream(
+          *decoder_callbacks.streamInfo().filterState(),
+          SoloHttpFilterNames::get().AwsLambda, time_source_);
+    }
   }
 
    // Http::StreamEncoderFilter
@@ -81,27 +97,56 @@ public:
     return function_on_route_;
   }
   
-  // Used by unit tests to gain access to the authenticator
-  const AwsAuthenticator  awsAuthenticator() {
-    return aws_authenticator_;
+  // Used by unit tests to gain access to the authenticator, which is only
+  // there once the stream turned out to call a function.
+  const AwsAuthenticator *awsAuthenticator() const {
+    return aws_authenticator_.get();
   }
 
 private:
   static const HeaderList HeadersToSign;
 
   void handleDefaultBody();
+  // applies the default body and the request transformation, once.
+  void prepareBody();
+  // closes the envelope of the body once the body, if any, has arrived.
+  void finishBodyEnvelope(bool streaming);
 
   void lambdafy();
+  // answers the signed request with a 202 and invokes the function detached
+  // from the stream, if the route responds early, and returns whether it did.
+  bool respondEarly();
   void finalizeResponse();
-  bool parseResponseAsALB(Http::ResponseHeaderMap&, 
-                          const Buffer::Instance&, Buffer::Instance&);
+  Http::FilterDataStatus decodeEventStream(Buffer::Instance &data,
+                                           bool end_stream);
+  void releaseConcurrency(ConcurrencyLimiter::Outcome outcome);
+  // tells the region selector of the cluster how the region answered.
+  void recordRegion(bool error);
+  // times the stream until it is done with the step the histogram is of, or
+  // returns nullptr if the config keeps no stats.
+  Stats::CompletableTimespanPtr startTimer(
+      Stats::Histogram &(*histogram)(const AwsLambdaFilterStats &)) const;
+  // reserves the budget of the buffered bodies for the body buffered with
+  // data, or rejects the request if it is over budget.
+  bool reserveBody(const Buffer::Instance &data);
+  void waitForCredentials();
+  void doneWaitingForCredentials(bool record);
   bool isResponseTransformationNeeded();
   bool isRequestTransformationNeeded();
+  bool isRequestBodyTransformed();
   void transformRequest();
+  // answers the request from the response cache of the function, if it has
+  // the response.
+  bool serveCachedResponse();
+  void bufferCachedResponse(const Buffer::Instance &data, bool end_stream);
+  void cacheResponse(const Buffer::Instance &body);
 
   Http::RequestHeaderMap *request_headers_{};
   Http::ResponseHeaderMap *response_headers_{};
-  AwsAuthenticator aws_authenticator_;
+  // allocated with its hashing state only for the streams that call a
+  // function, as the filter runs on every stream of the listener.
+  std::unique_ptr<AwsAuthenticator> aws_authenticator_;
+  TimeSource &time_source_;
 
   Http::StreamDecoderFilterCallbacks *decoder_callbacks_{};
   Http::StreamEncoderFilterCallbacks *encoder_callbacks_{};
@@ -128,6 +173,39 @@ private:
 
   // if end_stream_is true before stopping iteration
   bool end_stream_{};
+
+  // set while the stream is stopped waiting on its credentials.
+  Stats::CompletableTimespanPtr credentials_wait_;
+
+  // the limit the request holds a slot of, until its response headers.
+  ConcurrencyLimiterSharedPtr concurrency_limiter_;
+  uint64_t concurrency_epoch_{};
+
+  // the failover region the request was sent to, if the cluster has any, and
+  // when it was sent.
+  absl::optional<size_t> region_index_;
+  MonotonicTime region_sent_at_;
+
+  // the bytes of the budget of the buffered bodies that the request body
+  // holds while it is buffered.
+  Buffer::BodyBudget::Reservation body_reservation_;
+
+  // wraps the body as it arrives, if the function takes it base64 encoded.
+  std::unique_ptr<BodyEnvelope> body_envelope_;
+
+  // decodes the response of a streaming invocation, if any.
+  std::unique_ptr<EventStreamDecoder> event_stream_decoder_;
+
+  bool body_prepared_{};
+  // set when the response goes in the response cache under the key, until
+  // it is complete.
+  bool cache_response_{};
+  bool served_from_cache_{};
+  std::string cache_key_;
+  // the copy of the response that is not transformed, as it streams through.
+  std::unique_ptr<Buffer::OwnedImpl> cached_body_;
+  // the time of the filter on the stream, if the config records it.
+  Http::FilterTime *filter_time_{};
 };
 
 } // namespace AwsLambda
@@ -2,6 +2,7 @@
 
 #include "envoy/registry/registry.h"
 
+#include "source/common/http/filter_pool.h"
 #include "source/extensions/common/aws/credentials_provider_impl.h"
 #include "source/extensions/common/aws/utility.h"
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter.h"
@@ -26,10 +27,13 @@ AWSLambdaFilterConfigFactory::createFilterFactoryFromProtoTyped(
                                             context.clusterManager()),
       context.mainThreadDispatcher(), context.api(), context.threadLocal(), stats_prefix,
       context.scope(), proto_config);
+  config->cacheProtocolOptions(context.clusterManager());
+  config->detachInvocations(context.clusterManager());
+  config->prefetchCredentials(context.clusterManager(), context.initManager());
   return
       [&context, config]
       (Http::FilterChainFactoryCallbacks &callbacks) -> void {
-        callbacks.addStreamFilter(std::make_shared<AWSLambdaFilter>(
+        callbacks.addStreamFilter(Http::FilterPool<AWSLambdaFilter>::make(
             context.clusterManager(), context.api(), config));
       };
 }
@@ -0,0 +1,42 @@
+#include "source/extensions/filters/http/aws_lambda/body_envelope.h"
+
+#include "source/common/common/assert.h"
+#include "source/extensions/filters/http/transformation/body_base64.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+void BodyEnvelope::wrap(Buffer::Instance &data, bool end_stream) {
+  ASSERT(!done_);
+  Buffer::OwnedImpl wrapped;
+  if (!started_) {
+    wrapped.add(Prefix);
+    started_ = true;
+  }
+  pending_.move(data);
+  // the last chunk is padded, the others leave their partial group behind.
+  const uint64_t groups_length =
+      end_stream ? pending_.length() : pending_.length() / 3 * 3;
+  if (groups_length != 0) {
+    Buffer::OwnedImpl groups;
+    groups.move(pending_, groups_length);
+    Transformation::base64EncodeBody(groups, wrapped);
+  }
+  if (end_stream) {
+    wrapped.add(Suffix);
+    done_ = true;
+  }
+  length_ += wrapped.length();
+  data.move(wrapped);
+}
+
+uint64_t BodyEnvelope::wrappedLength(uint64_t body_length) {
+  return Prefix.size() + (body_length + 2) / 3 * 4 + Suffix.size();
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#include "envoy/buffer/buffer.h"
+
+#include "source/common/buffer/buffer_impl.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Wraps a request body, as it streams, into the json envelope API Gateway and
+ * ALB send binary bodies in: `{"body":"<base64>","isBase64Encoded":true}`.
+ * The base64 of the body is written 3 byte groups at a time, and the bytes of
+ * a group that is split across chunks are kept until the next chunk.
+ */
+class BodyEnvelope {
+public:
+  /**
+   * Replaces the chunk with its part of the envelope.
+   * @param data the next chunk of the body, which may be empty.
+   * @param end_stream whether the chunk is the last one, that closes the
+   * envelope.
+   */
+  void wrap(Buffer::Instance &data, bool end_stream);
+
+  // whether the envelope was closed.
+  bool done() const { return done_; }
+  // the length of the envelope written so far.
+  uint64_t length() const { return length_; }
+
+  // the length of the envelope of a body of the given length.
+  static uint64_t wrappedLength(uint64_t body_length);
+
+  static constexpr absl::string_view Prefix = "{\"body\":\"";
+  static constexpr absl::string_view Suffix = "\",\"isBase64Encoded\":true}";
+
+private:
+  // the last bytes of the body, less than a group.
+  Buffer::OwnedImpl pending_;
+  bool started_{};
+  bool done_{};
+  uint64_t length_{};
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,108 @@
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+
+#include <algorithm>
+
+#include "source/common/protobuf/utility.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+constexpr double DefaultBackoffRatio = 0.5;
+} // namespace
+
+ConcurrencyLimiter::ConcurrencyLimiter(const ConcurrencyLimitProto &proto,
+                                       ConcurrencyLimiterStats stats)
+    : min_limit_(std::max<uint32_t>(proto.min_concurrency(), 1)),
+      max_limit_(proto.max_concurrency()),
+      backoff_ratio_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto, backoff_ratio,
+                                                     DefaultBackoffRatio)),
+      limit_(max_limit_), stats_(std::move(stats)) {
+  stats_.concurrency_limit_.set(limit());
+}
+
+ConcurrencyLimiterStats
+ConcurrencyLimiter::generateStats(const std::string &prefix,
+                                  Stats::Scope &scope) {
+  return {ALL_CONCURRENCY_LIMITER_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                        POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+bool ConcurrencyLimiter::tryAcquire(uint64_t &epoch) {
+  uint32_t in_flight = in_flight_.load();
+  do {
+    if (in_flight >= limit()) {
+      stats_.rq_rejected_.inc();
+      return false;
+    }
+  } while (!in_flight_.compare_exchange_weak(in_flight, in_flight + 1));
+  epoch = epoch_.load();
+  stats_.rq_active_.inc();
+  return true;
+}
+
+void ConcurrencyLimiter::release(uint64_t epoch, Outcome outcome) {
+  in_flight_.fetch_sub(1);
+  stats_.rq_active_.dec();
+  switch (outcome) {
+  case Outcome::Success:
+    // grows by one once a limit's worth of requests succeeded.
+    updateLimit([](double limit) { return limit + 1 / limit; });
+    break;
+  case Outcome::Throttled:
+    stats_.rq_throttled_.inc();
+    // only the first request of an epoch to be throttled backs off.
+    if (epoch_.compare_exchange_strong(epoch, epoch + 1)) {
+      updateLimit([this](double limit) { return limit * backoff_ratio_; });
+    }
+    break;
+  case Outcome::Ignored:
+    break;
+  }
+}
+
+template <class Update>
+void ConcurrencyLimiter::updateLimit(const Update &update) {
+  double limit = limit_.load();
+  double updated;
+  do {
+    updated = std::min(std::max(update(limit), min_limit_), max_limit_);
+  } while (!limit_.compare_exchange_weak(limit, updated));
+  stats_.concurrency_limit_.set(static_cast<uint64_t>(updated));
+}
+
+ConcurrencyLimiterSharedPtr
+ConcurrencyLimiterRegistry::getOrCreate(const std::string &function,
+                                        const ConcurrencyLimitProto &proto,
+                                        Stats::Scope &scope) {
+  const Key key(function, MessageUtil::hash(proto));
+  absl::MutexLock lock(&mutex_);
+  // the limiters of the functions that are no longer routed to are dropped.
+  for (auto it = limiters_.begin(); it != limiters_.end();) {
+    if (it->second.expired() && it->first != key) {
+      limiters_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  std::weak_ptr<ConcurrencyLimiter> &cached = limiters_[key];
+  if (ConcurrencyLimiterSharedPtr existing = cached.lock()) {
+    return existing;
+  }
+  auto limiter = std::make_shared<ConcurrencyLimiter>(
+      proto, ConcurrencyLimiter::generateStats(
+                 absl::StrCat("aws_lambda.concurrency_limit.", function, "."),
+                 scope));
+  cached = limiter;
+  return limiter;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "envoy/singleton/instance.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * All stats for the concurrency limit of a function. @see stats_macros.h
+ */
+#define ALL_CONCURRENCY_LIMITER_STATS(COUNTER, GAUGE)                          \
+  COUNTER(rq_rejected)                                                         \
+  COUNTER(rq_throttled)                                                        \
+  GAUGE(rq_active, Accumulate)                                                 \
+  GAUGE(concurrency_limit, NeverImport)
+
+/**
+ * Wrapper struct for concurrency limit stats. @see stats_macros.h
+ */
+struct ConcurrencyLimiterStats {
+  ALL_CONCURRENCY_LIMITER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ConcurrencyLimitProto = envoy::config::filter::http::aws_lambda::v2::
+    AWSLambdaPerRoute::ConcurrencyLimit;
+
+/**
+ * An adaptive limit on the requests to a function that are in flight, shared
+ * by all the workers. The limit grows additively with the successful
+ * responses and is cut multiplicatively when the function is throttled, so
+ * that it settles just below the concurrency the function is allowed.
+ */
+class ConcurrencyLimiter {
+public:
+  enum class Outcome {
+    // the function answered, so the limit may grow.
+    Success,
+    // the function was throttled, or failed.
+    Throttled,
+    // nothing is known of the function, e.g. the request was reset.
+    Ignored,
+  };
+
+  ConcurrencyLimiter(const ConcurrencyLimitProto &proto,
+                     ConcurrencyLimiterStats stats);
+
+  /**
+   * @param epoch receives the epoch of the limit the request was let through
+   * with, that is given back to release.
+   * @return false if the request is over the limit.
+   */
+  bool tryAcquire(uint64_t &epoch);
+
+  // called once for every request that was let through.
+  void release(uint64_t epoch, Outcome outcome);
+
+  uint32_t limit() const { return static_cast<uint32_t>(limit_.load()); }
+
+  static ConcurrencyLimiterStats generateStats(const std::string &prefix,
+                                               Stats::Scope &scope);
+
+private:
+  template <class Update> void updateLimit(const Update &update);
+
+  const double min_limit_;
+  const double max_limit_;
+  const double backoff_ratio_;
+  std::atomic<uint32_t> in_flight_{0};
+  std::atomic<double> limit_;
+  // bumped on every backoff, so that the requests that were already in flight
+  // when the limit was cut don't cut it again.
+  std::atomic<uint64_t> epoch_{0};
+  ConcurrencyLimiterStats stats_;
+};
+
+using ConcurrencyLimiterSharedPtr = std::shared_ptr<ConcurrencyLimiter>;
+
+/**
+ * The limiters of the functions, shared by the route configs that limit the
+ * same function in the same way, across config updates. A limiter lives for
+ * as long as a route config holds on to it.
+ */
+class ConcurrencyLimiterRegistry : public Singleton::Instance {
+public:
+  /**
+   * @param function the function and qualifier that are limited.
+   * @param scope where the stats of a new limiter go.
+   */
+  ConcurrencyLimiterSharedPtr getOrCreate(const std::string &function,
+                                          const ConcurrencyLimitProto &proto,
+                                          Stats::Scope &scope);
+
+private:
+  using Key = std::pair<std::string, uint64_t>;
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<Key, std::weak_ptr<ConcurrencyLimiter>>
+      limiters_ ABSL_GUARDED_BY(mutex_);
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,17 +1,26 @@
 #include "source/extensions/filters/http/aws_lambda/config.h"
 
+#include <deque>
+#include <functional>
+
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 
+#include "envoy/singleton/manager.h"
 #include "envoy/thread_local/thread_local.h"
 
 #include "source/common/common/regex.h"
 #include "source/common/config/utility.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+#include "absl/strings/str_cat.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace AwsLambda {
 
+SINGLETON_MANAGER_REGISTRATION(aws_lambda_concurrency_limiters);
+
 namespace CommonAws = Envoy::Extensions::Common::Aws;
 
 namespace {
@@ -33,6 +42,55 @@ namespace {
 // Refreshing every 14 minutes should guarantee us fresh credentials.
 constexpr std::chrono::milliseconds REFRESH_AWS_CREDS =
     std::chrono::minutes(14);
+
+// runs the refreshes of the default credentials of all the configs, one after
+// the other, on a thread that lives as long as the process. A fetch can block
+// on the instance metadata service for as long as its timeouts allow, so the
+// thread is never joined, and the refresher is never destroyed.
+class CredentialsRefresher {
+public:
+  using Refresh = std::function<void()>;
+
+  static CredentialsRefresher &get(Thread::ThreadFactory &thread_factory) {
+    static CredentialsRefresher *refresher =
+        new CredentialsRefresher(thread_factory);
+    return *refresher;
+  }
+
+  void post(Refresh refresh) {
+    absl::MutexLock lock(&mutex_);
+    pending_.push_back(std::move(refresh));
+  }
+
+private:
+  explicit CredentialsRefresher(Thread::ThreadFactory &thread_factory) {
+    Thread::Options options;
+    options.name_ = "aws-lambda-creds";
+    thread_ = thread_factory.createThread([this]() { run(); }, options);
+  }
+
+  bool hasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !pending_.empty();
+  }
+
+  void run() {
+    while (true) {
+      Refresh refresh;
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(this, &CredentialsRefresher::hasWork));
+        refresh = std::move(pending_.front());
+        pending_.pop_front();
+      }
+      refresh();
+    }
+  }
+
+  absl::Mutex mutex_;
+  std::deque<Refresh> pending_ ABSL_GUARDED_BY(mutex_);
+  Thread::ThreadPtr thread_;
+};
+
 } // namespace
 
 AWSLambdaConfigImpl::AWSLambdaConfigImpl(
@@ -43,12 +101,23 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
     Stats::Scope &scope,
     const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig
         &protoconfig)
-    : stats_(generateStats(stats_prefix, scope)), api_(api),
-      file_watcher_(dispatcher.createFilesystemWatcher()), tls_(tls),
+    : stats_(generateStats(stats_prefix, scope)),
+      sts_stats_(StsCredentialsProvider::generateStats(
+          stats_prefix + "aws_lambda.", scope)),
+      api_(api), file_watcher_(dispatcher.createFilesystemWatcher()), tls_(tls),
+      protocol_options_(tls),
+      detached_invocations_config_(protoconfig.detached_invocations()),
+      detached_invocation_stats_(DetachedInvocations::generateStats(
+          stats_prefix + "aws_lambda.detached_invocations.", scope)),
+      detached_invocations_(tls),
       credential_refresh_delay_(std::chrono::milliseconds(
         DurationUtil::durationToMilliseconds(
           protoconfig.credential_refresh_delay()))),
-          propagate_original_routing_(protoconfig.propagate_original_routing()){
+          propagate_original_routing_(protoconfig.propagate_original_routing()),
+      prefetch_role_credentials_(protoconfig.prefetch_role_credentials()),
+      wait_for_prefetched_credentials_(
+          protoconfig.wait_for_prefetched_credentials()),
+      record_filter_time_(protoconfig.record_filter_time()) {
 
 
   // Initialize Credential fetcher, if none exists do nothing. Filter will
@@ -57,7 +126,8 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
   case envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
       CredentialsFetcherCase::kUseDefaultCredentials: {
     ENVOY_LOG(debug, "{}: Using default credentials source", __func__);
-    provider_ = std::move(provider);
+    provider_refresh_ =
+        std::make_shared<ProviderRefresh>(std::move(provider), dispatcher);
 
     auto empty_creds = std::make_shared<const CommonAws::Credentials>();
     tls_.set([empty_creds](Event::Dispatcher &) {
@@ -65,9 +135,9 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
     });
 
     timer_ = dispatcher.createTimer([this] { timerCallback(); });
-    // call the time callback to fetch credentials now.
-    // this will also re-trigger the timer.
-    timerCallback();
+    // fetch the credentials now, so that the first requests are signed.
+    // this will also trigger the timer, whose refreshes are asynchronous.
+    onProviderCredentials(provider_refresh_->provider_->getCredentials());
     break;
   }
   case envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
@@ -81,12 +151,14 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
     // tls set
     sts_factory_ = std::move(sts_factory);
     auto service_account_creds = protoconfig.service_account_credentials();
-    tls_.set([this, web_token = web_token_, role_arn = role_arn_,
-                    service_account_creds](Event::Dispatcher &dispatcher) {
-      StsCredentialsProviderPtr sts_cred_provider = sts_factory_->build(
-          service_account_creds, dispatcher, web_token, role_arn);
-      return std::make_shared<ThreadLocalCredentials>(
-          std::move(sts_cred_provider));
+    // a single provider on the main thread fetches the credentials for all
+    // the workers.
+    sts_credentials_ = StsCredentialsManager::create(
+        sts_factory_->build(service_account_creds, dispatcher, sts_stats_,
+                            web_token_, role_arn_),
+        dispatcher, tls, api_.timeSource(), role_arn_);
+    tls_.set([](Event::Dispatcher &) {
+      return std::make_shared<ThreadLocalCredentials>();
     });
     sts_enabled_ = true;
     break;
@@ -147,10 +219,7 @@ void AWSLambdaConfigImpl::init(Event::Dispatcher &dispatcher) {
               shared_this->stats_.webtoken_failure_.inc();
             }else{
               shared_this->stats_.webtoken_state_.set(1);
-              shared_this->tls_.runOnAllThreads(
-                  [web_token](OptRef<ThreadLocalCredentials> prev_config) {
-                    prev_config->sts_credentials_->setWebToken(web_token);
-                  });
+              shared_this->sts_credentials_->setWebToken(web_token);
             }
             // TODO: check if web_token is valid
             // TODO: stats here 
@@ -210,7 +279,7 @@ StsConnectionPool::Context *AWSLambdaConfigImpl::getCredentials(
     return nullptr;
   }
 
-  if (provider_) {
+  if (provider_refresh_ != nullptr) {
     ENVOY_LOG(trace, "{}: Credentials found from default source", __func__);
     callbacks->onSuccess(tls_->credentials_);
     // no context necessary as these credentials are available immediately
@@ -220,7 +289,7 @@ StsConnectionPool::Context *AWSLambdaConfigImpl::getCredentials(
   if (sts_enabled_) {
     ENVOY_LOG(trace, "{}: Credentials being retrieved from STS provider",
               __func__);
-    return tls_->sts_credentials_->find(ext_cfg->roleArn(),
+    return sts_credentials_->find(ext_cfg->roleArn(),
                              ext_cfg->disableRoleChaining(), callbacks);
   }
 
@@ -229,9 +298,109 @@ StsConnectionPool::Context *AWSLambdaConfigImpl::getCredentials(
   return nullptr;
 }
 
+void AWSLambdaConfigImpl::cacheProtocolOptions(Upstream::ClusterManager &cm) {
+  // the caches are built on their worker, so that they register for the
+  // updates of its clusters.
+  protocol_options_.set([&cm](Event::Dispatcher &) {
+    return std::make_shared<ProtocolOptionsCache>(cm);
+  });
+  protocol_options_cached_ = true;
+}
+
+void AWSLambdaConfigImpl::detachInvocations(Upstream::ClusterManager &cm) {
+  detached_invocations_.set([this, &cm](Event::Dispatcher &dispatcher) {
+    return std::make_shared<DetachedInvocations>(
+        cm, dispatcher, detached_invocations_config_,
+        detached_invocation_stats_);
+  });
+  invocations_detached_ = true;
+}
+
+void AWSLambdaConfigImpl::prefetchCredentials(Upstream::ClusterManager &cm,
+                                              Init::Manager &init_manager) {
+  if (!sts_enabled_ || !prefetch_role_credentials_) {
+    return;
+  }
+
+  // clusters from later cds updates are prefetched as they come, without
+  // holding anything up.
+  cluster_update_callbacks_ = cm.addThreadLocalClusterUpdateCallbacks(*this);
+  auto prefetch_clusters = [this, &cm]() {
+    for (const auto &cluster : cm.clusters().active_clusters_) {
+      prefetchCluster(*cluster.second.get().info());
+    }
+  };
+
+  if (!wait_for_prefetched_credentials_) {
+    prefetch_clusters();
+    return;
+  }
+  prefetch_target_ = std::make_unique<Init::TargetImpl>(
+      "aws_lambda sts credentials", [this, prefetch_clusters]() {
+        prefetch_clusters();
+        sts_credentials_->whenPrefetched([this]() {
+          ENVOY_LOG(debug, "sts credentials prefetched");
+          prefetch_target_->ready();
+        });
+      });
+  init_manager.add(*prefetch_target_);
+}
+
+void AWSLambdaConfigImpl::onClusterAddOrUpdate(
+    Upstream::ThreadLocalCluster &cluster) {
+  prefetchCluster(*cluster.info());
+}
+
+void AWSLambdaConfigImpl::prefetchCluster(const Upstream::ClusterInfo &info) {
+  auto ext_cfg =
+      info.extensionProtocolOptionsTyped<AWSLambdaProtocolExtensionConfig>(
+          SoloHttpFilterNames::get().AwsLambda);
+  // clusters with static credentials don't assume a role.
+  if (ext_cfg == nullptr ||
+      (ext_cfg->accessKey().has_value() && ext_cfg->secretKey().has_value())) {
+    return;
+  }
+  ENVOY_LOG(trace, "{}: prefetching sts credentials for cluster {}", __func__,
+            info.name());
+  sts_credentials_->prefetch(ext_cfg->roleArn(),
+                             ext_cfg->disableRoleChaining());
+}
+
+AWSLambdaConfigImpl::~AWSLambdaConfigImpl() {
+  if (provider_refresh_ != nullptr) {
+    // a refresh that is still in flight finishes on its own, without a
+    // result.
+    absl::MutexLock lock(&provider_refresh_->mutex_);
+    provider_refresh_->dispatcher_ = nullptr;
+  }
+}
+
 void AWSLambdaConfigImpl::timerCallback() {
-  // get new credentials.
-  auto new_creds = provider_->getCredentials();
+  // the timer is only re-enabled once the previous refresh has posted its
+  // result, but a refresh is never waited for.
+  if (refresh_in_flight_) {
+    ENVOY_LOG(debug, "{}: a credentials refresh is still in flight", __func__);
+    return;
+  }
+  refresh_in_flight_ = true;
+  CredentialsRefresher::get(api_.threadFactory())
+      .post([refresh = provider_refresh_, weak_this = weak_from_this()]() {
+        auto new_creds = refresh->provider_->getCredentials();
+        absl::MutexLock lock(&refresh->mutex_);
+        if (refresh->dispatcher_ == nullptr) {
+          return;
+        }
+        refresh->dispatcher_->post([weak_this, new_creds]() {
+          if (auto config = weak_this.lock()) {
+            config->refresh_in_flight_ = false;
+            config->onProviderCredentials(new_creds);
+          }
+        });
+      });
+}
+
+void AWSLambdaConfigImpl::onProviderCredentials(
+    const CommonAws::Credentials &new_creds) {
   if (new_creds == CommonAws::Credentials()) {
     stats_.fetch_failed_.inc();
     stats_.current_state_.set(0);
@@ -281,20 +450,88 @@ AwsLambdaFilterStats
 AWSLambdaConfigImpl::generateStats(const std::string &prefix,
                                    Stats::Scope &scope) {
   const std::string final_prefix = prefix + "aws_lambda.";
-  return {ALL_AWS_LAMBDA_FILTER_STATS(POOL_COUNTER_PREFIX(scope, final_prefix),
-                                      POOL_GAUGE_PREFIX(scope, final_prefix))};
+  return {ALL_AWS_LAMBDA_FILTER_STATS(
+      POOL_COUNTER_PREFIX(scope, final_prefix),
+      POOL_GAUGE_PREFIX(scope, final_prefix),
+      POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
 }
 
 AWSLambdaRouteConfig::AWSLambdaRouteConfig(
     const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute &protoconfig,
     Server::Configuration::ServerFactoryContext &context
     )
-    : path_(functionUrlPath(protoconfig.name(), protoconfig.qualifier())),
+    : path_(functionUrlPath(protoconfig.name(), protoconfig.qualifier(),
+                            protoconfig.response_streaming())),
       async_(protoconfig.async()),
+      respond_early_(protoconfig.respond_early()),
       unwrap_as_alb_(protoconfig.unwrap_as_alb()),
-      has_transformer_config_(protoconfig.has_transformer_config())
+      has_transformer_config_(protoconfig.has_transformer_config()),
+      unsigned_payload_(protoconfig.unsigned_payload()),
+      response_streaming_(protoconfig.response_streaming()),
+      base64_encode_body_(protoconfig.base64_encode_body())
     {
 
+  if (unsigned_payload_ && (protoconfig.has_empty_body_override() ||
+                            protoconfig.has_request_transformer_config())) {
+    throw EnvoyException(
+        "unsigned_payload streams the body, it can't be combined with "
+        "empty_body_override or request_transformer_config");
+  }
+
+  if (respond_early_ && (!async_ || unsigned_payload_)) {
+    throw EnvoyException(
+        "respond_early invokes the function detached with the whole body, it "
+        "requires async and can't be combined with unsigned_payload");
+  }
+
+  if (response_streaming_ && (async_ || unwrap_as_alb_ ||
+                              has_transformer_config_)) {
+    throw EnvoyException(
+        "response_streaming streams the response, it can't be combined with "
+        "async, unwrap_as_alb or transformer_config");
+  }
+
+  if (base64_encode_body_ && (protoconfig.has_empty_body_override() ||
+                              protoconfig.has_request_transformer_config())) {
+    throw EnvoyException(
+        "base64_encode_body encodes the body as it arrives, it can't be "
+        "combined with empty_body_override or request_transformer_config");
+  }
+
+  if (protoconfig.has_response_cache() && (async_ || response_streaming_)) {
+    throw EnvoyException(
+        "response_cache caches the whole response, it can't be combined with "
+        "async or response_streaming");
+  }
+
+  const std::string function =
+      protoconfig.qualifier().empty()
+          ? protoconfig.name()
+          : absl::StrCat(protoconfig.name(), ".", protoconfig.qualifier());
+
+  if (protoconfig.has_concurrency_limit()) {
+    const auto &concurrency_limit = protoconfig.concurrency_limit();
+    if (concurrency_limit.min_concurrency() >
+        concurrency_limit.max_concurrency()) {
+      throw EnvoyException("concurrency_limit min_concurrency can't be above "
+                           "max_concurrency");
+    }
+    concurrency_limiters_ =
+        context.singletonManager().getTyped<ConcurrencyLimiterRegistry>(
+            SINGLETON_MANAGER_REGISTERED_NAME(aws_lambda_concurrency_limiters),
+            [] { return std::make_shared<ConcurrencyLimiterRegistry>(); });
+    concurrency_limiter_ = concurrency_limiters_->getOrCreate(
+        function, concurrency_limit, context.scope());
+  }
+
+  if (protoconfig.has_response_cache()) {
+    response_cache_ = std::make_shared<ResponseCache>(
+        protoconfig.response_cache(), context.timeSource(),
+        ResponseCache::generateStats(
+            absl::StrCat("aws_lambda.response_cache.", function, "."),
+            context.scope()));
+  }
+
   if (protoconfig.has_empty_body_override()) {
     default_body_ = protoconfig.empty_body_override().value();
   }
@@ -314,16 +551,51 @@ AWSLambdaRouteConfig::AWSLambdaRouteConfig(
 
 std::string
 AWSLambdaRouteConfig::functionUrlPath(const std::string &name,
-                                      const std::string &qualifier) {
+                                      const std::string &qualifier,
+                                      bool response_streaming) {
 
   std::stringstream val;
-  val << "/2015-03-31/functions/" << name << "/invocations";
+  if (response_streaming) {
+    val << "/2021-11-15/functions/" << name
+        << "/response-streaming-invocations";
+  } else {
+    val << "/2015-03-31/functions/" << name << "/invocations";
+  }
   if (!qualifier.empty()) {
     val << "?Qualifier=" << qualifier;
   }
   return val.str();
 }
 
+ProtocolOptionsCache::ProtocolOptionsCache(Upstream::ClusterManager &cm)
+    : cm_(cm), cluster_update_callbacks_(
+                   cm.addThreadLocalClusterUpdateCallbacks(*this)) {}
+
+SharedAWSLambdaProtocolExtensionConfig
+ProtocolOptionsCache::get(const std::string &cluster_name) {
+  auto it = options_.find(cluster_name);
+  if (it != options_.end()) {
+    return it->second;
+  }
+  Upstream::ThreadLocalCluster *cluster =
+      cm_.getThreadLocalCluster(cluster_name);
+  if (cluster == nullptr) {
+    // not cached, as the name of an unknown cluster may be anything.
+    return nullptr;
+  }
+  SharedAWSLambdaProtocolExtensionConfig options =
+      cluster->info()
+          ->extensionProtocolOptionsTyped<AWSLambdaProtocolExtensionConfig>(
+              SoloHttpFilterNames::get().AwsLambda);
+  options_.emplace(cluster_name, options);
+  return options;
+}
+
+void ProtocolOptionsCache::onClusterAddOrUpdate(
+    Upstream::ThreadLocalCluster &cluster) {
+  options_.erase(cluster.info()->name());
+}
+
 AWSLambdaProtocolExtensionConfig::AWSLambdaProtocolExtensionConfig(
     const envoy::config::filter::http::aws_lambda::v2::
         AWSLambdaProtocolExtension &protoconfig)
@@ -341,6 +613,13 @@ AWSLambdaProtocolExtensionConfig::AWSLambdaProtocolExtensionConfig(
     role_arn_ = protoconfig.role_arn();
   }
   disable_role_chaining_ = protoconfig.disable_role_chaining();
+  if (!protoconfig.failover_regions().empty()) {
+    std::vector<RegionSelector::Region> regions{{host_, region_}};
+    for (const auto &failover : protoconfig.failover_regions()) {
+      regions.push_back({failover.host(), failover.region()});
+    }
+    region_selector_ = std::make_shared<RegionSelector>(std::move(regions));
+  }
 }
 
 } // namespace AwsLambda
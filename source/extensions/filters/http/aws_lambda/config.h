@@ -4,14 +4,25 @@
 #include <string>
 
 #include "envoy/http/filter.h"
+#include "envoy/init/manager.h"
 #include "envoy/stats/scope.h"
 #include "envoy/stats/stats_macros.h"
+#include "envoy/thread/thread.h"
 #include "envoy/upstream/cluster_manager.h"
 
+#include "source/common/init/target_impl.h"
 #include "source/extensions/common/aws/credentials_provider.h"
+#include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+#include "source/extensions/filters/http/aws_lambda/detached_invocations.h"
+#include "source/extensions/filters/http/aws_lambda/region_selector.h"
+#include "source/extensions/filters/http/aws_lambda/response_cache.h"
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_manager.h"
 #include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
 
@@ -23,20 +34,27 @@ namespace AwsLambda {
 /**
  * All stats for the aws filter. @see stats_macros.h
  */
-#define ALL_AWS_LAMBDA_FILTER_STATS(COUNTER, GAUGE)                            \
+#define ALL_AWS_LAMBDA_FILTER_STATS(COUNTER, GAUGE, HISTOGRAM)                 \
   COUNTER(fetch_failed)                                                        \
   COUNTER(fetch_success)                                                       \
   COUNTER(creds_rotated)                                                       \
   COUNTER(webtoken_rotated)                                                    \
   COUNTER(webtoken_failure)                                                    \
+  COUNTER(body_budget_exhausted)                                               \
   GAUGE(webtoken_state, NeverImport)                                           \
-  GAUGE(current_state, NeverImport)
+  GAUGE(current_state, NeverImport)                                            \
+  GAUGE(streams_waiting_for_credentials, Accumulate)                           \
+  HISTOGRAM(credentials_wait_time, Milliseconds)                               \
+  HISTOGRAM(request_transformation_time, Microseconds)                         \
+  HISTOGRAM(signing_time, Microseconds)                                        \
+  HISTOGRAM(response_transformation_time, Microseconds)
 
 /**
  * Wrapper struct for aws filter stats. @see stats_macros.h
  */
 struct AwsLambdaFilterStats {
-  ALL_AWS_LAMBDA_FILTER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+  ALL_AWS_LAMBDA_FILTER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT,
+                              GENERATE_HISTOGRAM_STRUCT)
 };
 
 using CredentialsSharedPtr =
@@ -60,10 +78,13 @@ public:
   }
   const absl::optional<std::string> &roleArn() const { return role_arn_; }
   const bool &disableRoleChaining() const { return disable_role_chaining_; }
+  // null unless the function is deployed in failover regions.
+  RegionSelector *regionSelector() const { return region_selector_.get(); }
 
 private:
   std::string host_;
   std::string region_;
+  RegionSelectorSharedPtr region_selector_;
   absl::optional<std::string> access_key_;
   absl::optional<std::string> secret_key_;
   absl::optional<std::string> session_token_;
@@ -74,21 +95,68 @@ private:
 using SharedAWSLambdaProtocolExtensionConfig =
     std::shared_ptr<const AWSLambdaProtocolExtensionConfig>;
 
+/**
+ * The lambda protocol options of the clusters, resolved once per worker
+ * rather than on every request. The entry of a cluster is dropped when the
+ * cluster is updated or removed on the worker.
+ */
+class ProtocolOptionsCache : public ThreadLocal::ThreadLocalObject,
+                             public Upstream::ClusterUpdateCallbacks {
+public:
+  // Must be constructed on the worker whose clusters it caches.
+  explicit ProtocolOptionsCache(Upstream::ClusterManager &cm);
+
+  /**
+   * @return the options of the cluster, or nullptr if it has none or doesn't
+   * exist.
+   */
+  SharedAWSLambdaProtocolExtensionConfig get(const std::string &cluster_name);
+
+  // Upstream::ClusterUpdateCallbacks
+  void onClusterAddOrUpdate(Upstream::ThreadLocalCluster &cluster) override;
+  void onClusterRemoval(const std::string &cluster_name) override {
+    options_.erase(cluster_name);
+  }
+
+private:
+  Upstream::ClusterManager &cm_;
+  // the clusters without options are cached too, as nullptr.
+  absl::flat_hash_map<std::string, SharedAWSLambdaProtocolExtensionConfig>
+      options_;
+  Upstream::ClusterUpdateCallbacksHandlePtr cluster_update_callbacks_;
+};
+
 class AWSLambdaConfig {
 public:
   virtual StsConnectionPool::Context *
   getCredentials(SharedAWSLambdaProtocolExtensionConfig ext_cfg,
                  StsConnectionPool::Context::Callbacks *callbacks) const PURE;
   virtual bool propagateOriginalRouting() const PURE;
+  // the signing caches of the calling worker, if the config keeps them.
+  virtual SigningKeyCache *signingKeyCache() const { return nullptr; }
+  virtual SigningTimeCache *signingTimeCache() const { return nullptr; }
+  // the protocol options of the clusters of the calling worker, if the
+  // config keeps them.
+  virtual ProtocolOptionsCache *protocolOptionsCache() const {
+    return nullptr;
+  }
+  // the stats the streams record their latencies in, if any.
+  virtual const AwsLambdaFilterStats *stats() const { return nullptr; }
+  // whether the streams keep the time the filter spends on them.
+  virtual bool recordFilterTime() const { return false; }
+  // the invocations the calling worker sends detached from their streams, if
+  // the config sends any.
+  virtual DetachedInvocations *detachedInvocations() const { return nullptr; }
   virtual ~AWSLambdaConfig() = default;
 };
 
 class AWSLambdaConfigImpl
     : public AWSLambdaConfig,
+      public Upstream::ClusterUpdateCallbacks,
       public Envoy::Logger::Loggable<Envoy::Logger::Id::filter>,
       public std::enable_shared_from_this<AWSLambdaConfigImpl> {
 public:
-  ~AWSLambdaConfigImpl() = default;
+  ~AWSLambdaConfigImpl() override;
 
   static std::shared_ptr<AWSLambdaConfigImpl>
   create(std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
@@ -108,6 +176,43 @@ public:
       return propagate_original_routing_;
     }
 
+  /**
+   * Fetches the sts credentials of the roles set on the clusters, if
+   * configured to, ahead of their first request and again whenever a cluster
+   * is added or updated. Must be called on the main thread.
+   * @param init_manager waits on the roles of the current clusters, if
+   * configured to.
+   */
+  void prefetchCredentials(Upstream::ClusterManager &cm,
+                           Init::Manager &init_manager);
+
+  // Keeps the protocol options of the clusters on every worker. Must be
+  // called on the main thread.
+  void cacheProtocolOptions(Upstream::ClusterManager &cm);
+
+  // Sends the invocations of the routes that respond early from every worker.
+  // Must be called on the main thread.
+  void detachInvocations(Upstream::ClusterManager &cm);
+
+  // Upstream::ClusterUpdateCallbacks
+  void onClusterAddOrUpdate(Upstream::ThreadLocalCluster &cluster) override;
+  void onClusterRemoval(const std::string &) override {}
+
+  SigningKeyCache *signingKeyCache() const override {
+    return &tls_->signing_keys_;
+  }
+  SigningTimeCache *signingTimeCache() const override {
+    return &tls_->signing_times_;
+  }
+  ProtocolOptionsCache *protocolOptionsCache() const override {
+    return protocol_options_cached_ ? &*protocol_options_ : nullptr;
+  }
+  const AwsLambdaFilterStats *stats() const override { return &stats_; }
+  bool recordFilterTime() const override { return record_filter_time_; }
+  DetachedInvocations *detachedInvocations() const override {
+    return invocations_detached_ ? &*detached_invocations_ : nullptr;
+  }
+
 private:
   AWSLambdaConfigImpl(
       std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
@@ -121,33 +226,55 @@ private:
 
 
   struct ThreadLocalCredentials : public Envoy::ThreadLocal::ThreadLocalObject {
+    ThreadLocalCredentials() = default;
     ThreadLocalCredentials(CredentialsConstSharedPtr credentials)
         : credentials_(credentials) {}
-    ThreadLocalCredentials(StsCredentialsProviderPtr credentials)
-        : sts_credentials_(std::move(credentials)) {}
     CredentialsConstSharedPtr credentials_;
-    StsCredentialsProviderPtr sts_credentials_;
+    // the keys derived from the credentials used on this worker.
+    mutable SigningKeyCache signing_keys_;
+    mutable SigningTimeCache signing_times_;
   };
 
   CredentialsConstSharedPtr getProviderCredentials() const;
 
+  void prefetchCluster(const Upstream::ClusterInfo &info);
+
   static AwsLambdaFilterStats generateStats(const std::string &prefix,
                                             Stats::Scope &scope);
 
   void timerCallback();
+  // publishes the credentials of the default provider to the workers.
+  void onProviderCredentials(
+      const Envoy::Extensions::Common::Aws::Credentials &new_creds);
 
   void init(Event::Dispatcher &dispatcher);
 
   void loadSTSData();
 
   AwsLambdaFilterStats stats_;
+  StsCredentialsProviderStats sts_stats_;
 
   Api::Api &api_;
 
   Envoy::Filesystem::WatcherPtr file_watcher_;
 
-  std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
-      provider_;
+  // the default provider, which is shared with the refresh thread, as a
+  // fetch that blocks on the instance metadata service may outlive the config.
+  struct ProviderRefresh {
+    explicit ProviderRefresh(
+        std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
+            &&provider,
+        Event::Dispatcher &dispatcher)
+        : provider_(std::move(provider)), dispatcher_(&dispatcher) {}
+
+    // only used by the refresh thread once the config is built.
+    const std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
+        provider_;
+    absl::Mutex mutex_;
+    // where the refreshes post their result, until the config is destroyed.
+    Event::Dispatcher *dispatcher_ ABSL_GUARDED_BY(mutex_);
+  };
+  std::shared_ptr<ProviderRefresh> provider_refresh_;
 
   bool sts_enabled_ = false;
   std::string token_file_;
@@ -155,13 +282,28 @@ private:
   std::string role_arn_;
   
   ThreadLocal::TypedSlot<ThreadLocalCredentials> tls_;
+  ThreadLocal::TypedSlot<ProtocolOptionsCache> protocol_options_;
+  bool protocol_options_cached_{};
+  const DetachedInvocationsConfig detached_invocations_config_;
+  DetachedInvocationStats detached_invocation_stats_;
+  ThreadLocal::TypedSlot<DetachedInvocations> detached_invocations_;
+  bool invocations_detached_{};
+  // fetches the sts credentials once for all the workers
+  StsCredentialsManagerSharedPtr sts_credentials_;
+  bool prefetch_role_credentials_;
+  bool wait_for_prefetched_credentials_;
+  Upstream::ClusterUpdateCallbacksHandlePtr cluster_update_callbacks_;
+  std::unique_ptr<Init::TargetImpl> prefetch_target_;
 
   Event::TimerPtr timer_;
+  // whether a refresh of the default credentials waits for its result.
+  bool refresh_in_flight_{};
 
   std::unique_ptr<StsCredentialsProviderFactory> sts_factory_;
   std::chrono::milliseconds credential_refresh_delay_;
 
   bool propagate_original_routing_;
+  bool record_filter_time_;
 };
 
 typedef std::shared_ptr<const AWSLambdaConfig> AWSLambdaConfigConstSharedPtr;
@@ -175,6 +317,8 @@ public:
 
   const std::string &path() const { return path_; }
   bool async() const { return async_; }
+  // whether the request is answered before the function is invoked.
+  bool respondEarly() const { return respond_early_; }
   const absl::optional<std::string> &defaultBody() const {
     return default_body_;
   }
@@ -183,17 +327,40 @@ public:
   Transformation::TransformerConstSharedPtr requestTransformerConfig() const { return request_transformer_config_; }
   bool hasTransformerConfig() const { return has_transformer_config_; }
   bool hasRequestTransformerConfig() const { return request_transformer_config_ != nullptr; }
+  // whether the body is streamed and left out of the signature.
+  bool unsignedPayload() const { return unsigned_payload_; }
+  // whether the function is invoked with InvokeWithResponseStream.
+  bool responseStreaming() const { return response_streaming_; }
+  // whether the body is sent base64 encoded in a json envelope.
+  bool base64EncodeBody() const { return base64_encode_body_; }
+  // the limit on the requests in flight to the function, if any.
+  const ConcurrencyLimiterSharedPtr &concurrencyLimiter() const {
+    return concurrency_limiter_;
+  }
+  // the cache of the responses of the function, if any.
+  const ResponseCacheSharedPtr &responseCache() const {
+    return response_cache_;
+  }
 private:
   std::string path_;
   bool async_;
+  bool respond_early_;
   bool unwrap_as_alb_;
   Transformation::TransformerConstSharedPtr transformer_config_;
   bool has_transformer_config_;
   Transformation::TransformerConstSharedPtr request_transformer_config_;
   absl::optional<std::string> default_body_;
+  bool unsigned_payload_;
+  bool response_streaming_;
+  bool base64_encode_body_;
+  // held so that the route configs that are alive share their limiters.
+  std::shared_ptr<ConcurrencyLimiterRegistry> concurrency_limiters_;
+  ConcurrencyLimiterSharedPtr concurrency_limiter_;
+  ResponseCacheSharedPtr response_cache_;
 
   static std::string functionUrlPath(const std::string &name,
-                                     const std::string &qualifier);
+                                     const std::string &qualifier,
+                                     bool response_streaming);
 };
 
 } // namespace AwsLambda
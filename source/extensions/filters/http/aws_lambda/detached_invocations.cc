@@ -0,0 +1,156 @@
+#include "source/extensions/filters/http/aws_lambda/detached_invocations.h"
+
+#include <algorithm>
+
+#include "source/common/common/enum_to_int.h"
+#include "source/common/http/header_map_impl.h"
+#include "source/common/http/message_impl.h"
+#include "source/common/http/utility.h"
+#include "source/common/protobuf/utility.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+DetachedInvocationsConfig::DetachedInvocationsConfig(
+    const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
+        DetachedInvocations &proto)
+    : max_in_flight_(
+          PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto, max_in_flight, 100)),
+      num_retries_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto, num_retries, 2)),
+      per_try_timeout_(
+          PROTOBUF_GET_MS_OR_DEFAULT(proto, per_try_timeout, 15000)),
+      retry_back_off_(PROTOBUF_GET_MS_OR_DEFAULT(proto, retry_back_off, 100)) {
+}
+
+DetachedInvocations::DetachedInvocations(
+    Upstream::ClusterManager &cm, Event::Dispatcher &dispatcher,
+    const DetachedInvocationsConfig &config, DetachedInvocationStats stats)
+    : cm_(cm), dispatcher_(dispatcher), config_(config),
+      stats_(std::move(stats)) {}
+
+DetachedInvocations::~DetachedInvocations() {
+  stats_.active_.sub(invocations_.size());
+}
+
+bool DetachedInvocations::invoke(const std::string &cluster_name,
+                                 const Http::RequestHeaderMap &headers,
+                                 const Buffer::Instance *body) {
+  if (invocations_.size() >= config_.max_in_flight_) {
+    stats_.overflow_.inc();
+    return false;
+  }
+  auto invocation =
+      std::make_unique<Invocation>(*this, cluster_name, headers, body);
+  LinkedList::moveIntoList(std::move(invocation), invocations_);
+  stats_.active_.inc();
+  invocations_.front()->send();
+  return true;
+}
+
+void DetachedInvocations::done(Invocation &invocation) {
+  stats_.active_.dec();
+  dispatcher_.deferredDelete(invocation.removeFromList(invocations_));
+}
+
+DetachedInvocationStats
+DetachedInvocations::generateStats(const std::string &prefix,
+                                   Stats::Scope &scope) {
+  return {ALL_DETACHED_INVOCATION_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                        POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+DetachedInvocations::Invocation::Invocation(
+    DetachedInvocations &parent, const std::string &cluster_name,
+    const Http::RequestHeaderMap &headers, const Buffer::Instance *body)
+    : parent_(parent), cluster_name_(cluster_name),
+      headers_(Http::createHeaderMap<Http::RequestHeaderMapImpl>(headers)) {
+  if (body != nullptr) {
+    body_.add(*body);
+  }
+}
+
+DetachedInvocations::Invocation::~Invocation() {
+  if (request_ != nullptr) {
+    request_->cancel();
+  }
+}
+
+void DetachedInvocations::Invocation::send() {
+  // the cluster may have gone away while the invocation waited to retry.
+  Upstream::ThreadLocalCluster *cluster =
+      parent_.cm_.getThreadLocalCluster(cluster_name_);
+  if (cluster == nullptr) {
+    fail("the cluster is gone");
+    return;
+  }
+  tries_++;
+  auto message = std::make_unique<Http::RequestMessageImpl>(
+      Http::createHeaderMap<Http::RequestHeaderMapImpl>(*headers_));
+  message->body().add(body_);
+  in_flight_ = true;
+  Http::AsyncClient::Request *request = cluster->httpAsyncClient().send(
+      std::move(message), *this,
+      Http::AsyncClient::RequestOptions().setTimeout(
+          parent_.config_.per_try_timeout_));
+  // the request may have completed inline, and must not be cancelled then.
+  if (in_flight_) {
+    request_ = request;
+  }
+}
+
+void DetachedInvocations::Invocation::onSuccess(
+    const Http::AsyncClient::Request &, Http::ResponseMessagePtr &&response) {
+  in_flight_ = false;
+  request_ = nullptr;
+  const uint64_t status = Http::Utility::getResponseStatus(response->headers());
+  if (status >= 200 && status < 300) {
+    parent_.stats_.success_.inc();
+    parent_.done(*this);
+  } else if (status == enumToInt(Http::Code::TooManyRequests) ||
+             status >= 500) {
+    retryOrFail(absl::StrCat("status ", status));
+  } else {
+    fail(absl::StrCat("status ", status));
+  }
+}
+
+void DetachedInvocations::Invocation::onFailure(
+    const Http::AsyncClient::Request &,
+    Http::AsyncClient::FailureReason reason) {
+  in_flight_ = false;
+  request_ = nullptr;
+  retryOrFail(absl::StrCat("failure ", enumToInt(reason)));
+}
+
+void DetachedInvocations::Invocation::retryOrFail(absl::string_view reason) {
+  if (tries_ > parent_.config_.num_retries_) {
+    fail(reason);
+    return;
+  }
+  ENVOY_LOG(debug, "retrying the detached invocation of {}: {}",
+            headers_->getPathValue(), reason);
+  parent_.stats_.retry_.inc();
+  // never sent from the callback, which may be that of a reset by the
+  // client as it goes away.
+  if (retry_timer_ == nullptr) {
+    retry_timer_ = parent_.dispatcher_.createTimer([this]() { send(); });
+  }
+  retry_timer_->enableTimer(parent_.config_.retry_back_off_ *
+                            (1 << std::min<uint32_t>(tries_ - 1, 16)));
+}
+
+void DetachedInvocations::Invocation::fail(absl::string_view reason) {
+  ENVOY_LOG(warn, "the detached invocation of {} failed after {} tries: {}",
+            headers_->getPathValue(), tries_, reason);
+  parent_.stats_.failure_.inc();
+  parent_.done(*this);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "envoy/event/deferred_deletable.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/http/async_client.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/cluster_manager.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/linked_object.h"
+#include "source/common/common/logger.h"
+
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * All stats for the invocations detached from their streams. @see
+ * stats_macros.h
+ */
+#define ALL_DETACHED_INVOCATION_STATS(COUNTER, GAUGE)                          \
+  COUNTER(success)                                                             \
+  COUNTER(failure)                                                             \
+  COUNTER(retry)                                                               \
+  COUNTER(overflow)                                                            \
+  GAUGE(active, Accumulate)
+
+/**
+ * Wrapper struct for detached invocation stats. @see stats_macros.h
+ */
+struct DetachedInvocationStats {
+  ALL_DETACHED_INVOCATION_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+struct DetachedInvocationsConfig {
+  explicit DetachedInvocationsConfig(
+      const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
+          DetachedInvocations &proto);
+
+  uint32_t max_in_flight_;
+  uint32_t num_retries_;
+  std::chrono::milliseconds per_try_timeout_;
+  std::chrono::milliseconds retry_back_off_;
+};
+
+/**
+ * The async invocations of the routes that respond early, which a worker
+ * sends on its own once the stream was answered with a 202. An invocation is
+ * retried on a failure, a 429 or a 5xx, after a back off that doubles with
+ * each retry. The invocations still in flight when the filter config goes
+ * away are cancelled.
+ */
+class DetachedInvocations : public ThreadLocal::ThreadLocalObject,
+                            public Logger::Loggable<Logger::Id::aws> {
+public:
+  DetachedInvocations(Upstream::ClusterManager &cm,
+                      Event::Dispatcher &dispatcher,
+                      const DetachedInvocationsConfig &config,
+                      DetachedInvocationStats stats);
+  ~DetachedInvocations() override;
+
+  /**
+   * Invokes the function with a copy of the signed request.
+   * @return false, invoking nothing, if the worker has as many invocations in
+   * flight as it may.
+   */
+  bool invoke(const std::string &cluster_name,
+              const Http::RequestHeaderMap &headers,
+              const Buffer::Instance *body);
+
+  size_t inFlight() const { return invocations_.size(); }
+
+  static DetachedInvocationStats generateStats(const std::string &prefix,
+                                               Stats::Scope &scope);
+
+private:
+  class Invocation : public Http::AsyncClient::Callbacks,
+                     public Event::DeferredDeletable,
+                     public LinkedObject<Invocation> {
+  public:
+    Invocation(DetachedInvocations &parent, const std::string &cluster_name,
+               const Http::RequestHeaderMap &headers,
+               const Buffer::Instance *body);
+    ~Invocation() override;
+
+    void send();
+
+    // Http::AsyncClient::Callbacks
+    void onSuccess(const Http::AsyncClient::Request &,
+                   Http::ResponseMessagePtr &&response) override;
+    void onFailure(const Http::AsyncClient::Request &,
+                   Http::AsyncClient::FailureReason reason) override;
+    void onBeforeFinalizeUpstreamSpan(Tracing::Span &,
+                                      const Http::ResponseHeaderMap *) override {
+    }
+
+  private:
+    void retryOrFail(absl::string_view reason);
+    void fail(absl::string_view reason);
+
+    DetachedInvocations &parent_;
+    const std::string cluster_name_;
+    const Http::RequestHeaderMapPtr headers_;
+    Buffer::OwnedImpl body_;
+    uint32_t tries_{};
+    bool in_flight_{};
+    Http::AsyncClient::Request *request_{};
+    Event::TimerPtr retry_timer_;
+  };
+  using InvocationPtr = std::unique_ptr<Invocation>;
+
+  // deletes the invocation once the callback it is done in returns.
+  void done(Invocation &invocation);
+
+  Upstream::ClusterManager &cm_;
+  Event::Dispatcher &dispatcher_;
+  const DetachedInvocationsConfig config_;
+  DetachedInvocationStats stats_;
+  std::list<InvocationPtr> invocations_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,213 @@
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+#include "nlohmann/json.hpp"
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+// the total length, the headers length and the crc of both.
+constexpr uint32_t PreludeLength = 12;
+constexpr uint32_t CrcLength = 4;
+// the largest message the event stream format allows.
+constexpr uint32_t MaxMessageLength = 16 * 1024 * 1024;
+
+// the types of the header values.
+enum HeaderType : uint8_t {
+  BoolTrue = 0,
+  BoolFalse = 1,
+  Byte = 2,
+  Short = 3,
+  Integer = 4,
+  Long = 5,
+  ByteArray = 6,
+  String = 7,
+  Timestamp = 8,
+  Uuid = 9,
+};
+
+// the crc of the first length bytes of the buffer, without linearizing it.
+uint32_t crcOf(const Buffer::Instance &buffer, uint64_t length) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (const Buffer::RawSlice &slice : buffer.getRawSlices()) {
+    if (length == 0) {
+      break;
+    }
+    const uint64_t size = std::min<uint64_t>(slice.len_, length);
+    crc = crc32(crc, static_cast<const Bytef *>(slice.mem_), size);
+    length -= size;
+  }
+  return crc;
+}
+
+} // namespace
+
+bool EventStreamDecoder::decode(Buffer::Instance &data,
+                                Buffer::Instance &payload) {
+  if (!error_.empty()) {
+    data.drain(data.length());
+    return false;
+  }
+  buffered_.move(data);
+
+  while (buffered_.length() >= PreludeLength) {
+    const uint32_t total_length = buffered_.peekBEInt<uint32_t>(0);
+    const uint32_t headers_length = buffered_.peekBEInt<uint32_t>(4);
+    if (total_length > MaxMessageLength ||
+        total_length < PreludeLength + CrcLength ||
+        headers_length > total_length - PreludeLength - CrcLength) {
+      return fail("invalid message length");
+    }
+    // the prelude is checked before waiting for the rest of the message, so
+    // that a corrupt length is not waited on.
+    if (crcOf(buffered_, PreludeLength - CrcLength) !=
+        buffered_.peekBEInt<uint32_t>(PreludeLength - CrcLength)) {
+      return fail("prelude crc mismatch");
+    }
+    if (buffered_.length() < total_length) {
+      break;
+    }
+    if (!decodeMessage(total_length, headers_length, payload)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool EventStreamDecoder::decodeMessage(uint32_t total_length,
+                                       uint32_t headers_length,
+                                       Buffer::Instance &payload) {
+  if (crcOf(buffered_, total_length - CrcLength) !=
+      buffered_.peekBEInt<uint32_t>(total_length - CrcLength)) {
+    return fail("message crc mismatch");
+  }
+
+  // the headers are small, and are parsed from a copy.
+  std::string headers(headers_length, '\0');
+  buffered_.copyOut(PreludeLength, headers_length, headers.data());
+  MessageHeaders parsed;
+  if (!parseHeaders(headers, parsed)) {
+    return fail("invalid message headers");
+  }
+  buffered_.drain(PreludeLength + headers_length);
+  const uint32_t payload_length =
+      total_length - PreludeLength - headers_length - CrcLength;
+
+  if (parsed.message_type == "event" && parsed.event_type == "PayloadChunk") {
+    payload.move(buffered_, payload_length);
+    buffered_.drain(CrcLength);
+    return true;
+  }
+
+  std::string body(payload_length, '\0');
+  buffered_.copyOut(0, payload_length, body.data());
+  buffered_.drain(payload_length + CrcLength);
+
+  if (parsed.message_type == "exception") {
+    return fail(absl::StrCat(parsed.exception_type, ": ", body));
+  }
+  if (parsed.message_type == "event" &&
+      parsed.event_type == "InvokeComplete") {
+    complete_ = true;
+    const nlohmann::json result = nlohmann::json::parse(body, nullptr, false);
+    if (result.is_object()) {
+      const auto error_code = result.find("ErrorCode");
+      if (error_code != result.end() && error_code->is_string()) {
+        const auto details = result.find("ErrorDetails");
+        return fail(absl::StrCat(
+            error_code->get<std::string>(), ": ",
+            details != result.end() && details->is_string()
+                ? details->get<std::string>()
+                : ""));
+      }
+    }
+    return true;
+  }
+  // events that aren't known are skipped.
+  ENVOY_LOG(trace, "skipping event stream message {} {}",
+            parsed.message_type, parsed.event_type);
+  return true;
+}
+
+bool EventStreamDecoder::parseHeaders(absl::string_view headers,
+                                      MessageHeaders &parsed) {
+  while (!headers.empty()) {
+    const uint8_t name_length = headers[0];
+    if (headers.size() < 2u + name_length) {
+      return false;
+    }
+    const absl::string_view name = headers.substr(1, name_length);
+    const uint8_t type = headers[1 + name_length];
+    headers.remove_prefix(2 + name_length);
+
+    size_t value_offset = 0;
+    size_t value_length;
+    switch (type) {
+    case BoolTrue:
+    case BoolFalse:
+      value_length = 0;
+      break;
+    case Byte:
+      value_length = 1;
+      break;
+    case Short:
+      value_length = 2;
+      break;
+    case Integer:
+      value_length = 4;
+      break;
+    case Long:
+    case Timestamp:
+      value_length = 8;
+      break;
+    case Uuid:
+      value_length = 16;
+      break;
+    case ByteArray:
+    case String:
+      // prefixed by their 2 bytes length.
+      if (headers.size() < 2) {
+        return false;
+      }
+      value_offset = 2;
+      value_length = (static_cast<uint8_t>(headers[0]) << 8) |
+                     static_cast<uint8_t>(headers[1]);
+      break;
+    default:
+      return false;
+    }
+    if (headers.size() < value_offset + value_length) {
+      return false;
+    }
+    if (type == String) {
+      const absl::string_view value = headers.substr(value_offset, value_length);
+      if (name == ":message-type") {
+        parsed.message_type = value;
+      } else if (name == ":event-type") {
+        parsed.event_type = value;
+      } else if (name == ":exception-type") {
+        parsed.exception_type = value;
+      }
+    }
+    headers.remove_prefix(value_offset + value_length);
+  }
+  return true;
+}
+
+bool EventStreamDecoder::fail(std::string error) {
+  error_ = std::move(error);
+  buffered_.drain(buffered_.length());
+  return false;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/logger.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Decodes the application/vnd.amazon.eventstream framing of the responses of
+ * InvokeWithResponseStream. Every message is a prelude, holding the lengths of
+ * the message and of its headers and their crc, then the headers, the payload
+ * and the crc of the whole message. The payloads of the PayloadChunk events
+ * make up the response of the function, and the stream ends with an
+ * InvokeComplete event, which holds the error of the function, if any.
+ */
+class EventStreamDecoder : public Logger::Loggable<Logger::Id::aws> {
+public:
+  /**
+   * Decodes the messages of the stream that are complete. A message that is
+   * split across calls is kept until the rest of it arrives.
+   * @param data the bytes of the stream that arrived, which are drained.
+   * @param payload receives the payload of the chunks, which is moved rather
+   * than copied.
+   * @return false if the stream is malformed or reports an error, in which
+   * case all the calls that follow fail as well.
+   */
+  bool decode(Buffer::Instance &data, Buffer::Instance &payload);
+
+  // whether the InvokeComplete event was received.
+  bool complete() const { return complete_; }
+  // why the stream failed, once decode returned false.
+  const std::string &error() const { return error_; }
+
+private:
+  struct MessageHeaders {
+    absl::string_view message_type;
+    absl::string_view event_type;
+    absl::string_view exception_type;
+  };
+
+  bool decodeMessage(uint32_t total_length, uint32_t headers_length,
+                     Buffer::Instance &payload);
+  static bool parseHeaders(absl::string_view headers, MessageHeaders &parsed);
+  bool fail(std::string error);
+
+  Buffer::OwnedImpl buffered_;
+  bool complete_{};
+  std::string error_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
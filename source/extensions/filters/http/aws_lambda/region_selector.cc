@@ -0,0 +1,70 @@
+#include "source/extensions/filters/http/aws_lambda/region_selector.h"
+
+#include "source/common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+// the weight of a new response in the averages.
+constexpr double Smoothing = 0.2;
+// how much worse than its latency a region that always fails is.
+constexpr double ErrorPenalty = 10;
+} // namespace
+
+RegionSelector::RegionSelector(std::vector<Region> regions)
+    : regions_(std::move(regions)),
+      averages_(std::make_unique<Averages[]>(regions_.size())) {
+  ASSERT(!regions_.empty());
+}
+
+size_t RegionSelector::select() {
+  const uint64_t selection = selections_.fetch_add(1);
+  if (selection % ProbeInterval == ProbeInterval - 1) {
+    return (selection / ProbeInterval) % regions_.size();
+  }
+  // the earlier region wins the ties.
+  size_t best = 0;
+  double best_score = score(0);
+  for (size_t i = 1; i < regions_.size(); i++) {
+    const double region_score = score(i);
+    if (region_score < best_score) {
+      best = i;
+      best_score = region_score;
+    }
+  }
+  return best;
+}
+
+void RegionSelector::record(size_t index, std::chrono::milliseconds latency,
+                            bool error) {
+  Averages &averages = averages_[index];
+  const double latency_ms = static_cast<double>(latency.count());
+  const double failed = error ? 1 : 0;
+  if (!averages.sampled_.exchange(true)) {
+    averages.latency_ms_ = latency_ms;
+    averages.error_rate_ = failed;
+    return;
+  }
+  averages.latency_ms_ =
+      averages.latency_ms_ + Smoothing * (latency_ms - averages.latency_ms_);
+  averages.error_rate_ =
+      averages.error_rate_ + Smoothing * (failed - averages.error_rate_);
+}
+
+double RegionSelector::score(size_t index) const {
+  const Averages &averages = averages_[index];
+  if (!averages.sampled_) {
+    return 0;
+  }
+  // a region that answers in no time is still told apart by its errors.
+  return (averages.latency_ms_ + 1) *
+         (1 + ErrorPenalty * averages.error_rate_);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
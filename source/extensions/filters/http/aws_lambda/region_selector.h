@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Chooses which of the regions a function is deployed in a request is sent
+ * to, from the moving averages of the latency and of the errors of the
+ * responses of each region. The averages are shared by all the workers, and
+ * updated without a lock: an update that races with another may be lost,
+ * which only delays the averages a little.
+ */
+class RegionSelector {
+public:
+  struct Region {
+    std::string host_;
+    std::string region_;
+  };
+
+  // the regions, in order of preference.
+  explicit RegionSelector(std::vector<Region> regions);
+
+  // the index of the region the next request goes to.
+  size_t select();
+
+  const Region &region(size_t index) const { return regions_[index]; }
+  size_t size() const { return regions_.size(); }
+
+  // records the response of a request sent to the region.
+  void record(size_t index, std::chrono::milliseconds latency, bool error);
+
+  // one of every ProbeInterval requests goes to the regions in turn, so that
+  // a region that recovered is chosen again.
+  static constexpr uint64_t ProbeInterval = 100;
+
+private:
+  struct Averages {
+    std::atomic<bool> sampled_{false};
+    std::atomic<double> latency_ms_{0};
+    std::atomic<double> error_rate_{0};
+  };
+
+  // lower is better. A region that hasn't answered yet is as good as can be,
+  // so that each region is tried once.
+  double score(size_t index) const;
+
+  const std::vector<Region> regions_;
+  std::unique_ptr<Averages[]> averages_;
+  std::atomic<uint64_t> selections_{0};
+};
+
+using RegionSelectorSharedPtr = std::shared_ptr<RegionSelector>;
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,126 @@
+#include "source/extensions/filters/http/aws_lambda/response_cache.h"
+
+#include "source/common/common/hex.h"
+#include "source/common/crypto/utility.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
+#include "source/common/protobuf/utility.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+constexpr uint32_t DefaultMaxEntries = 1000;
+constexpr uint64_t DefaultMaxBodyBytes = 64 * 1024;
+} // namespace
+
+ResponseCache::ResponseCache(const ResponseCacheProto &proto,
+                             TimeSource &time_source, ResponseCacheStats stats)
+    : ttl_(DurationUtil::durationToMilliseconds(proto.ttl())),
+      max_entries_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto, max_entries,
+                                                   DefaultMaxEntries)),
+      max_body_bytes_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto, max_body_bytes,
+                                                      DefaultMaxBodyBytes)),
+      time_source_(time_source), stats_(std::move(stats)) {
+  for (const std::string &header : proto.headers()) {
+    headers_.emplace_back(absl::AsciiStrToLower(header));
+  }
+}
+
+ResponseCacheStats ResponseCache::generateStats(const std::string &prefix,
+                                                Stats::Scope &scope) {
+  return {ALL_RESPONSE_CACHE_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                   POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+std::string ResponseCache::key(const std::string &function,
+                               const Http::RequestHeaderMap &headers,
+                               const Buffer::Instance *body) const {
+  // header values can't hold a new line, which then separates the parts.
+  std::string key = absl::StrCat(function, "\n");
+  for (const Http::LowerCaseString &name : headers_) {
+    const auto values = headers.get(name);
+    absl::StrAppend(&key, name.get(), ":");
+    for (size_t i = 0; i < values.size(); i++) {
+      absl::StrAppend(&key, i == 0 ? "" : ",",
+                      values[i]->value().getStringView());
+    }
+    absl::StrAppend(&key, "\n");
+  }
+  // the body is hashed, so that large bodies don't make large keys.
+  if (body != nullptr && body->length() != 0) {
+    absl::StrAppend(&key, Hex::encode(Common::Crypto::UtilitySingleton::get()
+                                          .getSha256Digest(*body)));
+  }
+  return key;
+}
+
+ResponseCache::ResponseConstSharedPtr
+ResponseCache::lookup(const std::string &key) {
+  absl::MutexLock lock(&mutex_);
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    stats_.cache_miss_.inc();
+    return nullptr;
+  }
+  if (entry->second.expiry_ <= time_source_.monotonicTime()) {
+    evict(entry);
+    stats_.cache_miss_.inc();
+    return nullptr;
+  }
+  stats_.cache_hit_.inc();
+  return entry->second.response_;
+}
+
+void ResponseCache::insert(const std::string &key,
+                           const Http::ResponseHeaderMap &headers,
+                           const Buffer::Instance &body) {
+  if (body.length() > max_body_bytes_) {
+    return;
+  }
+  auto response = std::make_shared<Response>();
+  response->status_ = Http::Utility::getResponseStatus(headers);
+  headers.iterate([&response](const Http::HeaderEntry &header)
+                      -> Http::HeaderMap::Iterate {
+    const absl::string_view name = header.key().getStringView();
+    // the status is kept apart, and the length is that of the body.
+    if (!absl::StartsWith(name, ":") &&
+        name != Http::Headers::get().ContentLength.get()) {
+      response->headers_.emplace_back(name, header.value().getStringView());
+    }
+    return Http::HeaderMap::Iterate::Continue;
+  });
+  response->body_ = body.toString();
+  const MonotonicTime expiry = time_source_.monotonicTime() + ttl_;
+
+  absl::MutexLock lock(&mutex_);
+  auto existing = entries_.find(key);
+  if (existing != entries_.end()) {
+    evict(existing);
+  }
+  while (!order_.empty() && entries_.size() >= max_entries_) {
+    evict(entries_.find(order_.front()));
+    stats_.cache_eviction_.inc();
+  }
+  order_.push_back(key);
+  entries_.emplace(key, Entry{std::move(response), expiry, --order_.end()});
+  stats_.cache_entries_.set(entries_.size());
+}
+
+void ResponseCache::evict(
+    absl::flat_hash_map<std::string, Entry>::iterator entry) {
+  order_.erase(entry->second.order_);
+  entries_.erase(entry);
+  stats_.cache_entries_.set(entries_.size());
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
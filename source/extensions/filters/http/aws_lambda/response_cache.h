@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/common/time.h"
+#include "envoy/http/header_map.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * All stats for the response cache of a route. @see stats_macros.h
+ */
+#define ALL_RESPONSE_CACHE_STATS(COUNTER, GAUGE)                               \
+  COUNTER(cache_hit)                                                           \
+  COUNTER(cache_miss)                                                          \
+  COUNTER(cache_eviction)                                                      \
+  GAUGE(cache_entries, NeverImport)
+
+/**
+ * Wrapper struct for response cache stats. @see stats_macros.h
+ */
+struct ResponseCacheStats {
+  ALL_RESPONSE_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ResponseCacheProto = envoy::config::filter::http::aws_lambda::v2::
+    AWSLambdaPerRoute::ResponseCache;
+
+/**
+ * The responses of a function whose invocations are pure lookups, shared by
+ * all the workers. The responses are kept unwrapped and transformed, as they
+ * are sent downstream, for as long as the ttl, so that a hit skips the
+ * credentials, the signing and the invocation altogether.
+ */
+class ResponseCache {
+public:
+  struct Response {
+    uint64_t status_{};
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string body_;
+  };
+  using ResponseConstSharedPtr = std::shared_ptr<const Response>;
+
+  ResponseCache(const ResponseCacheProto &proto, TimeSource &time_source,
+                ResponseCacheStats stats);
+
+  /**
+   * @param function the path the function is invoked at, which names the
+   * function and its qualifier.
+   * @param headers the request headers, once transformed, whose configured
+   * headers are part of the key.
+   * @param body the request body, once transformed, if any.
+   * @return the key the response of the request is cached under.
+   */
+  std::string key(const std::string &function,
+                  const Http::RequestHeaderMap &headers,
+                  const Buffer::Instance *body) const;
+
+  // the unexpired response cached under the key, if any.
+  ResponseConstSharedPtr lookup(const std::string &key);
+
+  void insert(const std::string &key, const Http::ResponseHeaderMap &headers,
+              const Buffer::Instance &body);
+
+  // the largest response body that is cached.
+  uint64_t maxBodyBytes() const { return max_body_bytes_; }
+
+  static ResponseCacheStats generateStats(const std::string &prefix,
+                                          Stats::Scope &scope);
+
+private:
+  struct Entry {
+    ResponseConstSharedPtr response_;
+    MonotonicTime expiry_;
+    std::list<std::string>::iterator order_;
+  };
+
+  void evict(absl::flat_hash_map<std::string, Entry>::iterator entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const std::chrono::milliseconds ttl_;
+  const uint32_t max_entries_;
+  const uint64_t max_body_bytes_;
+  std::vector<Http::LowerCaseString> headers_;
+  TimeSource &time_source_;
+  ResponseCacheStats stats_;
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  // the keys from the oldest insertion to the newest, the oldest being evicted
+  // first when the cache is full.
+  std::list<std::string> order_ ABSL_GUARDED_BY(mutex_);
+};
+
+using ResponseCacheSharedPtr = std::shared_ptr<ResponseCache>;
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,248 @@
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_cache_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "envoy/common/exception.h"
+
+#include "source/common/common/assert.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "openssl/aead.h"
+#include "openssl/rand.h"
+#include "openssl/sha.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+constexpr absl::string_view FORMAT_VERSION = "1";
+// binds the sealed file to its purpose, so that a file sealed with the same
+// key for something else doesn't open.
+constexpr absl::string_view ASSOCIATED_DATA =
+    "io.solo.aws_lambda.sts_credentials";
+constexpr size_t NONCE_LENGTH = 12;
+// the key, access key id, secret, session token and expiry of a role.
+constexpr size_t FIELDS_PER_ROLE = 5;
+constexpr std::chrono::seconds MIN_SYNC_INTERVAL = std::chrono::minutes(1);
+
+bool writeAll(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = ::write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+} // namespace
+
+StsCredentialsCacheFile::StsCredentialsCacheFile(
+    Api::Api &api, const envoy::config::filter::http::aws_lambda::v2::
+                       AWSLambdaConfig::ServiceAccountCredentials::
+                           CredentialsCacheFile &config)
+    : api_(api), path_(config.path()) {
+  if (!api_.fileSystem().fileExists(config.key_file())) {
+    throw EnvoyException(fmt::format(
+        "Credentials cache key file {} does not exist", config.key_file()));
+  }
+  const std::string secret = api_.fileSystem().fileReadToEnd(config.key_file());
+  if (secret.empty()) {
+    throw EnvoyException(fmt::format(
+        "Credentials cache key file {} exists but is empty",
+        config.key_file()));
+  }
+  key_.resize(SHA256_DIGEST_LENGTH);
+  SHA256(reinterpret_cast<const uint8_t *>(secret.data()), secret.size(),
+         reinterpret_cast<uint8_t *>(key_.data()));
+}
+
+StsCredentialsMap
+StsCredentialsCacheFile::load(SystemTime now,
+                              std::chrono::seconds min_lifetime) const {
+  StsCredentialsMap credentials;
+  if (!api_.fileSystem().fileExists(path_)) {
+    return credentials;
+  }
+  std::string sealed;
+  try {
+    sealed = api_.fileSystem().fileReadToEnd(path_);
+  } catch (const EnvoyException &e) {
+    ENVOY_LOG(warn, "can't read the credentials cache {}: {}", path_,
+              e.what());
+    return credentials;
+  }
+  std::string plaintext;
+  if (!unseal(sealed, plaintext) || !parse(plaintext, credentials)) {
+    ENVOY_LOG(warn, "ignoring the credentials cache {}, which was sealed "
+                    "with another key or is corrupt",
+              path_);
+    return {};
+  }
+  for (auto it = credentials.begin(); it != credentials.end();) {
+    if (it->second->expirationTime() - now <= min_lifetime) {
+      credentials.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  ENVOY_LOG(debug, "loaded the credentials of {} roles from {}",
+            credentials.size(), path_);
+  return credentials;
+}
+
+bool StsCredentialsCacheFile::save(const StsCredentialsMap &credentials,
+                                   SystemTime now) const {
+  const std::string sealed = seal(serialize(credentials, now));
+  // written next to the file and renamed over it, so that it is replaced
+  // whole. The name is unique, as the process this one replaces on a hot
+  // restart may be saving its own credentials at the same time.
+  std::string temporary = absl::StrCat(path_, ".tmp.XXXXXX");
+  const int fd = ::mkostemp(temporary.data(), O_CLOEXEC);
+  if (fd < 0) {
+    ENVOY_LOG(warn, "can't write the credentials cache {}: {}", temporary,
+              errno);
+    return false;
+  }
+  // a sync blocks the main thread on the disk, so only the first write of
+  // each interval waits for it.
+  const MonotonicTime sync_time = api_.timeSource().monotonicTime();
+  const bool sync =
+      !last_sync_.has_value() || sync_time - *last_sync_ >= MIN_SYNC_INTERVAL;
+  bool written = writeAll(fd, sealed);
+  if (written && sync) {
+    written = ::fsync(fd) == 0;
+    last_sync_ = sync_time;
+  }
+  ::close(fd);
+  if (!written || std::rename(temporary.c_str(), path_.c_str()) != 0) {
+    ENVOY_LOG(warn, "can't write the credentials cache {}: {}", path_, errno);
+    ::unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string StsCredentialsCacheFile::serialize(
+    const StsCredentialsMap &credentials, SystemTime now) {
+  std::string out = absl::StrCat(FORMAT_VERSION, "\n");
+  for (const auto &[key, role] : credentials) {
+    if (role->expirationTime() <= now) {
+      continue;
+    }
+    const std::string &access_key_id = role->accessKeyId().value_or("");
+    const std::string &secret_access_key =
+        role->secretAccessKey().value_or("");
+    const std::string &session_token = role->sessionToken().value_or("");
+    // none of the fields of sts credentials hold new lines, but one that
+    // did would misalign the ones that follow.
+    if (absl::StrContains(key, '\n') ||
+        absl::StrContains(access_key_id, '\n') ||
+        absl::StrContains(secret_access_key, '\n') ||
+        absl::StrContains(session_token, '\n')) {
+      continue;
+    }
+    absl::StrAppend(&out, key, "\n", access_key_id, "\n", secret_access_key,
+                    "\n", session_token, "\n",
+                    std::chrono::duration_cast<std::chrono::seconds>(
+                        role->expirationTime().time_since_epoch())
+                        .count(),
+                    "\n");
+  }
+  return out;
+}
+
+bool StsCredentialsCacheFile::parse(absl::string_view plaintext,
+                                    StsCredentialsMap &out) {
+  std::vector<absl::string_view> lines = absl::StrSplit(plaintext, '\n');
+  // the last line ends with a new line too.
+  if (lines.size() < 2 || lines.front() != FORMAT_VERSION ||
+      !lines.back().empty() || (lines.size() - 2) % FIELDS_PER_ROLE != 0) {
+    return false;
+  }
+  for (size_t i = 1; i + FIELDS_PER_ROLE < lines.size();
+       i += FIELDS_PER_ROLE) {
+    int64_t expiry;
+    if (!absl::SimpleAtoi(lines[i + 4], &expiry)) {
+      return false;
+    }
+    out[std::string(lines[i])] = std::make_shared<const StsCredentials>(
+        lines[i + 1], lines[i + 2], lines[i + 3],
+        SystemTime(std::chrono::seconds(expiry)));
+  }
+  return true;
+}
+
+std::string StsCredentialsCacheFile::seal(absl::string_view plaintext) const {
+  bssl::ScopedEVP_AEAD_CTX ctx;
+  const EVP_AEAD *aead = EVP_aead_aes_256_gcm();
+  RELEASE_ASSERT(EVP_AEAD_CTX_init(ctx.get(), aead,
+                                   reinterpret_cast<const uint8_t *>(
+                                       key_.data()),
+                                   key_.size(), EVP_AEAD_DEFAULT_TAG_LENGTH,
+                                   nullptr) == 1,
+                 "");
+  std::string sealed(
+      NONCE_LENGTH + plaintext.size() + EVP_AEAD_max_overhead(aead), '\0');
+  uint8_t *nonce = reinterpret_cast<uint8_t *>(sealed.data());
+  RAND_bytes(nonce, NONCE_LENGTH);
+  size_t length;
+  RELEASE_ASSERT(
+      EVP_AEAD_CTX_seal(
+          ctx.get(), nonce + NONCE_LENGTH, &length,
+          sealed.size() - NONCE_LENGTH, nonce, NONCE_LENGTH,
+          reinterpret_cast<const uint8_t *>(plaintext.data()),
+          plaintext.size(),
+          reinterpret_cast<const uint8_t *>(ASSOCIATED_DATA.data()),
+          ASSOCIATED_DATA.size()) == 1,
+      "");
+  sealed.resize(NONCE_LENGTH + length);
+  return sealed;
+}
+
+bool StsCredentialsCacheFile::unseal(absl::string_view sealed,
+                                     std::string &plaintext) const {
+  if (sealed.size() < NONCE_LENGTH) {
+    return false;
+  }
+  bssl::ScopedEVP_AEAD_CTX ctx;
+  if (EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_256_gcm(),
+                        reinterpret_cast<const uint8_t *>(key_.data()),
+                        key_.size(), EVP_AEAD_DEFAULT_TAG_LENGTH,
+                        nullptr) != 1) {
+    return false;
+  }
+  const uint8_t *nonce = reinterpret_cast<const uint8_t *>(sealed.data());
+  plaintext.resize(sealed.size() - NONCE_LENGTH);
+  size_t length;
+  if (EVP_AEAD_CTX_open(
+          ctx.get(), reinterpret_cast<uint8_t *>(plaintext.data()), &length,
+          plaintext.size(), nonce, NONCE_LENGTH, nonce + NONCE_LENGTH,
+          sealed.size() - NONCE_LENGTH,
+          reinterpret_cast<const uint8_t *>(ASSOCIATED_DATA.data()),
+          ASSOCIATED_DATA.size()) != 1) {
+    return false;
+  }
+  plaintext.resize(length);
+  return true;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
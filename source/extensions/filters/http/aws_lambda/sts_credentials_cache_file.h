@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "envoy/api/api.h"
+#include "envoy/common/time.h"
+
+#include "source/common/common/logger.h"
+#include "source/extensions/filters/http/aws_lambda/sts_fetcher.h"
+
+#include "absl/types/optional.h"
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+using StsCredentialsMap =
+    std::unordered_map<std::string, StsCredentialsConstSharedPtr>;
+
+/**
+ * Keeps the sts credentials of the roles in a file that outlives the process,
+ * so that the one that replaces it on a hot restart or a deploy starts with
+ * the credentials that are still valid. The file is sealed with AES-256-GCM,
+ * under a key derived from the contents of the key file, and is replaced
+ * atomically so that the processes running side by side during a hot restart
+ * never read a partial file. It is synced to disk at most once a minute; a
+ * file that a crash of the host leaves partial doesn't open, and holds no
+ * credentials.
+ */
+class StsCredentialsCacheFile : public Logger::Loggable<Logger::Id::aws> {
+public:
+  /**
+   * @throw EnvoyException if the key file can't be read or is empty.
+   */
+  StsCredentialsCacheFile(Api::Api &api,
+                          const envoy::config::filter::http::aws_lambda::v2::
+                              AWSLambdaConfig::ServiceAccountCredentials::
+                                  CredentialsCacheFile &config);
+
+  /**
+   * @return the credentials in the file that are valid for at least
+   * min_lifetime past now, keyed like the cache of the credentials provider.
+   * A missing or corrupt file, or one sealed with another key, holds none.
+   */
+  StsCredentialsMap load(SystemTime now,
+                         std::chrono::seconds min_lifetime) const;
+
+  /**
+   * Replaces the file with the credentials that are not expired yet.
+   * @return false if the file could not be written.
+   */
+  bool save(const StsCredentialsMap &credentials, SystemTime now) const;
+
+  static std::string serialize(const StsCredentialsMap &credentials,
+                               SystemTime now);
+  static bool parse(absl::string_view plaintext, StsCredentialsMap &out);
+
+private:
+  std::string seal(absl::string_view plaintext) const;
+  bool unseal(absl::string_view sealed, std::string &plaintext) const;
+
+  Api::Api &api_;
+  const std::string path_;
+  // derived from the contents of the key file.
+  std::string key_;
+  // when save last synced the file to disk.
+  mutable absl::optional<MonotonicTime> last_sync_;
+};
+
+using StsCredentialsCacheFilePtr = std::unique_ptr<StsCredentialsCacheFile>;
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,282 @@
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_manager.h"
+
+#include "source/common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+StsCredentialsManagerSharedPtr StsCredentialsManager::create(
+    StsCredentialsProviderPtr provider, Event::Dispatcher &main_dispatcher,
+    ThreadLocal::SlotAllocator &tls, TimeSource &time_source,
+    std::string_view default_role_arn) {
+  // We can't use make_shared here because the constructor of this class is
+  // private.
+  return StsCredentialsManagerSharedPtr(
+      new StsCredentialsManager(std::move(provider), main_dispatcher, tls,
+                                time_source, default_role_arn));
+}
+
+StsCredentialsManager::StsCredentialsManager(
+    StsCredentialsProviderPtr provider, Event::Dispatcher &main_dispatcher,
+    ThreadLocal::SlotAllocator &tls, TimeSource &time_source,
+    std::string_view default_role_arn)
+    : main_dispatcher_(main_dispatcher), time_source_(time_source),
+      default_role_arn_(default_role_arn), tls_(tls),
+      provider_(std::move(provider)) {
+  tls_.set([](Event::Dispatcher &dispatcher) {
+    return std::make_shared<ThreadLocalStsCredentials>(dispatcher);
+  });
+}
+
+StsConnectionPool::Context *StsCredentialsManager::find(
+    const absl::optional<std::string> &role_arn, bool disable_role_chaining,
+    StsConnectionPool::Context::Callbacks *callbacks) {
+  const std::string role_arn_lookup = StsCredentialsProvider::lookupKey(
+      role_arn.value_or(default_role_arn_), disable_role_chaining);
+  ThreadLocalStsCredentials &local = *tls_;
+
+  const auto existing = local.credentials_.find(role_arn_lookup);
+  if (existing != local.credentials_.end()) {
+    const StsCredentialsConstSharedPtr credentials = existing->second;
+    const auto time_left =
+        credentials->expirationTime() - time_source_.systemTime();
+    if (time_left > REFRESH_GRACE_PERIOD) {
+      callbacks->onSuccess(credentials);
+      return nullptr;
+    }
+    if (time_left > MIN_CREDENTIALS_LIFETIME) {
+      // serve the copy while the main thread refreshes it.
+      if (!local.pending_.contains(role_arn_lookup)) {
+        local.pending_[role_arn_lookup];
+        request(role_arn_lookup, role_arn, disable_role_chaining);
+      }
+      callbacks->onSuccess(credentials);
+      return nullptr;
+    }
+  }
+
+  const bool requested = local.pending_.contains(role_arn_lookup);
+  Waiter &waiter = local.acquire(callbacks);
+  local.pending_[role_arn_lookup].pushBack(waiter);
+  if (!requested) {
+    const uint64_t generation = waiter.generation_;
+    request(role_arn_lookup, role_arn, disable_role_chaining);
+    // the main thread may have answered right away, when the post ran
+    // inline, in which case the waiter may have been resumed already.
+    if (waiter.generation_ != generation) {
+      return nullptr;
+    }
+  }
+  return &waiter;
+}
+
+void StsCredentialsManager::request(const std::string &role_arn_lookup,
+                                    const absl::optional<std::string> &role_arn,
+                                    bool disable_role_chaining) {
+  main_dispatcher_.post([weak_this = weak_from_this(), role_arn_lookup,
+                         role_arn, disable_role_chaining]() {
+    if (StsCredentialsManagerSharedPtr manager = weak_this.lock()) {
+      manager->fetch(role_arn_lookup, role_arn, disable_role_chaining);
+    }
+  });
+}
+
+void StsCredentialsManager::fetch(const std::string &role_arn_lookup,
+                                  const absl::optional<std::string> &role_arn,
+                                  bool disable_role_chaining) {
+  FetchPtr &fetch = fetches_[role_arn_lookup];
+  if (fetch == nullptr) {
+    fetch = std::make_unique<Fetch>(*this, role_arn_lookup);
+  }
+  // workers that ask while a fetch is in flight get its result.
+  if (fetch->in_flight_) {
+    return;
+  }
+  fetch->in_flight_ = true;
+  // the context, if any, is owned by the provider.
+  provider_->find(role_arn, disable_role_chaining, fetch.get());
+}
+
+void StsCredentialsManager::prefetch(
+    const absl::optional<std::string> &role_arn, bool disable_role_chaining) {
+  const std::string role_arn_lookup = StsCredentialsProvider::lookupKey(
+      role_arn.value_or(default_role_arn_), disable_role_chaining);
+  ENVOY_LOG(debug, "prefetching sts credentials for {}", role_arn_lookup);
+  prefetching_.insert(role_arn_lookup);
+  fetch(role_arn_lookup, role_arn, disable_role_chaining);
+}
+
+void StsCredentialsManager::whenPrefetched(std::function<void()> callback) {
+  if (prefetching_.empty()) {
+    callback();
+    return;
+  }
+  prefetched_callbacks_.push_back(std::move(callback));
+}
+
+void StsCredentialsManager::onFetched(const std::string &role_arn_lookup) {
+  if (prefetching_.erase(role_arn_lookup) == 0 || !prefetching_.empty()) {
+    return;
+  }
+  const std::vector<std::function<void()>> callbacks =
+      std::move(prefetched_callbacks_);
+  prefetched_callbacks_.clear();
+  for (const auto &callback : callbacks) {
+    callback();
+  }
+}
+
+void StsCredentialsManager::Fetch::onSuccess(
+    std::shared_ptr<const Envoy::Extensions::Common::Aws::Credentials>
+        credentials) {
+  in_flight_ = false;
+  // the provider only ever hands out sts credentials.
+  auto sts_credentials =
+      std::dynamic_pointer_cast<const StsCredentials>(credentials);
+  ASSERT(sts_credentials != nullptr);
+  parent_.publish(role_arn_lookup_, std::move(sts_credentials));
+  parent_.onFetched(role_arn_lookup_);
+}
+
+void StsCredentialsManager::Fetch::onFailure(CredentialsFailureStatus status) {
+  in_flight_ = false;
+  parent_.publishFailure(role_arn_lookup_, status);
+  parent_.onFetched(role_arn_lookup_);
+}
+
+void StsCredentialsManager::publish(const std::string &role_arn_lookup,
+                                    StsCredentialsConstSharedPtr credentials) {
+  ENVOY_LOG(trace, "publishing sts credentials for {} to the workers",
+            role_arn_lookup);
+  tls_.runOnAllThreads([role_arn_lookup, credentials](
+                           OptRef<ThreadLocalStsCredentials> local) {
+    local->credentials_[role_arn_lookup] = credentials;
+    local->resume(role_arn_lookup, credentials, {});
+  });
+}
+
+void StsCredentialsManager::publishFailure(const std::string &role_arn_lookup,
+                                           CredentialsFailureStatus status) {
+  ENVOY_LOG(debug, "failed to fetch sts credentials for {}", role_arn_lookup);
+  // the copies the workers have are kept for as long as they are valid.
+  tls_.runOnAllThreads(
+      [role_arn_lookup, status](OptRef<ThreadLocalStsCredentials> local) {
+        local->resume(role_arn_lookup, nullptr, status);
+      });
+}
+
+void StsCredentialsManager::Waiter::cancel() {
+  // Cancel should never be called once the waiter has been resumed.
+  ASSERT(next_ != this);
+  local_->release(*this);
+}
+
+void StsCredentialsManager::Waiter::unlink() {
+  prev_->next_ = next_;
+  next_->prev_ = prev_;
+  prev_ = this;
+  next_ = this;
+}
+
+void StsCredentialsManager::WaiterList::pushBack(Waiter &waiter) {
+  waiter.prev_ = head_.prev_;
+  waiter.next_ = &head_;
+  head_.prev_->next_ = &waiter;
+  head_.prev_ = &waiter;
+}
+
+void StsCredentialsManager::WaiterList::splice(WaiterList &other) {
+  if (other.empty()) {
+    return;
+  }
+  Waiter *first = other.head_.next_;
+  Waiter *last = other.head_.prev_;
+  first->prev_ = head_.prev_;
+  head_.prev_->next_ = first;
+  last->next_ = &head_;
+  head_.prev_ = last;
+  other.head_.next_ = &other.head_;
+  other.head_.prev_ = &other.head_;
+}
+
+StsCredentialsManager::Waiter &
+StsCredentialsManager::ThreadLocalStsCredentials::acquire(
+    StsConnectionPool::Context::Callbacks *callbacks) {
+  Waiter *waiter;
+  if (free_waiters_.empty()) {
+    waiter = &waiters_.emplace_back(*this);
+  } else {
+    waiter = free_waiters_.back();
+    free_waiters_.pop_back();
+  }
+  waiter->callbacks_ = callbacks;
+  return *waiter;
+}
+
+void StsCredentialsManager::ThreadLocalStsCredentials::release(
+    Waiter &waiter) {
+  waiter.unlink();
+  waiter.callbacks_ = nullptr;
+  ++waiter.generation_;
+  free_waiters_.push_back(&waiter);
+}
+
+void StsCredentialsManager::ThreadLocalStsCredentials::resume(
+    const std::string &role_arn_lookup,
+    StsCredentialsConstSharedPtr credentials,
+    CredentialsFailureStatus status) {
+  // the waiters are taken out first, as their callbacks may look up the role
+  // again.
+  auto pending = pending_.find(role_arn_lookup);
+  if (pending == pending_.end()) {
+    return;
+  }
+  if (!pending->second.empty()) {
+    Resumption &resumption = resuming_.emplace_back();
+    resumption.waiters_.splice(pending->second);
+    resumption.credentials_ = std::move(credentials);
+    resumption.status_ = status;
+  }
+  pending_.erase(pending);
+  resumeBatch();
+}
+
+void StsCredentialsManager::ThreadLocalStsCredentials::resumeBatch() {
+  size_t resumed = 0;
+  while (!resuming_.empty() && resumed < RESUME_BATCH_SIZE) {
+    Resumption &resumption = resuming_.front();
+    if (resumption.waiters_.empty()) {
+      resuming_.pop_front();
+      continue;
+    }
+    Waiter &waiter = resumption.waiters_.front();
+    StsConnectionPool::Context::Callbacks *callbacks = waiter.callbacks_;
+    const StsCredentialsConstSharedPtr credentials = resumption.credentials_;
+    const CredentialsFailureStatus status = resumption.status_;
+    // the waiter is recycled before the callbacks, which may wait again.
+    release(waiter);
+    ++resumed;
+    if (credentials != nullptr) {
+      callbacks->onSuccess(credentials);
+    } else {
+      callbacks->onFailure(status);
+    }
+  }
+  if (resuming_.empty() || resume_scheduled_) {
+    return;
+  }
+  resume_scheduled_ = true;
+  dispatcher_.post([weak_this = weak_from_this()]() {
+    if (std::shared_ptr<ThreadLocalStsCredentials> local = weak_this.lock()) {
+      local->resume_scheduled_ = false;
+      local->resumeBatch();
+    }
+  });
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "source/common/common/logger.h"
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+// the number of the streams waiting on a role that are resumed at once, when
+// its credentials are fetched. The others are resumed on the next iterations
+// of the dispatcher, so that a role that many streams wait on doesn't hold up
+// the other streams of the worker.
+constexpr size_t RESUME_BATCH_SIZE = 64;
+} // namespace
+
+class StsCredentialsManager;
+using StsCredentialsManagerSharedPtr = std::shared_ptr<StsCredentialsManager>;
+
+/**
+ * Shares the sts credentials of the roles between all the workers. The
+ * credentials are fetched by a single provider on the main thread, and every
+ * set that is fetched is pushed to all the workers, which keep an immutable
+ * copy. A worker only asks the main thread for the credentials of a role when
+ * its copy is missing or due for a refresh, so that a role is assumed once per
+ * rotation instead of once per worker.
+ */
+class StsCredentialsManager
+    : public std::enable_shared_from_this<StsCredentialsManager>,
+      public Logger::Loggable<Logger::Id::aws> {
+public:
+  /**
+   * @param provider the provider that fetches the credentials, called on the
+   * main thread only.
+   * @param main_dispatcher the dispatcher of the main thread.
+   * @param default_role_arn the role assumed when none is configured.
+   */
+  static StsCredentialsManagerSharedPtr
+  create(StsCredentialsProviderPtr provider, Event::Dispatcher &main_dispatcher,
+         ThreadLocal::SlotAllocator &tls, TimeSource &time_source,
+         std::string_view default_role_arn);
+
+  /**
+   * Called on a worker, with the same contract as StsCredentialsProvider.
+   * @return a context if the credentials are not available yet, in which case
+   * the callbacks are called once the main thread has fetched them.
+   */
+  StsConnectionPool::Context *
+  find(const absl::optional<std::string> &role_arn, bool disable_role_chaining,
+       StsConnectionPool::Context::Callbacks *callbacks);
+
+  // Called on the main thread.
+  void setWebToken(std::string_view web_token) {
+    provider_->setWebToken(web_token);
+  }
+
+  /**
+   * Fetches the credentials of the role and pushes them to the workers ahead
+   * of their first request. Called on the main thread.
+   */
+  void prefetch(const absl::optional<std::string> &role_arn,
+                bool disable_role_chaining);
+
+  /**
+   * Calls back, on the main thread, once all the prefetches that were started
+   * have completed, successfully or not. Calls back right away if there are
+   * none in flight.
+   */
+  void whenPrefetched(std::function<void()> callback);
+
+private:
+  StsCredentialsManager(StsCredentialsProviderPtr provider,
+                        Event::Dispatcher &main_dispatcher,
+                        ThreadLocal::SlotAllocator &tls,
+                        TimeSource &time_source,
+                        std::string_view default_role_arn);
+
+  struct ThreadLocalStsCredentials;
+  class WaiterList;
+
+  // a request of a worker that waits on the main thread. The waiters are
+  // linked into the list of the role they wait on, and recycled by their
+  // worker, so that parking a stream doesn't allocate.
+  class Waiter : public StsConnectionPool::Context {
+  public:
+    // the head of a list.
+    Waiter() = default;
+    explicit Waiter(ThreadLocalStsCredentials &local) : local_(&local) {}
+    Waiter(const Waiter &) = delete;
+    Waiter &operator=(const Waiter &) = delete;
+
+    StsConnectionPool::Context::Callbacks *callbacks() const override {
+      return callbacks_;
+    }
+    // the waiter is unlinked, and can be reused right away.
+    void cancel() override;
+
+  private:
+    friend class StsCredentialsManager;
+    friend class WaiterList;
+    friend struct ThreadLocalStsCredentials;
+
+    void unlink();
+
+    ThreadLocalStsCredentials *local_{};
+    StsConnectionPool::Context::Callbacks *callbacks_{};
+    // bumped every time the waiter is recycled.
+    uint64_t generation_{};
+    Waiter *prev_{this};
+    Waiter *next_{this};
+  };
+
+  // a circular list of waiters, that a waiter leaves without knowing which
+  // list it is in.
+  class WaiterList {
+  public:
+    WaiterList() = default;
+    WaiterList(const WaiterList &) = delete;
+    WaiterList &operator=(const WaiterList &) = delete;
+
+    bool empty() const { return head_.next_ == &head_; }
+    Waiter &front() { return *head_.next_; }
+    void pushBack(Waiter &waiter);
+    // moves all the waiters of the other list to the back of this one.
+    void splice(WaiterList &other);
+
+  private:
+    Waiter head_;
+  };
+
+  // the waiters of a role whose fetch completed, resumed in batches.
+  struct Resumption {
+    WaiterList waiters_;
+    // null if the fetch failed.
+    StsCredentialsConstSharedPtr credentials_;
+    CredentialsFailureStatus status_{};
+  };
+
+  struct ThreadLocalStsCredentials
+      : public ThreadLocal::ThreadLocalObject,
+        public std::enable_shared_from_this<ThreadLocalStsCredentials> {
+    explicit ThreadLocalStsCredentials(Event::Dispatcher &dispatcher)
+        : dispatcher_(dispatcher) {}
+
+    Waiter &acquire(StsConnectionPool::Context::Callbacks *callbacks);
+    void release(Waiter &waiter);
+    // hands the outcome of the fetch of the role to its waiters.
+    void resume(const std::string &role_arn_lookup,
+                StsCredentialsConstSharedPtr credentials,
+                CredentialsFailureStatus status);
+    // resumes at most RESUME_BATCH_SIZE waiters, and the others on the next
+    // iterations of the dispatcher.
+    void resumeBatch();
+
+    Event::Dispatcher &dispatcher_;
+    // the copies of the credentials, keyed by StsCredentialsProvider::lookupKey
+    absl::flat_hash_map<std::string, StsCredentialsConstSharedPtr>
+        credentials_;
+    // the storage of the waiters, which is never shrunk, and the ones that
+    // can be reused.
+    std::deque<Waiter> waiters_;
+    std::vector<Waiter *> free_waiters_;
+    // the roles requested from the main thread, with the requests waiting on
+    // them. A refresh ahead of expiry has no waiters. The lists don't move, as
+    // their waiters point to them.
+    absl::node_hash_map<std::string, WaiterList> pending_;
+    std::list<Resumption> resuming_;
+    bool resume_scheduled_{};
+  };
+
+  // the fetch of the credentials of a role on the main thread, on behalf of
+  // all the workers.
+  class Fetch : public StsConnectionPool::Context::Callbacks {
+  public:
+    Fetch(StsCredentialsManager &parent, std::string role_arn_lookup)
+        : parent_(parent), role_arn_lookup_(std::move(role_arn_lookup)) {}
+
+    void onSuccess(
+        std::shared_ptr<const Envoy::Extensions::Common::Aws::Credentials>
+            credentials) override;
+    void onFailure(CredentialsFailureStatus status) override;
+
+    bool in_flight_{false};
+
+  private:
+    StsCredentialsManager &parent_;
+    const std::string role_arn_lookup_;
+  };
+  using FetchPtr = std::unique_ptr<Fetch>;
+
+  // posts a request for the credentials of the role to the main thread.
+  void request(const std::string &role_arn_lookup,
+               const absl::optional<std::string> &role_arn,
+               bool disable_role_chaining);
+  // runs on the main thread.
+  void fetch(const std::string &role_arn_lookup,
+             const absl::optional<std::string> &role_arn,
+             bool disable_role_chaining);
+  void publish(const std::string &role_arn_lookup,
+               StsCredentialsConstSharedPtr credentials);
+  void publishFailure(const std::string &role_arn_lookup,
+                      CredentialsFailureStatus status);
+  void onFetched(const std::string &role_arn_lookup);
+
+  Event::Dispatcher &main_dispatcher_;
+  TimeSource &time_source_;
+  const std::string default_role_arn_;
+  ThreadLocal::TypedSlot<ThreadLocalStsCredentials> tls_;
+
+  // main thread only. The fetches are declared before the provider, so that
+  // the contexts of the provider don't outlive their callbacks.
+  absl::flat_hash_map<std::string, FetchPtr> fetches_;
+  absl::flat_hash_set<std::string> prefetching_;
+  std::vector<std::function<void()>> prefetched_callbacks_;
+  StsCredentialsProviderPtr provider_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -25,6 +25,7 @@ public:
       const envoy::config::filter::http::aws_lambda::v2::
           AWSLambdaConfig_ServiceAccountCredentials &config,
       Api::Api &api, Upstream::ClusterManager &cm,
+      Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
       StsConnectionPoolFactoryPtr conn_pool_factory, std::string_view web_token,
       std::string_view role_arn);
 
@@ -42,32 +43,74 @@ public:
               std::list<std::string>  &chained_requests) override; 
 
 private:
+  // the role a connection pool assumes, so that its credentials can be
+  // refreshed without a request asking for them.
+  struct CachedRole {
+    std::string role_arn_;
+    bool disable_role_chaining_;
+    Event::TimerPtr refresh_timer_;
+  };
+
+  // starts fetching the credentials of the role, unless they are already being
+  // fetched, and returns the connection pool that fetches them.
+  StsConnectionPool &fetch(const std::string &role_arn,
+                           const std::string &role_arn_lookup,
+                           bool disable_role_chaining);
+  StsConnectionPool &pool(const std::string &role_arn,
+                          const std::string &role_arn_lookup,
+                          bool disable_role_chaining);
+  void scheduleRefresh(const std::string &role_arn_lookup,
+                       const StsCredentials &credentials);
+  void refresh(const std::string &role_arn_lookup);
+
   Api::Api &api_;
   Upstream::ClusterManager &cm_;
+  Event::Dispatcher &dispatcher_;
+  StsCredentialsProviderStats &stats_;
   const envoy::config::filter::http::aws_lambda::v2::
       AWSLambdaConfig_ServiceAccountCredentials config_;
 
   std::string default_role_arn_;
   envoy::config::core::v3::HttpUri uri_;
   StsConnectionPoolFactoryPtr conn_pool_factory_;
+  // shared by the fetchers of all the roles, so it outlives them.
+  StsFetchQueue fetch_queue_;
 
   // web_token set by AWS, will be auto-updated by StsCredentialsProvider
   std::string web_token_;
   // Credentials storage map, keyed by arn
-  std::unordered_map<std::string, StsCredentialsConstSharedPtr>
-      credentials_cache_;
+  StsCredentialsMap credentials_cache_;
+  // keeps the credentials for the process that replaces this one, if set.
+  StsCredentialsCacheFilePtr cache_file_;
 
   std::unordered_map<std::string, StsConnectionPoolPtr> connection_pools_;
+  // keyed like the connection pools
+  std::unordered_map<std::string, CachedRole> roles_;
 };
 
 StsCredentialsProviderImpl::StsCredentialsProviderImpl(
   const envoy::config::filter::http::aws_lambda::v2::
       AWSLambdaConfig_ServiceAccountCredentials &config,
   Api::Api &api, Upstream::ClusterManager &cm,
+  Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
   StsConnectionPoolFactoryPtr conn_pool_factory, std::string_view web_token,
   std::string_view role_arn)
-  : api_(api), cm_(cm), config_(config), default_role_arn_(role_arn),
-    conn_pool_factory_(std::move(conn_pool_factory)), web_token_(web_token) {
+  : api_(api), cm_(cm), dispatcher_(dispatcher), stats_(stats),
+    config_(config), default_role_arn_(role_arn),
+    conn_pool_factory_(std::move(conn_pool_factory)),
+    fetch_queue_(config.max_concurrent_fetches(), stats.sts_fetch_time_,
+                 stats.sts_fetches_queued_, api.timeSource()),
+    web_token_(web_token) {
+
+  if (config_.has_credentials_cache_file()) {
+    cache_file_ = std::make_unique<StsCredentialsCacheFile>(
+        api_, config_.credentials_cache_file());
+    // the credentials of the process this one replaces are served until they
+    // are due for a refresh.
+    credentials_cache_ = cache_file_->load(api_.timeSource().systemTime(),
+                                           MIN_CREDENTIALS_LIFETIME);
+    stats_.sts_cache_file_restored_.add(credentials_cache_.size());
+  }
 
   uri_.set_cluster(config_.cluster());
   uri_.set_uri(config_.uri());
@@ -91,6 +134,11 @@ void StsCredentialsProviderImpl::onResult(
   if (!inserted.second){
     credentials_cache_[role_arn] = result;
   }
+  scheduleRefresh(role_arn, *result);
+  if (cache_file_ != nullptr &&
+      !cache_file_->save(credentials_cache_, api_.timeSource().systemTime())) {
+    stats_.sts_cache_file_write_failed_.inc();
+  }
 
   // kick off any waiting chained assumption roles relying on this credential
   while( !chained_requests.empty()){
@@ -133,12 +181,8 @@ StsConnectionPool::Context *StsCredentialsProviderImpl::find(
     role_arn = role_arn_arg.value();
   }
 
-  std::string role_arn_lookup = role_arn;
-  if (disable_role_chaining) {
-    // if disable_role_chaining is set on an upstream we need a distinction 
-    // so that we can serve both chained and non-chained as needed
-    role_arn_lookup = "no-chain-" + role_arn;
-  }
+  const std::string role_arn_lookup =
+      lookupKey(role_arn, disable_role_chaining);
       
 
   ASSERT(!role_arn.empty());
@@ -148,31 +192,59 @@ StsConnectionPool::Context *StsCredentialsProviderImpl::find(
   const auto existing_token = credentials_cache_.find(role_arn_lookup);
   if (existing_token != credentials_cache_.end()) {
     // thing  exists
+    const StsCredentialsConstSharedPtr credentials = existing_token->second;
     const auto now = api_.timeSource().systemTime();
     // If the expiration time is more than a minute away, return it immediately
-    auto time_left = existing_token->second->expirationTime() - now;
+    auto time_left = credentials->expirationTime() - now;
     if (time_left > REFRESH_GRACE_PERIOD) {
-      callbacks->onSuccess(existing_token->second);
+      stats_.sts_cache_hit_.inc();
+      callbacks->onSuccess(credentials);
+      return nullptr;
+    }
+    // the credentials are due for a refresh, which happens in the background
+    // as long as they can still be used for this request.
+    if (time_left > MIN_CREDENTIALS_LIFETIME) {
+      stats_.sts_cache_hit_.inc();
+      fetch(role_arn, role_arn_lookup, disable_role_chaining);
+      callbacks->onSuccess(credentials);
       return nullptr;
     }
     // token is expired, fallthrough to create a new one
   }
 
-  // Look for active connection pool for given role_arn
+  stats_.sts_cache_miss_.inc();
+  // generate and return a context with the current callbacks
+  return fetch(role_arn, role_arn_lookup, disable_role_chaining).add(callbacks);
+};
+
+StsConnectionPool &
+StsCredentialsProviderImpl::pool(const std::string &role_arn,
+                                 const std::string &role_arn_lookup,
+                                 bool disable_role_chaining) {
   auto conn_pool = connection_pools_.find(role_arn_lookup);
-  if (conn_pool != connection_pools_.end()) {
-    // We have an existing connection pool, 
-    // check if there is already a request in flight
-    if (conn_pool->second->requestInFlight()) {
-     // add new context to connection pool and return it to the caller
-     return conn_pool->second->add(callbacks);
-    }
-  }else{
-     // since there is no existing connection pool then we need to create one
-     conn_pool =  connection_pools_
-          .emplace(role_arn_lookup, conn_pool_factory_->build(
-            role_arn_lookup, role_arn, this, StsFetcher::create(cm_, api_)))
-          .first;
+  if (conn_pool == connection_pools_.end()) {
+    conn_pool = connection_pools_
+                    .emplace(role_arn_lookup,
+                             conn_pool_factory_->build(
+                                 role_arn_lookup, role_arn, this,
+                                 StsFetcher::create(cm_, api_, &fetch_queue_)))
+                    .first;
+    roles_.emplace(role_arn_lookup,
+                   CachedRole{role_arn, disable_role_chaining, nullptr});
+  }
+  return *conn_pool->second;
+}
+
+StsConnectionPool &
+StsCredentialsProviderImpl::fetch(const std::string &role_arn,
+                                  const std::string &role_arn_lookup,
+                                  bool disable_role_chaining) {
+  // Look for active connection pool for given role_arn, and check if there is
+  // already a request in flight
+  StsConnectionPool &conn_pool =
+      pool(role_arn, role_arn_lookup, disable_role_chaining);
+  if (conn_pool.requestInFlight()) {
+    return conn_pool;
   }
 
   // Short circuit any additional checks if we are the base arn 
@@ -180,8 +252,8 @@ StsConnectionPool::Context *StsCredentialsProviderImpl::find(
   //  and use webtoken.
   if (role_arn == default_role_arn_  ||  disable_role_chaining) {
     // initialize the connection and subscribe to the callbacks
-    conn_pool->second->init(uri_, web_token_, NULL);
-    return conn_pool->second->add(callbacks);
+    conn_pool.init(uri_, web_token_, NULL);
+    return conn_pool;
   }
 
   // For chaining check to see if we need to get the base token in addition.
@@ -189,35 +261,75 @@ StsConnectionPool::Context *StsCredentialsProviderImpl::find(
   // need to make sure the creds are good for the duration of our sts call.
   const auto existing_base_token = credentials_cache_.find(default_role_arn_); 
   if (existing_base_token != credentials_cache_.end()) {
+    const StsCredentialsConstSharedPtr base_token = existing_base_token->second;
     const auto now = api_.timeSource().systemTime();
-    auto time_left = existing_base_token->second->expirationTime() - now;
-    if (time_left > REFRESH_GRACE_PERIOD) {
+    auto time_left = base_token->expirationTime() - now;
+    if (time_left > MIN_CREDENTIALS_LIFETIME) {
       ENVOY_LOG(trace,"found base token with remaining time");
-      conn_pool->second->init(uri_, web_token_, existing_base_token->second);
-      return conn_pool->second->add(callbacks);
+      if (time_left <= REFRESH_GRACE_PERIOD) {
+        // the base token is refreshed once for all the chained roles, which
+        // don't wait on it while it's still good for their own sts call.
+        fetch(default_role_arn_, default_role_arn_, false);
+      }
+      conn_pool.init(uri_, web_token_, base_token);
+      return conn_pool;
     }
   }
   
   // find/create default connection pool
-  auto base_conn_pool = connection_pools_.find(default_role_arn_);
-  if (base_conn_pool == connection_pools_.end()) {
-     base_conn_pool =  connection_pools_
-          .emplace(default_role_arn_, conn_pool_factory_->build(
-            default_role_arn_, default_role_arn_, this, 
-            StsFetcher::create(cm_, api_))).first;
-  }
+  StsConnectionPool &base_conn_pool =
+      pool(default_role_arn_, default_role_arn_, false);
   // only recreate base request if its not in flight
-  if (!base_conn_pool->second->requestInFlight()) {
-   base_conn_pool->second->init(uri_, web_token_, NULL);
+  if (!base_conn_pool.requestInFlight()) {
+    base_conn_pool.init(uri_, web_token_, NULL);
   }
-  base_conn_pool->second->addChained(role_arn);
-
+  base_conn_pool.addChained(role_arn);
 
   // initialize the connection but dont fetch as we are waiting on base conn
-  conn_pool->second->setInFlight();
-  // generate and return a context with the current callbacks
-  return conn_pool->second->add(callbacks);
-};
+  conn_pool.setInFlight();
+  return conn_pool;
+}
+
+void StsCredentialsProviderImpl::scheduleRefresh(
+    const std::string &role_arn_lookup, const StsCredentials &credentials) {
+  auto role = roles_.find(role_arn_lookup);
+  if (role == roles_.end()) {
+    return;
+  }
+
+  // refresh at a random point of the jitter window before the grace period,
+  // so that find keeps serving the cached credentials in the meantime.
+  const auto jitter = std::chrono::milliseconds(
+      api_.randomGenerator().random() %
+      std::chrono::duration_cast<std::chrono::milliseconds>(REFRESH_JITTER)
+          .count());
+  const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         credentials.expirationTime() -
+                         api_.timeSource().systemTime() -
+                         REFRESH_GRACE_PERIOD) -
+                     jitter;
+  if (delay <= std::chrono::milliseconds::zero()) {
+    // too short lived to be refreshed ahead, find refreshes them on demand.
+    return;
+  }
+
+  CachedRole &cached_role = role->second;
+  if (cached_role.refresh_timer_ == nullptr) {
+    cached_role.refresh_timer_ = dispatcher_.createTimer(
+        [this, role_arn_lookup]() { refresh(role_arn_lookup); });
+  }
+  cached_role.refresh_timer_->enableTimer(delay);
+}
+
+void StsCredentialsProviderImpl::refresh(const std::string &role_arn_lookup) {
+  const CachedRole &role = roles_.at(role_arn_lookup);
+  ENVOY_LOG(debug, "refreshing sts credentials for {} ahead of their expiry",
+            role.role_arn_);
+  stats_.sts_refresh_ahead_.inc();
+  // a failed refresh is not retried, the next find past the grace period
+  // fetches the credentials again.
+  fetch(role.role_arn_, role_arn_lookup, role.disable_role_chaining_);
+}
 
 class StsCredentialsProviderFactoryImpl : public StsCredentialsProviderFactory {
 public:
@@ -227,8 +339,8 @@ public:
   StsCredentialsProviderPtr
   build(const envoy::config::filter::http::aws_lambda::v2::
             AWSLambdaConfig_ServiceAccountCredentials &config,
-        Event::Dispatcher &dispatcher, std::string_view web_token,
-        std::string_view role_arn) const override;
+        Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
+        std::string_view web_token, std::string_view role_arn) const override;
 
 private:
   Api::Api &api_;
@@ -238,23 +350,40 @@ private:
 StsCredentialsProviderPtr StsCredentialsProviderFactoryImpl::build(
     const envoy::config::filter::http::aws_lambda::v2::
         AWSLambdaConfig_ServiceAccountCredentials &config,
-    Event::Dispatcher &dispatcher, std::string_view web_token,
-    std::string_view role_arn) const {
+    Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
+    std::string_view web_token, std::string_view role_arn) const {
 
   return StsCredentialsProvider::create(
-      config, api_, cm_, StsConnectionPoolFactory::create(api_, dispatcher),
-      web_token, role_arn);
+      config, api_, cm_, dispatcher, stats,
+      StsConnectionPoolFactory::create(api_, dispatcher), web_token, role_arn);
 };
 
 StsCredentialsProviderPtr StsCredentialsProvider::create(
     const envoy::config::filter::http::aws_lambda::v2::
         AWSLambdaConfig_ServiceAccountCredentials &config,
     Api::Api &api, Upstream::ClusterManager &cm,
+    Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
     StsConnectionPoolFactoryPtr factory, std::string_view web_token,
     std::string_view role_arn) {
 
   return std::make_unique<StsCredentialsProviderImpl>(
-      config, api, cm, std::move(factory), web_token, role_arn);
+      config, api, cm, dispatcher, stats, std::move(factory), web_token,
+      role_arn);
+}
+
+StsCredentialsProviderStats
+StsCredentialsProvider::generateStats(const std::string &prefix,
+                                      Stats::Scope &scope) {
+  return {ALL_STS_CREDENTIALS_PROVIDER_STATS(
+      POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix),
+      POOL_HISTOGRAM_PREFIX(scope, prefix))};
+}
+
+std::string StsCredentialsProvider::lookupKey(const std::string &role_arn,
+                                              bool disable_role_chaining) {
+  // if disable_role_chaining is set on an upstream we need a distinction
+  // so that we can serve both chained and non-chained as needed
+  return disable_role_chaining ? "no-chain-" + role_arn : role_arn;
 }
 
 StsCredentialsProviderFactoryPtr
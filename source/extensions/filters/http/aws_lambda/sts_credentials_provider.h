@@ -3,11 +3,15 @@
 #include "envoy/api/api.h"
 #include "envoy/common/pure.h"
 #include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
 
 #include "source/common/common/regex.h"
 
 #include "source/extensions/common/aws/credentials_provider.h"
 #include "source/extensions/filters/http/aws_lambda/sts_connection_pool.h"
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_cache_file.h"
 
 #include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
 
@@ -21,8 +25,35 @@ constexpr char AWS_ROLE_ARN[] = "AWS_ROLE_ARN";
 constexpr char AWS_WEB_IDENTITY_TOKEN_FILE[] = "AWS_WEB_IDENTITY_TOKEN_FILE";
 
 constexpr std::chrono::minutes REFRESH_GRACE_PERIOD{5};
+// cached credentials are refreshed ahead of the grace period, at a random
+// point of this window, so that the roles aren't all refreshed at once.
+constexpr std::chrono::minutes REFRESH_JITTER{1};
+// credentials in the grace period are still handed out while they are
+// refreshed, as long as they are valid for at least this long.
+constexpr std::chrono::seconds MIN_CREDENTIALS_LIFETIME{30};
 } // namespace
 
+/**
+ * All stats for the sts credentials cache. @see stats_macros.h
+ */
+#define ALL_STS_CREDENTIALS_PROVIDER_STATS(COUNTER, GAUGE, HISTOGRAM)         \
+  COUNTER(sts_cache_hit)                                                       \
+  COUNTER(sts_cache_miss)                                                      \
+  COUNTER(sts_refresh_ahead)                                                   \
+  COUNTER(sts_cache_file_restored)                                             \
+  COUNTER(sts_cache_file_write_failed)                                         \
+  GAUGE(sts_fetches_queued, Accumulate)                                        \
+  HISTOGRAM(sts_fetch_time, Milliseconds)
+
+/**
+ * Wrapper struct for sts credentials cache stats. @see stats_macros.h
+ */
+struct StsCredentialsProviderStats {
+  ALL_STS_CREDENTIALS_PROVIDER_STATS(GENERATE_COUNTER_STRUCT,
+                                     GENERATE_GAUGE_STRUCT,
+                                     GENERATE_HISTOGRAM_STRUCT)
+};
+
 class StsCredentialsProvider;
 using StsCredentialsProviderPtr = std::unique_ptr<StsCredentialsProvider>;
 
@@ -42,8 +73,16 @@ public:
   create(const envoy::config::filter::http::aws_lambda::v2::
              AWSLambdaConfig_ServiceAccountCredentials &config,
          Api::Api &api, Upstream::ClusterManager &cm,
+         Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
          StsConnectionPoolFactoryPtr factory, std::string_view web_token,
          std::string_view role_arn);
+
+  static StsCredentialsProviderStats generateStats(const std::string &prefix,
+                                                   Stats::Scope &scope);
+
+  // the key the credentials of the role are cached under.
+  static std::string lookupKey(const std::string &role_arn,
+                               bool disable_role_chaining);
 };
 
 class StsCredentialsProviderFactory;
@@ -57,8 +96,8 @@ public:
   virtual StsCredentialsProviderPtr
   build(const envoy::config::filter::http::aws_lambda::v2::
             AWSLambdaConfig_ServiceAccountCredentials &config,
-        Event::Dispatcher &dispatcher, std::string_view web_token,
-        std::string_view role_arn) const PURE;
+        Event::Dispatcher &dispatcher, StsCredentialsProviderStats &stats,
+        std::string_view web_token, std::string_view role_arn) const PURE;
 
   static StsCredentialsProviderFactoryPtr create(Api::Api &api,
                                                  Upstream::ClusterManager &cm);
@@ -1,10 +1,13 @@
 #include "source/extensions/filters/http/aws_lambda/sts_fetcher.h"
 
+#include <algorithm>
+
 #include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/enum_to_int.h"
 #include "source/common/common/regex.h"
 #include "source/common/http/headers.h"
 #include "source/common/http/utility.h"
+#include "source/common/stats/timespan_impl.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -14,11 +17,13 @@ namespace AwsLambda {
 namespace {
 
 class StsFetcherImpl : public StsFetcher,
+                       public StsFetchQueue::Request,
                        public Logger::Loggable<Logger::Id::aws>,
                        public Http::AsyncClient::Callbacks {
 public:
-  StsFetcherImpl(Upstream::ClusterManager &cm, Api::Api &api)
-      : cm_(cm), api_(api){
+  StsFetcherImpl(Upstream::ClusterManager &cm, Api::Api &api,
+                 StsFetchQueue *queue)
+      : cm_(cm), api_(api), queue_(queue) {
     ENVOY_LOG(trace, "{}", __func__);
   }
 
@@ -81,8 +86,7 @@ public:
       message->body().add(body);
       ENVOY_LOG(debug, "assume role with token from [uri = {}]: start",
                                                                 uri_->uri());
-      request_ = thread_local_cluster->httpAsyncClient().send(
-                                           std::move(message),*this, options);
+      enqueue(std::move(message), options);
       return;
     }
     
@@ -106,14 +110,41 @@ public:
     ENVOY_LOG(trace, "assume chained [accesskey={}] ",
                 creds->accessKeyId().value());
     ENVOY_LOG(debug, "assume chained role from [uri = {}]: start", uri_->uri());
-    request_ = thread_local_cluster->httpAsyncClient().send(
-                                            std::move(message), *this, options);
+    enqueue(std::move(message), options);
+  }
+
+  // StsFetchQueue::Request
+  void send() override {
+    // the cluster may have gone away while the request was queued.
+    const auto thread_local_cluster =
+        cm_.getThreadLocalCluster(uri_->cluster());
+    if (thread_local_cluster == nullptr) {
+      ENVOY_LOG(error,
+                "{}: assume role with token [uri = {}] failed: [cluster = {}] "
+                "is not configured",
+                __func__, uri_->uri(), uri_->cluster());
+      complete_ = true;
+      callbacks_->onFailure(CredentialsFailureStatus::ClusterNotFound);
+      reset();
+      return;
+    }
+    if (queue_ != nullptr) {
+      fetch_timer_ = queue_->startTimer();
+    }
+    Http::AsyncClient::Request *request =
+        thread_local_cluster->httpAsyncClient().send(std::move(message_),
+                                                     *this, options_);
+    // the request may have completed inline, and must not be cancelled then.
+    if (!complete_) {
+      request_ = request;
+    }
   }
 
   // HTTP async receive methods
   void onSuccess(const Http::AsyncClient::Request &,
                  Http::ResponseMessagePtr &&response) override {
     complete_ = true;
+    completeTimer();
     const uint64_t status_code =
         Http::Utility::getResponseStatus(response->headers());
     if (status_code == enumToInt(Http::Code::OK)) {
@@ -172,6 +203,7 @@ public:
     ENVOY_LOG(debug, "{}: assume role with token [uri = {}]: network error {}",
               __func__, uri_->uri(), enumToInt(reason));
     complete_ = true;
+    completeTimer();
     callbacks_->onFailure(CredentialsFailureStatus::Network);
     reset();
   }
@@ -187,6 +219,13 @@ private:
   const envoy::config::core::v3::HttpUri *uri_{};
   Http::AsyncClient::Request *request_{};
   absl::string_view role_arn_;
+  StsFetchQueue *queue_;
+  // whether the request is queued or in flight in the queue.
+  bool in_queue_{};
+  // the prepared request, until it is sent.
+  Http::RequestMessagePtr message_;
+  Http::AsyncClient::RequestOptions options_;
+  Stats::CompletableTimespanPtr fetch_timer_;
 
   class AWSStsHeaderValues {
   public:
@@ -211,16 +250,78 @@ private:
 
   const std::string DefaultRegion = "us-east-1";
 
+  void enqueue(Http::RequestMessagePtr &&message,
+               const Http::AsyncClient::RequestOptions &options) {
+    message_ = std::move(message);
+    options_ = options;
+    if (queue_ == nullptr) {
+      send();
+      return;
+    }
+    in_queue_ = true;
+    queue_->add(*this);
+  }
+
+  void completeTimer() {
+    if (fetch_timer_ != nullptr) {
+      fetch_timer_->complete();
+      fetch_timer_.reset();
+    }
+  }
+
   void reset() {
     request_ = nullptr;
     callbacks_ = nullptr;
     uri_ = nullptr;
+    message_.reset();
+    // a cancelled request is not recorded.
+    fetch_timer_.reset();
+    // last, as the queue may send the next request right away.
+    if (in_queue_) {
+      in_queue_ = false;
+      queue_->remove(*this);
+    }
   }
 };
 } // namespace
 
-StsFetcherPtr StsFetcher::create(Upstream::ClusterManager &cm, Api::Api &api) {
-  return std::make_unique<StsFetcherImpl>(cm, api);
+void StsFetchQueue::add(Request &request) {
+  if (max_in_flight_ != 0 && in_flight_ >= max_in_flight_) {
+    queued_.push_back(&request);
+    queued_gauge_.inc();
+    return;
+  }
+  ++in_flight_;
+  request.send();
+}
+
+void StsFetchQueue::remove(Request &request) {
+  const auto queued = std::find(queued_.begin(), queued_.end(), &request);
+  if (queued != queued_.end()) {
+    queued_.erase(queued);
+    queued_gauge_.dec();
+    return;
+  }
+  ASSERT(in_flight_ > 0);
+  --in_flight_;
+  if (queued_.empty()) {
+    return;
+  }
+  Request *next = queued_.front();
+  queued_.pop_front();
+  queued_gauge_.dec();
+  ++in_flight_;
+  next->send();
+}
+
+Stats::CompletableTimespanPtr StsFetchQueue::startTimer() const {
+  return std::make_unique<Stats::HistogramCompletableTimespanImpl>(
+      fetch_time_, time_source_);
+}
+
+StsFetcherPtr StsFetcher::create(Upstream::ClusterManager &cm, Api::Api &api,
+                                 StsFetchQueue *queue) {
+  return std::make_unique<StsFetcherImpl>(cm, api, queue);
 }
 
 } // namespace AwsLambda
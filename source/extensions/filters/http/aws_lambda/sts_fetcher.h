@@ -1,8 +1,12 @@
 #pragma once
 
+#include <list>
+
 #include "envoy/api/api.h"
 #include "envoy/common/pure.h"
 #include "envoy/config/core/v3/http_uri.pb.h"
+#include "envoy/stats/stats.h"
+#include "envoy/stats/timespan.h"
 #include "envoy/upstream/cluster_manager.h"
 
 #include "source/extensions/common/aws/credentials_provider.h"
@@ -43,6 +47,54 @@ private:
   const SystemTime expiration_time_;
 };
 
+/**
+ * Bounds the number of sts requests that are in flight at once. The fetches
+ * of roles that rotate together are queued and sent as the earlier ones
+ * complete, rather than all opening a connection to the sts cluster at once.
+ */
+class StsFetchQueue {
+public:
+  class Request {
+  public:
+    virtual ~Request() = default;
+
+    /**
+     * Called once the request may be sent.
+     */
+    virtual void send() PURE;
+  };
+
+  /**
+   * @param max_in_flight the number of requests that are sent at once, or 0
+   * to send them all right away.
+   * @param fetch_time the histogram the latency of the requests is recorded
+   * in.
+   * @param queued the gauge of the requests that wait to be sent.
+   */
+  StsFetchQueue(uint32_t max_in_flight, Stats::Histogram &fetch_time,
+                Stats::Gauge &queued, TimeSource &time_source)
+      : max_in_flight_(max_in_flight), fetch_time_(fetch_time),
+        queued_gauge_(queued), time_source_(time_source) {}
+
+  // sends the request, or queues it if too many are in flight.
+  void add(Request &request);
+
+  // called when the request completes or is cancelled, which sends the next
+  // queued request if it was in flight.
+  void remove(Request &request);
+
+  // times a request that is sent.
+  Stats::CompletableTimespanPtr startTimer() const;
+
+private:
+  const uint32_t max_in_flight_;
+  Stats::Histogram &fetch_time_;
+  Stats::Gauge &queued_gauge_;
+  TimeSource &time_source_;
+  uint32_t in_flight_{};
+  std::list<Request *> queued_;
+};
+
 class StsFetcher;
 using StsFetcherPtr = std::unique_ptr<StsFetcher>;
 
@@ -107,9 +159,11 @@ public:
    * Factory method for creating a StsFetcher.
    * @param cm the cluster manager to use during Sts retrieval
    * @param api the api instance
+   * @param queue the queue the requests wait in to be sent, if any.
    * @return a StsFetcher instance
    */
-  static StsFetcherPtr create(Upstream::ClusterManager &cm, Api::Api &api);
+  static StsFetcherPtr create(Upstream::ClusterManager &cm, Api::Api &api,
+                              StsFetchQueue *queue = nullptr);
 };
 
 } // namespace AwsLambda
@@ -0,0 +1,78 @@
+#include "source/extensions/filters/http/aws_lambda/sts_response_parser.h"
+
+#include <algorithm>
+
+#include "absl/strings/match.h"
+#include "absl/strings/strip.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+constexpr size_t FieldCount = 4;
+
+// returns the field the element fills, or nullptr if it holds none.
+absl::string_view *fieldOf(absl::string_view element,
+                           StsResponseFields &fields) {
+  if (element == "AccessKeyId") {
+    return &fields.access_key;
+  }
+  if (element == "SecretAccessKey") {
+    return &fields.secret_key;
+  }
+  if (element == "SessionToken") {
+    return &fields.session_token;
+  }
+  if (element == "Expiration") {
+    return &fields.expiration;
+  }
+  return nullptr;
+}
+
+// true if the tag that starts at pos closes the element.
+bool closes(absl::string_view body, size_t pos, absl::string_view element) {
+  absl::string_view tag = body.substr(pos);
+  return absl::ConsumePrefix(&tag, "</") &&
+         absl::ConsumePrefix(&tag, element) && absl::StartsWith(tag, ">");
+}
+
+} // namespace
+
+bool StsResponseParser::parse(absl::string_view body,
+                              StsResponseFields &fields) {
+  // the fields that were found, so that an empty element counts as well.
+  absl::string_view *found[FieldCount] = {};
+  size_t found_count = 0;
+
+  size_t pos = body.find('<');
+  while (pos != absl::string_view::npos && found_count < FieldCount) {
+    const size_t name_start = pos + 1;
+    const size_t tag_end = body.find('>', name_start);
+    if (tag_end == absl::string_view::npos) {
+      break;
+    }
+    const absl::string_view element =
+        body.substr(name_start, tag_end - name_start);
+    // text can't contain a '<', so the value ends at the next tag.
+    const size_t value_start = tag_end + 1;
+    pos = body.find('<', value_start);
+
+    absl::string_view *field = fieldOf(element, fields);
+    if (field == nullptr || pos == absl::string_view::npos ||
+        std::find(found, found + found_count, field) != found + found_count ||
+        !closes(body, pos, element)) {
+      continue;
+    }
+    *field = body.substr(value_start, pos - value_start);
+    found[found_count++] = field;
+  }
+  return found_count == FieldCount;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
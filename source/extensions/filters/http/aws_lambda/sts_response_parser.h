@@ -1,7 +1,8 @@
 #pragma once
 
-#include "source/common/common/regex.h"
-#include "source/common/singleton/const_singleton.h"
+#include <chrono>
+
+#include "absl/strings/string_view.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -26,31 +27,29 @@ constexpr std::chrono::milliseconds DUPE_REFRESH_STS_CREDS =
 } // namespace
 
 
-class StsResponseRegexValues {
-public:
-  StsResponseRegexValues() {
-
-    // Initialize regex strings, should never fail
-    regex_access_key =
-        Regex::Utility::parseStdRegex("<AccessKeyId>(.*?)</AccessKeyId>");
-    regex_secret_key = Regex::Utility::parseStdRegex(
-        "<SecretAccessKey>(.*?)</SecretAccessKey>");
-    regex_session_token =
-        Regex::Utility::parseStdRegex("<SessionToken>(.*?)</SessionToken>");
-    regex_expiration =
-        Regex::Utility::parseStdRegex("<Expiration>(.*?)</Expiration>");
-  };
-
-  std::regex regex_access_key;
-
-  std::regex regex_secret_key;
-
-  std::regex regex_session_token;
-
-  std::regex regex_expiration;
+/**
+ * The credentials in an AssumeRoleWithWebIdentity response. The fields view
+ * into the parsed body.
+ */
+struct StsResponseFields {
+  absl::string_view access_key;
+  absl::string_view secret_key;
+  absl::string_view session_token;
+  absl::string_view expiration;
 };
 
-using StsResponseRegex = ConstSingleton<StsResponseRegexValues>;
+class StsResponseParser {
+public:
+  /**
+   * Extracts the credentials from the xml body in a single walk, without
+   * copying them. The text of the first AccessKeyId, SecretAccessKey,
+   * SessionToken and Expiration elements is used, as is.
+   * @param body the response body.
+   * @param fields receives the credentials.
+   * @return false if any of the elements is missing.
+   */
+  static bool parse(absl::string_view body, StsResponseFields &fields);
+};
 
 
 } // namespace AwsLambda
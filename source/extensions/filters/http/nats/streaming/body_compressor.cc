@@ -0,0 +1,88 @@
+#include "source/extensions/filters/http/nats/streaming/body_compressor.h"
+
+#include <memory>
+
+#include "source/common/common/assert.h"
+#include "source/common/common/macros.h"
+
+#include "zstd.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+namespace {
+
+struct ZstdContextDeleter {
+  void operator()(ZSTD_CCtx *context) const { ZSTD_freeCCtx(context); }
+};
+
+// the context of the calling worker, which keeps its tables from one body to
+// the next.
+ZSTD_CCtx &workerContext() {
+  static thread_local std::unique_ptr<ZSTD_CCtx, ZstdContextDeleter> context(
+      ZSTD_createCCtx());
+  RELEASE_ASSERT(context != nullptr, "can't allocate a zstd context");
+  return *context;
+}
+
+void checkZstd(size_t result) {
+  RELEASE_ASSERT(!ZSTD_isError(result), ZSTD_getErrorName(result));
+}
+
+} // namespace
+
+BodyCompressor::BodyCompressor(const ProtoConfig &proto_config)
+    : codec_(proto_config.codec()), level_(proto_config.level()),
+      min_body_size_(proto_config.min_body_size()) {}
+
+const Http::LowerCaseString &BodyCompressor::encodingHeader() {
+  CONSTRUCT_ON_FIRST_USE(Http::LowerCaseString, "x-nats-body-encoding");
+}
+
+absl::string_view BodyCompressor::encoding() const {
+  switch (codec_) {
+  case ProtoConfig::ZSTD:
+  default:
+    return "zstd";
+  }
+}
+
+void BodyCompressor::compress(const Buffer::Instance &body,
+                              Buffer::Instance &output) const {
+  ZSTD_CCtx &context = workerContext();
+  checkZstd(ZSTD_CCtx_reset(&context, ZSTD_reset_session_and_parameters));
+  // 0 is the default level of zstd too.
+  checkZstd(ZSTD_CCtx_setParameter(&context, ZSTD_c_compressionLevel, level_));
+  // recorded in the frame, so that the consumers can size their buffer.
+  checkZstd(ZSTD_CCtx_setPledgedSrcSize(&context, body.length()));
+
+  // the output of a frame never exceeds the bound, so it is compressed in a
+  // single pass.
+  Buffer::ReservationSingleSlice reservation =
+      output.reserveSingleSlice(ZSTD_compressBound(body.length()));
+  ZSTD_outBuffer out{reservation.slice().mem_, reservation.slice().len_, 0};
+  for (const Buffer::RawSlice &slice : body.getRawSlices()) {
+    ZSTD_inBuffer in{slice.mem_, slice.len_, 0};
+    while (in.pos != in.size) {
+      checkZstd(ZSTD_compressStream2(&context, &out, &in, ZSTD_e_continue));
+    }
+  }
+  ZSTD_inBuffer end{nullptr, 0, 0};
+  size_t remaining;
+  do {
+    remaining = ZSTD_compressStream2(&context, &out, &end, ZSTD_e_end);
+    checkZstd(remaining);
+    RELEASE_ASSERT(remaining == 0 || out.pos != out.size,
+                   "zstd frame over its bound");
+  } while (remaining != 0);
+  reservation.commit(out.pos);
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
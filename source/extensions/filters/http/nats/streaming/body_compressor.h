@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/http/header_map.h"
+
+#include "absl/strings/string_view.h"
+#include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+/**
+ * Compresses the bodies that a route publishes. The input is read slice by
+ * slice with the streaming api of the codec, into a single slice reserved for
+ * the largest output, and each worker reuses a context of its own.
+ */
+class BodyCompressor {
+public:
+  using ProtoConfig = envoy::config::filter::http::nats::streaming::v2::
+      NatsStreamingPerRoute::Compression;
+
+  explicit BodyCompressor(const ProtoConfig &proto_config);
+
+  // the payload header that names the codec to the consumers.
+  static const Http::LowerCaseString &encodingHeader();
+  // the value of the header.
+  absl::string_view encoding() const;
+
+  uint32_t minBodySize() const { return min_body_size_; }
+
+  /**
+   * Appends the compressed body to the output, leaving the body as it is.
+   */
+  void compress(const Buffer::Instance &body, Buffer::Instance &output) const;
+
+private:
+  const ProtoConfig::Codec codec_;
+  const int level_;
+  const uint32_t min_body_size_;
+};
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
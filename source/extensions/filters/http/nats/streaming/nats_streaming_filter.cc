@@ -11,8 +11,10 @@
 #include "source/common/common/macros.h"
 #include "source/common/common/utility.h"
 #include "source/common/grpc/common.h"
+#include "source/common/http/header_map_impl.h"
 #include "source/common/http/solo_filter_utility.h"
 #include "source/common/http/utility.h"
+#include "source/common/nats/streaming/message_utility.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
 
@@ -25,44 +27,98 @@ namespace Streaming {
 struct RcDetailsValues {
   // The jwt_authn filter rejected the request
   const std::string PayloadTooLarge = "nats_payload_too_big";
+  const std::string BodyBudgetExhausted = "nats_body_budget_exhausted";
   const std::string Completion = "nats_completion";
+  const std::string Reply = "nats_reply";
 };
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 
 NatsStreamingFilter::NatsStreamingFilter(
     NatsStreamingFilterConfigSharedPtr config,
-    Envoy::Nats::Streaming::ClientPtr nats_streaming_client)
-    : config_(config), nats_streaming_client_(nats_streaming_client) {}
+    Envoy::Nats::Streaming::ClientPtr nats_streaming_client,
+    Envoy::Nats::Streaming::ClientPtr jet_stream_client,
+    Envoy::Nats::Streaming::ClientPtr core_client,
+    Envoy::Nats::Streaming::ClientPtr request_reply_client)
+    : config_(config), nats_streaming_client_(nats_streaming_client),
+      jet_stream_client_(jet_stream_client), core_client_(core_client),
+      request_reply_client_(request_reply_client) {}
 
 NatsStreamingFilter::~NatsStreamingFilter() {}
 
 void NatsStreamingFilter::onDestroy() {
+  cancelRequests();
+  body_reservation_.release();
+}
 
+void NatsStreamingFilter::cancelRequests() {
   if (in_flight_request_ != nullptr) {
     in_flight_request_->cancel();
     in_flight_request_ = nullptr;
   }
+  for (const ChunkRequestPtr &chunk_request : chunk_requests_) {
+    if (chunk_request->request_ != nullptr) {
+      chunk_request->request_->cancel();
+      chunk_request->request_ = nullptr;
+    }
+  }
 }
 
 Http::FilterHeadersStatus
 NatsStreamingFilter::decodeHeaders(Envoy::Http::RequestHeaderMap &headers,
                                    bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
   retrieveRouteSpecificFilterConfig();
 
   if (!isActive()) {
     return Http::FilterHeadersStatus::Continue;
   }
 
+  // the body is buffered unless it is published in chunks, so one that won't
+  // fit in the buffer is rejected before it arrives.
+  if (!end_stream && chunkSize() == 0 &&
+      Http::SoloFilterUtility::contentLengthExceeds(
+          headers, decoder_buffer_limit_.value_or(0))) {
+    decoder_callbacks_->sendLocalReply(
+        Http::Code::PayloadTooLarge, "nats streaming paylaod too large",
+        nullptr, absl::nullopt, RcDetails::get().PayloadTooLarge);
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
   // Fill in the headers.
   // TODO(talnordan): Consider extracting a common utility function which
   // converts a `HeaderMap` to a Protobuf `Map`, to reduce code duplication
   // with `Filters::Common::ExtAuthz::CheckRequestUtils::setHttpRequest()`.
   auto *mutable_headers = payload_.mutable_headers();
-  headers.iterate([mutable_headers](const Envoy::Http::HeaderEntry &e) {
-    (*mutable_headers)[std::string(e.key().getStringView())] =
-        std::string(e.value().getStringView());
-    return Envoy::Http::HeaderMap::Iterate::Continue;
-  });
+  const NatsStreamingRouteSpecificFilterConfig &route_config =
+      *optional_route_specific_filter_config_.value();
+  if (!route_config.includeHeaders().empty()) {
+    // only the configured headers are looked up, the last value winning as
+    // when iterating.
+    for (const Http::LowerCaseString &name : route_config.includeHeaders()) {
+      const auto values = headers.get(name);
+      if (!values.empty()) {
+        (*mutable_headers)[name.get()] =
+            std::string(values[values.size() - 1]->value().getStringView());
+      }
+    }
+  } else {
+    headers.iterate([mutable_headers, &route_config](
+                        const Envoy::Http::HeaderEntry &e) {
+      const absl::string_view key = e.key().getStringView();
+      if (!route_config.excludesHeader(key)) {
+        (*mutable_headers)[std::string(key)] =
+            std::string(e.value().getStringView());
+      }
+      return Envoy::Http::HeaderMap::Iterate::Continue;
+    });
+  }
+
+  if (chunkSize() != 0) {
+    correlation_id_ = std::string(headers.getRequestIdValue());
+    if (correlation_id_.empty()) {
+      correlation_id_ = std::to_string(decoder_callbacks_->streamId());
+    }
+  }
 
   if (end_stream) {
     relayToNatsStreaming();
@@ -74,10 +130,28 @@ NatsStreamingFilter::decodeHeaders(Envoy::Http::RequestHeaderMap &headers,
 Http::FilterDataStatus
 NatsStreamingFilter::decodeData(Envoy::Buffer::Instance &data,
                                 bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
   if (!isActive()) {
     return Http::FilterDataStatus::Continue;
   }
 
+  const uint32_t chunk_size = chunkSize();
+  if (chunk_size != 0) {
+    // the body isn't buffered beyond a chunk, so it isn't bound by the buffer
+    // limit.
+    if (completed_) {
+      return Http::FilterDataStatus::StopIterationNoBuffer;
+    }
+    body_.move(data);
+    while (body_.length() > chunk_size && !completed_) {
+      relayChunkToNatsStreaming(chunk_size, false);
+    }
+    if (end_stream && !completed_) {
+      relayChunkToNatsStreaming(body_.length(), true);
+    }
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+
   body_.move(data);
 
   if ((decoder_buffer_limit_.has_value()) &&
@@ -91,6 +165,14 @@ NatsStreamingFilter::decodeData(Envoy::Buffer::Instance &data,
 
   body_.move(data);
 
+  if (!body_reservation_.reserveTo(body_.length())) {
+    config_->stats().body_budget_exhausted_.inc();
+    decoder_callbacks_->sendLocalReply(
+        Http::Code::ServiceUnavailable, "buffered bodies over budget", nullptr,
+        absl::nullopt, RcDetails::get().BodyBudgetExhausted);
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+
   if (end_stream) {
     relayToNatsStreaming();
 
@@ -104,16 +186,37 @@ NatsStreamingFilter::decodeData(Envoy::Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 NatsStreamingFilter::decodeTrailers(Envoy::Http::RequestTrailerMap &) {
+  const Http::FilterTime::Scope time(filter_time_);
   if (!isActive()) {
     return Http::FilterTrailersStatus::Continue;
   }
 
+  if (completed_) {
+    return Http::FilterTrailersStatus::StopIteration;
+  }
   relayToNatsStreaming();
   return Http::FilterTrailersStatus::StopIteration;
 }
 
 void NatsStreamingFilter::onResponse() { onCompletion(Http::Code::OK, ""); }
 
+void NatsStreamingFilter::onReply(Buffer::InstancePtr &&reply) {
+  const Http::FilterTime::Scope time(filter_time_);
+  if (!complete()) {
+    return;
+  }
+  // the payload of the reply is the body of the response, as it is.
+  Http::ResponseHeaderMapPtr headers = Http::ResponseHeaderMapImpl::create();
+  headers->setStatus(enumToInt(Http::Code::OK));
+  headers->setContentLength(reply->length());
+  const bool end_stream = reply->length() == 0;
+  decoder_callbacks_->encodeHeaders(std::move(headers), end_stream,
+                                    RcDetails::get().Reply);
+  if (!end_stream) {
+    decoder_callbacks_->encodeData(*reply, true);
+  }
+}
+
 void NatsStreamingFilter::onFailure() {
   onCompletion(Http::Code::InternalServerError, "nats streaming filter abort",
                StreamInfo::ResponseFlag::NoHealthyUpstream);
@@ -124,6 +227,43 @@ void NatsStreamingFilter::onTimeout() {
                StreamInfo::ResponseFlag::UpstreamRequestTimeout);
 }
 
+void NatsStreamingFilter::onOverflow() {
+  onCompletion(Http::Code::ServiceUnavailable,
+               "nats streaming filter overflow",
+               StreamInfo::ResponseFlag::UpstreamOverflow);
+}
+
+void NatsStreamingFilter::ChunkRequest::onResponse() {
+  done_ = true;
+  request_ = nullptr;
+  parent_.onChunkResponse();
+}
+
+void NatsStreamingFilter::ChunkRequest::onFailure() {
+  done_ = true;
+  request_ = nullptr;
+  parent_.onFailure();
+}
+
+void NatsStreamingFilter::ChunkRequest::onTimeout() {
+  done_ = true;
+  request_ = nullptr;
+  parent_.onTimeout();
+}
+
+void NatsStreamingFilter::ChunkRequest::onOverflow() {
+  done_ = true;
+  request_ = nullptr;
+  parent_.onOverflow();
+}
+
+void NatsStreamingFilter::onChunkResponse() {
+  chunks_acked_++;
+  if (last_chunk_sent_ && chunks_acked_ == chunks_sent_) {
+    onResponse();
+  }
+}
+
 void NatsStreamingFilter::retrieveRouteSpecificFilterConfig() {
 
   const auto *route_local = Http::Utility::resolveMostSpecificPerFilterConfig<
@@ -134,11 +274,30 @@ void NatsStreamingFilter::retrieveRouteSpecificFilterConfig() {
   }
 }
 
+Envoy::Nats::Streaming::Client &NatsStreamingFilter::client() {
+  using envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute;
+  switch (optional_route_specific_filter_config_.value()->protocol()) {
+  case NatsStreamingPerRoute::JETSTREAM:
+    return *jet_stream_client_;
+  case NatsStreamingPerRoute::CORE:
+    return *core_client_;
+  case NatsStreamingPerRoute::REQUEST_REPLY:
+    return *request_reply_client_;
+  default:
+    return *nats_streaming_client_;
+  }
+}
+
 void NatsStreamingFilter::relayToNatsStreaming() {
   ASSERT(optional_route_specific_filter_config_.has_value(), "");
   ASSERT(!optional_route_specific_filter_config_.value()->subject().empty(),
          "");
 
+  if (chunkSize() != 0) {
+    relayChunkToNatsStreaming(body_.length(), true);
+    return;
+  }
+
   const std::string *cluster_name =
       Http::SoloFilterUtility::resolveClusterName(decoder_callbacks_);
   if (!cluster_name) {
@@ -154,22 +313,154 @@ void NatsStreamingFilter::relayToNatsStreaming() {
   const std::string &discover_prefix =
       route_specific_filter_config->discoverPrefix();
 
-  // TODO(talnordan): Consider minimizing content copying.
-  payload_.set_body(body_.toString());
-  std::string payload_string = payload_.SerializeAsString();
-  in_flight_request_ = nats_streaming_client_->makeRequest(
-      subject, cluster_id, discover_prefix, std::move(payload_string), *this);
+  const bool compress = compresses(body_, false);
+  if (compress) {
+    (*payload_.mutable_headers())[BodyCompressor::encodingHeader().get()] =
+        std::string(route_specific_filter_config->compressor()->encoding());
+  }
+  // the body is moved after the serialized headers rather than copied into the
+  // payload, and is then written to the connection as it was received.
+  auto payload =
+      std::make_unique<Buffer::OwnedImpl>(payload_.SerializeAsString());
+  appendBody(body_, compress, *payload);
+  // the body is the client's to send from here.
+  body_reservation_.release();
+  if (route_specific_filter_config->fireAndForget()) {
+    relayUnackedToNatsStreaming(std::move(payload), true);
+    return;
+  }
+  in_flight_request_ = client().makeRequest(
+      subject, cluster_id, discover_prefix, std::move(payload), *this);
+}
+
+void NatsStreamingFilter::relayChunkToNatsStreaming(uint64_t length,
+                                                    bool last) {
+  const std::string *cluster_name =
+      Http::SoloFilterUtility::resolveClusterName(decoder_callbacks_);
+  if (!cluster_name) {
+    return;
+  }
+
+  // the acked chunks are dropped from the front, those still in flight being
+  // kept so that they are cancelled along with the request.
+  while (!chunk_requests_.empty() && chunk_requests_.front()->done_) {
+    chunk_requests_.pop_front();
+  }
+
+  auto &&route_specific_filter_config =
+      optional_route_specific_filter_config_.value();
+
+  const bool compress = compresses(body_, true);
+  pb::Payload chunk;
+  if (chunks_sent_ == 0) {
+    chunk.mutable_headers()->swap(*payload_.mutable_headers());
+    if (compress) {
+      (*chunk.mutable_headers())[BodyCompressor::encodingHeader().get()] =
+          std::string(route_specific_filter_config->compressor()->encoding());
+    }
+  }
+  chunk.set_correlation_id(correlation_id_);
+  chunk.set_sequence(chunks_sent_);
+  chunk.set_last(last);
+  auto payload = std::make_unique<Buffer::OwnedImpl>(chunk.SerializeAsString());
+  Buffer::OwnedImpl body;
+  body.move(body_, length);
+  appendBody(body, compress, *payload);
+
+  chunks_sent_++;
+  last_chunk_sent_ = last;
+  if (route_specific_filter_config->fireAndForget()) {
+    relayUnackedToNatsStreaming(std::move(payload), last);
+    return;
+  }
+  chunk_requests_.push_back(std::make_unique<ChunkRequest>(*this));
+  ChunkRequest &chunk_request = *chunk_requests_.back();
+  // the publish may complete before it returns.
+  Envoy::Nats::Streaming::PublishRequestPtr request = client().makeRequest(
+      route_specific_filter_config->subject(),
+      route_specific_filter_config->clusterId(),
+      route_specific_filter_config->discoverPrefix(), std::move(payload),
+      chunk_request);
+  if (!chunk_request.done_) {
+    chunk_request.request_ = std::move(request);
+  }
+}
+
+bool NatsStreamingFilter::compresses(const Buffer::Instance &body,
+                                     bool chunk) const {
+  const BodyCompressor *compressor =
+      optional_route_specific_filter_config_.value()->compressor();
+  // the chunks are all compressed, as the header that says so is published
+  // with the first one only.
+  return compressor != nullptr &&
+         (chunk ||
+          (body.length() != 0 && body.length() >= compressor->minBodySize()));
+}
+
+void NatsStreamingFilter::appendBody(Buffer::Instance &body, bool compress,
+                                     Buffer::Instance &payload) {
+  if (!compress) {
+    Envoy::Nats::Streaming::MessageUtility::appendBytesField(
+        pb::Payload::kBodyFieldNumber, body, payload);
+    return;
+  }
+  const std::chrono::nanoseconds cpu_start = Http::FilterTime::threadCpuTime();
+  Buffer::OwnedImpl compressed;
+  optional_route_specific_filter_config_.value()->compressor()->compress(
+      body, compressed);
+  const NatsStreamingFilterStats &stats = config_->stats();
+  stats.compression_cpu_time_.recordValue(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          Http::FilterTime::threadCpuTime() - cpu_start)
+          .count());
+  stats.compressed_bodies_.inc();
+  stats.compression_input_bytes_.add(body.length());
+  stats.compression_output_bytes_.add(compressed.length());
+  body.drain(body.length());
+  Envoy::Nats::Streaming::MessageUtility::appendBytesField(
+      pb::Payload::kBodyFieldNumber, compressed, payload);
+}
+
+void NatsStreamingFilter::relayUnackedToNatsStreaming(
+    Buffer::InstancePtr &&payload, bool last) {
+  auto &&route_specific_filter_config =
+      optional_route_specific_filter_config_.value();
+  // the handle isn't kept, as the publish isn't cancelled with the request.
+  // The client returns no handle only when the publish overflowed.
+  Envoy::Nats::Streaming::PublishRequestPtr request = client().makeRequest(
+      route_specific_filter_config->subject(),
+      route_specific_filter_config->clusterId(),
+      route_specific_filter_config->discoverPrefix(), std::move(payload),
+      config_->unackedPublishCallbacks());
+  if (request == nullptr) {
+    onOverflow();
+  } else if (last) {
+    onResponse();
+  }
 }
 
 void NatsStreamingFilter::onCompletion(Http::Code response_code,
                                        const std::string &body_text) {
-  in_flight_request_ = nullptr;
-
+  const Http::FilterTime::Scope time(filter_time_);
+  if (!complete()) {
+    return;
+  }
   decoder_callbacks_->sendLocalReply(response_code, body_text, nullptr,
                                      absl::nullopt,
                                      RcDetails::get().Completion);
 }
 
+bool NatsStreamingFilter::complete() {
+  if (completed_) {
+    return false;
+  }
+  completed_ = true;
+  in_flight_request_ = nullptr;
+  // a chunk that failed fails the request, the others being of no use.
+  cancelRequests();
+  return true;
+}
+
 void NatsStreamingFilter::onCompletion(Http::Code response_code,
                                        const std::string &body_text,
                                        StreamInfo::ResponseFlag response_flag) {
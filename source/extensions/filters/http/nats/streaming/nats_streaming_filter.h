@@ -1,7 +1,13 @@
 #pragma once
 
+#include <list>
+#include <memory>
+
 #include "include/envoy/nats/streaming/client.h"
 
+#include "source/common/buffer/body_budget.h"
+#include "source/common/http/filter_time.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_filter_config.h"
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_route_specific_filter_config.h"
 
@@ -20,7 +26,10 @@ class NatsStreamingFilter : public Http::StreamDecoderFilter,
                             public Envoy::Nats::Streaming::PublishCallbacks {
 public:
   NatsStreamingFilter(NatsStreamingFilterConfigSharedPtr config,
-                      Envoy::Nats::Streaming::ClientPtr nats_streaming_client);
+                      Envoy::Nats::Streaming::ClientPtr nats_streaming_client,
+                      Envoy::Nats::Streaming::ClientPtr jet_stream_client,
+                      Envoy::Nats::Streaming::ClientPtr core_client,
+                      Envoy::Nats::Streaming::ClientPtr request_reply_client);
   ~NatsStreamingFilter();
 
   // Http::StreamFilterBase
@@ -39,14 +48,38 @@ public:
     if (decoder_limit > 0) {
       decoder_buffer_limit_ = decoder_limit;
     }
+    if (config_->recordFilterTime()) {
+      filter_time_ = &Http::FilterTime::forStream(
+          *decoder_callbacks.streamInfo().filterState(),
+          SoloHttpFilterNames::get().NatsStreaming,
+          decoder_callbacks.dispatcher().timeSource());
+    }
   }
 
   // Nats::Streaming::PublishCallbacks
   virtual void onResponse() override;
+  virtual void onReply(Buffer::InstancePtr &&reply) override;
   virtual void onFailure() override;
   virtual void onTimeout() override;
+  virtual void onOverflow() override;
 
 private:
+  // the callbacks of the publish of one chunk of a body published in chunks.
+  struct ChunkRequest : public Envoy::Nats::Streaming::PublishCallbacks {
+    explicit ChunkRequest(NatsStreamingFilter &parent) : parent_(parent) {}
+
+    // Nats::Streaming::PublishCallbacks
+    void onResponse() override;
+    void onFailure() override;
+    void onTimeout() override;
+    void onOverflow() override;
+
+    NatsStreamingFilter &parent_;
+    Envoy::Nats::Streaming::PublishRequestPtr request_;
+    bool done_{};
+  };
+  using ChunkRequestPtr = std::unique_ptr<ChunkRequest>;
+
   void retrieveRouteSpecificFilterConfig();
 
   inline bool isActive() {
@@ -55,15 +88,46 @@ private:
 
   void relayToNatsStreaming();
 
+  // the client of the protocol of the route.
+  Envoy::Nats::Streaming::Client &client();
+
+  uint32_t chunkSize() const {
+    return optional_route_specific_filter_config_.value()->chunkSize();
+  }
+
+  // publishes the first length bytes of body_ as the next chunk.
+  void relayChunkToNatsStreaming(uint64_t length, bool last);
+
+  void onChunkResponse();
+
+  // publishes without waiting for the ack, answering the request once the last
+  // of its publishes was handed to the client.
+  void relayUnackedToNatsStreaming(Buffer::InstancePtr &&payload, bool last);
+
+  // whether the body of a payload of the route is compressed.
+  bool compresses(const Buffer::Instance &body, bool chunk) const;
+
+  // appends the body, compressed if need be, to the serialized payload.
+  void appendBody(Buffer::Instance &body, bool compress,
+                  Buffer::Instance &payload);
+
+  void cancelRequests();
+
   inline void onCompletion(Http::Code response_code,
                            const std::string &body_text);
 
+  // whether the request completes now, rather than having completed already.
+  bool complete();
+
   inline void onCompletion(Http::Code response_code,
                            const std::string &body_text,
                            StreamInfo::ResponseFlag response_flag);
 
   const NatsStreamingFilterConfigSharedPtr config_;
   Envoy::Nats::Streaming::ClientPtr nats_streaming_client_;
+  Envoy::Nats::Streaming::ClientPtr jet_stream_client_;
+  Envoy::Nats::Streaming::ClientPtr core_client_;
+  Envoy::Nats::Streaming::ClientPtr request_reply_client_;
   Router::RouteConstSharedPtr route_;
   absl::optional<const NatsStreamingRouteSpecificFilterConfig *>
       optional_route_specific_filter_config_;
@@ -71,7 +135,19 @@ private:
   absl::optional<uint32_t> decoder_buffer_limit_{};
   pb::Payload payload_;
   Buffer::OwnedImpl body_{};
+  // the bytes of the budget of the buffered bodies that body_ holds.
+  Buffer::BodyBudget::Reservation body_reservation_;
   Envoy::Nats::Streaming::PublishRequestPtr in_flight_request_{};
+  // the chunks published so far, the acked ones being dropped as new ones are
+  // published.
+  std::string correlation_id_;
+  std::list<ChunkRequestPtr> chunk_requests_;
+  uint64_t chunks_sent_{};
+  uint64_t chunks_acked_{};
+  bool last_chunk_sent_{};
+  bool completed_{};
+  // the time of the filter on the stream, if the config records it.
+  Http::FilterTime *filter_time_{};
 };
 
 } // namespace Streaming
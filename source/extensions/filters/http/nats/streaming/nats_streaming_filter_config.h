@@ -1,9 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <string>
+#include <vector>
 
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
 #include "envoy/upstream/cluster_manager.h"
+#include "include/envoy/nats/streaming/client.h"
 
 #include "source/common/protobuf/utility.h"
 
@@ -15,6 +20,49 @@ namespace HttpFilters {
 namespace Nats {
 namespace Streaming {
 
+/**
+ * All stats for the nats streaming filter. @see stats_macros.h
+ */
+#define ALL_NATS_STREAMING_FILTER_STATS(COUNTER, HISTOGRAM)                    \
+  COUNTER(unacked_publish_success)                                             \
+  COUNTER(unacked_publish_failure)                                             \
+  COUNTER(unacked_publish_timeout)                                             \
+  COUNTER(unacked_publish_overflow)                                            \
+  COUNTER(body_budget_exhausted)                                               \
+  COUNTER(compressed_bodies)                                                   \
+  COUNTER(compression_input_bytes)                                             \
+  COUNTER(compression_output_bytes)                                            \
+  HISTOGRAM(compression_cpu_time, Microseconds)
+
+/**
+ * Wrapper struct for nats streaming filter stats. @see stats_macros.h
+ */
+struct NatsStreamingFilterStats {
+  ALL_NATS_STREAMING_FILTER_STATS(GENERATE_COUNTER_STRUCT,
+                                  GENERATE_HISTOGRAM_STRUCT)
+};
+
+/**
+ * The callbacks of the publishes of the requests that were answered without
+ * waiting for their ack, which only count the outcomes. They are shared by all
+ * those publishes, as they hold no state of their own.
+ */
+class UnackedPublishCallbacks
+    : public Envoy::Nats::Streaming::PublishCallbacks {
+public:
+  explicit UnackedPublishCallbacks(NatsStreamingFilterStats stats)
+      : stats_(std::move(stats)) {}
+
+  // Nats::Streaming::PublishCallbacks
+  void onResponse() override { stats_.unacked_publish_success_.inc(); }
+  void onFailure() override { stats_.unacked_publish_failure_.inc(); }
+  void onTimeout() override { stats_.unacked_publish_timeout_.inc(); }
+  void onOverflow() override { stats_.unacked_publish_overflow_.inc(); }
+
+private:
+  NatsStreamingFilterStats stats_;
+};
+
 class NatsStreamingFilterConfig {
 
   using ProtoConfig =
@@ -22,14 +70,23 @@ class NatsStreamingFilterConfig {
 
 public:
   NatsStreamingFilterConfig(const ProtoConfig &proto_config,
-                            Upstream::ClusterManager &clusterManager)
+                            Upstream::ClusterManager &clusterManager,
+                            const std::string &stats_prefix,
+                            Stats::Scope &scope)
       : op_timeout_(PROTOBUF_GET_MS_OR_DEFAULT(proto_config, op_timeout, 5000)),
         cluster_(proto_config.cluster()),
-        max_connections_(proto_config.max_connections()) {
-    if (max_connections_ != 1) {
-      throw EnvoyException("nats-streaming filter: only one concurrent "
-                           "connection is currently supported");
-    }
+        max_connections_(std::max(proto_config.max_connections(), 1U)),
+        shard_by_subject_(proto_config.shard_by_subject()),
+        max_pending_acks_(std::max(
+            PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto_config, max_pending_acks,
+                                            256),
+            1U)),
+        eager_connect_protocols_(proto_config.eager_connect_protocols().begin(),
+                                 proto_config.eager_connect_protocols().end()),
+        shared_connection_workers_(proto_config.shared_connection_workers()),
+        record_filter_time_(proto_config.record_filter_time()),
+        stats_(generateStats(stats_prefix + "nats_streaming.", scope)),
+        unacked_publish_callbacks_(stats_) {
     if (!clusterManager.clusters().hasCluster(cluster_)) {
       throw EnvoyException(fmt::format(
           "nats-streaming filter: unknown cluster '{}' in config", cluster_));
@@ -39,11 +96,45 @@ public:
   const std::chrono::milliseconds &opTimeout() const { return op_timeout_; }
   const std::string &cluster() const { return cluster_; }
   uint32_t maxConnections() const { return max_connections_; }
+  bool shardBySubject() const { return shard_by_subject_; }
+  uint32_t maxPendingAcks() const { return max_pending_acks_; }
+  // whether the connections of the protocol are opened ahead of the requests.
+  bool eagerConnect(
+      envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute::
+          Protocol protocol) const {
+    return std::find(eager_connect_protocols_.begin(),
+                     eager_connect_protocols_.end(),
+                     protocol) != eager_connect_protocols_.end();
+  }
+  // the number of workers that open connections for the others, if any.
+  uint32_t sharedConnectionWorkers() const {
+    return shared_connection_workers_;
+  }
+  // whether the streams keep the time the filter spends on them.
+  bool recordFilterTime() const { return record_filter_time_; }
+  const NatsStreamingFilterStats &stats() const { return stats_; }
+  Envoy::Nats::Streaming::PublishCallbacks &unackedPublishCallbacks() {
+    return unacked_publish_callbacks_;
+  }
+
+  static NatsStreamingFilterStats generateStats(const std::string &prefix,
+                                                Stats::Scope &scope) {
+    return {ALL_NATS_STREAMING_FILTER_STATS(
+        POOL_COUNTER_PREFIX(scope, prefix),
+        POOL_HISTOGRAM_PREFIX(scope, prefix))};
+  }
 
 private:
   std::chrono::milliseconds op_timeout_;
   std::string cluster_;
   uint32_t max_connections_;
+  bool shard_by_subject_;
+  uint32_t max_pending_acks_;
+  std::vector<int> eager_connect_protocols_;
+  uint32_t shared_connection_workers_;
+  bool record_filter_time_;
+  NatsStreamingFilterStats stats_;
+  UnackedPublishCallbacks unacked_publish_callbacks_;
 };
 
 typedef std::shared_ptr<NatsStreamingFilterConfig>
@@ -2,7 +2,12 @@
 
 #include "envoy/registry/registry.h"
 
+#include "source/common/http/filter_pool.h"
 #include "source/common/nats/codec_impl.h"
+#include "source/common/nats/core/client_impl.h"
+#include "source/common/nats/core/request_reply_client_impl.h"
+#include "source/common/nats/jetstream/client_impl.h"
+#include "source/common/nats/streaming/client_impl.h"
 #include "source/common/nats/streaming/client_pool.h"
 #include "source/common/tcp/conn_pool_impl.h"
 
@@ -20,27 +25,92 @@ Http::FilterFactoryCb
 NatsStreamingFilterConfigFactory::createFilterFactoryFromProtoTyped(
     const envoy::config::filter::http::nats::streaming::v2::NatsStreaming
         &proto_config,
-    const std::string &, Server::Configuration::FactoryContext &context) {
+    const std::string &stats_prefix,
+    Server::Configuration::FactoryContext &context) {
 
   NatsStreamingFilterConfigSharedPtr config =
       std::make_shared<NatsStreamingFilterConfig>(
-          NatsStreamingFilterConfig(proto_config, context.clusterManager()));
+          proto_config, context.clusterManager(), stats_prefix,
+          context.scope());
 
   Tcp::ConnPoolNats::ClientFactory<Envoy::Nats::Message> &client_factory =
       Tcp::ConnPoolNats::ClientFactoryImpl<Envoy::Nats::Message,
                                            Envoy::Nats::EncoderImpl,
                                            Envoy::Nats::DecoderImpl>::instance_;
 
+  using envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute;
+  using Envoy::Nats::Streaming::ClientPool;
+  Random::RandomGenerator &random = context.api().randomGenerator();
   Envoy::Nats::Streaming::ClientPtr nats_streaming_client =
-      std::make_shared<Envoy::Nats::Streaming::ClientPool>(
+      std::make_shared<ClientPool>(
           config->cluster(), context.clusterManager(), client_factory,
-          context.threadLocal(), context.api().randomGenerator(), config->opTimeout());
+          context.threadLocal(), config->maxConnections(),
+          config->shardBySubject(),
+          config->eagerConnect(NatsStreamingPerRoute::NATS_STREAMING),
+          config->sharedConnectionWorkers(),
+          ClientPool::streamingClientFactory(
+              random, config->opTimeout(),
+              Envoy::Nats::Streaming::ClientImpl::generateStats(
+                  config->cluster(), context.scope())));
 
-  return [config, nats_streaming_client](
+  // the connections of a protocol no route uses are never opened.
+  const std::chrono::milliseconds op_timeout = config->opTimeout();
+  const uint32_t max_pending_acks = config->maxPendingAcks();
+  Envoy::Nats::Streaming::ClientPtr jet_stream_client =
+      std::make_shared<ClientPool>(
+          config->cluster(), context.clusterManager(), client_factory,
+          context.threadLocal(), config->maxConnections(),
+          config->shardBySubject(),
+          config->eagerConnect(NatsStreamingPerRoute::JETSTREAM),
+          config->sharedConnectionWorkers(),
+          [&random, op_timeout, max_pending_acks](
+              Tcp::ConnPoolNats::InstancePtr<Envoy::Nats::Message> &&conn_pool,
+              Event::Dispatcher &dispatcher, const std::string &hash_key)
+              -> Envoy::Nats::Streaming::PooledClientPtr {
+            return std::make_unique<Envoy::Nats::JetStream::ClientImpl>(
+                std::move(conn_pool), random, dispatcher, op_timeout,
+                max_pending_acks, hash_key);
+          });
+
+  Envoy::Nats::Streaming::ClientPtr core_client =
+      std::make_shared<ClientPool>(
+          config->cluster(), context.clusterManager(), client_factory,
+          context.threadLocal(), config->maxConnections(),
+          config->shardBySubject(),
+          config->eagerConnect(NatsStreamingPerRoute::CORE),
+          config->sharedConnectionWorkers(),
+          [&random](
+              Tcp::ConnPoolNats::InstancePtr<Envoy::Nats::Message> &&conn_pool,
+              Event::Dispatcher &dispatcher, const std::string &hash_key)
+              -> Envoy::Nats::Streaming::PooledClientPtr {
+            return std::make_unique<Envoy::Nats::Core::ClientImpl>(
+                std::move(conn_pool), random, dispatcher, hash_key);
+          });
+
+  Envoy::Nats::Streaming::ClientPtr request_reply_client =
+      std::make_shared<ClientPool>(
+          config->cluster(), context.clusterManager(), client_factory,
+          context.threadLocal(), config->maxConnections(),
+          config->shardBySubject(),
+          config->eagerConnect(NatsStreamingPerRoute::REQUEST_REPLY),
+          config->sharedConnectionWorkers(),
+          [&random, op_timeout](
+              Tcp::ConnPoolNats::InstancePtr<Envoy::Nats::Message> &&conn_pool,
+              Event::Dispatcher &dispatcher, const std::string &hash_key)
+              -> Envoy::Nats::Streaming::PooledClientPtr {
+            return std::make_unique<
+                Envoy::Nats::Core::RequestReplyClientImpl>(
+                std::move(conn_pool), random, dispatcher, op_timeout,
+                hash_key);
+          });
+
+  return [config, nats_streaming_client, jet_stream_client, core_client,
+          request_reply_client](
              Envoy::Http::FilterChainFactoryCallbacks &callbacks) -> void {
-    auto filter = new NatsStreamingFilter(config, nats_streaming_client);
     callbacks.addStreamDecoderFilter(
-        Http::StreamDecoderFilterSharedPtr{filter});
+        Http::FilterPool<NatsStreamingFilter>::make(
+            config, nats_streaming_client, jet_stream_client, core_client,
+            request_reply_client));
   };
 }
 
@@ -1,5 +1,9 @@
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_route_specific_filter_config.h"
 
+#include "envoy/common/exception.h"
+
+#include "absl/strings/ascii.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -10,7 +14,34 @@ NatsStreamingRouteSpecificFilterConfig::NatsStreamingRouteSpecificFilterConfig(
     const envoy::config::filter::http::nats::streaming::v2::
         NatsStreamingPerRoute &proto_config)
     : subject_(proto_config.subject()), cluster_id_(proto_config.cluster_id()),
-      discover_prefix_(proto_config.discover_prefix()) {}
+      discover_prefix_(proto_config.discover_prefix()),
+      chunk_size_(proto_config.chunk_size()),
+      fire_and_forget_(proto_config.ack_mode() ==
+                       envoy::config::filter::http::nats::streaming::v2::
+                           NatsStreamingPerRoute::NONE),
+      protocol_(proto_config.protocol()),
+      compressor_(proto_config.has_compression()
+                      ? std::make_unique<const BodyCompressor>(
+                            proto_config.compression())
+                      : nullptr) {
+  // the reply answers the request, so there is a single publish to wait for.
+  if (protocol_ == envoy::config::filter::http::nats::streaming::v2::
+                       NatsStreamingPerRoute::REQUEST_REPLY &&
+      (chunk_size_ != 0 || fire_and_forget_)) {
+    throw EnvoyException(
+        "nats-streaming filter: a REQUEST_REPLY route can't set chunk_size or "
+        "the NONE ack_mode");
+  }
+  for (const std::string &header : proto_config.exclude_headers()) {
+    exclude_headers_.insert(absl::AsciiStrToLower(header));
+  }
+  for (const std::string &header : proto_config.include_headers()) {
+    Http::LowerCaseString name(header);
+    if (!excludesHeader(name.get())) {
+      include_headers_.push_back(std::move(name));
+    }
+  }
+}
 
 } // namespace Streaming
 } // namespace Nats
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/http/header_map.h"
 #include "envoy/router/router.h"
 
+#include "source/extensions/filters/http/nats/streaming/body_compressor.h"
+
+#include "absl/container/flat_hash_set.h"
 #include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
 
 namespace Envoy {
@@ -21,10 +29,34 @@ public:
   const std::string &clusterId() const { return cluster_id_; }
   const std::string &discoverPrefix() const { return discover_prefix_; }
 
+  // the headers that are published, if not all of them.
+  const std::vector<Http::LowerCaseString> &includeHeaders() const {
+    return include_headers_;
+  }
+  bool excludesHeader(absl::string_view name) const {
+    return exclude_headers_.contains(name);
+  }
+  // 0 when the body is published as a single message.
+  uint32_t chunkSize() const { return chunk_size_; }
+  // whether the request is answered without waiting for the acks.
+  bool fireAndForget() const { return fire_and_forget_; }
+  using Protocol = envoy::config::filter::http::nats::streaming::v2::
+      NatsStreamingPerRoute::Protocol;
+  // the protocol the subject is published to with.
+  Protocol protocol() const { return protocol_; }
+  // compresses the bodies the route publishes, if it does.
+  const BodyCompressor *compressor() const { return compressor_.get(); }
+
 private:
   const std::string subject_;
   const std::string cluster_id_;
   const std::string discover_prefix_;
+  std::vector<Http::LowerCaseString> include_headers_;
+  absl::flat_hash_set<std::string> exclude_headers_;
+  const uint32_t chunk_size_;
+  const bool fire_and_forget_;
+  const Protocol protocol_;
+  std::unique_ptr<const BodyCompressor> compressor_;
 };
 
 } // namespace Streaming
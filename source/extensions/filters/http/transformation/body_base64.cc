@@ -0,0 +1,150 @@
+#include "source/extensions/filters/http/transformation/body_base64.h"
+
+#include <array>
+
+#include "envoy/common/exception.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+constexpr char EncodeTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr char Padding = '=';
+constexpr int8_t InvalidChar = -1;
+
+constexpr std::array<int8_t, 256> makeDecodeTable() {
+  std::array<int8_t, 256> table{};
+  for (auto &value : table) {
+    value = InvalidChar;
+  }
+  for (int i = 0; i < 64; i++) {
+    table[static_cast<unsigned char>(EncodeTable[i])] = i;
+  }
+  return table;
+}
+
+constexpr std::array<int8_t, 256> DecodeTable = makeDecodeTable();
+
+// writes the 4 characters that encode the 3 bytes at in.
+inline void encodeGroup(const uint8_t *in, char *out) {
+  const uint32_t group = (in[0] << 16) | (in[1] << 8) | in[2];
+  out[0] = EncodeTable[(group >> 18) & 0x3f];
+  out[1] = EncodeTable[(group >> 12) & 0x3f];
+  out[2] = EncodeTable[(group >> 6) & 0x3f];
+  out[3] = EncodeTable[group & 0x3f];
+}
+
+[[noreturn]] void throwInvalid() {
+  throw EnvoyException("the body is not valid base64");
+}
+
+} // namespace
+
+void base64EncodeBody(const Buffer::Instance &input, Buffer::Instance &output) {
+  const uint64_t length = input.length();
+  if (length == 0) {
+    return;
+  }
+  auto reservation = output.reserveSingleSlice((length + 2) / 3 * 4);
+  char *out = static_cast<char *>(reservation.slice().mem_);
+
+  // the bytes of a group that spans two slices.
+  uint8_t carry[3];
+  size_t carry_size = 0;
+  for (const Buffer::RawSlice &slice : input.getRawSlices()) {
+    const uint8_t *in = static_cast<const uint8_t *>(slice.mem_);
+    const uint8_t *end = in + slice.len_;
+    while (carry_size != 0 && in != end) {
+      carry[carry_size++] = *in++;
+      if (carry_size == 3) {
+        encodeGroup(carry, out);
+        out += 4;
+        carry_size = 0;
+      }
+    }
+    for (; end - in >= 3; in += 3) {
+      encodeGroup(in, out);
+      out += 4;
+    }
+    while (in != end) {
+      carry[carry_size++] = *in++;
+    }
+  }
+
+  if (carry_size != 0) {
+    carry[1] = carry_size > 1 ? carry[1] : 0;
+    carry[2] = 0;
+    encodeGroup(carry, out);
+    out[3] = Padding;
+    if (carry_size == 1) {
+      out[2] = Padding;
+    }
+    out += 4;
+  }
+  reservation.commit(out - static_cast<char *>(reservation.slice().mem_));
+}
+
+void base64DecodeBody(const Buffer::Instance &input, Buffer::Instance &output) {
+  const uint64_t length = input.length();
+  if (length == 0) {
+    return;
+  }
+  if (length % 4 != 0) {
+    throwInvalid();
+  }
+  auto reservation = output.reserveSingleSlice(length / 4 * 3);
+  char *out = static_cast<char *>(reservation.slice().mem_);
+
+  // the values of the characters of the current group, which may span
+  // slices.
+  uint32_t group = 0;
+  size_t group_size = 0;
+  size_t padding = 0;
+  for (const Buffer::RawSlice &slice : input.getRawSlices()) {
+    const uint8_t *in = static_cast<const uint8_t *>(slice.mem_);
+    const uint8_t *end = in + slice.len_;
+    for (; in != end; in++) {
+      if (*in == Padding) {
+        padding++;
+        continue;
+      }
+      const int8_t value = DecodeTable[*in];
+      // padding is only allowed at the very end.
+      if (value == InvalidChar || padding != 0) {
+        throwInvalid();
+      }
+      group = (group << 6) | value;
+      if (++group_size == 4) {
+        out[0] = static_cast<char>(group >> 16);
+        out[1] = static_cast<char>(group >> 8);
+        out[2] = static_cast<char>(group);
+        out += 3;
+        group = 0;
+        group_size = 0;
+      }
+    }
+  }
+
+  // the length is a multiple of 4, so the padding completes the last group.
+  if (padding > 2) {
+    throwInvalid();
+  }
+  if (group_size == 2) {
+    out[0] = static_cast<char>(group >> 4);
+    out += 1;
+  } else if (group_size == 3) {
+    out[0] = static_cast<char>(group >> 10);
+    out[1] = static_cast<char>(group >> 2);
+    out += 2;
+  }
+  reservation.commit(out - static_cast<char *>(reservation.slice().mem_));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
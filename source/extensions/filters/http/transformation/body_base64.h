@@ -0,0 +1,28 @@
+#pragma once
+
+#include "envoy/buffer/buffer.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Appends the padded base64 encoding of input to output. The input is read
+ * slice by slice and is not modified, and the output is written in place into
+ * a single reservation, without an intermediate string.
+ */
+void base64EncodeBody(const Buffer::Instance &input, Buffer::Instance &output);
+
+/**
+ * Appends the base64 decoding of input to output, the same way as
+ * base64EncodeBody(). The input must be padded, as Base64::decode() expects.
+ *
+ * Throws EnvoyException if input isn't valid base64.
+ */
+void base64DecodeBody(const Buffer::Instance &input, Buffer::Instance &output);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,12 +1,13 @@
 #include "source/extensions/filters/http/transformation/body_header_transformer.h"
 
+#include <algorithm>
+
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/http/headers.h"
 #include "source/common/http/utility.h"
+#include "source/extensions/filters/http/transformation/json_escape.h"
 
-#include "nlohmann/json.hpp"
-
-// For convenience
-using json = nlohmann::json;
+#include "absl/container/inlined_vector.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -19,18 +20,46 @@ void BodyHeaderTransformer::transform(
     Http::RequestOrResponseHeaderMap &header_map,
     Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
     Http::StreamFilterCallbacks &) const {
-  json json_body;
+  // the json is written straight into the new body. Keys are written in
+  // sorted order, and the last value of a repeated header wins, which is what
+  // a json object gave us.
+  Buffer::OwnedImpl output;
+  output.add("{", 1);
   if (body.length() > 0) {
-    json_body["body"] = body.toString();
+    const uint64_t length = body.length();
+    output.add("\"body\":");
+    appendJsonString(output,
+                     absl::string_view(
+                         static_cast<const char *>(body.linearize(length)),
+                         length));
+    output.add(",", 1);
   }
 
-  json &headers = json_body["headers"];
+  absl::InlinedVector<std::pair<absl::string_view, absl::string_view>, 32>
+      headers;
   header_map.iterate(
       [&headers](const Http::HeaderEntry &header) -> Http::HeaderMap::Iterate {
-        headers[std::string(header.key().getStringView())] =
-            std::string(header.value().getStringView());
+        headers.emplace_back(header.key().getStringView(),
+                             header.value().getStringView());
         return Http::HeaderMap::Iterate::Continue;
       });
+  std::stable_sort(headers.begin(), headers.end(),
+                   [](const auto &a, const auto &b) { return a.first < b.first; });
+  output.add("\"headers\":");
+  if (headers.empty()) {
+    output.add("null");
+  } else {
+    output.add("{", 1);
+    for (size_t i = 0; i < headers.size(); i++) {
+      if (i + 1 < headers.size() && headers[i + 1].first == headers[i].first) {
+        continue;
+      }
+      appendJsonString(output, headers[i].first);
+      output.add(":", 1);
+      appendJsonString(output, headers[i].second);
+      output.add(i + 1 < headers.size() ? "," : "}");
+    }
+  }
 
   if (add_request_metadata_) {
     if (request_headers == (&header_map)){
@@ -43,11 +72,15 @@ void BodyHeaderTransformer::transform(
         // remove the question mark
         query_string.remove_prefix(1);
       }
-      json_body["queryString"] = query_string;
-      json_body["httpMethod"] = request_headers->Method()->value().getStringView();
-      json_body["path"] = path_view;
+      output.add(",\"httpMethod\":");
+      appendJsonString(output, request_headers->Method()->value().getStringView());
+      output.add(",\"path\":");
+      appendJsonString(output, path_view);
+      output.add(",\"queryString\":");
+      appendJsonString(output, query_string);
     }
   }
+  output.add("}", 1);
 
   // remove content length, as we have new body.
   header_map.removeContentLength();
@@ -58,7 +91,7 @@ void BodyHeaderTransformer::transform(
 
   // replace body
   body.drain(body.length());
-  body.add(json_body.dump());
+  body.move(output);
   header_map.setContentLength(body.length());
 }
 
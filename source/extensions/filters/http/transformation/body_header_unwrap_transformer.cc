@@ -0,0 +1,32 @@
+#include "source/extensions/filters/http/transformation/body_header_unwrap_transformer.h"
+
+#include "envoy/common/exception.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/alb_response_parser.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+void BodyHeaderUnwrapTransformer::transform(
+    Http::RequestOrResponseHeaderMap &header_map, Http::RequestHeaderMap *,
+    Buffer::Instance &body, Http::StreamFilterCallbacks &) const {
+  // the content type of the json doesn't describe the unwrapped body, which
+  // gets the one in the headers, if any.
+  header_map.removeContentType();
+  Buffer::OwnedImpl unwrapped;
+  if (!Http::AlbResponseParser::parse(body, header_map, unwrapped, true)) {
+    throw EnvoyException(
+        "the body is not a json object with the headers and the body");
+  }
+  body.drain(body.length());
+  body.move(unwrapped);
+  header_map.setContentLength(body.length());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "source/extensions/filters/http/transformation/transformer.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * The reverse of the BodyHeaderTransformer: unwraps a json body that holds
+ * the statusCode, headers and body of the message, as a function returns
+ * them. The whole body is needed to find the headers, which may come after
+ * the body in the json, so it is buffered. The unwrapped body is handed over
+ * to the stream without copying it again.
+ */
+class BodyHeaderUnwrapTransformer : public Transformer {
+public:
+  void transform(Http::RequestOrResponseHeaderMap &map,
+                 Http::RequestHeaderMap *request_headers,
+                 Buffer::Instance &body,
+                 Http::StreamFilterCallbacks &) const override;
+  bool passthrough_body() const override { return false; };
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
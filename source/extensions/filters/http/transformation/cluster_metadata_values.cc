@@ -0,0 +1,103 @@
+#include "source/extensions/filters/http/transformation/cluster_metadata_values.h"
+
+#include <sstream>
+
+#include "envoy/registry/registry.h"
+
+#include "source/common/singleton/const_singleton.h"
+
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+struct BoolHeaderValues {
+  const std::string trueString = "true";
+  const std::string falseString = "false";
+};
+typedef ConstSingleton<BoolHeaderValues> BoolHeader;
+
+ClusterMetadataValues::ClusterMetadataValues(
+    const ProtobufWkt::Struct &metadata) {
+  values_.reserve(metadata.fields().size());
+  for (const auto &field : metadata.fields()) {
+    values_.emplace(field.first, toJson(field.second));
+  }
+}
+
+const nlohmann::json *ClusterMetadataValues::find(absl::string_view key) const {
+  auto it = values_.find(key);
+  return it == values_.end() ? nullptr : &it->second;
+}
+
+nlohmann::json ClusterMetadataValues::toJson(const ProtobufWkt::Value &value) {
+  switch (value.kind_case()) {
+  case ProtobufWkt::Value::kStringValue: {
+    return value.string_value();
+  }
+  case ProtobufWkt::Value::kNumberValue: {
+    return value.number_value();
+  }
+  case ProtobufWkt::Value::kBoolValue: {
+    return value.bool_value() ? BoolHeader::get().trueString
+                              : BoolHeader::get().falseString;
+  }
+  case ProtobufWkt::Value::kListValue: {
+    const auto &listval = value.list_value().values();
+    if (listval.size() == 0) {
+      break;
+    }
+
+    std::stringstream ss;
+    bool first = true;
+    for (const ProtobufWkt::Value &element : listval) {
+      if (!first) {
+        ss << ",";
+      }
+      first = false;
+
+      switch (element.kind_case()) {
+      case ProtobufWkt::Value::kStringValue: {
+        ss << element.string_value();
+        break;
+      }
+      case ProtobufWkt::Value::kNumberValue: {
+        ss << element.number_value();
+        break;
+      }
+      case ProtobufWkt::Value::kBoolValue: {
+        ss << (element.bool_value() ? BoolHeader::get().trueString
+                                    : BoolHeader::get().falseString);
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    return ss.str();
+  }
+  default: {
+    break;
+  }
+  }
+  return "";
+}
+
+std::string ClusterMetadataValuesFactory::name() const {
+  return SoloHttpFilterNames::get().Transformation;
+}
+
+std::unique_ptr<const Config::TypedMetadata::Object>
+ClusterMetadataValuesFactory::parse(const ProtobufWkt::Struct &data) const {
+  return std::make_unique<const ClusterMetadataValues>(data);
+}
+
+REGISTER_FACTORY(ClusterMetadataValuesFactory,
+                 Upstream::ClusterTypedMetadataFactory);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
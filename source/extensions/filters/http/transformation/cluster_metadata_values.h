@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+
+#include "envoy/config/typed_metadata.h"
+#include "envoy/upstream/upstream.h"
+
+#include "source/common/protobuf/protobuf.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * The values of a cluster's transformation filter metadata, as they are
+ * returned by clusterMetadata(). They are converted once, when the cluster is
+ * created, and a cluster update creates a new cluster along with new values.
+ */
+class ClusterMetadataValues : public Config::TypedMetadata::Object {
+public:
+  explicit ClusterMetadataValues(const ProtobufWkt::Struct &metadata);
+
+  /**
+   * @return the value of the key, or nullptr if the metadata doesn't have a
+   * value that clusterMetadata() can return for it.
+   */
+  const nlohmann::json *find(absl::string_view key) const;
+
+  /**
+   * Converts a metadata value the way clusterMetadata() returns it: strings,
+   * numbers and bools as they are, and lists joined with commas.
+   * @return the converted value, or an empty string if the value has a kind
+   * that can't be converted.
+   */
+  static nlohmann::json toJson(const ProtobufWkt::Value &value);
+
+private:
+  absl::flat_hash_map<std::string, nlohmann::json> values_;
+};
+
+/**
+ * Creates the ClusterMetadataValues of a cluster from the filter metadata
+ * under the transformation filter name.
+ */
+class ClusterMetadataValuesFactory
+    : public Upstream::ClusterTypedMetadataFactory {
+public:
+  std::string name() const override;
+  std::unique_ptr<const Config::TypedMetadata::Object>
+  parse(const ProtobufWkt::Struct &data) const override;
+  // typed filter metadata isn't read by clusterMetadata().
+  std::unique_ptr<const Config::TypedMetadata::Object>
+  parse(const ProtobufWkt::Any &) const override {
+    return nullptr;
+  }
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
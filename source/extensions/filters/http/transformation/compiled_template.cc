@@ -0,0 +1,335 @@
+#include "source/extensions/filters/http/transformation/compiled_template.h"
+
+#include <algorithm>
+
+#include "source/extensions/filters/http/transformation/json_escape.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+// These are the default inja delimiters, which are the ones the
+// transformation filter uses.
+constexpr absl::string_view ExpressionOpen = "{{";
+constexpr absl::string_view ExpressionClose = "}}";
+
+bool isNameChar(char c) { return absl::ascii_isalnum(c) || c == '_'; }
+
+// names that inja parses as something else than a variable.
+bool isKeyword(absl::string_view name) {
+  return name == "true" || name == "false" || name == "null" ||
+         name == "in" || name == "and" || name == "or" || name == "not";
+}
+
+// splits a variable name on the separator of the notation, making sure that
+// every key is a plain name.
+absl::optional<std::vector<std::string>>
+splitVariable(absl::string_view name, bool advanced_templates) {
+  const char separator = advanced_templates ? '/' : '.';
+  if (advanced_templates) {
+    absl::ConsumePrefix(&name, "/");
+  }
+  if (name.empty() || (!absl::ascii_isalpha(name[0]) && name[0] != '_')) {
+    return absl::nullopt;
+  }
+  std::vector<std::string> path = absl::StrSplit(name, separator);
+  for (const std::string &key : path) {
+    if (key.empty() || !std::all_of(key.begin(), key.end(), isNameChar)) {
+      return absl::nullopt;
+    }
+  }
+  if (isKeyword(path[0])) {
+    return absl::nullopt;
+  }
+  return path;
+}
+
+// returns the index of an array element the way json pointers write it.
+absl::optional<size_t> arrayIndex(absl::string_view key) {
+  size_t index;
+  if (key.empty() || (key.size() > 1 && key[0] == '0') ||
+      !std::all_of(key.begin(), key.end(), absl::ascii_isdigit) ||
+      !absl::SimpleAtoi(key, &index)) {
+    return absl::nullopt;
+  }
+  return index;
+}
+
+absl::string_view firstValue(const RenderContext &context,
+                             const Http::HeaderMap &headers,
+                             const Http::LowerCaseString &key) {
+  if (context.header_memo_ != nullptr) {
+    return context.header_memo_->get(headers, key);
+  }
+  const Http::HeaderMap::GetResult entries = headers.get(key);
+  return entries.empty() ? absl::string_view()
+                         : entries[0]->value().getStringView();
+}
+
+} // namespace
+
+absl::optional<CompiledTemplate>
+CompiledTemplate::compile(absl::string_view text, bool advanced_templates,
+                          const ExtractionSlots *extraction_slots) {
+  CompiledTemplate compiled;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    const size_t open = text.find(ExpressionOpen, pos);
+    const absl::string_view literal = text.substr(
+        pos, open == absl::string_view::npos ? absl::string_view::npos
+                                             : open - pos);
+    // statements, comments and line statements are left to inja.
+    if (absl::StrContains(literal, "{%") || absl::StrContains(literal, "{#") ||
+        absl::StrContains(literal, "##")) {
+      return absl::nullopt;
+    }
+    if (!literal.empty()) {
+      compiled.ops_.push_back(
+          Op{OpType::Text, std::string(literal), {}, {}, {}, false});
+    }
+    if (open == absl::string_view::npos) {
+      break;
+    }
+
+    const size_t start = open + ExpressionOpen.size();
+    const size_t close = text.find(ExpressionClose, start);
+    if (close == absl::string_view::npos ||
+        !compiled.compileExpression(text.substr(start, close - start),
+                                    advanced_templates, extraction_slots,
+                                    false)) {
+      return absl::nullopt;
+    }
+    pos = close + ExpressionClose.size();
+  }
+  return compiled;
+}
+
+absl::optional<absl::string_view> CompiledTemplate::constantText() const {
+  if (ops_.empty()) {
+    return absl::string_view();
+  }
+  const Op *op = singleOp(OpType::Text);
+  if (op == nullptr) {
+    return absl::nullopt;
+  }
+  return absl::string_view(op->text_);
+}
+
+const Http::LowerCaseString *CompiledTemplate::copiedHeader() const {
+  const Op *op = singleOp(OpType::Header);
+  return op != nullptr ? &op->header_.value() : nullptr;
+}
+
+const Http::LowerCaseString *CompiledTemplate::copiedRequestHeader() const {
+  const Op *op = singleOp(OpType::RequestHeader);
+  return op != nullptr ? &op->header_.value() : nullptr;
+}
+
+const CompiledTemplate::Op *CompiledTemplate::singleOp(OpType type) const {
+  // the output of an escaped op isn't its value.
+  if (ops_.size() != 1 || ops_[0].type_ != type || ops_[0].escape_) {
+    return nullptr;
+  }
+  return &ops_[0];
+}
+
+bool CompiledTemplate::compileExpression(
+    absl::string_view expression, bool advanced_templates,
+    const ExtractionSlots *extraction_slots, bool escape) {
+  // whitespace control is left to inja.
+  if (absl::StartsWith(expression, "-") || absl::EndsWith(expression, "-")) {
+    return false;
+  }
+  expression = absl::StripAsciiWhitespace(expression);
+
+  // json_escape() of anything the ops print escapes what they print.
+  constexpr absl::string_view JsonEscape = "json_escape(";
+  if (!escape && absl::StartsWith(expression, JsonEscape) &&
+      absl::EndsWith(expression, ")")) {
+    return compileExpression(
+        expression.substr(JsonEscape.size(),
+                          expression.size() - JsonEscape.size() - 1),
+        advanced_templates, extraction_slots, true);
+  }
+
+  const size_t paren = expression.find('(');
+  if (paren == absl::string_view::npos) {
+    absl::optional<std::vector<std::string>> path =
+        splitVariable(expression, advanced_templates);
+    if (!path.has_value()) {
+      return false;
+    }
+    ops_.push_back(
+        Op{OpType::Variable, {}, {}, std::move(path.value()), {}, escape});
+    return true;
+  }
+
+  // a call with a single string literal without escapes, e.g. header("a"),
+  // or without arguments.
+  const absl::string_view function = expression.substr(0, paren);
+  absl::string_view argument = expression.substr(paren + 1);
+  if (!absl::ConsumeSuffix(&argument, ")")) {
+    return false;
+  }
+  argument = absl::StripAsciiWhitespace(argument);
+  if (argument.empty()) {
+    if (function == "context") {
+      ops_.push_back(Op{OpType::Context, {}, {}, {}, {}, escape});
+    } else if (function == "body") {
+      ops_.push_back(Op{OpType::Body, {}, {}, {}, {}, escape});
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (argument.size() < 2 || argument.front() != '"' ||
+      argument.back() != '"') {
+    return false;
+  }
+  argument = argument.substr(1, argument.size() - 2);
+  if (absl::StrContains(argument, '"') || absl::StrContains(argument, '\\')) {
+    return false;
+  }
+
+  if (function == "header") {
+    ops_.push_back(Op{
+        OpType::Header, {}, Http::LowerCaseString(argument), {}, {}, escape});
+  } else if (function == "request_header") {
+    ops_.push_back(Op{OpType::RequestHeader,
+                      {},
+                      Http::LowerCaseString(argument),
+                      {},
+                      {},
+                      escape});
+  } else if (function == "extraction") {
+    Op op{OpType::Extraction, std::string(argument), {}, {}, {}, escape};
+    if (extraction_slots != nullptr) {
+      auto it = extraction_slots->find(argument);
+      if (it == extraction_slots->end()) {
+        // there is no such extraction, which prints nothing.
+        return true;
+      }
+      op.slot_ = it->second;
+    }
+    ops_.push_back(std::move(op));
+  } else if (function == "env") {
+    ops_.push_back(
+        Op{OpType::Environment, std::string(argument), {}, {}, {}, escape});
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool CompiledTemplate::render(const RenderContext &context,
+                              std::string &output) const {
+  for (const Op &op : ops_) {
+    switch (op.type_) {
+    case OpType::Text:
+      output.append(op.text_);
+      break;
+    case OpType::Header:
+      appendText(firstValue(context, context.header_map_, *op.header_),
+                 op.escape_, output);
+      break;
+    case OpType::RequestHeader:
+      if (context.request_headers_ != nullptr) {
+        appendText(
+            firstValue(context, *context.request_headers_, *op.header_),
+            op.escape_, output);
+      }
+      break;
+    case OpType::Extraction: {
+      const absl::optional<size_t> slot =
+          op.slot_.has_value() ? op.slot_ : context.extractions_.slot(op.text_);
+      if (slot.has_value()) {
+        appendText(context.extractions_.value(slot.value()), op.escape_,
+                   output);
+      }
+      break;
+    }
+    case OpType::Environment: {
+      auto it = context.environ_.find(op.text_);
+      if (it != context.environ_.end()) {
+        appendText(it->second, op.escape_, output);
+      }
+      break;
+    }
+    case OpType::Variable: {
+      // inja renders with an empty object when the context isn't one.
+      const nlohmann::json *value = &context.context_;
+      if (!value->is_object()) {
+        return false;
+      }
+      for (const std::string &key : op.path_) {
+        if (value->is_object()) {
+          auto it = value->find(key);
+          if (it == value->end()) {
+            return false;
+          }
+          value = &*it;
+        } else if (value->is_array()) {
+          const absl::optional<size_t> index = arrayIndex(key);
+          if (!index.has_value() || index.value() >= value->size()) {
+            return false;
+          }
+          value = &(*value)[index.value()];
+        } else {
+          return false;
+        }
+      }
+      if (!appendValue(*value, op.escape_, output)) {
+        return false;
+      }
+      break;
+    }
+    case OpType::Context:
+      // unlike variables, the callback returns the context as it is.
+      if (!appendValue(context.context_, op.escape_, output)) {
+        return false;
+      }
+      break;
+    case OpType::Body:
+      appendText(context.body_(), op.escape_, output);
+      break;
+    }
+  }
+  return true;
+}
+
+void CompiledTemplate::appendText(absl::string_view text, bool escape,
+                                  std::string &output) {
+  if (escape) {
+    appendJsonEscaped(output, text);
+  } else {
+    output.append(text.data(), text.size());
+  }
+}
+
+bool CompiledTemplate::appendValue(const nlohmann::json &value, bool escape,
+                                   std::string &output) {
+  if (value.is_string()) {
+    appendText(value.get_ref<const std::string &>(), escape, output);
+  } else if (value.is_null()) {
+    // how null is printed differs between inja versions.
+    return false;
+  } else {
+    appendText(value.dump(), escape, output);
+  }
+  return true;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
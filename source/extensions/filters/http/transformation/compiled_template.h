@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "envoy/http/header_map.h"
+
+#include "source/extensions/filters/http/transformation/render_context.h"
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * A template lowered, at config time, into a flat list of ops that are
+ * rendered without going through inja. Only templates made of text and of
+ * expressions that print a variable, the result of header(),
+ * request_header(), extraction() or env() called with a string literal, or
+ * the result of context() or body(), are compiled, along with json_escape()
+ * of any of these. Everything else is left to inja.
+ *
+ * The ops print the values they look up in place, where the inja callbacks
+ * return a copy of them, which matters most for context() and body().
+ */
+class CompiledTemplate {
+public:
+  /**
+   * @param text the template source, which inja already parsed successfully.
+   * @param advanced_templates whether the template uses json pointer notation.
+   * @param extraction_slots the slots of the extractions the template is
+   * rendered with, which extraction() calls are resolved to. Without them,
+   * the extractions are looked up by name when rendered.
+   * @return the compiled template, or nullopt if the template uses anything
+   * that the ops can't render.
+   */
+  static absl::optional<CompiledTemplate>
+  compile(absl::string_view text, bool advanced_templates,
+          const ExtractionSlots *extraction_slots = nullptr);
+
+  /**
+   * Appends the rendered template to output.
+   * @return false if a variable is missing or isn't printed the same way by
+   * the ops and by inja. The template must then be rendered by inja, which
+   * reports the error as it always did, and output must be discarded.
+   */
+  bool render(const RenderContext &context, std::string &output) const;
+
+  size_t size() const { return ops_.size(); }
+
+  /**
+   * @return the output of a template that is only text, or nullopt.
+   */
+  absl::optional<absl::string_view> constantText() const;
+  /**
+   * @return the header whose first value is the output of a template made of
+   * a single header() call, or nullptr. copiedRequestHeader() is the same for
+   * request_header().
+   */
+  const Http::LowerCaseString *copiedHeader() const;
+  const Http::LowerCaseString *copiedRequestHeader() const;
+
+private:
+  enum class OpType {
+    Text,
+    Header,
+    RequestHeader,
+    Extraction,
+    Environment,
+    Variable,
+    Context,
+    Body
+  };
+
+  struct Op {
+    OpType type_;
+    // the text, or the name of the extraction or of the environment variable.
+    std::string text_;
+    absl::optional<Http::LowerCaseString> header_;
+    // the keys of a variable, split once.
+    std::vector<std::string> path_;
+    // the slot of the extraction, when it was resolved.
+    absl::optional<size_t> slot_;
+    // whether the output is escaped as json_escape() does.
+    bool escape_;
+  };
+
+  // the only op of the template, when it has one of the given type.
+  const Op *singleOp(OpType type) const;
+
+  bool compileExpression(absl::string_view expression, bool advanced_templates,
+                         const ExtractionSlots *extraction_slots, bool escape);
+  static void appendText(absl::string_view text, bool escape,
+                         std::string &output);
+  // appends the value the way inja prints it, or returns false if inja may
+  // print it differently.
+  static bool appendValue(const nlohmann::json &value, bool escape,
+                          std::string &output);
+
+  std::vector<Op> ops_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
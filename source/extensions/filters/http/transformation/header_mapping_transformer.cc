@@ -0,0 +1,149 @@
+#include "source/extensions/filters/http/transformation/header_mapping_transformer.h"
+
+#include "source/extensions/filters/http/transformation/compiled_template.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+using TransformationTemplate =
+    envoy::api::v2::filter::http::TransformationTemplate;
+
+HeaderMappingTransformerConstSharedPtr
+HeaderMappingTransformer::create(const TransformationTemplate &transformation) {
+  if (!transformation.extractors().empty() ||
+      !transformation.dynamic_metadata_values().empty() ||
+      transformation.has_result_cache() ||
+      transformation.has_streaming_body() ||
+      transformation.body_base64() != TransformationTemplate::NoBase64) {
+    return nullptr;
+  }
+  // a body that is parsed fails the transformation when it isn't json.
+  switch (transformation.body_transformation_case()) {
+  case TransformationTemplate::kPassthrough:
+    break;
+  case TransformationTemplate::BODY_TRANSFORMATION_NOT_SET:
+    if (transformation.parse_body_behavior() !=
+        TransformationTemplate::DontParse) {
+      return nullptr;
+    }
+    break;
+  default:
+    return nullptr;
+  }
+
+  std::shared_ptr<HeaderMappingTransformer> transformer(
+      new HeaderMappingTransformer(transformation.has_passthrough(),
+                                   transformation.body_prefix_bytes()));
+  const bool advanced_templates = transformation.advanced_templates();
+  for (const auto &header : transformation.headers()) {
+    // escaped values are not the values of the headers they copy.
+    if (header.second.json_escape_expressions()) {
+      return nullptr;
+    }
+    absl::optional<Mapping> mapping =
+        lower(header.first, header.second.text(), advanced_templates);
+    if (!mapping.has_value()) {
+      return nullptr;
+    }
+    transformer->headers_.push_back(std::move(mapping.value()));
+  }
+  for (const std::string &name : transformation.headers_to_remove()) {
+    transformer->headers_to_remove_.emplace_back(name);
+  }
+  for (const auto &header : transformation.headers_to_append()) {
+    if (header.value().json_escape_expressions()) {
+      return nullptr;
+    }
+    absl::optional<Mapping> mapping =
+        lower(header.key(), header.value().text(), advanced_templates);
+    if (!mapping.has_value()) {
+      return nullptr;
+    }
+    transformer->headers_to_append_.push_back(std::move(mapping.value()));
+  }
+  return transformer;
+}
+
+absl::optional<HeaderMappingTransformer::Mapping>
+HeaderMappingTransformer::lower(const std::string &name,
+                                absl::string_view text,
+                                bool advanced_templates) {
+  const absl::optional<CompiledTemplate> compiled =
+      CompiledTemplate::compile(text, advanced_templates);
+  if (!compiled.has_value()) {
+    return absl::nullopt;
+  }
+  Mapping mapping(name);
+  if (const absl::optional<absl::string_view> constant =
+          compiled->constantText()) {
+    mapping.text_ = std::string(constant.value());
+  } else if (const Http::LowerCaseString *source = compiled->copiedHeader()) {
+    mapping.source_ = *source;
+  } else if (const Http::LowerCaseString *source =
+                 compiled->copiedRequestHeader()) {
+    mapping.source_ = *source;
+    mapping.from_request_ = true;
+  } else {
+    return absl::nullopt;
+  }
+  return mapping;
+}
+
+HeaderMappingTransformer::Mapping::Mapping(const std::string &name)
+    : name_(name), handles_(name_) {}
+
+absl::string_view HeaderMappingTransformer::Mapping::value(
+    const Http::RequestOrResponseHeaderMap &header_map,
+    const Http::RequestHeaderMap *request_headers, std::string &copy) const {
+  if (!source_.has_value()) {
+    return text_;
+  }
+  const Http::HeaderMap *source = &header_map;
+  if (from_request_) {
+    source = request_headers;
+    if (source == nullptr) {
+      return {};
+    }
+  }
+  const Http::HeaderMap::GetResult entries = source->get(source_.value());
+  if (entries.empty()) {
+    return {};
+  }
+  const absl::string_view value = entries[0]->value().getStringView();
+  if (source == &header_map && source_.value() == name_) {
+    copy.assign(value.data(), value.size());
+    return copy;
+  }
+  return value;
+}
+
+void HeaderMappingTransformer::transform(
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::RequestHeaderMap *request_headers, Buffer::Instance &,
+    Http::StreamFilterCallbacks &) const {
+  // each value is read after the headers before it are changed, like the
+  // templates the mappings were lowered from.
+  std::string copy;
+  for (const Mapping &header : headers_) {
+    header.handles_.set(header_map, header.name_,
+                        header.value(header_map, request_headers, copy));
+  }
+  for (const Http::LowerCaseString &name : headers_to_remove_) {
+    header_map.remove(name);
+  }
+  for (const Mapping &header : headers_to_append_) {
+    const absl::string_view value =
+        header.value(header_map, request_headers, copy);
+    if (!value.empty()) {
+      // don't remove headers that already exist.
+      header_map.addReferenceKey(header.name_, value);
+    }
+  }
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
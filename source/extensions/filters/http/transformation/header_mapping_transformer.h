@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/http/header_map.h"
+
+#include "source/extensions/filters/http/transformation/inline_header_handles.h"
+#include "source/extensions/filters/http/transformation/transformer.h"
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+#include "api/envoy/config/filter/http/transformation/v2/transformation_filter.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+class HeaderMappingTransformer;
+using HeaderMappingTransformerConstSharedPtr =
+    std::shared_ptr<const HeaderMappingTransformer>;
+
+/**
+ * A transformation template that only sets, removes and appends headers, with
+ * values that are either constant or copied from a header, e.g.
+ * `{{ header("x-a") }}`. The headers are changed directly, in the order the
+ * InjaTransformer renders them in, without rendering anything.
+ */
+class HeaderMappingTransformer : public Transformer {
+public:
+  /**
+   * @return the transformer that applies the template, or nullptr if the
+   * template does more than mapping headers, or could fail the transformation
+   * (e.g. by parsing the body). It must then be given to an InjaTransformer.
+   */
+  static HeaderMappingTransformerConstSharedPtr
+  create(const envoy::api::v2::filter::http::TransformationTemplate
+             &transformation);
+
+  void transform(Http::RequestOrResponseHeaderMap &header_map,
+                 Http::RequestHeaderMap *request_headers, Buffer::Instance &,
+                 Http::StreamFilterCallbacks &) const override;
+  bool passthrough_body() const override { return passthrough_body_; }
+  uint64_t body_prefix_bytes() const override { return body_prefix_bytes_; }
+
+private:
+  struct Mapping {
+    explicit Mapping(const std::string &name);
+
+    // the value of the header, which refers to the header maps or to text_.
+    // It is copied into copy when the header is copied from itself, as
+    // setting the header frees it.
+    absl::string_view value(const Http::RequestOrResponseHeaderMap &header_map,
+                            const Http::RequestHeaderMap *request_headers,
+                            std::string &copy) const;
+
+    Http::LowerCaseString name_;
+    InlineHeaderHandles handles_;
+    std::string text_;
+    // the header the value is copied from, if it isn't constant.
+    absl::optional<Http::LowerCaseString> source_;
+    bool from_request_{};
+  };
+
+  // the mapping of a header whose template is a constant or a single
+  // header() or request_header() call, or nullopt.
+  static absl::optional<Mapping> lower(const std::string &name,
+                                       absl::string_view text,
+                                       bool advanced_templates);
+
+  HeaderMappingTransformer(bool passthrough_body, uint64_t body_prefix_bytes)
+      : passthrough_body_(passthrough_body),
+        body_prefix_bytes_(body_prefix_bytes) {}
+
+  const bool passthrough_body_;
+  const uint64_t body_prefix_bytes_;
+  std::vector<Mapping> headers_;
+  std::vector<Http::LowerCaseString> headers_to_remove_;
+  std::vector<Mapping> headers_to_append_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
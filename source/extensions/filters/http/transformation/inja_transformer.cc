@@ -1,14 +1,32 @@
 #include "source/extensions/filters/http/transformation/inja_transformer.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iterator>
+#include <ostream>
+#include <streambuf>
 
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/buffer/buffer_utility.h"
+#include "source/common/common/cleanup.h"
+#include "source/common/common/hash.h"
 #include "source/common/common/macros.h"
 #include "source/common/common/regex.h"
 #include "source/common/common/utility.h"
 #include "source/common/config/metadata.h"
+#include "source/common/http/header_map_impl.h"
+#include "source/common/protobuf/utility.h"
+#include "source/common/stats/timespan_impl.h"
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
+#include "source/extensions/filters/http/transformation/body_base64.h"
+#include "source/extensions/filters/http/transformation/json_escape.h"
+#include "source/extensions/filters/http/transformation/shared_json_body.h"
 
 extern char **environ;
 
@@ -26,14 +44,79 @@ namespace Transformation {
 using TransformationTemplate =
     envoy::api::v2::filter::http::TransformationTemplate;
 
-struct BoolHeaderValues {
-  const std::string trueString = "true";
-  const std::string falseString = "false";
-};
-typedef ConstSingleton<BoolHeaderValues> BoolHeader;
-
 // TODO: move to common
 namespace {
+
+using Environment = std::unordered_map<std::string, std::string>;
+
+// the size a record of a streamed body can grow to, unless configured.
+constexpr uint32_t DefaultMaxRecordBytes = 1024 * 1024;
+
+// a stream buffer that appends to a string, so that the string can be
+// reserved before rendering into it, unlike the one of a std::ostringstream.
+class StringStreamBuffer : public std::streambuf {
+public:
+  explicit StringStreamBuffer(std::string &output) : output_(output) {}
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      output_.push_back(traits_type::to_char_type(ch));
+    }
+    return traits_type::not_eof(ch);
+  }
+  std::streamsize xsputn(const char *s, std::streamsize count) override {
+    output_.append(s, count);
+    return count;
+  }
+
+private:
+  std::string &output_;
+};
+
+// @return the position of the delimiter that closes a tag opened before
+// start, skipping the ones in the string literals of its expression.
+size_t closingDelimiter(absl::string_view text, size_t start,
+                        absl::string_view delimiter, bool literals) {
+  char quote = 0;
+  for (size_t i = start; i < text.size(); i++) {
+    const char c = text[i];
+    if (quote != 0) {
+      if (c == '\\') {
+        i++;
+      } else if (c == quote) {
+        quote = 0;
+      }
+    } else if (literals && (c == '"' || c == '\'')) {
+      quote = c;
+    } else if (text.substr(i, delimiter.size()) == delimiter) {
+      return i;
+    }
+  }
+  return absl::string_view::npos;
+}
+
+std::shared_ptr<const Environment> buildEnvironment() {
+  auto environment = std::make_shared<Environment>();
+  for (char **env = environ; *env != 0; env++) {
+    std::string current_env(*env);
+    size_t equals = current_env.find("=");
+    if (equals > 0) {
+      std::string key = current_env.substr(0, equals);
+      std::string value = current_env.substr(equals + 1);
+      (*environment)[key] = value;
+    }
+  }
+  return environment;
+}
+
+// the environment of the process, which is read once and shared by all the
+// transformers that can read any environment variable.
+const std::shared_ptr<const Environment> &processEnvironment() {
+  CONSTRUCT_ON_FIRST_USE(std::shared_ptr<const Environment>,
+                         buildEnvironment());
+}
+
 const Http::HeaderMap::GetResult
 getHeader(const Http::RequestOrResponseHeaderMap &header_map,
           const Http::LowerCaseString &key) {
@@ -48,19 +131,85 @@ getHeader(const Http::RequestOrResponseHeaderMap &header_map,
   return getHeader(header_map, lowerkey);
 }
 
+const Http::HeaderMap::GetResult
+getHeader(const Http::RequestOrResponseHeaderMap &header_map,
+          const std::string &key, const HeaderKeyMap *header_keys) {
+  if (header_keys != nullptr) {
+    auto it = header_keys->find(key);
+    if (it != header_keys->end()) {
+      return getHeader(header_map, it->second);
+    }
+  }
+  return getHeader(header_map, key);
+}
+
+// the first value of the header, which the memo of the context remembers when
+// the key of the header was resolved at config time.
+absl::string_view firstHeaderValue(
+    const Http::RequestOrResponseHeaderMap &header_map, const std::string &key,
+    const RenderContext &context) {
+  if (context.header_memo_ != nullptr && context.header_keys_ != nullptr) {
+    auto it = context.header_keys_->find(key);
+    if (it != context.header_keys_->end()) {
+      return context.header_memo_->get(header_map, it->second);
+    }
+  }
+  const Http::HeaderMap::GetResult header_entries =
+      getHeader(header_map, key, context.header_keys_);
+  if (header_entries.empty()) {
+    return "";
+  }
+  return header_entries[0]->value().getStringView();
+}
+
+// passes the slices of the body to the observer, when there is one.
+void observeBody(const Buffer::Instance &body,
+                 const Transformer::BodyObserver *observer) {
+  if (observer == nullptr) {
+    return;
+  }
+  for (const Buffer::RawSlice &slice : body.getRawSlices()) {
+    (*observer)(absl::string_view(static_cast<const char *>(slice.mem_),
+                                  slice.len_));
+  }
+}
+
 } // namespace
 
 Extractor::Extractor(const envoy::api::v2::filter::http::Extraction &extractor)
     : headername_(extractor.header()), body_(extractor.has_body()),
-      group_(extractor.subgroup()),
-      extract_regex_(Regex::Utility::parseStdRegex(extractor.regex())) {
-  // mark count == number of sub groups, and we need to add one for match number
-  // 0 so we test for < instead of <= see:
-  // http://www.cplusplus.com/reference/regex/basic_regex/mark_count/
-  if (extract_regex_.mark_count() < group_) {
+      group_(extractor.subgroup()) {
+  if (extractor.source_case() ==
+      envoy::api::v2::filter::http::Extraction::kJsonPointer) {
+    json_pointer_.emplace(extractor.json_pointer());
+    if (extractor.regex().empty()) {
+      if (group_ != 0) {
+        throw EnvoyException(fmt::format(
+            "group {} requested for a json pointer with no regex", group_));
+      }
+      return;
+    }
+  }
+  re2::RE2::Options options;
+  options.set_log_errors(false);
+  // match bytes, like std::regex does.
+  options.set_encoding(re2::RE2::Options::EncodingLatin1);
+  auto re2_regex = std::make_unique<const re2::RE2>(extractor.regex(), options);
+  unsigned int groups;
+  if (re2_regex->ok()) {
+    groups = re2_regex->NumberOfCapturingGroups();
+    re2_regex_ = std::move(re2_regex);
+  } else {
+    std_regex_.emplace(Regex::Utility::parseStdRegex(extractor.regex()));
+    // mark count == number of sub groups, and we need to add one for match
+    // number 0 so we test for < instead of <= see:
+    // http://www.cplusplus.com/reference/regex/basic_regex/mark_count/
+    groups = std_regex_->mark_count();
+  }
+  if (groups < group_) {
     throw EnvoyException(
         fmt::format("group {} requested for regex with only {} sub groups",
-                    group_, extract_regex_.mark_count()));
+                    group_, groups));
   }
 }
 
@@ -68,10 +217,17 @@ absl::string_view
 Extractor::extract(Http::StreamFilterCallbacks &callbacks,
                    const Http::RequestOrResponseHeaderMap &header_map,
                    GetBodyFunc &body) const {
-  if (body_) {
-    const std::string &string_body = body();
-    absl::string_view sv(string_body);
-    return extractValue(callbacks, sv);
+  if (json_pointer_.has_value()) {
+    const absl::optional<absl::string_view> value = json_pointer_->find(body());
+    if (!value.has_value()) {
+      ENVOY_STREAM_LOG(debug, "extractor json pointer found no value",
+                       callbacks);
+      return "";
+    }
+    return re2_regex_ || std_regex_ ? extractValue(callbacks, value.value())
+                                    : value.value();
+  } else if (body_) {
+    return extractValue(callbacks, body());
   } else {
     const Http::HeaderMap::GetResult header_entries = getHeader(header_map, headername_);
     if (header_entries.empty()) {
@@ -84,103 +240,138 @@ Extractor::extract(Http::StreamFilterCallbacks &callbacks,
 absl::string_view
 Extractor::extractValue(Http::StreamFilterCallbacks &callbacks,
                         absl::string_view value) const {
+  absl::optional<absl::string_view> result =
+      re2_regex_ ? matchRe2(value) : matchStdRegex(callbacks, value);
+  if (!result.has_value()) {
+    ENVOY_STREAM_LOG(debug, "extractor regex did not match input", callbacks);
+    return "";
+  }
+  return result.value();
+}
+
+absl::optional<absl::string_view>
+Extractor::matchRe2(absl::string_view value) const {
+  // only the groups up to the requested one need to be captured.
+  absl::InlinedVector<re2::StringPiece, 4> groups(group_ + 1);
+  if (!re2_regex_->Match(re2::StringPiece(value.data(), value.size()), 0,
+                         value.size(), re2::RE2::ANCHOR_BOTH, groups.data(),
+                         groups.size())) {
+    return absl::nullopt;
+  }
+  const re2::StringPiece &group = groups[group_];
+  return absl::string_view(group.data(), group.size());
+}
+
+absl::optional<absl::string_view>
+Extractor::matchStdRegex(Http::StreamFilterCallbacks &callbacks,
+                         absl::string_view value) const {
   // get and regex
   std::match_results<absl::string_view::const_iterator> regex_result;
-  if (std::regex_match(value.begin(), value.end(), regex_result,
-                       extract_regex_)) {
-    if (group_ >= regex_result.size()) {
-      // this should never happen as we test this in the ctor.
-      ASSERT("no such group in the regex");
-      ENVOY_STREAM_LOG(debug, "invalid group specified for regex", callbacks);
-      return "";
-    }
-    const auto &sub_match = regex_result[group_];
-    return absl::string_view(sub_match.first, sub_match.length());
-  } else {
-    ENVOY_STREAM_LOG(debug, "extractor regex did not match input", callbacks);
+  if (!std::regex_match(value.begin(), value.end(), regex_result,
+                        std_regex_.value())) {
+    return absl::nullopt;
   }
-  return "";
+  if (group_ >= regex_result.size()) {
+    // this should never happen as we test this in the ctor.
+    ASSERT("no such group in the regex");
+    ENVOY_STREAM_LOG(debug, "invalid group specified for regex", callbacks);
+    return absl::string_view();
+  }
+  const auto &sub_match = regex_result[group_];
+  return absl::string_view(sub_match.first, sub_match.length());
 }
 
-TransformerInstance::TransformerInstance(
-    const Http::RequestOrResponseHeaderMap &header_map,
-    const Http::RequestHeaderMap *request_headers, GetBodyFunc &body,
-    const std::unordered_map<std::string, absl::string_view> &extractions,
-    const json &context,
-    const std::unordered_map<std::string, std::string> &environ,
-    const envoy::config::core::v3::Metadata *cluster_metadata)
-    : header_map_(header_map), request_headers_(request_headers), body_(body),
-      extractions_(extractions), context_(context), environ_(environ),
-      cluster_metadata_(cluster_metadata) {
-  env_.add_callback("header", 1,
-                    [this](Arguments &args) { return header_callback(args); });
-  env_.add_callback("request_header", 1, [this](Arguments &args) {
+TransformerInstance::TransformerInstance() {
+  addCallback("header", 1,
+              [this](Arguments &args) { return header_callback(args); });
+  addCallback("request_header", 1, [this](Arguments &args) {
     return request_header_callback(args);
   });
-  env_.add_callback("extraction", 1, [this](Arguments &args) {
-    return extracted_callback(args);
-  });
-  env_.add_callback("context", 0, [this](Arguments &) { return context_; });
-  env_.add_callback("body", 0, [this](Arguments &) { return body_(); });
-  env_.add_callback("env", 1, [this](Arguments &args) { return env(args); });
-  env_.add_callback("clusterMetadata", 1, [this](Arguments &args) {
+  addCallback("extraction", 1,
+              [this](Arguments &args) { return extracted_callback(args); });
+  addCallback("context", 0, [this](Arguments &) { return context_->context_; });
+  addCallback("body", 0, [this](Arguments &) { return context_->body_(); });
+  addCallback("env", 1, [this](Arguments &args) { return env(args); });
+  addCallback("clusterMetadata", 1, [this](Arguments &args) {
     return cluster_metadata_callback(args);
   });
-  env_.add_callback("base64_encode", 1, [this](Arguments &args) {
-    return base64_encode_callback(args); 
+  addCallback("base64_encode", 1, [this](Arguments &args) {
+    return base64_encode_callback(args);
   });
-  env_.add_callback("base64_decode", 1, [this](Arguments &args) {
-    return base64_decode_callback(args); 
+  addCallback("base64_decode", 1, [this](Arguments &args) {
+    return base64_decode_callback(args);
   });
   // substring can be called with either two or three arguments --
   // the first argument is the string to be modified, the second is the start position
   // of the substring, and the optional third argument is the length of the substring.
   // If the third argument is not provided, the substring will extend to the end of the string.
-  env_.add_callback("substring", 2, [this](Arguments &args) {
-    return substring_callback(args); 
-  });
-  env_.add_callback("substring", 3, [this](Arguments &args) {
-    return substring_callback(args); 
-  });
+  addCallback("substring", 2,
+              [this](Arguments &args) { return substring_callback(args); });
+  addCallback("substring", 3,
+              [this](Arguments &args) { return substring_callback(args); });
+  // escapes a value to be printed between the quotes of a json string.
+  addCallback("json_escape", 1,
+              [this](Arguments &args) { return json_escape_callback(args); });
+}
+
+TransformerInstance::TransformerInstance(TimeSource &time_source)
+    : TransformerInstance() {
+  time_source_ = &time_source;
+}
+
+TransformerInstance &
+TransformerInstance::forThread(TimeSource *time_source) {
+  static thread_local TransformerInstance instance;
+  instance.time_source_ = time_source;
+  return instance;
+}
+
+void TransformerInstance::addCallback(
+    const std::string &name, int num_args,
+    std::function<json(inja::Arguments &)> callback) {
+  env_.add_callback(
+      name, num_args,
+      [this, name, callback = std::move(callback)](Arguments &args) -> json {
+        if (profile_ == nullptr) {
+          return callback(args);
+        }
+        const MonotonicTime start = time_source_->monotonicTime();
+        json result = callback(args);
+        profile_->addCallback(name, time_source_->monotonicTime() - start);
+        return result;
+      });
 }
 
 json TransformerInstance::header_callback(const inja::Arguments &args) const {
   const std::string &headername = args.at(0)->get_ref<const std::string &>();
-  const Http::HeaderMap::GetResult header_entries = getHeader(header_map_, headername);
-  if (header_entries.empty()) {
-    return "";
-  }
-  return std::string(header_entries[0]->value().getStringView());
+  return std::string(
+      firstHeaderValue(context_->header_map_, headername, *context_));
 }
 
 json TransformerInstance::request_header_callback(
     const inja::Arguments &args) const {
-  if (request_headers_ == nullptr) {
+  if (context_->request_headers_ == nullptr) {
     return "";
   }
   const std::string &headername = args.at(0)->get_ref<const std::string &>();
-  const Http::HeaderMap::GetResult header_entries =
-      getHeader(*request_headers_, headername);
-  if (header_entries.empty()) {
-    return "";
-  }
-  return std::string(header_entries[0]->value().getStringView());
+  return std::string(
+      firstHeaderValue(*context_->request_headers_, headername, *context_));
 }
 
 json TransformerInstance::extracted_callback(
     const inja::Arguments &args) const {
   const std::string &name = args.at(0)->get_ref<const std::string &>();
-  const auto value_it = extractions_.find(name);
-  if (value_it != extractions_.end()) {
-    return value_it->second;
+  const absl::optional<size_t> slot = context_->extractions_.slot(name);
+  if (slot.has_value()) {
+    return context_->extractions_.value(slot.value());
   }
   return "";
 }
 
 json TransformerInstance::env(const inja::Arguments &args) const {
   const std::string &key = args.at(0)->get_ref<const std::string &>();
-  auto it = environ_.find(key);
-  if (it != environ_.end()) {
+  auto it = context_->environ_.find(key);
+  if (it != context_->environ_.end()) {
     return it->second;
   }
   return "";
@@ -190,74 +381,18 @@ json TransformerInstance::cluster_metadata_callback(
     const inja::Arguments &args) const {
   const std::string &key = args.at(0)->get_ref<const std::string &>();
 
-  if (!cluster_metadata_) {
-    return "";
-  }
-
-  const ProtobufWkt::Value &value = Envoy::Config::Metadata::metadataValue(
-      cluster_metadata_, SoloHttpFilterNames::get().Transformation, key);
-
-  switch (value.kind_case()) {
-  case ProtobufWkt::Value::kStringValue: {
-    return value.string_value();
-    break;
+  if (context_->cluster_metadata_values_ != nullptr) {
+    const json *value = context_->cluster_metadata_values_->find(key);
+    return value == nullptr ? json("") : *value;
   }
-  case ProtobufWkt::Value::kNumberValue: {
-    return value.number_value();
-    break;
-  }
-  case ProtobufWkt::Value::kBoolValue: {
-    const std::string &stringval = value.bool_value()
-                                       ? BoolHeader::get().trueString
-                                       : BoolHeader::get().falseString;
-    return stringval;
-    break;
+  if (!context_->cluster_metadata_) {
+    return "";
   }
-  case ProtobufWkt::Value::kListValue: {
-    const auto &listval = value.list_value().values();
-    if (listval.size() == 0) {
-      break;
-    }
-
-    // size is not zero, so this will work
-    auto it = listval.begin();
-    std::stringstream ss;
 
-    auto addValue = [&ss, &it] {
-      const ProtobufWkt::Value &value = *it;
-
-      switch (value.kind_case()) {
-      case ProtobufWkt::Value::kStringValue: {
-        ss << value.string_value();
-        break;
-      }
-      case ProtobufWkt::Value::kNumberValue: {
-        ss << value.number_value();
-        break;
-      }
-      case ProtobufWkt::Value::kBoolValue: {
-        ss << (value.bool_value() ? BoolHeader::get().trueString
-                                  : BoolHeader::get().falseString);
-        break;
-      }
-      default:
-        break;
-      }
-    };
-
-    addValue();
-
-    for (it++; it != listval.end(); it++) {
-      ss << ",";
-      addValue();
-    }
-    return ss.str();
-  }
-  default: {
-    break;
-  }
-  }
-  return "";
+  // the cluster was created without the converted values.
+  return ClusterMetadataValues::toJson(Envoy::Config::Metadata::metadataValue(
+      context_->cluster_metadata_, SoloHttpFilterNames::get().Transformation,
+      key));
 }
 
 json TransformerInstance::base64_encode_callback(const inja::Arguments &args) const {
@@ -313,40 +448,270 @@ json TransformerInstance::substring_callback(const inja::Arguments &args) const
   return input.substr(start, substring_len);
 }
 
-std::string TransformerInstance::render(const inja::Template &input) {
+json TransformerInstance::json_escape_callback(
+    const inja::Arguments &args) const {
+  const json &value = *args.at(0);
+  std::string escaped;
+  // other values are escaped as the json text inja prints them as.
+  appendJsonEscaped(escaped, value.is_string()
+                                 ? value.get_ref<const std::string &>()
+                                 : value.dump());
+  return escaped;
+}
+
+std::string TransformerInstance::render(const inja::Template &input,
+                                        const RenderContext &context,
+                                        absl::string_view template_name,
+                                        size_t size_hint) {
+  std::string output;
+  output.reserve(size_hint);
+  StringStreamBuffer stream_buffer(output);
+  std::ostream stream(&stream_buffer);
+  renderTo(stream, input, context, template_name);
+  return output;
+}
+
+void TransformerInstance::renderTo(Buffer::Instance &output,
+                                   const inja::Template &input,
+                                   const RenderContext &context,
+                                   absl::string_view template_name,
+                                   const Transformer::BodyObserver *observer) {
+  Buffer::BufferOutputStream stream(output, observer);
+  renderTo(stream, input, context, template_name);
+}
+
+void TransformerInstance::renderTo(std::ostream &output,
+                                   const inja::Template &input,
+                                   const RenderContext &context,
+                                   absl::string_view template_name) {
+  context_ = &context;
+  Cleanup unbind([this] { context_ = nullptr; });
+  TemplateProfiler &profiler = TemplateProfiler::get();
+  if (time_source_ == nullptr || !profiler.shouldSample(render_count_++)) {
+    renderJson(output, input, context);
+    return;
+  }
+
+  TemplateProfiler::RenderProfile profile;
+  profile_ = &profile;
+  Cleanup unset_profile([this] { profile_ = nullptr; });
+  const MonotonicTime start = time_source_->monotonicTime();
+  renderJson(output, input, context);
+  profiler.record(template_name, time_source_->monotonicTime() - start,
+                  profile);
+}
+
+void TransformerInstance::renderJson(std::ostream &output,
+                                     const inja::Template &input,
+                                     const RenderContext &context) {
   // inja can't handle context that are not objects correctly, so we give it an
   // empty object in that case
-  if (context_.is_object()) {
-    return env_.render(input, context_);
+  if (context.context_.is_object()) {
+    env_.render_to(output, input, context.context_);
   } else {
-    return env_.render(input, {});
+    env_.render_to(output, input, {});
+  }
+}
+
+ParsedTemplate::ParsedTemplate(absl::string_view text, bool advanced_templates,
+                               const ExtractionSlots *extraction_slots)
+    : parsed_(TemplateCache::get().parse(text, advanced_templates)),
+      compiled_(CompiledTemplate::compile(text, advanced_templates,
+                                          extraction_slots)) {}
+
+ParsedTemplate::ParsedTemplate(
+    const envoy::api::v2::filter::http::InjaTemplate &inja_template,
+    bool advanced_templates, const ExtractionSlots *extraction_slots)
+    : ParsedTemplate(inja_template.json_escape_expressions()
+                         ? jsonEscapeExpressions(inja_template.text())
+                         : inja_template.text(),
+                     advanced_templates, extraction_slots) {}
+
+std::string ParsedTemplate::jsonEscapeExpressions(absl::string_view text) {
+  std::string escaped;
+  escaped.reserve(text.size());
+  size_t pos = 0;
+  while (pos < text.size()) {
+    const size_t open = text.find('{', pos);
+    if (open == absl::string_view::npos || open + 1 == text.size()) {
+      break;
+    }
+    const char kind = text[open + 1];
+    if (kind != '{' && kind != '%' && kind != '#') {
+      escaped.append(text.data() + pos, open + 1 - pos);
+      pos = open + 1;
+      continue;
+    }
+    const absl::string_view close = kind == '{'   ? "}}"
+                                    : kind == '%' ? "%}"
+                                                  : "#}";
+    const size_t start = open + 2;
+    const size_t end = closingDelimiter(text, start, close, kind != '#');
+    if (end == absl::string_view::npos) {
+      // inja reports the unterminated tag.
+      break;
+    }
+    escaped.append(text.data() + pos, start - pos);
+    absl::string_view inner = text.substr(start, end - start);
+    if (kind == '{' && !absl::StripAsciiWhitespace(inner).empty()) {
+      // whitespace control stays outside of the call.
+      const bool strip_before = absl::ConsumePrefix(&inner, "-");
+      const bool strip_after = absl::ConsumeSuffix(&inner, "-");
+      absl::StrAppend(&escaped, strip_before ? "-" : "", " json_escape(",
+                      absl::StripAsciiWhitespace(inner), ") ",
+                      strip_after ? "-" : "");
+    } else {
+      escaped.append(inner.data(), inner.size());
+    }
+    escaped.append(close.data(), close.size());
+    pos = end + close.size();
+  }
+  escaped.append(text.data() + pos, text.size() - pos);
+  return escaped;
+}
+
+bool ParsedTemplate::dependsOnRequest(
+    const TemplateDependencies &dependencies) {
+  // without variables the json context can only be read through these
+  // functions, and the rest of the request only through the callbacks.
+  static constexpr absl::string_view request_functions[] = {
+      "context",    "exists",         "existsIn", "header",
+      "extraction", "request_header", "body",     "clusterMetadata"};
+  if (!dependencies.variables().empty()) {
+    return true;
+  }
+  for (absl::string_view function : request_functions) {
+    if (dependencies.callsFunction(function)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParsedTemplate::precompute(TransformerInstance &instance,
+                                const RenderContext &context) {
+  if (dependsOnRequest(dependencies())) {
+    return;
+  }
+  try {
+    constant_output_.emplace(instance.render(parsed_->template_, context));
+  } catch (const std::exception &) {
+    // leave it to fail when rendered for a request, as it did before.
+  }
+}
+
+std::string ParsedTemplate::render(TransformerInstance &instance,
+                                   const RenderContext &context) const {
+  if (constant_output_.has_value()) {
+    return constant_output_.value();
+  }
+  const size_t size_hint = output_size_.get();
+  std::string output;
+  bool rendered = false;
+  if (compiled_.has_value()) {
+    output.reserve(size_hint);
+    rendered = renderCompiled(instance, context, output);
+  }
+  if (!rendered) {
+    output = instance.render(parsed_->template_, context, parsed_->name_,
+                             size_hint);
   }
+  output_size_.record(output.size());
+  return output;
 }
 
-InjaTransformer::InjaTransformer(const TransformationTemplate &transformation)
+void ParsedTemplate::renderTo(TransformerInstance &instance,
+                              Buffer::Instance &output,
+                              const RenderContext &context,
+                              const Transformer::BodyObserver *observer) const {
+  if (constant_output_.has_value()) {
+    if (observer != nullptr) {
+      (*observer)(constant_output_.value());
+    }
+    output.add(constant_output_.value());
+    return;
+  }
+  if (compiled_.has_value()) {
+    std::string rendered;
+    rendered.reserve(output_size_.get());
+    if (renderCompiled(instance, context, rendered)) {
+      output_size_.record(rendered.size());
+      if (observer != nullptr) {
+        (*observer)(rendered);
+      }
+      output.add(rendered);
+      return;
+    }
+  }
+  // the buffer grows by adding slices, which doesn't copy what was already
+  // rendered, so there is nothing to reserve.
+  instance.renderTo(output, parsed_->template_, context, parsed_->name_,
+                    observer);
+}
+
+bool ParsedTemplate::renderCompiled(TransformerInstance &instance,
+                                    const RenderContext &context,
+                                    std::string &output) const {
+  if (!instance.shouldShadow()) {
+    return compiled_->render(context, output);
+  }
+  TimeSource &time_source = *instance.timeSource();
+  const MonotonicTime start = time_source.monotonicTime();
+  if (!compiled_->render(context, output)) {
+    // inja renders it for the request, so there is nothing to compare.
+    return false;
+  }
+  const MonotonicTime compiled_end = time_source.monotonicTime();
+  bool matched;
+  try {
+    matched = instance.render(parsed_->template_, context, parsed_->name_,
+                              output.size()) == output;
+  } catch (const std::exception &) {
+    matched = false;
+  }
+  TemplateShadow::get().record(parsed_->name_, matched, compiled_end - start,
+                               time_source.monotonicTime() - compiled_end);
+  return true;
+}
+
+InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
+                                 absl::optional<InjaTransformerStats> stats,
+                                 absl::optional<ResultCacheStats> result_cache_stats)
     : advanced_templates_(transformation.advanced_templates()),
       passthrough_body_(transformation.has_passthrough()),
+      async_body_threshold_(transformation.async_body_threshold()),
+      body_prefix_bytes_(transformation.body_prefix_bytes()),
+      body_base64_(transformation.body_base64()),
       parse_body_behavior_(transformation.parse_body_behavior()),
-      ignore_error_on_parse_(transformation.ignore_error_on_parse()) {
-  inja::ParserConfig parser_config;
-  inja::LexerConfig lexer_config;
-  inja::TemplateStorage template_storage;
-  if (!advanced_templates_) {
-    parser_config.notation = inja::ElementNotation::Dot;
-  }
+      ignore_error_on_parse_(transformation.ignore_error_on_parse()),
+      stats_(std::move(stats)) {
 
-  inja::Parser parser(parser_config, lexer_config, template_storage);
+  TemplateDependencies dependencies;
 
   const auto &extractors = transformation.extractors();
   for (auto it = extractors.begin(); it != extractors.end(); it++) {
     extractors_.emplace_back(std::make_pair(it->first, it->second));
+    if (advanced_templates_) {
+      extraction_slots_.emplace(it->first, extractors_.size() - 1);
+    } else {
+      extractor_paths_.push_back(absl::StrSplit(it->first, '.'));
+    }
+  }
+  for (size_t i = 0; i < extractor_paths_.size(); i++) {
+    if (!addExtractionPath(extraction_tree_, extractor_paths_[i], i)) {
+      extraction_tree_.clear();
+      break;
+    }
   }
   const auto &headers = transformation.headers();
   for (auto it = headers.begin(); it != headers.end(); it++) {
     Http::LowerCaseString header_name(it->first);
     try {
-      headers_.emplace_back(std::make_pair(std::move(header_name),
-                                           parser.parse(it->second.text())));
+      header_handles_.emplace_back(header_name);
+      headers_.emplace_back(
+          std::move(header_name),
+          ParsedTemplate(it->second, advanced_templates_, &extraction_slots_));
+      dependencies.merge(headers_.back().second.dependencies());
     } catch (const std::exception &e) {
       throw EnvoyException(fmt::format(
           "Failed to parse header template '{}': {}", it->first, e.what()));
@@ -367,8 +732,10 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation)
     const auto &it = headers_to_append.Get(idx);
     Http::LowerCaseString header_name(it.key());
     try {
-      headers_to_append_.emplace_back(std::make_pair(std::move(header_name),
-                                           parser.parse(it.value().text())));
+      headers_to_append_.emplace_back(
+          std::move(header_name),
+          ParsedTemplate(it.value(), advanced_templates_, &extraction_slots_));
+      dependencies.merge(headers_to_append_.back().second.dependencies());
     } catch (const std::exception &e) {
       throw EnvoyException(fmt::format(
           "Failed to parse header template '{}': {}", it.key(), e.what()));
@@ -376,18 +743,27 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation)
   }
   const auto &dynamic_metadata_values =
       transformation.dynamic_metadata_values();
+  // the namespaces are kept in the order they first appear in.
+  absl::flat_hash_map<std::string, size_t> namespace_indexes;
   for (auto it = dynamic_metadata_values.begin();
        it != dynamic_metadata_values.end(); it++) {
     try {
-      DynamicMetadataValue dynamicMetadataValue;
-      dynamicMetadataValue.namespace_ = it->metadata_namespace();
-      if (dynamicMetadataValue.namespace_.empty()) {
-        dynamicMetadataValue.namespace_ =
-            SoloHttpFilterNames::get().Transformation;
+      std::string metadata_namespace = it->metadata_namespace();
+      if (metadata_namespace.empty()) {
+        metadata_namespace = SoloHttpFilterNames::get().Transformation;
+      }
+      dynamic_metadata_.push_back(DynamicMetadataValue{
+          it->key(), ParsedTemplate(it->value(), advanced_templates_,
+                                    &extraction_slots_)});
+      dependencies.merge(dynamic_metadata_.back().template_.dependencies());
+      auto inserted = namespace_indexes.emplace(
+          metadata_namespace, dynamic_metadata_namespaces_.size());
+      if (inserted.second) {
+        dynamic_metadata_namespaces_.push_back(
+            DynamicMetadataNamespace{std::move(metadata_namespace), {}});
       }
-      dynamicMetadataValue.key_ = it->key();
-      dynamicMetadataValue.template_ = parser.parse(it->value().text());
-      dynamic_metadata_.emplace_back(std::move(dynamicMetadataValue));
+      dynamic_metadata_namespaces_[inserted.first->second].values_.push_back(
+          dynamic_metadata_.size() - 1);
     } catch (const std::exception &e) {
       throw EnvoyException(fmt::format(
           "Failed to parse header template '{}': {}", it->key(), e.what()));
@@ -397,7 +773,9 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation)
   switch (transformation.body_transformation_case()) {
   case TransformationTemplate::kBody: {
     try {
-      body_template_.emplace(parser.parse(transformation.body().text()));
+      body_template_.emplace(transformation.body(), advanced_templates_,
+                             &extraction_slots_);
+      dependencies.merge(body_template_->dependencies());
     } catch (const std::exception &e) {
       throw EnvoyException(
           fmt::format("Failed to parse body template {}", e.what()));
@@ -415,152 +793,989 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation)
   }
   }
 
-  // parse environment
-  for (char **env = environ; *env != 0; env++) {
-    std::string current_env(*env);
-    size_t equals = current_env.find("=");
-    if (equals > 0) {
-      std::string key = current_env.substr(0, equals);
-      std::string value = current_env.substr(equals + 1);
-      environ_[key] = value;
+  if (transformation.has_streaming_body()) {
+    if (transformation.body_transformation_case() !=
+        TransformationTemplate::kBody) {
+      throw EnvoyException("a transformation with a streaming_body must set "
+                           "the body template");
+    }
+    streaming_format_ = transformation.streaming_body().format();
+    max_record_bytes_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+        transformation.streaming_body(), max_record_bytes,
+        DefaultMaxRecordBytes);
+  }
+
+  // only the prefix of the body goes through the transformation, so it can't
+  // be replaced, nor parsed as json.
+  if (body_prefix_bytes_ != 0) {
+    if (transformation.body_transformation_case() !=
+        TransformationTemplate::BODY_TRANSFORMATION_NOT_SET) {
+      throw EnvoyException(
+          "a transformation with body_prefix_bytes can't set the body");
+    }
+    if (parse_body_behavior_ != TransformationTemplate::DontParse) {
+      throw EnvoyException("a transformation with body_prefix_bytes must not "
+                           "parse the body");
+    }
+  }
+
+  if (body_base64_ != TransformationTemplate::NoBase64) {
+    if (passthrough_body_ || body_prefix_bytes_ != 0 ||
+        streaming_format_.has_value()) {
+      throw EnvoyException("body_base64 needs the whole body, it can't be "
+                           "combined with passthrough, body_prefix_bytes or "
+                           "streaming_body");
+    }
+  }
+
+  // merging extractors to the body renders the whole json context.
+  if (!merged_extractors_to_body_) {
+    if (!readsBody(dependencies)) {
+      body_parser_ = JsonBodyParser::validateOnly();
+    } else if (!dependencies.callsFunction("context")) {
+      body_parser_ = JsonBodyParser::referencedKeys(
+          dependencies.topLevelVariables(advanced_templates_));
+    }
+  }
+
+  for (absl::string_view function : {"header", "request_header"}) {
+    for (const std::string &name : dependencies.literalArguments(function)) {
+      header_keys_.emplace(name, Http::LowerCaseString(name));
+    }
+  }
+
+  if (transformation.has_result_cache()) {
+    // the cache key has the values of all the headers the templates can read.
+    for (absl::string_view function : {"header", "request_header"}) {
+      if (dependencies.callsWithDynamicArguments(function)) {
+        throw EnvoyException(fmt::format(
+            "a transformation with a result cache can only call {}() with a "
+            "string literal",
+            function));
+      }
+    }
+    if (dependencies.callsFunction("clusterMetadata")) {
+      throw EnvoyException(
+          "a transformation with a result cache can't read cluster metadata");
+    }
+    absl::flat_hash_set<std::string> cache_headers(
+        dependencies.literalArguments("header").begin(),
+        dependencies.literalArguments("header").end());
+    for (const auto &named_extractor : extractors) {
+      if (named_extractor.second.source_case() ==
+          envoy::api::v2::filter::http::Extraction::kHeader) {
+        cache_headers.emplace(named_extractor.second.header());
+      }
+    }
+    for (const std::string &name : cache_headers) {
+      cache_headers_.emplace_back(name);
+    }
+    for (const std::string &name :
+         dependencies.literalArguments("request_header")) {
+      cache_request_headers_.emplace_back(name);
+    }
+    const auto &result_cache = transformation.result_cache();
+    result_cache_ = std::make_unique<ResultCache>(
+        result_cache.max_entries(), result_cache.max_bytes(),
+        std::move(result_cache_stats));
+  }
+
+  // keep only the environment variables the templates ask for by name.
+  if (dependencies.readsAnyEnvironmentVariable()) {
+    environ_ = processEnvironment();
+  } else {
+    auto environment = std::make_shared<Environment>();
+    for (const std::string &name : dependencies.environmentVariables()) {
+      const char *value = std::getenv(name.c_str());
+      if (value != nullptr) {
+        environment->emplace(name, value);
+      }
     }
+    environ_ = std::move(environment);
+  }
+
+  // render the templates that don't depend on the request now, so that their
+  // output can be reused.
+  TransformerInstance instance;
+  auto empty_headers = Http::RequestHeaderMapImpl::create();
+  GetBodyFunc empty_body = [] { return absl::string_view(); };
+  const Extractions no_extractions;
+  const json empty_context;
+  const RenderContext context{*empty_headers, nullptr, empty_body,
+                              no_extractions, empty_context, *environ_,
+                              nullptr};
+  for (auto &header : headers_) {
+    header.second.precompute(instance, context);
+  }
+  for (auto &header : headers_to_append_) {
+    header.second.precompute(instance, context);
+  }
+  for (auto &dynamic_metadata : dynamic_metadata_) {
+    dynamic_metadata.template_.precompute(instance, context);
+  }
+  if (body_template_.has_value()) {
+    body_template_->precompute(instance, context);
   }
 }
 
 InjaTransformer::~InjaTransformer() {}
 
-void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
-                                Http::RequestHeaderMap *request_headers,
-                                Buffer::Instance &body,
-                                Http::StreamFilterCallbacks &callbacks) const {
-  absl::optional<std::string> string_body;
-  GetBodyFunc get_body = [&string_body, &body]() -> const std::string & {
-    if (!string_body.has_value()) {
-      string_body.emplace(body.toString());
+InjaTransformerStats
+InjaTransformer::generateStats(const std::string &prefix,
+                               Stats::Scope &scope) {
+  const std::string final_prefix = prefix + "transformation.inja.";
+  return {
+      ALL_INJA_TRANSFORMER_STATS(POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
+}
+
+std::vector<absl::string_view>
+InjaTransformer::templateSources(const TransformationTemplate &transformation) {
+  std::vector<absl::string_view> sources;
+  for (const auto &header : transformation.headers()) {
+    sources.push_back(header.second.text());
+  }
+  for (const auto &header : transformation.headers_to_append()) {
+    sources.push_back(header.value().text());
+  }
+  for (const auto &value : transformation.dynamic_metadata_values()) {
+    sources.push_back(value.value().text());
+  }
+  if (transformation.has_body()) {
+    sources.push_back(transformation.body().text());
+  }
+  return sources;
+}
+
+Stats::CompletableTimespanPtr
+InjaTransformer::startTimer(
+    Stats::Histogram &(*histogram)(const InjaTransformerStats &),
+    Http::StreamFilterCallbacks &callbacks) const {
+  if (!stats_.has_value()) {
+    return nullptr;
+  }
+  return std::make_unique<Stats::HistogramCompletableTimespanImpl>(
+      histogram(*stats_), callbacks.dispatcher().timeSource());
+}
+
+bool InjaTransformer::readsBody(
+    const TemplateDependencies &dependencies) const {
+  if (dependencies.callsFunction("context")) {
+    return true;
+  }
+  for (const auto &variable : dependencies.variables()) {
+    // with dot notation an extractor is stored in the json context under its
+    // name, so reading it doesn't read the body.
+    const bool is_extractor =
+        !advanced_templates_ &&
+        std::any_of(extractors_.begin(), extractors_.end(),
+                    [&variable](const auto &named_extractor) {
+                      return named_extractor.first == variable;
+                    });
+    if (!is_extractor) {
+      return true;
     }
-    return string_body.value();
-  };
+  }
+  return false;
+}
 
-  json json_body;
+bool InjaTransformer::shouldParseBody(uint64_t body_length) const {
+  // TODO: gate this under a parse_body boolean
+  return parse_body_behavior_ == TransformationTemplate::ParseAsJson &&
+         body_length > 0;
+}
 
-  if (parse_body_behavior_ != TransformationTemplate::DontParse &&
-      body.length() > 0) {
-    const std::string &bodystring = get_body();
-    // parse the body as json
-    // TODO: gate this under a parse_body boolean
-    if (parse_body_behavior_ == TransformationTemplate::ParseAsJson) {
-      if (ignore_error_on_parse_) {
-        try {
-          json_body = json::parse(bodystring);
-        } catch (const std::exception &) {
-        }
-      } else {
-        json_body = json::parse(bodystring);
-      }
-    } else {
-      ASSERT("missing behavior");
+bool InjaTransformer::parsesJsonBody() const {
+  return parse_body_behavior_ == TransformationTemplate::ParseAsJson &&
+         !passthrough_body_;
+}
+
+SharedJsonBody::JsonSharedPtr
+InjaTransformer::parseBody(absl::string_view body,
+                           Http::StreamFilterCallbacks &callbacks,
+                           json &json_body) const {
+  StreamInfo::FilterState &filter_state =
+      *callbacks.streamInfo().filterState();
+  if (!SharedJsonBody::expected(filter_state)) {
+    json_body = body_parser_.parse(body, ignore_error_on_parse_);
+    return nullptr;
+  }
+
+  // with dot notation the extractions are added to the json context, which
+  // then needs its own document.
+  const bool changes_context = !advanced_templates_ && !extractors_.empty();
+  const SharedJsonBody::Version version = SharedJsonBody::version(body);
+  SharedJsonBody::JsonSharedPtr shared =
+      SharedJsonBody::find(filter_state, version);
+  if (shared != nullptr) {
+    if (!body_parser_.parsesWholeBody()) {
+      json_body = body_parser_.fromParsed(*shared);
+      return nullptr;
     }
+    if (changes_context) {
+      json_body = *shared;
+      return nullptr;
+    }
+    return shared;
   }
-  // get the extractions
-  std::unordered_map<std::string, absl::string_view> extractions;
-  if (advanced_templates_) {
-    extractions.reserve(extractors_.size());
+
+  json parsed = body_parser_.parse(body, ignore_error_on_parse_);
+  // only the whole document can be used by the other parsers, and it is not
+  // copied to be shared.
+  if (!body_parser_.parsesWholeBody() || changes_context) {
+    json_body = std::move(parsed);
+    return nullptr;
+  }
+  if (parsed.is_null()) {
+    return nullptr;
   }
+  auto parsed_body = std::make_shared<const json>(std::move(parsed));
+  SharedJsonBody::store(filter_state, version, parsed_body);
+  return parsed_body;
+}
 
+std::vector<absl::string_view>
+InjaTransformer::extract(Http::StreamFilterCallbacks &callbacks,
+                         const Http::RequestOrResponseHeaderMap &header_map,
+                         GetBodyFunc &get_body) const {
+  std::vector<absl::string_view> values;
+  values.reserve(extractors_.size());
   for (const auto &named_extractor : extractors_) {
-    const std::string &name = named_extractor.first;
-    if (advanced_templates_) {
-      extractions[name] =
-          named_extractor.second.extract(callbacks, header_map, get_body);
-    } else {
-      absl::string_view name_to_split = name;
+    values.push_back(
+        named_extractor.second.extract(callbacks, header_map, get_body));
+  }
+  return values;
+}
+
+Extractions InjaTransformer::addExtractions(
+    const std::vector<absl::string_view> &values, json &json_body) const {
+  ASSERT(values.size() == extractors_.size());
+  if (advanced_templates_) {
+    return Extractions(extraction_slots_, values);
+  }
+  if (!extraction_tree_.empty()) {
+    addExtractions(extraction_tree_, values, json_body);
+  } else {
+    for (size_t i = 0; i < extractors_.size(); i++) {
       json *current = &json_body;
-      for (size_t pos = name_to_split.find("."); pos != std::string::npos;
-           pos = name_to_split.find(".")) {
-        auto &&field_name = name_to_split.substr(0, pos);
-        current = &(*current)[std::string(field_name)];
-        name_to_split = name_to_split.substr(pos + 1);
+      for (const std::string &field_name : extractor_paths_[i]) {
+        current = &(*current)[field_name];
       }
-      (*current)[std::string(name_to_split)] =
-          named_extractor.second.extract(callbacks, header_map, get_body);
+      *current = values[i];
     }
   }
+  return Extractions();
+}
 
-  // get cluster metadata
-  const envoy::config::core::v3::Metadata *cluster_metadata{};
-  Upstream::ClusterInfoConstSharedPtr ci = callbacks.clusterInfo();
-  if (ci.get()) {
-    cluster_metadata = &ci->metadata();
+void InjaTransformer::addExtractions(
+    const std::vector<ExtractionNode> &nodes,
+    const std::vector<absl::string_view> &values, json &parent) {
+  for (const ExtractionNode &node : nodes) {
+    json &child = parent[node.key_];
+    if (node.extractor_.has_value()) {
+      child = values[node.extractor_.value()];
+    } else {
+      addExtractions(node.children_, values, child);
+    }
   }
+}
 
-  // start transforming!
-  TransformerInstance instance(header_map, request_headers, get_body,
-                               extractions, json_body, environ_,
-                               cluster_metadata);
+bool InjaTransformer::addExtractionPath(std::vector<ExtractionNode> &nodes,
+                                        const std::vector<std::string> &path,
+                                        size_t extractor) {
+  std::vector<ExtractionNode> *children = &nodes;
+  for (size_t depth = 0; depth < path.size(); depth++) {
+    const bool leaf = depth + 1 == path.size();
+    auto it = std::find_if(children->begin(), children->end(),
+                           [&path, depth](const ExtractionNode &node) {
+                             return node.key_ == path[depth];
+                           });
+    if (it == children->end()) {
+      children->push_back(ExtractionNode{path[depth], {}, {}});
+      it = children->end() - 1;
+    } else if (leaf || it->extractor_.has_value()) {
+      // one path is a prefix of the other, so the order of the extractors
+      // matters.
+      return false;
+    }
+    if (leaf) {
+      it->extractor_ = extractor;
+    }
+    children = &it->children_;
+  }
+  return true;
+}
 
-  // Body transform:
-  absl::optional<Buffer::OwnedImpl> maybe_body;
+RenderContext InjaTransformer::makeContext(
+    const Http::RequestOrResponseHeaderMap &header_map,
+    const Http::RequestHeaderMap *request_headers, GetBodyFunc &get_body,
+    const Extractions &extractions, const json &json_body,
+    const Upstream::ClusterInfo *cluster_info, HeaderMemo *header_memo) const {
+  const envoy::config::core::v3::Metadata *cluster_metadata{};
+  const ClusterMetadataValues *cluster_metadata_values{};
+  if (cluster_info != nullptr) {
+    cluster_metadata = &cluster_info->metadata();
+    cluster_metadata_values =
+        cluster_info->typedMetadata().get<ClusterMetadataValues>(
+            SoloHttpFilterNames::get().Transformation);
+  }
+  return RenderContext{header_map,       request_headers, get_body,
+                       extractions,      json_body,       *environ_,
+                       cluster_metadata, &header_keys_,
+                       cluster_metadata_values, header_memo};
+}
 
+void InjaTransformer::renderBody(TransformerInstance &instance,
+                                 const RenderContext &context,
+                                 const json &json_body,
+                                 const Buffer::Instance &body,
+                                 absl::optional<Buffer::OwnedImpl> &output,
+                                 const BodyObserver *observer) const {
+  // the coded body is observed once it is coded.
+  const bool coded = body_base64_ != TransformationTemplate::NoBase64;
+  const BodyObserver *render_observer = coded ? nullptr : observer;
   if (body_template_.has_value()) {
-    std::string output = instance.render(body_template_.value());
-    maybe_body.emplace(output);
+    output.emplace();
+    body_template_->renderTo(instance, output.value(), context,
+                             render_observer);
   } else if (merged_extractors_to_body_) {
-    std::string output = json_body.dump();
-    maybe_body.emplace(output);
+    std::string rendered = json_body.dump();
+    if (render_observer != nullptr) {
+      (*render_observer)(rendered);
+    }
+    output.emplace(rendered);
+  }
+
+  if (!coded) {
+    return;
+  }
+  // the original body is left as is, as the headers are rendered with it.
+  Buffer::OwnedImpl rendered;
+  const Buffer::Instance *input = &body;
+  if (output.has_value()) {
+    rendered.move(output.value());
+    input = &rendered;
+  } else {
+    output.emplace();
   }
+  if (body_base64_ == TransformationTemplate::EncodeBase64) {
+    base64EncodeBody(*input, output.value());
+  } else {
+    base64DecodeBody(*input, output.value());
+  }
+  observeBody(output.value(), observer);
+}
 
+void InjaTransformer::renderHeaders(
+    TransformerInstance &instance, const RenderContext &context,
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::StreamFilterCallbacks &callbacks,
+    CachedTransformation *result) const {
   // DynamicMetadata transform:
-  for (const auto &templated_dynamic_metadata : dynamic_metadata_) {
-    std::string output = instance.render(templated_dynamic_metadata.template_);
-    if (!output.empty()) {
-      ProtobufWkt::Struct strct(
-          MessageUtil::keyValueStruct(templated_dynamic_metadata.key_, output));
-      callbacks.streamInfo().setDynamicMetadata(
-          templated_dynamic_metadata.namespace_, strct);
+  if (!dynamic_metadata_.empty()) {
+    std::vector<std::string> outputs;
+    outputs.reserve(dynamic_metadata_.size());
+    for (const auto &templated_dynamic_metadata : dynamic_metadata_) {
+      outputs.push_back(
+          templated_dynamic_metadata.template_.render(instance, context));
+    }
+    setDynamicMetadata(outputs, callbacks);
+    if (result != nullptr) {
+      result->dynamic_metadata_ = std::move(outputs);
     }
   }
 
   // Headers transform:
-  for (const auto &templated_header : headers_) {
-    std::string output = instance.render(templated_header.second);
-    // remove existing header
-    header_map.remove(templated_header.first);
+  for (size_t i = 0; i < headers_.size(); i++) {
+    std::string output = headers_[i].second.render(instance, context);
     // TODO(yuval-k): Do we need to support intentional empty headers?
-    if (!output.empty()) {
-      // we can add the key as reference as the headers_ lifetime is as the
-      // route's
-      header_map.addReferenceKey(templated_header.first, output);
+    setHeader(header_map, i, output);
+    invalidateHeader(context, headers_[i].first);
+    if (result != nullptr) {
+      result->headers_.push_back(std::move(output));
     }
   }
 
   for (const auto &header_to_remove : headers_to_remove_) {
     header_map.remove(header_to_remove);
+    invalidateHeader(context, header_to_remove);
   }
 
   // Headers to Append Values transform:
   for (const auto &templated_header : headers_to_append_) {
-    std::string output = instance.render(templated_header.second);
+    std::string output = templated_header.second.render(instance, context);
     if (!output.empty()) {
       // we can add the key as reference as the headers_to_append_ lifetime is as the
       // route's
       // don't remove headers that already exist
       header_map.addReferenceKey(templated_header.first, output);
+      invalidateHeader(context, templated_header.first);
+    }
+    if (result != nullptr) {
+      result->headers_to_append_.push_back(std::move(output));
     }
   }
+}
 
-  // replace body. we do it here so that headers and dynamic metadata have the
-  // original body.
-  if (maybe_body.has_value()) {
-    // remove content length, as we have new body.
+void InjaTransformer::invalidateHeader(const RenderContext &context,
+                                       const Http::LowerCaseString &name) {
+  if (context.header_memo_ != nullptr) {
+    context.header_memo_->invalidate(name);
+  }
+}
+
+void InjaTransformer::setHeader(Http::RequestOrResponseHeaderMap &header_map,
+                                size_t index, absl::string_view value) const {
+  header_handles_[index].set(header_map, headers_[index].first, value);
+}
+
+void InjaTransformer::setDynamicMetadata(
+    const std::vector<std::string> &outputs,
+    Http::StreamFilterCallbacks &callbacks) const {
+  ASSERT(outputs.size() == dynamic_metadata_.size());
+  for (const auto &metadata_namespace : dynamic_metadata_namespaces_) {
+    // each call merges into the stream's metadata, so all the values of a
+    // namespace are merged at once.
+    ProtobufWkt::Struct strct;
+    auto &fields = *strct.mutable_fields();
+    for (size_t index : metadata_namespace.values_) {
+      if (!outputs[index].empty()) {
+        fields[dynamic_metadata_[index].key_].set_string_value(outputs[index]);
+      }
+    }
+    if (!fields.empty()) {
+      callbacks.streamInfo().setDynamicMetadata(metadata_namespace.namespace_,
+                                                strct);
+    }
+  }
+}
+
+ResultCache::Key
+InjaTransformer::cacheKey(const Http::RequestOrResponseHeaderMap &header_map,
+                          const Http::RequestHeaderMap *request_headers,
+                          GetBodyFunc &get_body) const {
+  // the templates only ever read the first value of a header.
+  auto first_value = [](const Http::HeaderMap *headers,
+                        const Http::LowerCaseString &name) {
+    if (headers == nullptr) {
+      return std::string();
+    }
+    const Http::HeaderMap::GetResult entries = headers->get(name);
+    return entries.empty() ? std::string()
+                           : std::string(entries[0]->value().getStringView());
+  };
+
+  ResultCache::Key key;
+  const absl::string_view body = get_body();
+  key.body_hash_ = HashUtil::xxHash64(body);
+  key.body_length_ = body.size();
+  key.header_values_.reserve(cache_headers_.size() +
+                             cache_request_headers_.size());
+  for (const auto &name : cache_headers_) {
+    key.header_values_.push_back(first_value(&header_map, name));
+  }
+  for (const auto &name : cache_request_headers_) {
+    key.header_values_.push_back(first_value(request_headers, name));
+  }
+  return key;
+}
+
+void InjaTransformer::applyCached(const CachedTransformationSharedPtr &cached,
+                                  Http::RequestOrResponseHeaderMap &header_map,
+                                  Buffer::Instance &body,
+                                  Http::StreamFilterCallbacks &callbacks) const {
+  ASSERT(cached->dynamic_metadata_.size() == dynamic_metadata_.size());
+  ASSERT(cached->headers_.size() == headers_.size());
+  ASSERT(cached->headers_to_append_.size() == headers_to_append_.size());
+
+  setDynamicMetadata(cached->dynamic_metadata_, callbacks);
+  for (size_t i = 0; i < headers_.size(); i++) {
+    setHeader(header_map, i, cached->headers_[i]);
+  }
+  for (const auto &header_to_remove : headers_to_remove_) {
+    header_map.remove(header_to_remove);
+  }
+  for (size_t i = 0; i < headers_to_append_.size(); i++) {
+    if (!cached->headers_to_append_[i].empty()) {
+      header_map.addReferenceKey(headers_to_append_[i].first,
+                                 cached->headers_to_append_[i]);
+    }
+  }
+
+  if (cached->body_.has_value()) {
     header_map.removeContentLength();
-    // replace body
     body.drain(body.length());
-    // prepend is used because it doesn't copy, it drains maybe_body
-    body.prepend(maybe_body.value());
+    // the body refers to the cached string, which the fragment keeps alive.
+    auto *fragment = new Buffer::BufferFragmentImpl(
+        cached->body_->data(), cached->body_->size(),
+        [cached](const void *, size_t,
+                 const Buffer::BufferFragmentImpl *fragment) {
+          delete fragment;
+        });
+    body.addBufferFragment(*fragment);
     header_map.setContentLength(body.length());
   }
 }
 
+void InjaTransformer::replaceBody(
+    Http::RequestOrResponseHeaderMap &header_map, Buffer::Instance &body,
+    absl::optional<Buffer::OwnedImpl> &rendered_body) {
+  if (!rendered_body.has_value()) {
+    return;
+  }
+  // remove content length, as we have new body.
+  header_map.removeContentLength();
+  // replace body
+  body.drain(body.length());
+  // prepend is used because it doesn't copy, it drains rendered_body
+  body.prepend(rendered_body.value());
+  header_map.setContentLength(body.length());
+}
+
+void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
+                                Http::RequestHeaderMap *request_headers,
+                                Buffer::Instance &body,
+                                Http::StreamFilterCallbacks &callbacks) const {
+  transformWith(header_map, request_headers, body, callbacks, nullptr);
+}
+
+void InjaTransformer::transformObserved(
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+    Http::StreamFilterCallbacks &callbacks,
+    const BodyObserver &observer) const {
+  transformWith(header_map, request_headers, body, callbacks, &observer);
+}
+
+void InjaTransformer::transformWith(
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+    Http::StreamFilterCallbacks &callbacks,
+    const BodyObserver *observer) const {
+  absl::optional<absl::string_view> string_body;
+  GetBodyFunc get_body = [&string_body, &body]() -> absl::string_view {
+    if (!string_body.has_value()) {
+      // linearize only copies when the body spans more than one slice, and
+      // the body is not modified until all the templates are rendered.
+      const uint64_t length = body.length();
+      string_body.emplace(static_cast<const char *>(body.linearize(length)),
+                          length);
+    }
+    return string_body.value();
+  };
+
+  absl::optional<ResultCache::Key> cache_key;
+  std::shared_ptr<CachedTransformation> result;
+  if (result_cache_ != nullptr) {
+    cache_key.emplace(cacheKey(header_map, request_headers, get_body));
+    CachedTransformationSharedPtr cached = result_cache_->find(*cache_key);
+    if (cached != nullptr) {
+      applyCached(cached, header_map, body, callbacks);
+      // the cached body was rendered before, so it is observed as it is.
+      observeBody(body, observer);
+      return;
+    }
+    result = std::make_shared<CachedTransformation>();
+  }
+
+  json json_body;
+  SharedJsonBody::JsonSharedPtr parsed_body;
+
+  // parse the body as json
+  if (shouldParseBody(body.length())) {
+    Stats::CompletableTimespanPtr timer = startTimer(
+        [](const InjaTransformerStats &stats) -> Stats::Histogram & {
+          return stats.body_parse_time_;
+        },
+        callbacks);
+    parsed_body = parseBody(get_body(), callbacks, json_body);
+    if (timer != nullptr) {
+      timer->complete();
+    }
+  }
+  const json &context_body = parsed_body != nullptr ? *parsed_body : json_body;
+  // get the extractions
+  const std::vector<absl::string_view> extracted =
+      extract(callbacks, header_map, get_body);
+  const Extractions extractions = addExtractions(extracted, json_body);
+
+  // start transforming!
+  Upstream::ClusterInfoConstSharedPtr ci = callbacks.clusterInfo();
+  HeaderMemo header_memo;
+  const RenderContext context =
+      makeContext(header_map, request_headers, get_body, extractions,
+                  context_body, ci.get(), &header_memo);
+  TransformerInstance &instance =
+      TransformerInstance::forThread(&callbacks.dispatcher().timeSource());
+  Stats::CompletableTimespanPtr render_timer = startTimer(
+      [](const InjaTransformerStats &stats) -> Stats::Histogram & {
+        return stats.render_time_;
+      },
+      callbacks);
+
+  // Body transform:
+  absl::optional<Buffer::OwnedImpl> maybe_body;
+  renderBody(instance, context, context_body, body, maybe_body, observer);
+  if (result != nullptr && maybe_body.has_value()) {
+    result->body_.emplace(maybe_body->toString());
+  }
+
+  renderHeaders(instance, context, header_map, callbacks, result.get());
+
+  if (render_timer != nullptr) {
+    render_timer->complete();
+  }
+
+  if (!maybe_body.has_value()) {
+    // the body is kept as it is.
+    observeBody(body, observer);
+  }
+  // replace body. we do it here so that headers and dynamic metadata have the
+  // original body.
+  replaceBody(header_map, body, maybe_body);
+
+  if (result != nullptr) {
+    result_cache_->insert(std::move(cache_key.value()), std::move(result));
+  }
+}
+
+/**
+ * Holds a copy of the headers and the body while the body is parsed and
+ * rendered on a pool thread, so that the stream can go away in the meantime.
+ * The extractors run when the task is created, on the worker thread.
+ */
+class InjaTransformationTask : public TransformationTask {
+public:
+  InjaTransformationTask(const InjaTransformer &transformer,
+                         const Http::RequestOrResponseHeaderMap &header_map,
+                         const Http::RequestHeaderMap *request_headers,
+                         Buffer::Instance &body,
+                         Http::StreamFilterCallbacks &callbacks)
+      : transformer_(transformer),
+        headers_(Http::createHeaderMap<Http::RequestHeaderMapImpl>(header_map)),
+        cluster_info_(callbacks.clusterInfo()) {
+    // when transforming a request the request headers are the headers.
+    if (request_headers == &header_map) {
+      request_headers_ = headers_.get();
+    } else if (request_headers != nullptr) {
+      request_headers_copy_ =
+          Http::createHeaderMap<Http::RequestHeaderMapImpl>(*request_headers);
+      request_headers_ = request_headers_copy_.get();
+    }
+    body_.move(body);
+    get_body_ = [this]() -> absl::string_view {
+      if (!string_body_.has_value()) {
+        const uint64_t length = body_.length();
+        string_body_.emplace(
+            static_cast<const char *>(body_.linearize(length)), length);
+      }
+      return string_body_.value();
+    };
+    extracted_ = transformer_.extract(callbacks, *headers_, get_body_);
+  }
+
+  void run() override {
+    try {
+      if (transformer_.shouldParseBody(body_.length())) {
+        json_body_ = transformer_.body_parser_.parse(
+            get_body_(), transformer_.ignore_error_on_parse_);
+      }
+      extractions_ = transformer_.addExtractions(extracted_, json_body_);
+      const RenderContext context =
+          transformer_.makeContext(*headers_, request_headers_, get_body_,
+                                   extractions_, json_body_,
+                                   cluster_info_.get());
+      // the renders on the pool threads are not profiled.
+      transformer_.renderBody(TransformerInstance::forThread(nullptr), context,
+                              json_body_, body_, rendered_body_);
+    } catch (const std::exception &e) {
+      error_.emplace(e.what());
+    }
+  }
+
+  void complete(Http::RequestOrResponseHeaderMap &header_map,
+                Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+                Http::StreamFilterCallbacks &callbacks) override {
+    if (error_.has_value()) {
+      throw EnvoyException(error_.value());
+    }
+    HeaderMemo header_memo;
+    const RenderContext context = transformer_.makeContext(
+        header_map, request_headers, get_body_, extractions_, json_body_,
+        cluster_info_.get(), &header_memo);
+    transformer_.renderHeaders(
+        TransformerInstance::forThread(&callbacks.dispatcher().timeSource()),
+        context, header_map, callbacks);
+    if (rendered_body_.has_value()) {
+      InjaTransformer::replaceBody(header_map, body, rendered_body_);
+    } else {
+      body.move(body_);
+    }
+  }
+
+private:
+  const InjaTransformer &transformer_;
+  Http::RequestHeaderMapPtr headers_;
+  Http::RequestHeaderMapPtr request_headers_copy_;
+  const Http::RequestHeaderMap *request_headers_{};
+  Upstream::ClusterInfoConstSharedPtr cluster_info_;
+  Buffer::OwnedImpl body_;
+  absl::optional<absl::string_view> string_body_;
+  GetBodyFunc get_body_;
+  std::vector<absl::string_view> extracted_;
+  json json_body_;
+  // refers to extracted_.
+  Extractions extractions_;
+  absl::optional<Buffer::OwnedImpl> rendered_body_;
+  absl::optional<std::string> error_;
+};
+
+TransformationTaskPtr
+InjaTransformer::startTask(Http::RequestOrResponseHeaderMap &header_map,
+                           Http::RequestHeaderMap *request_headers,
+                           Buffer::Instance &body,
+                           Http::StreamFilterCallbacks &callbacks) const {
+  // hits in the result cache are cheaper than posting the task, and so is
+  // transforming a body prefix.
+  if (async_body_threshold_ == 0 || passthrough_body_ ||
+      result_cache_ != nullptr || body_prefix_bytes_ != 0 ||
+      body.length() < async_body_threshold_) {
+    return nullptr;
+  }
+  return std::make_unique<InjaTransformationTask>(
+      *this, header_map, request_headers, body, callbacks);
+}
+
+/**
+ * Splits a streamed body into json records, and renders the body template
+ * for each of them as soon as it is complete.
+ */
+class InjaBodyStream : public BodyStream {
+public:
+  InjaBodyStream(const InjaTransformer &transformer,
+                 const Http::RequestOrResponseHeaderMap &header_map,
+                 const Http::RequestHeaderMap *request_headers,
+                 Http::StreamFilterCallbacks &callbacks)
+      : transformer_(transformer), header_map_(header_map),
+        request_headers_(request_headers), callbacks_(callbacks),
+        cluster_info_(callbacks.clusterInfo()) {}
+
+  void transformData(Buffer::Instance &data, bool end_stream) override {
+    std::string output;
+    for (const Buffer::RawSlice &slice : data.getRawSlices()) {
+      const absl::string_view input(static_cast<const char *>(slice.mem_),
+                                    slice.len_);
+      if (transformer_.streaming_format_ == StreamingBody::JSON_ARRAY) {
+        scanArray(input, output);
+      } else {
+        scanLines(input, output);
+      }
+    }
+    data.drain(data.length());
+    if (end_stream) {
+      finish(output);
+    }
+    data.add(output);
+  }
+
+private:
+  using StreamingBody = envoy::api::v2::filter::http::StreamingBody;
+  enum class ArrayState {
+    BeforeArray,
+    BeforeRecord,
+    InRecord,
+    AfterRecord,
+    Done
+  };
+
+  void scanLines(absl::string_view input, std::string &output) {
+    while (!input.empty()) {
+      const size_t newline = input.find('\n');
+      appendToRecord(input.substr(0, newline));
+      if (newline == absl::string_view::npos) {
+        return;
+      }
+      emit(output);
+      input.remove_prefix(newline + 1);
+    }
+  }
+
+  void scanArray(absl::string_view input, std::string &output) {
+    for (const char c : input) {
+      switch (state_) {
+      case ArrayState::BeforeArray:
+        if (c == '[') {
+          output.push_back('[');
+          state_ = ArrayState::BeforeRecord;
+        } else if (!absl::ascii_isspace(c)) {
+          throw EnvoyException("the streamed body is not a json array");
+        }
+        break;
+      case ArrayState::BeforeRecord:
+        if (c == ']' && records_ == 0) {
+          closeArray(output);
+        } else if (!absl::ascii_isspace(c)) {
+          state_ = ArrayState::InRecord;
+          scanRecord(c, output);
+        }
+        break;
+      case ArrayState::InRecord:
+        scanRecord(c, output);
+        break;
+      case ArrayState::AfterRecord:
+        if (c == ',') {
+          state_ = ArrayState::BeforeRecord;
+        } else if (c == ']') {
+          closeArray(output);
+        } else if (!absl::ascii_isspace(c)) {
+          throw EnvoyException("invalid json array in the streamed body");
+        }
+        break;
+      case ArrayState::Done:
+        if (!absl::ascii_isspace(c)) {
+          throw EnvoyException("unexpected data after the json array");
+        }
+        break;
+      }
+    }
+  }
+
+  // adds a character to the current array element, and renders the element
+  // once it is complete.
+  void scanRecord(char c, std::string &output) {
+    if (in_string_) {
+      if (escaped_) {
+        escaped_ = false;
+      } else if (c == '\\') {
+        escaped_ = true;
+      } else if (c == '"') {
+        in_string_ = false;
+      }
+      appendToRecord(absl::string_view(&c, 1));
+      return;
+    }
+    if (depth_ == 0 && (c == ',' || c == ']')) {
+      // the end of an element that isn't an object or an array.
+      emit(output);
+      if (c == ',') {
+        state_ = ArrayState::BeforeRecord;
+      } else {
+        closeArray(output);
+      }
+      return;
+    }
+    appendToRecord(absl::string_view(&c, 1));
+    if (c == '"') {
+      in_string_ = true;
+    } else if (c == '{' || c == '[') {
+      depth_++;
+    } else if (c == '}' || c == ']') {
+      if (depth_ == 0) {
+        throw EnvoyException("invalid json array in the streamed body");
+      }
+      if (--depth_ == 0) {
+        emit(output);
+        state_ = ArrayState::AfterRecord;
+      }
+    }
+  }
+
+  void closeArray(std::string &output) {
+    output.push_back(']');
+    state_ = ArrayState::Done;
+  }
+
+  void appendToRecord(absl::string_view input) {
+    if (record_.size() + input.size() > transformer_.max_record_bytes_) {
+      throw EnvoyException("a json record of the streamed body is too large");
+    }
+    record_.append(input.data(), input.size());
+  }
+
+  void emit(std::string &output) {
+    const absl::string_view record = absl::StripAsciiWhitespace(record_);
+    if (!record.empty()) {
+      if (transformer_.streaming_format_ == StreamingBody::JSON_ARRAY) {
+        if (records_ > 0) {
+          output.push_back(',');
+        }
+        absl::StrAppend(&output, render(record));
+      } else {
+        absl::StrAppend(&output, render(record), "\n");
+      }
+      records_++;
+    }
+    record_.clear();
+  }
+
+  void finish(std::string &output) {
+    if (transformer_.streaming_format_ == StreamingBody::JSON_ARRAY) {
+      if (state_ != ArrayState::Done) {
+        throw EnvoyException("the json array of the streamed body is truncated");
+      }
+    } else {
+      emit(output);
+    }
+  }
+
+  std::string render(absl::string_view record) {
+    json json_body = json::parse(record.begin(), record.end());
+    GetBodyFunc get_body = [record]() { return record; };
+    const std::vector<absl::string_view> extracted =
+        transformer_.extract(callbacks_, header_map_, get_body);
+    const Extractions extractions =
+        transformer_.addExtractions(extracted, json_body);
+    const RenderContext context = transformer_.makeContext(
+        header_map_, request_headers_, get_body, extractions, json_body,
+        cluster_info_.get());
+    return transformer_.body_template_->render(
+        TransformerInstance::forThread(&callbacks_.dispatcher().timeSource()),
+        context);
+  }
+
+  const InjaTransformer &transformer_;
+  const Http::RequestOrResponseHeaderMap &header_map_;
+  const Http::RequestHeaderMap *request_headers_;
+  Http::StreamFilterCallbacks &callbacks_;
+  const Upstream::ClusterInfoConstSharedPtr cluster_info_;
+
+  std::string record_;
+  uint64_t records_{};
+  ArrayState state_{ArrayState::BeforeArray};
+  // where an array element is at, outside of strings.
+  uint32_t depth_{};
+  bool in_string_{};
+  bool escaped_{};
+};
+
+BodyStreamPtr
+InjaTransformer::startBodyStream(Http::RequestOrResponseHeaderMap &header_map,
+                                 Http::RequestHeaderMap *request_headers,
+                                 Http::StreamFilterCallbacks &callbacks) const {
+  if (!streaming_format_.has_value()) {
+    return nullptr;
+  }
+
+  // the headers are rendered before any of the body arrives.
+  GetBodyFunc get_body = []() { return absl::string_view(); };
+  json json_body;
+  const std::vector<absl::string_view> extracted =
+      extract(callbacks, header_map, get_body);
+  const Extractions extractions = addExtractions(extracted, json_body);
+  Upstream::ClusterInfoConstSharedPtr ci = callbacks.clusterInfo();
+  HeaderMemo header_memo;
+  const RenderContext context =
+      makeContext(header_map, request_headers, get_body, extractions,
+                  json_body, ci.get(), &header_memo);
+  renderHeaders(
+      TransformerInstance::forThread(&callbacks.dispatcher().timeSource()),
+      context, header_map, callbacks);
+
+  // the length of the transformed body isn't known up front.
+  header_map.removeContentLength();
+  return std::make_unique<InjaBodyStream>(*this, header_map, request_headers,
+                                          callbacks);
+}
+
 } // namespace Transformation
 } // namespace HttpFilters
 } // namespace Extensions
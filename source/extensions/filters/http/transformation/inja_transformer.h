@@ -1,14 +1,35 @@
 #pragma once
 
+#include <atomic>
 #include <map>
 
 #include "envoy/buffer/buffer.h"
+#include "envoy/common/time.h"
 #include "envoy/http/header_map.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/stats/timespan.h"
 
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/base64.h"
 
+#include "source/extensions/filters/http/transformation/cluster_metadata_values.h"
+#include "source/extensions/filters/http/transformation/compiled_template.h"
+#include "source/extensions/filters/http/transformation/inline_header_handles.h"
+#include "source/extensions/filters/http/transformation/json_body_parser.h"
+#include "source/extensions/filters/http/transformation/json_pointer.h"
+#include "source/extensions/filters/http/transformation/render_context.h"
+#include "source/extensions/filters/http/transformation/result_cache.h"
+#include "source/extensions/filters/http/transformation/shared_json_body.h"
+#include "source/extensions/filters/http/transformation/template_analysis.h"
+#include "source/extensions/filters/http/transformation/template_cache.h"
+#include "source/extensions/filters/http/transformation/template_profiler.h"
+#include "source/extensions/filters/http/transformation/template_shadow.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "re2/re2.h"
+
 // clang-format off
 #include "nlohmann/json.hpp"
 #include "inja/inja.hpp"
@@ -21,21 +42,58 @@ namespace Extensions {
 namespace HttpFilters {
 namespace Transformation {
 
-using GetBodyFunc = std::function<const std::string &()>;
-
+/**
+ * Holds an inja environment with the transformation callbacks registered.
+ * Registering the callbacks is relatively expensive, so an instance is created
+ * once per thread and reused for every render of all the transformers on that
+ * thread.
+ */
 class TransformerInstance {
 public:
-  TransformerInstance(
-      const Http::RequestOrResponseHeaderMap &header_map,
-      const Http::RequestHeaderMap *request_headers, GetBodyFunc &body,
-      const std::unordered_map<std::string, absl::string_view> &extractions,
-      const nlohmann::json &context,
-      const std::unordered_map<std::string, std::string> &environ,
-      const envoy::config::core::v3::Metadata *cluster_metadata);
+  TransformerInstance();
+  // renders can be sampled by the TemplateProfiler when it is given a time
+  // source.
+  explicit TransformerInstance(TimeSource &time_source);
+
+  /**
+   * @return the instance of the calling thread, which is created by its first
+   * call and lives as long as the thread. Its renders are sampled with the
+   * time source until the next call, and never when it is null.
+   */
+  static TransformerInstance &forThread(TimeSource *time_source);
 
-  std::string render(const inja::Template &input);
+  /**
+   * @param template_name identifies the template in the profile.
+   * @param size_hint the expected size of the output, which is reserved
+   * before rendering.
+   */
+  std::string render(const inja::Template &input, const RenderContext &context,
+                     absl::string_view template_name = {},
+                     size_t size_hint = 0);
+  // renders straight into the output buffer, without an intermediate string.
+  // the observer, when given, sees the output as it is added to the buffer.
+  void renderTo(Buffer::Instance &output, const inja::Template &input,
+                const RenderContext &context,
+                absl::string_view template_name = {},
+                const Transformer::BodyObserver *observer = nullptr);
+
+  // whether the next compiled render is compared with inja by the
+  // TemplateShadow, which needs the time source.
+  bool shouldShadow() {
+    return time_source_ != nullptr &&
+           TemplateShadow::get().shouldSample(shadow_count_++);
+  }
+  TimeSource *timeSource() const { return time_source_; }
 
 private:
+  void renderTo(std::ostream &output, const inja::Template &input,
+                const RenderContext &context, absl::string_view template_name);
+  void renderJson(std::ostream &output, const inja::Template &input,
+                  const RenderContext &context);
+  // registers a callback that is timed when the render is profiled.
+  void addCallback(const std::string &name, int num_args,
+                   std::function<nlohmann::json(inja::Arguments &)> callback);
+
   // header_value(name)
   nlohmann::json header_callback(const inja::Arguments &args) const;
   nlohmann::json request_header_callback(const inja::Arguments &args) const;
@@ -47,15 +105,113 @@ private:
   nlohmann::json base64_encode_callback(const inja::Arguments &args) const;
   nlohmann::json base64_decode_callback(const inja::Arguments &args) const;
   nlohmann::json substring_callback(const inja::Arguments &args) const;
+  nlohmann::json json_escape_callback(const inja::Arguments &args) const;
 
   inja::Environment env_;
-  const Http::RequestOrResponseHeaderMap &header_map_;
-  const Http::RequestHeaderMap *request_headers_;
-  GetBodyFunc &body_;
-  const std::unordered_map<std::string, absl::string_view> &extractions_;
-  const nlohmann::json &context_;
-  const std::unordered_map<std::string, std::string> &environ_;
-  const envoy::config::core::v3::Metadata *cluster_metadata_;
+  // only set while render() is running.
+  const RenderContext *context_{};
+
+  TimeSource *time_source_{};
+  uint64_t render_count_{};
+  uint64_t shadow_count_{};
+  // only set while a profiled render is running.
+  TemplateProfiler::RenderProfile *profile_{};
+};
+
+/**
+ * A running average of the sizes of the outputs of a template, used to reserve
+ * the output before rendering. It is updated by all the worker threads without
+ * synchronization, so an update may be lost, which only makes the estimate
+ * lag.
+ */
+class OutputSizeEstimate {
+public:
+  OutputSizeEstimate() = default;
+  OutputSizeEstimate(const OutputSizeEstimate &other) : estimate_(other.get()) {}
+
+  size_t get() const { return estimate_.load(std::memory_order_relaxed); }
+  // an exponentially weighted moving average, where the last output weighs a
+  // quarter.
+  void record(size_t size) {
+    const size_t estimate = get();
+    estimate_.store(estimate - estimate / 4 + size / 4,
+                    std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<size_t> estimate_{0};
+};
+
+/**
+ * A parsed template, along with what it reads when rendered. Templates whose
+ * output doesn't depend on the request are rendered once at config time and
+ * the output is reused, and simple templates are compiled to skip inja.
+ */
+class ParsedTemplate {
+public:
+  /**
+   * @param text the template source. Identical templates are parsed once and
+   * shared through the TemplateCache.
+   * @param advanced_templates whether the template uses json pointer notation.
+   * @param extraction_slots the slots of the extractions the template is
+   * rendered with, when they are known.
+   */
+  ParsedTemplate(absl::string_view text, bool advanced_templates,
+                 const ExtractionSlots *extraction_slots = nullptr);
+  /**
+   * @param inja_template the template, whose expressions are all escaped as
+   * json strings when it asks for it.
+   */
+  ParsedTemplate(
+      const envoy::api::v2::filter::http::InjaTemplate &inja_template,
+      bool advanced_templates,
+      const ExtractionSlots *extraction_slots = nullptr);
+
+  /**
+   * @return the template with each of its expressions passed to
+   * json_escape(). Statements and comments are left as they are.
+   */
+  static std::string jsonEscapeExpressions(absl::string_view text);
+
+  /**
+   * @return whether the output of a template with these dependencies can
+   * change between requests.
+   */
+  static bool dependsOnRequest(const TemplateDependencies &dependencies);
+
+  /**
+   * Renders the template once with the given context, and keeps the output
+   * if the template doesn't depend on the request.
+   */
+  void precompute(TransformerInstance &instance, const RenderContext &context);
+
+  std::string render(TransformerInstance &instance,
+                     const RenderContext &context) const;
+  void renderTo(TransformerInstance &instance, Buffer::Instance &output,
+                const RenderContext &context,
+                const Transformer::BodyObserver *observer = nullptr) const;
+
+  const TemplateDependencies &dependencies() const {
+    return parsed_->dependencies_;
+  }
+  const absl::optional<std::string> &constantOutput() const {
+    return constant_output_;
+  }
+  size_t estimatedOutputSize() const { return output_size_.get(); }
+
+private:
+  // renders the compiled template, comparing it with inja when the
+  // TemplateShadow samples the render. Returns false when the compiled
+  // template can't render the context.
+  bool renderCompiled(TransformerInstance &instance,
+                      const RenderContext &context, std::string &output) const;
+
+  TemplateCache::EntrySharedPtr parsed_;
+  absl::optional<std::string> constant_output_;
+  // set when the template can be rendered without inja. Compiled renders are
+  // not sampled by the TemplateProfiler.
+  absl::optional<CompiledTemplate> compiled_;
+  mutable OutputSizeEstimate output_size_;
 };
 
 class Extractor : Logger::Loggable<Logger::Id::filter> {
@@ -69,45 +225,235 @@ private:
   absl::string_view extractValue(Http::StreamFilterCallbacks &callbacks,
                                  absl::string_view value) const;
 
+  // return nullopt when the regex doesn't match.
+  absl::optional<absl::string_view> matchRe2(absl::string_view value) const;
+  absl::optional<absl::string_view>
+  matchStdRegex(Http::StreamFilterCallbacks &callbacks,
+                absl::string_view value) const;
+
   const Http::LowerCaseString headername_;
   const bool body_;
+  // set when the value is found in the json body rather than matched on the
+  // whole body, with no regex when the regex is empty.
+  absl::optional<JsonPointer> json_pointer_;
   const unsigned int group_;
-  const std::regex extract_regex_;
+  // RE2 is used whenever it can compile the regex. regexes that use
+  // features RE2 doesn't support (e.g. backreferences or lookarounds) fall
+  // back to std::regex.
+  std::unique_ptr<const re2::RE2> re2_regex_;
+  absl::optional<std::regex> std_regex_;
+};
+
+/**
+ * All stats for the inja transformer. @see stats_macros.h
+ */
+#define ALL_INJA_TRANSFORMER_STATS(HISTOGRAM)                                  \
+  HISTOGRAM(body_parse_time, Microseconds)                                     \
+  HISTOGRAM(render_time, Microseconds)
+
+/**
+ * Wrapper struct for inja transformer stats. @see stats_macros.h
+ */
+struct InjaTransformerStats {
+  ALL_INJA_TRANSFORMER_STATS(GENERATE_HISTOGRAM_STRUCT)
 };
 
 class InjaTransformer : public Transformer {
 public:
   InjaTransformer(const envoy::api::v2::filter::http::TransformationTemplate
-                      &transformation);
+                      &transformation,
+                  absl::optional<InjaTransformerStats> stats = absl::nullopt,
+                  absl::optional<ResultCacheStats> result_cache_stats =
+                      absl::nullopt);
   ~InjaTransformer();
 
+  static InjaTransformerStats generateStats(const std::string &prefix,
+                                            Stats::Scope &scope);
+
+  /**
+   * @return the sources of the templates that a transformer built from this
+   * config parses, in the notation of the config.
+   */
+  static std::vector<absl::string_view>
+  templateSources(const envoy::api::v2::filter::http::TransformationTemplate
+                      &transformation);
+
   void transform(Http::RequestOrResponseHeaderMap &map,
                  Http::RequestHeaderMap *request_headers,
                  Buffer::Instance &body,
                  Http::StreamFilterCallbacks &) const override;
+  // the body is observed as it is rendered, rather than after.
+  void transformObserved(Http::RequestOrResponseHeaderMap &map,
+                         Http::RequestHeaderMap *request_headers,
+                         Buffer::Instance &body,
+                         Http::StreamFilterCallbacks &callbacks,
+                         const BodyObserver &observer) const override;
+  // the task parses and renders the body on the pool, and renders the headers
+  // and dynamic metadata when it completes. The transformer must outlive the
+  // task.
+  TransformationTaskPtr
+  startTask(Http::RequestOrResponseHeaderMap &map,
+            Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+            Http::StreamFilterCallbacks &callbacks) const override;
+  // the headers and dynamic metadata are rendered right away, without the
+  // body, which is transformed record by record.
+  BodyStreamPtr
+  startBodyStream(Http::RequestOrResponseHeaderMap &header_map,
+                  Http::RequestHeaderMap *request_headers,
+                  Http::StreamFilterCallbacks &callbacks) const override;
   bool passthrough_body() const override { return passthrough_body_; };
+  uint64_t body_prefix_bytes() const override { return body_prefix_bytes_; }
+  bool parsesJsonBody() const override;
 
 private:
+  friend class InjaTransformationTask;
+  friend class InjaBodyStream;
+
+  // a key of the merged paths of the extractors, see extraction_tree_.
+  struct ExtractionNode {
+    std::string key_;
+    // the index of the extractor stored at this node, if it is a leaf.
+    absl::optional<size_t> extractor_;
+    std::vector<ExtractionNode> children_;
+  };
+
+  // whether any of the templates can read a field of the parsed body.
+  bool readsBody(const TemplateDependencies &dependencies) const;
+  bool shouldParseBody(uint64_t body_length) const;
+  // parses the body with body_parser_ into json_body, unless the stream shares
+  // its parsed bodies. The document parsed by an earlier transformation of the
+  // stream is then reused when the body is unchanged, and the document is
+  // returned rather than copied when the json context isn't changed.
+  SharedJsonBody::JsonSharedPtr
+  parseBody(absl::string_view body, Http::StreamFilterCallbacks &callbacks,
+            nlohmann::json &json_body) const;
+  // runs the extractors, in the order of extractors_.
+  std::vector<absl::string_view>
+  extract(Http::StreamFilterCallbacks &callbacks,
+          const Http::RequestOrResponseHeaderMap &header_map,
+          GetBodyFunc &get_body) const;
+  // makes the extracted values available to the templates, either in the json
+  // context or in the returned slots, which refer to values.
+  Extractions addExtractions(const std::vector<absl::string_view> &values,
+                             nlohmann::json &json_body) const;
+  static void addExtractions(const std::vector<ExtractionNode> &nodes,
+                             const std::vector<absl::string_view> &values,
+                             nlohmann::json &parent);
+  static bool addExtractionPath(std::vector<ExtractionNode> &nodes,
+                                const std::vector<std::string> &path,
+                                size_t extractor);
+  // the memo, when given, must be invalidated as the headers change.
+  RenderContext makeContext(const Http::RequestOrResponseHeaderMap &header_map,
+                            const Http::RequestHeaderMap *request_headers,
+                            GetBodyFunc &get_body,
+                            const Extractions &extractions,
+                            const nlohmann::json &json_body,
+                            const Upstream::ClusterInfo *cluster_info,
+                            HeaderMemo *header_memo = nullptr) const;
+  // the observer, when given, sees the transformed body as it is written.
+  void transformWith(Http::RequestOrResponseHeaderMap &map,
+                     Http::RequestHeaderMap *request_headers,
+                     Buffer::Instance &body,
+                     Http::StreamFilterCallbacks &callbacks,
+                     const BodyObserver *observer) const;
+  // renders the new body into output, and base64 codes the rendered body, or
+  // the original one, when body_base64_ is set. The observer, when given,
+  // sees the output, after it is coded.
+  void renderBody(TransformerInstance &instance, const RenderContext &context,
+                  const nlohmann::json &json_body, const Buffer::Instance &body,
+                  absl::optional<Buffer::OwnedImpl> &output,
+                  const BodyObserver *observer = nullptr) const;
+  // renders the dynamic metadata and the headers, in that order, and records
+  // the outputs in result when it is set. The headers are invalidated in the
+  // memo of the context as they are changed.
+  void renderHeaders(TransformerInstance &instance,
+                     const RenderContext &context,
+                     Http::RequestOrResponseHeaderMap &header_map,
+                     Http::StreamFilterCallbacks &callbacks,
+                     CachedTransformation *result = nullptr) const;
+  ResultCache::Key cacheKey(const Http::RequestOrResponseHeaderMap &header_map,
+                            const Http::RequestHeaderMap *request_headers,
+                            GetBodyFunc &get_body) const;
+  // sets the rendered dynamic metadata values, with one struct per namespace.
+  void setDynamicMetadata(const std::vector<std::string> &outputs,
+                          Http::StreamFilterCallbacks &callbacks) const;
+  // replaces the value of the templated header at index, or removes the
+  // header when the value is empty.
+  void setHeader(Http::RequestOrResponseHeaderMap &header_map, size_t index,
+                 absl::string_view value) const;
+  static void invalidateHeader(const RenderContext &context,
+                               const Http::LowerCaseString &name);
+  // applies the outputs of a transformation that was rendered before.
+  void applyCached(const CachedTransformationSharedPtr &cached,
+                   Http::RequestOrResponseHeaderMap &header_map,
+                   Buffer::Instance &body,
+                   Http::StreamFilterCallbacks &callbacks) const;
+  static void replaceBody(Http::RequestOrResponseHeaderMap &header_map,
+                          Buffer::Instance &body,
+                          absl::optional<Buffer::OwnedImpl> &rendered_body);
+  // times a step of the transformation into the histogram of the step when
+  // stats are enabled, and returns nullptr otherwise.
+  Stats::CompletableTimespanPtr
+  startTimer(Stats::Histogram &(*histogram)(const InjaTransformerStats &),
+             Http::StreamFilterCallbacks &callbacks) const;
+
   struct DynamicMetadataValue {
-    std::string namespace_;
     std::string key_;
-    inja::Template template_;
+    ParsedTemplate template_;
+  };
+  // the dynamic metadata values that go in the same namespace, as indexes in
+  // dynamic_metadata_.
+  struct DynamicMetadataNamespace {
+    std::string namespace_;
+    std::vector<size_t> values_;
   };
 
   bool advanced_templates_{};
   bool passthrough_body_{};
+  // bodies this large are transformed by startTask(), when it's non zero.
+  uint64_t async_body_threshold_{};
+  uint64_t body_prefix_bytes_{};
+  // set when the body is streamed as records of this format.
+  absl::optional<envoy::api::v2::filter::http::StreamingBody::Format>
+      streaming_format_;
+  uint32_t max_record_bytes_{};
+  envoy::api::v2::filter::http::TransformationTemplate::Base64Body
+      body_base64_{};
   std::vector<std::pair<std::string, Extractor>> extractors_;
-  std::vector<std::pair<Http::LowerCaseString, inja::Template>> headers_;
-  std::vector<std::pair<Http::LowerCaseString, inja::Template>> headers_to_append_;
+  // with pointer notation, the slots of the extractors by name, which are
+  // their indexes in extractors_.
+  ExtractionSlots extraction_slots_;
+  // with dot notation, the path in the json context that each extractor is
+  // stored at, split once so that the keys aren't copied out of the names on
+  // every request.
+  std::vector<std::vector<std::string>> extractor_paths_;
+  // the same paths merged, so that the keys extractors have in common are
+  // looked up once. It is empty when a path is a prefix of another, in which
+  // case the extractors are stored one after the other.
+  std::vector<ExtractionNode> extraction_tree_;
+  std::vector<std::pair<Http::LowerCaseString, ParsedTemplate>> headers_;
+  // the handles of the templated headers, in the order of headers_.
+  std::vector<InlineHeaderHandles> header_handles_;
+  std::vector<std::pair<Http::LowerCaseString, ParsedTemplate>> headers_to_append_;
   std::vector<Http::LowerCaseString> headers_to_remove_;
   std::vector<DynamicMetadataValue> dynamic_metadata_;
-  std::unordered_map<std::string, std::string> environ_;
+  std::vector<DynamicMetadataNamespace> dynamic_metadata_namespaces_;
+  HeaderKeyMap header_keys_;
+  // the environment variables the templates can read. When any variable can
+  // be read, this is the snapshot shared by all the transformers.
+  std::shared_ptr<const std::unordered_map<std::string, std::string>> environ_;
 
   envoy::api::v2::filter::http::TransformationTemplate::RequestBodyParse
       parse_body_behavior_;
   bool ignore_error_on_parse_;
+  JsonBodyParser body_parser_;
+  absl::optional<InjaTransformerStats> stats_;
+  ResultCachePtr result_cache_;
+  // the headers, and the request headers, that the cached results depend on.
+  std::vector<Http::LowerCaseString> cache_headers_;
+  std::vector<Http::LowerCaseString> cache_request_headers_;
 
-  absl::optional<inja::Template> body_template_;
+  absl::optional<ParsedTemplate> body_template_;
   bool merged_extractors_to_body_{};
 };
 
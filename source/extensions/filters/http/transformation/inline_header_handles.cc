@@ -0,0 +1,52 @@
+#include "source/extensions/filters/http/transformation/inline_header_handles.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+InlineHeaderHandles::InlineHeaderHandles(const Http::LowerCaseString &name)
+    : request_(Http::CustomInlineHeaderRegistry::getInlineHeader<
+               Http::CustomInlineHeaderRegistry::Type::RequestHeaders>(name)),
+      response_(Http::CustomInlineHeaderRegistry::getInlineHeader<
+                Http::CustomInlineHeaderRegistry::Type::ResponseHeaders>(
+          name)) {}
+
+void InlineHeaderHandles::set(Http::RequestOrResponseHeaderMap &header_map,
+                              const Http::LowerCaseString &name,
+                              absl::string_view value) const {
+  if (request_.has_value()) {
+    if (auto *request_headers =
+            dynamic_cast<Http::RequestHeaderMap *>(&header_map)) {
+      if (value.empty()) {
+        request_headers->removeInline(request_.value());
+      } else {
+        request_headers->setInline(request_.value(), value);
+      }
+      return;
+    }
+  }
+  if (response_.has_value()) {
+    if (auto *response_headers =
+            dynamic_cast<Http::ResponseHeaderMap *>(&header_map)) {
+      if (value.empty()) {
+        response_headers->removeInline(response_.value());
+      } else {
+        response_headers->setInline(response_.value(), value);
+      }
+      return;
+    }
+  }
+
+  header_map.remove(name);
+  if (!value.empty()) {
+    // we can add the key as reference as the name lives as long as the
+    // route's transformer.
+    header_map.addReferenceKey(name, value);
+  }
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
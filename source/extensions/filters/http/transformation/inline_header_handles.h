@@ -0,0 +1,43 @@
+#pragma once
+
+#include "envoy/http/header_map.h"
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * The handles of a header that is set by a transformation, looked up once at
+ * config time. A header that is an inline header of the request or of the
+ * response is set in place rather than removed and added again.
+ */
+class InlineHeaderHandles {
+public:
+  explicit InlineHeaderHandles(const Http::LowerCaseString &name);
+
+  /**
+   * Replaces the value of the header, or removes the header when the value is
+   * empty.
+   * @param name the name the handles were looked up for. A header that isn't
+   * inline is added with a reference to it, so it must outlive the map.
+   */
+  void set(Http::RequestOrResponseHeaderMap &header_map,
+           const Http::LowerCaseString &name, absl::string_view value) const;
+
+private:
+  absl::optional<Http::CustomInlineHeaderRegistry::Handle<
+      Http::CustomInlineHeaderRegistry::Type::RequestHeaders>>
+      request_;
+  absl::optional<Http::CustomInlineHeaderRegistry::Handle<
+      Http::CustomInlineHeaderRegistry::Type::ResponseHeaders>>
+      response_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,78 @@
+#include "source/extensions/filters/http/transformation/json_body_parser.h"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+JsonBodyParser
+JsonBodyParser::referencedKeys(absl::flat_hash_set<std::string> keys) {
+  JsonBodyParser parser;
+  parser.keys_.emplace(std::move(keys));
+  return parser;
+}
+
+JsonBodyParser JsonBodyParser::validateOnly() {
+  JsonBodyParser parser;
+  parser.validate_only_ = true;
+  return parser;
+}
+
+json JsonBodyParser::parse(absl::string_view body, bool ignore_errors) const {
+  if (validate_only_) {
+    // accept() doesn't build a json document.
+    if (!ignore_errors && !json::accept(body.begin(), body.end())) {
+      // parse to raise the same error a full parse would.
+      parse(body);
+    }
+    return json();
+  }
+  if (ignore_errors) {
+    try {
+      return parse(body);
+    } catch (const std::exception &) {
+      return json();
+    }
+  }
+  return parse(body);
+}
+
+json JsonBodyParser::fromParsed(const json &parsed) const {
+  if (validate_only_) {
+    return json();
+  }
+  if (!keys_.has_value() || !parsed.is_object()) {
+    return parsed;
+  }
+  json referenced = json::object();
+  for (const std::string &key : keys_.value()) {
+    auto it = parsed.find(key);
+    if (it != parsed.end()) {
+      referenced.emplace(key, *it);
+    }
+  }
+  return referenced;
+}
+
+json JsonBodyParser::parse(absl::string_view body) const {
+  if (!keys_.has_value()) {
+    return json::parse(body.begin(), body.end());
+  }
+  // keys at depth 1 are the keys of the top level object. dropping a key
+  // also drops its value, which is then never allocated.
+  const json::parser_callback_t keep_referenced_keys =
+      [this](int depth, json::parse_event_t event, json &parsed) {
+        if (depth != 1 || event != json::parse_event_t::key) {
+          return true;
+        }
+        return keys_->contains(parsed.get_ref<const std::string &>());
+      };
+  return json::parse(body.begin(), body.end(), keep_referenced_keys);
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+#include "nlohmann/json.hpp"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Parses request/response bodies for the ParseAsJson body parse behavior.
+ * The parser only does as much work as the templates that use the result
+ * need: it can parse the whole body, only the referenced top level keys of
+ * it, or just validate it.
+ */
+class JsonBodyParser {
+public:
+  // parses the whole body.
+  JsonBodyParser() = default;
+
+  // only keeps the given top level keys of a json object body.
+  static JsonBodyParser referencedKeys(absl::flat_hash_set<std::string> keys);
+
+  // nothing reads the parsed body, so it is only validated.
+  static JsonBodyParser validateOnly();
+
+  /**
+   * @param body the body to parse.
+   * @param ignore_errors whether to return a null json value rather than
+   * throw when the body is not valid json.
+   * @return the parsed body, or a null json value if the parser only
+   * validates.
+   */
+  nlohmann::json parse(absl::string_view body, bool ignore_errors) const;
+
+  // whether parse() returns the whole document, which can then be shared
+  // with the other parsers of the same body.
+  bool parsesWholeBody() const { return !validate_only_ && !keys_.has_value(); }
+
+  /**
+   * @param parsed the whole body, as parsed by another parser.
+   * @return what parse() returns for the same body, without parsing it again.
+   */
+  nlohmann::json fromParsed(const nlohmann::json &parsed) const;
+
+private:
+  nlohmann::json parse(absl::string_view body) const;
+
+  bool validate_only_{};
+  absl::optional<absl::flat_hash_set<std::string>> keys_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,175 @@
+#include "source/extensions/filters/http/transformation/json_escape.h"
+
+#include <cstring>
+
+#include "envoy/common/exception.h"
+
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+constexpr uint64_t OneInEachByte = 0x0101010101010101ULL;
+constexpr uint64_t HighBitInEachByte = 0x8080808080808080ULL;
+
+// the high bit of each byte is set where the byte of word is zero, and
+// possibly in the bytes above it.
+uint64_t zeroBytes(uint64_t word) {
+  return (word - OneInEachByte) & ~word & HighBitInEachByte;
+}
+
+// the high bit of each byte is set where the byte of word is a control
+// character, a quote, a backslash or part of a multi-byte UTF-8 sequence, and
+// possibly in the bytes above it.
+uint64_t attention(uint64_t word) {
+  const uint64_t control = (word - OneInEachByte * 0x20) & ~word;
+  const uint64_t quote = zeroBytes(word ^ (OneInEachByte * '"'));
+  const uint64_t backslash = zeroBytes(word ^ (OneInEachByte * '\\'));
+  return (control | quote | backslash | word) & HighBitInEachByte;
+}
+
+// whether any of the bytes of the words needs attention. May give false
+// positives, which only cost a byte by byte look at the words.
+bool needsAttention(uint64_t word) { return attention(word) != 0; }
+bool needsAttention(uint64_t first, uint64_t second) {
+  // the masks are combined before the branch, which compilers turn into
+  // 16 byte vector operations where the target has them.
+  return (attention(first) | attention(second)) != 0;
+}
+
+// returns the length of the valid UTF-8 sequence that starts at pos, or 0 if
+// the sequence is invalid. Rejects overlong encodings and surrogates.
+size_t utf8SequenceLength(absl::string_view value, size_t pos) {
+  const auto byte = [value](size_t i) {
+    return static_cast<unsigned char>(value[i]);
+  };
+  const auto continuation = [&](size_t i, unsigned char low = 0x80,
+                                unsigned char high = 0xBF) {
+    return i < value.size() && byte(i) >= low && byte(i) <= high;
+  };
+  const unsigned char lead = byte(pos);
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    return continuation(pos + 1) ? 2 : 0;
+  }
+  if (lead >= 0xE0 && lead <= 0xEF) {
+    const unsigned char low = lead == 0xE0 ? 0xA0 : 0x80;
+    const unsigned char high = lead == 0xED ? 0x9F : 0xBF;
+    return continuation(pos + 1, low, high) && continuation(pos + 2) ? 3 : 0;
+  }
+  if (lead >= 0xF0 && lead <= 0xF4) {
+    const unsigned char low = lead == 0xF0 ? 0x90 : 0x80;
+    const unsigned char high = lead == 0xF4 ? 0x8F : 0xBF;
+    return continuation(pos + 1, low, high) && continuation(pos + 2) &&
+                   continuation(pos + 3)
+               ? 4
+               : 0;
+  }
+  return 0;
+}
+
+void append(Buffer::Instance &output, const char *data, size_t size) {
+  output.add(data, size);
+}
+void append(std::string &output, const char *data, size_t size) {
+  output.append(data, size);
+}
+
+// appends the escaped value, without quotes.
+template <typename Output>
+void appendEscaped(Output &output, absl::string_view value) {
+  // bytes that don't need escaping are copied in runs.
+  size_t run_start = 0;
+  size_t pos = 0;
+  const auto flush = [&]() {
+    if (pos > run_start) {
+      append(output, value.data() + run_start, pos - run_start);
+    }
+  };
+  const auto escape = [&](absl::string_view escaped) {
+    flush();
+    append(output, escaped.data(), escaped.size());
+    pos++;
+    run_start = pos;
+  };
+
+  while (pos < value.size()) {
+    // most values are runs of plain ascii, which are skipped 16 bytes at a
+    // time, and then 8.
+    if (pos + 2 * sizeof(uint64_t) <= value.size()) {
+      uint64_t words[2];
+      memcpy(words, value.data() + pos, sizeof(words));
+      if (!needsAttention(words[0], words[1])) {
+        pos += sizeof(words);
+        continue;
+      }
+    }
+    if (pos + sizeof(uint64_t) <= value.size()) {
+      uint64_t word;
+      memcpy(&word, value.data() + pos, sizeof(word));
+      if (!needsAttention(word)) {
+        pos += sizeof(word);
+        continue;
+      }
+    }
+
+    const unsigned char c = static_cast<unsigned char>(value[pos]);
+    switch (c) {
+    case '"':
+      escape("\\\"");
+      break;
+    case '\\':
+      escape("\\\\");
+      break;
+    case '\b':
+      escape("\\b");
+      break;
+    case '\f':
+      escape("\\f");
+      break;
+    case '\n':
+      escape("\\n");
+      break;
+    case '\r':
+      escape("\\r");
+      break;
+    case '\t':
+      escape("\\t");
+      break;
+    default:
+      if (c < 0x20) {
+        escape(fmt::format("\\u{:04x}", c));
+      } else if (c < 0x80) {
+        pos++;
+      } else {
+        const size_t length = utf8SequenceLength(value, pos);
+        if (length == 0) {
+          throw EnvoyException(
+              fmt::format("invalid UTF-8 byte at index {}: 0x{:02X}", pos, c));
+        }
+        pos += length;
+      }
+    }
+  }
+  flush();
+}
+
+} // namespace
+
+void appendJsonString(Buffer::Instance &output, absl::string_view value) {
+  output.add("\"", 1);
+  appendEscaped(output, value);
+  output.add("\"", 1);
+}
+
+void appendJsonEscaped(std::string &output, absl::string_view value) {
+  appendEscaped(output, value);
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Appends value to output as a quoted json string. The output is the same as
+ * nlohmann::json::dump() with the default arguments: quotes, backslashes and
+ * control characters are escaped, and UTF-8 is copied as is.
+ *
+ * Throws EnvoyException if value isn't valid UTF-8, as dump() would.
+ */
+void appendJsonString(Buffer::Instance &output, absl::string_view value);
+
+/**
+ * Appends value to output escaped as the contents of a json string, without
+ * the quotes, so that templates can print it between quotes of their own.
+ *
+ * Throws EnvoyException if value isn't valid UTF-8.
+ */
+void appendJsonEscaped(std::string &output, absl::string_view value);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
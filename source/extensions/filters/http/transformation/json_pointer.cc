@@ -0,0 +1,240 @@
+#include "source/extensions/filters/http/transformation/json_pointer.h"
+
+#include <algorithm>
+
+#include "envoy/common/exception.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+#include "fmt/format.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// the characters that end a number or a literal.
+bool isDelimiter(char c) {
+  return isWhitespace(c) || c == ',' || c == '}' || c == ']';
+}
+
+// an array index has no leading zeros, and "-" names no element.
+absl::optional<uint64_t> arrayIndex(absl::string_view name) {
+  uint64_t index;
+  if (name.empty() || (name.size() > 1 && name[0] == '0') ||
+      !std::all_of(name.begin(), name.end(), absl::ascii_isdigit) ||
+      !absl::SimpleAtoi(name, &index)) {
+    return absl::nullopt;
+  }
+  return index;
+}
+
+// whether the key, as written in the document, is the name.
+bool keyEquals(absl::string_view key, absl::string_view name) {
+  if (key.find('\\') == absl::string_view::npos) {
+    return key == name;
+  }
+  // keys with escapes are rare, and unescaped the slow way.
+  const nlohmann::json unescaped =
+      nlohmann::json::parse(absl::StrCat("\"", key, "\""), nullptr, false);
+  return unescaped.is_string() &&
+         unescaped.get_ref<const std::string &>() == name;
+}
+
+class Scanner {
+public:
+  explicit Scanner(absl::string_view document) : document_(document) {}
+
+  char peek() {
+    skipWhitespace();
+    return pos_ < document_.size() ? document_[pos_] : '\0';
+  }
+
+  bool consume(char c) {
+    if (peek() != c) {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  // moves to the value of the named member of the object at pos_.
+  bool findMember(absl::string_view name) {
+    if (!consume('{') || consume('}')) {
+      return false;
+    }
+    do {
+      absl::optional<absl::string_view> key;
+      if (!consume('"') || !(key = string()).has_value() || !consume(':')) {
+        return false;
+      }
+      if (keyEquals(key.value(), name)) {
+        return true;
+      }
+      if (!skipValue()) {
+        return false;
+      }
+    } while (consume(','));
+    return false;
+  }
+
+  // moves to the element of the array at pos_.
+  bool findElement(uint64_t index) {
+    if (!consume('[') || consume(']')) {
+      return false;
+    }
+    for (uint64_t i = 0; i < index; i++) {
+      if (!skipValue() || !consume(',')) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the value at pos_.
+  absl::optional<absl::string_view> value() {
+    if (consume('"')) {
+      return string();
+    }
+    const size_t start = pos_;
+    if (!skipValue()) {
+      return absl::nullopt;
+    }
+    return document_.substr(start, pos_ - start);
+  }
+
+private:
+  void skipWhitespace() {
+    while (pos_ < document_.size() && isWhitespace(document_[pos_])) {
+      ++pos_;
+    }
+  }
+
+  // the contents of the string whose opening quote was consumed.
+  absl::optional<absl::string_view> string() {
+    const size_t start = pos_;
+    while (true) {
+      pos_ = document_.find_first_of("\"\\", pos_);
+      if (pos_ == absl::string_view::npos) {
+        pos_ = document_.size();
+        return absl::nullopt;
+      }
+      if (document_[pos_] == '"') {
+        return document_.substr(start, pos_++ - start);
+      }
+      // the escaped character is skipped along with the backslash.
+      pos_ += 2;
+    }
+  }
+
+  bool skipValue() {
+    switch (peek()) {
+    case '\0':
+      return false;
+    case '"':
+      ++pos_;
+      return string().has_value();
+    case '{':
+    case '[':
+      return skipContainer();
+    default: {
+      const size_t start = pos_;
+      while (pos_ < document_.size() && !isDelimiter(document_[pos_])) {
+        ++pos_;
+      }
+      return pos_ != start;
+    }
+    }
+  }
+
+  // the brackets of the nested values are only counted, not matched.
+  bool skipContainer() {
+    uint32_t depth = 0;
+    while (pos_ < document_.size()) {
+      pos_ = document_.find_first_of("\"{}[]", pos_);
+      if (pos_ == absl::string_view::npos) {
+        break;
+      }
+      switch (document_[pos_++]) {
+      case '"':
+        if (!string().has_value()) {
+          return false;
+        }
+        break;
+      case '{':
+      case '[':
+        ++depth;
+        break;
+      default:
+        if (--depth == 0) {
+          return true;
+        }
+      }
+    }
+    pos_ = document_.size();
+    return false;
+  }
+
+  const absl::string_view document_;
+  size_t pos_{};
+};
+
+} // namespace
+
+JsonPointer::JsonPointer(absl::string_view pointer) {
+  if (pointer.empty()) {
+    return;
+  }
+  if (pointer[0] != '/') {
+    throw EnvoyException(fmt::format(
+        "json pointer '{}' must be empty or start with '/'", pointer));
+  }
+  for (absl::string_view name : absl::StrSplit(pointer.substr(1), '/')) {
+    // the escapes are replaced in a single pass, so that ~01 stands for ~1.
+    std::string unescaped =
+        absl::StrReplaceAll(name, {{"~1", "/"}, {"~0", "~"}});
+    const absl::optional<uint64_t> index = arrayIndex(unescaped);
+    tokens_.push_back(Token{std::move(unescaped), index});
+  }
+}
+
+absl::optional<absl::string_view>
+JsonPointer::find(absl::string_view document) const {
+  Scanner scanner(document);
+  for (const Token &token : tokens_) {
+    switch (scanner.peek()) {
+    case '{':
+      if (!scanner.findMember(token.name)) {
+        return absl::nullopt;
+      }
+      break;
+    case '[':
+      if (!token.index.has_value() ||
+          !scanner.findElement(token.index.value())) {
+        return absl::nullopt;
+      }
+      break;
+    default:
+      return absl::nullopt;
+    }
+  }
+  return scanner.value();
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
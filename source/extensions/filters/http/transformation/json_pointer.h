@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * A JSON pointer (RFC 6901), compiled once, that finds the value it points to
+ * by scanning the text of a json document. The members and elements ahead of
+ * the value are skipped over without being parsed, and the scan stops at the
+ * value, so the rest of the document is never read.
+ */
+class JsonPointer {
+public:
+  /**
+   * @throw EnvoyException if the pointer is neither empty nor starts with '/'.
+   */
+  explicit JsonPointer(absl::string_view pointer);
+
+  /**
+   * @return a view of the value in the document: the contents of a string,
+   * without its quotes and with its escapes as written, or the text of any
+   * other value. nullopt if there is no such value, or if the document isn't
+   * json up to it.
+   */
+  absl::optional<absl::string_view> find(absl::string_view document) const;
+
+private:
+  struct Token {
+    std::string name;
+    // set when the name is an array index.
+    absl::optional<uint64_t> index;
+  };
+
+  std::vector<Token> tokens_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
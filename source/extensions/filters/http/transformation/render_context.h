@@ -0,0 +1,136 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "envoy/config/core/v3/base.pb.h"
+#include "envoy/http/header_map.h"
+
+#include "source/extensions/filters/http/transformation/cluster_metadata_values.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+// Returns a view of the body. The view is valid until the body is modified.
+using GetBodyFunc = std::function<absl::string_view()>;
+
+// header names as written in templates, mapped to their lowered keys.
+using HeaderKeyMap = absl::flat_hash_map<std::string, Http::LowerCaseString>;
+
+// the slots of the extracted values, by the names of their extractors. The
+// names are known at config time, so the slots are assigned once and the
+// values of a request are stored in an array.
+using ExtractionSlots = absl::flat_hash_map<std::string, size_t>;
+
+/**
+ * The extracted values of a request, in the slots of their extractors. The
+ * values are views of the request, so storing them doesn't copy any strings.
+ */
+class Extractions {
+public:
+  Extractions() = default;
+  Extractions(const ExtractionSlots &slots,
+              absl::Span<const absl::string_view> values)
+      : slots_(&slots), values_(values) {}
+
+  /**
+   * @return the slot of the named extractor, if there is one.
+   */
+  absl::optional<size_t> slot(absl::string_view name) const {
+    if (slots_ == nullptr) {
+      return absl::nullopt;
+    }
+    auto it = slots_->find(name);
+    if (it == slots_->end()) {
+      return absl::nullopt;
+    }
+    return it->second;
+  }
+
+  /**
+   * @return the value in the slot, which is empty when the slot is out of
+   * range.
+   */
+  absl::string_view value(size_t slot) const {
+    return slot < values_.size() ? values_[slot] : absl::string_view();
+  }
+
+private:
+  const ExtractionSlots *slots_{};
+  absl::Span<const absl::string_view> values_;
+};
+
+/**
+ * The first values of the headers the templates of a transformation read,
+ * so that a header read by several templates is looked up once. The values
+ * are views of the header maps, so the transformation invalidates a header
+ * whenever it changes it. The keys must outlive the memo.
+ */
+class HeaderMemo {
+public:
+  absl::string_view get(const Http::HeaderMap &headers,
+                        const Http::LowerCaseString &key) {
+    auto inserted = values_.try_emplace(Key{&headers, key.get()});
+    if (inserted.second) {
+      const Http::HeaderMap::GetResult entries = headers.get(key);
+      if (!entries.empty()) {
+        inserted.first->second = entries[0]->value().getStringView();
+      }
+    }
+    return inserted.first->second;
+  }
+
+  // forgets the values of the header in all the header maps.
+  void invalidate(const Http::LowerCaseString &key) {
+    for (auto it = values_.begin(); it != values_.end();) {
+      if (it->first.second == key.get()) {
+        values_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+private:
+  using Key = std::pair<const Http::HeaderMap *, absl::string_view>;
+  absl::flat_hash_map<Key, absl::string_view> values_;
+};
+
+/**
+ * The per-request values that the template callbacks read from. A context is
+ * only bound to a TransformerInstance for the duration of a single render.
+ */
+struct RenderContext {
+  const Http::RequestOrResponseHeaderMap &header_map_;
+  const Http::RequestHeaderMap *request_headers_;
+  GetBodyFunc &body_;
+  const Extractions &extractions_;
+  const nlohmann::json &context_;
+  const std::unordered_map<std::string, std::string> &environ_;
+  const envoy::config::core::v3::Metadata *cluster_metadata_;
+  // the keys of the headers the templates name with string literals, so that
+  // they don't need to be lowered on every lookup.
+  const HeaderKeyMap *header_keys_{};
+  // the converted values of the cluster metadata, when the cluster has them.
+  const ClusterMetadataValues *cluster_metadata_values_{};
+  // remembers the headers looked up by the keys in header_keys_, when set.
+  HeaderMemo *header_memo_{};
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
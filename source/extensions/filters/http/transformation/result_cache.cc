@@ -0,0 +1,106 @@
+#include "source/extensions/filters/http/transformation/result_cache.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+uint64_t totalSize(const std::vector<std::string> &values) {
+  uint64_t size = 0;
+  for (const std::string &value : values) {
+    size += value.size();
+  }
+  return size;
+}
+
+} // namespace
+
+uint64_t CachedTransformation::bytes() const {
+  return (body_.has_value() ? body_->size() : 0) +
+         totalSize(dynamic_metadata_) + totalSize(headers_) +
+         totalSize(headers_to_append_);
+}
+
+uint64_t ResultCache::Key::bytes() const { return totalSize(header_values_); }
+
+ResultCache::ResultCache(uint32_t max_entries, uint64_t max_bytes,
+                         absl::optional<ResultCacheStats> stats)
+    : max_entries_(max_entries), max_bytes_(max_bytes),
+      stats_(std::move(stats)) {}
+
+ResultCache::~ResultCache() {
+  if (stats_.has_value()) {
+    absl::MutexLock lock(&mutex_);
+    stats_->entries_.sub(entries_.size());
+    stats_->bytes_.sub(bytes_);
+  }
+}
+
+ResultCacheStats ResultCache::generateStats(Stats::Scope &scope) {
+  const std::string prefix = "transformation.inja.result_cache.";
+  return {ALL_RESULT_CACHE_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                 POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+CachedTransformationSharedPtr ResultCache::find(const Key &key) {
+  absl::MutexLock lock(&mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    if (stats_.has_value()) {
+      stats_->misses_.inc();
+    }
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  if (stats_.has_value()) {
+    stats_->hits_.inc();
+  }
+  return it->second->result_;
+}
+
+void ResultCache::insert(Key key, CachedTransformationSharedPtr result) {
+  const uint64_t bytes = key.bytes() + result->bytes();
+  if (bytes > max_bytes_) {
+    return;
+  }
+
+  absl::MutexLock lock(&mutex_);
+  if (index_.contains(key)) {
+    // another worker rendered the same result in the meantime.
+    return;
+  }
+  entries_.push_front(Entry{key, std::move(result), bytes});
+  index_.emplace(std::move(key), entries_.begin());
+  bytes_ += bytes;
+  if (stats_.has_value()) {
+    stats_->entries_.inc();
+    stats_->bytes_.add(bytes);
+  }
+  while (entries_.size() > max_entries_ || bytes_ > max_bytes_) {
+    evict();
+  }
+}
+
+size_t ResultCache::size() {
+  absl::MutexLock lock(&mutex_);
+  return entries_.size();
+}
+
+void ResultCache::evict() {
+  const Entry &entry = entries_.back();
+  bytes_ -= entry.bytes_;
+  if (stats_.has_value()) {
+    stats_->entries_.dec();
+    stats_->bytes_.sub(entry.bytes_);
+    stats_->evictions_.inc();
+  }
+  index_.erase(entry.key_);
+  entries_.pop_back();
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * All stats for the result caches. @see stats_macros.h
+ */
+#define ALL_RESULT_CACHE_STATS(COUNTER, GAUGE)                                 \
+  COUNTER(hits)                                                                \
+  COUNTER(misses)                                                              \
+  COUNTER(evictions)                                                           \
+  GAUGE(entries, Accumulate)                                                   \
+  GAUGE(bytes, Accumulate)
+
+/**
+ * Wrapper struct for result cache stats. @see stats_macros.h
+ */
+struct ResultCacheStats {
+  ALL_RESULT_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+/**
+ * The rendered outputs of a transformation, in the order of the templates
+ * that rendered them, so that they can be applied to another stream.
+ */
+struct CachedTransformation {
+  uint64_t bytes() const;
+
+  absl::optional<std::string> body_;
+  std::vector<std::string> dynamic_metadata_;
+  std::vector<std::string> headers_;
+  std::vector<std::string> headers_to_append_;
+};
+
+using CachedTransformationSharedPtr = std::shared_ptr<const CachedTransformation>;
+
+/**
+ * A least recently used cache of the results of a transformation, bounded
+ * both by the number of results and by their total size. It is shared by all
+ * the workers.
+ */
+class ResultCache {
+public:
+  /**
+   * What the result depends on. The body is only kept as a hash, while the
+   * values of the headers the transformation reads are compared as they are.
+   */
+  struct Key {
+    template <typename H> friend H AbslHashValue(H h, const Key &key) {
+      return H::combine(std::move(h), key.body_hash_, key.body_length_,
+                        key.header_values_);
+    }
+    bool operator==(const Key &other) const {
+      return body_hash_ == other.body_hash_ &&
+             body_length_ == other.body_length_ &&
+             header_values_ == other.header_values_;
+    }
+    uint64_t bytes() const;
+
+    uint64_t body_hash_{};
+    uint64_t body_length_{};
+    std::vector<std::string> header_values_;
+  };
+
+  ResultCache(uint32_t max_entries, uint64_t max_bytes,
+              absl::optional<ResultCacheStats> stats);
+  ~ResultCache();
+
+  static ResultCacheStats generateStats(Stats::Scope &scope);
+
+  // @return the cached result, or nullptr if there is none.
+  CachedTransformationSharedPtr find(const Key &key);
+
+  // caches the result, evicting the least recently used ones to make room.
+  void insert(Key key, CachedTransformationSharedPtr result);
+
+  size_t size();
+
+private:
+  struct Entry {
+    Key key_;
+    CachedTransformationSharedPtr result_;
+    uint64_t bytes_;
+  };
+  using EntryList = std::list<Entry>;
+
+  void evict() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const uint32_t max_entries_;
+  const uint64_t max_bytes_;
+  absl::optional<ResultCacheStats> stats_;
+
+  absl::Mutex mutex_;
+  // most recently used first.
+  EntryList entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<Key, EntryList::iterator> index_ ABSL_GUARDED_BY(mutex_);
+  uint64_t bytes_ ABSL_GUARDED_BY(mutex_){};
+};
+
+using ResultCachePtr = std::unique_ptr<ResultCache>;
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,52 @@
+#include "source/extensions/filters/http/transformation/shared_json_body.h"
+
+#include "source/common/common/hash.h"
+#include "source/common/common/macros.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+const std::string &SharedJsonBody::key() {
+  CONSTRUCT_ON_FIRST_USE(std::string, "io.solo.transformation.json_body");
+}
+
+SharedJsonBody::Version SharedJsonBody::version(absl::string_view body) {
+  return {HashUtil::xxHash64(body), body.size()};
+}
+
+void SharedJsonBody::expect(StreamInfo::FilterState &filter_state) {
+  if (!expected(filter_state)) {
+    store(filter_state, Version{}, nullptr);
+  }
+}
+
+bool SharedJsonBody::expected(const StreamInfo::FilterState &filter_state) {
+  return filter_state.hasData<SharedJsonBody>(key());
+}
+
+SharedJsonBody::JsonSharedPtr
+SharedJsonBody::find(StreamInfo::FilterState &filter_state,
+                     const Version &version) {
+  const auto *shared = filter_state.getDataReadOnly<SharedJsonBody>(key());
+  if (shared == nullptr || !(shared->version_ == version)) {
+    return nullptr;
+  }
+  return shared->json_;
+}
+
+void SharedJsonBody::store(StreamInfo::FilterState &filter_state,
+                           const Version &version, JsonSharedPtr json) {
+  // mutable, so that a transformation of a later body replaces it.
+  filter_state.setData(key(),
+                       std::shared_ptr<SharedJsonBody>(
+                           new SharedJsonBody(version, std::move(json))),
+                       StreamInfo::FilterState::StateType::Mutable,
+                       StreamInfo::FilterState::LifeSpan::FilterChain);
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "envoy/stream_info/filter_state.h"
+
+#include "absl/strings/string_view.h"
+
+#include "nlohmann/json.hpp"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * A json body parsed by a transformation, kept in the filter state so that
+ * the later transformations of the stream (the ones of later stages, or of
+ * the aws_lambda filter) don't parse the same body again. The document is
+ * keyed by a version of the body it was parsed from, and is only reused
+ * while the body is unchanged. The body is only hashed and the document only
+ * stored for the streams that expect a later transformation to reuse it.
+ */
+class SharedJsonBody : public StreamInfo::FilterState::Object {
+public:
+  using JsonSharedPtr = std::shared_ptr<const nlohmann::json>;
+
+  static const std::string &key();
+
+  // identifies the content of a body.
+  struct Version {
+    uint64_t hash_;
+    uint64_t length_;
+
+    bool operator==(const Version &other) const {
+      return hash_ == other.hash_ && length_ == other.length_;
+    }
+  };
+  static Version version(absl::string_view body);
+
+  /**
+   * Marks the stream as one whose transformations share their parsed body,
+   * unless a document is stored already.
+   */
+  static void expect(StreamInfo::FilterState &filter_state);
+
+  // whether the stream was marked by expect(), or has a stored document.
+  static bool expected(const StreamInfo::FilterState &filter_state);
+
+  /**
+   * @return the document parsed from the body with this version, if a
+   * transformation of the stream stored one.
+   */
+  static JsonSharedPtr find(StreamInfo::FilterState &filter_state,
+                            const Version &version);
+
+  // replaces the document stored for the stream.
+  static void store(StreamInfo::FilterState &filter_state,
+                    const Version &version, JsonSharedPtr json);
+
+private:
+  SharedJsonBody(const Version &version, JsonSharedPtr json)
+      : version_(version), json_(std::move(json)) {}
+
+  const Version version_;
+  const JsonSharedPtr json_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
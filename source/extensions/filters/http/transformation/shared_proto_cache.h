@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "source/common/protobuf/protobuf.h"
+#include "source/common/protobuf/utility.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Objects built from config protos, shared across config generations. A
+ * control plane update rebuilds the whole filter config, even when only a few
+ * of its rules changed; the new config is built while the old one is still
+ * alive, so looking up the objects of the old config by the hash of their
+ * proto lets the unchanged rules reuse them instead of building them again.
+ * An entry lives for as long as a config holds on to it.
+ *
+ * Entries are also keyed on the owner (e.g. the stats scope) the object was
+ * built with, so that an object is only shared by configs that would have
+ * built it the same way.
+ */
+template <class T> class SharedProtoCache {
+public:
+  using SharedPtr = std::shared_ptr<const T>;
+
+  /**
+   * @param proto the config the object is built from.
+   * @param owner what the object depends on besides the proto.
+   * @param create builds the object when there is none to reuse. Exceptions
+   * it throws are propagated and nothing is cached.
+   * @return the object for the proto, which may be shared with other callers.
+   */
+  template <class Factory>
+  SharedPtr getOrCreate(const Protobuf::Message &proto, const void *owner,
+                        Factory &&create) {
+    return getOrCreate(proto, owner, "", std::forward<Factory>(create));
+  }
+
+  /**
+   * As above, for objects that also depend on a name within the owner, e.g.
+   * the stats prefix in the scope.
+   */
+  template <class Factory>
+  SharedPtr getOrCreate(const Protobuf::Message &proto, const void *owner,
+                        absl::string_view name, Factory &&create) {
+    const Key key(MessageUtil::hash(proto), owner, std::string(name));
+    {
+      absl::MutexLock lock(&mutex_);
+      auto it = entries_.find(key);
+      if (it != entries_.end()) {
+        if (SharedPtr entry = it->second.lock()) {
+          return entry;
+        }
+      }
+    }
+
+    // build without holding the lock, as building may take a while.
+    SharedPtr built = create();
+    if (built == nullptr) {
+      return built;
+    }
+    // the built object is owned by the deleter of the shared entry, so that
+    // dropping the last reference to the entry also removes it from the map.
+    const T *object = built.get();
+    SharedPtr entry(object, [this, key, built](const T *) mutable {
+      release(key);
+      built.reset();
+    });
+
+    // the lock is declared after the entry so that it is unlocked before an
+    // unused entry releases itself.
+    absl::MutexLock lock(&mutex_);
+    std::weak_ptr<const T> &cached = entries_[key];
+    if (SharedPtr existing = cached.lock()) {
+      // another caller built the same object in the meantime.
+      return existing;
+    }
+    cached = entry;
+    return entry;
+  }
+
+  // the number of distinct objects that are currently shared.
+  size_t size() const {
+    absl::MutexLock lock(&mutex_);
+    return entries_.size();
+  }
+
+private:
+  using Key = std::tuple<uint64_t, const void *, std::string>;
+
+  void release(const Key &key) {
+    absl::MutexLock lock(&mutex_);
+    auto it = entries_.find(key);
+    // the entry may have been replaced after the last reference was dropped.
+    if (it != entries_.end() && it->second.expired()) {
+      entries_.erase(it);
+    }
+  }
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<Key, std::weak_ptr<const T>>
+      entries_ ABSL_GUARDED_BY(mutex_);
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,223 @@
+#include "source/extensions/filters/http/transformation/template_analysis.h"
+
+#include "source/common/common/assert.h"
+#include "source/common/common/macros.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/strip.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+// These are the default inja delimiters, which are the ones the
+// transformation filter uses.
+constexpr absl::string_view ExpressionOpen = "{{";
+constexpr absl::string_view ExpressionClose = "}}";
+constexpr absl::string_view StatementOpen = "{%";
+constexpr absl::string_view StatementClose = "%}";
+constexpr absl::string_view CommentOpen = "{#";
+constexpr absl::string_view CommentClose = "#}";
+constexpr absl::string_view LineStatement = "##";
+
+const absl::flat_hash_set<absl::string_view> &keywords() {
+  CONSTRUCT_ON_FIRST_USE(absl::flat_hash_set<absl::string_view>,
+                         {"in", "if", "else", "endif", "for", "endfor", "and",
+                          "or", "not", "true", "false", "null", "set",
+                          "include"});
+}
+
+const absl::flat_hash_set<std::string> &noArguments() {
+  CONSTRUCT_ON_FIRST_USE(absl::flat_hash_set<std::string>);
+}
+
+bool isIdStart(char c) { return absl::ascii_isalpha(c) || c == '_'; }
+
+// matches the characters the inja lexer accepts in an identifier.
+bool isIdChar(char c) {
+  return absl::ascii_isalnum(c) || c == '_' || c == '.' || c == '/' ||
+         c == '-';
+}
+
+// returns the position right after the string literal that starts at pos.
+size_t skipString(absl::string_view text, size_t pos) {
+  ASSERT(text[pos] == '"');
+  for (pos++; pos < text.size(); pos++) {
+    if (text[pos] == '\\') {
+      pos++;
+    } else if (text[pos] == '"') {
+      return pos + 1;
+    }
+  }
+  return text.size();
+}
+
+// returns the position of the close delimiter, ignoring delimiters inside of
+// string literals, or npos if the block is not terminated.
+size_t findClose(absl::string_view text, size_t pos, absl::string_view close) {
+  while (pos < text.size()) {
+    if (text[pos] == '"') {
+      pos = skipString(text, pos);
+    } else if (absl::StartsWith(text.substr(pos), close)) {
+      return pos;
+    } else {
+      pos++;
+    }
+  }
+  return absl::string_view::npos;
+}
+
+size_t skipWhitespace(absl::string_view text, size_t pos) {
+  while (pos < text.size() && absl::ascii_isspace(text[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+// returns the contents of the string literal that is the only argument of the
+// call whose arguments start at pos, if there is one.
+absl::optional<absl::string_view> literalArgument(absl::string_view expression,
+                                                  size_t pos) {
+  pos = skipWhitespace(expression, pos);
+  if (pos >= expression.size() || expression[pos] != '"') {
+    return absl::nullopt;
+  }
+  const size_t end = skipString(expression, pos);
+  const size_t close = skipWhitespace(expression, end);
+  if (end - pos < 2 || close >= expression.size() || expression[close] != ')') {
+    return absl::nullopt;
+  }
+  return expression.substr(pos + 1, end - pos - 2);
+}
+
+} // namespace
+
+TemplateDependencies TemplateDependencies::analyze(absl::string_view text) {
+  TemplateDependencies dependencies;
+
+  // scans the block that starts at pos (after the open delimiter) and returns
+  // the position after its close delimiter.
+  auto scan_block = [&dependencies, text](size_t pos,
+                                          absl::string_view close) {
+    size_t end = findClose(text, pos, close);
+    if (end == absl::string_view::npos) {
+      dependencies.scanExpression(text.substr(pos));
+      return text.size();
+    }
+    dependencies.scanExpression(text.substr(pos, end - pos));
+    return end + close.size();
+  };
+
+  bool line_start = true;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    absl::string_view rest = text.substr(pos);
+    if (absl::StartsWith(rest, CommentOpen)) {
+      size_t end = text.find(CommentClose, pos + CommentOpen.size());
+      pos = end == absl::string_view::npos ? text.size()
+                                           : end + CommentClose.size();
+      line_start = false;
+    } else if (absl::StartsWith(rest, ExpressionOpen)) {
+      pos = scan_block(pos + ExpressionOpen.size(), ExpressionClose);
+      line_start = false;
+    } else if (absl::StartsWith(rest, StatementOpen)) {
+      pos = scan_block(pos + StatementOpen.size(), StatementClose);
+      line_start = false;
+    } else if (line_start && absl::StartsWith(rest, LineStatement)) {
+      pos = scan_block(pos + LineStatement.size(), "\n");
+      line_start = true;
+    } else {
+      const char c = text[pos];
+      line_start = c == '\n' || (line_start && (c == ' ' || c == '\t'));
+      pos++;
+    }
+  }
+  return dependencies;
+}
+
+void TemplateDependencies::scanExpression(absl::string_view expression) {
+  size_t pos = 0;
+  while (pos < expression.size()) {
+    const char c = expression[pos];
+    if (c == '"') {
+      pos = skipString(expression, pos);
+      continue;
+    }
+    if (absl::ascii_isdigit(c)) {
+      // skip numbers so that exponents are not taken as identifiers.
+      while (pos < expression.size() &&
+             (absl::ascii_isalnum(expression[pos]) || expression[pos] == '.')) {
+        pos++;
+      }
+      continue;
+    }
+    if (!isIdStart(c)) {
+      pos++;
+      continue;
+    }
+
+    const size_t start = pos;
+    while (pos < expression.size() && isIdChar(expression[pos])) {
+      pos++;
+    }
+    const absl::string_view id = expression.substr(start, pos - start);
+    const size_t next = skipWhitespace(expression, pos);
+    if (next < expression.size() && expression[next] == '(') {
+      functions_.emplace(id);
+      const absl::optional<absl::string_view> arg =
+          literalArgument(expression, next + 1);
+      if (arg.has_value()) {
+        literal_arguments_[id].emplace(arg.value());
+        // exists("name") looks up a variable by its name.
+        if (id == "exists") {
+          variables_.emplace(arg.value());
+        }
+      } else {
+        dynamic_argument_functions_.emplace(id);
+      }
+    } else if (!keywords().contains(id)) {
+      variables_.emplace(id);
+    }
+  }
+}
+
+absl::flat_hash_set<std::string>
+TemplateDependencies::topLevelVariables(bool pointer_notation) const {
+  absl::flat_hash_set<std::string> keys;
+  for (absl::string_view variable : variables_) {
+    if (pointer_notation) {
+      absl::ConsumePrefix(&variable, "/");
+      keys.emplace(variable.substr(0, variable.find('/')));
+    } else {
+      keys.emplace(variable.substr(0, variable.find('.')));
+    }
+  }
+  return keys;
+}
+
+const absl::flat_hash_set<std::string> &
+TemplateDependencies::literalArguments(absl::string_view function) const {
+  auto it = literal_arguments_.find(function);
+  return it == literal_arguments_.end() ? noArguments() : it->second;
+}
+
+void TemplateDependencies::merge(const TemplateDependencies &other) {
+  functions_.insert(other.functions_.begin(), other.functions_.end());
+  variables_.insert(other.variables_.begin(), other.variables_.end());
+  for (const auto &arguments : other.literal_arguments_) {
+    literal_arguments_[arguments.first].insert(arguments.second.begin(),
+                                               arguments.second.end());
+  }
+  dynamic_argument_functions_.insert(other.dynamic_argument_functions_.begin(),
+                                     other.dynamic_argument_functions_.end());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * What a template reads from its environment when it is rendered. The
+ * analysis is done on the template source, and over-approximates: a name that
+ * is listed may not be read at runtime, but everything that can be read is
+ * listed.
+ */
+class TemplateDependencies {
+public:
+  /**
+   * Scans the inja template source for function calls and variable lookups.
+   * @param text the template source.
+   */
+  static TemplateDependencies analyze(absl::string_view text);
+
+  void merge(const TemplateDependencies &other);
+
+  // names of all the functions called, including the inja builtins.
+  const absl::flat_hash_set<std::string> &functions() const {
+    return functions_;
+  }
+  // the variable paths looked up in the json context, as written in the
+  // template (e.g. "a.b" or "a/b").
+  const absl::flat_hash_set<std::string> &variables() const {
+    return variables_;
+  }
+
+  /**
+   * @param function the name of a function that takes one argument.
+   * @return the string literals that the function is called with.
+   */
+  const absl::flat_hash_set<std::string> &
+  literalArguments(absl::string_view function) const;
+
+  // the names passed as string literals to env().
+  const absl::flat_hash_set<std::string> &environmentVariables() const {
+    return literalArguments("env");
+  }
+  // true if the function is called with anything but a single string
+  // literal, e.g. with the result of another call.
+  bool callsWithDynamicArguments(absl::string_view function) const {
+    return dynamic_argument_functions_.contains(function);
+  }
+  // true if env() is called with an argument that isn't a string literal, in
+  // which case any environment variable may be read.
+  bool readsAnyEnvironmentVariable() const {
+    return callsWithDynamicArguments("env");
+  }
+
+  /**
+   * @param pointer_notation whether the template uses json pointer notation
+   * (advanced templates) rather than dot notation to access elements.
+   * @return the top level keys of the json context that the variables read.
+   */
+  absl::flat_hash_set<std::string> topLevelVariables(bool pointer_notation) const;
+
+  bool callsFunction(absl::string_view name) const {
+    return functions_.contains(name);
+  }
+
+  // true if rendering may read anything from the json context.
+  bool readsContext() const {
+    return !variables_.empty() || callsFunction("context");
+  }
+
+private:
+  void scanExpression(absl::string_view expression);
+
+  absl::flat_hash_set<std::string> functions_;
+  absl::flat_hash_set<std::string> variables_;
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
+      literal_arguments_;
+  absl::flat_hash_set<std::string> dynamic_argument_functions_;
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
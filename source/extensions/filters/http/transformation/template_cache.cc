@@ -0,0 +1,82 @@
+#include "source/extensions/filters/http/transformation/template_cache.h"
+
+#include "source/common/common/macros.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+constexpr size_t MaxNameLength = 128;
+} // namespace
+
+TemplateCache &TemplateCache::get() {
+  MUTABLE_CONSTRUCT_ON_FIRST_USE(TemplateCache);
+}
+
+TemplateCache::EntrySharedPtr TemplateCache::parse(absl::string_view text,
+                                                   bool advanced_templates) {
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = entries_.find(Key(text, advanced_templates));
+    if (it != entries_.end()) {
+      if (EntrySharedPtr entry = it->second.lock()) {
+        return entry;
+      }
+    }
+  }
+
+  // parse without holding the lock; a template that fails to parse throws and
+  // is not cached.
+  inja::ParserConfig parser_config;
+  inja::LexerConfig lexer_config;
+  inja::TemplateStorage template_storage;
+  if (!advanced_templates) {
+    parser_config.notation = inja::ElementNotation::Dot;
+  }
+  inja::Parser parser(parser_config, lexer_config, template_storage);
+  auto *parsed = new Entry{std::string(text), advanced_templates,
+                           parser.parse(text),
+                           TemplateDependencies::analyze(text),
+                           std::string(text.substr(0, MaxNameLength))};
+  EntrySharedPtr entry(parsed,
+                       [this](const Entry *released) { release(released); });
+
+  // the lock is declared after the entry so that it is unlocked before an
+  // unused entry releases itself.
+  absl::MutexLock lock(&mutex_);
+  auto it = entries_.find(Key(text, advanced_templates));
+  if (it != entries_.end()) {
+    if (EntrySharedPtr existing = it->second.lock()) {
+      // another caller parsed the same template in the meantime.
+      return existing;
+    }
+    // the key views the text of the expired entry, which is about to go.
+    entries_.erase(it);
+  }
+  entries_.emplace(Key(parsed->text_, advanced_templates), entry);
+  return entry;
+}
+
+size_t TemplateCache::size() const {
+  absl::MutexLock lock(&mutex_);
+  return entries_.size();
+}
+
+void TemplateCache::release(const Entry *entry) {
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = entries_.find(Key(entry->text_, entry->advanced_templates_));
+    // the entry may have been replaced after the last reference was dropped.
+    if (it != entries_.end() && it->second.expired()) {
+      entries_.erase(it);
+    }
+  }
+  delete entry;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
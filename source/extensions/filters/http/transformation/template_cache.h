@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "source/extensions/filters/http/transformation/template_analysis.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+#include "inja/inja.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Parsed templates shared by all the transformers in the process. Generated
+ * configs tend to repeat the same template text on many routes, so templates
+ * are keyed on their text and notation and parsed once. An entry lives for as
+ * long as a transformer holds on to it.
+ */
+class TemplateCache {
+public:
+  struct Entry {
+    // the key of the entry, which the cache refers to rather than copies.
+    std::string text_;
+    bool advanced_templates_;
+    inja::Template template_;
+    TemplateDependencies dependencies_;
+    // the start of the template text, to tell templates apart in profiles.
+    std::string name_;
+  };
+  using EntrySharedPtr = std::shared_ptr<const Entry>;
+
+  static TemplateCache &get();
+
+  /**
+   * @param text the template source.
+   * @param advanced_templates whether the template uses json pointer notation
+   * rather than dot notation.
+   * @return the parsed template, which may be shared with other callers.
+   * Throws if the template fails to parse.
+   */
+  EntrySharedPtr parse(absl::string_view text, bool advanced_templates);
+
+  // the number of distinct templates that are currently parsed.
+  size_t size() const;
+
+private:
+  // views the text of the entry the key maps to, which is only released once
+  // the key has been erased or maps to another entry.
+  using Key = std::pair<absl::string_view, bool>;
+
+  void release(const Entry *entry);
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<Key, std::weak_ptr<const Entry>>
+      entries_ ABSL_GUARDED_BY(mutex_);
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
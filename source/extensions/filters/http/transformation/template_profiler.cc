@@ -0,0 +1,146 @@
+#include "source/extensions/filters/http/transformation/template_profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "source/common/common/macros.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
+
+#include "absl/strings/numbers.h"
+#include "nlohmann/json.hpp"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+constexpr uint32_t DefaultSampleRate = 100;
+
+// the stats as a json array, with the most expensive first.
+nlohmann::json
+toJson(const absl::flat_hash_map<std::string, TemplateProfiler::Stat> &stats,
+       const std::string &name_key) {
+  std::vector<std::pair<std::string, TemplateProfiler::Stat>> sorted(
+      stats.begin(), stats.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.total_ > b.second.total_;
+  });
+  nlohmann::json array = nlohmann::json::array();
+  for (const auto &entry : sorted) {
+    const auto total_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            entry.second.total_)
+            .count();
+    array.push_back({{name_key, entry.first},
+                     {"count", entry.second.count_},
+                     {"total_us", total_us},
+                     {"mean_us", total_us / entry.second.count_}});
+  }
+  return array;
+}
+
+} // namespace
+
+void TemplateProfiler::RenderProfile::addCallback(
+    absl::string_view name, std::chrono::nanoseconds elapsed) {
+  Stat &stat = callbacks_[name];
+  stat.count_++;
+  stat.total_ += elapsed;
+}
+
+TemplateProfiler &TemplateProfiler::get() {
+  MUTABLE_CONSTRUCT_ON_FIRST_USE(TemplateProfiler);
+}
+
+void TemplateProfiler::enable(uint32_t sample_rate) {
+  sample_rate_.store(sample_rate, std::memory_order_relaxed);
+}
+
+void TemplateProfiler::disable() {
+  sample_rate_.store(0, std::memory_order_relaxed);
+}
+
+void TemplateProfiler::reset() {
+  absl::MutexLock lock(&mutex_);
+  templates_.clear();
+  callbacks_.clear();
+}
+
+void TemplateProfiler::record(absl::string_view template_name,
+                              std::chrono::nanoseconds elapsed,
+                              const RenderProfile &profile) {
+  absl::MutexLock lock(&mutex_);
+  Stat &stat = templates_[template_name];
+  stat.count_++;
+  stat.total_ += elapsed;
+  for (const auto &callback : profile.callbacks_) {
+    Stat &callback_stat = callbacks_[callback.first];
+    callback_stat.count_ += callback.second.count_;
+    callback_stat.total_ += callback.second.total_;
+  }
+}
+
+std::string TemplateProfiler::dump() const {
+  absl::MutexLock lock(&mutex_);
+  nlohmann::json profile = {
+      {"sample_rate", sample_rate_.load(std::memory_order_relaxed)},
+      {"templates", toJson(templates_, "template")},
+      {"callbacks", toJson(callbacks_, "callback")}};
+  return profile.dump(2);
+}
+
+void TemplateProfiler::registerAdminHandlers(Server::Admin &admin) {
+  // fails without side effects when the handlers are already registered.
+  admin.addHandler(
+      "/transformation/profile", "dump the transformation template profile",
+      [this](absl::string_view, Http::ResponseHeaderMap &response_headers,
+             Buffer::Instance &response, Server::AdminStream &) {
+        response_headers.setReferenceContentType(
+            Http::Headers::get().ContentTypeValues.Json);
+        response.add(dump());
+        return Http::Code::OK;
+      },
+      false, false);
+  admin.addHandler(
+      "/transformation/profile/config",
+      "enable=<sample rate>, disable or reset the transformation template "
+      "profile",
+      [this](absl::string_view path_and_query, Http::ResponseHeaderMap &,
+             Buffer::Instance &response, Server::AdminStream &) {
+        return handleConfig(path_and_query, response);
+      },
+      false, true);
+}
+
+Http::Code TemplateProfiler::handleConfig(absl::string_view path_and_query,
+                                          Buffer::Instance &response) {
+  const Http::Utility::QueryParams params =
+      Http::Utility::parseAndDecodeQueryString(path_and_query);
+  if (params.count("disable") != 0) {
+    disable();
+  } else if (params.count("reset") != 0) {
+    reset();
+  } else if (params.count("enable") != 0) {
+    uint32_t sample_rate = DefaultSampleRate;
+    const std::string &value = params.at("enable");
+    if (!value.empty() &&
+        (!absl::SimpleAtoi(value, &sample_rate) || sample_rate == 0)) {
+      response.add("enable takes a positive sample rate\n");
+      return Http::Code::BadRequest;
+    }
+    enable(sample_rate);
+  } else {
+    response.add("usage: enable=<sample rate>, disable or reset\n");
+    return Http::Code::BadRequest;
+  }
+  response.add("OK\n");
+  return Http::Code::OK;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/http/codes.h"
+#include "envoy/http/header_map.h"
+#include "envoy/server/admin.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * An opt-in sampling profiler for template rendering. When enabled, one in
+ * every sample_rate renders on each worker records the time spent rendering
+ * the template and in each of the callbacks it calls. The profile is toggled
+ * and read through the admin endpoints registered by registerAdminHandlers().
+ */
+class TemplateProfiler {
+public:
+  struct Stat {
+    uint64_t count_{};
+    std::chrono::nanoseconds total_{};
+  };
+
+  /**
+   * What a single sampled render spent its time on. Only used by the thread
+   * that renders, so it needs no locking.
+   */
+  class RenderProfile {
+  public:
+    void addCallback(absl::string_view name, std::chrono::nanoseconds elapsed);
+
+  private:
+    friend class TemplateProfiler;
+    absl::flat_hash_map<std::string, Stat> callbacks_;
+  };
+
+  static TemplateProfiler &get();
+
+  /**
+   * @param sample_rate profile one in every sample_rate renders.
+   */
+  void enable(uint32_t sample_rate);
+  void disable();
+  void reset();
+
+  /**
+   * @param render_count how many renders the calling thread has done.
+   * @return whether the next render should be profiled.
+   */
+  bool shouldSample(uint64_t render_count) const {
+    const uint32_t sample_rate = sample_rate_.load(std::memory_order_relaxed);
+    return sample_rate != 0 && render_count % sample_rate == 0;
+  }
+
+  void record(absl::string_view template_name, std::chrono::nanoseconds elapsed,
+              const RenderProfile &profile);
+
+  // the profile collected so far, as a json object.
+  std::string dump() const;
+
+  /**
+   * Registers /transformation/profile, which dumps the profile, and
+   * /transformation/profile/config, which takes one of enable=<sample rate>,
+   * disable or reset.
+   */
+  void registerAdminHandlers(Server::Admin &admin);
+
+  Http::Code handleConfig(absl::string_view path_and_query,
+                          Buffer::Instance &response);
+
+private:
+  std::atomic<uint32_t> sample_rate_{};
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Stat> templates_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<std::string, Stat> callbacks_ ABSL_GUARDED_BY(mutex_);
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,133 @@
+#include "source/extensions/filters/http/transformation/template_shadow.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "source/common/common/macros.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
+
+#include "absl/strings/numbers.h"
+#include "nlohmann/json.hpp"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+constexpr uint32_t DefaultSampleRate = 100;
+
+} // namespace
+
+TemplateShadow &TemplateShadow::get() {
+  MUTABLE_CONSTRUCT_ON_FIRST_USE(TemplateShadow);
+}
+
+void TemplateShadow::enable(uint32_t sample_rate) {
+  sample_rate_.store(sample_rate, std::memory_order_relaxed);
+}
+
+void TemplateShadow::disable() {
+  sample_rate_.store(0, std::memory_order_relaxed);
+}
+
+void TemplateShadow::reset() {
+  absl::MutexLock lock(&mutex_);
+  templates_.clear();
+}
+
+void TemplateShadow::record(absl::string_view template_name, bool matched,
+                            std::chrono::nanoseconds compiled_elapsed,
+                            std::chrono::nanoseconds inja_elapsed) {
+  absl::MutexLock lock(&mutex_);
+  Stat &stat = templates_[template_name];
+  stat.count_++;
+  if (!matched) {
+    stat.mismatches_++;
+  }
+  stat.compiled_total_ += compiled_elapsed;
+  stat.inja_total_ += inja_elapsed;
+}
+
+std::string TemplateShadow::dump() const {
+  absl::MutexLock lock(&mutex_);
+  std::vector<std::pair<std::string, Stat>> sorted(templates_.begin(),
+                                                   templates_.end());
+  // the templates that don't match first, then the most rendered.
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    if (a.second.mismatches_ != b.second.mismatches_) {
+      return a.second.mismatches_ > b.second.mismatches_;
+    }
+    return a.second.count_ > b.second.count_;
+  });
+  nlohmann::json templates = nlohmann::json::array();
+  for (const auto &entry : sorted) {
+    const Stat &stat = entry.second;
+    templates.push_back(
+        {{"template", entry.first},
+         {"count", stat.count_},
+         {"mismatches", stat.mismatches_},
+         {"compiled_mean_ns", stat.compiled_total_.count() / stat.count_},
+         {"inja_mean_ns", stat.inja_total_.count() / stat.count_}});
+  }
+  nlohmann::json shadow = {
+      {"sample_rate", sample_rate_.load(std::memory_order_relaxed)},
+      {"templates", std::move(templates)}};
+  return shadow.dump(2);
+}
+
+void TemplateShadow::registerAdminHandlers(Server::Admin &admin) {
+  // fails without side effects when the handlers are already registered.
+  admin.addHandler(
+      "/transformation/shadow",
+      "dump the comparison of compiled templates with inja",
+      [this](absl::string_view, Http::ResponseHeaderMap &response_headers,
+             Buffer::Instance &response, Server::AdminStream &) {
+        response_headers.setReferenceContentType(
+            Http::Headers::get().ContentTypeValues.Json);
+        response.add(dump());
+        return Http::Code::OK;
+      },
+      false, false);
+  admin.addHandler(
+      "/transformation/shadow/config",
+      "enable=<sample rate>, disable or reset the comparison of compiled "
+      "templates with inja",
+      [this](absl::string_view path_and_query, Http::ResponseHeaderMap &,
+             Buffer::Instance &response, Server::AdminStream &) {
+        return handleConfig(path_and_query, response);
+      },
+      false, true);
+}
+
+Http::Code TemplateShadow::handleConfig(absl::string_view path_and_query,
+                                        Buffer::Instance &response) {
+  const Http::Utility::QueryParams params =
+      Http::Utility::parseAndDecodeQueryString(path_and_query);
+  if (params.count("disable") != 0) {
+    disable();
+  } else if (params.count("reset") != 0) {
+    reset();
+  } else if (params.count("enable") != 0) {
+    uint32_t sample_rate = DefaultSampleRate;
+    const std::string &value = params.at("enable");
+    if (!value.empty() &&
+        (!absl::SimpleAtoi(value, &sample_rate) || sample_rate == 0)) {
+      response.add("enable takes a positive sample rate\n");
+      return Http::Code::BadRequest;
+    }
+    enable(sample_rate);
+  } else {
+    response.add("usage: enable=<sample rate>, disable or reset\n");
+    return Http::Code::BadRequest;
+  }
+  response.add("OK\n");
+  return Http::Code::OK;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/http/codes.h"
+#include "envoy/server/admin.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * An opt-in comparison of the compiled templates with inja. When enabled, one
+ * in every sample_rate compiled renders on each worker is rendered by inja
+ * too, and the outputs and the time each engine took are recorded. The
+ * request always gets the compiled output. The comparison is toggled and read
+ * through the admin endpoints registered by registerAdminHandlers().
+ */
+class TemplateShadow {
+public:
+  struct Stat {
+    uint64_t count_{};
+    uint64_t mismatches_{};
+    std::chrono::nanoseconds compiled_total_{};
+    std::chrono::nanoseconds inja_total_{};
+  };
+
+  static TemplateShadow &get();
+
+  /**
+   * @param sample_rate compare one in every sample_rate compiled renders.
+   */
+  void enable(uint32_t sample_rate);
+  void disable();
+  void reset();
+
+  /**
+   * @param render_count how many compiled renders the calling thread has done.
+   * @return whether the next compiled render should be compared.
+   */
+  bool shouldSample(uint64_t render_count) const {
+    const uint32_t sample_rate = sample_rate_.load(std::memory_order_relaxed);
+    return sample_rate != 0 && render_count % sample_rate == 0;
+  }
+
+  /**
+   * @param matched whether inja rendered the same output, without failing.
+   */
+  void record(absl::string_view template_name, bool matched,
+              std::chrono::nanoseconds compiled_elapsed,
+              std::chrono::nanoseconds inja_elapsed);
+
+  // the comparisons recorded so far, as a json object.
+  std::string dump() const;
+
+  /**
+   * Registers /transformation/shadow, which dumps the comparisons, and
+   * /transformation/shadow/config, which takes one of enable=<sample rate>,
+   * disable or reset.
+   */
+  void registerAdminHandlers(Server::Admin &admin);
+
+  Http::Code handleConfig(absl::string_view path_and_query,
+                          Buffer::Instance &response);
+
+private:
+  std::atomic<uint32_t> sample_rate_{};
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Stat> templates_ ABSL_GUARDED_BY(mutex_);
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
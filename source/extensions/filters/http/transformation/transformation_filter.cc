@@ -1,13 +1,17 @@
 #include "source/extensions/filters/http/transformation/transformation_filter.h"
 
+#include "source/common/common/cleanup.h"
 #include "source/common/common/empty_string.h"
 #include "source/common/common/enum_to_int.h"
 #include "source/common/config/metadata.h"
 #include "source/common/http/header_utility.h"
 #include "source/common/http/header_map_impl.h"
+#include "source/common/http/solo_filter_utility.h"
 #include "source/common/http/utility.h"
+#include "source/common/stats/timespan_impl.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
+#include "source/extensions/filters/http/transformation/shared_json_body.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
 
 namespace Envoy {
@@ -21,6 +25,18 @@ struct RcDetailsValues {
 };
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 
+namespace {
+
+// the response headers given to the transformations on stream completion of
+// the streams that didn't get a response.
+Http::ResponseHeaderMap &emptyResponseHeaders() {
+  static thread_local Http::ResponseHeaderMapPtr headers =
+      Http::ResponseHeaderMapImpl::create();
+  return *headers;
+}
+
+} // namespace
+
 TransformationFilter::TransformationFilter(FilterConfigSharedPtr config)
     : filter_config_(config) {}
 
@@ -28,15 +44,20 @@ TransformationFilter::~TransformationFilter() {}
 
 void TransformationFilter::onDestroy() { 
   destroyed_ = true;
+  cancelTask();
+  endResponseStream();
   resetInternalState(); 
 }
 
-void TransformationFilter::onStreamComplete() { transformOnStreamCompletion(); }
+void TransformationFilter::onStreamComplete() {
+  const Http::FilterTime::Scope time(filter_time_);
+  transformOnStreamCompletion();
+}
 
 Http::FilterHeadersStatus
 TransformationFilter::decodeHeaders(Http::RequestHeaderMap &header_map,
                                     bool end_stream) {
-
+  const Http::FilterTime::Scope time(filter_time_);
   request_headers_ = &header_map;
   setupTransformationPair();
 
@@ -48,12 +69,22 @@ TransformationFilter::decodeHeaders(Http::RequestHeaderMap &header_map,
     return Http::FilterHeadersStatus::Continue;
   }
 
+  // a body that won't fit in the buffer is rejected before it is buffered.
+  if (!end_stream && bufferedByStream(*request_transformation_) &&
+      Http::SoloFilterUtility::contentLengthExceeds(header_map,
+                                                    decoder_buffer_limit_)) {
+    request_transformation_ = nullptr;
+    error(Error::PayloadTooLarge);
+    requestError();
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
   if (end_stream || request_transformation_->passthrough_body()) {
     filter_config_->stats().request_header_transformations_.inc();
     transformRequest();
 
-    return is_error() ? Http::FilterHeadersStatus::StopIteration
-                      : Http::FilterHeadersStatus::Continue;
+    return is_error() || taskPending() ? Http::FilterHeadersStatus::StopIteration
+                                       : Http::FilterHeadersStatus::Continue;
   }
 
   return Http::FilterHeadersStatus::StopIteration;
@@ -61,23 +92,51 @@ TransformationFilter::decodeHeaders(Http::RequestHeaderMap &header_map,
 
 Http::FilterDataStatus TransformationFilter::decodeData(Buffer::Instance &data,
                                                         bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
   if (!requestActive()) {
     return Http::FilterDataStatus::Continue;
   }
 
-  request_body_.move(data);
-  if ((decoder_buffer_limit_ != 0) &&
-      (request_body_.length() > decoder_buffer_limit_)) {
-    error(Error::PayloadTooLarge);
+  if (bufferedByStream(*request_transformation_)) {
+    const uint64_t length =
+        bufferedLength(decoder_callbacks_->decodingBuffer(), data);
+    const bool too_large =
+        decoder_buffer_limit_ != 0 && length > decoder_buffer_limit_;
+    if (too_large || !request_reservation_.reserveTo(length)) {
+      error(too_large ? Error::PayloadTooLarge : Error::BodyBudgetExhausted);
+      requestError();
+      return Http::FilterDataStatus::StopIterationNoBuffer;
+    }
+    if (!end_stream) {
+      return Http::FilterDataStatus::StopIterationAndBuffer;
+    }
+    decoder_callbacks_->addDecodedData(data, false);
+    filter_config_->stats().request_body_transformations_.inc();
+    transformRequest();
+    return is_error() || taskPending()
+               ? Http::FilterDataStatus::StopIterationNoBuffer
+               : Http::FilterDataStatus::Continue;
+  }
+
+  const bool prefix_complete =
+      bufferBody(request_transformation_->body_prefix_bytes(), request_body_,
+                 data);
+  const bool too_large = decoder_buffer_limit_ != 0 &&
+                         request_body_.length() > decoder_buffer_limit_;
+  if (too_large || !request_reservation_.reserveTo(request_body_.length())) {
+    error(too_large ? Error::PayloadTooLarge : Error::BodyBudgetExhausted);
     requestError();
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
 
-  if (end_stream) {
+  if (end_stream || prefix_complete) {
     filter_config_->stats().request_body_transformations_.inc();
     transformRequest();
-    return is_error() ? Http::FilterDataStatus::StopIterationNoBuffer
-                      : Http::FilterDataStatus::Continue;
+    // the rest of the body, if any, is left in data and continues with the
+    // transformed prefix.
+    return is_error() || taskPending()
+               ? Http::FilterDataStatus::StopIterationNoBuffer
+               : Http::FilterDataStatus::Continue;
   }
 
   return Http::FilterDataStatus::StopIterationNoBuffer;
@@ -85,18 +144,23 @@ Http::FilterDataStatus TransformationFilter::decodeData(Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 TransformationFilter::decodeTrailers(Http::RequestTrailerMap &) {
+  const Http::FilterTime::Scope time(filter_time_);
   if (requestActive()) {
     filter_config_->stats().request_body_transformations_.inc();
     transformRequest();
   }
-  return is_error() ? Http::FilterTrailersStatus::StopIteration
-                    : Http::FilterTrailersStatus::Continue;
+  return is_error() || taskPending() ? Http::FilterTrailersStatus::StopIteration
+                                     : Http::FilterTrailersStatus::Continue;
 }
 
 Http::FilterHeadersStatus
 TransformationFilter::encodeHeaders(Http::ResponseHeaderMap &header_map,
                                     bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
   response_headers_ = &header_map;
+  // the stream is already responding, e.g. with a local reply, so the request
+  // won't be continued.
+  cancelTask();
 
   if (!response_transformation_ && route_config_ != nullptr) {
     const TransformConfig *staged_config =
@@ -118,7 +182,13 @@ TransformationFilter::encodeHeaders(Http::ResponseHeaderMap &header_map,
   if (end_stream || response_transformation_->passthrough_body()) {
     filter_config_->stats().response_header_transformations_.inc();
     transformResponse();
-    return destroyed_ ? Http::FilterHeadersStatus::StopIteration : Http::FilterHeadersStatus::Continue;
+    return destroyed_ || taskPending() ? Http::FilterHeadersStatus::StopIteration
+                                       : Http::FilterHeadersStatus::Continue;
+  }
+
+  if (startResponseStream()) {
+    return destroyed_ ? Http::FilterHeadersStatus::StopIteration
+                      : Http::FilterHeadersStatus::Continue;
   }
 
   return Http::FilterHeadersStatus::StopIteration;
@@ -126,22 +196,60 @@ TransformationFilter::encodeHeaders(Http::ResponseHeaderMap &header_map,
 
 Http::FilterDataStatus TransformationFilter::encodeData(Buffer::Instance &data,
                                                         bool end_stream) {
+  const Http::FilterTime::Scope time(filter_time_);
+  if (response_stream_ != nullptr) {
+    return transformResponseStream(data, end_stream);
+  }
   if (!responseActive()) {
     return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
   }
 
-  response_body_.move(data);
-  if ((encoder_buffer_limit_ != 0) &&
-      (response_body_.length() > encoder_buffer_limit_)) {
-    error(Error::PayloadTooLarge);
+  if (bufferedByStream(*response_transformation_)) {
+    const Buffer::Instance *buffered = encoder_callbacks_->encodingBuffer();
+    const uint64_t length = bufferedLength(buffered, data);
+    const bool too_large =
+        encoder_buffer_limit_ != 0 && length > encoder_buffer_limit_;
+    if (too_large || !response_reservation_.reserveTo(length)) {
+      // the error replaces what was buffered of the body.
+      if (buffered != nullptr && buffered != &data) {
+        encoder_callbacks_->modifyEncodingBuffer(
+            [](Buffer::Instance &body) { body.drain(body.length()); });
+      }
+      data.drain(data.length());
+      error(too_large ? Error::PayloadTooLarge : Error::BodyBudgetExhausted);
+      responseError();
+      return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer
+                        : Http::FilterDataStatus::Continue;
+    }
+    if (!end_stream) {
+      return Http::FilterDataStatus::StopIterationAndBuffer;
+    }
+    encoder_callbacks_->addEncodedData(data, false);
+    filter_config_->stats().response_body_transformations_.inc();
+    transformResponse();
+    return destroyed_ || taskPending()
+               ? Http::FilterDataStatus::StopIterationNoBuffer
+               : Http::FilterDataStatus::Continue;
+  }
+
+  const bool prefix_complete =
+      bufferBody(response_transformation_->body_prefix_bytes(), response_body_,
+                 data);
+  const bool too_large = encoder_buffer_limit_ != 0 &&
+                         response_body_.length() > encoder_buffer_limit_;
+  if (too_large ||
+      !response_reservation_.reserveTo(response_body_.length())) {
+    error(too_large ? Error::PayloadTooLarge : Error::BodyBudgetExhausted);
     responseError();
     return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
   }
 
-  if (end_stream) {
+  if (end_stream || prefix_complete) {
     filter_config_->stats().response_body_transformations_.inc();
     transformResponse();
-    return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
+    return destroyed_ || taskPending()
+               ? Http::FilterDataStatus::StopIterationNoBuffer
+               : Http::FilterDataStatus::Continue;
   }
 
   return Http::FilterDataStatus::StopIterationNoBuffer;
@@ -149,19 +257,117 @@ Http::FilterDataStatus TransformationFilter::encodeData(Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 TransformationFilter::encodeTrailers(Http::ResponseTrailerMap &) {
+  const Http::FilterTime::Scope time(filter_time_);
+  if (response_stream_ != nullptr) {
+    // flushes what is left of the body before the trailers.
+    Buffer::OwnedImpl data;
+    if (transformResponseStream(data, true) !=
+        Http::FilterDataStatus::Continue) {
+      return Http::FilterTrailersStatus::StopIteration;
+    }
+    if (data.length() > 0) {
+      encoder_callbacks_->addEncodedData(data, false);
+    }
+    return Http::FilterTrailersStatus::Continue;
+  }
   if (responseActive()) {
     filter_config_->stats().response_body_transformations_.inc();
     transformResponse();
   }
-  return destroyed_ ? Http::FilterTrailersStatus::StopIteration : Http::FilterTrailersStatus::Continue;
+  return destroyed_ || taskPending() ? Http::FilterTrailersStatus::StopIteration
+                                     : Http::FilterTrailersStatus::Continue;
+}
+
+bool TransformationFilter::bufferBody(uint64_t body_prefix_bytes,
+                                      Buffer::Instance &body,
+                                      Buffer::Instance &data) {
+  if (body_prefix_bytes == 0) {
+    body.move(data);
+    return false;
+  }
+  ASSERT(body.length() < body_prefix_bytes);
+  body.move(data, std::min<uint64_t>(data.length(),
+                                     body_prefix_bytes - body.length()));
+  return body.length() == body_prefix_bytes;
+}
+
+bool TransformationFilter::bufferedByStream(
+    const Transformer &transformation) {
+  // the stream can't hold back only the prefix of the body, which is staged
+  // while the rest of the body continues.
+  return !transformation.passthrough_body() &&
+         transformation.body_prefix_bytes() == 0;
+}
+
+uint64_t TransformationFilter::bufferedLength(const Buffer::Instance *buffered,
+                                              const Buffer::Instance &data) {
+  // the data given to a filter is the buffered body once a filter before it
+  // continues with it.
+  if (buffered == nullptr || buffered == &data) {
+    return data.length();
+  }
+  return buffered->length() + data.length();
+}
+
+bool TransformationFilter::startResponseStream() {
+  try {
+    response_stream_ = response_transformation_->startBodyStream(
+        *response_headers_, request_headers_, *encoder_callbacks_);
+  } catch (std::exception &e) {
+    ENVOY_STREAM_LOG(debug, "failure transforming {}", *encoder_callbacks_,
+                     e.what());
+    response_transformation_ = nullptr;
+    error(Error::TemplateParseError, e.what());
+    responseError();
+    return true;
+  }
+  if (response_stream_ == nullptr) {
+    return false;
+  }
+  filter_config_->stats().response_header_transformations_.inc();
+  // the stream reads the transformer until the body is done.
+  stream_transformation_ = response_transformation_;
+  response_transformation_ = nullptr;
+  return true;
+}
+
+Http::FilterDataStatus
+TransformationFilter::transformResponseStream(Buffer::Instance &data,
+                                              bool end_stream) {
+  filter_config_->stats().response_bytes_in_.add(data.length());
+  try {
+    response_stream_->transformData(data, end_stream);
+  } catch (std::exception &e) {
+    ENVOY_STREAM_LOG(debug, "failure transforming the streamed body {}",
+                     *encoder_callbacks_, e.what());
+    filter_config_->stats().response_error_.inc();
+    data.drain(data.length());
+    endResponseStream();
+    // the headers are already sent, so the response can't be replaced.
+    encoder_callbacks_->resetStream();
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+  filter_config_->stats().response_bytes_out_.add(data.length());
+  if (end_stream) {
+    filter_config_->stats().response_body_transformations_.inc();
+    endResponseStream();
+  }
+  return Http::FilterDataStatus::Continue;
+}
+
+void TransformationFilter::endResponseStream() {
+  response_stream_.reset();
+  stream_transformation_ = nullptr;
 }
 
 // Creates pair of request and response transformation per route
 void TransformationFilter::setupTransformationPair() {
+  // the route is kept for the transformers of its config, which are borrowed.
+  route_ = decoder_callbacks_->route();
   route_config_ =
       Http::Utility::resolveMostSpecificPerFilterConfig<RouteFilterConfig>(
           decoder_callbacks_);
-  TransformerPairConstSharedPtr active_transformer_pair;
+  const TransformerPair *active_transformer_pair;
   // if there is a route level config present, automatically disregard
   // header_matching rules
   const TransformConfig *config_to_use = filter_config_.get();
@@ -172,7 +378,14 @@ void TransformationFilter::setupTransformationPair() {
     if (staged_config) {
       config_to_use = staged_config;
     }
+    // the stages of the route parse the body once between them.
+    if (route_config_->sharesParsedBody()) {
+      SharedJsonBody::expect(*decoder_callbacks_->streamInfo().filterState());
+    }
   }
+  // each stage matches the request as it reaches the stage, after the stages
+  // and filters before it changed it, so the matches of a stage can't be
+  // reused by the stages after it.
   active_transformer_pair = config_to_use->findTransformers(*request_headers_);
 
   if (active_transformer_pair != nullptr) {
@@ -187,20 +400,52 @@ void TransformationFilter::setupTransformationPair() {
 }
 
 void TransformationFilter::transformRequest() {
-  transformSomething(*decoder_callbacks_, request_transformation_,
-                     *request_headers_, request_body_,
-                     &TransformationFilter::requestError,
-                     &TransformationFilter::addDecoderData);
+  auto transform = [this](Buffer::Instance &body,
+                          void (TransformationFilter::*addData)(
+                              Buffer::Instance &)) {
+    transformSomething(Direction::Request, *decoder_callbacks_,
+                       request_transformation_, *request_headers_, body,
+                       &TransformationFilter::requestError, addData,
+                       filter_config_->stats().request_transformation_time_,
+                       filter_config_->stats().request_bytes_in_,
+                       filter_config_->stats().request_bytes_out_);
+  };
+  // the body buffered by the stream is transformed where it is, so it isn't
+  // added to the stream again.
+  if (bufferedByStream(*request_transformation_) &&
+      decoder_callbacks_->decodingBuffer() != nullptr) {
+    decoder_callbacks_->modifyDecodingBuffer(
+        [&transform](Buffer::Instance &body) { transform(body, nullptr); });
+  } else {
+    transform(request_body_, &TransformationFilter::addDecoderData);
+  }
+  if (taskPending()) {
+    // transformRequest() is called again when the task is done.
+    return;
+  }
   if (should_clear_cache_) {
     decoder_callbacks_->clearRouteCache();
   }
 }
 
 void TransformationFilter::transformResponse() {
-  transformSomething(*encoder_callbacks_, response_transformation_,
-                     *response_headers_, response_body_,
-                     &TransformationFilter::responseError,
-                     &TransformationFilter::addEncoderData);
+  auto transform = [this](Buffer::Instance &body,
+                          void (TransformationFilter::*addData)(
+                              Buffer::Instance &)) {
+    transformSomething(Direction::Response, *encoder_callbacks_,
+                       response_transformation_, *response_headers_, body,
+                       &TransformationFilter::responseError, addData,
+                       filter_config_->stats().response_transformation_time_,
+                       filter_config_->stats().response_bytes_in_,
+                       filter_config_->stats().response_bytes_out_);
+  };
+  if (bufferedByStream(*response_transformation_) &&
+      encoder_callbacks_->encodingBuffer() != nullptr) {
+    encoder_callbacks_->modifyEncodingBuffer(
+        [&transform](Buffer::Instance &body) { transform(body, nullptr); });
+  } else {
+    transform(response_body_, &TransformationFilter::addEncoderData);
+  }
 }
 
 void TransformationFilter::addDecoderData(Buffer::Instance &data) {
@@ -219,17 +464,23 @@ void TransformationFilter::transformOnStreamCompletion() {
   // Body isn't required for this transformer since it isn't included
   // in access logs
   Buffer::OwnedImpl emptyBody{};
-  std::unique_ptr<Http::ResponseHeaderMapImpl> emptyResponseHeaderMap;
 
   // If response_headers_ is a nullptr (this can happpen if a client disconnects)
   // we pass in an empty response header to avoid errors within the transformer.
-  if (response_headers_ == nullptr) {
-    emptyResponseHeaderMap = Http::ResponseHeaderMapImpl::create();
-    response_headers_ = emptyResponseHeaderMap.get();
+  // The empty map is reused by the streams of the thread, so it is cleared of
+  // what the transformation added.
+  Http::ResponseHeaderMap *response_headers = response_headers_;
+  Cleanup clear_headers([response_headers]() {
+    if (response_headers == nullptr) {
+      emptyResponseHeaders().clear();
+    }
+  });
+  if (response_headers == nullptr) {
+    response_headers = &emptyResponseHeaders();
   }
 
   try {
-    on_stream_completion_transformation_->transform(*response_headers_,
+    on_stream_completion_transformation_->transform(*response_headers,
                                                     request_headers_, 
                                                     emptyBody, 
                                                     *encoder_callbacks_);
@@ -243,17 +494,47 @@ void TransformationFilter::transformOnStreamCompletion() {
 }
 
 void TransformationFilter::transformSomething(
-    Http::StreamFilterCallbacks &callbacks,
-    TransformerConstSharedPtr &transformation,
+    Direction direction, Http::StreamFilterCallbacks &callbacks,
+    const Transformer *&transformation,
     Http::RequestOrResponseHeaderMap &header_map, Buffer::Instance &body,
     void (TransformationFilter::*responeWithError)(),
-    void (TransformationFilter::*addData)(Buffer::Instance &)) {
+    void (TransformationFilter::*addData)(Buffer::Instance &),
+    Stats::Histogram &transformation_time, Stats::Counter &bytes_in,
+    Stats::Counter &bytes_out) {
 
   try {
-    transformation->transform(header_map, request_headers_, body, callbacks);
+    if (completed_task_ != nullptr) {
+      TransformationTaskPtr task = std::move(completed_task_);
+      task->complete(header_map, request_headers_, body, callbacks);
+    } else {
+      bytes_in.add(body.length());
+      transformation_timespan_ =
+          std::make_unique<Stats::HistogramCompletableTimespanImpl>(
+              transformation_time, callbacks.dispatcher().timeSource());
+      TransformationTaskPtr task;
+      if (filter_config_->workerPool() != nullptr) {
+        task = transformation->startTask(header_map, request_headers_, body,
+                                         callbacks);
+      }
+      if (task == nullptr) {
+        transformation->transform(header_map, request_headers_, body,
+                                  callbacks);
+      } else if (postTask(direction, callbacks, *transformation, task)) {
+        return;
+      } else {
+        // the pool is full, so the task runs here.
+        task->run();
+        task->complete(header_map, request_headers_, body, callbacks);
+      }
+    }
+    transformation_timespan_->complete();
+    bytes_out.add(body.length());
 
     if (body.length() > 0) {
-      (this->*addData)(body);
+      // a body transformed in place is already in the stream.
+      if (addData != nullptr) {
+        (this->*addData)(body);
+      }
     } else if (!transformation->passthrough_body()) {
       // only remove content type if the request is not passthrough.
       // This means that the empty body is a result of the transformation.
@@ -263,14 +544,85 @@ void TransformationFilter::transformSomething(
   } catch (std::exception &e) {
     ENVOY_STREAM_LOG(debug, "failure transforming {}", callbacks, e.what());
     error(Error::TemplateParseError, e.what());
+    // the error replaces a body that is transformed in place.
+    body.drain(body.length());
   }
 
   transformation = nullptr;
+  // the body is in the stream once transformed, or dropped with the error.
+  if (direction == Direction::Request) {
+    request_reservation_.release();
+  } else {
+    response_reservation_.release();
+  }
   if (is_error()) {
     (this->*responeWithError)();
   }
 }
 
+bool TransformationFilter::postTask(Direction direction,
+                                    Http::StreamFilterCallbacks &callbacks,
+                                    const Transformer &transformation,
+                                    TransformationTaskPtr &task) {
+  auto pending = std::make_shared<PendingTask>(
+      transformation.shared_from_this(), std::move(task));
+  Event::Dispatcher &dispatcher = callbacks.dispatcher();
+  const bool posted = filter_config_->workerPool()->post(
+      [this, pending, &dispatcher, direction]() mutable {
+        pending->task_->run();
+        // the task, and with it its transformer, is released on the worker
+        // thread even when the stream is cancelled, as the worker threads,
+        // and with them their dispatchers, outlive the streams.
+        dispatcher.post([this, pending = std::move(pending), direction]() {
+          if (!pending->cancelled()) {
+            onTaskComplete(direction);
+          }
+        });
+      });
+  if (!posted) {
+    task = std::move(pending->task_);
+    return false;
+  }
+  ENVOY_STREAM_LOG(debug, "transforming on the worker pool", callbacks);
+  pending_task_ = std::move(pending);
+  return true;
+}
+
+void TransformationFilter::onTaskComplete(Direction direction) {
+  completed_task_ = std::move(pending_task_->task_);
+  pending_task_.reset();
+  {
+    // the later filters that the stream continues to aren't timed.
+    const Http::FilterTime::Scope time(filter_time_);
+    if (direction == Direction::Request) {
+      transformRequest();
+    } else {
+      transformResponse();
+    }
+  }
+  switch (direction) {
+  case Direction::Request:
+    if (!is_error()) {
+      decoder_callbacks_->continueDecoding();
+    }
+    break;
+  case Direction::Response:
+    encoder_callbacks_->continueEncoding();
+    break;
+  }
+}
+
+void TransformationFilter::cancelTask() {
+  if (pending_task_ == nullptr) {
+    return;
+  }
+  {
+    absl::MutexLock lock(&pending_task_->mutex_);
+    pending_task_->cancelled_ = true;
+  }
+  pending_task_.reset();
+}
+
 void TransformationFilter::requestError() {
   ASSERT(is_error());
   filter_config_->stats().request_error_.inc();
@@ -292,6 +644,8 @@ void TransformationFilter::responseError() {
 void TransformationFilter::resetInternalState() {
   request_body_.drain(request_body_.length());
   response_body_.drain(response_body_.length());
+  request_reservation_.release();
+  response_reservation_.release();
 }
 
 void TransformationFilter::error(Error error, std::string msg) {
@@ -318,6 +672,12 @@ void TransformationFilter::error(Error error, std::string msg) {
     error_code_ = Http::Code::NotFound;
     break;
   }
+  case Error::BodyBudgetExhausted: {
+    filter_config_->stats().body_budget_exhausted_.inc();
+    error_messgae_ = "buffered bodies over budget";
+    error_code_ = Http::Code::ServiceUnavailable;
+    break;
+  }
   }
   if (!msg.empty()) {
     if (error_messgae_.empty()) {
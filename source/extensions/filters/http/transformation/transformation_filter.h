@@ -1,8 +1,13 @@
 #pragma once
 
 #include "envoy/server/filter_config.h"
+#include "envoy/stats/timespan.h"
 
+#include "source/common/buffer/body_budget.h"
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/filter_time.h"
+
+#include "absl/synchronization/mutex.h"
 
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
@@ -39,6 +44,11 @@ public:
       Http::StreamDecoderFilterCallbacks &callbacks) override {
     decoder_callbacks_ = &callbacks;
     decoder_buffer_limit_ = callbacks.decoderBufferLimit();
+    if (filter_config_->recordFilterTime()) {
+      filter_time_ = &Http::FilterTime::forStream(
+          *callbacks.streamInfo().filterState(), filter_config_->name(),
+          callbacks.dispatcher().timeSource());
+    }
   };
 
   // Http::StreamEncoderFilter
@@ -68,6 +78,7 @@ private:
     JsonParseError,
     TemplateParseError,
     TransformationNotFound,
+    BodyBudgetExhausted,
   };
 
   enum class Direction {
@@ -91,18 +102,73 @@ private:
 
   void addDecoderData(Buffer::Instance &data);
   void addEncoderData(Buffer::Instance &data);
+  // starts transforming the response body as it arrives, when the
+  // transformation streams it, and returns whether it does.
+  bool startResponseStream();
+  Http::FilterDataStatus transformResponseStream(Buffer::Instance &data,
+                                                 bool end_stream);
+  void endResponseStream();
+  // moves data to the body, or only as much as fits in the prefix when the
+  // transformation reads one, and returns whether the prefix is complete.
+  static bool bufferBody(uint64_t body_prefix_bytes, Buffer::Instance &body,
+                         Buffer::Instance &data);
+  // whether the stream buffers the whole body for the transformation, which
+  // then transforms it in place rather than in a copy staged by the filter.
+  static bool bufferedByStream(const Transformer &transformation);
+  // the length of the body buffered by the stream once data is added to it.
+  static uint64_t bufferedLength(const Buffer::Instance *buffered,
+                                 const Buffer::Instance &data);
   void
-  transformSomething(Http::StreamFilterCallbacks &callbacks,
-                     TransformerConstSharedPtr &transformation,
+  transformSomething(Direction direction,
+                     Http::StreamFilterCallbacks &callbacks,
+                     const Transformer *&transformation,
                      Http::RequestOrResponseHeaderMap &header_map,
                      Buffer::Instance &body,
                      void (TransformationFilter::*responeWithError)(),
-                     void (TransformationFilter::*addData)(Buffer::Instance &));
+                     void (TransformationFilter::*addData)(Buffer::Instance &),
+                     Stats::Histogram &transformation_time,
+                     Stats::Counter &bytes_in, Stats::Counter &bytes_out);
 
   void resetInternalState();
 
+  // A task running on the worker pool. It is shared with the pool thread,
+  // which posts it back to the worker once it ran, where it completes unless
+  // it was cancelled.
+  struct PendingTask {
+    PendingTask(TransformerConstSharedPtr transformer,
+                TransformationTaskPtr task)
+        : transformer_(std::move(transformer)), task_(std::move(task)) {}
+
+    bool cancelled() {
+      absl::MutexLock lock(&mutex_);
+      return cancelled_;
+    }
+
+    absl::Mutex mutex_;
+    bool cancelled_ ABSL_GUARDED_BY(mutex_){};
+    // keeps the transformer alive until the task is done with it, as the
+    // configs that lend it to the stream may be gone by then.
+    const TransformerConstSharedPtr transformer_;
+    TransformationTaskPtr task_;
+  };
+  using PendingTaskSharedPtr = std::shared_ptr<PendingTask>;
+
+  // posts the task to the worker pool, which takes it unless it is full.
+  bool postTask(Direction direction, Http::StreamFilterCallbacks &callbacks,
+                const Transformer &transformation, TransformationTaskPtr &task);
+  void onTaskComplete(Direction direction);
+  bool taskPending() const { return pending_task_ != nullptr; }
+  void cancelTask();
+
   Http::StreamDecoderFilterCallbacks *decoder_callbacks_{};
   Http::StreamEncoderFilterCallbacks *encoder_callbacks_{};
+  // the listener and route configs own the transformers below, which are only
+  // borrowed by the stream. The listener config is declared first so that it
+  // outlives them. The per-route configs of the route, its virtual host and
+  // its route table are kept by the route table, which the stream holds until
+  // it is destroyed, and route_ also keeps those of the route when the route
+  // cache is cleared. A task that outlives the stream owns its transformer.
+  FilterConfigSharedPtr filter_config_;
   Router::RouteConstSharedPtr route_;
   const RouteFilterConfig *route_config_{};
   uint32_t decoder_buffer_limit_{};
@@ -111,17 +177,28 @@ private:
   Http::ResponseHeaderMap *response_headers_{nullptr};
   Buffer::OwnedImpl request_body_{};
   Buffer::OwnedImpl response_body_{};
-
-  TransformerConstSharedPtr request_transformation_;
-  TransformerConstSharedPtr response_transformation_;
-  TransformerConstSharedPtr on_stream_completion_transformation_;
+  // the bytes of the budget of the buffered bodies that the bodies hold until
+  // they are transformed.
+  Buffer::BodyBudget::Reservation request_reservation_;
+  Buffer::BodyBudget::Reservation response_reservation_;
+
+  const Transformer *request_transformation_{};
+  const Transformer *response_transformation_{};
+  const Transformer *on_stream_completion_transformation_{};
+  // the response transformation while its body is streamed.
+  const Transformer *stream_transformation_{};
+  BodyStreamPtr response_stream_;
   absl::optional<Error> error_;
   Http::Code error_code_;
   std::string error_messgae_;
   bool should_clear_cache_{};
   bool destroyed_{};
-
-  FilterConfigSharedPtr filter_config_;
+  PendingTaskSharedPtr pending_task_;
+  // the task whose run() finished, until the transformation is completed.
+  TransformationTaskPtr completed_task_;
+  Stats::CompletableTimespanPtr transformation_timespan_;
+  // the time of the filter on the stream, if the config records it.
+  Http::FilterTime *filter_time_{};
 };
 
 } // namespace Transformation
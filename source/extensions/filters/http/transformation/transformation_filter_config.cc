@@ -1,31 +1,150 @@
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 
+#include <algorithm>
+#include <atomic>
+
+#include "envoy/singleton/manager.h"
+#include "envoy/thread/thread.h"
+
 #include "source/common/common/assert.h"
+#include "source/common/common/macros.h"
 #include "source/common/common/matchers.h"
 #include "source/common/protobuf/protobuf.h"
 #include "source/common/protobuf/message_validator_impl.h"
 #include "source/common/config/utility.h"
+#include "source/common/http/header_utility.h"
+#include "source/common/http/headers.h"
 
 
 #include "source/extensions/filters/http/transformation/body_header_transformer.h"
+#include "source/extensions/filters/http/transformation/body_header_unwrap_transformer.h"
+#include "source/extensions/filters/http/transformation/header_mapping_transformer.h"
 #include "source/extensions/filters/http/transformation/inja_transformer.h"
+#include "source/extensions/filters/http/transformation/shared_proto_cache.h"
+#include "source/extensions/filters/http/transformation/template_cache.h"
+
+#include "absl/container/inlined_vector.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace Transformation {
 
+SINGLETON_MANAGER_REGISTRATION(transformation_worker_pool);
+
+namespace {
+
+// the inja transformers and matchers of the current config generations, so
+// that rules that are unchanged by an update reuse them.
+SharedProtoCache<Transformer> &transformerCache() {
+  MUTABLE_CONSTRUCT_ON_FIRST_USE(SharedProtoCache<Transformer>);
+}
+
+SharedProtoCache<Matcher::Matcher> &matcherCache() {
+  MUTABLE_CONSTRUCT_ON_FIRST_USE(SharedProtoCache<Matcher::Matcher>);
+}
+
+// parses the templates of all the inja transformations of the config on the
+// given number of threads. The parsed templates are kept in the TemplateCache
+// for as long as the returned entries are alive, so that building the
+// transformers afterwards on the main thread finds them parsed.
+std::vector<TemplateCache::EntrySharedPtr>
+parseTemplates(const TransformationConfigProto &proto_config, uint32_t threads,
+               Thread::ThreadFactory &thread_factory) {
+  std::vector<std::pair<absl::string_view, bool>> sources;
+  auto add_sources = [&sources](const envoy::api::v2::filter::http::
+                                    Transformation &transformation) {
+    if (!transformation.has_transformation_template()) {
+      return;
+    }
+    const auto &transformation_template =
+        transformation.transformation_template();
+    // the templates that only map headers are never parsed.
+    if (HeaderMappingTransformer::create(transformation_template) != nullptr) {
+      return;
+    }
+    for (absl::string_view source :
+         InjaTransformer::templateSources(transformation_template)) {
+      sources.emplace_back(source, transformation_template.advanced_templates());
+    }
+  };
+  for (const auto &rule : proto_config.transformations()) {
+    const auto &route_transformation = rule.route_transformations();
+    add_sources(route_transformation.request_transformation());
+    add_sources(route_transformation.response_transformation());
+    add_sources(route_transformation.on_stream_completion_transformation());
+  }
+
+  std::vector<TemplateCache::EntrySharedPtr> parsed(sources.size());
+  std::atomic<size_t> next{0};
+  auto parse = [&sources, &parsed, &next]() {
+    for (size_t i = next++; i < sources.size(); i = next++) {
+      try {
+        parsed[i] =
+            TemplateCache::get().parse(sources[i].first, sources[i].second);
+      } catch (const std::exception &) {
+        // reported with the name of the template when the transformer is
+        // built.
+      }
+    }
+  };
+  std::vector<Thread::ThreadPtr> workers;
+  const size_t worker_count = std::min<size_t>(threads, sources.size());
+  for (size_t i = 0; i < worker_count; i++) {
+    workers.push_back(thread_factory.createThread(
+        parse, Thread::Options{"transformation_load"}));
+  }
+  for (auto &worker : workers) {
+    worker->join();
+  }
+  return parsed;
+}
+
+Matcher::MatcherConstPtr
+createMatcher(const envoy::config::route::v3::RouteMatch &match) {
+  // matchers only depend on their config.
+  return matcherCache().getOrCreate(
+      match, nullptr, [&match] { return Matcher::Matcher::create(match); });
+}
+
+} // namespace
+
 TransformerConstSharedPtr Transformation::getTransformer(
     const envoy::api::v2::filter::http::Transformation &transformation,
-    Server::Configuration::CommonFactoryContext &context) {
+    Server::Configuration::CommonFactoryContext &context,
+    const std::string &stats_prefix) {
   switch (transformation.transformation_type_case()) {
-  case envoy::api::v2::filter::http::Transformation::kTransformationTemplate:
-    return std::make_unique<InjaTransformer>(
-        transformation.transformation_template());
+  case envoy::api::v2::filter::http::Transformation::kTransformationTemplate: {
+    const auto &transformation_template =
+        transformation.transformation_template();
+    // templates that only map headers are applied without inja.
+    TransformerConstSharedPtr header_mapping =
+        HeaderMappingTransformer::create(transformation_template);
+    if (header_mapping != nullptr) {
+      return header_mapping;
+    }
+    // the transformer holds on to stats of the scope under the prefix, and all
+    // the scopes share the server's thread local instance.
+    return transformerCache().getOrCreate(
+        transformation_template, &context.scope(), stats_prefix,
+        [&transformation_template, &context,
+         &stats_prefix]() -> TransformerConstSharedPtr {
+          absl::optional<ResultCacheStats> result_cache_stats;
+          if (transformation_template.has_result_cache()) {
+            result_cache_stats = ResultCache::generateStats(context.scope());
+          }
+          return std::make_shared<InjaTransformer>(
+              transformation_template,
+              InjaTransformer::generateStats(stats_prefix, context.scope()),
+              std::move(result_cache_stats));
+        });
+  }
   case envoy::api::v2::filter::http::Transformation::kHeaderBodyTransform: {
     const auto& header_body_transform = transformation.header_body_transform();
     return std::make_unique<BodyHeaderTransformer>(header_body_transform.add_request_metadata());
   }
+  case envoy::api::v2::filter::http::Transformation::kHeaderBodyUnwrap:
+    return std::make_unique<BodyHeaderUnwrapTransformer>();
   case envoy::api::v2::filter::http::Transformation::kTransformerConfig: {
     auto &factory = Config::Utility::getAndCheckFactory<TransformerExtensionFactory>(transformation.transformer_config());
     auto config = Config::Utility::translateAnyToFactoryConfig(transformation.transformer_config().typed_config(), context.messageValidationContext().staticValidationVisitor(), factory);
@@ -43,6 +162,30 @@ TransformationFilterConfig::TransformationFilterConfig(
     const TransformationConfigProto &proto_config, const std::string &prefix,
     Server::Configuration::FactoryContext &context)
     : FilterConfig(prefix, context.scope(), proto_config.stage()) {
+  record_filter_time_ = proto_config.record_filter_time();
+
+  if (proto_config.has_async_pool()) {
+    const auto &async_pool = proto_config.async_pool();
+    // the pool outlives listener updates, so its stats go in the server
+    // scope.
+    worker_pool_ = context.singletonManager().getTyped<WorkerPool>(
+        SINGLETON_MANAGER_REGISTERED_NAME(transformation_worker_pool),
+        [&async_pool, &context] {
+          return std::make_shared<WorkerPool>(
+              async_pool.threads(), async_pool.max_pending(),
+              context.api().threadFactory(),
+              context.getServerFactoryContext().scope());
+        });
+  }
+
+  // the transformers built below find their templates already parsed. The
+  // config is only used once it is fully built.
+  std::vector<TemplateCache::EntrySharedPtr> parsed_templates;
+  if (proto_config.config_load_threads() > 1) {
+    parsed_templates =
+        parseTemplates(proto_config, proto_config.config_load_threads(),
+                       context.api().threadFactory());
+  }
 
   for (const auto &rule : proto_config.transformations()) {
     if (!rule.has_match()) {
@@ -58,7 +201,7 @@ TransformationFilterConfig::TransformationFilterConfig(
       if (route_transformation.has_request_transformation()) {
         try {
           request_transformation = Transformation::getTransformer(
-              route_transformation.request_transformation(), context);
+              route_transformation.request_transformation(), context, prefix);
         } catch (const std::exception &e) {
           throw EnvoyException(
               fmt::format("Failed to parse request template: {}", e.what()));
@@ -67,7 +210,7 @@ TransformationFilterConfig::TransformationFilterConfig(
       if (route_transformation.has_response_transformation()) {
         try {
           response_transformation = Transformation::getTransformer(
-              route_transformation.response_transformation(), context);
+              route_transformation.response_transformation(), context, prefix);
         } catch (const std::exception &e) {
           throw EnvoyException(
               fmt::format("Failed to parse response template: {}", e.what()));
@@ -76,7 +219,8 @@ TransformationFilterConfig::TransformationFilterConfig(
       if (route_transformation.has_on_stream_completion_transformation()) {
         try {
           on_stream_completion_transformation = Transformation::getTransformer(
-              route_transformation.on_stream_completion_transformation(), context);
+              route_transformation.on_stream_completion_transformation(),
+              context, prefix);
         } catch (const std::exception &e) {
           throw EnvoyException(
               fmt::format("Failed to get the on stream completion transformation: {}", e.what()));
@@ -88,9 +232,11 @@ TransformationFilterConfig::TransformationFilterConfig(
                                           response_transformation,
                                           on_stream_completion_transformation,
                                           clear_route_cache);
-    transformer_pairs_.emplace_back(Matcher::Matcher::create(rule.match()),
-                                    transformer_pair);
+    Matcher::MatcherConstPtr matcher = createMatcher(rule.match());
+    matcher_index_.add(matcher);
+    transformer_pairs_.emplace_back(std::move(matcher), transformer_pair);
   }
+  matcher_index_.build();
 }
 
 class ResponseMatcherImpl : public ResponseMatcher {
@@ -99,17 +245,78 @@ public:
       const envoy::api::v2::filter::http::ResponseMatcher &match);
   bool matches(const Http::ResponseHeaderMap &headers,
                const StreamInfo::StreamInfo &stream_info) const override;
+  absl::optional<HeaderRequirement> headerRequirement() const override {
+    return header_requirement_;
+  }
 
 private:
   std::vector<Http::HeaderUtility::HeaderDataPtr> headers_;
   absl::optional<Matchers::StringMatcherImpl<envoy::type::matcher::v3::StringMatcher>> response_code_details_match_;
+  // whether the details matcher matches empty details, which is what most
+  // responses that aren't local replies have.
+  bool matches_empty_details_{};
+  absl::optional<HeaderRequirement> header_requirement_;
 };
 
+namespace {
+
+// returns the value that the header matcher requires, if it only matches
+// that exact value.
+absl::optional<std::string>
+exactHeaderValue(const envoy::config::route::v3::HeaderMatcher &header) {
+  using envoy::config::route::v3::HeaderMatcher;
+  if (header.invert_match()) {
+    return absl::nullopt;
+  }
+  std::string value;
+  switch (header.header_match_specifier_case()) {
+  case HeaderMatcher::kExactMatch:
+    value = header.exact_match();
+    break;
+  case HeaderMatcher::kStringMatch:
+    if (header.string_match().match_pattern_case() !=
+            envoy::type::matcher::v3::StringMatcher::kExact ||
+        header.string_match().ignore_case()) {
+      return absl::nullopt;
+    }
+    value = header.string_match().exact();
+    break;
+  default:
+    return absl::nullopt;
+  }
+  // an empty exact value only requires the header to be present.
+  if (value.empty()) {
+    return absl::nullopt;
+  }
+  return value;
+}
+
+} // namespace
+
 ResponseMatcherImpl::ResponseMatcherImpl(
     const envoy::api::v2::filter::http::ResponseMatcher &match)
     : headers_(Http::HeaderUtility::buildHeaderDataVector(match.headers())) {
   if (match.has_response_code_details()) {
     response_code_details_match_.emplace(match.response_code_details());
+    matches_empty_details_ = response_code_details_match_->match("");
+  }
+  // :status is what response rules usually match on, so it's the preferred
+  // header to index on.
+  for (const auto &header : match.headers()) {
+    absl::optional<std::string> value = exactHeaderValue(header);
+    if (!value.has_value()) {
+      continue;
+    }
+    const bool is_status =
+        header.name() == Http::Headers::get().Status.get();
+    if (!header_requirement_.has_value() || is_status) {
+      header_requirement_.emplace(
+          HeaderRequirement{Http::LowerCaseString(header.name()),
+                            std::move(value.value())});
+    }
+    if (is_status) {
+      break;
+    }
   }
 }
 
@@ -122,7 +329,12 @@ bool ResponseMatcherImpl::matches(
     if (!maybe_details.has_value()) {
       return false;
     }
-    if (!response_code_details_match_.value().match(maybe_details.value())) {
+    if (maybe_details.value().empty()) {
+      if (!matches_empty_details_) {
+        return false;
+      }
+    } else if (!response_code_details_match_.value().match(
+                   maybe_details.value())) {
       return false;
     }
   }
@@ -169,9 +381,21 @@ RouteTransformationFilterConfig::RouteTransformationFilterConfig(
     }
     temp_stages[transformation.stage()]->addTransformation(transformation, context);
   }
+  uint32_t parsing_stages = 0;
   for (uint32_t i = 0; i < stages_.size(); i++) {
+    if (temp_stages[i] != nullptr && temp_stages[i]->parsesJsonBody()) {
+      parsing_stages++;
+    }
     stages_[i] = std::move(temp_stages[i]);
   }
+  shares_parsed_body_ = parsing_stages > 1;
+}
+
+void PerStageRouteTransformationFilterConfig::addTransformer(
+    const TransformerConstSharedPtr &transformer) {
+  if (transformer != nullptr && transformer->parsesJsonBody()) {
+    parses_json_body_ = true;
+  }
 }
 
 void PerStageRouteTransformationFilterConfig::addTransformation(
@@ -187,7 +411,7 @@ void PerStageRouteTransformationFilterConfig::addTransformation(
     Matcher::MatcherConstPtr matcher;
 
     if (request_match.has_match()) {
-      matcher = Matcher::Matcher::create(request_match.match());
+      matcher = createMatcher(request_match.match());
     }
 
     bool clear_route_cache = request_match.clear_route_cache();
@@ -210,6 +434,8 @@ void PerStageRouteTransformationFilterConfig::addTransformation(
       }
     }
 
+    addTransformer(request_transformation);
+    addTransformer(response_transformation);
     if (request_transformation != nullptr ||
         response_transformation != nullptr) {
 
@@ -230,9 +456,11 @@ void PerStageRouteTransformationFilterConfig::addTransformation(
     }
     auto &&transformation = response_match.response_transformation();
     try {
-      std::pair<ResponseMatcherConstPtr, TransformerConstSharedPtr> pair(
-          std::move(matcher), Transformation::getTransformer(transformation, context));
-      response_transformations_.emplace_back(std::move(pair));
+      TransformerConstSharedPtr response_transformation =
+          Transformation::getTransformer(transformation, context);
+      addTransformer(response_transformation);
+      response_transformations_.add(std::move(matcher),
+                                    std::move(response_transformation));
     } catch (const std::exception &e) {
       throw EnvoyException(fmt::format(
           "Failed to parse response template on response matcher: {}",
@@ -247,26 +475,82 @@ void PerStageRouteTransformationFilterConfig::addTransformation(
   }
 }
 
-TransformerPairConstSharedPtr
+const TransformerPair *
 PerStageRouteTransformationFilterConfig::findTransformers(
     const Http::RequestHeaderMap &headers) const {
+  Matcher::LazyQueryParams query_params(headers);
   for (const auto &pair : transformer_pairs_) {
-    if (pair.matcher() == nullptr || pair.matcher()->matches(headers)) {
-      return pair.transformer_pair();
+    if (pair.matcher() == nullptr ||
+        pair.matcher()->matches(headers, query_params)) {
+      return pair.transformer_pair().get();
     }
   }
   return nullptr;
 }
 
-TransformerConstSharedPtr
+const Transformer *
 PerStageRouteTransformationFilterConfig::findResponseTransform(
     const Http::ResponseHeaderMap &headers, StreamInfo::StreamInfo &si) const {
-  for (const auto &pair : response_transformations_) {
-    if (pair.first == nullptr || pair.first->matches(headers, si)) {
-      return pair.second;
+  return response_transformations_.findFirst(headers, si).get();
+}
+
+void ResponseMatcherIndex::add(ResponseMatcherConstPtr matcher,
+                               TransformerConstSharedPtr transformer) {
+  const size_t position = rules_.size();
+  absl::optional<ResponseMatcher::HeaderRequirement> requirement;
+  if (matcher != nullptr) {
+    requirement = matcher->headerRequirement();
+  }
+  rules_.emplace_back(std::move(matcher), std::move(transformer));
+
+  if (!requirement.has_value()) {
+    unindexed_.push_back(position);
+    return;
+  }
+  auto it = std::find_if(headers_.begin(), headers_.end(),
+                         [&requirement](const auto &header) {
+                           return header.first == requirement->name_;
+                         });
+  if (it == headers_.end()) {
+    headers_.emplace_back(requirement->name_,
+                          absl::flat_hash_map<std::string, std::vector<size_t>>());
+    it = headers_.end() - 1;
+  }
+  it->second[requirement->value_].push_back(position);
+}
+
+const TransformerConstSharedPtr &
+ResponseMatcherIndex::findFirst(const Http::ResponseHeaderMap &headers,
+                                const StreamInfo::StreamInfo &si) const {
+  static const TransformerConstSharedPtr none;
+  absl::InlinedVector<size_t, 16> candidates(unindexed_.begin(),
+                                             unindexed_.end());
+  for (const auto &header : headers_) {
+    // header matchers compare against all the values of a header, joined
+    // with commas, so the index is looked up the same way.
+    const Http::HeaderUtility::GetAllOfHeaderAsStringResult all_values =
+        Http::HeaderUtility::getAllOfHeaderAsString(headers, header.first);
+    const absl::optional<absl::string_view> value = all_values.result();
+    if (!value.has_value()) {
+      continue;
+    }
+    auto it = header.second.find(value.value());
+    if (it != header.second.end()) {
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
     }
   }
-  return nullptr;
+  if (!headers_.empty()) {
+    // first match wins, so evaluate the candidates in the order they were
+    // added.
+    std::sort(candidates.begin(), candidates.end());
+  }
+  for (size_t candidate : candidates) {
+    const auto &rule = rules_[candidate];
+    if (rule.first == nullptr || rule.first->matches(headers, si)) {
+      return rule.second;
+    }
+  }
+  return none;
 }
 
 } // namespace Transformation
@@ -12,6 +12,9 @@
 #include "api/envoy/config/filter/http/transformation/v2/transformation_filter.pb.validate.h"
 #include "envoy/server/factory_context.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/optional.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -21,7 +24,8 @@ class Transformation {
 public:
   static TransformerConstSharedPtr getTransformer(
       const envoy::api::v2::filter::http::Transformation &transformation,
-      Server::Configuration::CommonFactoryContext &context );
+      Server::Configuration::CommonFactoryContext &context,
+      const std::string &stats_prefix = "");
 };
 
 class ResponseMatcher;
@@ -32,6 +36,20 @@ public:
   virtual bool matches(const Http::ResponseHeaderMap &headers,
                        const StreamInfo::StreamInfo &stream_info) const PURE;
 
+  // a header that a response must have, with exactly this value, to match.
+  struct HeaderRequirement {
+    Http::LowerCaseString name_;
+    std::string value_;
+  };
+
+  /**
+   * @return a header requirement that the matcher can be indexed on, if it
+   * has one.
+   */
+  virtual absl::optional<HeaderRequirement> headerRequirement() const {
+    return absl::nullopt;
+  }
+
   /**
    * Factory method to create a shared instance of a matcher based on the rule
    * defined.
@@ -40,6 +58,42 @@ public:
   create(const envoy::api::v2::filter::http::ResponseMatcher &match);
 };
 
+/**
+ * An ordered list of response rules, indexed on the exact header values their
+ * matchers require. Finding the first rule that matches a response only
+ * evaluates the rules whose required header has the value of the response,
+ * along with the rules that can't be indexed, in the order they were added.
+ */
+class ResponseMatcherIndex {
+public:
+  /**
+   * Adds a rule after the ones already added.
+   * @param matcher the matcher of the rule, or nullptr to match any response.
+   */
+  void add(ResponseMatcherConstPtr matcher,
+           TransformerConstSharedPtr transformer);
+
+  /**
+   * @return the transformer of the first rule that matches the response.
+   */
+  const TransformerConstSharedPtr &
+  findFirst(const Http::ResponseHeaderMap &headers,
+            const StreamInfo::StreamInfo &stream_info) const;
+
+  size_t size() const { return rules_.size(); }
+
+private:
+  std::vector<std::pair<ResponseMatcherConstPtr, TransformerConstSharedPtr>>
+      rules_;
+  // the positions of the indexed rules by the value of their required header,
+  // for each of the required header names.
+  std::vector<std::pair<Http::LowerCaseString,
+                        absl::flat_hash_map<std::string, std::vector<size_t>>>>
+      headers_;
+  // rules that can't be indexed, and are always evaluated.
+  std::vector<size_t> unindexed_;
+};
+
 using TransformationConfigProto =
     envoy::api::v2::filter::http::FilterTransformations;
 using RouteTransformationConfigProto =
@@ -71,16 +125,21 @@ public:
           RouteTransformations_RouteTransformation &transformations,
           Server::Configuration::CommonFactoryContext &context);
 
-  TransformerPairConstSharedPtr
+  const TransformerPair *
   findTransformers(const Http::RequestHeaderMap &headers) const override;
-  TransformerConstSharedPtr
+  const Transformer *
   findResponseTransform(const Http::ResponseHeaderMap &,
                         StreamInfo::StreamInfo &) const override;
 
+  // whether any of the transformations of the stage parses the json body.
+  bool parsesJsonBody() const { return parses_json_body_; }
+
 private:
+  void addTransformer(const TransformerConstSharedPtr &transformer);
+
   std::vector<MatcherTransformerPair> transformer_pairs_;
-  std::vector<std::pair<ResponseMatcherConstPtr, TransformerConstSharedPtr>>
-      response_transformations_;
+  ResponseMatcherIndex response_transformations_;
+  bool parses_json_body_{};
 };
 
 class RouteTransformationFilterConfig : public RouteFilterConfig {
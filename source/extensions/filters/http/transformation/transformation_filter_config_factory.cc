@@ -5,8 +5,11 @@
 #include "envoy/registry/registry.h"
 
 #include "source/common/common/macros.h"
+#include "source/common/http/filter_pool.h"
 #include "source/common/protobuf/utility.h"
 
+#include "source/extensions/filters/http/transformation/template_profiler.h"
+#include "source/extensions/filters/http/transformation/template_shadow.h"
 #include "source/extensions/filters/http/transformation/transformation_filter.h"
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 
@@ -23,10 +26,12 @@ TransformationFilterConfigFactory::createFilterFactoryFromProtoTyped(
 
   FilterConfigSharedPtr config = std::make_shared<TransformationFilterConfig>(
       proto_config, stats_prefix, context);
+  TemplateProfiler::get().registerAdminHandlers(context.admin());
+  TemplateShadow::get().registerAdminHandlers(context.admin());
 
   return [config](Http::FilterChainFactoryCallbacks &callbacks) -> void {
-    auto filter = new TransformationFilter(config);
-    callbacks.addStreamFilter(Http::StreamFilterSharedPtr{filter});
+    callbacks.addStreamFilter(
+        Http::FilterPool<TransformationFilter>::make(config));
   };
 }
 
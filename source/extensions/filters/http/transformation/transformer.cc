@@ -18,21 +18,34 @@ TransformerPair::TransformerPair(TransformerConstSharedPtr request_transformer,
       response_transformation_(response_transformer),
       on_stream_completion_transformation_(on_stream_completion_transformer) {}
 
-TransformerPairConstSharedPtr
+void Transformer::transformObserved(Http::RequestOrResponseHeaderMap &map,
+                                    Http::RequestHeaderMap *request_headers,
+                                    Buffer::Instance &body,
+                                    Http::StreamFilterCallbacks &callbacks,
+                                    const BodyObserver &observer) const {
+  transform(map, request_headers, body, callbacks);
+  for (const Buffer::RawSlice &slice : body.getRawSlices()) {
+    observer(absl::string_view(static_cast<const char *>(slice.mem_),
+                               slice.len_));
+  }
+}
+
+const TransformerPair *
 FilterConfig::findTransformers(const Http::RequestHeaderMap &headers) const {
-  for (const auto &pair : transformerPairs()) {
-    if (pair.matcher()->matches(headers)) {
-      return pair.transformer_pair();
-    }
+  ASSERT(matcher_index_.size() == transformerPairs().size());
+  const absl::optional<size_t> position = matcher_index_.findFirst(headers);
+  if (!position.has_value()) {
+    return nullptr;
   }
-  return nullptr;
+  return transformerPairs()[position.value()].transformer_pair().get();
 }
 
 TransformationFilterStats FilterConfig::generateStats(const std::string &prefix,
                                                       Stats::Scope &scope) {
   const std::string final_prefix = prefix + "transformation.";
   return {ALL_TRANSFORMATION_FILTER_STATS(
-      POOL_COUNTER_PREFIX(scope, final_prefix))};
+      POOL_COUNTER_PREFIX(scope, final_prefix),
+      POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
 }
 
 RouteFilterConfig::RouteFilterConfig() : stages_(MAX_STAGE_NUMBER + 1) {}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 
 #include "envoy/buffer/buffer.h"
@@ -10,9 +12,14 @@
 #include "envoy/stats/stats_macros.h"
 
 #include "source/common/http/header_utility.h"
+#include "source/common/matcher/matcher_index.h"
 #include "source/common/matcher/solo_matcher.h"
 #include "source/common/protobuf/protobuf.h"
 
+#include "source/extensions/filters/http/transformation/worker_pool.h"
+
+#include "absl/strings/string_view.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -21,34 +28,128 @@ namespace Transformation {
 /**
  * All stats for the transformation filter. @see stats_macros.h
  */
-#define ALL_TRANSFORMATION_FILTER_STATS(COUNTER)                               \
+#define ALL_TRANSFORMATION_FILTER_STATS(COUNTER, HISTOGRAM)                    \
   COUNTER(request_body_transformations)                                        \
   COUNTER(request_header_transformations)                                      \
   COUNTER(response_header_transformations)                                     \
   COUNTER(response_body_transformations)                                       \
   COUNTER(request_error)                                                       \
   COUNTER(response_error)                                                      \
-  COUNTER(on_stream_complete_error)
+  COUNTER(on_stream_complete_error)                                            \
+  COUNTER(request_bytes_in)                                                    \
+  COUNTER(request_bytes_out)                                                   \
+  COUNTER(response_bytes_in)                                                   \
+  COUNTER(response_bytes_out)                                                  \
+  COUNTER(body_budget_exhausted)                                               \
+  HISTOGRAM(request_transformation_time, Microseconds)                         \
+  HISTOGRAM(response_transformation_time, Microseconds)
 
 /**
  * Wrapper struct for transformation @see stats_macros.h
  */
 struct TransformationFilterStats {
-  ALL_TRANSFORMATION_FILTER_STATS(GENERATE_COUNTER_STRUCT)
+  ALL_TRANSFORMATION_FILTER_STATS(GENERATE_COUNTER_STRUCT,
+                                  GENERATE_HISTOGRAM_STRUCT)
+};
+
+/**
+ * A transformation that is split so that its expensive part can run on a
+ * WorkerPool thread.
+ */
+class TransformationTask {
+public:
+  virtual ~TransformationTask() {}
+
+  // runs on a pool thread, and must not touch the stream. Errors are kept
+  // and thrown by complete().
+  virtual void run() PURE;
+
+  // runs on the worker thread after run(), and finishes the transformation
+  // like Transformer::transform() would.
+  virtual void complete(Http::RequestOrResponseHeaderMap &map,
+                        Http::RequestHeaderMap *request_headers,
+                        Buffer::Instance &body,
+                        Http::StreamFilterCallbacks &callbacks) PURE;
+};
+
+using TransformationTaskPtr = std::unique_ptr<TransformationTask>;
+
+/**
+ * Transforms a body as it is streamed, a chunk at a time.
+ */
+class BodyStream {
+public:
+  virtual ~BodyStream() {}
+
+  // replaces the data with its transformed output. Input that doesn't make a
+  // whole record yet is kept until more data arrives. Throws on invalid
+  // input.
+  virtual void transformData(Buffer::Instance &data, bool end_stream) PURE;
 };
 
-class Transformer {
+using BodyStreamPtr = std::unique_ptr<BodyStream>;
+
+// transformers are always owned by shared pointers, so that a stream that
+// borrows one can take a reference to it when its use outlives the stream.
+class Transformer : public std::enable_shared_from_this<Transformer> {
 public:
   virtual ~Transformer() {}
 
   virtual bool passthrough_body() const PURE;
 
+  // the number of bytes of the body that the transformation reads, after
+  // which the rest of the body is streamed through. 0 means the whole body.
+  virtual uint64_t body_prefix_bytes() const { return 0; }
+
+  // whether the transformation parses the body as json, and so may share the
+  // parsed document with the other transformations of the stream.
+  virtual bool parsesJsonBody() const { return false; }
+
   virtual void transform(Http::RequestOrResponseHeaderMap &map,
                          // request header map. this has the request header map
                          // even when transforming responses.
                          Http::RequestHeaderMap *request_headers,
                          Buffer::Instance &body,
                          Http::StreamFilterCallbacks &callbacks) const PURE;
+
+  using BodyObserver = std::function<void(absl::string_view)>;
+
+  /**
+   * Like transform(), and passes the transformed body to the observer, in
+   * order, as it is written. This lets the caller hash the body without a
+   * second pass over it. By default the body is observed after transform().
+   */
+  virtual void transformObserved(Http::RequestOrResponseHeaderMap &map,
+                                 Http::RequestHeaderMap *request_headers,
+                                 Buffer::Instance &body,
+                                 Http::StreamFilterCallbacks &callbacks,
+                                 const BodyObserver &observer) const;
+
+  /**
+   * Starts a transformation that runs on a worker pool, instead of
+   * transform(). The task takes the body; the rest of the stream is only read
+   * by complete().
+   * @return nullptr if the transformation should run inline.
+   */
+  virtual TransformationTaskPtr
+  startTask(Http::RequestOrResponseHeaderMap &,
+            Http::RequestHeaderMap *, Buffer::Instance &,
+            Http::StreamFilterCallbacks &) const {
+    return nullptr;
+  }
+
+  /**
+   * Transforms the headers of a stream whose body is transformed as it
+   * arrives rather than buffered. The stream must not outlive the
+   * transformer, nor the headers.
+   * @return the stream that transforms the body, or nullptr if the body
+   * should be buffered and given to transform().
+   */
+  virtual BodyStreamPtr startBodyStream(Http::RequestOrResponseHeaderMap &,
+                                        Http::RequestHeaderMap *,
+                                        Http::StreamFilterCallbacks &) const {
+    return nullptr;
+  }
 };
 
 typedef std::shared_ptr<const Transformer> TransformerConstSharedPtr;
@@ -60,16 +161,18 @@ public:
                   TransformerConstSharedPtr on_stream_completion_transformer,
                   bool should_clear_cache);
 
-  TransformerConstSharedPtr getRequestTranformation() const {
-    return request_transformation_;
+  // the transformers live as long as the config that holds the pair, so they
+  // are lent to the streams rather than shared with them.
+  const Transformer *getRequestTranformation() const {
+    return request_transformation_.get();
   }
 
-  TransformerConstSharedPtr getResponseTranformation() const {
-    return response_transformation_;
+  const Transformer *getResponseTranformation() const {
+    return response_transformation_.get();
   }
 
-  TransformerConstSharedPtr getOnStreamCompletionTransformation() const {
-    return on_stream_completion_transformation_;
+  const Transformer *getOnStreamCompletionTransformation() const {
+    return on_stream_completion_transformation_.get();
   }
 
   bool shouldClearCache() const { return clear_route_cache_; }
@@ -85,9 +188,10 @@ typedef std::shared_ptr<const TransformerPair> TransformerPairConstSharedPtr;
 class TransformConfig {
 public:
   virtual ~TransformConfig() {}
-  virtual TransformerPairConstSharedPtr
+  // the results are owned by the config, and valid for as long as it is.
+  virtual const TransformerPair *
   findTransformers(const Http::RequestHeaderMap &headers) const PURE;
-  virtual TransformerConstSharedPtr
+  virtual const Transformer *
   findResponseTransform(const Http::ResponseHeaderMap &headers,
                         StreamInfo::StreamInfo &) const PURE;
 };
@@ -105,7 +209,7 @@ public:
                          TransformerPairConstSharedPtr transformer_pair)
       : matcher_(matcher), transformer_pair_(transformer_pair) {}
 
-  TransformerPairConstSharedPtr transformer_pair() const {
+  const TransformerPairConstSharedPtr &transformer_pair() const {
     return transformer_pair_;
   }
 
@@ -128,10 +232,10 @@ public:
   transformerPairs() const PURE;
 
   // Finds the matcher that matched the header
-  TransformerPairConstSharedPtr
+  const TransformerPair *
   findTransformers(const Http::RequestHeaderMap &headers) const override;
 
-  TransformerConstSharedPtr
+  const Transformer *
   findResponseTransform(const Http::ResponseHeaderMap &,
                         StreamInfo::StreamInfo &) const override {
     return nullptr;
@@ -143,6 +247,19 @@ public:
 
   uint32_t stage() const { return stage_; }
 
+  // the pool that runs the transformations that support it, if the filter
+  // has one.
+  WorkerPool *workerPool() const { return worker_pool_.get(); }
+
+  // whether the streams keep the time the filter spends on them.
+  bool recordFilterTime() const { return record_filter_time_; }
+
+protected:
+  // indexes the matchers of transformerPairs(), in the same order.
+  Matcher::MatcherIndex matcher_index_;
+  WorkerPoolSharedPtr worker_pool_;
+  bool record_filter_time_{};
+
 private:
   TransformationFilterStats stats_;
   uint32_t stage_{};
@@ -155,8 +272,13 @@ public:
 
   const TransformConfig *transformConfigForStage(uint32_t stage) const override;
 
+  // whether transformations of more than one stage parse the json body, and
+  // so share the parsed document through the filter state.
+  bool sharesParsedBody() const { return shares_parsed_body_; }
+
 protected:
   std::vector<std::unique_ptr<const TransformConfig>> stages_;
+  bool shares_parsed_body_{};
 };
 
 typedef std::shared_ptr<const RouteFilterConfig>
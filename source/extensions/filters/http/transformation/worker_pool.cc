@@ -0,0 +1,75 @@
+#include "source/extensions/filters/http/transformation/worker_pool.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+WorkerPoolStats generateStats(Stats::Scope &scope) {
+  const std::string prefix = "transformation.worker_pool.";
+  return {ALL_WORKER_POOL_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+} // namespace
+
+WorkerPool::WorkerPool(uint32_t threads, uint32_t max_pending,
+                       Thread::ThreadFactory &thread_factory,
+                       Stats::Scope &scope)
+    : max_pending_(max_pending), stats_(generateStats(scope)) {
+  threads_.reserve(threads);
+  for (uint32_t i = 0; i < threads; i++) {
+    threads_.push_back(thread_factory.createThread(
+        [this]() { run(); }, Thread::Options{"transformation"}));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+    stats_.tasks_pending_.sub(pending_.size());
+    pending_.clear();
+  }
+  for (auto &thread : threads_) {
+    thread->join();
+  }
+}
+
+bool WorkerPool::post(Task task) {
+  absl::MutexLock lock(&mutex_);
+  if (stopping_ || pending_.size() >= max_pending_) {
+    stats_.tasks_rejected_.inc();
+    return false;
+  }
+  pending_.push_back(std::move(task));
+  stats_.tasks_pending_.inc();
+  return true;
+}
+
+bool WorkerPool::hasWork() const { return stopping_ || !pending_.empty(); }
+
+void WorkerPool::run() {
+  while (true) {
+    Task task;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &WorkerPool::hasWork));
+      if (stopping_) {
+        return;
+      }
+      task = std::move(pending_.front());
+      pending_.pop_front();
+      stats_.tasks_pending_.dec();
+    }
+    task();
+    stats_.tasks_completed_.inc();
+  }
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
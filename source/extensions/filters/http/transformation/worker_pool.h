@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "envoy/singleton/instance.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread/thread.h"
+
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * All stats for the worker pool. @see stats_macros.h
+ */
+#define ALL_WORKER_POOL_STATS(COUNTER, GAUGE)                                  \
+  COUNTER(tasks_completed)                                                     \
+  COUNTER(tasks_rejected)                                                      \
+  GAUGE(tasks_pending, Accumulate)
+
+/**
+ * Wrapper struct for worker pool stats. @see stats_macros.h
+ */
+struct WorkerPoolStats {
+  ALL_WORKER_POOL_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+/**
+ * A fixed number of threads that run the transformations that are too
+ * expensive to run on a worker thread. The number of tasks waiting for a
+ * thread is bounded, so that a burst of large bodies can't queue up without
+ * limit: when the pool is full the caller runs the task itself.
+ */
+class WorkerPool : public Singleton::Instance {
+public:
+  using Task = std::function<void()>;
+
+  WorkerPool(uint32_t threads, uint32_t max_pending,
+             Thread::ThreadFactory &thread_factory, Stats::Scope &scope);
+  // waits for the tasks that already started, and drops the pending ones.
+  ~WorkerPool() override;
+
+  /**
+   * @param task runs on one of the pool threads.
+   * @return false if the task was not queued because the pool is full.
+   */
+  bool post(Task task);
+
+  const WorkerPoolStats &stats() const { return stats_; }
+
+private:
+  void run();
+  bool hasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const uint32_t max_pending_;
+  WorkerPoolStats stats_;
+  absl::Mutex mutex_;
+  std::deque<Task> pending_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_){};
+  std::vector<Thread::ThreadPtr> threads_;
+};
+
+using WorkerPoolSharedPtr = std::shared_ptr<WorkerPool>;
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
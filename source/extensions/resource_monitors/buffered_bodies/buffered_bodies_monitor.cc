@@ -0,0 +1,31 @@
+#include "source/extensions/resource_monitors/buffered_bodies/buffered_bodies_monitor.h"
+
+#include "source/common/buffer/body_budget.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ResourceMonitors {
+namespace BufferedBodies {
+
+BufferedBodiesMonitor::BufferedBodiesMonitor(
+    const envoy::config::resource_monitor::buffered_bodies::v2::
+        BufferedBodiesConfig &config) {
+  Buffer::BodyBudget::get().setLimit(config.max_buffered_bytes());
+}
+
+BufferedBodiesMonitor::~BufferedBodiesMonitor() {
+  // the budget outlives the server, e.g. the next one of a test.
+  Buffer::BodyBudget::get().setLimit(0);
+}
+
+void BufferedBodiesMonitor::updateResourceUsage(
+    Server::ResourceMonitor::Callbacks &callbacks) {
+  Server::ResourceUsage usage;
+  usage.resource_pressure_ = Buffer::BodyBudget::get().pressure();
+  callbacks.onSuccess(usage);
+}
+
+} // namespace BufferedBodies
+} // namespace ResourceMonitors
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "envoy/server/resource_monitor.h"
+
+#include "api/envoy/config/resource_monitor/buffered_bodies/v2/buffered_bodies.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ResourceMonitors {
+namespace BufferedBodies {
+
+/**
+ * Reports the pressure of the budget of the buffered bodies, @see
+ * Buffer::BodyBudget, whose limit it sets for as long as it lives.
+ */
+class BufferedBodiesMonitor : public Server::ResourceMonitor {
+public:
+  explicit BufferedBodiesMonitor(
+      const envoy::config::resource_monitor::buffered_bodies::v2::
+          BufferedBodiesConfig &config);
+  ~BufferedBodiesMonitor() override;
+
+  // Server::ResourceMonitor
+  void
+  updateResourceUsage(Server::ResourceMonitor::Callbacks &callbacks) override;
+};
+
+} // namespace BufferedBodies
+} // namespace ResourceMonitors
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,30 @@
+#include "source/extensions/resource_monitors/buffered_bodies/config.h"
+
+#include "envoy/registry/registry.h"
+
+#include "source/extensions/resource_monitors/buffered_bodies/buffered_bodies_monitor.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ResourceMonitors {
+namespace BufferedBodies {
+
+Server::ResourceMonitorPtr
+BufferedBodiesMonitorFactory::createResourceMonitorFromProtoTyped(
+    const envoy::config::resource_monitor::buffered_bodies::v2::
+        BufferedBodiesConfig &config,
+    Server::Configuration::ResourceMonitorFactoryContext &) {
+  return std::make_unique<BufferedBodiesMonitor>(config);
+}
+
+/**
+ * Static registration for the buffered bodies resource monitor. @see
+ * RegisterFactory.
+ */
+REGISTER_FACTORY(BufferedBodiesMonitorFactory,
+                 Server::Configuration::ResourceMonitorFactory);
+
+} // namespace BufferedBodies
+} // namespace ResourceMonitors
+} // namespace Extensions
+} // namespace Envoy
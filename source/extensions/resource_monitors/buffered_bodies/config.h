@@ -0,0 +1,34 @@
+#pragma once
+
+#include "envoy/server/resource_monitor_config.h"
+
+#include "source/extensions/resource_monitors/common/factory_base.h"
+
+#include "api/envoy/config/resource_monitor/buffered_bodies/v2/buffered_bodies.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ResourceMonitors {
+namespace BufferedBodies {
+
+/**
+ * Config registration for the buffered bodies resource monitor.
+ */
+class BufferedBodiesMonitorFactory
+    : public Common::FactoryBase<envoy::config::resource_monitor::
+                                     buffered_bodies::v2::BufferedBodiesConfig> {
+public:
+  BufferedBodiesMonitorFactory()
+      : FactoryBase("io.solo.resource_monitors.buffered_bodies") {}
+
+private:
+  Server::ResourceMonitorPtr createResourceMonitorFromProtoTyped(
+      const envoy::config::resource_monitor::buffered_bodies::v2::
+          BufferedBodiesConfig &config,
+      Server::Configuration::ResourceMonitorFactoryContext &context) override;
+};
+
+} // namespace BufferedBodies
+} // namespace ResourceMonitors
+} // namespace Extensions
+} // namespace Envoy
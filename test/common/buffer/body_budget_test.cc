@@ -0,0 +1,55 @@
+#include "source/common/buffer/body_budget.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Buffer {
+namespace {
+
+class BodyBudgetTest : public testing::Test {
+public:
+  ~BodyBudgetTest() override { budget_.setLimit(0); }
+
+  BodyBudget &budget_{BodyBudget::get()};
+};
+
+TEST_F(BodyBudgetTest, NoLimit) {
+  BodyBudget::Reservation reservation;
+  EXPECT_TRUE(reservation.reserveTo(1 << 30));
+  EXPECT_EQ(1U << 30, budget_.used());
+  EXPECT_EQ(0, budget_.pressure());
+
+  reservation.release();
+  EXPECT_EQ(0, budget_.used());
+}
+
+TEST_F(BodyBudgetTest, ReservesUpToTheLimit) {
+  budget_.setLimit(100);
+  BodyBudget::Reservation first;
+  BodyBudget::Reservation second;
+  EXPECT_TRUE(first.reserveTo(40));
+  // only what the body grew by is reserved.
+  EXPECT_TRUE(first.reserveTo(60));
+  EXPECT_TRUE(first.reserveTo(50));
+  EXPECT_EQ(60, first.bytes());
+  EXPECT_DOUBLE_EQ(0.6, budget_.pressure());
+
+  EXPECT_FALSE(second.reserveTo(41));
+  EXPECT_EQ(0, second.bytes());
+  EXPECT_TRUE(second.reserveTo(40));
+  EXPECT_EQ(100, budget_.used());
+  EXPECT_DOUBLE_EQ(1, budget_.pressure());
+}
+
+TEST_F(BodyBudgetTest, ReleasesOnDestruction) {
+  budget_.setLimit(100);
+  {
+    BodyBudget::Reservation reservation;
+    EXPECT_TRUE(reservation.reserveTo(100));
+  }
+  EXPECT_EQ(0, budget_.used());
+}
+
+} // namespace
+} // namespace Buffer
+} // namespace Envoy
@@ -23,6 +23,38 @@ TEST(BufferUtilityTest, DrainBufferToString) {
   EXPECT_EQ(0, buffer.length());
 }
 
+TEST(BufferUtilityTest, BufferOutputStream) {
+  Buffer::OwnedImpl buffer("prefix-");
+  {
+    BufferOutputStream stream(buffer);
+    stream << "hello" << ' ' << 42;
+    stream.flush();
+    EXPECT_EQ("prefix-hello 42", buffer.toString());
+
+    // larger than the staging area.
+    stream << std::string(4096, 'a');
+    stream << "-end";
+  }
+  EXPECT_EQ("prefix-hello 42" + std::string(4096, 'a') + "-end",
+            buffer.toString());
+}
+
+TEST(BufferUtilityTest, BufferOutputStreamObserver) {
+  Buffer::OwnedImpl buffer("prefix-");
+  std::string observed;
+  const BufferOutputStream::WriteObserver observer =
+      [&observed](absl::string_view data) { observed.append(data); };
+  {
+    BufferOutputStream stream(buffer, &observer);
+    stream << "hello" << ' ' << 42;
+    stream << std::string(4096, 'a');
+    stream << "-end";
+  }
+  // the observer sees only what the stream appended, in order.
+  EXPECT_EQ("hello 42" + std::string(4096, 'a') + "-end", observed);
+  EXPECT_EQ("prefix-" + observed, buffer.toString());
+}
+
 } // namespace
 } // namespace Buffer
 } // namespace Envoy
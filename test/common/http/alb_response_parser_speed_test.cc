@@ -0,0 +1,76 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/base64.h"
+#include "source/common/http/alb_response_parser.h"
+
+#include "test/test_common/utility.h"
+
+#include "benchmark/benchmark.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Http {
+
+namespace {
+
+// a json body of about the requested size, as a function would return it.
+std::string functionBody(size_t size) {
+  std::string body = R"({"items":[)";
+  for (int i = 0; body.size() < size; i++) {
+    if (i > 0) {
+      body += ",";
+    }
+    body += fmt::format(R"({{"id":{},"name":"item-{}"}})", i, i);
+  }
+  body += "]}";
+  return body;
+}
+
+// the escaping a function's json serializer applies to a string value.
+std::string escape(absl::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(c);
+  }
+  return escaped;
+}
+
+// an ALB response wrapping a body of about the requested size, either as an
+// escaped json string or base64 encoded.
+std::string albResponse(size_t size, bool base64) {
+  const std::string body = functionBody(size);
+  return fmt::format(
+      R"({{"statusCode":200,"statusDescription":"200 OK",)"
+      R"("headers":{{"content-type":"application/json",)"
+      R"("x-custom-header":"value"}},)"
+      R"("multiValueHeaders":{{"set-cookie":["a=1","b=2"]}},)"
+      R"("isBase64Encoded":{},"body":"{}"}})",
+      base64 ? "true" : "false",
+      base64 ? Base64::encode(body.data(), body.size()) : escape(body));
+}
+
+} // namespace
+
+// unwrapping an ALB response of the given body size, with the body as a
+// json string (0) or base64 encoded (1).
+static void BM_AlbResponseParse(benchmark::State &state) {
+  const std::string response = albResponse(state.range(0), state.range(1));
+  for (auto _ : state) {
+    Buffer::OwnedImpl json(response);
+    Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+    Buffer::OwnedImpl body;
+    benchmark::DoNotOptimize(AlbResponseParser::parse(json, headers, body));
+  }
+  state.SetBytesProcessed(state.iterations() * response.size());
+}
+BENCHMARK(BM_AlbResponseParse)
+    ->ArgsProduct({{1 << 8, 8 << 10, 256 << 10, 1 << 20}, {0, 1}});
+
+} // namespace Http
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
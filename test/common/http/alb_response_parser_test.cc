@@ -0,0 +1,73 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/alb_response_parser.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Http {
+
+TEST(AlbResponseParser, UnwrapsTheResponse) {
+  Buffer::OwnedImpl json(R"({
+    "statusCode": 201,
+    "requestContext": {"nested": [1, {"deeper": null}, "skipped"]},
+    "headers": {"Content-Type": "text/plain", "X-Count": 3},
+    "multiValueHeaders": {"Set-Cookie": ["a=1", "b=2"]},
+    "body": "line\n\"quoted\" \u00e9\ud83d\ude00",
+  })");
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  Buffer::OwnedImpl body;
+
+  ASSERT_TRUE(AlbResponseParser::parse(json, headers, body));
+  EXPECT_EQ("201", headers.getStatusValue());
+  EXPECT_EQ("text/plain", headers.getContentTypeValue());
+  // values that are not strings are added empty.
+  EXPECT_TRUE(headers.has("x-count"));
+  EXPECT_EQ("", headers.get_("x-count"));
+  const auto cookies = headers.get(Http::LowerCaseString("set-cookie"));
+  ASSERT_EQ(2U, cookies.size());
+  EXPECT_EQ("a=1", cookies[0]->value().getStringView());
+  EXPECT_EQ("b=2", cookies[1]->value().getStringView());
+  EXPECT_EQ("line\n\"quoted\" \xc3\xa9\xf0\x9f\x98\x80", body.toString());
+}
+
+TEST(AlbResponseParser, DecodesTheBodyWhenFlaggedAfterIt) {
+  Buffer::OwnedImpl json(
+      R"({"body": "AGJpbmFyeQ==", "isBase64Encoded": true})");
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  Buffer::OwnedImpl body;
+
+  ASSERT_TRUE(AlbResponseParser::parse(json, headers, body));
+  EXPECT_EQ("200", headers.getStatusValue());
+  // binary bodies are kept whole.
+  EXPECT_EQ(std::string("\0binary", 7), body.toString());
+}
+
+TEST(AlbResponseParser, RejectsInvalidResponses) {
+  const std::vector<std::string> responses = {
+      "",
+      "[]",
+      R"({"statusCode": "201"})",
+      R"({"body": "x", "isBase64Encoded": "yes"})",
+      R"({"body": "unterminated})",
+      R"({"body": "bad \q escape"})",
+      R"({"headers": {"a": "b"}} trailing)",
+      R"({"a": 1 "b": 2})",
+      R"({"a": [1,, 2]})",
+      // nested deeper than protobuf would parse.
+      R"({"a": )" + std::string(200, '[') + std::string(200, ']') + "}",
+  };
+  for (const std::string &response : responses) {
+    Buffer::OwnedImpl json(response);
+    Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+    Buffer::OwnedImpl body;
+    EXPECT_FALSE(AlbResponseParser::parse(json, headers, body)) << response;
+    // nothing is applied from an invalid response.
+    EXPECT_EQ("200", headers.getStatusValue());
+    EXPECT_EQ(0U, body.length());
+  }
+}
+
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "source/common/http/filter_pool.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Http {
+
+namespace {
+
+class TestFilter {
+public:
+  explicit TestFilter(const std::string &name) : name_(name) {}
+
+  const std::string &name() const { return name_; }
+  std::vector<int> &state() { return state_; }
+
+private:
+  const std::string name_;
+  std::vector<int> state_;
+};
+
+class OtherFilter {
+public:
+  int value_{};
+};
+
+} // namespace
+
+TEST(FilterPool, ReusesTheBlocksOfTheReleasedFilters) {
+  std::shared_ptr<TestFilter> filter = FilterPool<TestFilter>::make("first");
+  filter->state().push_back(1);
+  const void *block = filter.get();
+  filter.reset();
+  EXPECT_EQ(1U, FilterPool<TestFilter>::freeBlocks());
+
+  // the filter is constructed anew in the block of the previous one.
+  filter = FilterPool<TestFilter>::make("second");
+  EXPECT_EQ(block, filter.get());
+  EXPECT_EQ("second", filter->name());
+  EXPECT_TRUE(filter->state().empty());
+  EXPECT_EQ(0U, FilterPool<TestFilter>::freeBlocks());
+}
+
+TEST(FilterPool, KeepsAListForEachType) {
+  const size_t free_blocks = FilterPool<TestFilter>::freeBlocks();
+  const size_t other_free_blocks = FilterPool<OtherFilter>::freeBlocks();
+  FilterPool<OtherFilter>::make();
+  EXPECT_EQ(free_blocks, FilterPool<TestFilter>::freeBlocks());
+  EXPECT_EQ(std::max<size_t>(other_free_blocks, 1),
+            FilterPool<OtherFilter>::freeBlocks());
+}
+
+TEST(FilterPool, FreesTheBlocksPastTheLimit) {
+  std::vector<std::shared_ptr<OtherFilter>> filters;
+  for (size_t i = 0; i < FilterPool<OtherFilter>::MaxFreeBlocks + 10; ++i) {
+    filters.push_back(FilterPool<OtherFilter>::make());
+  }
+  filters.clear();
+  EXPECT_EQ(FilterPool<OtherFilter>::MaxFreeBlocks,
+            FilterPool<OtherFilter>::freeBlocks());
+}
+
+} // namespace Http
+} // namespace Envoy
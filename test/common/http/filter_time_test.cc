@@ -0,0 +1,65 @@
+#include "source/common/http/filter_time.h"
+#include "source/common/stream_info/filter_state_impl.h"
+
+#include "test/test_common/simulated_time_system.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Http {
+
+class FilterTimeTest : public testing::Test {
+public:
+  FilterTime &timeOf(absl::string_view filter_name) {
+    return FilterTime::forStream(filter_state_, filter_name, time_system_);
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  StreamInfo::FilterStateImpl filter_state_{
+      StreamInfo::FilterState::LifeSpan::FilterChain};
+};
+
+TEST_F(FilterTimeTest, IsSharedByTheFiltersOfAName) {
+  FilterTime &time = timeOf("io.solo.filter");
+  EXPECT_EQ(&time, &timeOf("io.solo.filter"));
+  EXPECT_NE(&time, &timeOf("io.solo.other"));
+  EXPECT_EQ(&time, filter_state_.getDataReadOnly<FilterTime>(
+                       "io.solo.filter.time"));
+}
+
+TEST_F(FilterTimeTest, AddsTheTimeOfItsScopes) {
+  FilterTime &time = timeOf("io.solo.filter");
+  {
+    FilterTime::Scope scope(&time);
+    time_system_.advanceTimeWait(std::chrono::milliseconds(3));
+    {
+      // counted by the outer scope already.
+      FilterTime::Scope nested(&time);
+      time_system_.advanceTimeWait(std::chrono::milliseconds(2));
+    }
+  }
+  time_system_.advanceTimeWait(std::chrono::milliseconds(10));
+  {
+    FilterTime::Scope scope(&time);
+    time_system_.advanceTimeWait(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(std::chrono::milliseconds(6), time.wall());
+  EXPECT_GE(time.cpu().count(), 0);
+
+  // a filter that doesn't record its time has none.
+  FilterTime::Scope scope(nullptr);
+}
+
+TEST_F(FilterTimeTest, Serializes) {
+  FilterTime time(time_system_);
+  time.add(std::chrono::microseconds(1500), std::chrono::microseconds(700));
+  EXPECT_EQ("wall_us=1500 cpu_us=700", time.serializeAsString().value());
+
+  const auto proto = time.serializeAsProto();
+  const auto &fields = dynamic_cast<ProtobufWkt::Struct &>(*proto).fields();
+  EXPECT_EQ(1500, fields.at("wall_us").number_value());
+  EXPECT_EQ(700, fields.at("cpu_us").number_value());
+}
+
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,149 @@
+#include "source/common/matcher/matcher_index.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Matcher {
+namespace {
+
+MatcherConstPtr createMatcher(const std::string &yaml) {
+  envoy::config::route::v3::RouteMatch match;
+  TestUtility::loadFromYaml(yaml, match);
+  return Matcher::create(match);
+}
+
+absl::optional<size_t> findFirst(const MatcherIndex &index,
+                                 const std::string &path) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", path}};
+  return index.findFirst(headers);
+}
+
+TEST(MatcherIndex, FirstMatchWins) {
+  MatcherIndex index;
+  index.add(createMatcher("prefix: /foo/bar"));
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/fo+\"}"));
+  index.add(createMatcher("path: /foo"));
+  index.add(createMatcher("prefix: /foo"));
+  index.add(createMatcher("prefix: /"));
+
+  EXPECT_EQ(0, findFirst(index, "/foo/bar/baz"));
+  EXPECT_EQ(1, findFirst(index, "/foo"));
+  EXPECT_EQ(2, findFirst(index, "/foo?a=b"));
+  EXPECT_EQ(3, findFirst(index, "/foo/baz"));
+  EXPECT_EQ(4, findFirst(index, "/bar"));
+}
+
+TEST(MatcherIndex, NoMatch) {
+  MatcherIndex index;
+  index.add(createMatcher("prefix: /foo"));
+  index.add(createMatcher("path: /bar"));
+
+  EXPECT_EQ(absl::nullopt, findFirst(index, "/fo"));
+  EXPECT_EQ(absl::nullopt, findFirst(index, "/bar/baz"));
+}
+
+TEST(MatcherIndex, CaseInsensitiveIsNotIndexed) {
+  MatcherIndex index;
+  index.add(createMatcher("{prefix: /FOO, case_sensitive: false}"));
+  index.add(createMatcher("{path: /BAR, case_sensitive: false}"));
+
+  EXPECT_EQ(0, findFirst(index, "/foo/baz"));
+  EXPECT_EQ(1, findFirst(index, "/bar"));
+}
+
+TEST(MatcherIndex, ChecksHeadersOfCandidates) {
+  MatcherIndex index;
+  index.add(createMatcher(R"EOF(
+prefix: /foo
+headers:
+- name: x-foo
+  exact_match: bar
+)EOF"));
+  index.add(createMatcher("prefix: /foo"));
+
+  Http::TestRequestHeaderMapImpl headers{{":path", "/foo"}, {"x-foo", "bar"}};
+  EXPECT_EQ(0, index.findFirst(headers));
+  headers.setCopy(Http::LowerCaseString("x-foo"), "baz");
+  EXPECT_EQ(1, index.findFirst(headers));
+}
+
+TEST(MatcherIndex, ChecksQueryParametersOfCandidates) {
+  MatcherIndex index;
+  index.add(createMatcher(R"EOF(
+prefix: /foo
+query_parameters:
+- name: a
+  string_match: {exact: b}
+)EOF"));
+  index.add(createMatcher(R"EOF(
+prefix: /foo
+query_parameters:
+- name: c
+  present_match: true
+)EOF"));
+
+  EXPECT_EQ(0, findFirst(index, "/foo?a=b"));
+  EXPECT_EQ(1, findFirst(index, "/foo?a=c&c=d"));
+  EXPECT_EQ(absl::nullopt, findFirst(index, "/foo?a=c"));
+}
+
+TEST(MatcherIndex, RegexSet) {
+  MatcherIndex index;
+  index.add(
+      createMatcher("safe_regex: {google_re2: {}, regex: \"/foo/[0-9]+\"}"));
+  index.add(createMatcher("prefix: /foo/1"));
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/foo/.*\"}"));
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/bar\"}"));
+  index.build();
+
+  EXPECT_EQ(0, findFirst(index, "/foo/12"));
+  EXPECT_EQ(1, findFirst(index, "/foo/1a"));
+  EXPECT_EQ(2, findFirst(index, "/foo/a?b=c"));
+  EXPECT_EQ(3, findFirst(index, "/bar?b=c"));
+  // the regexes match the whole path.
+  EXPECT_EQ(absl::nullopt, findFirst(index, "/bar/baz"));
+  EXPECT_EQ(absl::nullopt, findFirst(index, "/baz/bar"));
+}
+
+TEST(MatcherIndex, RegexesAddedAfterBuild) {
+  MatcherIndex index;
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/foo\"}"));
+  index.build();
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/ba.\"}"));
+
+  EXPECT_EQ(0, findFirst(index, "/foo"));
+  EXPECT_EQ(1, findFirst(index, "/bar"));
+  index.build();
+  EXPECT_EQ(1, findFirst(index, "/baz"));
+}
+
+TEST(MatcherIndex, ChecksHeadersOfRegexCandidates) {
+  MatcherIndex index;
+  index.add(createMatcher(R"EOF(
+safe_regex: {google_re2: {}, regex: "/fo+"}
+headers:
+- name: x-foo
+  exact_match: bar
+)EOF"));
+  index.add(createMatcher("safe_regex: {google_re2: {}, regex: \"/f.*\"}"));
+  index.build();
+
+  Http::TestRequestHeaderMapImpl headers{{":path", "/foo"}, {"x-foo", "bar"}};
+  EXPECT_EQ(0, index.findFirst(headers));
+  headers.setCopy(Http::LowerCaseString("x-foo"), "baz");
+  EXPECT_EQ(1, index.findFirst(headers));
+}
+
+TEST(LazyQueryParams, ParsesOnFirstUse) {
+  Http::TestRequestHeaderMapImpl headers{{":path", "/foo?a=b"}};
+  LazyQueryParams query_params(headers);
+  const Http::Utility::QueryParams &parsed = query_params.get();
+  EXPECT_EQ("b", parsed.at("a"));
+  EXPECT_EQ(&parsed, &query_params.get());
+}
+
+} // namespace
+} // namespace Matcher
+} // namespace Envoy
@@ -0,0 +1,101 @@
+#include "source/common/nats/circuit_breakers.h"
+
+#include "test/mocks/nats/mocks.h"
+#include "test/mocks/upstream/cluster_info.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Nats {
+
+class NatsCircuitBreakersTest : public testing::Test {
+public:
+  NatsCircuitBreakersTest() {
+    // at most 2 pending requests and 3 requests.
+    cluster_->resetResourceManager(1024, 2, 3, 3, 1024);
+    ON_CALL(conn_pool_, clusterInfo()).WillByDefault(Return(cluster_));
+  }
+
+  Upstream::Resource &pending() {
+    return cluster_->resourceManager(Upstream::ResourcePriority::Default)
+        .pendingRequests();
+  }
+  Upstream::Resource &requests() {
+    return cluster_->resourceManager(Upstream::ResourcePriority::Default)
+        .requests();
+  }
+  uint64_t overflows() {
+    return cluster_->stats().upstream_rq_pending_overflow_.value();
+  }
+
+  NiceMock<ConnPoolNats::MockInstance> conn_pool_;
+  std::shared_ptr<NiceMock<Upstream::MockClusterInfo>> cluster_{
+      new NiceMock<Upstream::MockClusterInfo>()};
+};
+
+TEST_F(NatsCircuitBreakersTest, RejectsThePendingRequestsOverTheThreshold) {
+  CircuitBreakers circuit_breakers(conn_pool_);
+  EXPECT_TRUE(circuit_breakers.admit(true));
+  circuit_breakers.update(2, 2);
+  EXPECT_EQ(2, pending().count());
+  EXPECT_EQ(2, requests().count());
+
+  EXPECT_FALSE(circuit_breakers.admit(true));
+  EXPECT_EQ(1, overflows());
+  // a request that is written right away isn't pending.
+  EXPECT_TRUE(circuit_breakers.admit(false));
+  EXPECT_EQ(1, overflows());
+}
+
+TEST_F(NatsCircuitBreakersTest, RejectsTheRequestsOverTheThreshold) {
+  CircuitBreakers circuit_breakers(conn_pool_);
+  circuit_breakers.update(0, 3);
+  EXPECT_FALSE(circuit_breakers.admit(false));
+  EXPECT_FALSE(circuit_breakers.admit(true));
+  EXPECT_EQ(2, overflows());
+
+  circuit_breakers.update(0, 2);
+  EXPECT_TRUE(circuit_breakers.admit(false));
+}
+
+TEST_F(NatsCircuitBreakersTest, ReleasesTheCountsOnDestruction) {
+  {
+    CircuitBreakers circuit_breakers(conn_pool_);
+    circuit_breakers.update(2, 3);
+  }
+  EXPECT_EQ(0, pending().count());
+  EXPECT_EQ(0, requests().count());
+}
+
+TEST_F(NatsCircuitBreakersTest, ReleasesTheCountsOnTheClusterTheyWereTakenOn) {
+  CircuitBreakers circuit_breakers(conn_pool_);
+  circuit_breakers.update(1, 1);
+
+  // the cluster is updated, and the pool now makes requests to the new one.
+  auto updated = std::make_shared<NiceMock<Upstream::MockClusterInfo>>();
+  ON_CALL(conn_pool_, clusterInfo()).WillByDefault(Return(updated));
+  circuit_breakers.update(0, 0);
+  EXPECT_EQ(0, pending().count());
+  EXPECT_EQ(0, requests().count());
+
+  circuit_breakers.update(1, 1);
+  EXPECT_EQ(0, pending().count());
+  EXPECT_EQ(1, updated->resourceManager(Upstream::ResourcePriority::Default)
+                   .pendingRequests()
+                   .count());
+  circuit_breakers.update(0, 0);
+}
+
+TEST_F(NatsCircuitBreakersTest, AdmitsTheRequestsToARemovedCluster) {
+  ON_CALL(conn_pool_, clusterInfo()).WillByDefault(Return(nullptr));
+  CircuitBreakers circuit_breakers(conn_pool_);
+  EXPECT_TRUE(circuit_breakers.admit(true));
+  circuit_breakers.update(5, 5);
+}
+
+} // namespace Nats
+} // namespace Envoy
@@ -0,0 +1,85 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/nats/codec_impl.h"
+#include "source/common/nats/message_builder.h"
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Nats {
+
+namespace {
+
+class CountingDecoderCallbacks : public DecoderCallbacks<Message> {
+public:
+  void onValue(MessagePtr &&value) override {
+    benchmark::DoNotOptimize(value);
+    values_++;
+  }
+
+  uint64_t values_{};
+};
+
+// what a NATS Streaming client reads: mostly acks, with the odd heartbeat,
+// PING and +OK in between.
+std::string serverStream(size_t payload_size) {
+  const std::string payload(payload_size, 'a');
+  std::string stream;
+  for (int i = 0; i < 64; i++) {
+    absl::StrAppend(&stream, "MSG _STAN.acks.abcdefghijklmnopqrstuv.", i,
+                    " 3 ", payload.size(), "\r\n", payload, "\r\n");
+    if (i % 16 == 0) {
+      absl::StrAppend(&stream, "MSG _INBOX.abcdefghijklmnopqrstuv 1 "
+                               "_STAN.heartbeat.xyz 0\r\n\r\n");
+    }
+    if (i % 32 == 0) {
+      absl::StrAppend(&stream, "PING\r\n+OK\r\n");
+    }
+  }
+  return stream;
+}
+
+} // namespace
+
+// decoding a stream as it is read, in reads of the given size.
+static void BM_DecodeStream(benchmark::State &state) {
+  const std::string stream = serverStream(state.range(0));
+  const size_t read_size = state.range(1);
+  CountingDecoderCallbacks callbacks;
+  DecoderImpl decoder(callbacks);
+  for (auto _ : state) {
+    for (size_t offset = 0; offset < stream.size(); offset += read_size) {
+      Buffer::OwnedImpl data(
+          absl::string_view(stream).substr(offset, read_size));
+      decoder.decode(data);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * stream.size());
+  benchmark::DoNotOptimize(callbacks.values_);
+}
+BENCHMARK(BM_DecodeStream)
+    ->ArgsProduct({{0, 64, 1 << 10, 16 << 10}, {256, 4 << 10, 16 << 10}});
+
+// building a PUB of the payload, as each publish does, and encoding it.
+static void BM_EncodePubMessage(benchmark::State &state) {
+  const std::string payload(state.range(0), 'a');
+  EncoderImpl encoder;
+  Buffer::OwnedImpl out;
+  uint64_t sequence = 0;
+  for (auto _ : state) {
+    const Message message = MessageBuilder::createPubMessage(
+        "_STAN.pub.abcdefghijklmnopqrstuv.subject1",
+        "_STAN.acks.abcdefghijklmnopqrstuv", ++sequence,
+        std::make_unique<Buffer::OwnedImpl>(payload));
+    encoder.encode(message, out);
+    out.drain(out.length());
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_EncodePubMessage)->RangeMultiplier(8)->Range(64, 1 << 20);
+
+} // namespace Nats
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
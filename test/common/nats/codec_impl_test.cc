@@ -5,6 +5,7 @@
 #include "source/common/nats/codec_impl.h"
 
 #include "test/mocks/nats/mocks.h"
+#include "test/test_common/utility.h"
 
 #include "gtest/gtest.h"
 
@@ -107,10 +108,133 @@ TEST_F(NatsEncoderDecoderImplTest, MultipleSimpleStringsFragmentedDecode) {
   EXPECT_EQ(0UL, buffer_.length());
 }
 
+TEST_F(NatsEncoderDecoderImplTest, EncodesPayloads) {
+  Message value{"PUB subject1 reply_to1 8"};
+  value.setPayload(std::make_shared<Buffer::OwnedImpl>("payload1"));
+  encoder_.encode(value, buffer_);
+  EXPECT_EQ("PUB subject1 reply_to1 8\r\npayload1\r\n", buffer_.toString());
+
+  // the encoded payload outlives the message.
+  value.setPayload(nullptr);
+  EXPECT_EQ("PUB subject1 reply_to1 8\r\npayload1\r\n", buffer_.toString());
+}
+
+TEST_F(NatsEncoderDecoderImplTest, SimpleStringsAcrossSlices) {
+  // each byte in its own slice, so that the CR and the LF are apart.
+  const std::string input = "MSG foo 1 5\r\nhello\r\nPING\r\n";
+  for (const char c : input) {
+    buffer_.appendSliceForTest(&c, 1);
+  }
+  decoder_.decode(buffer_);
+  ASSERT_EQ(2, decoded_values_.size());
+  EXPECT_EQ("MSG foo 1 5", decoded_values_[0]->asString());
+  EXPECT_EQ("hello", decoded_values_[0]->payload()->toString());
+  EXPECT_EQ("PING", decoded_values_[1]->asString());
+  EXPECT_EQ(0UL, buffer_.length());
+}
+
+TEST_F(NatsEncoderDecoderImplTest, TokenizesOperations) {
+  buffer_.add("PING\r\nSUB  foo\t1\r\n");
+  decoder_.decode(buffer_);
+  ASSERT_EQ(2, decoded_values_.size());
+  EXPECT_EQ("PING", decoded_values_[0]->operation());
+  EXPECT_EQ(0, decoded_values_[0]->argumentCount());
+  EXPECT_EQ(nullptr, decoded_values_[0]->payload());
+  EXPECT_EQ("SUB", decoded_values_[1]->operation());
+  ASSERT_EQ(2, decoded_values_[1]->argumentCount());
+  EXPECT_EQ("foo", decoded_values_[1]->argument(0));
+  EXPECT_EQ("1", decoded_values_[1]->argument(1));
+}
+
+TEST_F(NatsEncoderDecoderImplTest, MsgWithPayload) {
+  // the payload is read by its length, so it may hold a CRLF.
+  buffer_.add("MSG foo 1 reply 7\r\nhe\r\nllo\r\nMSG bar 2 0\r\n\r\n");
+  decoder_.decode(buffer_);
+  ASSERT_EQ(2, decoded_values_.size());
+
+  const Message &msg = *decoded_values_[0];
+  EXPECT_EQ("MSG", msg.operation());
+  ASSERT_EQ(4, msg.argumentCount());
+  EXPECT_EQ("foo", msg.argument(0));
+  EXPECT_EQ("reply", msg.argument(2));
+  EXPECT_EQ("he\r\nllo", msg.payload()->toString());
+
+  const Message &empty = *decoded_values_[1];
+  EXPECT_EQ("bar", empty.argument(0));
+  ASSERT_NE(nullptr, empty.payload());
+  EXPECT_EQ(0, empty.payload()->length());
+  EXPECT_EQ(0UL, buffer_.length());
+}
+
+TEST_F(NatsEncoderDecoderImplTest, MsgPayloadAcrossDecodes) {
+  buffer_.add("MSG foo 1 10\r\n01234");
+  decoder_.decode(buffer_);
+  EXPECT_EQ(0, decoded_values_.size());
+  buffer_.add("56789\r");
+  decoder_.decode(buffer_);
+  EXPECT_EQ(0, decoded_values_.size());
+  buffer_.add("\n");
+  decoder_.decode(buffer_);
+  ASSERT_EQ(1, decoded_values_.size());
+  EXPECT_EQ("0123456789", decoded_values_[0]->payload()->toString());
+}
+
+TEST_F(NatsEncoderDecoderImplTest, InvalidMsg) {
+  buffer_.add("MSG foo 1 ten\r\n");
+  EXPECT_THROW_WITH_MESSAGE(decoder_.decode(buffer_), ProtocolError,
+                            "invalid MSG");
+}
+
+TEST_F(NatsEncoderDecoderImplTest, MsgPayloadTooLarge) {
+  buffer_.add(
+      fmt::format("MSG foo 1 {}\r\n", DecoderImpl::MaxPayloadBytes + 1));
+  EXPECT_THROW_WITH_MESSAGE(decoder_.decode(buffer_), ProtocolError,
+                            "MSG payload too large");
+}
+
+TEST_F(NatsEncoderDecoderImplTest, InvalidMsgExpectCRAfterPayload) {
+  buffer_.add("MSG foo 1 2\r\nabc\r\n");
+  EXPECT_THROW_WITH_MESSAGE(decoder_.decode(buffer_), ProtocolError,
+                            "expected carriage return");
+}
+
+TEST_F(NatsEncoderDecoderImplTest, CRLFSplitAcrossDecodes) {
+  buffer_.add("+OK\r");
+  decoder_.decode(buffer_);
+  EXPECT_EQ(0, decoded_values_.size());
+
+  buffer_.add("\n");
+  decoder_.decode(buffer_);
+  ASSERT_EQ(1, decoded_values_.size());
+  EXPECT_EQ("+OK", decoded_values_[0]->asString());
+}
+
+TEST_F(NatsEncoderDecoderImplTest, InvalidSimpleStringExpectLFAcrossSlices) {
+  buffer_.add("+OK\r");
+  decoder_.decode(buffer_);
+  buffer_.add("a");
+  EXPECT_THROW(decoder_.decode(buffer_), ProtocolError);
+}
+
 TEST_F(NatsEncoderDecoderImplTest, InvalidSimpleStringExpectLF) {
   buffer_.add(":-123\ra");
   EXPECT_THROW(decoder_.decode(buffer_), ProtocolError);
 }
 
+TEST_F(NatsEncoderDecoderImplTest, DecodesTheType) {
+  buffer_.add("MSG foo 1 0\r\n\r\nping\r\nPONG\r\n+OK\r\n-ERR 'x'\r\n"
+              "INFO {}\r\nSUB foo 1\r\n\r\n");
+  decoder_.decode(buffer_);
+  ASSERT_EQ(8, decoded_values_.size());
+  EXPECT_EQ(Message::Type::Msg, decoded_values_[0]->type());
+  EXPECT_EQ(Message::Type::Ping, decoded_values_[1]->type());
+  EXPECT_EQ(Message::Type::Pong, decoded_values_[2]->type());
+  EXPECT_EQ(Message::Type::Ok, decoded_values_[3]->type());
+  EXPECT_EQ(Message::Type::Err, decoded_values_[4]->type());
+  EXPECT_EQ(Message::Type::Info, decoded_values_[5]->type());
+  EXPECT_EQ(Message::Type::Other, decoded_values_[6]->type());
+  EXPECT_EQ(Message::Type::Other, decoded_values_[7]->type());
+}
+
 } // namespace Nats
 } // namespace Envoy
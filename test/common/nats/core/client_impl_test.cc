@@ -0,0 +1,115 @@
+#include "source/common/nats/core/client_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/nats/mocks.h"
+#include "test/mocks/nats/streaming/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+class CoreClientImplTest : public testing::Test {
+public:
+  CoreClientImplTest() {
+    ON_CALL(*conn_pool_, makeRequest(_, _))
+        .WillByDefault(Invoke(
+            [this](const std::string &, const Message &request) {
+              sent_.push_back(request.asString());
+            }));
+  }
+
+  static Buffer::InstancePtr payload(const std::string &data) {
+    return std::make_unique<Buffer::OwnedImpl>(data);
+  }
+
+  static MessagePtr message(const std::string &string) {
+    auto message = std::make_unique<Message>(string);
+    message->tokenize();
+    return message;
+  }
+
+  NiceMock<Nats::ConnPoolNats::MockInstance> *conn_pool_{
+      new NiceMock<Nats::ConnPoolNats::MockInstance>()};
+  NiceMock<Random::MockRandomGenerator> random_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  Streaming::MockPublishCallbacks callbacks_;
+  std::vector<std::string> sent_;
+};
+
+TEST_F(CoreClientImplTest, PublishesOnceConnected) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, ""};
+
+  // the first request connects, and waits for the connection.
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject2", "", "", payload("payload2"), callbacks_);
+  request2->cancel();
+  ASSERT_EQ(1U, sent_.size());
+  EXPECT_EQ(1U, client.outstandingRequests());
+
+  // the publishes have no reply subject, and succeed once written.
+  EXPECT_CALL(callbacks_, onResponse());
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(std::vector<std::string>({sent_[0], "PUB subject1 8"}), sent_);
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  EXPECT_CALL(callbacks_, onResponse());
+  PublishRequestPtr request3 = client.makeRequest(
+      "subject3", "", "", payload("payload3"), callbacks_);
+  EXPECT_NE(nullptr, request3);
+  EXPECT_EQ("PUB subject3 8", sent_.back());
+}
+
+TEST_F(CoreClientImplTest, ConnectsAheadOfTheFirstRequest) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, ""};
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  client.connect();
+  client.connect();
+  ASSERT_EQ(1U, sent_.size());
+  client.onResponse(message("INFO {}"));
+
+  // the first request is published right away.
+  EXPECT_CALL(callbacks_, onResponse());
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  EXPECT_EQ("PUB subject1 8", sent_.back());
+}
+
+TEST_F(CoreClientImplTest, ReconnectsOnClose) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, ""};
+  EXPECT_CALL(callbacks_, onResponse()).Times(2);
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  client.onResponse(message("INFO {}"));
+
+  auto *reconnect_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  client.onClose();
+  EXPECT_TRUE(reconnect_timer->enabled_);
+
+  // the requests made meanwhile wait for the connection.
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject2", "", "", payload("payload2"), callbacks_);
+  EXPECT_EQ(1U, client.outstandingRequests());
+
+  reconnect_timer->invokeCallback();
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ("PUB subject2 8", sent_.back());
+  EXPECT_EQ(0U, client.outstandingRequests());
+}
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
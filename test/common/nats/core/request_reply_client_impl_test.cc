@@ -0,0 +1,178 @@
+#include "source/common/nats/core/request_reply_client_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/nats/mocks.h"
+#include "test/mocks/nats/streaming/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Nats {
+namespace Core {
+
+class RequestReplyClientImplTest : public testing::Test {
+public:
+  RequestReplyClientImplTest() {
+    ON_CALL(*conn_pool_, makeRequest(_, _))
+        .WillByDefault(Invoke([this](const std::string &,
+                                     const Message &request) {
+          Message message(request);
+          message.tokenize();
+          sent_.push_back(std::string(message.operation()));
+          if (message.operation() == "SUB") {
+            subscribed_.push_back(std::string(message.argument(0)));
+          } else if (message.operation() == "PUB") {
+            reply_to_.push_back(std::string(message.argument(1)));
+          }
+        }));
+  }
+
+  static Buffer::InstancePtr payload(const std::string &data) {
+    return std::make_unique<Buffer::OwnedImpl>(data);
+  }
+
+  static MessagePtr message(const std::string &string) {
+    auto message = std::make_unique<Message>(string);
+    message->tokenize();
+    return message;
+  }
+
+  static MessagePtr reply(const std::string &reply_to,
+                          const std::string &payload) {
+    MessagePtr reply =
+        message(absl::StrCat("MSG ", reply_to, " 1 ", payload.size()));
+    reply->setPayload(std::make_shared<Buffer::OwnedImpl>(payload));
+    return reply;
+  }
+
+  NiceMock<Nats::ConnPoolNats::MockInstance> *conn_pool_{
+      new NiceMock<Nats::ConnPoolNats::MockInstance>()};
+  NiceMock<Random::MockRandomGenerator> random_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  std::chrono::milliseconds op_timeout_{5000};
+  Streaming::MockPublishCallbacks callbacks1_;
+  Streaming::MockPublishCallbacks callbacks2_;
+  std::vector<std::string> sent_;
+  std::vector<std::string> subscribed_;
+  std::vector<std::string> reply_to_;
+};
+
+TEST_F(RequestReplyClientImplTest, AnswersTheRequestsWithTheirReplies) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  RequestReplyClientImpl client{
+      Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_}, random_,
+      dispatcher_, op_timeout_, ""};
+
+  // the requests made while connecting wait for the connection.
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks1_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject2", "", "", payload("payload2"), callbacks2_);
+  EXPECT_EQ(std::vector<std::string>({"CONNECT"}), sent_);
+  EXPECT_EQ(2U, client.outstandingRequests());
+
+  // a single subscription gets the replies of both.
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(std::vector<std::string>({"CONNECT", "SUB", "PUB", "PUB"}),
+            sent_);
+  ASSERT_EQ(1U, subscribed_.size());
+  ASSERT_EQ(2U, reply_to_.size());
+  const std::string inbox =
+      subscribed_[0].substr(0, subscribed_[0].size() - 1);
+  EXPECT_EQ(absl::StrCat(inbox, "1"), reply_to_[0]);
+  EXPECT_EQ(absl::StrCat(inbox, "2"), reply_to_[1]);
+
+  // the replies may come in any order, and the second one to a request
+  // finds nothing.
+  EXPECT_CALL(callbacks2_, onReply_("reply2"));
+  client.onResponse(reply(reply_to_[1], "reply2"));
+  EXPECT_CALL(callbacks1_, onReply_("reply1"));
+  client.onResponse(reply(reply_to_[0], "reply1"));
+  client.onResponse(reply(reply_to_[0], "again"));
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  // a request made once connected is published right away.
+  PublishRequestPtr request3 = client.makeRequest(
+      "subject1", "", "", payload("payload3"), callbacks1_);
+  EXPECT_EQ(3U, reply_to_.size());
+  EXPECT_EQ(1U, client.outstandingRequests());
+}
+
+TEST_F(RequestReplyClientImplTest, IgnoresTheRepliesOfCanceledRequests) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  RequestReplyClientImpl client{
+      Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_}, random_,
+      dispatcher_, op_timeout_, ""};
+
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks1_);
+  client.onResponse(message("INFO {}"));
+  request1->cancel();
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  EXPECT_CALL(callbacks1_, onReply_(_)).Times(0);
+  client.onResponse(reply(reply_to_[0], "reply1"));
+  // neither is a message to an inbox of the client.
+  client.onResponse(reply("_INBOX.other.1", "reply1"));
+  client.onResponse(reply(absl::StrCat(reply_to_[0], "x"), "reply1"));
+}
+
+TEST_F(RequestReplyClientImplTest, TimesOutTheRequestsWithoutReply) {
+  auto *timeout_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  RequestReplyClientImpl client{
+      Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_}, random_,
+      dispatcher_, std::chrono::milliseconds(0), ""};
+
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks1_);
+  client.onResponse(message("INFO {}"));
+  EXPECT_TRUE(timeout_timer->enabled_);
+
+  EXPECT_CALL(callbacks1_, onTimeout());
+  timeout_timer->invokeCallback();
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  // a reply that comes too late finds nothing.
+  EXPECT_CALL(callbacks1_, onReply_(_)).Times(0);
+  client.onResponse(reply(reply_to_[0], "reply1"));
+}
+
+TEST_F(RequestReplyClientImplTest, FailsPublishedRequestsOnClose) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  RequestReplyClientImpl client{
+      Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_}, random_,
+      dispatcher_, op_timeout_, ""};
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks1_);
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(1U, reply_to_.size());
+
+  auto *reconnect_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  EXPECT_CALL(callbacks1_, onFailure());
+  client.onClose();
+  EXPECT_EQ(0U, client.outstandingRequests());
+  EXPECT_TRUE(reconnect_timer->enabled_);
+
+  // the requests made meanwhile are published once reconnected, after the
+  // inbox is subscribed to again.
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject2", "", "", payload("payload2"), callbacks2_);
+  reconnect_timer->invokeCallback();
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(2U, subscribed_.size());
+  EXPECT_EQ(2U, reply_to_.size());
+  EXPECT_CALL(callbacks2_, onReply_("reply2"));
+  client.onResponse(reply(reply_to_[1], "reply2"));
+}
+
+} // namespace Core
+} // namespace Nats
+} // namespace Envoy
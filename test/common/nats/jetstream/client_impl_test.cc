@@ -0,0 +1,136 @@
+#include "source/common/nats/jetstream/client_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/nats/mocks.h"
+#include "test/mocks/nats/streaming/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Nats {
+namespace JetStream {
+
+class JetStreamClientImplTest : public testing::Test {
+public:
+  JetStreamClientImplTest() {
+    ON_CALL(*conn_pool_, makeRequest(_, _))
+        .WillByDefault(Invoke([this](const std::string &,
+                                     const Message &request) {
+          Message message(request);
+          message.tokenize();
+          sent_.push_back(std::string(message.operation()));
+          if (message.operation() == "PUB") {
+            reply_to_.push_back(std::string(message.argument(1)));
+          }
+        }));
+  }
+
+  static Buffer::InstancePtr payload(const std::string &data) {
+    return std::make_unique<Buffer::OwnedImpl>(data);
+  }
+
+  static MessagePtr message(const std::string &string) {
+    auto message = std::make_unique<Message>(string);
+    message->tokenize();
+    return message;
+  }
+
+  static MessagePtr ack(const std::string &reply_to,
+                        const std::string &payload) {
+    MessagePtr ack =
+        message(absl::StrCat("MSG ", reply_to, " 1 ", payload.size()));
+    ack->setPayload(std::make_shared<Buffer::OwnedImpl>(payload));
+    return ack;
+  }
+
+  NiceMock<Nats::ConnPoolNats::MockInstance> *conn_pool_{
+      new NiceMock<Nats::ConnPoolNats::MockInstance>()};
+  NiceMock<Random::MockRandomGenerator> random_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  std::chrono::milliseconds op_timeout_{5000};
+  Streaming::MockPublishCallbacks callbacks_;
+  std::vector<std::string> sent_;
+  std::vector<std::string> reply_to_;
+};
+
+TEST_F(JetStreamClientImplTest, PublishesWithinTheWindow) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, 1, ""};
+
+  // the first request connects, and waits for the connection.
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "", "", payload("payload2"), callbacks_);
+  EXPECT_EQ(std::vector<std::string>({"CONNECT"}), sent_);
+  EXPECT_EQ(2U, client.outstandingRequests());
+
+  // only one publish waits for its ack at a time.
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(std::vector<std::string>({"CONNECT", "SUB", "PUB"}), sent_);
+
+  EXPECT_CALL(callbacks_, onResponse());
+  client.onResponse(ack(reply_to_[0], R"({"stream":"s","seq":1})"));
+  EXPECT_EQ(2U, reply_to_.size());
+  EXPECT_EQ(1U, client.outstandingRequests());
+
+  EXPECT_CALL(callbacks_, onFailure());
+  client.onResponse(
+      ack(reply_to_[1], R"({"error":{"code":503,"description":"x"}})"));
+  EXPECT_EQ(0U, client.outstandingRequests());
+}
+
+TEST_F(JetStreamClientImplTest, IgnoresTheAcksOfCanceledRequests) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, 1, ""};
+
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "", "", payload("payload2"), callbacks_);
+  client.onResponse(message("INFO {}"));
+
+  // canceling the publish in flight frees the window for the next one.
+  request1->cancel();
+  EXPECT_EQ(2U, reply_to_.size());
+  EXPECT_CALL(callbacks_, onResponse()).Times(0);
+  client.onResponse(ack(reply_to_[0], R"({"stream":"s","seq":1})"));
+  EXPECT_EQ(1U, client.outstandingRequests());
+}
+
+TEST_F(JetStreamClientImplTest, FailsInFlightRequestsOnClose) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, 1, ""};
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "", "", payload("payload1"), callbacks_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "", "", payload("payload2"), callbacks_);
+  client.onResponse(message("INFO {}"));
+
+  auto *reconnect_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  EXPECT_CALL(callbacks_, onFailure());
+  client.onClose();
+  EXPECT_EQ(1U, client.outstandingRequests());
+  EXPECT_TRUE(reconnect_timer->enabled_);
+
+  // the pending request is published once reconnected.
+  reconnect_timer->invokeCallback();
+  client.onResponse(message("INFO {}"));
+  EXPECT_EQ(2U, reply_to_.size());
+  EXPECT_EQ(1U, client.outstandingRequests());
+}
+
+} // namespace JetStream
+} // namespace Nats
+} // namespace Envoy
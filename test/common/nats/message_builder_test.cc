@@ -1,3 +1,4 @@
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/assert.h"
 #include "source/common/nats/message_builder.h"
 
@@ -26,13 +27,31 @@ TEST_F(NatsMessageBuilderTest, PubMessage) {
   ASSERT_EQ(expected_message, actual_message);
 }
 
+TEST_F(NatsMessageBuilderTest, PubMessageWithPayload) {
+  Message expected_message{"PUB subject1 8"};
+  expected_message.setPayload(std::make_shared<Buffer::OwnedImpl>("payload1"));
+  auto actual_message = MessageBuilder::createPubMessage(
+      "subject1", std::make_unique<Buffer::OwnedImpl>("payload1"));
+  ASSERT_EQ(expected_message, actual_message);
+}
+
 TEST_F(NatsMessageBuilderTest, PubMessageWithReplyToAndPayload) {
-  Message expected_message{"PUB subject1 reply_to1 8\r\npayload1"};
+  Message expected_message{"PUB subject1 reply_to1 8"};
+  expected_message.setPayload(std::make_shared<Buffer::OwnedImpl>("payload1"));
   auto actual_message =
       MessageBuilder::createPubMessage("subject1", "reply_to1", "payload1");
   ASSERT_EQ(expected_message, actual_message);
 }
 
+TEST_F(NatsMessageBuilderTest, PubMessageWithReplyToChildAndPayload) {
+  Message expected_message{"PUB subject1 inbox1.17 8"};
+  expected_message.setPayload(std::make_shared<Buffer::OwnedImpl>("payload1"));
+  auto actual_message = MessageBuilder::createPubMessage(
+      "subject1", "inbox1", 17,
+      std::make_unique<Buffer::OwnedImpl>("payload1"));
+  ASSERT_EQ(expected_message, actual_message);
+}
+
 TEST_F(NatsMessageBuilderTest, SubMessage) {
   Message expected_message{"SUB subject1 6"};
   auto actual_message = MessageBuilder::createSubMessage("subject1", 6);
@@ -43,6 +62,9 @@ TEST_F(NatsMessageBuilderTest, PongMessage) {
   Message expected_message{"PONG"};
   auto actual_message = MessageBuilder::createPongMessage();
   ASSERT_EQ(expected_message, actual_message);
+  // the PONG is built once.
+  EXPECT_EQ(expected_message, MessageBuilder::pongMessage());
+  EXPECT_EQ(&MessageBuilder::pongMessage(), &MessageBuilder::pongMessage());
 }
 
 } // namespace Nats
@@ -0,0 +1,37 @@
+#include "source/common/common/random_generator.h"
+#include "source/common/nats/nuid/nuid.h"
+
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Nuid {
+
+// generating a NUID as a new string, as the guid of each publish is.
+static void BM_NuidNextString(benchmark::State &state) {
+  Random::RandomGeneratorImpl random_generator;
+  Nuid nuid(random_generator);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nuid.next());
+  }
+}
+BENCHMARK(BM_NuidNextString);
+
+// generating a NUID into storage of the caller.
+static void BM_NuidNextInto(benchmark::State &state) {
+  Random::RandomGeneratorImpl random_generator;
+  Nuid nuid(random_generator);
+  char output[Nuid::TOTAL_LEN];
+  for (auto _ : state) {
+    nuid.next(output);
+    benchmark::DoNotOptimize(output);
+  }
+}
+BENCHMARK(BM_NuidNextInto);
+
+} // namespace Nuid
+} // namespace Nats
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
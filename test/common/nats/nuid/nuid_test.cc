@@ -1,12 +1,16 @@
+#include <cctype>
 #include <climits>
 
 #include "source/common/common/random_generator.h"
 #include "source/common/nats/nuid/nuid.h"
 
+#include "test/mocks/common.h"
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 using testing::NiceMock;
+using testing::Return;
 
 namespace Envoy {
 namespace Nats {
@@ -34,6 +38,31 @@ TEST_F(NuidTest, Length) {
   EXPECT_EQ(Nuid::TOTAL_LEN, nuid.next().length());
 }
 
+TEST_F(NuidTest, Digits62) {
+  NiceMock<Random::MockRandomGenerator> random_generator;
+  ON_CALL(random_generator, random()).WillByDefault(Return(42));
+  // the prefix is 42 in 10 digits then in 2, and the increment 33 + 42.
+  Nuid nuid(random_generator, 0);
+  EXPECT_EQ("000000000g0g", nuid.pre());
+  EXPECT_EQ("000000000g0g000000001D", nuid.next());
+
+  char output[Nuid::TOTAL_LEN];
+  nuid.next(output);
+  EXPECT_EQ("000000000g0g000000002Q", std::string(output, Nuid::TOTAL_LEN));
+}
+
+TEST_F(NuidTest, NextIntoStorage) {
+  Nuid nuid(random_generator_);
+  char output[Nuid::TOTAL_LEN + 1];
+  output[Nuid::TOTAL_LEN] = '!';
+  nuid.next(output);
+  EXPECT_EQ('!', output[Nuid::TOTAL_LEN]);
+  EXPECT_EQ(nuid.pre(), std::string(output, Nuid::PRE_LEN));
+  for (auto i = 0; i < Nuid::TOTAL_LEN; ++i) {
+    EXPECT_TRUE(std::isalnum(output[i]));
+  }
+}
+
 TEST_F(NuidTest, ProperPrefix) {
   auto min = CHAR_MAX;
   auto max = CHAR_MIN;
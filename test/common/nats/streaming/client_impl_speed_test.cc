@@ -0,0 +1,134 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/random_generator.h"
+#include "source/common/nats/streaming/client_impl.h"
+#include "source/common/nats/streaming/message_utility.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/test_common/utility.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Nats {
+namespace Streaming {
+
+namespace {
+
+// a NATS Streaming server behind a pool, which opens the session and acks
+// each publish. The replies are held until delivered, as if they were read
+// from the connection.
+class FakeServer : public Tcp::ConnPoolNats::Instance<Message> {
+public:
+  // Tcp::ConnPoolNats::Instance
+  void setPoolCallbacks(
+      Tcp::ConnPoolNats::PoolCallbacks<Message> &callbacks) override {
+    callbacks_ = &callbacks;
+  }
+  void makeRequest(const std::string &, const Message &request) override {
+    Message message(request);
+    message.tokenize();
+    if (message.operation() == "CONNECT") {
+      auto info = std::make_unique<Message>("INFO {}");
+      info->tokenize();
+      replies_.emplace_back(std::move(info));
+    } else if (message.operation() == "PUB" && message.argumentCount() == 3) {
+      const absl::string_view reply_to = message.argument(1);
+      if (absl::StartsWith(message.argument(0), "_STAN.discover")) {
+        replies_.emplace_back(
+            msg(reply_to, MessageUtility::createConnectResponseMessage(
+                              "_STAN.pub", "", "", "")));
+      } else {
+        replies_.emplace_back(msg(reply_to, pub_ack_));
+      }
+    }
+  }
+  Upstream::ClusterInfoConstSharedPtr clusterInfo() override {
+    return nullptr;
+  }
+
+  void deliver() {
+    std::vector<MessagePtr> replies;
+    replies.swap(replies_);
+    for (MessagePtr &reply : replies) {
+      callbacks_->onResponse(std::move(reply));
+    }
+  }
+
+private:
+  static MessagePtr msg(absl::string_view subject,
+                        const std::string &payload) {
+    auto msg = std::make_unique<Message>(
+        absl::StrCat("MSG ", subject, " 1 ", payload.size()));
+    msg->tokenize();
+    msg->setPayload(std::make_shared<Buffer::OwnedImpl>(payload));
+    return msg;
+  }
+
+  Tcp::ConnPoolNats::PoolCallbacks<Message> *callbacks_{};
+  std::vector<MessagePtr> replies_;
+  const std::string pub_ack_{
+      MessageUtility::createPubAckMessage("abcdefghijklmnopqrstuv", "")};
+};
+
+class CountingPublishCallbacks : public PublishCallbacks {
+public:
+  // Nats::Streaming::PublishCallbacks
+  void onResponse() override { responses_++; }
+  void onFailure() override {}
+  void onTimeout() override {}
+  void onOverflow() override {}
+
+  uint64_t responses_{};
+};
+
+} // namespace
+
+// publishing batches of the given size and receiving their acks, once the
+// session is open.
+static void BM_PublishAckRoundTrip(benchmark::State &state) {
+  const size_t batch_size = state.range(0);
+  const std::string payload(256, 'a');
+  Api::ApiPtr api = Api::createApiForTest();
+  Event::DispatcherPtr dispatcher = api->allocateDispatcher("test");
+  Random::RandomGeneratorImpl random;
+  Stats::TestUtil::TestStore store;
+  auto *server = new FakeServer();
+  ClientImpl client(Tcp::ConnPoolNats::InstancePtr<Message>{server}, random,
+                    *dispatcher, std::chrono::milliseconds(5000),
+                    ClientImpl::generateStats("cluster1", store), "");
+  CountingPublishCallbacks callbacks;
+  std::vector<PublishRequestPtr> requests;
+  requests.reserve(batch_size);
+
+  // the first request opens the session.
+  client.connect();
+  server->deliver();
+  requests.push_back(client.makeRequest(
+      "subject1", "cluster1", "_STAN.discover",
+      std::make_unique<Buffer::OwnedImpl>(payload), callbacks));
+  server->deliver();
+  server->deliver();
+  requests.clear();
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < batch_size; i++) {
+      requests.push_back(client.makeRequest(
+          "subject1", "cluster1", "_STAN.discover",
+          std::make_unique<Buffer::OwnedImpl>(payload), callbacks));
+    }
+    server->deliver();
+    requests.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+  benchmark::DoNotOptimize(callbacks.responses_);
+}
+BENCHMARK(BM_PublishAckRoundTrip)->Arg(1)->Arg(16)->Arg(256);
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -1,14 +1,22 @@
 #include "source/common/nats/streaming/client_impl.h"
+#include "source/common/nats/streaming/message_utility.h"
+
+#include "test/common/stats/stat_test_utility.h"
 
 #include "test/mocks/common.h"
 #include "test/mocks/event/mocks.h"
 #include "test/mocks/nats/mocks.h"
 #include "test/mocks/nats/streaming/mocks.h"
 #include "test/mocks/runtime/mocks.h"
+#include "test/mocks/upstream/cluster_info.h"
 
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+using testing::_;
+using testing::Invoke;
 using testing::NiceMock;
 using testing::Return;
 
@@ -18,11 +26,17 @@ namespace Streaming {
 
 class NatsStreamingClientImplTest : public testing::Test {
 public:
+  static Buffer::InstancePtr payload(const std::string &data) {
+    return std::make_unique<Buffer::OwnedImpl>(data);
+  }
+
   Nats::ConnPoolNats::MockInstance *conn_pool_{
       new Nats::ConnPoolNats::MockInstance()};
   NiceMock<Random::MockRandomGenerator> random_;
   Event::MockDispatcher dispatcher_;
   std::chrono::milliseconds op_timeout_{5000};
+  Stats::TestUtil::TestStore store_;
+  ClientStats stats_{ClientImpl::generateStats("cluster1", store_)};
   MockPublishCallbacks callbacks_;
   PublishRequestPtr handle_;
 };
@@ -30,7 +44,241 @@ public:
 TEST_F(NatsStreamingClientImplTest, Empty) {
   // TODO(talnordan): This is a dummy test.
   ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
-                    random_, dispatcher_, op_timeout_};
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+}
+
+TEST_F(NatsStreamingClientImplTest, CountsOutstandingRequests) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  // the first request connects, and waits for the connection.
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _));
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+      callbacks_);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload2"),
+      callbacks_);
+  EXPECT_EQ(2U, client.outstandingRequests());
+
+  request1->cancel();
+  EXPECT_EQ(1U, client.outstandingRequests());
+}
+
+TEST_F(NatsStreamingClientImplTest, PublishesToThePubPrefix) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _));
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+      callbacks_);
+
+  std::vector<std::string> sent;
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _))
+      .Times(3)
+      .WillRepeatedly(Invoke([&sent](const std::string &,
+                                     const Message &request) {
+        sent.push_back(request.asString());
+      }));
+  client.onConnected("pub_prefix1");
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload2"),
+      callbacks_);
+  // the pub prefix of a new session replaces the previous one.
+  client.onConnected("pub_prefix2");
+  PublishRequestPtr request3 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload3"),
+      callbacks_);
+
+  ASSERT_EQ(3U, sent.size());
+  EXPECT_TRUE(absl::StartsWith(sent[0], "PUB pub_prefix1.subject1 "));
+  EXPECT_TRUE(absl::StartsWith(sent[1], "PUB pub_prefix1.subject1 "));
+  EXPECT_TRUE(absl::StartsWith(sent[2], "PUB pub_prefix2.subject1 "));
+}
+
+TEST_F(NatsStreamingClientImplTest, ConnectsAheadOfTheFirstRequest) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+  std::vector<std::string> sent;
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _))
+      .WillRepeatedly(Invoke([&sent](const std::string &,
+                                     const Message &request) {
+        Message message(request);
+        message.tokenize();
+        sent.push_back(std::string(message.operation()));
+      }));
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  client.connect();
+  client.connect();
+  EXPECT_EQ(std::vector<std::string>({"CONNECT"}), sent);
+
+  // the session waits for the first request to name the cluster.
+  auto info = std::make_unique<Message>("INFO {}");
+  info->tokenize();
+  client.onResponse(std::move(info));
+  EXPECT_EQ(std::vector<std::string>({"CONNECT", "SUB", "SUB", "SUB"}), sent);
+
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+      callbacks_);
+  EXPECT_EQ(std::vector<std::string>({"CONNECT", "SUB", "SUB", "SUB", "PUB"}),
+            sent);
+  EXPECT_EQ(1U, client.outstandingRequests());
+}
+
+TEST_F(NatsStreamingClientImplTest, RecordsStats) {
+  const std::string prefix = "cluster.cluster1.nats_streaming.";
+  auto gauge = [this, &prefix](const std::string &name) {
+    return store_.gauge(prefix + name, Stats::Gauge::ImportMode::Accumulate)
+        .value();
+  };
+  std::vector<std::string> reply_to;
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _))
+      .WillRepeatedly(Invoke([&reply_to](const std::string &,
+                                         const Message &request) {
+        Message message(request);
+        message.tokenize();
+        if (message.operation() == "PUB") {
+          reply_to.push_back(std::string(message.argument(1)));
+        }
+      }));
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  {
+    ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                      random_, dispatcher_, op_timeout_, stats_, ""};
+    PublishRequestPtr request1 = client.makeRequest(
+        "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+        callbacks_);
+    PublishRequestPtr request2 = client.makeRequest(
+        "subject1", "cluster_id1", "discover_prefix1", payload("payload2"),
+        callbacks_);
+    EXPECT_EQ(2U, gauge("publish_pending"));
+    request2->cancel();
+    EXPECT_EQ(1U, store_.counter(prefix + "publish_cancel").value());
+    EXPECT_EQ(1U, gauge("publish_pending"));
+
+    client.onConnected("pub_prefix1");
+    EXPECT_EQ(0U, gauge("publish_pending"));
+    EXPECT_EQ(1U, gauge("publish_in_flight"));
+    EXPECT_LT(0U, store_.counter(prefix + "tx_bytes").value());
+
+    // the ack of the publish records its latency.
+    ASSERT_EQ(1U, reply_to.size());
+    const std::string pub_ack =
+        MessageUtility::createPubAckMessage("guid1", "");
+    auto ack = std::make_unique<Message>(
+        absl::StrCat("MSG ", reply_to[0], " 1 ", pub_ack.size()));
+    ack->tokenize();
+    ack->setPayload(std::make_shared<Buffer::OwnedImpl>(pub_ack));
+    EXPECT_CALL(callbacks_, onResponse());
+    client.onResponse(std::move(ack));
+    EXPECT_EQ(0U, gauge("publish_in_flight"));
+    EXPECT_EQ(
+        1U, store_.histogramValues(prefix + "publish_ack_time", false).size());
+    EXPECT_LT(0U, store_.counter(prefix + "rx_bytes").value());
+
+    PublishRequestPtr request3 = client.makeRequest(
+        "subject1", "cluster_id1", "discover_prefix1", payload("payload3"),
+        callbacks_);
+    EXPECT_EQ(1U, gauge("publish_in_flight"));
+  }
+  // the gauges drop the requests of a client that is gone.
+  EXPECT_EQ(0U, gauge("publish_in_flight"));
+}
+
+TEST_F(NatsStreamingClientImplTest, OverflowsAboveTheHighWatermark) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+
+  client.onAboveWriteBufferHighWatermark();
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _)).Times(0);
+  EXPECT_CALL(callbacks_, onOverflow());
+  EXPECT_EQ(nullptr, client.makeRequest("subject1", "cluster_id1",
+                                        "discover_prefix1", payload("payload1"),
+                                        callbacks_));
+  EXPECT_EQ(0U, client.outstandingRequests());
+
+  client.onBelowWriteBufferLowWatermark();
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _));
+  EXPECT_NE(nullptr, client.makeRequest("subject1", "cluster_id1",
+                                        "discover_prefix1", payload("payload1"),
+                                        callbacks_));
+}
+
+TEST_F(NatsStreamingClientImplTest, OverflowsThePendingRequestsThreshold) {
+  auto cluster = std::make_shared<NiceMock<Upstream::MockClusterInfo>>();
+  cluster->resetResourceManager(1024, 1, 1024, 3, 1024);
+  Upstream::ResourceManager &resources =
+      cluster->resourceManager(Upstream::ResourcePriority::Default);
+  EXPECT_CALL(*conn_pool_, clusterInfo()).WillRepeatedly(Return(cluster));
+  {
+    ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                      random_, dispatcher_, op_timeout_, stats_, ""};
+
+    // the first request waits for the connection, which leaves no room for
+    // another one.
+    EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+    EXPECT_CALL(*conn_pool_, makeRequest(_, _));
+    PublishRequestPtr request1 = client.makeRequest(
+        "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+        callbacks_);
+    EXPECT_EQ(1U, resources.pendingRequests().count());
+    EXPECT_EQ(1U, resources.requests().count());
+
+    EXPECT_CALL(callbacks_, onOverflow());
+    EXPECT_EQ(nullptr, client.makeRequest("subject1", "cluster_id1",
+                                          "discover_prefix1",
+                                          payload("payload2"), callbacks_));
+    EXPECT_EQ(1U, cluster->stats().upstream_rq_pending_overflow_.value());
+    EXPECT_EQ(1U, client.outstandingRequests());
+
+    // once connected, the request is in flight and no longer pending.
+    new NiceMock<Event::MockTimer>(&dispatcher_);
+    EXPECT_CALL(*conn_pool_, makeRequest(_, _));
+    client.onConnected("pub_prefix1");
+    EXPECT_EQ(0U, resources.pendingRequests().count());
+    EXPECT_EQ(1U, resources.requests().count());
+  }
+  // the counts of a client that is gone are released.
+  EXPECT_EQ(0U, resources.requests().count());
+}
+
+TEST_F(NatsStreamingClientImplTest, FailsInFlightRequestsOnClose) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_, stats_, ""};
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _)).Times(2);
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  PublishRequestPtr request1 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload1"),
+      callbacks_);
+  client.onConnected("pub_prefix1");
+  EXPECT_EQ(1U, client.outstandingRequests());
+
+  auto *reconnect_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  EXPECT_CALL(callbacks_, onFailure());
+  client.onClose();
+  EXPECT_EQ(0U, client.outstandingRequests());
+  EXPECT_TRUE(reconnect_timer->enabled_);
+
+  // the requests made meanwhile wait for the connection.
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _)).Times(0);
+  PublishRequestPtr request2 = client.makeRequest(
+      "subject1", "cluster_id1", "discover_prefix1", payload("payload2"),
+      callbacks_);
+  EXPECT_EQ(1U, client.outstandingRequests());
+
+  // CONNECT, then the pending request once connected.
+  EXPECT_CALL(*conn_pool_, makeRequest(_, _)).Times(2);
+  reconnect_timer->invokeCallback();
+  client.onConnected("pub_prefix1");
+  EXPECT_EQ(1U, client.outstandingRequests());
 }
 
 } // namespace Streaming
@@ -6,6 +6,9 @@
 
 #include "gmock/gmock.h"
 
+using testing::_;
+using testing::Invoke;
+
 namespace Envoy {
 namespace Nats {
 namespace Streaming {
@@ -51,6 +54,25 @@ TEST_F(NatsStreamingHeartbeatHandlerTest, Reply) {
   HeartbeatHandler::onMessage(reply_to, payload, callbacks_);
 }
 
+TEST_F(NatsStreamingHeartbeatHandlerTest, ReusesTheReply) {
+  absl::optional<std::string> reply_to{"reply-to"};
+  const std::string payload{};
+  Message reply;
+  std::vector<const Message *> sent;
+  EXPECT_CALL(callbacks_, send(_))
+      .Times(3)
+      .WillRepeatedly(Invoke(
+          [&sent](const Message &message) { sent.push_back(&message); }));
+  HeartbeatHandler::onMessage(reply_to, payload, reply, callbacks_);
+  HeartbeatHandler::onMessage(reply_to, payload, reply, callbacks_);
+  EXPECT_EQ(MessageBuilder::createPubMessage("reply-to"), reply);
+
+  absl::optional<std::string> other_reply_to{"other-reply-to"};
+  HeartbeatHandler::onMessage(other_reply_to, payload, reply, callbacks_);
+  EXPECT_EQ(MessageBuilder::createPubMessage("other-reply-to"), reply);
+  EXPECT_EQ(std::vector<const Message *>({&reply, &reply, &reply}), sent);
+}
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace Envoy
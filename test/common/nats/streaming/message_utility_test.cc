@@ -1,3 +1,4 @@
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/assert.h"
 #include "source/common/nats/streaming/message_utility.h"
 
@@ -43,11 +44,13 @@ TEST_F(NatsStreamingMessageUtilityTest, PubMsgMessage) {
   const std::string uuid{"13581321-dead-beef-b77c-24f6818b6043"};
   const std::string subject{"subject1"};
   const std::string data{"\"d\ra\0t\t \na\v"};
-  const auto message =
-      MessageUtility::createPubMsgMessage(client_id, uuid, subject, data);
+  Buffer::OwnedImpl data_buffer(data);
+  const auto message = MessageUtility::createPubMsgMessage(
+      client_id, uuid, subject, data_buffer);
+  EXPECT_EQ(0U, data_buffer.length());
 
   pb::PubMsg pub_msg;
-  pub_msg.ParseFromString(message);
+  pub_msg.ParseFromString(message->toString());
 
   EXPECT_EQ(client_id, pub_msg.clientid());
   EXPECT_EQ(uuid, pub_msg.guid());
@@ -55,6 +58,25 @@ TEST_F(NatsStreamingMessageUtilityTest, PubMsgMessage) {
   EXPECT_EQ(data, pub_msg.data());
 }
 
+TEST_F(NatsStreamingMessageUtilityTest, AppendBytesField) {
+  pb::PubMsg expected;
+  expected.set_guid("guid1");
+  expected.set_data(std::string(300, 'd'));
+
+  pb::PubMsg pub_msg;
+  pub_msg.set_guid("guid1");
+  Buffer::OwnedImpl message(pub_msg.SerializeAsString());
+  Buffer::OwnedImpl data(std::string(300, 'd'));
+  MessageUtility::appendBytesField(pb::PubMsg::kDataFieldNumber, data, message);
+  EXPECT_EQ(expected.SerializeAsString(), message.toString());
+
+  // an empty field is left out.
+  Buffer::OwnedImpl empty;
+  MessageUtility::appendBytesField(pb::PubMsg::kDataFieldNumber, empty,
+                                   message);
+  EXPECT_EQ(expected.SerializeAsString(), message.toString());
+}
+
 TEST_F(NatsStreamingMessageUtilityTest, PubAckMessage) {
   const std::string uuid{"13581321-dead-beef-b77c-24f6818b6043"};
   const std::string error{"E\"R\rR\0O\t \nR\v"};
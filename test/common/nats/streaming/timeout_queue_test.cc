@@ -0,0 +1,85 @@
+#include "source/common/nats/streaming/timeout_queue.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/test_common/simulated_time_system.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Nats {
+namespace Streaming {
+
+using std::chrono::milliseconds;
+
+class NatsStreamingTimeoutQueueTest : public testing::Test {
+public:
+  void onTimeout(uint64_t id) {
+    timed_out_.push_back(id);
+    if (on_timeout_) {
+      on_timeout_(id);
+    }
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  Event::MockTimer *timer_{new Event::MockTimer(&dispatcher_)};
+  std::vector<uint64_t> timed_out_;
+  std::function<void(uint64_t)> on_timeout_;
+  TimeoutQueue queue_{dispatcher_, time_system_, milliseconds(1000),
+                      [this](uint64_t id) { onTimeout(id); }};
+};
+
+TEST_F(NatsStreamingTimeoutQueueTest, ArmsASingleTimer) {
+  EXPECT_CALL(*timer_, enableTimer(milliseconds(1000), _));
+  queue_.add(1);
+  time_system_.advanceTimeWait(milliseconds(400));
+  queue_.add(2);
+  queue_.add(3);
+  EXPECT_EQ(3U, queue_.size());
+
+  // the timer is armed again for the earliest deadline left.
+  time_system_.advanceTimeWait(milliseconds(600));
+  EXPECT_CALL(*timer_, enableTimer(milliseconds(400), _));
+  timer_->invokeCallback();
+  EXPECT_EQ(std::vector<uint64_t>({1}), timed_out_);
+
+  time_system_.advanceTimeWait(milliseconds(400));
+  timer_->invokeCallback();
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), timed_out_);
+  EXPECT_EQ(0U, queue_.size());
+}
+
+TEST_F(NatsStreamingTimeoutQueueTest, RoundsTheDelayUp) {
+  EXPECT_CALL(*timer_, enableTimer(milliseconds(1000), _));
+  queue_.add(1);
+  time_system_.advanceTimeWait(std::chrono::microseconds(500));
+  queue_.add(2);
+
+  time_system_.advanceTimeWait(milliseconds(999) +
+                               std::chrono::microseconds(500));
+  EXPECT_CALL(*timer_, enableTimer(milliseconds(1), _));
+  timer_->invokeCallback();
+  EXPECT_EQ(std::vector<uint64_t>({1}), timed_out_);
+}
+
+TEST_F(NatsStreamingTimeoutQueueTest, AddsFromTheCallback) {
+  on_timeout_ = [this](uint64_t id) {
+    if (id == 1) {
+      queue_.add(2);
+    }
+  };
+  EXPECT_CALL(*timer_, enableTimer(milliseconds(1000), _)).Times(2);
+  queue_.add(1);
+  time_system_.advanceTimeWait(milliseconds(1000));
+  timer_->invokeCallback();
+  EXPECT_EQ(std::vector<uint64_t>({1}), timed_out_);
+  EXPECT_EQ(1U, queue_.size());
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace Envoy
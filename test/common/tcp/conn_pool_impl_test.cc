@@ -100,6 +100,8 @@ public:
   const std::string cluster_name_{"foo"};
   std::shared_ptr<Upstream::MockHost> host_{new NiceMock<Upstream::MockHost>()};
   Event::MockDispatcher dispatcher_;
+  Event::MockSchedulableCallback *flush_callback_{
+      new NiceMock<Event::MockSchedulableCallback>(&dispatcher_)};
   MockEncoder *encoder_{new MockEncoder()};
   MockDecoder *decoder_{new MockDecoder()};
   DecoderCallbacks<T> *callbacks_{};
@@ -309,10 +311,82 @@ TEST_F(TcpClientImplTest, ConnectFail) {
   EXPECT_EQ(1UL, host_->stats_.cx_connect_fail_.value());
 }
 
+TEST_F(TcpClientImplTest, WritesTheRequestsOfAnIterationTogether) {
+  setup();
+  onConnected();
+
+  EXPECT_CALL(*upstream_connection_, write(_, _)).Times(0);
+  client_->makeRequest("request1");
+  client_->makeRequest("request2");
+  EXPECT_TRUE(flush_callback_->enabled_);
+
+  EXPECT_CALL(*upstream_connection_, write(_, false))
+      .WillOnce(Invoke([](Buffer::Instance &data, bool) -> void {
+        EXPECT_EQ("+request1\r\n+request2\r\n", data.toString());
+        data.drain(data.length());
+      }));
+  flush_callback_->invokeCallback();
+
+  EXPECT_CALL(*upstream_connection_,
+              close(Network::ConnectionCloseType::NoFlush));
+  EXPECT_CALL(pool_callbacks_, onClose());
+  client_->close();
+}
+
+TEST_F(TcpClientImplTest, DropsTheRequestsOfAClosedConnection) {
+  setup();
+  onConnected();
+
+  client_->makeRequest("request1");
+
+  EXPECT_CALL(pool_callbacks_, onClose());
+  upstream_connection_->raiseEvent(Network::ConnectionEvent::RemoteClose);
+
+  EXPECT_CALL(*upstream_connection_, write(_, _)).Times(0);
+  flush_callback_->invokeCallback();
+}
+
 class ConfigOutlierDisabled : public Config {
   bool disableOutlierEvents() const override { return true; }
+  uint32_t maxBufferSizeBeforeFlush() const override { return 64 * 1024; }
 };
 
+class ConfigNoBuffer : public Config {
+  bool disableOutlierEvents() const override { return false; }
+  uint32_t maxBufferSizeBeforeFlush() const override { return 0; }
+};
+
+TEST_F(TcpClientImplTest, Watermarks) {
+  setup();
+  onConnected();
+
+  EXPECT_CALL(pool_callbacks_, onAboveWriteBufferHighWatermark());
+  upstream_connection_->runHighWatermarkCallbacks();
+  EXPECT_CALL(pool_callbacks_, onBelowWriteBufferLowWatermark());
+  upstream_connection_->runLowWatermarkCallbacks();
+
+  EXPECT_CALL(pool_callbacks_, onClose());
+  client_->close();
+}
+
+TEST_F(TcpClientImplTest, WritesRightAwayPastTheBufferSize) {
+  setup(std::make_unique<ConfigNoBuffer>());
+  onConnected();
+
+  EXPECT_CALL(*upstream_connection_, write(_, false))
+      .WillOnce(Invoke([](Buffer::Instance &data, bool) -> void {
+        EXPECT_EQ("+request1\r\n", data.toString());
+        data.drain(data.length());
+      }));
+  client_->makeRequest("request1");
+  EXPECT_FALSE(flush_callback_->enabled_);
+
+  EXPECT_CALL(*upstream_connection_,
+              close(Network::ConnectionCloseType::NoFlush));
+  EXPECT_CALL(pool_callbacks_, onClose());
+  client_->close();
+}
+
 TEST_F(TcpClientImplTest, OutlierDisabled) {
   InSequence s;
 
@@ -339,6 +413,7 @@ TEST(TcpClientFactoryImplTest, Basic) {
   std::shared_ptr<Upstream::MockHost> host(new NiceMock<Upstream::MockHost>());
   EXPECT_CALL(*host, createConnection_(_, _)).WillOnce(Return(conn_info));
   NiceMock<Event::MockDispatcher> dispatcher;
+  new NiceMock<Event::MockSchedulableCallback>(&dispatcher);
   MockPoolCallbacks callbacks;
   ConfigImpl config;
   ClientPtr<T> client = factory.create(host, dispatcher, callbacks, config);
@@ -383,7 +458,7 @@ TEST_F(TcpConnPoolImplTest, Basic) {
       .WillOnce(Invoke([&](Upstream::LoadBalancerContext *context)
                            -> Upstream::HostConstSharedPtr {
         EXPECT_EQ(context->computeHashKey().value(),
-                  std::hash<std::string>()("foo"));
+                  HashUtil::xxHash64("foo"));
         return cm_.thread_local_cluster_.lb_.host_;
       }));
   EXPECT_CALL(*this, create_(_)).WillOnce(Return(client));
@@ -0,0 +1,216 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "source/common/tcp/pipelined_client_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/tcp/mocks_nats.h"
+#include "test/mocks/upstream/mocks.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Tcp {
+namespace PipelinedClient {
+
+namespace {
+
+class MockRequestCallbacks : public RequestCallbacks<T> {
+public:
+  void onResponse(TPtr &&value) override { onResponse_(*value); }
+
+  MOCK_METHOD1(onResponse_, void(const T &value));
+  MOCK_METHOD0(onFailure, void());
+};
+
+} // namespace
+
+class TcpPipelinedClientImplTest : public testing::Test,
+                                   public ConnPoolNats::ClientFactory<T> {
+public:
+  TcpPipelinedClientImplTest() {
+    cm_.initializeClusters({"foo"}, {});
+    cm_.initializeThreadLocalClusters({"foo"});
+  }
+
+  void setup(uint32_t connections_per_host, uint32_t max_outstanding) {
+    config_ = std::make_unique<ConfigImpl>(connections_per_host,
+                                           max_outstanding);
+    client_ = std::make_unique<InstanceImpl<T>>("foo", cm_, *this, dispatcher_,
+                                                *config_);
+  }
+
+  // Tcp::ConnPoolNats::ClientFactory
+  ConnPoolNats::ClientPtr<T> create(Upstream::HostConstSharedPtr,
+                                    Event::Dispatcher &,
+                                    ConnPoolNats::PoolCallbacks<T> &callbacks,
+                                    const ConnPoolNats::Config &) override {
+    auto *client = new NiceMock<ConnPoolNats::MockClient>();
+    clients_.push_back(client);
+    pool_callbacks_.push_back(&callbacks);
+    return ConnPoolNats::ClientPtr<T>{client};
+  }
+
+  void respond(size_t client, const T &value) {
+    pool_callbacks_[client]->onResponse(std::make_unique<T>(value));
+  }
+
+  Upstream::MockHost &host() { return *cm_.thread_local_cluster_.lb_.host_; }
+
+  NiceMock<Upstream::MockClusterManager> cm_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  std::unique_ptr<ConfigImpl> config_;
+  std::vector<ConnPoolNats::MockClient *> clients_;
+  std::vector<ConnPoolNats::PoolCallbacks<T> *> pool_callbacks_;
+  InstancePtr<T> client_;
+};
+
+TEST_F(TcpPipelinedClientImplTest, CorrelatesTheResponsesInOrder) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks1;
+  MockRequestCallbacks callbacks2;
+  EXPECT_NE(nullptr, client_->makeRequest("foo", "request1", callbacks1));
+  EXPECT_NE(nullptr, client_->makeRequest("foo", "request2", callbacks2));
+  ASSERT_EQ(1U, clients_.size());
+
+  testing::InSequence s;
+  EXPECT_CALL(callbacks1, onResponse_("response1"));
+  EXPECT_CALL(callbacks2, onResponse_("response2"));
+  respond(0, "response1");
+  respond(0, "response2");
+}
+
+TEST_F(TcpPipelinedClientImplTest, OpensConnectionsWhileTheOthersAreBusy) {
+  setup(2, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  client_->makeRequest("foo", "request2", callbacks);
+  client_->makeRequest("foo", "request3", callbacks);
+  ASSERT_EQ(2U, clients_.size());
+
+  // the third request went to the first connection, which now has one more.
+  EXPECT_CALL(callbacks, onResponse_("response2"));
+  respond(1, "response2");
+  EXPECT_CALL(*clients_[1], makeRequest(T("request4")));
+  client_->makeRequest("foo", "request4", callbacks);
+  EXPECT_EQ(2U, clients_.size());
+}
+
+TEST_F(TcpPipelinedClientImplTest, ReusesAnIdleConnection) {
+  setup(4, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  EXPECT_CALL(callbacks, onResponse_("response1"));
+  respond(0, "response1");
+  client_->makeRequest("foo", "request2", callbacks);
+  EXPECT_EQ(1U, clients_.size());
+}
+
+TEST_F(TcpPipelinedClientImplTest, Overflow) {
+  setup(1, 1);
+  MockRequestCallbacks callbacks;
+  EXPECT_NE(nullptr, client_->makeRequest("foo", "request1", callbacks));
+  EXPECT_EQ(nullptr, client_->makeRequest("foo", "request2", callbacks));
+  EXPECT_EQ(1UL, host().cluster_.stats_.upstream_rq_pending_overflow_.value());
+}
+
+TEST_F(TcpPipelinedClientImplTest, SkipsConnectionsAboveTheHighWatermark) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  pool_callbacks_[0]->onAboveWriteBufferHighWatermark();
+  EXPECT_EQ(nullptr, client_->makeRequest("foo", "request2", callbacks));
+  pool_callbacks_[0]->onBelowWriteBufferLowWatermark();
+  EXPECT_NE(nullptr, client_->makeRequest("foo", "request2", callbacks));
+}
+
+TEST_F(TcpPipelinedClientImplTest, Cancel) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks1;
+  MockRequestCallbacks callbacks2;
+  PendingRequest *request1 =
+      client_->makeRequest("foo", "request1", callbacks1);
+  client_->makeRequest("foo", "request2", callbacks2);
+  request1->cancel();
+
+  EXPECT_CALL(callbacks1, onResponse_(_)).Times(0);
+  EXPECT_CALL(callbacks2, onResponse_("response2"));
+  respond(0, "response1");
+  respond(0, "response2");
+  EXPECT_EQ(1UL, host().cluster_.stats_.upstream_rq_cancelled_.value());
+}
+
+TEST_F(TcpPipelinedClientImplTest, CloseFailsTheOutstandingRequests) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  client_->makeRequest("foo", "request2", callbacks);
+
+  EXPECT_CALL(callbacks, onFailure()).Times(2);
+  EXPECT_CALL(dispatcher_, deferredDelete_(_));
+  clients_[0]->raiseEvent(Network::ConnectionEvent::RemoteClose);
+  EXPECT_EQ(
+      1UL, host().cluster_.stats_.upstream_cx_destroy_with_active_rq_.value());
+
+  // the next request opens another connection.
+  client_->makeRequest("foo", "request3", callbacks);
+  EXPECT_EQ(2U, clients_.size());
+}
+
+TEST_F(TcpPipelinedClientImplTest, UnexpectedResponseClosesTheConnection) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  EXPECT_CALL(callbacks, onResponse_("response1"));
+  respond(0, "response1");
+
+  EXPECT_CALL(*clients_[0], close());
+  respond(0, "response2");
+  EXPECT_EQ(1UL, host().cluster_.stats_.upstream_cx_protocol_error_.value());
+}
+
+TEST_F(TcpPipelinedClientImplTest, NoHost) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks;
+  EXPECT_CALL(cm_.thread_local_cluster_.lb_, chooseHost(_))
+      .WillOnce(Return(nullptr));
+  EXPECT_EQ(nullptr, client_->makeRequest("foo", "request1", callbacks));
+  EXPECT_EQ(1UL, cm_.thread_local_cluster_.cluster_.info_->stats_
+                     .upstream_cx_none_healthy_.value());
+}
+
+TEST_F(TcpPipelinedClientImplTest, HostRemovedClosesItsConnections) {
+  setup(1, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+
+  EXPECT_CALL(callbacks, onFailure());
+  EXPECT_CALL(*clients_[0], close());
+  cm_.thread_local_cluster_.cluster_.priority_set_.runUpdateCallbacks(
+      0, {}, {cm_.thread_local_cluster_.lb_.host_});
+
+  client_->makeRequest("foo", "request2", callbacks);
+  EXPECT_EQ(2U, clients_.size());
+}
+
+TEST_F(TcpPipelinedClientImplTest, DestructionFailsTheOutstandingRequests) {
+  setup(2, 16);
+  MockRequestCallbacks callbacks;
+  client_->makeRequest("foo", "request1", callbacks);
+  client_->makeRequest("foo", "request2", callbacks);
+
+  EXPECT_CALL(callbacks, onFailure()).Times(2);
+  EXPECT_CALL(*clients_[0], close());
+  EXPECT_CALL(*clients_[1], close());
+  client_.reset();
+}
+
+} // namespace PipelinedClient
+} // namespace Tcp
+} // namespace Envoy
@@ -0,0 +1,121 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/aws_lambda/api_gateway_transformer.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class ApiGatewayTransformerTest : public testing::Test {
+protected:
+  json transform(const ApiGatewayTransformerProto &config,
+                 Buffer::Instance &body) {
+    ApiGatewayTransformer transformer(config);
+    transformer.transform(headers_, &headers_, body, callbacks_);
+    return json::parse(body.toString());
+  }
+
+  Http::TestRequestHeaderMapImpl headers_{
+      {":method", "POST"},
+      {":path", "/path/to?a=1&b=x%20y&a=2&c"},
+      {"x-multi", "one"},
+      {"x-multi", "two"},
+      {"user-agent", "curl"},
+      {"cookie", "k1=v1; k2=v2"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
+};
+
+TEST_F(ApiGatewayTransformerTest, WritesV1Event) {
+  ApiGatewayTransformerProto config;
+  Buffer::OwnedImpl body("{\"key\":\"value\"}");
+  json event = transform(config, body);
+
+  EXPECT_EQ("/path/to", event["path"]);
+  EXPECT_EQ("POST", event["httpMethod"]);
+  EXPECT_EQ("two", event["headers"]["x-multi"]);
+  EXPECT_EQ(json::array({"one", "two"}), event["multiValueHeaders"]["x-multi"]);
+  EXPECT_EQ("k1=v1; k2=v2", event["headers"]["cookie"]);
+  EXPECT_FALSE(event["headers"].contains(":path"));
+  EXPECT_EQ("2", event["queryStringParameters"]["a"]);
+  EXPECT_EQ("x y", event["queryStringParameters"]["b"]);
+  EXPECT_EQ("", event["queryStringParameters"]["c"]);
+  EXPECT_EQ(json::array({"1", "2"}),
+            event["multiValueQueryStringParameters"]["a"]);
+  EXPECT_TRUE(event["pathParameters"].is_null());
+  EXPECT_EQ("/path/to", event["requestContext"]["path"]);
+  EXPECT_EQ("{\"key\":\"value\"}", event["body"]);
+  EXPECT_EQ(false, event["isBase64Encoded"]);
+
+  EXPECT_EQ("application/json", headers_.getContentTypeValue());
+  EXPECT_EQ(std::to_string(body.length()), headers_.getContentLengthValue());
+}
+
+TEST_F(ApiGatewayTransformerTest, WritesV2Event) {
+  ApiGatewayTransformerProto config;
+  config.set_payload_version(ApiGatewayTransformerProto::V2);
+  Buffer::OwnedImpl body;
+  json event = transform(config, body);
+
+  EXPECT_EQ("2.0", event["version"]);
+  EXPECT_EQ("/path/to", event["rawPath"]);
+  EXPECT_EQ("a=1&b=x%20y&a=2&c", event["rawQueryString"]);
+  EXPECT_EQ("one,two", event["headers"]["x-multi"]);
+  EXPECT_FALSE(event["headers"].contains("cookie"));
+  EXPECT_EQ(json::array({"k1=v1", "k2=v2"}), event["cookies"]);
+  EXPECT_EQ("1,2", event["queryStringParameters"]["a"]);
+  EXPECT_EQ("POST", event["requestContext"]["http"]["method"]);
+  EXPECT_EQ("curl", event["requestContext"]["http"]["userAgent"]);
+  EXPECT_TRUE(event["body"].is_null());
+}
+
+TEST_F(ApiGatewayTransformerTest, OmitsAnEmptyQuery) {
+  headers_.setPath("/path");
+  ApiGatewayTransformerProto config;
+  Buffer::OwnedImpl body;
+  json event = transform(config, body);
+
+  EXPECT_TRUE(event["queryStringParameters"].is_null());
+  EXPECT_TRUE(event["multiValueQueryStringParameters"].is_null());
+}
+
+TEST_F(ApiGatewayTransformerTest, Base64EncodesTheBody) {
+  ApiGatewayTransformerProto config;
+  config.set_base64_encode_body(true);
+  Buffer::OwnedImpl body("hello");
+  json event = transform(config, body);
+
+  EXPECT_EQ("aGVsbG8=", event["body"]);
+  EXPECT_EQ(true, event["isBase64Encoded"]);
+}
+
+TEST_F(ApiGatewayTransformerTest, Base64EncodesBinaryBodies) {
+  ApiGatewayTransformerProto config;
+  Buffer::OwnedImpl body("\xff\xfe");
+  json event = transform(config, body);
+
+  EXPECT_EQ("//4=", event["body"]);
+  EXPECT_EQ(true, event["isBase64Encoded"]);
+}
+
+TEST_F(ApiGatewayTransformerTest, NeedsTheRequestHeaders) {
+  ApiGatewayTransformer transformer((ApiGatewayTransformerProto()));
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  Buffer::OwnedImpl body;
+  EXPECT_THROW_WITH_MESSAGE(
+      transformer.transform(response_headers, nullptr, body, callbacks_),
+      EnvoyException, "the api gateway transformer only transforms requests");
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,115 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
+
+#include "test/test_common/simulated_time_system.h"
+#include "test/test_common/utility.h"
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+// a body of the requested size, in slices of the size the codecs usually
+// read.
+void fillBody(Buffer::Instance &body, size_t size) {
+  const std::string slice(16 * 1024, 'a');
+  while (body.length() < size) {
+    Buffer::OwnedImpl chunk(
+        absl::string_view(slice).substr(0, size - body.length()));
+    body.move(chunk);
+  }
+}
+
+} // namespace
+
+// hashing the payload of a lambda request, as the body arrives. The SHA256
+// implementation of BoringSSL picks the SHA extensions of the CPU (SHA-NI on
+// x86, the ARMv8 crypto extensions on arm) at runtime, when they're
+// available.
+static void BM_PayloadHash(benchmark::State &state) {
+  Event::SimulatedTimeSystem time_system;
+  Buffer::OwnedImpl body;
+  fillBody(body, state.range(0));
+  for (auto _ : state) {
+    AwsAuthenticator aws(time_system);
+    aws.updatePayloadHash(body);
+    benchmark::DoNotOptimize(aws.getBodyHexSha());
+  }
+  state.SetBytesProcessed(state.iterations() * body.length());
+}
+BENCHMARK(BM_PayloadHash)->RangeMultiplier(8)->Range(1 << 10, 6 << 20);
+
+// signing a request with a small body, with and without the per worker caches.
+static void BM_Sign(benchmark::State &state) {
+  Event::SimulatedTimeSystem time_system;
+  const bool cached = state.range(0) != 0;
+  const std::string access_key = "AKIDEXAMPLE";
+  const std::string secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+  const HeaderList headers_to_sign = AwsAuthenticator::createHeaderToSign(
+      {Http::Headers::get().HostLegacy, Http::Headers::get().ContentType});
+  SigningKeyCache signing_keys;
+  SigningTimeCache signing_times;
+  Buffer::OwnedImpl body("{\"key\":\"value\"}");
+  for (auto _ : state) {
+    Http::TestRequestHeaderMapImpl headers{
+        {":method", "POST"},
+        {":authority", "lambda.us-east-1.amazonaws.com"},
+        {":path", "/2015-03-31/functions/func/invocations"},
+        {"content-type", "application/json"}};
+    AwsAuthenticator aws(time_system);
+    aws.init(&access_key, &secret_key, nullptr,
+             cached ? &signing_keys : nullptr,
+             cached ? &signing_times : nullptr);
+    aws.updatePayloadHash(body);
+    aws.sign(&headers, headers_to_sign, "us-east-1");
+  }
+}
+BENCHMARK(BM_Sign)->Arg(0)->Arg(1);
+
+// signing a request with the given number of signed headers besides the host
+// and the given body size, with the per worker caches.
+static void BM_SignHeadersAndBody(benchmark::State &state) {
+  Event::SimulatedTimeSystem time_system;
+  const std::string access_key = "AKIDEXAMPLE";
+  const std::string secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+  std::vector<Http::LowerCaseString> header_names{
+      Http::Headers::get().HostLegacy};
+  for (int64_t i = 0; i < state.range(0); i++) {
+    header_names.emplace_back(absl::StrCat("x-custom-header-", i));
+  }
+  const HeaderList headers_to_sign(header_names);
+  Buffer::OwnedImpl body;
+  fillBody(body, state.range(1));
+  SigningKeyCache signing_keys;
+  SigningTimeCache signing_times;
+  for (auto _ : state) {
+    Http::TestRequestHeaderMapImpl headers{
+        {":method", "POST"},
+        {":authority", "lambda.us-east-1.amazonaws.com"},
+        {":path", "/2015-03-31/functions/func/invocations"}};
+    for (size_t i = 1; i < header_names.size(); i++) {
+      headers.addCopy(header_names[i], "value");
+    }
+    AwsAuthenticator aws(time_system);
+    aws.init(&access_key, &secret_key, nullptr, &signing_keys,
+             &signing_times);
+    aws.updatePayloadHash(body);
+    aws.sign(&headers, headers_to_sign, "us-east-1");
+  }
+  state.SetBytesProcessed(state.iterations() * body.length());
+}
+BENCHMARK(BM_SignHeadersAndBody)
+    ->ArgsProduct({{0, 4, 16, 64}, {0, 1 << 10, 64 << 10, 1 << 20}});
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
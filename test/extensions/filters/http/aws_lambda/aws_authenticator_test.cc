@@ -156,6 +156,141 @@ TEST_F(AwsAuthenticatorTest, TestGuide) {
   EXPECT_EQ(session_header, sessiontoken);
 }
 
+TEST_F(AwsAuthenticatorTest, ReusesCachedSigningKeysAndDates) {
+  DangerousDeprecatedTestTime time;
+  std::string secretkey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+  std::string accesskey = "AKIDEXAMPLE";
+  SigningKeyCache signing_keys;
+  SigningTimeCache signing_times;
+
+  struct tm timeinfo = {};
+  timeinfo.tm_year = 2015 - 1900;
+  timeinfo.tm_mon = 7; // 0 based august.
+  timeinfo.tm_mday = 30;
+  timeinfo.tm_hour = 12;
+  timeinfo.tm_min = 36;
+  std::chrono::time_point<std::chrono::system_clock> awstime =
+      std::chrono::system_clock::from_time_t(std::mktime(&timeinfo));
+
+  auto sign = [&](const std::string &region) {
+    AwsAuthenticator aws(time.timeSystem());
+    aws.init(&accesskey, &secretkey, nullptr, &signing_keys,
+             &signing_times);
+    set_guide_test_params(aws);
+    Http::TestRequestHeaderMapImpl headers;
+    headers.setPath("/?Param1=value1&Param2=value2");
+    headers.setMethod(std::string("GET"));
+    headers.setHost(std::string("example.amazonaws.com"));
+    HeaderList headers_to_sign =
+        AwsAuthenticator::createHeaderToSign({Http::LowerCaseString("host")});
+    return signWithTime(aws, &headers, headers_to_sign, region, awstime);
+  };
+
+  std::string expected = "AWS4-HMAC-SHA256 "
+                         "Credential=AKIDEXAMPLE/20150830/us-east-1/service/"
+                         "aws4_request, SignedHeaders=host;x-amz-date, "
+                         "Signature="
+                         "b97d918cfa904a5beff61c982a1b6f458b799221646efd99d3219"
+                         "ec94cdf2500";
+  EXPECT_EQ(expected, sign("us-east-1"));
+  EXPECT_EQ(1, signing_keys.size());
+  // the second signature uses the cached key.
+  EXPECT_EQ(expected, sign("us-east-1"));
+  EXPECT_EQ(1, signing_keys.size());
+
+  const std::string other_region = sign("us-west-2");
+  EXPECT_NE(expected, other_region);
+  EXPECT_EQ(2, signing_keys.size());
+  EXPECT_EQ(other_region, sign("us-west-2"));
+}
+
+TEST(SigningKeyCache, CopiesTheKeyedContexts) {
+  SigningKeyCache cache;
+  SigningKeyCache::Key key;
+  key.fill(7);
+  const SigningKeyCache::KeyedHmac &keyed = cache.insert("scope", key);
+  EXPECT_EQ(&keyed, cache.find("scope"));
+  EXPECT_EQ(nullptr, cache.find("other"));
+
+  // each copy into the scratch context hashes as a context keyed anew.
+  for (const std::string data : {"string to sign", "another one"}) {
+    SigningKeyCache::Key expected;
+    unsigned int expected_len = expected.size();
+    HMAC(EVP_sha256(), key.data(), key.size(),
+         reinterpret_cast<const uint8_t *>(data.data()), data.size(),
+         expected.data(), &expected_len);
+
+    SigningKeyCache::Key out;
+    unsigned int out_len = out.size();
+    ASSERT_EQ(1, HMAC_CTX_copy_ex(&cache.scratch(), &keyed.context()));
+    HMAC_Update(&cache.scratch(),
+                reinterpret_cast<const uint8_t *>(data.data()), data.size());
+    HMAC_Final(&cache.scratch(), out.data(), &out_len);
+    EXPECT_EQ(expected, out);
+  }
+}
+
+TEST(SigningTimeCache, RefreshesOncePerSecond) {
+  SigningTimeCache cache;
+  struct tm timeinfo = {};
+  timeinfo.tm_year = 2015 - 1900;
+  timeinfo.tm_mon = 7; // 0 based august.
+  timeinfo.tm_mday = 30;
+  timeinfo.tm_hour = 23;
+  timeinfo.tm_min = 59;
+  timeinfo.tm_sec = 59;
+  const SystemTime time =
+      std::chrono::system_clock::from_time_t(std::mktime(&timeinfo));
+
+  cache.refresh(time);
+  EXPECT_EQ("20150830T235959Z", cache.requestDateTime());
+  EXPECT_EQ("20150830", cache.scopeDate());
+  const std::string &scope = cache.scope("us-east-1", "lambda");
+  EXPECT_EQ("20150830/us-east-1/lambda/aws4_request", scope);
+  EXPECT_EQ(&scope, &cache.scope("us-east-1", "lambda"));
+  EXPECT_EQ("20150830/us-west-2/lambda/aws4_request",
+            cache.scope("us-west-2", "lambda"));
+
+  cache.refresh(time + std::chrono::milliseconds(500));
+  EXPECT_EQ("20150830T235959Z", cache.requestDateTime());
+
+  cache.refresh(time + std::chrono::seconds(1));
+  EXPECT_EQ("20150831T000000Z", cache.requestDateTime());
+  EXPECT_EQ("20150831", cache.scopeDate());
+  EXPECT_EQ("20150831/us-east-1/lambda/aws4_request",
+            cache.scope("us-east-1", "lambda"));
+}
+
+TEST(HeaderList, SortsTheHeadersToSign) {
+  HeaderList headers = AwsAuthenticator::createHeaderToSign(
+      {Http::LowerCaseString("x-b"), Http::LowerCaseString("host"),
+       Http::LowerCaseString("x-b"), Http::LowerCaseString("content-type")});
+  std::vector<std::string> names;
+  for (const Http::LowerCaseString &header : headers) {
+    names.push_back(header.get());
+  }
+  EXPECT_EQ((std::vector<std::string>{"content-type", "host", "x-amz-date",
+                                      "x-b"}),
+            names);
+  EXPECT_EQ("content-type;host;x-amz-date;x-b", headers.signedHeaders());
+}
+
+TEST_F(AwsAuthenticatorTest, SignsOnlyThePresentHeaders) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+  std::string secretkey = "secretkey";
+  std::string accesskey = "accesskey";
+  aws.init(&accesskey, &secretkey, nullptr);
+
+  Http::TestRequestHeaderMapImpl headers{{":path", "/"},
+                                         {":authority", "example.com"}};
+  HeaderList headers_to_sign = AwsAuthenticator::createHeaderToSign(
+      {Http::LowerCaseString("host"), Http::LowerCaseString("x-missing")});
+  std::string sig = signWithTime(aws, &headers, headers_to_sign, "us-east-1",
+                                 std::chrono::system_clock::from_time_t(0));
+  EXPECT_THAT(sig, testing::HasSubstr("SignedHeaders=host;x-amz-date,"));
+}
+
 } // namespace AwsLambda
 } // namespace HttpFilters
 } // namespace Extensions
@@ -0,0 +1,63 @@
+#include "source/common/memory/stats.h"
+#include "source/extensions/filters/http/aws_lambda/config.h"
+
+#include "test/mocks/server/mocks.h"
+
+#include "benchmark/benchmark.h"
+#include "fmt/format.h"
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+// as many route configs as routes, each of them for its own function.
+static void BM_RouteConfigs(benchmark::State &state) {
+  NiceMock<Server::Configuration::MockServerFactoryContext>
+      server_factory_context;
+  std::vector<envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute>
+      protos(state.range(0));
+  for (int route = 0; route < state.range(0); route++) {
+    protos[route].set_name(fmt::format("function-{}", route));
+    protos[route].set_qualifier("v1");
+    protos[route].mutable_empty_body_override()->set_value(
+        fmt::format("{{\"route\": {}}}", route));
+  }
+
+  uint64_t allocated_before = 0;
+  uint64_t allocated_after = 0;
+  std::vector<std::shared_ptr<AWSLambdaRouteConfig>> configs;
+  configs.reserve(protos.size());
+  for (auto _ : state) {
+    allocated_before = Memory::Stats::totalCurrentlyAllocated();
+    for (const auto &proto : protos) {
+      configs.push_back(std::make_shared<AWSLambdaRouteConfig>(
+          proto, server_factory_context));
+    }
+    state.PauseTiming();
+    allocated_after = Memory::Stats::totalCurrentlyAllocated();
+    configs.clear();
+    state.ResumeTiming();
+  }
+  state.counters["routes_per_second"] = benchmark::Counter(
+      state.range(0), benchmark::Counter::kIsIterationInvariantRate);
+  // only known when built with tcmalloc.
+  state.counters["bytes_per_route"] =
+      (static_cast<double>(allocated_after) - allocated_before) /
+      state.range(0);
+}
+BENCHMARK(BM_RouteConfigs)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -0,0 +1,137 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/aws_lambda/aws_lambda_filter.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/server/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+// hands out the same credentials to every request, without asking sts.
+class StaticCredentialsConfig : public AWSLambdaConfig {
+public:
+  StsConnectionPool::Context *getCredentials(
+      SharedAWSLambdaProtocolExtensionConfig,
+      StsConnectionPool::Context::Callbacks *callbacks) const override {
+    callbacks->onSuccess(credentials_);
+    return nullptr;
+  }
+  bool propagateOriginalRouting() const override { return false; }
+  SigningKeyCache *signingKeyCache() const override { return &signing_keys_; }
+  SigningTimeCache *signingTimeCache() const override {
+    return &signing_times_;
+  }
+
+private:
+  const CredentialsConstSharedPtr credentials_{
+      std::make_shared<Envoy::Extensions::Common::Aws::Credentials>(
+          "AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY")};
+  mutable SigningKeyCache signing_keys_;
+  mutable SigningTimeCache signing_times_;
+};
+
+} // namespace
+
+// a request signed and its response passed through the filter, with the
+// response unwrapped from an ALB json payload (1) or left as is (0).
+static void BM_FilterRequestAndResponse(benchmark::State &state) {
+  const bool unwrap_as_alb = state.range(1) != 0;
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  NiceMock<Server::Configuration::MockServerFactoryContext>
+      server_factory_context;
+  factory_context.cluster_manager_.initializeThreadLocalClusters(
+      {"fake_cluster"});
+
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
+      protocol_proto;
+  protocol_proto.set_host("lambda.us-east-1.amazonaws.com");
+  protocol_proto.set_region("us-east-1");
+  ON_CALL(*factory_context.cluster_manager_.thread_local_cluster_.cluster_
+               .info_,
+          extensionProtocolOptions(SoloHttpFilterNames::get().AwsLambda))
+      .WillByDefault(Return(
+          std::make_shared<AWSLambdaProtocolExtensionConfig>(protocol_proto)));
+
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute route_proto;
+  route_proto.set_name("func");
+  route_proto.set_qualifier("v1");
+  route_proto.set_unwrap_as_alb(unwrap_as_alb);
+  AWSLambdaRouteConfig route_config(route_proto, server_factory_context);
+  auto config = std::make_shared<StaticCredentialsConfig>();
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> decoder_callbacks;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> encoder_callbacks;
+  ON_CALL(decoder_callbacks, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&route_config));
+  // the filter manager's buffering of the response, which the alb unwrap
+  // reads.
+  Buffer::OwnedImpl encoding_buffer;
+  ON_CALL(encoder_callbacks, encodingBuffer())
+      .WillByDefault(Return(&encoding_buffer));
+  ON_CALL(encoder_callbacks, addEncodedData(_, _))
+      .WillByDefault(Invoke([&encoding_buffer](Buffer::Instance &data, bool) {
+        encoding_buffer.move(data);
+      }));
+  ON_CALL(encoder_callbacks, modifyEncodingBuffer(_))
+      .WillByDefault(
+          Invoke([&encoding_buffer](
+                     std::function<void(Buffer::Instance &)> callback) {
+            callback(encoding_buffer);
+          }));
+
+  const std::string request_body(state.range(0), 'a');
+  const std::string response_body =
+      unwrap_as_alb ? absl::StrCat(R"({"statusCode":200,"headers":)",
+                                   R"({"content-type":"text/plain"},)",
+                                   R"("body":")", request_body, R"("})")
+                    : request_body;
+  for (auto _ : state) {
+    AWSLambdaFilter filter(factory_context.cluster_manager_,
+                           factory_context.api_, config);
+    filter.setDecoderFilterCallbacks(decoder_callbacks);
+    filter.setEncoderFilterCallbacks(encoder_callbacks);
+
+    Http::TestRequestHeaderMapImpl request_headers{
+        {":method", "POST"},
+        {":authority", "www.solo.io"},
+        {":path", "/invoke"},
+        {"content-type", "text/plain"}};
+    Buffer::OwnedImpl request_data(request_body);
+    filter.decodeHeaders(request_headers, false);
+    filter.decodeData(request_data, true);
+
+    Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+    Buffer::OwnedImpl response_data(response_body);
+    filter.encodeHeaders(response_headers, false);
+    filter.encodeData(response_data, true);
+    filter.onDestroy();
+    encoding_buffer.drain(encoding_buffer.length());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          (request_body.size() + response_body.size()));
+}
+BENCHMARK(BM_FilterRequestAndResponse)
+    ->ArgsProduct({{0, 1 << 10, 64 << 10, 1 << 20}, {0, 1}});
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
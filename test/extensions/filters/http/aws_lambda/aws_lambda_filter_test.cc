@@ -2,6 +2,8 @@
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter.h"
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter_config_factory.h"
 
+#include "test/common/stats/stat_test_utility.h"
+#include "test/extensions/filters/http/aws_lambda/event_stream_test_utility.h"
 #include "test/mocks/common.h"
 #include "test/mocks/server/mocks.h"
 #include "test/mocks/upstream/mocks.h"
@@ -45,7 +47,10 @@ public:
   MOCK_METHOD(StsConnectionPool::Context *, getCreds,  
                    (StsConnectionPool::Context::Callbacks *callbacks), (const));
 
+  const AwsLambdaFilterStats *stats() const override { return filter_stats_; }
+
   bool propagate_original_routing_;
+  const AwsLambdaFilterStats *filter_stats_{};
 };
 
 class StsContextStub : public StsConnectionPool::Context {
@@ -255,6 +260,257 @@ TEST_F(AWSLambdaFilterTest, SignsOnDataEndStream) {
   EXPECT_TRUE(headers.has("Authorization"));
 }
 
+TEST_F(AWSLambdaFilterTest, RejectsBodiesOverTheBufferLimit) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(8));
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"},
+                                         {"content-length", "9"}};
+
+  // the body is rejected before any of it is buffered to sign it.
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::PayloadTooLarge, _, _, _,
+                             "aws_lambda_payload_too_large"));
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  EXPECT_FALSE(headers.has("Authorization"));
+}
+
+TEST_F(AWSLambdaFilterTest, StreamsUnsignedPayloads) {
+  routeconfig_.set_unsigned_payload(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+
+  // the headers are signed without waiting for the body.
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, false));
+  EXPECT_TRUE(headers.has("Authorization"));
+  EXPECT_EQ("UNSIGNED-PAYLOAD", headers.get_("x-amz-content-sha256"));
+  EXPECT_THAT(headers.get_("Authorization"),
+              testing::HasSubstr("x-amz-content-sha256"));
+
+  Buffer::OwnedImpl data("data");
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->decodeData(data, false));
+  Http::TestRequestTrailerMapImpl trailers;
+  EXPECT_EQ(Http::FilterTrailersStatus::Continue,
+            filter_->decodeTrailers(trailers));
+  EXPECT_EQ(1, headers.get(Http::LowerCaseString("x-amz-date")).size());
+}
+
+TEST_F(AWSLambdaFilterTest, UnsignedPayloadNeedsNoBodyOverride) {
+  routeconfig_.set_unsigned_payload(true);
+  routeconfig_.mutable_empty_body_override()->set_value("{}");
+  EXPECT_THROW_WITH_MESSAGE(
+      setup_func(), EnvoyException,
+      "unsigned_payload streams the body, it can't be combined with "
+      "empty_body_override or request_transformer_config");
+}
+
+TEST_F(AWSLambdaFilterTest, RespondEarlyNeedsAsync) {
+  routeconfig_.set_respond_early(true);
+  EXPECT_THROW_WITH_MESSAGE(
+      setup_func(), EnvoyException,
+      "respond_early invokes the function detached with the whole body, it "
+      "requires async and can't be combined with unsigned_payload");
+}
+
+TEST_F(AWSLambdaFilterTest, WrapsTheBodyInABase64Envelope) {
+  routeconfig_.set_base64_encode_body(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"},
+                                         {"content-type", "image/png"},
+                                         {"content-length", "5"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  EXPECT_EQ("application/json", headers.getContentTypeValue());
+
+  // the chunks are wrapped as they arrive.
+  Buffer::OwnedImpl first("\x89PNG");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationAndBuffer,
+            filter_->decodeData(first, false));
+  Buffer::OwnedImpl last("\n");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(last, true));
+
+  const std::string wrapped = first.toString() + last.toString();
+  EXPECT_EQ("{\"body\":\"iVBORwo=\",\"isBase64Encoded\":true}", wrapped);
+  EXPECT_EQ(std::to_string(wrapped.size()), headers.getContentLengthValue());
+  EXPECT_TRUE(headers.has("Authorization"));
+}
+
+TEST_F(AWSLambdaFilterTest, WrapsAMissingBodyInABase64Envelope) {
+  routeconfig_.set_base64_encode_body(true);
+  setup_func();
+
+  Buffer::OwnedImpl body;
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, false))
+      .WillOnce(WithArg<0>(
+          Invoke([&body](Buffer::Instance &data) { body.move(data); })));
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ("{\"body\":\"\",\"isBase64Encoded\":true}", body.toString());
+  EXPECT_EQ(std::to_string(body.length()), headers.getContentLengthValue());
+}
+
+TEST_F(AWSLambdaFilterTest, Base64EncodedBodyNeedsNoRequestTransformation) {
+  routeconfig_.set_base64_encode_body(true);
+  routeconfig_.mutable_empty_body_override()->set_value("{}");
+  EXPECT_THROW_WITH_MESSAGE(
+      setup_func(), EnvoyException,
+      "base64_encode_body encodes the body as it arrives, it can't be "
+      "combined with empty_body_override or request_transformer_config");
+}
+
+TEST_F(AWSLambdaFilterTest, StreamsResponses) {
+  routeconfig_.set_response_streaming(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ("/2021-11-15/functions/" + routeconfig_.name() +
+                "/response-streaming-invocations?Qualifier=" +
+                routeconfig_.qualifier(),
+            headers.get_(":path"));
+
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"},
+                                                   {"content-length", "100"}};
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, false));
+  EXPECT_FALSE(response_headers.has("content-length"));
+
+  // every chunk is forwarded as soon as it is whole.
+  const std::string first = payloadChunk("hello ");
+  Buffer::OwnedImpl data(first + first.substr(0, 5));
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(data, false));
+  EXPECT_EQ("hello ", data.toString());
+
+  Buffer::OwnedImpl rest(first.substr(5) + invokeComplete());
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(rest, true));
+  EXPECT_EQ("hello ", rest.toString());
+}
+
+TEST_F(AWSLambdaFilterTest, ResetsFailedResponseStreams) {
+  routeconfig_.set_response_streaming(true);
+  setup_func();
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  filter_->encodeHeaders(response_headers, false);
+
+  Buffer::OwnedImpl data(payloadChunk("partial") +
+                         invokeComplete(R"({"ErrorCode": "Unhandled"})"));
+  EXPECT_CALL(filter_encode_callbacks_, resetStream());
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->encodeData(data, true));
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamingNeedsNoTransformation) {
+  routeconfig_.set_response_streaming(true);
+  routeconfig_.set_unwrap_as_alb(true);
+  EXPECT_THROW_WITH_MESSAGE(
+      setup_func(), EnvoyException,
+      "response_streaming streams the response, it can't be combined with "
+      "async, unwrap_as_alb or transformer_config");
+}
+
+TEST_F(AWSLambdaFilterTest, LimitsTheConcurrencyOfTheFunction) {
+  routeconfig_.mutable_concurrency_limit()->set_max_concurrency(1);
+  setup_func();
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  // a second request while the first is in flight is rejected.
+  AWSLambdaFilter second(factory_context_.cluster_manager_,
+                         factory_context_.api_, filter_config_);
+  second.setDecoderFilterCallbacks(filter_callbacks_);
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::TooManyRequests, _, _, _,
+                             "aws_lambda_concurrency_limited"));
+  Http::TestRequestHeaderMapImpl second_headers{
+      {":method", "GET"}, {":authority", "www.solo.io"}, {":path", "/other"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            second.decodeHeaders(second_headers, true));
+
+  // until the response of the first one frees its slot.
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  filter_->encodeHeaders(response_headers, true);
+  AWSLambdaFilter third(factory_context_.cluster_manager_,
+                        factory_context_.api_, filter_config_);
+  third.setDecoderFilterCallbacks(filter_callbacks_);
+  Http::TestRequestHeaderMapImpl third_headers{
+      {":method", "GET"}, {":authority", "www.solo.io"}, {":path", "/other"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            third.decodeHeaders(third_headers, true));
+  third.onDestroy();
+}
+
+TEST_F(AWSLambdaFilterTest, FailsOverToTheRegionThatAnswers) {
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
+      protoextconfig;
+  protoextconfig.set_host("lambda.us-east-1.amazonaws.com");
+  protoextconfig.set_region("us-east-1");
+  auto *failover = protoextconfig.add_failover_regions();
+  failover->set_host("lambda.us-west-2.amazonaws.com");
+  failover->set_region("us-west-2");
+  ON_CALL(
+      *factory_context_.cluster_manager_.thread_local_cluster_.cluster_.info_,
+      extensionProtocolOptions(SoloHttpFilterNames::get().AwsLambda))
+      .WillByDefault(Return(
+          std::make_shared<AWSLambdaProtocolExtensionConfig>(protoextconfig)));
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ("lambda.us-east-1.amazonaws.com", headers.getHostValue());
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "503"}};
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  filter_->encodeHeaders(response_headers, true);
+
+  // the next request is sent, and signed for, the region that didn't fail.
+  AWSLambdaFilter second(factory_context_.cluster_manager_,
+                         factory_context_.api_, filter_config_);
+  second.setDecoderFilterCallbacks(filter_callbacks_);
+  Http::TestRequestHeaderMapImpl second_headers{{":method", "GET"},
+                                                {":authority", "www.solo.io"},
+                                                {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            second.decodeHeaders(second_headers, true));
+  EXPECT_EQ("lambda.us-west-2.amazonaws.com", second_headers.getHostValue());
+  EXPECT_THAT(second_headers.get_("Authorization"),
+              testing::HasSubstr("/us-west-2/lambda/aws4_request"));
+  second.onDestroy();
+}
+
+TEST_F(AWSLambdaFilterTest, ConcurrencyLimitNeedsAValidRange) {
+  routeconfig_.mutable_concurrency_limit()->set_max_concurrency(1);
+  routeconfig_.mutable_concurrency_limit()->set_min_concurrency(2);
+  EXPECT_THROW_WITH_MESSAGE(
+      setup_func(), EnvoyException,
+      "concurrency_limit min_concurrency can't be above max_concurrency");
+}
+
 // see: https://docs.aws.amazon.com/lambda/latest/dg/API_Invoke.html
 TEST_F(AWSLambdaFilterTest, CorrectFuncCalled) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
@@ -351,6 +607,52 @@ TEST_F(AWSLambdaFilterTest, SignOnTrailedEndStream) {
   EXPECT_TRUE(headers.has("Authorization"));
 }
 
+TEST_F(AWSLambdaFilterTest, RecordsTheWaitForCredentials) {
+  setupRoute(false, false, false, false, true);
+  Stats::TestUtil::TestStore store;
+  AwsLambdaFilterStats stats{ALL_AWS_LAMBDA_FILTER_STATS(
+      POOL_COUNTER_PREFIX(store, "test."), POOL_GAUGE_PREFIX(store, "test."),
+      POOL_HISTOGRAM_PREFIX(store, "test."))};
+  filter_config_->filter_stats_ = &stats;
+
+  StsConnectionPool::Context::Callbacks *callbacks{};
+  StsContextStub context;
+  EXPECT_CALL(*filter_config_, getCreds)
+      .WillRepeatedly(Invoke([&](StsConnectionPool::Context::Callbacks *cb)
+                                 -> StsConnectionPool::Context * {
+        callbacks = cb;
+        return &context;
+      }));
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ(1, stats.streams_waiting_for_credentials_.value());
+
+  callbacks->onSuccess(filter_config_->credentials_);
+  EXPECT_EQ(0, stats.streams_waiting_for_credentials_.value());
+  EXPECT_EQ(1,
+            store.histogramValues("test.credentials_wait_time", false).size());
+  EXPECT_EQ(1, store.histogramValues("test.signing_time", false).size());
+
+  // a stream that goes away while waiting is not recorded
+  filter_ = std::make_unique<AWSLambdaFilter>(
+      factory_context_.cluster_manager_, factory_context_.api_,
+      filter_config_);
+  filter_->setDecoderFilterCallbacks(filter_callbacks_);
+  Http::TestRequestHeaderMapImpl headers_2{{":method", "GET"},
+                                           {":authority", "www.solo.io"},
+                                           {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers_2, true);
+  EXPECT_EQ(1, stats.streams_waiting_for_credentials_.value());
+  filter_->onDestroy();
+  EXPECT_EQ(0, stats.streams_waiting_for_credentials_.value());
+  EXPECT_EQ(1,
+            store.histogramValues("test.credentials_wait_time", false).size());
+}
+
 TEST_F(AWSLambdaFilterTest, SignsDataSetByPreviousFilters) {
   // there are cases where even if our filter is waiting on decode headers
   // decode data can still happen. We need to verify that bodysha is still
@@ -382,7 +684,7 @@ TEST_F(AWSLambdaFilterTest, SignsDataSetByPreviousFilters) {
   callbackReference->onSuccess(filter_config_->credentials_);
   filter_->decodeData(data_1, false);
   filter_->decodeTrailers(trailers_1);
-  auto auth1 = filter_->awsAuthenticator();
+  auto auth1 = *filter_->awsAuthenticator();
   auto hex_sha1 = auth1.getBodyHexSha();
 
   filter_ = std::make_unique<AWSLambdaFilter>(
@@ -402,7 +704,7 @@ TEST_F(AWSLambdaFilterTest, SignsDataSetByPreviousFilters) {
   filter_->decodeData(data_2, false);
   callbackReference->onSuccess(filter_config_->credentials_);
   filter_->decodeTrailers(trailers_2);
-  auto auth2 = filter_->awsAuthenticator();
+  auto auth2 = *filter_->awsAuthenticator();
   auto hex_sha2 = auth2.getBodyHexSha();
   EXPECT_EQ(hex_sha1, hex_sha2);
 
@@ -424,7 +726,7 @@ TEST_F(AWSLambdaFilterTest, SignsDataSetByPreviousFilters) {
   filter_->decodeHeaders(headers_3, false);
   filter_->decodeData(data_3, true);
   callbackReference->onSuccess(filter_config_->credentials_);
-  auto auth3 = filter_->awsAuthenticator();
+  auto auth3 = *filter_->awsAuthenticator();
   auto hex_sha3 = auth3.getBodyHexSha();
 
   EXPECT_EQ(hex_sha1, hex_sha3);
@@ -523,6 +825,20 @@ TEST_F(AWSLambdaFilterTest, EmptyBodyWithTrailersGetsOverriden) {
   filter_->decodeTrailers(trailers);
 }
 
+TEST_F(AWSLambdaFilterTest, NoAuthenticatorWithoutLambdaCluster) {
+  ON_CALL(
+      *factory_context_.cluster_manager_.thread_local_cluster_.cluster_.info_,
+      extensionProtocolOptions(SoloHttpFilterNames::get().AwsLambda))
+      .WillByDefault(Return(nullptr));
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ(nullptr, filter_->awsAuthenticator());
+}
+
 TEST_F(AWSLambdaFilterTest, NoFunctionOnRoute) {
   ON_CALL(filter_callbacks_,
           mostSpecificPerFilterConfig())
@@ -711,6 +1027,71 @@ TEST_F(AWSLambdaFilterTest, ALBDecodingInvalidJSON) {
   EXPECT_EQ("500", response_headers.getStatusValue());
 }
 
+
+TEST_F(AWSLambdaFilterTest, ServesCachedResponses) {
+  routeconfig_.mutable_response_cache()->mutable_ttl()->set_seconds(60);
+  setup_func();
+  EXPECT_CALL(*filter_config_, getCreds(_)).Times(1);
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "200"}, {"content-type", "application/json"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, false));
+  Buffer::OwnedImpl response_body("{\"answer\":42}");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->encodeData(response_body, true));
+
+  // the same request is answered from the cache, without being signed.
+  filter_ = std::make_unique<AWSLambdaFilter>(
+      factory_context_.cluster_manager_, factory_context_.api_,
+      filter_config_);
+  filter_->setDecoderFilterCallbacks(filter_callbacks_);
+  Http::TestRequestHeaderMapImpl cached_headers{{":method", "GET"},
+                                                {":authority", "www.solo.io"},
+                                                {":path", "/getsomething"}};
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, false))
+      .WillOnce(Invoke([](Http::ResponseHeaderMap &headers, bool) {
+        EXPECT_EQ("200", headers.getStatusValue());
+        EXPECT_EQ("application/json", headers.getContentTypeValue());
+        EXPECT_EQ("13", headers.getContentLengthValue());
+      }));
+  EXPECT_CALL(filter_callbacks_, encodeData(_, true))
+      .WillOnce(Invoke([](Buffer::Instance &data, bool) {
+        EXPECT_EQ("{\"answer\":42}", data.toString());
+      }));
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(cached_headers, true));
+  EXPECT_FALSE(cached_headers.has("Authorization"));
+}
+
+TEST_F(AWSLambdaFilterTest, DoesNotCacheFailedResponses) {
+  routeconfig_.mutable_response_cache()->mutable_ttl()->set_seconds(60);
+  setup_func();
+  EXPECT_CALL(*filter_config_, getCreds(_)).Times(2);
+
+  for (int i = 0; i < 2; i++) {
+    filter_ = std::make_unique<AWSLambdaFilter>(
+        factory_context_.cluster_manager_, factory_context_.api_,
+        filter_config_);
+    filter_->setDecoderFilterCallbacks(filter_callbacks_);
+    Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                           {":authority", "www.solo.io"},
+                                           {":path", "/getsomething"}};
+    EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+              filter_->decodeHeaders(headers, true));
+    filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+    Http::TestResponseHeaderMapImpl response_headers{
+        {":status", "200"}, {"x-amz-function-error", "Unhandled"}};
+    filter_->encodeHeaders(response_headers, true);
+  }
+}
+
 } // namespace AwsLambda
 } // namespace HttpFilters
 } // namespace Extensions
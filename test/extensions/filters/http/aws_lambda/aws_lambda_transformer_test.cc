@@ -278,6 +278,102 @@ TEST_F(AWSLambdaTransformerTest, TestConfigureRequestTransformerSignatureNoBody)
   );
 }
 
+TEST_F(AWSLambdaTransformerTest, HashesPassthroughBodiesAsTheyArrive) {
+  auto *transformer_config = routeconfig_.mutable_request_transformer_config();
+  transformer_config->set_name(
+      "io.solo.transformer.api_gateway_test_transformer");
+  Envoy::Extensions::Transformer::Fake::FakeTransformerProto transformer;
+  transformer.set_passthrough(true);
+  transformer_config->mutable_typed_config()->PackFrom(transformer);
+  setupRoute();
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  Buffer::OwnedImpl data_1("hello ");
+  Buffer::OwnedImpl data_2("world");
+  time_system_.setSystemTime(std::chrono::milliseconds(1000000000000));
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationAndBuffer,
+            filter_->decodeData(data_1, false));
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(data_2, true));
+  const std::string transformed_authorization(
+      headers.get(Http::LowerCaseString("authorization"))[0]
+          ->value()
+          .getStringView());
+
+  // the payload is the same as it is without a transformation
+  routeconfig_.clear_request_transformer_config();
+  setupRoute();
+  Http::TestRequestHeaderMapImpl headers_2{{":method", "GET"},
+                                           {":authority", "www.solo.io"},
+                                           {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers_2, false));
+  Buffer::OwnedImpl data_3("hello world");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(data_3, true));
+  EXPECT_EQ(transformed_authorization,
+            headers_2.get(Http::LowerCaseString("authorization"))[0]
+                ->value()
+                .getStringView());
+}
+
+TEST_F(AWSLambdaTransformerTest, HashesTheTransformedBodyAsItIsRendered) {
+  // larger than the staging area of the stream the body is rendered with.
+  std::string rendered;
+  for (int i = 0; i < 300; i++) {
+    rendered += "record-" + std::to_string(i) + ";";
+  }
+  auto *transformer_config = routeconfig_.mutable_request_transformer_config();
+  transformer_config->set_name(
+      "io.solo.transformer.api_gateway_test_transformer");
+  Envoy::Extensions::Transformer::Fake::FakeTransformerProto transformer;
+  transformer.set_body(rendered);
+  transformer_config->mutable_typed_config()->PackFrom(transformer);
+  setupRoute();
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  std::string upstream_body;
+  EXPECT_CALL(filter_callbacks_, modifyDecodingBuffer)
+      .WillOnce(Invoke(
+          [&](std::function<void(Buffer::Instance &)> transformer_callback) {
+            Buffer::OwnedImpl buffer("hello");
+            transformer_callback(buffer);
+            upstream_body = buffer.toString();
+          }));
+  Buffer::OwnedImpl data("hello");
+  time_system_.setSystemTime(std::chrono::milliseconds(1000000000000));
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->decodeData(data, true));
+  EXPECT_EQ(rendered, upstream_body);
+  const std::string transformed_authorization(
+      headers.get(Http::LowerCaseString("authorization"))[0]
+          ->value()
+          .getStringView());
+
+  // the signature is the one over the rendered bytes.
+  routeconfig_.clear_request_transformer_config();
+  setupRoute();
+  Http::TestRequestHeaderMapImpl headers_2{{":method", "GET"},
+                                           {":authority", "www.solo.io"},
+                                           {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers_2, false));
+  Buffer::OwnedImpl data_2(rendered);
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(data_2, true));
+  EXPECT_EQ(transformed_authorization,
+            headers_2.get(Http::LowerCaseString("authorization"))[0]
+                ->value()
+                .getStringView());
+}
+
 TEST_F(AWSLambdaTransformerTest, TestConfigureResponseTransformer){
   setupRoute(true, false);
   auto request_headers = setup_encode();
@@ -295,6 +391,31 @@ TEST_F(AWSLambdaTransformerTest, TestConfigureResponseTransformer){
   EXPECT_STREQ("test body from fake transformer", buf.toString().c_str());
 }
 
+TEST_F(AWSLambdaTransformerTest, KeepsBinaryTransformedResponses){
+  const std::string binary_body("binary\0body", 11);
+  auto *transformer_config = routeconfig_.mutable_transformer_config();
+  transformer_config->set_name(
+      "io.solo.transformer.api_gateway_test_transformer");
+  Envoy::Extensions::Transformer::Fake::FakeTransformerProto transformer;
+  transformer.set_body(binary_body);
+  transformer_config->mutable_typed_config()->PackFrom(transformer);
+  setupRoute();
+  auto response_headers = setup_encode();
+
+  Buffer::OwnedImpl buf("lambda response");
+  auto on_buf_mod = [&buf](std::function<void(Buffer::Instance&)> cb){cb(buf);};
+  EXPECT_CALL(filter_encode_callbacks_, encodingBuffer).WillOnce(Return(&buf));
+  EXPECT_CALL(filter_encode_callbacks_, modifyEncodingBuffer)
+      .WillOnce(Invoke(on_buf_mod));
+
+  Buffer::OwnedImpl dataBuf;
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->encodeData(dataBuf, true));
+  // the transformed body is not cut at the nul byte.
+  EXPECT_EQ(binary_body, buf.toString());
+  EXPECT_EQ("11", response_headers.getContentLengthValue());
+}
+
 TEST_F(AWSLambdaTransformerTest, TestNoBodyRequestTransformation){
   setupRoute(false, true);
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
@@ -0,0 +1,56 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/base64.h"
+#include "source/extensions/filters/http/aws_lambda/body_envelope.h"
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+std::string envelopeOf(const std::string &body) {
+  return absl::StrCat(BodyEnvelope::Prefix,
+                      Base64::encode(body.data(), body.size()),
+                      BodyEnvelope::Suffix);
+}
+
+TEST(BodyEnvelope, WrapsTheBodyAcrossChunks) {
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    value.push_back(static_cast<char>(i * 7));
+  }
+  for (size_t length : {0, 1, 2, 3, 4, 5, 64, 100}) {
+    const std::string body = value.substr(0, length);
+    for (size_t chunk_size : {1, 2, 3, 4, 7, 64}) {
+      BodyEnvelope envelope;
+      std::string wrapped;
+      for (size_t pos = 0; pos < length; pos += chunk_size) {
+        Buffer::OwnedImpl chunk(body.substr(pos, chunk_size));
+        envelope.wrap(chunk, false);
+        wrapped += chunk.toString();
+      }
+      Buffer::OwnedImpl last;
+      envelope.wrap(last, true);
+      wrapped += last.toString();
+
+      EXPECT_TRUE(envelope.done());
+      EXPECT_EQ(envelopeOf(body), wrapped);
+      EXPECT_EQ(wrapped.size(), envelope.length());
+      EXPECT_EQ(wrapped.size(), BodyEnvelope::wrappedLength(length));
+    }
+  }
+}
+
+TEST(BodyEnvelope, WrapsABodyInOneChunk) {
+  BodyEnvelope envelope;
+  Buffer::OwnedImpl data("solo");
+  envelope.wrap(data, true);
+  EXPECT_EQ("{\"body\":\"c29sbw==\",\"isBase64Encoded\":true}", data.toString());
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
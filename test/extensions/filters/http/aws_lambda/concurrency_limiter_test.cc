@@ -0,0 +1,113 @@
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class ConcurrencyLimiterTest : public testing::Test {
+public:
+  ConcurrencyLimiterTest() {
+    proto_.set_max_concurrency(4);
+    proto_.set_min_concurrency(1);
+  }
+
+  uint64_t gauge(const std::string &name) {
+    return TestUtility::findGauge(store_, "prefix." + name)->value();
+  }
+
+  ConcurrencyLimitProto proto_;
+  Stats::TestUtil::TestStore store_;
+};
+
+TEST_F(ConcurrencyLimiterTest, RejectsRequestsOverTheLimit) {
+  ConcurrencyLimiter limiter(
+      proto_, ConcurrencyLimiter::generateStats("prefix.", store_));
+  uint64_t epoch;
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(limiter.tryAcquire(epoch));
+  }
+  EXPECT_EQ(4, gauge("rq_active"));
+  EXPECT_FALSE(limiter.tryAcquire(epoch));
+  EXPECT_EQ(1, store_.counter("prefix.rq_rejected").value());
+
+  limiter.release(epoch, ConcurrencyLimiter::Outcome::Ignored);
+  EXPECT_TRUE(limiter.tryAcquire(epoch));
+}
+
+TEST_F(ConcurrencyLimiterTest, BacksOffOncePerEpoch) {
+  ConcurrencyLimiter limiter(
+      proto_, ConcurrencyLimiter::generateStats("prefix.", store_));
+  uint64_t first;
+  uint64_t second;
+  ASSERT_TRUE(limiter.tryAcquire(first));
+  ASSERT_TRUE(limiter.tryAcquire(second));
+
+  // both requests were in flight when the function was throttled, which
+  // only cuts the limit once.
+  limiter.release(first, ConcurrencyLimiter::Outcome::Throttled);
+  EXPECT_EQ(2, limiter.limit());
+  limiter.release(second, ConcurrencyLimiter::Outcome::Throttled);
+  EXPECT_EQ(2, limiter.limit());
+  EXPECT_EQ(2, store_.counter("prefix.rq_throttled").value());
+  EXPECT_EQ(2, gauge("concurrency_limit"));
+
+  // a request let through since then cuts it again, down to the minimum.
+  uint64_t third;
+  ASSERT_TRUE(limiter.tryAcquire(third));
+  limiter.release(third, ConcurrencyLimiter::Outcome::Throttled);
+  EXPECT_EQ(1, limiter.limit());
+  ASSERT_TRUE(limiter.tryAcquire(third));
+  limiter.release(third, ConcurrencyLimiter::Outcome::Throttled);
+  EXPECT_EQ(1, limiter.limit());
+}
+
+TEST_F(ConcurrencyLimiterTest, GrowsBackWithSuccesses) {
+  proto_.mutable_backoff_ratio()->set_value(0.25);
+  ConcurrencyLimiter limiter(
+      proto_, ConcurrencyLimiter::generateStats("prefix.", store_));
+  uint64_t epoch;
+  ASSERT_TRUE(limiter.tryAcquire(epoch));
+  limiter.release(epoch, ConcurrencyLimiter::Outcome::Throttled);
+  EXPECT_EQ(1, limiter.limit());
+
+  // about one more for every limit's worth of successes.
+  ASSERT_TRUE(limiter.tryAcquire(epoch));
+  limiter.release(epoch, ConcurrencyLimiter::Outcome::Success);
+  EXPECT_EQ(2, limiter.limit());
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(limiter.tryAcquire(epoch));
+    limiter.release(epoch, ConcurrencyLimiter::Outcome::Success);
+  }
+  EXPECT_EQ(3, limiter.limit());
+
+  // never above the maximum.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(limiter.tryAcquire(epoch));
+    limiter.release(epoch, ConcurrencyLimiter::Outcome::Success);
+  }
+  EXPECT_EQ(4, limiter.limit());
+}
+
+TEST_F(ConcurrencyLimiterTest, SharesTheLimitersOfAFunction) {
+  ConcurrencyLimiterRegistry registry;
+  ConcurrencyLimiterSharedPtr limiter =
+      registry.getOrCreate("func.v1", proto_, store_);
+  EXPECT_EQ(limiter, registry.getOrCreate("func.v1", proto_, store_));
+  EXPECT_NE(limiter, registry.getOrCreate("func.v2", proto_, store_));
+
+  // a different limit gets a limiter of its own.
+  ConcurrencyLimitProto other = proto_;
+  other.set_max_concurrency(10);
+  EXPECT_NE(limiter, registry.getOrCreate("func.v1", other, store_));
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -5,14 +5,18 @@
 #include "test/mocks/common.h"
 #include "test/mocks/server/mocks.h"
 #include "test/mocks/upstream/mocks.h"
+#include "test/test_common/thread_factory_for_test.h"
 #include "test/test_common/utility.h"
 
+#include "absl/synchronization/notification.h"
+
 #include "fmt/format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 using testing::_;
 using testing::AtLeast;
+using testing::ByMove;
 using testing::Invoke;
 using testing::Return;
 using testing::ReturnPointee;
@@ -38,6 +42,23 @@ public:
 protected:
   void SetUp() override {
     sts_factory_ = new NiceMock<MockStsCredentialsProviderFactory>();
+    ON_CALL(context_.api_, threadFactory())
+        .WillByDefault(ReturnRef(Thread::threadFactoryForTest()));
+  }
+
+  // runs the refresh timer, and then the result that the refresh thread posts
+  // to the main thread.
+  void refreshCredentials(Event::MockTimer &timer) {
+    absl::Notification posted;
+    Event::PostCb result;
+    EXPECT_CALL(context_.dispatcher_, post(_))
+        .WillOnce(Invoke([&](Event::PostCb cb) {
+          result = std::move(cb);
+          posted.Notify();
+        }));
+    timer.invokeCallback();
+    posted.WaitForNotification();
+    result();
   }
 
   NiceMock<Server::Configuration::MockFactoryContext> context_;
@@ -103,7 +124,7 @@ TEST_F(ConfigTest, WithUseDefaultCreds) {
 
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
 
-  timer->invokeCallback();
+  refreshCredentials(*timer);
 
   NiceMock<MockStsContextCallbacks> callbacks_2;
   std::shared_ptr<const AWSLambdaProtocolExtensionConfig> ext_config_2 =
@@ -170,7 +191,7 @@ TEST_F(ConfigTest, FailingToRotate) {
 
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
 
-  timer->invokeCallback();
+  refreshCredentials(*timer);
 
   // When we fail to rotate we latch to the last good credentials
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
@@ -187,6 +208,44 @@ TEST_F(ConfigTest, FailingToRotate) {
             stats_.counterFromString("prefix.aws_lambda.fetch_failed").value());
 }
 
+TEST_F(ConfigTest, DoesNotWaitForARefreshInFlight) {
+  auto timer = prepareTimer();
+
+  const Envoy::Extensions::Common::Aws::Credentials creds("access_key",
+                                                          "secret_key");
+
+  // the refresh blocks, as a fetch from the instance metadata service would,
+  // until the end of the test.
+  auto fetching = std::make_shared<absl::Notification>();
+  auto release = std::make_shared<absl::Notification>();
+  auto cred_provider = std::make_unique<
+      NiceMock<Envoy::Extensions::Common::Aws::MockCredentialsProvider>>();
+  EXPECT_CALL(*cred_provider, getCredentials())
+      .WillOnce(Return(creds))
+      .WillOnce(Invoke([fetching, release, creds]() {
+        fetching->Notify();
+        release->WaitForNotification();
+        return creds;
+      }));
+
+  std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
+      sts_factory_};
+  auto config = AWSLambdaConfigImpl::create(
+      std::move(cred_provider), std::move(unique_factory), context_.dispatcher_,
+      context_.api_, context_.thread_local_, "prefix.", stats_, protoconfig);
+
+  // a config destroyed during the refresh never gets its result.
+  EXPECT_CALL(context_.dispatcher_, post(_)).Times(0);
+  timer->invokeCallback();
+  fetching->WaitForNotification();
+
+  // the refresh in flight is skipped instead of waited for.
+  timer->invokeCallback();
+
+  config.reset();
+  release->Notify();
+}
+
 TEST_F(ConfigTest, WithProtocolExtensionCreds) {
 
   envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
@@ -261,11 +320,12 @@ TEST_F(ConfigTest, WithStsCreds) {
       .Times(1)
       .WillOnce(Return("web_token"));
 
-  EXPECT_CALL(*sts_factory_, build(_, _, _, _))
+  EXPECT_CALL(*sts_factory_, build(_, _, _, _, _))
       .WillOnce(
           Invoke([&](const envoy::config::filter::http::aws_lambda::v2::
                          AWSLambdaConfig_ServiceAccountCredentials &,
-                     Event::Dispatcher &, std::string_view web_token,
+                     Event::Dispatcher &, StsCredentialsProviderStats &,
+                     std::string_view web_token,
                      std::string_view role_arn) -> StsCredentialsProviderPtr {
             EXPECT_EQ(web_token, "web_token");
             EXPECT_EQ(role_arn, "test_arn");
@@ -288,16 +348,109 @@ TEST_F(ConfigTest, WithStsCreds) {
   std::shared_ptr<const AWSLambdaProtocolExtensionConfig> ext_config =
       std::make_shared<const AWSLambdaProtocolExtensionConfig>(protoextconfig);
 
+  // the credentials are fetched on the main thread, which the mocks run
+  // inline, and handed to the worker.
+  auto credentials = std::make_shared<const StsCredentials>(
+      "access_key", "secret_key", "session_token",
+      context_.api_.timeSource().systemTime() + std::chrono::hours(1));
   EXPECT_CALL(*sts_cred_provider_, find(_, _, _))
       .WillOnce(Invoke([&](const absl::optional<std::string> &role_arn_arg,
                         bool,
-                           StsConnectionPool::Context::Callbacks *)
+                           StsConnectionPool::Context::Callbacks *fetch)
                            -> StsConnectionPool::Context * {
         EXPECT_EQ(ext_config->roleArn().value(), role_arn_arg);
+        fetch->onSuccess(credentials);
         return nullptr;
       }));
+  EXPECT_CALL(callbacks, onSuccess(_));
   auto ptr = config->getCredentials(ext_config, &callbacks);
   EXPECT_EQ(nullptr, ptr);
+
+  // the worker has a copy now
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  EXPECT_CALL(callbacks_2, onSuccess(_));
+  EXPECT_EQ(nullptr, config->getCredentials(ext_config, &callbacks_2));
+}
+
+TEST_F(ConfigTest, PrefetchesStsCredentialsOfClusters) {
+
+  prepareSTS();
+  protoconfig.set_prefetch_role_credentials(true);
+
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
+      protoextconfig;
+  protoextconfig.set_role_arn("role_arn");
+  auto ext_config =
+      std::make_shared<const AWSLambdaProtocolExtensionConfig>(protoextconfig);
+
+  auto sts_cred_provider_ = new NiceMock<MockStsCredentialsProvider>();
+  std::unique_ptr<NiceMock<MockStsCredentialsProvider>> sts_cred_provider{
+      sts_cred_provider_};
+
+  setenv("AWS_WEB_IDENTITY_TOKEN_FILE", "test", 1);
+  setenv("AWS_ROLE_ARN", "test_arn", 1);
+  EXPECT_CALL(context_.api_.file_system_, fileExists(_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(context_.api_.file_system_, fileReadToEnd(_))
+      .WillOnce(Return("web_token"));
+  EXPECT_CALL(*sts_factory_, build(_, _, _, _, _))
+      .WillOnce(Return(ByMove(std::move(sts_cred_provider))));
+  EXPECT_CALL(context_.dispatcher_, createFilesystemWatcher_())
+      .WillOnce(Return(new NiceMock<Filesystem::MockWatcher>()));
+
+  std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
+      sts_factory_};
+  auto config = AWSLambdaConfigImpl::create(
+      std::make_unique<
+          NiceMock<Envoy::Extensions::Common::Aws::MockCredentialsProvider>>(),
+      std::move(unique_factory), context_.dispatcher_, context_.api_,
+      context_.thread_local_, "prefix.", stats_, protoconfig);
+
+  EXPECT_CALL(context_.cluster_manager_,
+              addThreadLocalClusterUpdateCallbacks_(_));
+  config->prefetchCredentials(context_.cluster_manager_,
+                              context_.init_manager_);
+
+  // a cluster added by cds gets its role prefetched
+  auto &cluster = context_.cluster_manager_.thread_local_cluster_;
+  ON_CALL(*cluster.cluster_.info_, extensionProtocolOptions(_))
+      .WillByDefault(Return(ext_config));
+  EXPECT_CALL(*sts_cred_provider_,
+              find(absl::optional<std::string>("role_arn"), false, _));
+  config->onClusterAddOrUpdate(cluster);
+}
+
+TEST_F(ConfigTest, CachesProtocolOptionsOfClusters) {
+  NiceMock<Upstream::MockClusterManager> cm;
+  EXPECT_CALL(cm, addThreadLocalClusterUpdateCallbacks_(_));
+  ProtocolOptionsCache cache(cm);
+
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
+      protoextconfig;
+  protoextconfig.set_host("lambda.us-east-1.amazonaws.com");
+  protoextconfig.set_region("us-east-1");
+  auto ext_config =
+      std::make_shared<const AWSLambdaProtocolExtensionConfig>(protoextconfig);
+  auto &cluster = cm.thread_local_cluster_;
+  ON_CALL(*cluster.cluster_.info_, extensionProtocolOptions(_))
+      .WillByDefault(Return(ext_config));
+
+  // the options are looked up once
+  EXPECT_CALL(cm, getThreadLocalCluster(_)).WillOnce(Return(&cluster));
+  EXPECT_EQ(ext_config, cache.get("fake_cluster"));
+  EXPECT_EQ(ext_config, cache.get("fake_cluster"));
+
+  // and again once the cluster is updated
+  cache.onClusterAddOrUpdate(cluster);
+  EXPECT_CALL(cm, getThreadLocalCluster(_)).WillOnce(Return(&cluster));
+  EXPECT_EQ(ext_config, cache.get("fake_cluster"));
+
+  // an unknown cluster is not cached
+  EXPECT_CALL(cm, getThreadLocalCluster(_))
+      .Times(2)
+      .WillRepeatedly(Return(nullptr));
+  EXPECT_EQ(nullptr, cache.get("unknown"));
+  EXPECT_EQ(nullptr, cache.get("unknown"));
 }
 
 } // namespace AwsLambda
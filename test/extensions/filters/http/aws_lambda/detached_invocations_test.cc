@@ -0,0 +1,143 @@
+#include "source/common/http/message_impl.h"
+#include "source/extensions/filters/http/aws_lambda/detached_invocations.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/upstream/cluster_manager.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+namespace {
+
+class DetachedInvocationsTest : public testing::Test {
+public:
+  DetachedInvocationsTest() {
+    cm_.initializeThreadLocalClusters({"lambda"});
+  }
+
+  void initialize() {
+    invocations_ = std::make_unique<DetachedInvocations>(
+        cm_, dispatcher_, DetachedInvocationsConfig(proto_config_),
+        DetachedInvocations::generateStats("detached.", store_));
+  }
+
+  // answers the next request with the status.
+  void respond(const std::string &status) {
+    EXPECT_CALL(cm_.thread_local_cluster_.async_client_, send_(_, _, _))
+        .WillOnce(Invoke([this, status](Http::RequestMessagePtr &message,
+                                        Http::AsyncClient::Callbacks &callbacks,
+                                        const Http::AsyncClient::RequestOptions
+                                            &) -> Http::AsyncClient::Request * {
+          sent_body_ = message->body().toString();
+          callbacks.onSuccess(
+              request_, std::make_unique<Http::ResponseMessageImpl>(
+                            Http::ResponseHeaderMapPtr{
+                                new Http::TestResponseHeaderMapImpl{
+                                    {":status", status}}}));
+          return nullptr;
+        }));
+  }
+
+  uint64_t counter(const std::string &name) {
+    return store_.counterFromString("detached." + name).value();
+  }
+
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
+      DetachedInvocations proto_config_;
+  NiceMock<Upstream::MockClusterManager> cm_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  Stats::TestUtil::TestStore store_;
+  NiceMock<Http::MockAsyncClientRequest> request_{
+      &cm_.thread_local_cluster_.async_client_};
+  std::unique_ptr<DetachedInvocations> invocations_;
+  Http::TestRequestHeaderMapImpl headers_{
+      {":method", "POST"},
+      {":path", "/2015-03-31/functions/fn/invocations"},
+      {":authority", "lambda.us-east-1.amazonaws.com"},
+      {"x-amz-invocation-type", "Event"}};
+  std::string sent_body_;
+};
+
+TEST_F(DetachedInvocationsTest, SendsACopyOfTheRequest) {
+  initialize();
+  respond("202");
+  Buffer::OwnedImpl body("{\"a\":1}");
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, &body));
+
+  EXPECT_EQ("{\"a\":1}", sent_body_);
+  EXPECT_EQ("{\"a\":1}", body.toString());
+  EXPECT_EQ(1, counter("success"));
+  EXPECT_EQ(0, invocations_->inFlight());
+}
+
+TEST_F(DetachedInvocationsTest, RetriesThrottledInvocations) {
+  initialize();
+  auto *retry_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  respond("429");
+  EXPECT_CALL(*retry_timer, enableTimer(std::chrono::milliseconds(100), _));
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_EQ(1, counter("retry"));
+  EXPECT_EQ(1, invocations_->inFlight());
+
+  respond("202");
+  retry_timer->invokeCallback();
+  EXPECT_EQ(1, counter("success"));
+  EXPECT_EQ(0, invocations_->inFlight());
+}
+
+TEST_F(DetachedInvocationsTest, FailsAfterTheRetries) {
+  proto_config_.mutable_num_retries()->set_value(0);
+  initialize();
+  respond("503");
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_EQ(0, counter("retry"));
+  EXPECT_EQ(1, counter("failure"));
+  EXPECT_EQ(0, invocations_->inFlight());
+}
+
+TEST_F(DetachedInvocationsTest, DoesNotRetryClientErrors) {
+  initialize();
+  respond("403");
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_EQ(0, counter("retry"));
+  EXPECT_EQ(1, counter("failure"));
+}
+
+TEST_F(DetachedInvocationsTest, LimitsTheInvocationsInFlight) {
+  proto_config_.mutable_max_in_flight()->set_value(1);
+  initialize();
+  EXPECT_CALL(cm_.thread_local_cluster_.async_client_, send_(_, _, _))
+      .WillOnce(Return(&request_));
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_FALSE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_EQ(1, counter("overflow"));
+
+  // the invocations in flight are cancelled with the config.
+  EXPECT_CALL(request_, cancel());
+  invocations_.reset();
+}
+
+TEST_F(DetachedInvocationsTest, FailsWithoutTheCluster) {
+  initialize();
+  EXPECT_CALL(cm_, getThreadLocalCluster(_)).WillOnce(Return(nullptr));
+  EXPECT_TRUE(invocations_->invoke("lambda", headers_, nullptr));
+  EXPECT_EQ(1, counter("failure"));
+}
+
+} // namespace
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,94 @@
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
+
+#include "test/extensions/filters/http/aws_lambda/event_stream_test_utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+TEST(EventStreamDecoder, DecodesThePayloadAsItArrives) {
+  const std::string stream =
+      payloadChunk("hello ") +
+      eventStreamMessage({{":message-type", "event"},
+                          {":content-type", "application/octet-stream"},
+                          {":event-type", "PayloadChunk"}},
+                         std::string("wor\0ld", 6)) +
+      invokeComplete();
+
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl payload;
+  // the stream is fed a few bytes at a time, splitting the messages.
+  for (size_t pos = 0; pos < stream.size(); pos += 7) {
+    Buffer::OwnedImpl data(stream.substr(pos, 7));
+    ASSERT_TRUE(decoder.decode(data, payload)) << decoder.error();
+    EXPECT_EQ(0U, data.length());
+  }
+  EXPECT_EQ(std::string("hello wor\0ld", 12), payload.toString());
+  EXPECT_TRUE(decoder.complete());
+}
+
+TEST(EventStreamDecoder, WaitsForWholeMessages) {
+  const std::string chunk = payloadChunk("hello");
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl data(chunk.substr(0, chunk.size() - 1));
+  Buffer::OwnedImpl payload;
+  ASSERT_TRUE(decoder.decode(data, payload));
+  EXPECT_EQ(0U, payload.length());
+
+  data.add(chunk.substr(chunk.size() - 1));
+  ASSERT_TRUE(decoder.decode(data, payload));
+  EXPECT_EQ("hello", payload.toString());
+  EXPECT_FALSE(decoder.complete());
+}
+
+TEST(EventStreamDecoder, FailsOnFunctionErrors) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl data(
+      payloadChunk("partial") +
+      invokeComplete(
+          R"({"ErrorCode": "Unhandled", "ErrorDetails": "boom"})"));
+  Buffer::OwnedImpl payload;
+  EXPECT_FALSE(decoder.decode(data, payload));
+  EXPECT_EQ("Unhandled: boom", decoder.error());
+  EXPECT_EQ("partial", payload.toString());
+}
+
+TEST(EventStreamDecoder, FailsOnExceptions) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl data(eventStreamMessage(
+      {{":message-type", "exception"}, {":exception-type", "ServiceException"}},
+      "unavailable"));
+  Buffer::OwnedImpl payload;
+  EXPECT_FALSE(decoder.decode(data, payload));
+  EXPECT_EQ("ServiceException: unavailable", decoder.error());
+
+  // the stream stays failed.
+  Buffer::OwnedImpl more(payloadChunk("more"));
+  EXPECT_FALSE(decoder.decode(more, payload));
+  EXPECT_EQ(0U, payload.length());
+}
+
+TEST(EventStreamDecoder, FailsOnCorruptMessages) {
+  std::string chunk = payloadChunk("hello");
+  chunk[chunk.size() - 6] ^= 1;
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl data(chunk);
+  Buffer::OwnedImpl payload;
+  EXPECT_FALSE(decoder.decode(data, payload));
+  EXPECT_EQ("message crc mismatch", decoder.error());
+
+  // a corrupt prelude fails without waiting for the rest of the message.
+  std::string prelude = payloadChunk("hello").substr(0, 12);
+  prelude[1] ^= 1;
+  EventStreamDecoder prelude_decoder;
+  Buffer::OwnedImpl prelude_data(prelude);
+  EXPECT_FALSE(prelude_decoder.decode(prelude_data, payload));
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+// frames the payload as an event stream message with string headers.
+inline std::string eventStreamMessage(
+    const std::vector<std::pair<std::string, std::string>> &headers,
+    const std::string &payload) {
+  const auto be32 = [](uint32_t value) {
+    return std::string{static_cast<char>(value >> 24),
+                       static_cast<char>(value >> 16),
+                       static_cast<char>(value >> 8), static_cast<char>(value)};
+  };
+  const auto crc = [](const std::string &data) {
+    return static_cast<uint32_t>(
+        crc32(0L, reinterpret_cast<const Bytef *>(data.data()), data.size()));
+  };
+
+  std::string encoded_headers;
+  for (const auto &header : headers) {
+    absl::StrAppend(&encoded_headers,
+                    std::string(1, static_cast<char>(header.first.size())),
+                    header.first, std::string(1, 7),
+                    std::string(1, static_cast<char>(header.second.size() >> 8)),
+                    std::string(1, static_cast<char>(header.second.size())),
+                    header.second);
+  }
+  const uint32_t total_length = 16 + encoded_headers.size() + payload.size();
+  std::string message =
+      absl::StrCat(be32(total_length), be32(encoded_headers.size()));
+  absl::StrAppend(&message, be32(crc(message)), encoded_headers, payload);
+  absl::StrAppend(&message, be32(crc(message)));
+  return message;
+}
+
+inline std::string payloadChunk(const std::string &payload) {
+  return eventStreamMessage(
+      {{":message-type", "event"}, {":event-type", "PayloadChunk"}}, payload);
+}
+
+inline std::string invokeComplete(const std::string &result = "{}") {
+  return eventStreamMessage(
+      {{":message-type", "event"}, {":event-type", "InvokeComplete"}}, result);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,71 @@
+#include "source/extensions/filters/http/aws_lambda/region_selector.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+using std::chrono::milliseconds;
+
+class RegionSelectorTest : public testing::Test {
+public:
+  RegionSelector selector_{{{"lambda.us-east-1.amazonaws.com", "us-east-1"},
+                            {"lambda.us-west-2.amazonaws.com", "us-west-2"}}};
+};
+
+TEST_F(RegionSelectorTest, TriesEachRegionOnce) {
+  EXPECT_EQ(0U, selector_.select());
+  selector_.record(0, milliseconds(100), false);
+  EXPECT_EQ(1U, selector_.select());
+  selector_.record(1, milliseconds(50), false);
+  EXPECT_EQ(1U, selector_.select());
+  EXPECT_EQ("us-west-2", selector_.region(1).region_);
+}
+
+TEST_F(RegionSelectorTest, PrefersTheFirstRegionOnTies) {
+  selector_.record(0, milliseconds(20), false);
+  selector_.record(1, milliseconds(20), false);
+  EXPECT_EQ(0U, selector_.select());
+}
+
+TEST_F(RegionSelectorTest, FollowsTheLatency) {
+  selector_.record(0, milliseconds(10), false);
+  selector_.record(1, milliseconds(20), false);
+  EXPECT_EQ(0U, selector_.select());
+  // the average catches up with a region that slowed down.
+  for (int i = 0; i < 10; i++) {
+    selector_.record(0, milliseconds(100), false);
+  }
+  EXPECT_EQ(1U, selector_.select());
+}
+
+TEST_F(RegionSelectorTest, MovesAwayFromErrors) {
+  selector_.record(0, milliseconds(10), false);
+  selector_.record(1, milliseconds(20), false);
+  // a region that fails fast is not the fastest.
+  selector_.record(0, milliseconds(10), true);
+  EXPECT_EQ(1U, selector_.select());
+  for (int i = 0; i < 20; i++) {
+    selector_.record(0, milliseconds(10), false);
+  }
+  EXPECT_EQ(0U, selector_.select());
+}
+
+TEST_F(RegionSelectorTest, ProbesTheRegionsNotChosen) {
+  selector_.record(0, milliseconds(10), false);
+  selector_.record(1, milliseconds(500), false);
+  int probes = 0;
+  for (uint64_t i = 0; i < 2 * RegionSelector::ProbeInterval; i++) {
+    if (selector_.select() == 1) {
+      probes++;
+    }
+  }
+  EXPECT_EQ(1, probes);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,93 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/aws_lambda/response_cache.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/test_common/simulated_time_system.h"
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class ResponseCacheTest : public testing::Test {
+public:
+  ResponseCacheTest() {
+    proto_.mutable_ttl()->set_seconds(10);
+    proto_.add_headers("X-Tenant");
+  }
+
+  std::unique_ptr<ResponseCache> create() {
+    return std::make_unique<ResponseCache>(
+        proto_, time_system_, ResponseCache::generateStats("prefix.", store_));
+  }
+
+  ResponseCacheProto proto_;
+  Event::SimulatedTimeSystem time_system_;
+  Stats::TestUtil::TestStore store_;
+  Http::TestResponseHeaderMapImpl response_headers_{
+      {":status", "200"}, {"content-length", "4"}, {"x-answer", "yes"}};
+  Buffer::OwnedImpl response_body_{"body"};
+};
+
+TEST_F(ResponseCacheTest, KeysOnTheFunctionHeadersAndBody) {
+  auto cache = create();
+  Http::TestRequestHeaderMapImpl headers{{"x-tenant", "a"}, {"x-other", "1"}};
+  Http::TestRequestHeaderMapImpl other_tenant{{"x-tenant", "b"}};
+  Http::TestRequestHeaderMapImpl other_header{{"x-tenant", "a"},
+                                              {"x-other", "2"}};
+  Buffer::OwnedImpl body("{}");
+
+  const std::string key = cache->key("/func", headers, &body);
+  EXPECT_EQ(key, cache->key("/func", other_header, &body));
+  EXPECT_NE(key, cache->key("/other", headers, &body));
+  EXPECT_NE(key, cache->key("/func", other_tenant, &body));
+  EXPECT_NE(key, cache->key("/func", headers, nullptr));
+}
+
+TEST_F(ResponseCacheTest, ServesResponsesUntilTheyExpire) {
+  auto cache = create();
+  EXPECT_EQ(nullptr, cache->lookup("key"));
+  cache->insert("key", response_headers_, response_body_);
+
+  ResponseCache::ResponseConstSharedPtr response = cache->lookup("key");
+  ASSERT_NE(nullptr, response);
+  EXPECT_EQ(200, response->status_);
+  EXPECT_EQ("body", response->body_);
+  // only the headers that aren't derived from the response are kept.
+  ASSERT_EQ(1, response->headers_.size());
+  EXPECT_EQ("x-answer", response->headers_[0].first);
+  EXPECT_EQ(1, store_.counter("prefix.cache_hit").value());
+
+  time_system_.advanceTimeWait(std::chrono::seconds(10));
+  EXPECT_EQ(nullptr, cache->lookup("key"));
+  EXPECT_EQ(2, store_.counter("prefix.cache_miss").value());
+  EXPECT_EQ(0, TestUtility::findGauge(store_, "prefix.cache_entries")->value());
+}
+
+TEST_F(ResponseCacheTest, EvictsTheOldestResponses) {
+  proto_.mutable_max_entries()->set_value(2);
+  auto cache = create();
+  cache->insert("first", response_headers_, response_body_);
+  cache->insert("second", response_headers_, response_body_);
+  cache->insert("third", response_headers_, response_body_);
+
+  EXPECT_EQ(nullptr, cache->lookup("first"));
+  EXPECT_NE(nullptr, cache->lookup("second"));
+  EXPECT_NE(nullptr, cache->lookup("third"));
+  EXPECT_EQ(1, store_.counter("prefix.cache_eviction").value());
+}
+
+TEST_F(ResponseCacheTest, SkipsLargeResponses) {
+  proto_.mutable_max_body_bytes()->set_value(3);
+  auto cache = create();
+  cache->insert("key", response_headers_, response_body_);
+  EXPECT_EQ(nullptr, cache->lookup("key"));
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,127 @@
+#include <unistd.h>
+
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_cache_file.h"
+
+#include "test/test_common/environment.h"
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+namespace {
+
+const SystemTime now(std::chrono::seconds(1700000000));
+
+class StsCredentialsCacheFileTest : public testing::Test {
+public:
+  StsCredentialsCacheFileTest() {
+    config_.set_path(TestEnvironment::temporaryPath("sts_credentials_cache"));
+    config_.set_key_file(
+        TestEnvironment::writeStringToFileForTest("sts_cache_key", "secret"));
+    ::unlink(config_.path().c_str());
+  }
+
+  StsCredentialsConstSharedPtr credentials(std::chrono::seconds lifetime) {
+    return std::make_shared<const StsCredentials>(
+        "access_key", "secret_key", "session_token", now + lifetime);
+  }
+
+  Api::ApiPtr api_{Api::createApiForTest()};
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
+      ServiceAccountCredentials::CredentialsCacheFile config_;
+};
+
+TEST_F(StsCredentialsCacheFileTest, RestoresTheCredentials) {
+  StsCredentialsCacheFile cache(*api_, config_);
+  EXPECT_TRUE(cache.save({{"arn", credentials(std::chrono::hours(1))},
+                          {"no-chain-arn", credentials(std::chrono::hours(2))}},
+                         now));
+
+  // a file written by another process, with the same key.
+  StsCredentialsMap loaded = StsCredentialsCacheFile(*api_, config_)
+                                 .load(now, std::chrono::seconds(30));
+  ASSERT_EQ(2, loaded.size());
+  EXPECT_EQ("access_key", loaded["arn"]->accessKeyId().value());
+  EXPECT_EQ("secret_key", loaded["arn"]->secretAccessKey().value());
+  EXPECT_EQ("session_token", loaded["arn"]->sessionToken().value());
+  EXPECT_EQ(now + std::chrono::hours(1), loaded["arn"]->expirationTime());
+  EXPECT_EQ(now + std::chrono::hours(2),
+            loaded["no-chain-arn"]->expirationTime());
+}
+
+TEST_F(StsCredentialsCacheFileTest, ReplacesTheFileOfAnotherProcess) {
+  // the processes running side by side during a hot restart.
+  StsCredentialsCacheFile parent(*api_, config_);
+  StsCredentialsCacheFile child(*api_, config_);
+  EXPECT_TRUE(parent.save({{"arn", credentials(std::chrono::hours(1))}}, now));
+  EXPECT_TRUE(child.save({{"arn", credentials(std::chrono::hours(2))}}, now));
+  EXPECT_TRUE(parent.save({{"arn", credentials(std::chrono::hours(3))}}, now));
+
+  StsCredentialsMap loaded = child.load(now, std::chrono::seconds(30));
+  ASSERT_EQ(1, loaded.size());
+  EXPECT_EQ(now + std::chrono::hours(3), loaded["arn"]->expirationTime());
+}
+
+TEST_F(StsCredentialsCacheFileTest, DropsTheCredentialsAboutToExpire) {
+  StsCredentialsCacheFile cache(*api_, config_);
+  EXPECT_TRUE(cache.save({{"expired", credentials(-std::chrono::seconds(1))},
+                          {"expiring", credentials(std::chrono::seconds(10))},
+                          {"valid", credentials(std::chrono::hours(1))}},
+                         now));
+
+  StsCredentialsMap loaded = cache.load(now, std::chrono::seconds(30));
+  ASSERT_EQ(1, loaded.size());
+  EXPECT_NE(loaded.end(), loaded.find("valid"));
+}
+
+TEST_F(StsCredentialsCacheFileTest, IgnoresAFileSealedWithAnotherKey) {
+  StsCredentialsCacheFile(*api_, config_)
+      .save({{"arn", credentials(std::chrono::hours(1))}}, now);
+
+  config_.set_key_file(
+      TestEnvironment::writeStringToFileForTest("other_key", "other secret"));
+  EXPECT_TRUE(StsCredentialsCacheFile(*api_, config_)
+                  .load(now, std::chrono::seconds(30))
+                  .empty());
+}
+
+TEST_F(StsCredentialsCacheFileTest, IgnoresACorruptFile) {
+  TestEnvironment::writeStringToFileForTest("sts_credentials_cache",
+                                            "not sealed");
+  EXPECT_TRUE(StsCredentialsCacheFile(*api_, config_)
+                  .load(now, std::chrono::seconds(30))
+                  .empty());
+}
+
+TEST_F(StsCredentialsCacheFileTest, LoadsNothingWithoutAFile) {
+  EXPECT_TRUE(StsCredentialsCacheFile(*api_, config_)
+                  .load(now, std::chrono::seconds(30))
+                  .empty());
+}
+
+TEST_F(StsCredentialsCacheFileTest, RequiresTheKeyFile) {
+  config_.set_key_file(TestEnvironment::temporaryPath("missing_key"));
+  EXPECT_THROW_WITH_MESSAGE(
+      StsCredentialsCacheFile cache(*api_, config_), EnvoyException,
+      fmt::format("Credentials cache key file {} does not exist",
+                  config_.key_file()));
+}
+
+TEST_F(StsCredentialsCacheFileTest, RejectsMalformedPlaintext) {
+  StsCredentialsMap out;
+  EXPECT_FALSE(StsCredentialsCacheFile::parse("2\n", out));
+  EXPECT_FALSE(StsCredentialsCacheFile::parse("1\narn\nkey\n", out));
+  EXPECT_FALSE(StsCredentialsCacheFile::parse(
+      "1\narn\nkey\nsecret\ntoken\nsoon\n", out));
+  EXPECT_TRUE(StsCredentialsCacheFile::parse("1\n", out));
+  EXPECT_TRUE(out.empty());
+}
+
+} // namespace
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
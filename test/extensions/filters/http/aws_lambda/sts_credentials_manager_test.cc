@@ -0,0 +1,207 @@
+#include "source/extensions/filters/http/aws_lambda/sts_credentials_manager.h"
+
+#include "test/extensions/filters/http/aws_lambda/mocks.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+#include "test/test_common/simulated_time_system.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::InvokeWithoutArgs;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class StsCredentialsManagerTest : public testing::Test {
+public:
+  void SetUp() override {
+    // the main thread runs the posts inline
+    ON_CALL(dispatcher_, post(_))
+        .WillByDefault(Invoke([](Event::PostCb cb) { cb(); }));
+    auto provider = std::make_unique<NiceMock<MockStsCredentialsProvider>>();
+    provider_ = provider.get();
+    manager_ = StsCredentialsManager::create(std::move(provider), dispatcher_,
+                                             tls_, time_system_, "base_arn");
+  }
+
+  StsCredentialsConstSharedPtr credentials(std::chrono::seconds lifetime) {
+    return std::make_shared<const StsCredentials>(
+        "access_key", "secret_key", "session_token",
+        time_system_.systemTime() + lifetime);
+  }
+
+  // makes the provider answer asynchronously, saving the callbacks of the
+  // main thread fetch.
+  void expectFetch(const std::string &role_arn) {
+    EXPECT_CALL(*provider_, find(absl::optional<std::string>(role_arn), _, _))
+        .WillOnce(Invoke([this](const absl::optional<std::string> &, bool,
+                                StsConnectionPool::Context::Callbacks *fetch)
+                             -> StsConnectionPool::Context * {
+          fetch_ = fetch;
+          return nullptr;
+        }));
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  NiceMock<MockStsCredentialsProvider> *provider_;
+  StsConnectionPool::Context::Callbacks *fetch_{};
+  StsCredentialsManagerSharedPtr manager_;
+};
+
+TEST_F(StsCredentialsManagerTest, FetchesOnceForAllRequests) {
+  expectFetch("role_arn");
+
+  NiceMock<MockStsContextCallbacks> callbacks_1;
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  EXPECT_NE(nullptr, manager_->find("role_arn", false, &callbacks_1));
+  EXPECT_NE(nullptr, manager_->find("role_arn", false, &callbacks_2));
+
+  EXPECT_CALL(callbacks_1, onSuccess(_));
+  EXPECT_CALL(callbacks_2, onSuccess(_));
+  fetch_->onSuccess(credentials(std::chrono::hours(1)));
+
+  // the published copy is served without asking the main thread
+  NiceMock<MockStsContextCallbacks> callbacks_3;
+  EXPECT_CALL(callbacks_3, onSuccess(_));
+  EXPECT_EQ(nullptr, manager_->find("role_arn", false, &callbacks_3));
+}
+
+TEST_F(StsCredentialsManagerTest, UsesTheDefaultRole) {
+  expectFetch("base_arn");
+
+  NiceMock<MockStsContextCallbacks> callbacks;
+  EXPECT_NE(nullptr, manager_->find(absl::nullopt, false, &callbacks));
+}
+
+TEST_F(StsCredentialsManagerTest, PropagatesFailures) {
+  expectFetch("role_arn");
+
+  NiceMock<MockStsContextCallbacks> callbacks_1;
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  StsConnectionPool::Context *context =
+      manager_->find("role_arn", false, &callbacks_1);
+  EXPECT_NE(nullptr, manager_->find("role_arn", false, &callbacks_2));
+
+  // a cancelled request is not called back
+  context->cancel();
+  EXPECT_CALL(callbacks_1, onFailure(_)).Times(0);
+  EXPECT_CALL(callbacks_2, onFailure(CredentialsFailureStatus::Network));
+  fetch_->onFailure(CredentialsFailureStatus::Network);
+
+  // the next request asks the main thread again
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_3;
+  EXPECT_NE(nullptr, manager_->find("role_arn", false, &callbacks_3));
+}
+
+TEST_F(StsCredentialsManagerTest, ResumesWaitersInBatches) {
+  std::vector<Event::PostCb> posted;
+  ON_CALL(tls_.dispatcher_, post(_))
+      .WillByDefault(
+          Invoke([&posted](Event::PostCb cb) { posted.push_back(cb); }));
+  expectFetch("role_arn");
+
+  std::vector<std::unique_ptr<NiceMock<MockStsContextCallbacks>>> callbacks;
+  for (size_t i = 0; i < RESUME_BATCH_SIZE + 1; i++) {
+    callbacks.push_back(std::make_unique<NiceMock<MockStsContextCallbacks>>());
+    EXPECT_NE(nullptr,
+              manager_->find("role_arn", false, callbacks.back().get()));
+  }
+
+  // the streams past the batch wait for the next iteration of the worker
+  size_t resumed = 0;
+  for (auto &waiter : callbacks) {
+    ON_CALL(*waiter, onSuccess(_))
+        .WillByDefault(InvokeWithoutArgs([&resumed]() { resumed++; }));
+  }
+  fetch_->onSuccess(credentials(std::chrono::hours(1)));
+  EXPECT_EQ(RESUME_BATCH_SIZE, resumed);
+  ASSERT_EQ(1, posted.size());
+  posted[0]();
+  EXPECT_EQ(RESUME_BATCH_SIZE + 1, resumed);
+}
+
+TEST_F(StsCredentialsManagerTest, ReusesCancelledWaiters) {
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_1;
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  StsConnectionPool::Context *context =
+      manager_->find("role_arn", false, &callbacks_1);
+  context->cancel();
+
+  // the waiter of the cancelled stream is handed to the next one
+  EXPECT_EQ(context, manager_->find("role_arn", false, &callbacks_2));
+  EXPECT_EQ(&callbacks_2, context->callbacks());
+  EXPECT_CALL(callbacks_1, onSuccess(_)).Times(0);
+  EXPECT_CALL(callbacks_2, onSuccess(_));
+  fetch_->onSuccess(credentials(std::chrono::hours(1)));
+}
+
+TEST_F(StsCredentialsManagerTest, RefreshesCopiesInTheGracePeriod) {
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_1;
+  manager_->find("role_arn", false, &callbacks_1);
+  fetch_->onSuccess(credentials(std::chrono::minutes(10)));
+
+  // the copy is due for a refresh, but still served while it is refreshed
+  time_system_.advanceTimeWait(std::chrono::minutes(7));
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  EXPECT_CALL(callbacks_2, onSuccess(_));
+  EXPECT_EQ(nullptr, manager_->find("role_arn", false, &callbacks_2));
+
+  // without asking again until the refresh is published
+  NiceMock<MockStsContextCallbacks> callbacks_3;
+  EXPECT_CALL(callbacks_3, onSuccess(_));
+  EXPECT_EQ(nullptr, manager_->find("role_arn", false, &callbacks_3));
+  fetch_->onSuccess(credentials(std::chrono::hours(1)));
+}
+
+TEST_F(StsCredentialsManagerTest, KeepsChainedAndUnchainedRolesApart) {
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_1;
+  manager_->find("role_arn", false, &callbacks_1);
+  fetch_->onSuccess(credentials(std::chrono::hours(1)));
+
+  expectFetch("role_arn");
+  NiceMock<MockStsContextCallbacks> callbacks_2;
+  EXPECT_CALL(callbacks_2, onSuccess(_)).Times(0);
+  EXPECT_NE(nullptr, manager_->find("role_arn", true, &callbacks_2));
+}
+
+TEST_F(StsCredentialsManagerTest, PrefetchesCredentials) {
+  expectFetch("role_arn");
+  manager_->prefetch("role_arn", false);
+  StsConnectionPool::Context::Callbacks *role_fetch = fetch_;
+  expectFetch("base_arn");
+  manager_->prefetch(absl::nullopt, false);
+
+  bool prefetched = false;
+  manager_->whenPrefetched([&prefetched]() { prefetched = true; });
+  role_fetch->onSuccess(credentials(std::chrono::hours(1)));
+  EXPECT_FALSE(prefetched);
+  fetch_->onFailure(CredentialsFailureStatus::Network);
+  EXPECT_TRUE(prefetched);
+
+  // the prefetched credentials were pushed to the workers
+  NiceMock<MockStsContextCallbacks> callbacks;
+  EXPECT_CALL(callbacks, onSuccess(_));
+  EXPECT_EQ(nullptr, manager_->find("role_arn", false, &callbacks));
+
+  bool called = false;
+  manager_->whenPrefetched([&called]() { called = true; });
+  EXPECT_TRUE(called);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
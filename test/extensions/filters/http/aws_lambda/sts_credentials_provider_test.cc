@@ -8,9 +8,11 @@
 
 #include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
 
+#include "test/common/stats/stat_test_utility.h"
 #include "test/extensions/filters/http/aws_lambda/mocks.h"
 #include "test/extensions/filters/http/common/mock.h"
 #include "test/mocks/api/mocks.h"
+#include "test/mocks/event/mocks.h"
 #include "test/mocks/http/mocks.h"
 #include "test/mocks/server/factory_context.h"
 #include "test/mocks/thread_local/mocks.h"
@@ -69,6 +71,9 @@ public:
   testing::NiceMock<MockStsConnectionPoolFactory> *sts_connection_pool_factory_;
   testing::NiceMock<MockStsConnectionPool> *sts_connection_pool_;
   testing::NiceMock<MockStsConnectionPool> *sts_chained_connection_pool_;
+  Stats::TestUtil::TestStore stats_store_;
+  StsCredentialsProviderStats stats_{
+      StsCredentialsProvider::generateStats("prefix.", stats_store_)};
 };
 
 TEST_F(StsCredentialsProviderTest, TestFullFlow) {
@@ -79,7 +84,8 @@ TEST_F(StsCredentialsProviderTest, TestFullFlow) {
       sts_connection_pool_factory_};
   auto sts_provider = StsCredentialsProvider::create(
       config_, mock_factory_ctx_.api_, mock_factory_ctx_.cluster_manager_,
-      std::move(factory_), token, role_arn);
+      mock_factory_ctx_.dispatcher_, stats_, std::move(factory_), token,
+      role_arn);
   testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_1;
 
   std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_pool{
@@ -162,7 +168,8 @@ TEST_F(StsCredentialsProviderTest, TestFullChainedFlow) {
       sts_connection_pool_factory_};
   auto sts_provider = StsCredentialsProvider::create(
       config_, mock_factory_ctx_.api_, mock_factory_ctx_.cluster_manager_,
-      std::move(factory_), token, base_role_arn);
+      mock_factory_ctx_.dispatcher_, stats_, std::move(factory_), token,
+      base_role_arn);
   testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_1;
 
   std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_pool{
@@ -238,6 +245,65 @@ TEST_F(StsCredentialsProviderTest, TestFullChainedFlow) {
   sts_provider->find(role_arn, false, &ctx_callbacks_4);
 }
 
+TEST_F(StsCredentialsProviderTest, ChainsOnBaseTokenBeingRefreshed) {
+  std::string base_role_arn = "test_arn";
+  std::string role_arn = "test_arn_chained";
+  std::string token = "test_token";
+  std::unique_ptr<testing::NiceMock<MockStsConnectionPoolFactory>> factory_{
+      sts_connection_pool_factory_};
+  auto sts_provider = StsCredentialsProvider::create(
+      config_, mock_factory_ctx_.api_, mock_factory_ctx_.cluster_manager_,
+      mock_factory_ctx_.dispatcher_, stats_, std::move(factory_), token,
+      base_role_arn);
+
+  std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_pool{
+      sts_connection_pool_};
+  std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_chained_pool{
+      sts_chained_connection_pool_};
+  StsConnectionPool::Callbacks *credentials_provider_callbacks;
+  EXPECT_CALL(*sts_connection_pool_factory_, build(_, _, _, _))
+      .WillOnce(Invoke([&](const absl::string_view, const absl::string_view,
+                           StsConnectionPool::Callbacks *callbacks,
+                           StsFetcherPtr) -> StsConnectionPoolPtr {
+        credentials_provider_callbacks = callbacks;
+        return std::move(unique_pool);
+      }))
+      .WillOnce(Invoke([&](const absl::string_view, const absl::string_view,
+                           StsConnectionPool::Callbacks *,
+                           StsFetcherPtr) -> StsConnectionPoolPtr {
+        return std::move(unique_chained_pool);
+      }));
+
+  // the base token is about to expire
+  EXPECT_CALL(*sts_connection_pool_, init(_, token, _));
+  testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_1;
+  sts_provider->find(base_role_arn, false, &ctx_callbacks_1);
+  auto base_credentials = std::make_shared<const StsCredentials>(
+      "access_key", "secret_key", "session_token",
+      simTime().systemTime() + std::chrono::minutes(3));
+  std::list<std::string> to_chain;
+  credentials_provider_callbacks->onResult(base_credentials, base_role_arn,
+                                           to_chain);
+
+  // the chained role is assumed with it right away, while it is refreshed
+  EXPECT_CALL(*sts_connection_pool_, init(_, token, _));
+  EXPECT_CALL(*sts_connection_pool_, addChained(_)).Times(0);
+  EXPECT_CALL(*sts_chained_connection_pool_,
+              init(_, _, StsCredentialsConstSharedPtr(base_credentials)));
+  EXPECT_CALL(*sts_chained_connection_pool_, setInFlight()).Times(0);
+  testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_2;
+  sts_provider->find(role_arn, false, &ctx_callbacks_2);
+
+  // which happens once for all the chained roles
+  EXPECT_CALL(*sts_connection_pool_, requestInFlight())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*sts_connection_pool_, init(_, _, _)).Times(0);
+  EXPECT_CALL(*sts_chained_connection_pool_, requestInFlight())
+      .WillOnce(Return(false));
+  EXPECT_CALL(*sts_chained_connection_pool_, init(_, _, _));
+  sts_provider->find(role_arn, false, &ctx_callbacks_2);
+}
+
 TEST_F(StsCredentialsProviderTest, TestUnchainedFlow) {
   // Setup
   std::string role_arn = "test_arn";
@@ -247,7 +313,8 @@ TEST_F(StsCredentialsProviderTest, TestUnchainedFlow) {
       sts_connection_pool_factory_};
   auto sts_provider = StsCredentialsProvider::create(
       config_, mock_factory_ctx_.api_, mock_factory_ctx_.cluster_manager_,
-      std::move(factory_), token, role_arn);
+      mock_factory_ctx_.dispatcher_, stats_, std::move(factory_), token,
+      role_arn);
   testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_1;
 
   std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_pool{
@@ -304,6 +371,69 @@ TEST_F(StsCredentialsProviderTest, TestUnchainedFlow) {
   sts_provider->find(role_arn, true, &ctx_callbacks_3);
 }
 
+TEST_F(StsCredentialsProviderTest, RefreshesAheadOfExpiry) {
+  std::string role_arn = "test_arn";
+  std::string token = "test_token";
+  std::unique_ptr<testing::NiceMock<MockStsConnectionPoolFactory>> factory_{
+      sts_connection_pool_factory_};
+  auto sts_provider = StsCredentialsProvider::create(
+      config_, mock_factory_ctx_.api_, mock_factory_ctx_.cluster_manager_,
+      mock_factory_ctx_.dispatcher_, stats_, std::move(factory_), token,
+      role_arn);
+
+  std::unique_ptr<testing::NiceMock<MockStsConnectionPool>> unique_pool{
+      sts_connection_pool_};
+  StsConnectionPool::Callbacks *credentials_provider_callbacks;
+  EXPECT_CALL(*sts_connection_pool_factory_, build(_, _, _, _))
+      .WillOnce(Invoke([&](const absl::string_view,
+                           const absl::string_view,
+                           StsConnectionPool::Callbacks *callbacks,
+                           StsFetcherPtr) -> StsConnectionPoolPtr {
+        credentials_provider_callbacks = callbacks;
+        return std::move(unique_pool);
+      }));
+  EXPECT_CALL(*sts_connection_pool_, init(_, _, _));
+  testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_1;
+  sts_provider->find(role_arn, false, &ctx_callbacks_1);
+  EXPECT_EQ(1UL,
+            stats_store_.counterFromString("prefix.sts_cache_miss").value());
+
+  // the refresh is scheduled before the grace period, minus the jitter
+  auto *refresh_timer =
+      new testing::NiceMock<Event::MockTimer>(&mock_factory_ctx_.dispatcher_);
+  EXPECT_CALL(*refresh_timer,
+              enableTimer(std::chrono::milliseconds(
+                              std::chrono::minutes(55)),
+                          _));
+  auto credentials = std::make_shared<const StsCredentials>(
+      "access_key", "secret_key", "session_token",
+      simTime().systemTime() + std::chrono::hours(1));
+  std::list<std::string> to_chain;
+  credentials_provider_callbacks->onResult(credentials, role_arn, to_chain);
+
+  testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_2;
+  EXPECT_CALL(ctx_callbacks_2, onSuccess(_));
+  EXPECT_EQ(nullptr, sts_provider->find(role_arn, false, &ctx_callbacks_2));
+  EXPECT_EQ(1UL,
+            stats_store_.counterFromString("prefix.sts_cache_hit").value());
+
+  // the timer fetches new credentials without a request waiting on them
+  EXPECT_CALL(*sts_connection_pool_, init(_, token, _));
+  EXPECT_CALL(*sts_connection_pool_, add(_)).Times(0);
+  refresh_timer->invokeCallback();
+  EXPECT_EQ(1UL,
+            stats_store_.counterFromString("prefix.sts_refresh_ahead").value());
+
+  // credentials in the grace period are served while they are refreshed
+  simTime().advanceTimeWait(std::chrono::minutes(57));
+  EXPECT_CALL(*sts_connection_pool_, requestInFlight()).WillOnce(Return(true));
+  testing::NiceMock<MockStsContextCallbacks> ctx_callbacks_3;
+  EXPECT_CALL(ctx_callbacks_3, onSuccess(_));
+  EXPECT_EQ(nullptr, sts_provider->find(role_arn, false, &ctx_callbacks_3));
+  EXPECT_EQ(2UL,
+            stats_store_.counterFromString("prefix.sts_cache_hit").value());
+}
+
 } // namespace AwsLambda
 } // namespace HttpFilters
 } // namespace Extensions
@@ -8,6 +8,7 @@
 
 #include "source/extensions/filters/http/aws_lambda/sts_fetcher.h"
 
+#include "test/common/stats/stat_test_utility.h"
 #include "test/extensions/filters/http/aws_lambda/mocks.h"
 #include "test/mocks/server/factory_context.h"
 #include "test/test_common/utility.h"
@@ -203,6 +204,93 @@ TEST_F(StsFetcherTest, TestCancel) {
   fetcher->cancel();
 }
 
+TEST_F(StsFetcherTest, QueuesFetchesBeyondTheLimit) {
+  Stats::TestUtil::TestStore store;
+  Stats::Gauge &queued =
+      store.gauge("sts_fetches_queued", Stats::Gauge::ImportMode::Accumulate);
+  StsFetchQueue queue(1,
+                      store.histogram("sts_fetch_time",
+                                      Stats::Histogram::Unit::Milliseconds),
+                      queued, mock_factory_ctx_.api_.timeSource());
+
+  // the requests are answered once the test calls them back.
+  std::vector<Http::AsyncClient::Callbacks *> sent;
+  Http::MockAsyncClientRequest request(
+      &(mock_factory_ctx_.cluster_manager_.thread_local_cluster_.async_client_));
+  ON_CALL(mock_factory_ctx_.cluster_manager_.thread_local_cluster_.async_client_,
+          send_(_, _, _))
+      .WillByDefault(
+          Invoke([&sent, &request](Http::RequestMessagePtr &,
+                                   Http::AsyncClient::Callbacks &callbacks,
+                                   const Http::AsyncClient::RequestOptions &)
+                     -> Http::AsyncClient::Request * {
+            sent.push_back(&callbacks);
+            return &request;
+          }));
+
+  std::unique_ptr<StsFetcher> fetcher_1(StsFetcher::create(
+      mock_factory_ctx_.cluster_manager_, mock_factory_ctx_.api_, &queue));
+  std::unique_ptr<StsFetcher> fetcher_2(StsFetcher::create(
+      mock_factory_ctx_.cluster_manager_, mock_factory_ctx_.api_, &queue));
+  std::unique_ptr<StsFetcher> fetcher_3(StsFetcher::create(
+      mock_factory_ctx_.cluster_manager_, mock_factory_ctx_.api_, &queue));
+  testing::NiceMock<MockStsFetcherCallbacks> callbacks_1;
+  testing::NiceMock<MockStsFetcherCallbacks> callbacks_2;
+  testing::NiceMock<MockStsFetcherCallbacks> callbacks_3;
+
+  fetcher_1->fetch(uri_, role_arn, web_token, NULL, &callbacks_1);
+  fetcher_2->fetch(uri_, role_arn, web_token, NULL, &callbacks_2);
+  fetcher_3->fetch(uri_, role_arn, web_token, NULL, &callbacks_3);
+  EXPECT_EQ(1, sent.size());
+  EXPECT_EQ(2, queued.value());
+
+  // a queued fetch that is cancelled is never sent.
+  fetcher_2->cancel();
+  EXPECT_EQ(1, queued.value());
+
+  Http::ResponseMessagePtr response(new Http::ResponseMessageImpl(
+      Http::ResponseHeaderMapPtr{new Http::TestResponseHeaderMapImpl{
+          {":status", "200"}}}));
+  response->body().add(valid_response);
+  EXPECT_CALL(callbacks_1, onSuccess(valid_response));
+  sent[0]->onSuccess(request, std::move(response));
+  EXPECT_EQ(1, store.histogramValues("sts_fetch_time", false).size());
+
+  // completing the first one sent the next queued fetch.
+  EXPECT_EQ(2, sent.size());
+  EXPECT_EQ(0, queued.value());
+  EXPECT_CALL(callbacks_3, onFailure(CredentialsFailureStatus::Network));
+  sent[1]->onFailure(request, Http::AsyncClient::FailureReason::Reset);
+}
+
+TEST_F(StsFetcherTest, SendsEverythingWithoutALimit) {
+  Stats::TestUtil::TestStore store;
+  Stats::Gauge &queued =
+      store.gauge("sts_fetches_queued", Stats::Gauge::ImportMode::Accumulate);
+  StsFetchQueue queue(0,
+                      store.histogram("sts_fetch_time",
+                                      Stats::Histogram::Unit::Milliseconds),
+                      queued, mock_factory_ctx_.api_.timeSource());
+  Http::MockAsyncClientRequest request(
+      &(mock_factory_ctx_.cluster_manager_.thread_local_cluster_.async_client_));
+  MockUpstream mock_sts(mock_factory_ctx_.cluster_manager_, &request);
+  EXPECT_CALL(mock_factory_ctx_.cluster_manager_.thread_local_cluster_
+                  .async_client_,
+              send_(_, _, _))
+      .Times(2);
+
+  std::unique_ptr<StsFetcher> fetcher_1(StsFetcher::create(
+      mock_factory_ctx_.cluster_manager_, mock_factory_ctx_.api_, &queue));
+  std::unique_ptr<StsFetcher> fetcher_2(StsFetcher::create(
+      mock_factory_ctx_.cluster_manager_, mock_factory_ctx_.api_, &queue));
+  testing::NiceMock<MockStsFetcherCallbacks> callbacks;
+  fetcher_1->fetch(uri_, role_arn, web_token, NULL, &callbacks);
+  fetcher_2->fetch(uri_, to_chain_role_arn, web_token, NULL, &callbacks);
+  EXPECT_EQ(0, queued.value());
+
+  EXPECT_CALL(request, cancel()).Times(2);
+}
+
 } // namespace
 } // namespace AwsLambda
 } // namespace HttpFilters
@@ -0,0 +1,66 @@
+#include "source/extensions/filters/http/aws_lambda/sts_response_parser.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+TEST(StsResponseParser, ExtractsTheCredentials) {
+  const std::string body = R"(
+<AssumeRoleWithWebIdentityResponse xmlns="https://sts.amazonaws.com/doc/2011-06-15/">
+  <AssumeRoleWithWebIdentityResult>
+    <SubjectFromWebIdentityToken>subject</SubjectFromWebIdentityToken>
+    <Credentials>
+      <SessionToken>some/session+token=</SessionToken>
+      <SecretAccessKey>some_secret_key</SecretAccessKey>
+      <Expiration>2100-07-28T21:20:25Z</Expiration>
+      <AccessKeyId>some_access_key</AccessKeyId>
+    </Credentials>
+  </AssumeRoleWithWebIdentityResult>
+</AssumeRoleWithWebIdentityResponse>
+)";
+
+  StsResponseFields fields;
+  ASSERT_TRUE(StsResponseParser::parse(body, fields));
+  EXPECT_EQ("some_access_key", fields.access_key);
+  EXPECT_EQ("some_secret_key", fields.secret_key);
+  EXPECT_EQ("some/session+token=", fields.session_token);
+  EXPECT_EQ("2100-07-28T21:20:25Z", fields.expiration);
+}
+
+TEST(StsResponseParser, UsesTheFirstElements) {
+  const std::string body =
+      "<AccessKeyId>first</AccessKeyId><AccessKeyId>second</AccessKeyId>"
+      "<SecretAccessKey></SecretAccessKey><SessionToken>token</SessionToken>"
+      "<Expiration>expiration</Expiration>";
+
+  StsResponseFields fields;
+  ASSERT_TRUE(StsResponseParser::parse(body, fields));
+  EXPECT_EQ("first", fields.access_key);
+  EXPECT_EQ("", fields.secret_key);
+}
+
+TEST(StsResponseParser, FailsOnMissingElements) {
+  StsResponseFields fields;
+  EXPECT_FALSE(StsResponseParser::parse("", fields));
+  EXPECT_FALSE(StsResponseParser::parse(
+      "<AccessKeyId>key</AccessKeyId><SecretAccessKey>secret</SecretAccessKey>"
+      "<SessionToken>token</SessionToken>",
+      fields));
+  // elements that aren't closed right away hold no value
+  EXPECT_FALSE(StsResponseParser::parse(
+      "<AccessKeyId>key</AccessKeyId><SecretAccessKey>secret</SecretAccessKey>"
+      "<SessionToken>token</SessionToken><Expiration><a></a></Expiration>",
+      fields));
+  EXPECT_FALSE(StsResponseParser::parse(
+      "<AccessKeyId>key</AccessKeyId><SecretAccessKey>secret</SecretAccessKey>"
+      "<SessionToken>token</SessionToken><Expiration>date",
+      fields));
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,3 +1,4 @@
+#include "source/common/buffer/buffer_utility.h"
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 #include "test/extensions/filters/http/aws_lambda/api_gateway_test_transformer.pb.h"
 
@@ -11,25 +12,60 @@ using FakeTransformerProto = envoy::test::extensions::transformation::ApiGateway
 
 class FakeTransformer : public HttpFilters::Transformation::Transformer {
 public:
-  bool passthrough_body() const override {return false;}
+  explicit FakeTransformer(std::string body = "test body from fake transformer",
+                           bool passthrough = false)
+      : body_(std::move(body)), passthrough_(passthrough) {}
+
+  bool passthrough_body() const override {return passthrough_;}
   // This transformer just drains the body and replaces it with a hardcoded string.
   void transform (Http::RequestOrResponseHeaderMap &,
                          Http::RequestHeaderMap *,
                          Buffer::Instance &body,
                          Http::StreamFilterCallbacks &) const override {
+                            if (passthrough_) {
+                              return;
+                            }
                             body.drain(body.length());
-                            body.add("test body from fake transformer");
+                            body.add(body_);
+  }
+  // writes the body in small pieces through a stream the observer tees, the
+  // way a rendered template is written.
+  void transformObserved(Http::RequestOrResponseHeaderMap &map,
+                         Http::RequestHeaderMap *request_headers,
+                         Buffer::Instance &body,
+                         Http::StreamFilterCallbacks &callbacks,
+                         const BodyObserver &observer) const override {
+    if (passthrough_) {
+      Transformer::transformObserved(map, request_headers, body, callbacks,
+                                     observer);
+      return;
+    }
+    body.drain(body.length());
+    Buffer::BufferOutputStream stream(body, &observer);
+    for (size_t i = 0; i < body_.size(); i += 100) {
+      stream << absl::string_view(body_).substr(i, 100);
+    }
   }
 
+private:
+  const std::string body_;
+  const bool passthrough_;
 };
 
 class FakeTransformerFactory : public TransformerExtensionFactory {
 public:
   std::string name() const override {return "io.solo.transformer.api_gateway_test_transformer";}
 
-  TransformerConstSharedPtr createTransformer(const Protobuf::Message &,
+  TransformerConstSharedPtr createTransformer(const Protobuf::Message &config,
   Server::Configuration::CommonFactoryContext &) override {
-    return std::make_shared<FakeTransformer>();
+    const auto &proto = dynamic_cast<const FakeTransformerProto &>(config);
+    if (proto.passthrough()) {
+      return std::make_shared<FakeTransformer>("", true);
+    }
+    if (proto.body().empty()) {
+      return std::make_shared<FakeTransformer>();
+    }
+    return std::make_shared<FakeTransformer>(proto.body());
   }
 
   ProtobufTypes::MessagePtr createEmptyConfigProto() override {
@@ -0,0 +1,61 @@
+#include "source/common/memory/stats.h"
+#include "source/extensions/filters/http/nats/streaming/nats_streaming_route_specific_filter_config.h"
+
+#include "benchmark/benchmark.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+// as many route configs as routes, each of them for its own subject.
+static void BM_RouteConfigs(benchmark::State &state) {
+  std::vector<envoy::config::filter::http::nats::streaming::v2::
+                  NatsStreamingPerRoute>
+      protos(state.range(0));
+  for (int route = 0; route < state.range(0); route++) {
+    protos[route].set_subject(fmt::format("subject-{}", route));
+    protos[route].set_cluster_id("cluster-id");
+    protos[route].set_discover_prefix("_STAN.discover");
+    protos[route].add_exclude_headers("cookie");
+    protos[route].add_exclude_headers("authorization");
+  }
+
+  uint64_t allocated_before = 0;
+  uint64_t allocated_after = 0;
+  std::vector<std::shared_ptr<NatsStreamingRouteSpecificFilterConfig>> configs;
+  configs.reserve(protos.size());
+  for (auto _ : state) {
+    allocated_before = Memory::Stats::totalCurrentlyAllocated();
+    for (const auto &proto : protos) {
+      configs.push_back(
+          std::make_shared<NatsStreamingRouteSpecificFilterConfig>(proto));
+    }
+    state.PauseTiming();
+    allocated_after = Memory::Stats::totalCurrentlyAllocated();
+    configs.clear();
+    state.ResumeTiming();
+  }
+  state.counters["routes_per_second"] = benchmark::Counter(
+      state.range(0), benchmark::Counter::kIsIterationInvariantRate);
+  // only known when built with tcmalloc.
+  state.counters["bytes_per_route"] =
+      (static_cast<double>(allocated_after) - allocated_before) /
+      state.range(0);
+}
+BENCHMARK(BM_RouteConfigs)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
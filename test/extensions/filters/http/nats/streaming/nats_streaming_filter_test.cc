@@ -10,8 +10,10 @@
 #include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "zstd.h"
 
 using testing::_;
+using testing::Invoke;
 using testing::NiceMock;
 using testing::Ref;
 using testing::Return;
@@ -22,6 +24,21 @@ namespace HttpFilters {
 namespace Nats {
 namespace Streaming {
 
+namespace {
+
+std::string decompress(const std::string &frame) {
+  const unsigned long long size =
+      ZSTD_getFrameContentSize(frame.data(), frame.size());
+  EXPECT_NE(ZSTD_CONTENTSIZE_UNKNOWN, size);
+  EXPECT_NE(ZSTD_CONTENTSIZE_ERROR, size);
+  std::string out(size, '\0');
+  EXPECT_EQ(size, ZSTD_decompress(out.data(), out.size(), frame.data(),
+                                  frame.size()));
+  return out;
+}
+
+} // namespace
+
 class NatsStreamingFilterTest : public testing::Test {
 public:
   NatsStreamingFilterTest() {}
@@ -37,10 +54,17 @@ protected:
     factory_context_.cluster_manager_.initializeThreadLocalClusters({"cluster"});
 
     config_.reset(new NatsStreamingFilterConfig(
-        proto_config, factory_context_.clusterManager()));
+        proto_config, factory_context_.clusterManager(), "prefix.",
+        factory_context_.scope()));
     nats_streaming_client_.reset(
         new NiceMock<Envoy::Nats::Streaming::MockClient>);
-    filter_.reset(new NatsStreamingFilter(config_, nats_streaming_client_));
+    jet_stream_client_.reset(new NiceMock<Envoy::Nats::Streaming::MockClient>);
+    core_client_.reset(new NiceMock<Envoy::Nats::Streaming::MockClient>);
+    request_reply_client_.reset(
+        new NiceMock<Envoy::Nats::Streaming::MockClient>);
+    filter_.reset(new NatsStreamingFilter(config_, nats_streaming_client_,
+                                          jet_stream_client_, core_client_,
+                                          request_reply_client_));
     filter_->setDecoderFilterCallbacks(callbacks_);
   }
 
@@ -56,10 +80,14 @@ protected:
   NatsStreamingFilterConfigSharedPtr config_;
   std::shared_ptr<NiceMock<Envoy::Nats::Streaming::MockClient>>
       nats_streaming_client_;
+  std::shared_ptr<NiceMock<Envoy::Nats::Streaming::MockClient>>
+      jet_stream_client_;
+  std::shared_ptr<NiceMock<Envoy::Nats::Streaming::MockClient>> core_client_;
+  std::shared_ptr<NiceMock<Envoy::Nats::Streaming::MockClient>>
+      request_reply_client_;
   std::unique_ptr<NatsStreamingFilter> filter_;
   NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
 
-private:
   envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute
   perRouteProtoConfig(const std::string &subject, const std::string &clusterId,
                       const std::string &discoverPrefix) {
@@ -257,6 +285,424 @@ TEST_F(NatsStreamingFilterTest, RequestWithTrailers) {
   EXPECT_EQ("hello world", actual_payload.body());
 }
 
+TEST_F(NatsStreamingFilterTest, RequestWithIncludedHeaders) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.add_include_headers("Some-Header");
+  proto_config.add_include_headers("missing-header");
+  proto_config.add_include_headers("cookie");
+  proto_config.add_exclude_headers("cookie");
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"},
+                                         {"other-header", "b"},
+                                         {"cookie", "c"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_EQ(1, actual_payload.headers().size());
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestWithExcludedHeaders) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.add_exclude_headers("Cookie");
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"},
+                                         {"cookie", "c"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_EQ(1, actual_payload.headers().size());
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestInChunks) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_chunk_size(4);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  std::vector<pb::Payload> chunks;
+  EXPECT_CALL(*nats_streaming_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _, _))
+      .Times(3)
+      .WillRepeatedly(
+          Invoke([&chunks](const std::string &, const std::string &,
+                           const std::string &, const std::string &payload,
+                           Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+                     -> Envoy::Nats::Streaming::PublishRequestPtr {
+            chunks.emplace_back();
+            EXPECT_TRUE(chunks.back().ParseFromString(payload));
+            callbacks.onResponse();
+            return nullptr;
+          }));
+  // the request is answered once, when the last chunk was acked.
+  EXPECT_CALL(callbacks_, sendLocalReply(Http::Code::OK, "", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"},
+                                         {"x-request-id", "id"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  Buffer::OwnedImpl data1("hello wo");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data1, false));
+  EXPECT_EQ(1U, chunks.size());
+
+  Buffer::OwnedImpl data2("rld");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data2, true));
+
+  ASSERT_EQ(3U, chunks.size());
+  EXPECT_EQ("a", chunks[0].headers().at("some-header"));
+  EXPECT_TRUE(chunks[1].headers().empty());
+  EXPECT_EQ("hell", chunks[0].body());
+  EXPECT_EQ("o wo", chunks[1].body());
+  EXPECT_EQ("rld", chunks[2].body());
+  for (uint64_t i = 0; i < chunks.size(); i++) {
+    EXPECT_EQ("id", chunks[i].correlation_id());
+    EXPECT_EQ(i, chunks[i].sequence());
+    EXPECT_EQ(i == 2, chunks[i].last());
+  }
+}
+
+TEST_F(NatsStreamingFilterTest, RequestInChunksFailure) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_chunk_size(4);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  EXPECT_CALL(*nats_streaming_client_, makeRequest_(_, _, _, _, _))
+      .WillOnce(Invoke([](const std::string &, const std::string &,
+                          const std::string &, const std::string &,
+                          Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+                           -> Envoy::Nats::Streaming::PublishRequestPtr {
+        callbacks.onFailure();
+        return nullptr;
+      }));
+  EXPECT_CALL(callbacks_,
+              sendLocalReply(Http::Code::InternalServerError,
+                             "nats streaming filter abort", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  // the rest of the body isn't published once a chunk failed.
+  Buffer::OwnedImpl data1("hello wo");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data1, false));
+  Buffer::OwnedImpl data2("rld");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data2, true));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestWithoutAck) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_ack_mode(envoy::config::filter::http::nats::streaming::v2::
+                                NatsStreamingPerRoute::NONE);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Envoy::Nats::Streaming::PublishCallbacks *publish_callbacks{};
+  EXPECT_CALL(*nats_streaming_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _, _))
+      .WillOnce(Invoke(
+          [&publish_callbacks](
+              const std::string &, const std::string &, const std::string &,
+              const std::string &,
+              Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+              -> Envoy::Nats::Streaming::PublishRequestPtr {
+            publish_callbacks = &callbacks;
+            return std::make_unique<
+                NiceMock<Envoy::Nats::Streaming::MockPublishRequest>>();
+          }));
+  // the request is answered before the ack.
+  EXPECT_CALL(callbacks_, sendLocalReply(Http::Code::OK, "", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+  filter_->onDestroy();
+
+  // the failure is counted once the request is gone.
+  ASSERT_NE(nullptr, publish_callbacks);
+  publish_callbacks->onFailure();
+  EXPECT_EQ(1U, factory_context_.scope()
+                    .counterFromString(
+                        "prefix.nats_streaming.unacked_publish_failure")
+                    .value());
+}
+
+TEST_F(NatsStreamingFilterTest, JetStreamRequest) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_protocol(envoy::config::filter::http::nats::streaming::v2::
+                                NatsStreamingPerRoute::JETSTREAM);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  EXPECT_CALL(*nats_streaming_client_, makeRequest_(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*jet_stream_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _,
+                           Ref(*filter_)));
+  EXPECT_CALL(callbacks_, sendLocalReply(Http::Code::OK, "", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(jet_stream_client_->last_payload_));
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+}
+
+TEST_F(NatsStreamingFilterTest, CoreRequest) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_protocol(envoy::config::filter::http::nats::streaming::v2::
+                                NatsStreamingPerRoute::CORE);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  EXPECT_CALL(*nats_streaming_client_, makeRequest_(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*jet_stream_client_, makeRequest_(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*core_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _,
+                           Ref(*filter_)));
+  EXPECT_CALL(callbacks_, sendLocalReply(Http::Code::OK, "", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestReplyRequest) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_protocol(envoy::config::filter::http::nats::streaming::v2::
+                                NatsStreamingPerRoute::REQUEST_REPLY);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Envoy::Nats::Streaming::PublishCallbacks *request_callbacks{};
+  EXPECT_CALL(*core_client_, makeRequest_(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*request_reply_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _,
+                           Ref(*filter_)))
+      .WillOnce(Invoke([&request_callbacks](
+                           const std::string &, const std::string &,
+                           const std::string &, const std::string &,
+                           Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+                           -> Envoy::Nats::Streaming::PublishRequestPtr {
+        request_callbacks = &callbacks;
+        return std::make_unique<
+            NiceMock<Envoy::Nats::Streaming::MockPublishRequest>>();
+      }));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+  ASSERT_NE(nullptr, request_callbacks);
+
+  // the reply is the body of the response.
+  EXPECT_CALL(callbacks_, sendLocalReply(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(callbacks_, encodeHeaders_(_, false))
+      .WillOnce(Invoke([](Http::ResponseHeaderMap &headers, bool) {
+        EXPECT_EQ("200", headers.getStatusValue());
+        EXPECT_EQ("5", headers.getContentLengthValue());
+      }));
+  EXPECT_CALL(callbacks_, encodeData(_, true))
+      .WillOnce(Invoke([](Buffer::Instance &data, bool) {
+        EXPECT_EQ("reply", data.toString());
+      }));
+  request_callbacks->onReply(std::make_unique<Buffer::OwnedImpl>("reply"));
+
+  // a timeout after the reply is of no consequence.
+  request_callbacks->onTimeout();
+}
+
+TEST_F(NatsStreamingFilterTest, RequestReplyRouteCantPublishInChunks) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_protocol(envoy::config::filter::http::nats::streaming::v2::
+                                NatsStreamingPerRoute::REQUEST_REPLY);
+  proto_config.set_chunk_size(16);
+  EXPECT_THROW_WITH_MESSAGE(
+      NatsStreamingRouteSpecificFilterConfig config(proto_config),
+      EnvoyException,
+      "nats-streaming filter: a REQUEST_REPLY route can't set chunk_size or "
+      "the NONE ack_mode");
+}
+
+TEST_F(NatsStreamingFilterTest, RequestOverflow) {
+  EXPECT_CALL(*nats_streaming_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _,
+                           Ref(*filter_)))
+      .WillOnce(Invoke([](const std::string &, const std::string &,
+                          const std::string &, const std::string &,
+                          Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+                           -> Envoy::Nats::Streaming::PublishRequestPtr {
+        callbacks.onOverflow();
+        return nullptr;
+      }));
+
+  const auto &&config =
+      routeSpecificFilterConfig("Subject1", "cluster_id", "discover_prefix1");
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  EXPECT_CALL(callbacks_.stream_info_,
+              setResponseFlag(StreamInfo::ResponseFlag::UpstreamOverflow));
+  EXPECT_CALL(callbacks_,
+              sendLocalReply(Http::Code::ServiceUnavailable,
+                             "nats streaming filter overflow", _, _, _));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestOverBufferLimit) {
+  EXPECT_CALL(*nats_streaming_client_, makeRequest_(_, _, _, _, _)).Times(0);
+
+  const auto &&config =
+      routeSpecificFilterConfig("Subject1", "cluster_id", "discover_prefix1");
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+  ON_CALL(callbacks_, decoderBufferLimit()).WillByDefault(Return(8));
+  filter_->setDecoderFilterCallbacks(callbacks_);
+
+  // the body is rejected before any of it is buffered.
+  EXPECT_CALL(callbacks_,
+              sendLocalReply(Http::Code::PayloadTooLarge,
+                             "nats streaming paylaod too large", _, _, _));
+  Http::TestRequestHeaderMapImpl headers{{"content-length", "9"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+}
+
+TEST_F(NatsStreamingFilterTest, RequestWithCompressedBody) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.mutable_compression()->set_min_body_size(8);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  const std::string body(1000, 'a');
+  Buffer::OwnedImpl data1(body.substr(0, 500));
+  filter_->decodeData(data1, false);
+  Buffer::OwnedImpl data2(body.substr(500));
+  filter_->decodeData(data2, true);
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+  EXPECT_EQ("zstd", actual_payload.headers().at("x-nats-body-encoding"));
+  EXPECT_GT(body.size(), actual_payload.body().size());
+  EXPECT_EQ(body, decompress(actual_payload.body()));
+
+  Stats::Scope &scope = factory_context_.scope();
+  EXPECT_EQ(1U,
+            scope.counterFromString("prefix.nats_streaming.compressed_bodies")
+                .value());
+  EXPECT_EQ(1000U,
+            scope.counterFromString(
+                     "prefix.nats_streaming.compression_input_bytes")
+                .value());
+  EXPECT_EQ(actual_payload.body().size(),
+            scope.counterFromString(
+                     "prefix.nats_streaming.compression_output_bytes")
+                .value());
+}
+
+TEST_F(NatsStreamingFilterTest, RequestWithShortBodyIsNotCompressed) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.mutable_compression()->set_min_body_size(64);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  Buffer::OwnedImpl data("hello world");
+  filter_->decodeData(data, true);
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_TRUE(actual_payload.headers().empty());
+  EXPECT_EQ("hello world", actual_payload.body());
+}
+
+TEST_F(NatsStreamingFilterTest, RequestInCompressedChunks) {
+  auto proto_config =
+      perRouteProtoConfig("Subject1", "cluster_id", "discover_prefix1");
+  proto_config.set_chunk_size(4);
+  // the chunks are compressed however short they are.
+  proto_config.mutable_compression()->set_min_body_size(64);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  std::vector<pb::Payload> chunks;
+  EXPECT_CALL(*nats_streaming_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _, _))
+      .Times(2)
+      .WillRepeatedly(
+          Invoke([&chunks](const std::string &, const std::string &,
+                           const std::string &, const std::string &payload,
+                           Envoy::Nats::Streaming::PublishCallbacks &callbacks)
+                     -> Envoy::Nats::Streaming::PublishRequestPtr {
+            chunks.emplace_back();
+            EXPECT_TRUE(chunks.back().ParseFromString(payload));
+            callbacks.onResponse();
+            return nullptr;
+          }));
+
+  Http::TestRequestHeaderMapImpl headers{{"x-request-id", "id"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  Buffer::OwnedImpl data("hello");
+  filter_->decodeData(data, true);
+
+  ASSERT_EQ(2U, chunks.size());
+  EXPECT_EQ("zstd", chunks[0].headers().at("x-nats-body-encoding"));
+  EXPECT_TRUE(chunks[1].headers().empty());
+  EXPECT_EQ("hell", decompress(chunks[0].body()));
+  EXPECT_EQ("o", decompress(chunks[1].body()));
+}
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace HttpFilters
@@ -0,0 +1,71 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/base64.h"
+#include "source/extensions/filters/http/transformation/body_base64.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+namespace {
+
+// a buffer with each piece of value in its own slice.
+void addSlices(Buffer::Instance &buffer, absl::string_view value,
+               size_t slice_size) {
+  for (size_t pos = 0; pos < value.size(); pos += slice_size) {
+    buffer.appendSliceForTest(value.substr(pos, slice_size));
+  }
+}
+
+TEST(BodyBase64, MatchesBase64AcrossSlices) {
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    value.push_back(static_cast<char>(i * 7));
+  }
+  for (size_t length : {0, 1, 2, 3, 4, 5, 63, 64, 100}) {
+    const std::string input = value.substr(0, length);
+    const std::string encoded = Base64::encode(input.data(), input.size());
+    for (size_t slice_size : {1, 2, 3, 5, 64}) {
+      Buffer::OwnedImpl body;
+      addSlices(body, input, slice_size);
+      Buffer::OwnedImpl output;
+      base64EncodeBody(body, output);
+      EXPECT_EQ(encoded, output.toString());
+      // the input is left as is.
+      EXPECT_EQ(input, body.toString());
+
+      Buffer::OwnedImpl encoded_body;
+      addSlices(encoded_body, encoded, slice_size);
+      Buffer::OwnedImpl decoded;
+      base64DecodeBody(encoded_body, decoded);
+      EXPECT_EQ(input, decoded.toString());
+    }
+  }
+}
+
+TEST(BodyBase64, AppendsToTheOutput) {
+  Buffer::OwnedImpl body("solo");
+  Buffer::OwnedImpl output("prefix:");
+  base64EncodeBody(body, output);
+  EXPECT_EQ("prefix:c29sbw==", output.toString());
+}
+
+TEST(BodyBase64, RejectsInvalidBase64) {
+  for (absl::string_view invalid : {"c29sbw", "c29s*w==", "c2=sbw==", "c===",
+                                    "c29sbw=a"}) {
+    Buffer::OwnedImpl body(invalid);
+    Buffer::OwnedImpl output;
+    EXPECT_THROW_WITH_MESSAGE(base64DecodeBody(body, output), EnvoyException,
+                              "the body is not valid base64");
+    EXPECT_EQ(0, output.length());
+  }
+}
+
+} // namespace
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
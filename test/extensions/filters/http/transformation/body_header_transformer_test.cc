@@ -117,6 +117,44 @@ TEST(BodyHeaderTransformer, transformWithExtraNoQuery) {
   EXPECT_EQ(expected, actual);
 }
 
+TEST(BodyHeaderTransformer, transformMatchesJsonDump) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":authority", "www.solo.io"},
+                                         {"x-repeated", "first"},
+                                         {"x-quote", "\"quoted\""},
+                                         {"x-repeated", "second"},
+                                         {":path", "/users/123?key=value"}};
+  const std::string original_body = "{\"a\": \"tab\there\"}\n";
+  Buffer::OwnedImpl body(original_body);
+
+  BodyHeaderTransformer transformer(true);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> filter_callbacks_{};
+  transformer.transform(headers, &headers, body, filter_callbacks_);
+
+  json expected;
+  expected["body"] = original_body;
+  expected["headers"] = {{":method", "POST"},
+                         {":authority", "www.solo.io"},
+                         {"x-quote", "\"quoted\""},
+                         {"x-repeated", "second"},
+                         {":path", "/users/123?key=value"}};
+  expected["httpMethod"] = "POST";
+  expected["path"] = "/users/123";
+  expected["queryString"] = "key=value";
+  EXPECT_EQ(expected.dump(), body.toString());
+}
+
+TEST(BodyHeaderTransformer, transformInvalidUtf8Body) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/users/123"}};
+  Buffer::OwnedImpl body("\xff");
+
+  BodyHeaderTransformer transformer(false);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> filter_callbacks_{};
+  EXPECT_THROW(transformer.transform(headers, &headers, body, filter_callbacks_),
+               EnvoyException);
+}
+
 } // namespace Transformation
 } // namespace HttpFilters
 } // namespace Extensions
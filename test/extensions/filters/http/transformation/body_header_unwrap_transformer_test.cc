@@ -0,0 +1,98 @@
+#include "envoy/common/exception.h"
+
+#include "source/common/buffer/buffer_impl.h"
+
+#include "source/extensions/filters/http/transformation/body_header_transformer.h"
+#include "source/extensions/filters/http/transformation/body_header_unwrap_transformer.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(BodyHeaderUnwrapTransformer, UnwrapsTheResponse) {
+  Http::TestRequestHeaderMapImpl request_headers{{":path", "/"}};
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"},
+                                          {"content-type", "application/json"},
+                                          {"x-envelope", "kept"},
+                                          {"x-replaced", "old"}};
+  Buffer::OwnedImpl body(R"({
+    "statusCode": 404,
+    "headers": {"x-replaced": "new"},
+    "multiValueHeaders": {"set-cookie": ["a=1", "b=2"]},
+    "body": "not found"
+  })");
+
+  BodyHeaderUnwrapTransformer transformer;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &request_headers, body, callbacks);
+
+  EXPECT_EQ("404", headers.getStatusValue());
+  // the content type described the json.
+  EXPECT_FALSE(headers.has("content-type"));
+  EXPECT_EQ("kept", headers.get_("x-envelope"));
+  EXPECT_EQ("new", headers.get_("x-replaced"));
+  EXPECT_EQ(1, headers.get(Http::LowerCaseString("x-replaced")).size());
+  EXPECT_EQ(2, headers.get(Http::LowerCaseString("set-cookie")).size());
+  EXPECT_EQ("not found", body.toString());
+  EXPECT_EQ("9", headers.getContentLengthValue());
+}
+
+TEST(BodyHeaderUnwrapTransformer, DecodesABase64Body) {
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  Buffer::OwnedImpl body(
+      R"({"headers": {"content-type": "application/octet-stream"},
+          "isBase64Encoded": true, "body": "AGJpbmFyeQ=="})");
+
+  BodyHeaderUnwrapTransformer transformer;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+  transformer.transform(headers, nullptr, body, callbacks);
+
+  EXPECT_EQ("200", headers.getStatusValue());
+  EXPECT_EQ("application/octet-stream", headers.getContentTypeValue());
+  EXPECT_EQ(std::string("\0binary", 7), body.toString());
+}
+
+TEST(BodyHeaderUnwrapTransformer, UndoesTheBodyHeaderTransformer) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/users/123"},
+                                         {"x-test", "789"}};
+  Buffer::OwnedImpl body("{\"a\":\"b\"}");
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  BodyHeaderTransformer(false).transform(headers, &headers, body, callbacks);
+  // the wrapped request is then changed on its way, e.g. by a function.
+  headers.setPath("/wrapped");
+  BodyHeaderUnwrapTransformer().transform(headers, &headers, body, callbacks);
+
+  EXPECT_EQ("/users/123", headers.getPathValue());
+  EXPECT_EQ("www.solo.io", headers.getHostValue());
+  EXPECT_EQ("789", headers.get_("x-test"));
+  EXPECT_EQ("{\"a\":\"b\"}", body.toString());
+}
+
+TEST(BodyHeaderUnwrapTransformer, FailsOnABodyThatIsNotAnObject) {
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  Buffer::OwnedImpl body("[\"body\"]");
+
+  BodyHeaderUnwrapTransformer transformer;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+  EXPECT_THROW(transformer.transform(headers, nullptr, body, callbacks),
+               EnvoyException);
+  EXPECT_EQ("200", headers.getStatusValue());
+  EXPECT_EQ("[\"body\"]", body.toString());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
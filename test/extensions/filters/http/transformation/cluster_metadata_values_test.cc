@@ -0,0 +1,53 @@
+#include "envoy/registry/registry.h"
+
+#include "source/common/protobuf/utility.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
+#include "source/extensions/filters/http/transformation/cluster_metadata_values.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(ClusterMetadataValues, ConvertsValues) {
+  ProtobufWkt::Struct metadata;
+  auto &fields = *metadata.mutable_fields();
+  fields["string"].set_string_value("val");
+  fields["number"].set_number_value(1.5);
+  fields["bool"].set_bool_value(true);
+  auto *list = fields["list"].mutable_list_value();
+  list->add_values()->set_string_value("a");
+  list->add_values()->set_number_value(2);
+  list->add_values()->set_bool_value(false);
+  fields["empty_list"].mutable_list_value();
+  fields["struct"].mutable_struct_value();
+
+  ClusterMetadataValues values(metadata);
+  ASSERT_NE(nullptr, values.find("string"));
+  EXPECT_EQ("val", *values.find("string"));
+  EXPECT_EQ(1.5, *values.find("number"));
+  EXPECT_EQ("true", *values.find("bool"));
+  EXPECT_EQ("a,2,false", *values.find("list"));
+  EXPECT_EQ("", *values.find("empty_list"));
+  EXPECT_EQ("", *values.find("struct"));
+  EXPECT_EQ(nullptr, values.find("missing"));
+}
+
+TEST(ClusterMetadataValues, FactoryIsRegistered) {
+  auto *factory =
+      Registry::FactoryRegistry<Upstream::ClusterTypedMetadataFactory>::
+          getFactory(SoloHttpFilterNames::get().Transformation);
+  ASSERT_NE(nullptr, factory);
+
+  auto object = factory->parse(MessageUtil::keyValueStruct("key", "val"));
+  const auto *values = dynamic_cast<const ClusterMetadataValues *>(object.get());
+  ASSERT_NE(nullptr, values);
+  EXPECT_EQ("val", *values->find("key"));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
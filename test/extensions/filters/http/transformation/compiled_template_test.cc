@@ -0,0 +1,134 @@
+#include "source/extensions/filters/http/transformation/compiled_template.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+using json = nlohmann::json;
+
+class CompiledTemplateTest : public testing::Test {
+public:
+  absl::optional<std::string> render(absl::string_view text,
+                                     bool advanced_templates = false) {
+    absl::optional<CompiledTemplate> compiled =
+        CompiledTemplate::compile(text, advanced_templates);
+    EXPECT_TRUE(compiled.has_value()) << text;
+    if (!compiled.has_value()) {
+      return absl::nullopt;
+    }
+    RenderContext context{headers_,     &request_headers_, get_body_,
+                          extractions_, context_,          environ_,
+                          nullptr};
+    std::string output;
+    if (!compiled->render(context, output)) {
+      return absl::nullopt;
+    }
+    return output;
+  }
+
+  Http::TestResponseHeaderMapImpl headers_{{":status", "200"}, {"x-a", "b"}};
+  Http::TestRequestHeaderMapImpl request_headers_{{":path", "/foo"}};
+  GetBodyFunc get_body_{[]() { return absl::string_view(); }};
+  ExtractionSlots extraction_slots_{{"ext", 0}};
+  std::vector<absl::string_view> extraction_values_{"value"};
+  Extractions extractions_{extraction_slots_, extraction_values_};
+  json context_ = json::parse(
+      R"({"a": {"b": "c", "n": 1, "list": [1, {"k": "v"}], "null": null}})");
+  std::unordered_map<std::string, std::string> environ_{{"HOME", "/root"}};
+};
+
+TEST_F(CompiledTemplateTest, RendersTextAndLookups) {
+  EXPECT_EQ("text", render("text"));
+  EXPECT_EQ("b /foo value /root",
+            render("{{header(\"X-A\")}} {{ request_header(\":path\") }} "
+                   "{{extraction(\"ext\")}} {{env(\"HOME\")}}"));
+  // missing values print nothing, as the callbacks return "".
+  EXPECT_EQ("[]", render("[{{header(\"missing\")}}{{extraction(\"none\")}}"
+                         "{{env(\"NONE\")}}]"));
+}
+
+TEST_F(CompiledTemplateTest, RendersVariables) {
+  EXPECT_EQ("c 1 v [1,{\"k\":\"v\"}]",
+            render("{{a.b}} {{ a.n }} {{a.list.1.k}} {{a.list}}"));
+  EXPECT_EQ("c v", render("{{a/b}} {{/a/list/1/k}}", true));
+}
+
+TEST_F(CompiledTemplateTest, ResolvesExtractionsToTheirSlots) {
+  const ExtractionSlots slots{{"other", 0}, {"ext", 1}};
+  absl::optional<CompiledTemplate> compiled = CompiledTemplate::compile(
+      "[{{extraction(\"ext\")}}{{extraction(\"none\")}}]", false, &slots);
+  ASSERT_TRUE(compiled.has_value());
+  // the missing extraction is left out of the ops.
+  EXPECT_EQ(3U, compiled->size());
+
+  // the slot is used as is, without looking up the name again.
+  const ExtractionSlots other_slots{{"ext", 0}};
+  const std::vector<absl::string_view> values{"a", "b"};
+  const Extractions extractions(other_slots, values);
+  RenderContext context{headers_, &request_headers_, get_body_, extractions,
+                        context_, environ_,          nullptr};
+  std::string output;
+  ASSERT_TRUE(compiled->render(context, output));
+  EXPECT_EQ("[b]", output);
+}
+
+TEST_F(CompiledTemplateTest, RendersContextAndBody) {
+  get_body_ = []() { return absl::string_view("{\"a\": 1}"); };
+  EXPECT_EQ("{\"a\":{\"b\":\"c\",\"list\":[1,{\"k\":\"v\"}],\"n\":1,"
+            "\"null\":null}} {\"a\": 1}",
+            render("{{context()}} {{ body( ) }}"));
+
+  // the callback returns the context even when it isn't an object.
+  context_ = "text";
+  EXPECT_EQ("text", render("{{ context() }}"));
+  context_ = nullptr;
+  EXPECT_EQ(absl::nullopt, render("{{ context() }}"));
+}
+
+TEST_F(CompiledTemplateTest, LeavesMissingVariablesToInja) {
+  EXPECT_EQ(absl::nullopt, render("{{a.missing}}"));
+  EXPECT_EQ(absl::nullopt, render("{{a.list.2}}"));
+  EXPECT_EQ(absl::nullopt, render("{{a.b.c}}"));
+  EXPECT_EQ(absl::nullopt, render("{{a.null}}"));
+
+  context_ = json::array();
+  EXPECT_EQ(absl::nullopt, render("{{a}}"));
+}
+
+TEST_F(CompiledTemplateTest, EscapesValues) {
+  headers_.addCopy(Http::LowerCaseString("x-quoted"), "say \"hi\"\n");
+  EXPECT_EQ("say \\\"hi\\\"\\n c [1,{\\\"k\\\":\\\"v\\\"}]",
+            render("{{ json_escape(header(\"x-quoted\")) }} "
+                   "{{json_escape(a.b)}} {{ json_escape( a.list ) }}"));
+  // an escaped header is not copied as is.
+  absl::optional<CompiledTemplate> compiled =
+      CompiledTemplate::compile("{{ json_escape(header(\"x-a\")) }}", false);
+  ASSERT_TRUE(compiled.has_value());
+  EXPECT_EQ(nullptr, compiled->copiedHeader());
+  EXPECT_FALSE(
+      CompiledTemplate::compile("{{ json_escape(json_escape(a.b)) }}", false)
+          .has_value());
+}
+
+TEST_F(CompiledTemplateTest, DoesNotCompileOtherConstructs) {
+  for (absl::string_view text :
+       {"{% if a %}b{% endif %}", "{# comment #}", "## set a = 1",
+        "{{ a + 1 }}", "{{ upper(a.b) }}", "{{- a.b }}", "{{ true }}",
+        "{{ header(\"a\\\"b\") }}", "{{ header(a) }}", "{{ 1 }}",
+        "{{ substring(\"abc\", 1) }}", "{{ header() }}",
+        "{{ context(\"a\") }}"}) {
+    EXPECT_FALSE(CompiledTemplate::compile(text, false).has_value()) << text;
+  }
+  // dots are part of the keys with pointer notation.
+  EXPECT_FALSE(CompiledTemplate::compile("{{ a.b }}", true).has_value());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
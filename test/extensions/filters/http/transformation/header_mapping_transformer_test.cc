@@ -0,0 +1,218 @@
+#include "source/common/buffer/buffer_impl.h"
+
+#include "source/extensions/filters/http/transformation/header_mapping_transformer.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+using TransformationTemplate =
+    envoy::api::v2::filter::http::TransformationTemplate;
+
+namespace {
+
+TransformationTemplate passthroughTemplate() {
+  TransformationTemplate transformation;
+  transformation.mutable_passthrough();
+  return transformation;
+}
+
+void addHeaderToAppend(TransformationTemplate &transformation,
+                       const std::string &key, const std::string &text) {
+  auto *header = transformation.add_headers_to_append();
+  header->set_key(key);
+  header->mutable_value()->set_text(text);
+}
+
+} // namespace
+
+TEST(HeaderMappingTransformer, MapsHeaders) {
+  TransformationTemplate transformation = passthroughTemplate();
+  (*transformation.mutable_headers())["x-static"].set_text("value");
+  (*transformation.mutable_headers())["x-copy"].set_text(
+      "{{ header(\"x-source\") }}");
+  (*transformation.mutable_headers())["x-missing"].set_text(
+      "{{ header(\"x-nothing\") }}");
+  (*transformation.mutable_headers())["x-empty"].set_text("");
+  (*transformation.mutable_headers())[":path"].set_text("/new");
+  transformation.add_headers_to_remove("x-remove");
+  addHeaderToAppend(transformation, "x-append", "{{header(\"x-source\")}}");
+  addHeaderToAppend(transformation, "x-append", "");
+
+  HeaderMappingTransformerConstSharedPtr transformer =
+      HeaderMappingTransformer::create(transformation);
+  ASSERT_NE(nullptr, transformer);
+  EXPECT_TRUE(transformer->passthrough_body());
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/old"},
+                                         {"x-source", "source"},
+                                         {"x-missing", "present"},
+                                         {"x-empty", "present"},
+                                         {"x-remove", "1"},
+                                         {"x-append", "first"}};
+  Buffer::OwnedImpl body;
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer->transform(headers, &headers, body, callbacks);
+
+  EXPECT_EQ("value", headers.get_("x-static"));
+  EXPECT_EQ("source", headers.get_("x-copy"));
+  EXPECT_FALSE(headers.has("x-missing"));
+  EXPECT_FALSE(headers.has("x-empty"));
+  EXPECT_EQ("/new", headers.getPathValue());
+  EXPECT_FALSE(headers.has("x-remove"));
+  EXPECT_EQ(2, headers.get(Http::LowerCaseString("x-append")).size());
+}
+
+TEST(HeaderMappingTransformer, CopiesRequestHeadersToTheResponse) {
+  TransformationTemplate transformation = passthroughTemplate();
+  (*transformation.mutable_headers())["x-request-id"].set_text(
+      "{{ request_header(\"x-request-id\") }}");
+
+  HeaderMappingTransformerConstSharedPtr transformer =
+      HeaderMappingTransformer::create(transformation);
+  ASSERT_NE(nullptr, transformer);
+
+  Http::TestRequestHeaderMapImpl request_headers{{"x-request-id", "abc"}};
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  Buffer::OwnedImpl body;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+  transformer->transform(response_headers, &request_headers, body, callbacks);
+  EXPECT_EQ("abc", response_headers.get_("x-request-id"));
+
+  // without the request headers there is nothing to copy.
+  Http::TestResponseHeaderMapImpl other_headers{{"x-request-id", "def"}};
+  transformer->transform(other_headers, nullptr, body, callbacks);
+  EXPECT_FALSE(other_headers.has("x-request-id"));
+}
+
+TEST(HeaderMappingTransformer, CopiesAHeaderFromItself) {
+  TransformationTemplate transformation = passthroughTemplate();
+  (*transformation.mutable_headers())["x-a"].set_text("{{ header(\"x-a\") }}");
+  (*transformation.mutable_headers())[":authority"].set_text(
+      "{{ header(\":authority\") }}");
+  addHeaderToAppend(transformation, "x-b", "{{ header(\"x-b\") }}");
+
+  HeaderMappingTransformerConstSharedPtr transformer =
+      HeaderMappingTransformer::create(transformation);
+  ASSERT_NE(nullptr, transformer);
+
+  const std::string long_value(64, 'a');
+  Http::TestRequestHeaderMapImpl headers{{":authority", long_value},
+                                         {"x-a", long_value},
+                                         {"x-a", "second"},
+                                         {"x-b", long_value}};
+  Buffer::OwnedImpl body;
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer->transform(headers, &headers, body, callbacks);
+
+  EXPECT_EQ(long_value, headers.getHostValue());
+  EXPECT_EQ(long_value, headers.get_("x-a"));
+  EXPECT_EQ(1, headers.get(Http::LowerCaseString("x-a")).size());
+  EXPECT_EQ(2, headers.get(Http::LowerCaseString("x-b")).size());
+}
+
+TEST(HeaderMappingTransformer, ReadsTheHeadersAsTheyChange) {
+  TransformationTemplate transformation = passthroughTemplate();
+  transformation.add_headers_to_remove("x-a");
+  addHeaderToAppend(transformation, "x-b", "{{ header(\"x-a\") }}");
+  addHeaderToAppend(transformation, "x-a", "new");
+  addHeaderToAppend(transformation, "x-c", "{{ header(\"x-a\") }}");
+
+  HeaderMappingTransformerConstSharedPtr transformer =
+      HeaderMappingTransformer::create(transformation);
+  ASSERT_NE(nullptr, transformer);
+
+  Http::TestRequestHeaderMapImpl headers{{"x-a", "old"}};
+  Buffer::OwnedImpl body;
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer->transform(headers, &headers, body, callbacks);
+
+  EXPECT_FALSE(headers.has("x-b"));
+  EXPECT_EQ("new", headers.get_("x-a"));
+  EXPECT_EQ("new", headers.get_("x-c"));
+}
+
+TEST(HeaderMappingTransformer, BuffersTheBodyThatIsNotParsed) {
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_body_prefix_bytes(16);
+  (*transformation.mutable_headers())["x-a"].set_text("a");
+
+  HeaderMappingTransformerConstSharedPtr transformer =
+      HeaderMappingTransformer::create(transformation);
+  ASSERT_NE(nullptr, transformer);
+  EXPECT_FALSE(transformer->passthrough_body());
+  EXPECT_EQ(16, transformer->body_prefix_bytes());
+
+  Http::TestRequestHeaderMapImpl headers;
+  Buffer::OwnedImpl body("not json");
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer->transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("a", headers.get_("x-a"));
+  EXPECT_EQ("not json", body.toString());
+}
+
+TEST(HeaderMappingTransformer, LeavesTheOtherTemplatesToInja) {
+  auto lowers = [](const TransformationTemplate &transformation) {
+    return HeaderMappingTransformer::create(transformation) != nullptr;
+  };
+  const TransformationTemplate passthrough = passthroughTemplate();
+  EXPECT_TRUE(lowers(passthrough));
+
+  // the body is parsed, and the transformation fails when it isn't json.
+  EXPECT_FALSE(lowers(TransformationTemplate()));
+
+  TransformationTemplate transformation = passthrough;
+  (*transformation.mutable_headers())["x-a"].set_text(
+      "{{ header(\"x-b\") }}-suffix");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  (*transformation.mutable_headers())["x-a"].set_text("{{ env(\"HOME\") }}");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  (*transformation.mutable_headers())["x-a"].set_text(
+      "{% if true %}a{% endif %}");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  addHeaderToAppend(transformation, "x-a", "{{ upper(header(\"x-b\")) }}");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  (*transformation.mutable_extractors())["a"].set_header("x-a");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  transformation.add_dynamic_metadata_values()->set_key("a");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = passthrough;
+  transformation.mutable_result_cache();
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = TransformationTemplate();
+  transformation.mutable_body()->set_text("body");
+  EXPECT_FALSE(lowers(transformation));
+
+  transformation = TransformationTemplate();
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_body_base64(TransformationTemplate::EncodeBase64);
+  EXPECT_FALSE(lowers(transformation));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,23 +1,46 @@
-#include "source/common/common/empty_string.h"
-
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/body_header_transformer.h"
 #include "source/extensions/filters/http/transformation/inja_transformer.h"
 
+#include "test/extensions/filters/http/transformation/json_body_test_utility.h"
 #include "test/mocks/http/mocks.h"
 #include "test/test_common/utility.h"
 
 #include "benchmark/benchmark.h"
-#include "fmt/format.h"
-
-using json = nlohmann::json;
 
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace Transformation {
 
+using TransformationTemplate =
+    envoy::api::v2::filter::http::TransformationTemplate;
+
 namespace {
-std::function<const std::string &()> empty_body = [] { return EMPTY_STRING; };
+GetBodyFunc empty_body = [] { return absl::string_view(); };
+
+Http::TestRequestHeaderMapImpl requestHeaders() {
+  return Http::TestRequestHeaderMapImpl{{":method", "POST"},
+                                        {":authority", "www.solo.io"},
+                                        {":path", "/users/123"},
+                                        {"content-type", "application/json"},
+                                        {"x-request-id", "abcdef"}};
+}
+
+void runTransformer(benchmark::State &state, const Transformer &transformer,
+                    const std::string &input) {
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  size_t output_bytes = 0;
+  for (auto _ : state) {
+    Http::TestRequestHeaderMapImpl headers = requestHeaders();
+    Buffer::OwnedImpl body(input);
+    transformer.transform(headers, &headers, body, callbacks);
+    output_bytes += body.length();
+  }
+  benchmark::DoNotOptimize(output_bytes);
+  state.SetBytesProcessed(state.iterations() * input.size());
 }
+} // namespace
 
 static void BM_ExrtactHeader(benchmark::State &state) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
@@ -40,6 +63,60 @@ static void BM_ExrtactHeader(benchmark::State &state) {
 // Register the function as a benchmark
 BENCHMARK(BM_ExrtactHeader);
 
+// headers, body and dynamic metadata rendered from a few fields of the body.
+static void BM_TransformTemplates(benchmark::State &state) {
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["x-user"].set_text("{{ user.name }}");
+  (*transformation.mutable_headers())["x-path"].set_text(
+      "{{ header(\":path\") }}");
+  transformation.mutable_body()->set_text(
+      "{\"id\": {{ user.id }}, \"name\": \"{{ user.name }}\", "
+      "\"encoded\": \"{{ base64_encode(user.name) }}\"}");
+  auto *dynamic_metadata = transformation.add_dynamic_metadata_values();
+  dynamic_metadata->set_key("user_id");
+  dynamic_metadata->mutable_value()->set_text("{{ user.id }}");
+  InjaTransformer transformer(transformation);
+
+  runTransformer(state, transformer, jsonBody(state.range(0)));
+}
+BENCHMARK(BM_TransformTemplates)->RangeMultiplier(8)->Range(1 << 10, 1 << 20);
+
+// a body template that walks the whole body.
+static void BM_TransformLoop(benchmark::State &state) {
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{% for item in items %}{{ item.name }},{% endfor %}");
+  InjaTransformer transformer(transformation);
+
+  runTransformer(state, transformer, jsonBody(state.range(0)));
+}
+BENCHMARK(BM_TransformLoop)->RangeMultiplier(8)->Range(1 << 10, 1 << 20);
+
+static void BM_MergeExtractorsToBody(benchmark::State &state) {
+  TransformationTemplate transformation;
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_header(":path");
+  extractor.set_regex("/users/(\\d+)");
+  extractor.set_subgroup(1);
+  (*transformation.mutable_extractors())["user_id"] = extractor;
+  transformation.mutable_merge_extractors_to_body();
+  InjaTransformer transformer(transformation);
+
+  runTransformer(state, transformer, jsonBody(state.range(0)));
+}
+BENCHMARK(BM_MergeExtractorsToBody)
+    ->RangeMultiplier(8)
+    ->Range(1 << 10, 1 << 20);
+
+static void BM_BodyHeaderTransformer(benchmark::State &state) {
+  BodyHeaderTransformer transformer(true);
+
+  runTransformer(state, transformer, jsonBody(state.range(0)));
+}
+BENCHMARK(BM_BodyHeaderTransformer)
+    ->RangeMultiplier(8)
+    ->Range(1 << 10, 1 << 20);
+
 } // namespace Transformation
 } // namespace HttpFilters
 } // namespace Extensions
@@ -1,12 +1,18 @@
+#include <thread>
+
 #include "source/extensions/filters/http/solo_well_known_names.h"
 #include "source/extensions/filters/http/transformation/inja_transformer.h"
 #include "source/common/common/base64.h"
+#include "source/common/config/metadata.h"
+#include "source/common/stats/isolated_store_impl.h"
 
 #include "test/mocks/common.h"
 #include "test/mocks/http/mocks.h"
 #include "test/mocks/server/mocks.h"
+#include "test/mocks/stats/mocks.h"
 #include "test/mocks/upstream/mocks.h"
 #include "test/test_common/environment.h"
+#include "test/test_common/test_time.h"
 
 #include "fmt/format.h"
 #include "gmock/gmock.h"
@@ -14,8 +20,10 @@
 
 using testing::_;
 using testing::AtLeast;
+using testing::ElementsAre;
 using testing::HasSubstr;
 using testing::Invoke;
+using testing::Property;
 using testing::Return;
 using testing::ReturnPointee;
 using testing::ReturnRef;
@@ -33,7 +41,7 @@ using TransformationTemplate =
     envoy::api::v2::filter::http::TransformationTemplate;
 
 namespace {
-std::function<const std::string &()> empty_body = [] { return EMPTY_STRING; };
+GetBodyFunc empty_body = [] { return absl::string_view(); };
 }
 
 inja::Template parse(std::string s) {
@@ -49,14 +57,15 @@ TEST(TransformerInstance, ReplacesValueFromContext) {
   json originalbody;
   originalbody["field1"] = "value1";
   Http::TestRequestHeaderMapImpl headers;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{field1}}"));
+  auto res = t.render(parse("{{field1}}"), context);
 
   EXPECT_EQ(originalbody["field1"], res);
 }
@@ -68,14 +77,15 @@ TEST(TransformerInstance, ReplacesValueFromInlineHeader) {
 
   Http::TestRequestHeaderMapImpl headers{
       {":method", "GET"}, {":authority", "www.solo.io"}, {":path", path}};
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{header(\":path\")}}"));
+  auto res = t.render(parse("{{header(\":path\")}}"), context);
 
   EXPECT_EQ(path, res);
 }
@@ -88,83 +98,90 @@ TEST(TransformerInstance, ReplacesValueFromCustomHeader) {
                                          {":authority", "www.solo.io"},
                                          {":path", "/getsomething"},
                                          {"x-custom-header", header}};
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{header(\"x-custom-header\")}}"));
+  auto res = t.render(parse("{{header(\"x-custom-header\")}}"), context);
 
   EXPECT_EQ(header, res);
 }
 
 TEST(TransformerInstance, ReplaceFromExtracted) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
   absl::string_view field = "res";
-  extractions["f"] = field;
+  const ExtractionSlots slots{{"f", 0}};
+  const std::vector<absl::string_view> values{field};
+  Extractions extractions(slots, values);
   Http::TestRequestHeaderMapImpl headers;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{extraction(\"f\")}}"));
+  auto res = t.render(parse("{{extraction(\"f\")}}"), context);
 
   EXPECT_EQ(field, res);
 }
 
 TEST(TransformerInstance, ReplaceFromNonExistentExtraction) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
-  extractions["foo"] = absl::string_view("bar");
+  const ExtractionSlots slots{{"foo", 0}};
+  const std::vector<absl::string_view> values{"bar"};
+  Extractions extractions(slots, values);
   Http::TestRequestHeaderMapImpl headers;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{extraction(\"notsuchfield\")}}"));
+  auto res = t.render(parse("{{extraction(\"notsuchfield\")}}"), context);
 
   EXPECT_EQ("", res);
 }
 
 TEST(TransformerInstance, Environment) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   Http::TestRequestHeaderMapImpl headers;
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
   env["FOO"] = "BAR";
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{env(\"FOO\")}}"));
+  auto res = t.render(parse("{{env(\"FOO\")}}"), context);
   EXPECT_EQ("BAR", res);
 }
 
 TEST(TransformerInstance, EmptyEnvironment) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   Http::TestRequestHeaderMapImpl headers;
 
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{env(\"FOO\")}}"));
+  auto res = t.render(parse("{{env(\"FOO\")}}"), context);
   EXPECT_EQ("", res);
 }
 
 TEST(TransformerInstance, ClusterMetadata) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   Http::TestRequestHeaderMapImpl headers;
 
   std::unordered_map<std::string, std::string> env;
@@ -174,45 +191,86 @@ TEST(TransformerInstance, ClusterMetadata) {
       {SoloHttpFilterNames::get().Transformation,
        MessageUtil::keyValueStruct("io.solo.hostname", "foo.example.com")});
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, &cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, &cluster_metadata};
 
-  auto res = t.render(parse("{{clusterMetadata(\"io.solo.hostname\")}}"));
+  auto res =
+      t.render(parse("{{clusterMetadata(\"io.solo.hostname\")}}"), context);
   EXPECT_EQ("foo.example.com", res);
 }
 
 TEST(TransformerInstance, EmptyClusterMetadata) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   Http::TestRequestHeaderMapImpl headers;
 
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(headers, &headers, empty_body, extractions,
-                        originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
 
-  auto res = t.render(parse("{{clusterMetadata(\"io.solo.hostname\")}}"));
+  auto res =
+      t.render(parse("{{clusterMetadata(\"io.solo.hostname\")}}"), context);
   EXPECT_EQ("", res);
 }
 
 TEST(TransformerInstance, RequestHeaders) {
   json originalbody;
-  std::unordered_map<std::string, absl::string_view> extractions;
+  Extractions extractions;
   Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
   Http::TestRequestHeaderMapImpl request_headers{{":method", "GET"}};
 
   std::unordered_map<std::string, std::string> env;
   envoy::config::core::v3::Metadata *cluster_metadata{};
 
-  TransformerInstance t(response_headers, &request_headers, empty_body,
-                        extractions, originalbody, env, cluster_metadata);
+  TransformerInstance t;
+  RenderContext context{response_headers, &request_headers, empty_body,
+                        extractions, originalbody, env, cluster_metadata};
 
   auto res = t.render(
-      parse("{{header(\":status\")}}-{{request_header(\":method\")}}"));
+      parse("{{header(\":status\")}}-{{request_header(\":method\")}}"),
+      context);
   EXPECT_EQ("200-GET", res);
 }
 
+TEST(TransformerInstance, ReusedAcrossContexts) {
+  json originalbody;
+  Extractions extractions;
+  std::unordered_map<std::string, std::string> env;
+  envoy::config::core::v3::Metadata *cluster_metadata{};
+  Http::TestRequestHeaderMapImpl headers1{{"x-custom-header", "first"}};
+  Http::TestRequestHeaderMapImpl headers2{{"x-custom-header", "second"}};
+
+  TransformerInstance t;
+  auto tmpl = parse("{{header(\"x-custom-header\")}}");
+  RenderContext context1{headers1, &headers1, empty_body, extractions,
+                         originalbody, env, cluster_metadata};
+  RenderContext context2{headers2, &headers2, empty_body, extractions,
+                         originalbody, env, cluster_metadata};
+
+  EXPECT_EQ("first", t.render(tmpl, context1));
+  EXPECT_EQ("second", t.render(tmpl, context2));
+  EXPECT_EQ("first", t.render(tmpl, context1));
+}
+
+TEST(TransformerInstance, SharedByTheTransformersOfAThread) {
+  Event::GlobalTimeSystem time_system;
+  TransformerInstance &instance = TransformerInstance::forThread(&time_system);
+  EXPECT_EQ(&time_system, instance.timeSource());
+  EXPECT_EQ(&instance, &TransformerInstance::forThread(nullptr));
+  EXPECT_EQ(nullptr, instance.timeSource());
+
+  TransformerInstance *other_instance{};
+  std::thread other([&other_instance] {
+    other_instance = &TransformerInstance::forThread(nullptr);
+  });
+  other.join();
+  EXPECT_NE(&instance, other_instance);
+}
+
 TEST(Extraction, ExtractIdFromHeader) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
@@ -239,13 +297,40 @@ TEST(Extraction, ExtractorWorkWithNewlines) {
   NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
 
   std::string body("1\n2\n3");
-  GetBodyFunc bodyfunc = [&body]() -> const std::string & { return body; };
+  GetBodyFunc bodyfunc = [&body]() -> absl::string_view { return body; };
 
   std::string res(Extractor(extractor).extract(callbacks, headers, bodyfunc));
 
   EXPECT_EQ(body, res);
 }
 
+TEST(Extraction, ExtractorFallsBackToStdRegex) {
+  // backreferences are not supported by RE2.
+  Http::TestRequestHeaderMapImpl headers{{"x-test", "abab"}};
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_header("x-test");
+  extractor.set_regex("(ab)\\1");
+  extractor.set_subgroup(1);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  std::string res(Extractor(extractor).extract(callbacks, headers, empty_body));
+
+  EXPECT_EQ("ab", res);
+}
+
+TEST(Extraction, ExtractorNoMatch) {
+  Http::TestRequestHeaderMapImpl headers{{":path", "/accounts/123"}};
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_header(":path");
+  extractor.set_regex("/users/(\\d+)");
+  extractor.set_subgroup(1);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  std::string res(Extractor(extractor).extract(callbacks, headers, empty_body));
+
+  EXPECT_EQ("", res);
+}
+
 TEST(Extraction, ExtractorFail) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
@@ -271,6 +356,34 @@ TEST(Extraction, ExtractorFailOnOutOfRangeGroup) {
       "group 123 requested for regex with only 1 sub groups");
 }
 
+TEST(Extraction, ExtractsTheValueAtAJsonPointer) {
+  Http::TestRequestHeaderMapImpl headers;
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_json_pointer("/user/id");
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  std::string body(R"({"user": {"name": "Ada", "id": "u-42"}})");
+  GetBodyFunc bodyfunc = [&body]() -> absl::string_view { return body; };
+  EXPECT_EQ("u-42", Extractor(extractor).extract(callbacks, headers, bodyfunc));
+
+  // the regex applies to the value.
+  extractor.set_regex("u-(\\d+)");
+  extractor.set_subgroup(1);
+  EXPECT_EQ("42", Extractor(extractor).extract(callbacks, headers, bodyfunc));
+
+  extractor.set_json_pointer("/user/missing");
+  EXPECT_EQ("", Extractor(extractor).extract(callbacks, headers, bodyfunc));
+}
+
+TEST(Extraction, JsonPointerWithoutRegexHasNoGroups) {
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_json_pointer("/user/id");
+  extractor.set_subgroup(1);
+  EXPECT_THROW_WITH_MESSAGE(
+      Extractor a(extractor), EnvoyException,
+      "group 1 requested for a json pointer with no regex");
+}
+
 TEST(Transformer, transform) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
@@ -397,6 +510,39 @@ TEST(Transformer, transformHeaderAndHeadersToAppend) {
   EXPECT_EQ("SECOND VALUE", result[2]->value().getStringView());
 }
 
+TEST(Transformer, TemplatesReadTheHeadersAsTheTransformationChangesThem) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/foo"},
+                                         {"x-a", "old"},
+                                         {"x-b", "removed"}};
+  Buffer::OwnedImpl body;
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  // the body is rendered first, and the headers then change.
+  transformation.mutable_body()->set_text(
+      "{{header(\"x-a\")}} {{header(\"x-b\")}}");
+  (*transformation.mutable_headers())["x-a"].set_text("new");
+  transformation.add_headers_to_remove("x-b");
+  const auto &header = transformation.add_headers_to_append();
+  header->set_key("x-c");
+  header->mutable_value()->set_text(
+      "{{header(\"x-a\")}}{{header(\"x-b\")}}");
+  // the same through inja.
+  const auto &header1 = transformation.add_headers_to_append();
+  header1->set_key("x-d");
+  header1->mutable_value()->set_text(
+      "{% if true %}{{header(\"x-a\")}}{{header(\"x-c\")}}{% endif %}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &headers, body, callbacks);
+
+  EXPECT_EQ("old removed", body.toString());
+  EXPECT_EQ("new", headers.get_("x-a"));
+  EXPECT_EQ("new", headers.get_("x-c"));
+  EXPECT_EQ("newnew", headers.get_("x-d"));
+}
+
 TEST(Transformer, transformSimpleNestedStructs) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
@@ -486,6 +632,38 @@ TEST(Transformer, transformMergeExtractorsToBody) {
   EXPECT_EQ("{\"ext1\":\"123\"}", res);
 }
 
+TEST(Transformer, transformMergeNestedExtractorsToBody) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {"x-a", "1"},
+                                         {"x-b", "2"},
+                                         {":path", "/users/123"}};
+  Buffer::OwnedImpl body("{\"user\":{\"name\":\"n\"}}");
+
+  TransformationTemplate transformation;
+  transformation.mutable_merge_extractors_to_body();
+
+  auto add_extractor = [&transformation](const std::string &name,
+                                         const std::string &header) {
+    envoy::api::v2::filter::http::Extraction extractor;
+    extractor.set_header(header);
+    extractor.set_regex("(.*)");
+    extractor.set_subgroup(1);
+    (*transformation.mutable_extractors())[name] = extractor;
+  };
+  // the extractors share the keys, and the body's.
+  add_extractor("user.headers.a", "x-a");
+  add_extractor("user.headers.b", "x-b");
+  add_extractor("user.path", ":path");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &headers, body, callbacks);
+
+  EXPECT_EQ("{\"user\":{\"headers\":{\"a\":\"1\",\"b\":\"2\"},"
+            "\"name\":\"n\",\"path\":\"/users/123\"}}",
+            body.toString());
+}
+
 TEST(Transformer, transformBodyNotSet) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
@@ -558,6 +736,234 @@ TEST(InjaTransformer, RemoveHeadersUsingEmptyTemplate) {
   EXPECT_FALSE(headers.has(content_type));
 }
 
+TEST(InjaTransformer, SetsInlineHeadersInPlace) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/foo"},
+                                         {"content-type", "text/plain"},
+                                         {"x-custom", "old"},
+                                         {"x-last", "last"}};
+  Buffer::OwnedImpl body("{}");
+
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["content-type"].set_text(
+      "application/json");
+  (*transformation.mutable_headers())["x-custom"].set_text("new");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &headers, body, callbacks);
+
+  // the inline header keeps its place, while the other one is added again.
+  std::vector<std::string> keys;
+  headers.iterate([&keys](const Http::HeaderEntry &header) {
+    keys.emplace_back(header.key().getStringView());
+    return Http::HeaderMap::Iterate::Continue;
+  });
+  EXPECT_THAT(keys, ElementsAre(":method", ":path", "content-type", "x-last",
+                                "x-custom"));
+  EXPECT_EQ("application/json", headers.get_("content-type"));
+  EXPECT_EQ("new", headers.get_("x-custom"));
+
+  Http::TestRequestHeaderMapImpl expected{{":method", "GET"},
+                                          {":path", "/foo"},
+                                          {"content-type", "application/json"},
+                                          {"x-last", "last"},
+                                          {"x-custom", "new"}};
+  EXPECT_EQ(expected.byteSize(), headers.byteSize());
+}
+
+TEST(InjaTransformer, SharesTheParsedBodyWithLaterTransformations) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  const std::string original = "{\"a\":\"body\",\"b\":\"other\"}";
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  StreamInfo::FilterState &filter_state =
+      *callbacks.stream_info_.filterState();
+
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["x-a"].set_text("{{ a }}");
+  (*transformation.mutable_headers())["x-context"].set_text(
+      "{{ existsIn(context(), \"b\") }}");
+  InjaTransformer transformer(transformation);
+  // the route has a later stage that parses the body too.
+  SharedJsonBody::expect(filter_state);
+
+  // a whole parse is stored for the transformations that follow.
+  Buffer::OwnedImpl body(original);
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("body", headers.get_("x-a"));
+  auto shared = SharedJsonBody::find(filter_state,
+                                     SharedJsonBody::version(original));
+  ASSERT_NE(nullptr, shared);
+  EXPECT_EQ("other", (*shared)["b"]);
+
+  // a transformation that only reads a key of the same body uses the stored
+  // document rather than parsing the body.
+  SharedJsonBody::store(filter_state, SharedJsonBody::version(original),
+                        std::make_shared<const json>(
+                            json::parse("{\"a\":\"stored\",\"b\":1}")));
+  TransformationTemplate referenced;
+  (*referenced.mutable_headers())["x-a"].set_text("{{ a }}");
+  InjaTransformer referenced_transformer(referenced);
+  referenced_transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("stored", headers.get_("x-a"));
+
+  // a changed body is parsed again.
+  Buffer::OwnedImpl changed("{\"a\":\"changed\"}");
+  referenced_transformer.transform(headers, &headers, changed, callbacks);
+  EXPECT_EQ("changed", headers.get_("x-a"));
+}
+
+TEST(InjaTransformer, ParsesTheBodyOfASingleStageInPlace) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/users/123"}};
+  const std::string original = "{\"a\":\"body\"}";
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  StreamInfo::FilterState &filter_state =
+      *callbacks.stream_info_.filterState();
+
+  // dot notation extractors, which are added to the parsed body.
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_header(":path");
+  extractor.set_regex("/users/(\\d+)");
+  extractor.set_subgroup(1);
+  TransformationTemplate transformation;
+  (*transformation.mutable_extractors())["user"] = extractor;
+  (*transformation.mutable_headers())["x-a"].set_text("{{ a }}-{{ user }}");
+  // which parses the whole body.
+  (*transformation.mutable_headers())["x-context"].set_text(
+      "{{ existsIn(context(), \"user\") }}");
+  InjaTransformer transformer(transformation);
+
+  // nothing is shared when no other stage parses the body.
+  Buffer::OwnedImpl body(original);
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("body-123", headers.get_("x-a"));
+  EXPECT_FALSE(SharedJsonBody::expected(filter_state));
+
+  // nor is the body that the extractions are added to, which would take a
+  // copy.
+  SharedJsonBody::expect(filter_state);
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("body-123", headers.get_("x-a"));
+  EXPECT_EQ(nullptr, SharedJsonBody::find(filter_state,
+                                          SharedJsonBody::version(original)));
+
+  // a stored document is copied rather than changed.
+  auto stored = std::make_shared<const json>(json::parse(original));
+  SharedJsonBody::store(filter_state, SharedJsonBody::version(original),
+                        stored);
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("body-123", headers.get_("x-a"));
+  EXPECT_EQ("true", headers.get_("x-context"));
+  EXPECT_EQ(json::parse(original), *stored);
+}
+
+TEST(InjaTransformer, Base64EncodesTheBody) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"content-length", "4"}};
+  Buffer::OwnedImpl body("solo");
+
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_body_base64(TransformationTemplate::EncodeBase64);
+  (*transformation.mutable_headers())["x-body"].set_text("{{ body() }}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("c29sbw==", body.toString());
+  EXPECT_EQ("8", headers.get_("content-length"));
+  // the headers are rendered with the original body.
+  EXPECT_EQ("solo", headers.get_("x-body"));
+}
+
+TEST(InjaTransformer, Base64DecodesTheRenderedBody) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  Buffer::OwnedImpl body("{\"payload\":\"c29sbw==\"}");
+
+  TransformationTemplate transformation;
+  transformation.set_body_base64(TransformationTemplate::DecodeBase64);
+  transformation.mutable_body()->set_text("{{ payload }}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("solo", body.toString());
+
+  Buffer::OwnedImpl invalid("{\"payload\":\"not base64\"}");
+  EXPECT_THROW_WITH_MESSAGE(
+      transformer.transform(headers, &headers, invalid, callbacks),
+      EnvoyException, "the body is not valid base64");
+}
+
+TEST(InjaTransformer, Base64BodyNeedsTheWholeBody) {
+  TransformationTemplate transformation;
+  transformation.set_body_base64(TransformationTemplate::EncodeBase64);
+  transformation.mutable_passthrough();
+
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer transformer(transformation), EnvoyException,
+      "body_base64 needs the whole body, it can't be combined with "
+      "passthrough, body_prefix_bytes or streaming_body");
+}
+
+TEST(InjaTransformer, ObservesTheBodyAsItIsWritten) {
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  std::string observed;
+  const Transformer::BodyObserver observer =
+      [&observed](absl::string_view data) { observed.append(data); };
+  auto transform = [&](const InjaTransformer &transformer,
+                       const std::string &input) {
+    Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                           {":path", "/foo"}};
+    Buffer::OwnedImpl body(input);
+    observed.clear();
+    transformer.transformObserved(headers, &headers, body, callbacks,
+                                  observer);
+    return body.toString();
+  };
+
+  // larger than the staging area of the stream the body is rendered with.
+  TransformationTemplate loop;
+  loop.mutable_body()->set_text("{% for i in items %}{{ i }}-{% endfor %}");
+  std::string items;
+  for (int i = 0; i < 1000; i++) {
+    items += (i == 0 ? "" : ",") + std::to_string(i);
+  }
+  const std::string rendered =
+      transform(InjaTransformer(loop), "{\"items\":[" + items + "]}");
+  EXPECT_GT(rendered.size(), 1024u);
+  EXPECT_EQ(rendered, observed);
+
+  // the coded body is observed, not the rendered one.
+  TransformationTemplate encode;
+  encode.set_parse_body_behavior(TransformationTemplate::DontParse);
+  encode.set_body_base64(TransformationTemplate::EncodeBase64);
+  EXPECT_EQ("c29sbw==", transform(InjaTransformer(encode), "solo"));
+  EXPECT_EQ("c29sbw==", observed);
+
+  // a body that isn't rendered is observed as it is.
+  TransformationTemplate headers_only;
+  headers_only.set_parse_body_behavior(TransformationTemplate::DontParse);
+  (*headers_only.mutable_headers())["x"].set_text("y");
+  EXPECT_EQ("solo", transform(InjaTransformer(headers_only), "solo"));
+  EXPECT_EQ("solo", observed);
+
+  // and so is the body of a cached result.
+  TransformationTemplate cached;
+  cached.mutable_result_cache()->set_max_entries(10);
+  cached.mutable_result_cache()->set_max_bytes(1000);
+  cached.mutable_body()->set_text("{{a}}");
+  Stats::IsolatedStoreImpl store;
+  ResultCacheStats stats = ResultCache::generateStats(store);
+  InjaTransformer cached_transformer(cached, absl::nullopt, stats);
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ("b", transform(cached_transformer, "{\"a\":\"b\"}"));
+    EXPECT_EQ("b", observed);
+  }
+  EXPECT_EQ(1, stats.hits_.value());
+}
+
 TEST(InjaTransformer, DontParseBodyAndExtractFromIt) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   Buffer::OwnedImpl body("not json body");
@@ -658,13 +1064,59 @@ TEST(InjaTransformer, UseDynamicMetaTwice) {
 
   NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
 
+  // both values are set at once.
   EXPECT_CALL(callbacks.stream_info_,
               setDynamicMetadata(SoloHttpFilterNames::get().Transformation, _))
-      .Times(2);
+      .WillOnce(
+          Invoke([](const std::string &, const ProtobufWkt::Struct &value) {
+            EXPECT_EQ(value.fields().at("foo").string_value(), "1");
+            EXPECT_EQ(value.fields().at("bar").string_value(), "123");
+          }));
   Buffer::OwnedImpl body("1");
   transformer.transform(headers, &headers, body, callbacks);
 }
 
+TEST(InjaTransformer, GroupsDynamicMetaByNamespace) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+
+  auto add_value = [&transformation](const std::string &metadata_namespace,
+                                     const std::string &key,
+                                     const std::string &text) {
+    auto dynamic_meta = transformation.add_dynamic_metadata_values();
+    dynamic_meta->set_metadata_namespace(metadata_namespace);
+    dynamic_meta->set_key(key);
+    dynamic_meta->mutable_value()->set_text(text);
+  };
+  add_value("a.ns", "first", "1");
+  add_value("b.ns", "second", "2");
+  add_value("a.ns", "third", "3");
+  // empty values are not set, and a namespace with no values is skipped.
+  add_value("a.ns", "empty", "");
+  add_value("c.ns", "empty", "");
+
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  EXPECT_CALL(callbacks.stream_info_, setDynamicMetadata("a.ns", _))
+      .WillOnce(
+          Invoke([](const std::string &, const ProtobufWkt::Struct &value) {
+            EXPECT_EQ(2, value.fields().size());
+            EXPECT_EQ(value.fields().at("first").string_value(), "1");
+            EXPECT_EQ(value.fields().at("third").string_value(), "3");
+          }));
+  EXPECT_CALL(callbacks.stream_info_, setDynamicMetadata("b.ns", _))
+      .WillOnce(
+          Invoke([](const std::string &, const ProtobufWkt::Struct &value) {
+            EXPECT_EQ(value.fields().at("second").string_value(), "2");
+          }));
+  EXPECT_CALL(callbacks.stream_info_, setDynamicMetadata("c.ns", _)).Times(0);
+  Buffer::OwnedImpl body;
+  transformer.transform(headers, &headers, body, callbacks);
+}
+
 TEST(InjaTransformer, UseEnvVar) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -682,6 +1134,23 @@ TEST(InjaTransformer, UseEnvVar) {
   EXPECT_EQ(body.toString(), "BAR");
 }
 
+TEST(InjaTransformer, UseEnvVarByName) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x-env", "FOO"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{{env(header(\"x-env\"))}}{{env(\"MISSING\")}}");
+  TestEnvironment::setEnvVar("FOO", "BAR", 1);
+
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "BAR");
+}
+
 TEST(InjaTransformer, Base64EncodeTestString) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -843,6 +1312,53 @@ TEST(InjaTransformer, SubstringNonIntegerArguments) {
   EXPECT_EQ(body.toString(), "");
 }
 
+TEST(InjaTransformer, JsonEscape) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x-name", "a\"b\\c"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{\"name\": \"{{ json_escape(header(\"x-name\")) }}\", "
+      "\"list\": \"{{ json_escape(context()) }}\"}");
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("[1, \"two\"]");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("{\"name\": \"a\\\"b\\\\c\", \"list\": \"[1,\\\"two\\\"]\"}",
+            body.toString());
+}
+
+TEST(InjaTransformer, JsonEscapesTheExpressions) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x-name", "a\"b"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{\"name\": \"{{ header(\"x-name\") }}\"{# a \"}}\" #}"
+      "{% if true %}, \"path\": \"{{- request_header(\":path\") -}}\""
+      "{% endif %}}");
+  transformation.mutable_body()->set_json_escape_expressions(true);
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("{}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("{\"name\": \"a\\\"b\", \"path\": \"/foo\"}", body.toString());
+}
+
+TEST(InjaTransformer, RewritesTheExpressionsToJsonEscapeThem) {
+  EXPECT_EQ("{ \"a\": \"{{ json_escape(b) }}\" }",
+            ParsedTemplate::jsonEscapeExpressions("{ \"a\": \"{{b}}\" }"));
+  EXPECT_EQ("{{- json_escape(header(\"}}\")) -}}{{ }}",
+            ParsedTemplate::jsonEscapeExpressions(
+                "{{-  header(\"}}\")-}}{{ }}"));
+  EXPECT_EQ("{% if a %}{# {{ b }} #}{% endif %}",
+            ParsedTemplate::jsonEscapeExpressions(
+                "{% if a %}{# {{ b }} #}{% endif %}"));
+  // inja reports the unterminated expression.
+  EXPECT_EQ("{{ json_escape(a) }}{{ b",
+            ParsedTemplate::jsonEscapeExpressions("{{a}}{{ b"));
+}
+
 TEST(InjaTransformer, ParseBodyListUsingContext) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -857,6 +1373,458 @@ TEST(InjaTransformer, ParseBodyListUsingContext) {
   EXPECT_EQ(body.toString(), "321");
 }
 
+TEST(InjaTransformer, ValidatesBodyThatIsNotRead) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["x-header"].set_text("constant");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("this is not json");
+  EXPECT_THROW(transformer.transform(headers, &headers, body, callbacks),
+               std::exception);
+
+  transformation.set_ignore_error_on_parse(true);
+  InjaTransformer transformer2(transformation);
+  transformer2.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("constant", headers.get_("x-header"));
+}
+
+TEST(InjaTransformer, ExtractorsDontRequireParsedBody) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/users/123"}};
+  TransformationTemplate transformation;
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.set_header(":path");
+  extractor.set_regex("/users/(\\d+)");
+  extractor.set_subgroup(1);
+  (*transformation.mutable_extractors())["ext1"] = extractor;
+  (*transformation.mutable_headers())["x-header"].set_text("{{ext1}}");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  // the body is never parsed, so it doesn't matter that it isn't an object.
+  Buffer::OwnedImpl body("[1,2,3]");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("123", headers.get_("x-header"));
+  EXPECT_EQ("[1,2,3]", body.toString());
+}
+
+TEST(InjaTransformer, ParseOnlyReferencedKeys) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{{ a.b }}-{% for i in c %}{{ i }}{% endfor %}-"
+      "{{ default(d, \"none\") }}");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body(
+      "{\"a\":{\"b\":\"x\"},\"c\":[1,2],\"d\":\"y\",\"e\":{\"f\":[1]}}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("x-12-y", body.toString());
+}
+
+TEST(InjaTransformer, BodySpanningSlices) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{ a }}-{{ body() }}");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body;
+  body.appendSliceForTest("{\"a\":");
+  body.appendSliceForTest("\"b\"}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("b-{\"a\":\"b\"}", body.toString());
+}
+
+TEST(InjaTransformer, ConstantTemplates) {
+  auto analyze = [](absl::string_view text) {
+    return TemplateDependencies::analyze(text);
+  };
+  EXPECT_FALSE(ParsedTemplate::dependsOnRequest(analyze("constant")));
+  EXPECT_FALSE(ParsedTemplate::dependsOnRequest(
+      analyze("{{ base64_encode(\"solo\") }} {{ env(\"HOME\") }}")));
+  EXPECT_TRUE(ParsedTemplate::dependsOnRequest(analyze("{{ a }}")));
+  EXPECT_TRUE(
+      ParsedTemplate::dependsOnRequest(analyze("{{ header(\"x\") }}")));
+  EXPECT_TRUE(ParsedTemplate::dependsOnRequest(analyze("{{ body() }}")));
+  EXPECT_TRUE(ParsedTemplate::dependsOnRequest(
+      analyze("{{ existsIn(context(), \"a\") }}")));
+}
+
+TEST(InjaTransformer, EstimatesOutputSizes) {
+  OutputSizeEstimate estimate;
+  for (int i = 0; i < 32; i++) {
+    estimate.record(1000);
+  }
+  EXPECT_GT(estimate.get(), 900);
+  EXPECT_LE(estimate.get(), 1000);
+  for (int i = 0; i < 32; i++) {
+    estimate.record(0);
+  }
+  EXPECT_LT(estimate.get(), 10);
+}
+
+TEST(InjaTransformer, ReservesRenderedTemplates) {
+  json originalbody;
+  originalbody["field1"] = std::string(1000, 'a');
+  Http::TestRequestHeaderMapImpl headers;
+  Extractions extractions;
+  std::unordered_map<std::string, std::string> env;
+  envoy::config::core::v3::Metadata *cluster_metadata{};
+  TransformerInstance t;
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        originalbody, env, cluster_metadata};
+
+  // the first template is compiled, the second one is rendered by inja.
+  for (absl::string_view text :
+       {"{{ field1 }}", "{% if true %}{{ field1 }}{% endif %}"}) {
+    ParsedTemplate parsed(text, false);
+    EXPECT_EQ(0, parsed.estimatedOutputSize());
+    for (int i = 0; i < 16; i++) {
+      EXPECT_EQ(originalbody["field1"], parsed.render(t, context));
+    }
+    EXPECT_GT(parsed.estimatedOutputSize(), 900);
+  }
+}
+
+TEST(TransformerInstance, ProfilesSampledRenders) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/getsomething"}};
+  Extractions extractions;
+  std::unordered_map<std::string, std::string> env;
+  json context_json;
+  Event::GlobalTimeSystem time_system;
+
+  TemplateProfiler &profiler = TemplateProfiler::get();
+  profiler.reset();
+  profiler.enable(1);
+  TransformerInstance t(time_system);
+  RenderContext context{headers, &headers, empty_body, extractions,
+                        context_json, env, nullptr};
+  t.render(parse("{{header(\":path\")}}{{header(\":method\")}}"), context,
+           "profiled");
+  profiler.disable();
+
+  json profile = json::parse(profiler.dump());
+  profiler.reset();
+  ASSERT_EQ(1, profile["templates"].size());
+  EXPECT_EQ("profiled", profile["templates"][0]["template"]);
+  ASSERT_EQ(1, profile["callbacks"].size());
+  EXPECT_EQ("header", profile["callbacks"][0]["callback"]);
+  EXPECT_EQ(2, profile["callbacks"][0]["count"]);
+}
+
+TEST(InjaTransformer, RendersConstantTemplatesOnce) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["x-constant"].set_text(
+      "{{ base64_encode(\"solo\") }}");
+  (*transformation.mutable_headers())["x-path"].set_text(
+      "{{ header(\":path\") }}");
+  transformation.mutable_body()->set_text("{{ upper(\"body\") }}");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  for (int i = 0; i < 2; i++) {
+    Buffer::OwnedImpl body("{}");
+    transformer.transform(headers, &headers, body, callbacks);
+    EXPECT_EQ("c29sbw==", headers.get_("x-constant"));
+    EXPECT_EQ("/foo", headers.get_("x-path"));
+    EXPECT_EQ("BODY", body.toString());
+  }
+}
+
+TEST(InjaTransformer, LiteralHeaderNamesAreLowered) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":path", "/foo"},
+                                         {"x-custom-header", "custom"},
+                                         {"x-name", "X-Custom-Header"}};
+  TransformationTemplate transformation;
+  (*transformation.mutable_headers())["x-literal"].set_text(
+      "{{ header(\"X-Custom-Header\") }}");
+  (*transformation.mutable_headers())["x-request"].set_text(
+      "{{ request_header(\"X-CUSTOM-HEADER\") }}");
+  (*transformation.mutable_headers())["x-computed"].set_text(
+      "{{ header(header(\"x-name\")) }}");
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Buffer::OwnedImpl body("{}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("custom", headers.get_("x-literal"));
+  EXPECT_EQ("custom", headers.get_("x-request"));
+  EXPECT_EQ("custom", headers.get_("x-computed"));
+}
+
+TEST(InjaTransformer, RecordsTimings) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{a}}");
+  NiceMock<Stats::MockStore> store;
+  InjaTransformer transformer(transformation,
+                              InjaTransformer::generateStats("prefix.", store));
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  EXPECT_CALL(store, deliverHistogramToSinks(
+                         Property(&Stats::Metric::name,
+                                  "prefix.transformation.inja.body_parse_time"),
+                         _));
+  EXPECT_CALL(store, deliverHistogramToSinks(
+                         Property(&Stats::Metric::name,
+                                  "prefix.transformation.inja.render_time"),
+                         _));
+  Buffer::OwnedImpl body("{\"a\":\"b\"}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("b", body.toString());
+}
+
+TEST(InjaTransformer, TransformsLargeBodiesInTasks) {
+  TransformationTemplate transformation;
+  transformation.set_async_body_threshold(10);
+  transformation.mutable_body()->set_text("{{a}}-{{ext}}");
+  (*transformation.mutable_headers())["x-body"].set_text("{{body()}}");
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.mutable_header()->assign("x-in");
+  extractor.set_regex("(.*)");
+  extractor.set_subgroup(1);
+  (*transformation.mutable_extractors())["ext"] = extractor;
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x-in", "value"}};
+  Buffer::OwnedImpl small_body("{}");
+  EXPECT_EQ(nullptr,
+            transformer.startTask(headers, &headers, small_body, callbacks));
+
+  Buffer::OwnedImpl body("{\"a\":\"b\"}    ");
+  TransformationTaskPtr task =
+      transformer.startTask(headers, &headers, body, callbacks);
+  ASSERT_NE(nullptr, task);
+  // the task has the body until it completes.
+  EXPECT_EQ(0U, body.length());
+  headers.setCopy(Http::LowerCaseString("x-in"), "changed");
+
+  task->run();
+  task->complete(headers, &headers, body, callbacks);
+  EXPECT_EQ("b-value", body.toString());
+  EXPECT_EQ("{\"a\":\"b\"}    ", headers.get_("x-body"));
+  EXPECT_EQ("7", headers.get_(Http::Headers::get().ContentLength));
+}
+
+TEST(InjaTransformer, TaskKeepsBodyThatIsNotRendered) {
+  TransformationTemplate transformation;
+  transformation.set_async_body_threshold(1);
+  (*transformation.mutable_headers())["x-a"].set_text("{{a}}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  Buffer::OwnedImpl body("{\"a\":\"b\"}");
+  TransformationTaskPtr task =
+      transformer.startTask(headers, &headers, body, callbacks);
+  ASSERT_NE(nullptr, task);
+  task->run();
+  task->complete(headers, &headers, body, callbacks);
+  EXPECT_EQ("{\"a\":\"b\"}", body.toString());
+  EXPECT_EQ("b", headers.get_("x-a"));
+}
+
+TEST(InjaTransformer, TaskThrowsErrorsWhenCompleted) {
+  TransformationTemplate transformation;
+  transformation.set_async_body_threshold(1);
+  transformation.mutable_body()->set_text("{{a}}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  Buffer::OwnedImpl body("not json");
+  TransformationTaskPtr task =
+      transformer.startTask(headers, &headers, body, callbacks);
+  ASSERT_NE(nullptr, task);
+  task->run();
+  EXPECT_THROW(task->complete(headers, &headers, body, callbacks),
+               EnvoyException);
+}
+
+TEST(InjaTransformer, ReplaysCachedResults) {
+  TransformationTemplate transformation;
+  transformation.mutable_result_cache()->set_max_entries(10);
+  transformation.mutable_result_cache()->set_max_bytes(1000);
+  transformation.mutable_body()->set_text("{{a}} {{header(\"x\")}}");
+  (*transformation.mutable_headers())["y"].set_text("{{a}}");
+  transformation.add_headers_to_remove("z");
+
+  Stats::IsolatedStoreImpl store;
+  ResultCacheStats stats = ResultCache::generateStats(store);
+  InjaTransformer transformer(transformation, absl::nullopt, stats);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  for (int i = 0; i < 2; i++) {
+    Http::TestRequestHeaderMapImpl headers{
+        {":method", "GET"}, {":path", "/foo"}, {"x", "1"}, {"z", "2"}};
+    Buffer::OwnedImpl body("{\"a\":\"b\"}");
+    transformer.transform(headers, &headers, body, callbacks);
+    EXPECT_EQ("b 1", body.toString());
+    EXPECT_EQ("b", headers.get_("y"));
+    EXPECT_FALSE(headers.has("z"));
+    EXPECT_EQ("3", headers.get_("content-length"));
+  }
+  EXPECT_EQ(1, stats.misses_.value());
+  EXPECT_EQ(1, stats.hits_.value());
+
+  // the header the template reads is part of the key.
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x", "2"}};
+  Buffer::OwnedImpl body("{\"a\":\"b\"}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ("b 2", body.toString());
+  EXPECT_EQ(2, stats.misses_.value());
+}
+
+TEST(InjaTransformer, ResultCacheRejectsDynamicHeaderNames) {
+  TransformationTemplate transformation;
+  transformation.mutable_result_cache()->set_max_entries(10);
+  transformation.mutable_result_cache()->set_max_bytes(1000);
+  transformation.mutable_body()->set_text("{{header(a)}}");
+
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer(transformation), EnvoyException,
+      "a transformation with a result cache can only call header() with a "
+      "string literal");
+}
+
+TEST(InjaTransformer, BodyPrefixCantTransformTheBody) {
+  TransformationTemplate transformation;
+  transformation.set_body_prefix_bytes(10);
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.mutable_body()->set_text("{{body()}}");
+
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer(transformation), EnvoyException,
+      "a transformation with body_prefix_bytes can't set the body");
+
+  transformation.clear_body();
+  transformation.set_parse_body_behavior(TransformationTemplate::ParseAsJson);
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer(transformation), EnvoyException,
+      "a transformation with body_prefix_bytes must not parse the body");
+
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  InjaTransformer transformer(transformation);
+  EXPECT_EQ(10U, transformer.body_prefix_bytes());
+}
+
+TEST(InjaTransformer, StreamsNewlineDelimitedJson) {
+  TransformationTemplate transformation;
+  transformation.mutable_streaming_body()->set_format(
+      envoy::api::v2::filter::http::StreamingBody::NEWLINE_DELIMITED_JSON);
+  transformation.mutable_body()->set_text("{{a}}");
+  (*transformation.mutable_headers())["x-streamed"].set_text("true");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"},
+                                          {"content-length", "100"}};
+  BodyStreamPtr stream = transformer.startBodyStream(headers, nullptr, callbacks);
+  ASSERT_NE(nullptr, stream);
+  EXPECT_EQ("true", headers.get_("x-streamed"));
+  EXPECT_FALSE(headers.has("content-length"));
+
+  // records are rendered as soon as their line is complete.
+  Buffer::OwnedImpl data("{\"a\":1}\n{\"a\"");
+  stream->transformData(data, false);
+  EXPECT_EQ("1\n", data.toString());
+
+  data.drain(data.length());
+  data.add(":2}\r\n\n{\"a\":3}");
+  stream->transformData(data, false);
+  EXPECT_EQ("2\n", data.toString());
+
+  data.drain(data.length());
+  stream->transformData(data, true);
+  EXPECT_EQ("3\n", data.toString());
+}
+
+TEST(InjaTransformer, StreamsJsonArrays) {
+  TransformationTemplate transformation;
+  transformation.mutable_streaming_body()->set_format(
+      envoy::api::v2::filter::http::StreamingBody::JSON_ARRAY);
+  transformation.mutable_body()->set_text("{{a}}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  BodyStreamPtr stream = transformer.startBodyStream(headers, nullptr, callbacks);
+  ASSERT_NE(nullptr, stream);
+
+  Buffer::OwnedImpl data(" [ {\"a\": \"]}\\\"\"}, {\"a\"");
+  stream->transformData(data, false);
+  EXPECT_EQ("[]}\"", data.toString());
+
+  data.drain(data.length());
+  data.add(":[2]} ]\n");
+  stream->transformData(data, true);
+  EXPECT_EQ(",[2]]", data.toString());
+}
+
+TEST(InjaTransformer, StreamsRejectInvalidBodies) {
+  TransformationTemplate transformation;
+  transformation.mutable_streaming_body()->set_format(
+      envoy::api::v2::filter::http::StreamingBody::JSON_ARRAY);
+  transformation.mutable_streaming_body()->mutable_max_record_bytes()->set_value(
+      8);
+  transformation.mutable_body()->set_text("{{a}}");
+
+  InjaTransformer transformer(transformation);
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks;
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+
+  {
+    BodyStreamPtr stream =
+        transformer.startBodyStream(headers, nullptr, callbacks);
+    Buffer::OwnedImpl data("[{\"a\":1}");
+    stream->transformData(data, false);
+    data.drain(data.length());
+    EXPECT_THROW_WITH_MESSAGE(stream->transformData(data, true),
+                              EnvoyException,
+                              "the json array of the streamed body is truncated");
+  }
+  {
+    BodyStreamPtr stream =
+        transformer.startBodyStream(headers, nullptr, callbacks);
+    Buffer::OwnedImpl data("[{\"a\":\"123456\"}]");
+    EXPECT_THROW_WITH_MESSAGE(stream->transformData(data, false),
+                              EnvoyException,
+                              "a json record of the streamed body is too large");
+  }
+  {
+    BodyStreamPtr stream =
+        transformer.startBodyStream(headers, nullptr, callbacks);
+    Buffer::OwnedImpl data("{\"a\":1}");
+    EXPECT_THROW_WITH_MESSAGE(stream->transformData(data, false),
+                              EnvoyException,
+                              "the streamed body is not a json array");
+  }
+
+  transformation.clear_body();
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer(transformation), EnvoyException,
+      "a transformation with a streaming_body must set the body template");
+}
+
 TEST(InjaTransformer, ParseFromClusterMetadata) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -878,6 +1846,32 @@ TEST(InjaTransformer, ParseFromClusterMetadata) {
   EXPECT_EQ(body.toString(), "val");
 }
 
+TEST(InjaTransformer, ParseFromConvertedClusterMetadata) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{{clusterMetadata(\"key\")}}-{{clusterMetadata(\"missing\")}}");
+
+  InjaTransformer transformer(transformation);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  // the values are converted when the cluster is created, so they are read
+  // from the typed metadata rather than from the metadata.
+  envoy::config::core::v3::Metadata meta;
+  meta.mutable_filter_metadata()->insert(
+      {SoloHttpFilterNames::get().Transformation,
+       MessageUtil::keyValueStruct("key", "val")});
+  Envoy::Config::TypedMetadataImpl<Upstream::ClusterTypedMetadataFactory>
+      typed_metadata(meta);
+  ON_CALL(*callbacks.cluster_info_, typedMetadata())
+      .WillByDefault(testing::ReturnRef(typed_metadata));
+
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "val-");
+}
+
 TEST(InjaTransformer, ParseFromNilClusterInfo) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
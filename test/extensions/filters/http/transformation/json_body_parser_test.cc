@@ -0,0 +1,64 @@
+#include "source/extensions/filters/http/transformation/json_body_parser.h"
+
+#include "gtest/gtest.h"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(JsonBodyParser, ParsesWholeBody) {
+  JsonBodyParser parser;
+  EXPECT_EQ(json::parse("{\"a\":1,\"b\":{\"c\":[1,2]}}"),
+            parser.parse("{\"a\":1,\"b\":{\"c\":[1,2]}}", false));
+}
+
+TEST(JsonBodyParser, ThrowsOnInvalidBody) {
+  JsonBodyParser parser;
+  EXPECT_THROW(parser.parse("not json", false), std::exception);
+  EXPECT_TRUE(parser.parse("not json", true).is_null());
+}
+
+TEST(JsonBodyParser, KeepsOnlyReferencedKeys) {
+  auto parser = JsonBodyParser::referencedKeys({"a", "b"});
+  EXPECT_EQ(json::parse("{\"a\":1,\"b\":{\"a\":2,\"c\":3}}"),
+            parser.parse("{\"a\":1,\"b\":{\"a\":2,\"c\":3},\"c\":{\"d\":4}}",
+                         false));
+}
+
+TEST(JsonBodyParser, ReferencedKeysKeepsArrays) {
+  auto parser = JsonBodyParser::referencedKeys({"a"});
+  EXPECT_EQ(json::parse("[{\"a\":1,\"b\":2}]"),
+            parser.parse("[{\"a\":1,\"b\":2}]", false));
+}
+
+TEST(JsonBodyParser, ValidateOnly) {
+  auto parser = JsonBodyParser::validateOnly();
+  EXPECT_TRUE(parser.parse("{\"a\":1}", false).is_null());
+  EXPECT_THROW(parser.parse("not json", false), std::exception);
+  EXPECT_TRUE(parser.parse("not json", true).is_null());
+}
+
+TEST(JsonBodyParser, FromParsed) {
+  const json parsed = json::parse("{\"a\":1,\"b\":{\"c\":2},\"d\":3}");
+  JsonBodyParser whole;
+  EXPECT_TRUE(whole.parsesWholeBody());
+  EXPECT_EQ(parsed, whole.fromParsed(parsed));
+
+  auto referenced = JsonBodyParser::referencedKeys({"a", "b", "missing"});
+  EXPECT_FALSE(referenced.parsesWholeBody());
+  EXPECT_EQ(json::parse("{\"a\":1,\"b\":{\"c\":2}}"),
+            referenced.fromParsed(parsed));
+  EXPECT_EQ(json::parse("[1,2]"), referenced.fromParsed(json::parse("[1,2]")));
+
+  auto validate = JsonBodyParser::validateOnly();
+  EXPECT_FALSE(validate.parsesWholeBody());
+  EXPECT_TRUE(validate.fromParsed(parsed).is_null());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
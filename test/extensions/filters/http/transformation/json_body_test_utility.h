@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+// a json object with a small "user" object and an "items" array that is
+// grown until the body is about the requested size.
+inline std::string jsonBody(size_t size) {
+  std::string body = R"({"user":{"id":123,"name":"solo"},"items":[)";
+  for (int i = 0; body.size() < size; i++) {
+    if (i > 0) {
+      body += ",";
+    }
+    body += fmt::format(R"({{"id":{},"name":"item-{}","tags":["a","b","c"]}})",
+                        i, i);
+  }
+  body += "]}";
+  return body;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
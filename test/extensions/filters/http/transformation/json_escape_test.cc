@@ -0,0 +1,66 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/json_escape.h"
+
+#include "gtest/gtest.h"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+namespace {
+
+std::string escape(absl::string_view value) {
+  Buffer::OwnedImpl output;
+  appendJsonString(output, value);
+  return output.toString();
+}
+
+TEST(JsonEscape, MatchesJsonDump) {
+  const std::vector<std::string> values = {
+      "",
+      "plain",
+      "a longer value without anything to escape in it",
+      "quote \" and backslash \\ at the start of a word",
+      "\"\\\"\\\"\\\"\\",
+      std::string("control \x01\x1f\x7f and nul \0 bytes", 27),
+      "\b\f\n\r\t tabs and newlines \t\n",
+      "two byte \xc3\xa9, three byte \xe2\x82\xac and four byte \xf0\x9f\x98\x80",
+      "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9",
+  };
+  for (const std::string &value : values) {
+    EXPECT_EQ(json(value).dump(), escape(value)) << value;
+  }
+}
+
+TEST(JsonEscape, RejectsInvalidUtf8) {
+  const std::vector<std::string> values = {
+      "\xff",
+      "truncated \xc3",
+      "bad continuation \xe2\x28\xa1",
+      "overlong \xc0\xaf",
+      "overlong \xe0\x80\xaf",
+      "surrogate \xed\xa0\x80",
+      "too large \xf4\x90\x80\x80",
+  };
+  for (const std::string &value : values) {
+    EXPECT_THROW(escape(value), EnvoyException) << value;
+    EXPECT_THROW(json(value).dump(), json::type_error) << value;
+  }
+}
+
+TEST(JsonEscape, AppendsTheEscapedValueWithoutQuotes) {
+  std::string output = "prefix ";
+  appendJsonEscaped(output, "a value longer than a block \"quoted\"\n");
+  EXPECT_EQ("prefix a value longer than a block \\\"quoted\\\"\\n", output);
+  appendJsonEscaped(output, "");
+  EXPECT_EQ("prefix a value longer than a block \\\"quoted\\\"\\n", output);
+}
+
+} // namespace
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
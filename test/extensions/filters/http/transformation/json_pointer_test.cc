@@ -0,0 +1,73 @@
+#include "source/extensions/filters/http/transformation/json_pointer.h"
+
+#include "envoy/common/exception.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+const absl::string_view document = R"({
+  "user": {"name": "Ada", "id": 42, "tags": ["a", {"b": [1, 2]}], "x": null},
+  "a/b": 1, "m~n": 2, "e\"sc": 3, "": {"": "empty"},
+  "quoted": "say \"hi\""
+})";
+
+absl::optional<absl::string_view> find(absl::string_view pointer) {
+  return JsonPointer(pointer).find(document);
+}
+} // namespace
+
+TEST(JsonPointer, FindsMembersAndElements) {
+  EXPECT_EQ("42", find("/user/id"));
+  EXPECT_EQ("Ada", find("/user/name"));
+  EXPECT_EQ("null", find("/user/x"));
+  EXPECT_EQ("a", find("/user/tags/0"));
+  EXPECT_EQ("2", find("/user/tags/1/b/1"));
+  EXPECT_EQ(R"({"b": [1, 2]})", find("/user/tags/1"));
+  EXPECT_EQ(document, find(""));
+}
+
+TEST(JsonPointer, ExtractsStringsAsWritten) {
+  EXPECT_EQ(R"(say \"hi\")", find("/quoted"));
+}
+
+TEST(JsonPointer, UnescapesTheTokensAndKeys) {
+  EXPECT_EQ("1", find("/a~1b"));
+  EXPECT_EQ("2", find("/m~0n"));
+  EXPECT_EQ("3", find("/e\"sc"));
+  EXPECT_EQ("empty", find("//"));
+}
+
+TEST(JsonPointer, FindsNothingWhereThereIsNoValue) {
+  EXPECT_FALSE(find("/user/missing").has_value());
+  EXPECT_FALSE(find("/user/tags/2").has_value());
+  EXPECT_FALSE(find("/user/tags/-").has_value());
+  EXPECT_FALSE(find("/user/tags/01").has_value());
+  EXPECT_FALSE(find("/user/id/0").has_value());
+  EXPECT_FALSE(JsonPointer("/a").find("").has_value());
+  EXPECT_FALSE(JsonPointer("/a").find("[]").has_value());
+}
+
+TEST(JsonPointer, StopsAtTheValue) {
+  // the rest of the document isn't read, so it doesn't need to be json.
+  EXPECT_EQ("1", JsonPointer("/a").find(R"({"a": 1, not json)"));
+  EXPECT_FALSE(JsonPointer("/b").find(R"({"a": {"c": 1)").has_value());
+  EXPECT_FALSE(JsonPointer("/a").find(R"({"a": "open)").has_value());
+}
+
+TEST(JsonPointer, RequiresALeadingSlash) {
+  EXPECT_THROW_WITH_MESSAGE(
+      JsonPointer pointer("user/id"), EnvoyException,
+      "json pointer 'user/id' must be empty or start with '/'");
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,97 @@
+#include "source/common/stats/isolated_store_impl.h"
+#include "source/extensions/filters/http/transformation/result_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+ResultCache::Key key(uint64_t body_hash, std::vector<std::string> headers = {}) {
+  ResultCache::Key key;
+  key.body_hash_ = body_hash;
+  key.body_length_ = 1;
+  key.header_values_ = std::move(headers);
+  return key;
+}
+
+CachedTransformationSharedPtr result(std::string body) {
+  auto result = std::make_shared<CachedTransformation>();
+  result->body_.emplace(std::move(body));
+  return result;
+}
+
+} // namespace
+
+class ResultCacheTest : public testing::Test {
+public:
+  Stats::IsolatedStoreImpl store_;
+  ResultCacheStats stats_{ResultCache::generateStats(store_)};
+};
+
+TEST_F(ResultCacheTest, FindsInsertedResults) {
+  ResultCache cache(10, 1000, stats_);
+  EXPECT_EQ(nullptr, cache.find(key(1)));
+
+  cache.insert(key(1), result("one"));
+  auto found = cache.find(key(1));
+  ASSERT_NE(nullptr, found);
+  EXPECT_EQ("one", found->body_.value());
+
+  // the header values are part of the key.
+  EXPECT_EQ(nullptr, cache.find(key(1, {"a"})));
+
+  EXPECT_EQ(1, stats_.hits_.value());
+  EXPECT_EQ(2, stats_.misses_.value());
+  EXPECT_EQ(1, stats_.entries_.value());
+  EXPECT_EQ(3, stats_.bytes_.value());
+}
+
+TEST_F(ResultCacheTest, EvictsLeastRecentlyUsedEntries) {
+  ResultCache cache(2, 1000, stats_);
+  cache.insert(key(1), result("one"));
+  cache.insert(key(2), result("two"));
+  // using the first result makes the second one the oldest.
+  EXPECT_NE(nullptr, cache.find(key(1)));
+  cache.insert(key(3), result("three"));
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_NE(nullptr, cache.find(key(1)));
+  EXPECT_EQ(nullptr, cache.find(key(2)));
+  EXPECT_NE(nullptr, cache.find(key(3)));
+  EXPECT_EQ(1, stats_.evictions_.value());
+  EXPECT_EQ(2, stats_.entries_.value());
+}
+
+TEST_F(ResultCacheTest, EvictsToStayUnderMaxBytes) {
+  ResultCache cache(10, 8, stats_);
+  cache.insert(key(1), result("one"));
+  cache.insert(key(2), result("two"));
+  cache.insert(key(3), result("three"));
+  EXPECT_EQ(1, cache.size());
+  EXPECT_NE(nullptr, cache.find(key(3)));
+  EXPECT_EQ(5, stats_.bytes_.value());
+
+  // results that can never fit are not cached.
+  cache.insert(key(4), result("too large"));
+  EXPECT_EQ(nullptr, cache.find(key(4)));
+  EXPECT_NE(nullptr, cache.find(key(3)));
+}
+
+TEST_F(ResultCacheTest, ReleasesGaugesWhenDestroyed) {
+  {
+    ResultCache cache(10, 1000, stats_);
+    cache.insert(key(1), result("one"));
+    EXPECT_EQ(1, stats_.entries_.value());
+  }
+  EXPECT_EQ(0, stats_.entries_.value());
+  EXPECT_EQ(0, stats_.bytes_.value());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
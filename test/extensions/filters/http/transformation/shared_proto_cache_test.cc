@@ -0,0 +1,76 @@
+#include "source/extensions/filters/http/transformation/shared_proto_cache.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+ProtobufWkt::StringValue config(const std::string &value) {
+  ProtobufWkt::StringValue proto;
+  proto.set_value(value);
+  return proto;
+}
+} // namespace
+
+TEST(SharedProtoCache, SharesObjectsOfEqualProtos) {
+  SharedProtoCache<std::string> cache;
+  int created = 0;
+  auto create = [&created] {
+    created++;
+    return std::make_shared<const std::string>("object");
+  };
+
+  auto first = cache.getOrCreate(config("a"), nullptr, create);
+  auto second = cache.getOrCreate(config("a"), nullptr, create);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(1, created);
+  EXPECT_EQ(1, cache.size());
+
+  // a different proto, owner or name builds another object.
+  auto changed = cache.getOrCreate(config("b"), nullptr, create);
+  int owner;
+  auto owned = cache.getOrCreate(config("a"), &owner, create);
+  auto named = cache.getOrCreate(config("a"), nullptr, "name", create);
+  EXPECT_NE(first.get(), changed.get());
+  EXPECT_NE(first.get(), owned.get());
+  EXPECT_NE(first.get(), named.get());
+  EXPECT_EQ(4, created);
+  EXPECT_EQ(4, cache.size());
+}
+
+TEST(SharedProtoCache, ReleasesUnusedObjects) {
+  SharedProtoCache<std::string> cache;
+  std::weak_ptr<const std::string> built;
+  auto create = [&built] {
+    auto object = std::make_shared<const std::string>("object");
+    built = object;
+    return object;
+  };
+
+  auto entry = cache.getOrCreate(config("a"), nullptr, create);
+  EXPECT_EQ(1, cache.size());
+  entry.reset();
+  EXPECT_EQ(0, cache.size());
+  EXPECT_TRUE(built.expired());
+}
+
+TEST(SharedProtoCache, DoesNotCacheFailures) {
+  SharedProtoCache<std::string> cache;
+  EXPECT_THROW(cache.getOrCreate(config("a"), nullptr,
+                                 []() -> std::shared_ptr<const std::string> {
+                                   throw std::runtime_error("invalid");
+                                 }),
+               std::runtime_error);
+  EXPECT_EQ(0, cache.size());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,98 @@
+#include "source/extensions/filters/http/transformation/template_analysis.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::UnorderedElementsAre;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(TemplateDependencies, PlainText) {
+  auto dependencies = TemplateDependencies::analyze("just some text {}");
+  EXPECT_TRUE(dependencies.functions().empty());
+  EXPECT_TRUE(dependencies.variables().empty());
+  EXPECT_FALSE(dependencies.readsContext());
+}
+
+TEST(TemplateDependencies, FunctionsAndVariables) {
+  auto dependencies = TemplateDependencies::analyze(
+      "{{ header(\"x-foo\") }}-{{ a.b }}-{{ upper(extraction(\"ext\")) }}");
+  EXPECT_THAT(dependencies.functions(),
+              UnorderedElementsAre("header", "upper", "extraction"));
+  EXPECT_THAT(dependencies.variables(), UnorderedElementsAre("a.b"));
+  EXPECT_TRUE(dependencies.readsContext());
+}
+
+TEST(TemplateDependencies, IgnoresStringsNumbersAndKeywords) {
+  auto dependencies = TemplateDependencies::analyze(
+      "{% if 1.5e3 > 2 and not false %}{{ \"{{ a }}\" }}{% endif %}");
+  EXPECT_TRUE(dependencies.variables().empty());
+  EXPECT_FALSE(dependencies.readsContext());
+}
+
+TEST(TemplateDependencies, IgnoresComments) {
+  auto dependencies = TemplateDependencies::analyze("{# {{ a }} #}text");
+  EXPECT_TRUE(dependencies.variables().empty());
+}
+
+TEST(TemplateDependencies, Statements) {
+  auto dependencies = TemplateDependencies::analyze(
+      "{% for item in items %}{{ item.name }}{% endfor %}\n"
+      "## if exists(\"flag\")\nyes\n## endif");
+  EXPECT_THAT(dependencies.variables(),
+              UnorderedElementsAre("item", "items", "item.name", "flag"));
+  EXPECT_THAT(dependencies.functions(), UnorderedElementsAre("exists"));
+}
+
+TEST(TemplateDependencies, Context) {
+  auto dependencies = TemplateDependencies::analyze("{{ context() }}");
+  EXPECT_TRUE(dependencies.variables().empty());
+  EXPECT_TRUE(dependencies.readsContext());
+}
+
+TEST(TemplateDependencies, TopLevelVariables) {
+  auto dependencies =
+      TemplateDependencies::analyze("{{ a.b }}{{ c/d }}{{ /e/f }}{{ g }}");
+  EXPECT_THAT(dependencies.topLevelVariables(false),
+              UnorderedElementsAre("a", "c/d", "/e/f", "g"));
+  EXPECT_THAT(dependencies.topLevelVariables(true),
+              UnorderedElementsAre("a.b", "c", "e", "g"));
+}
+
+TEST(TemplateDependencies, EnvironmentVariables) {
+  auto dependencies = TemplateDependencies::analyze(
+      "{{ env(\"FOO\") }}{{ env( \"BAR\" ) }}{{ base64_encode(\"BAZ\") }}");
+  EXPECT_THAT(dependencies.environmentVariables(),
+              UnorderedElementsAre("FOO", "BAR"));
+  EXPECT_FALSE(dependencies.readsAnyEnvironmentVariable());
+
+  dependencies.merge(TemplateDependencies::analyze("{{ env(name) }}"));
+  EXPECT_TRUE(dependencies.readsAnyEnvironmentVariable());
+}
+
+TEST(TemplateDependencies, LiteralArguments) {
+  auto dependencies = TemplateDependencies::analyze(
+      "{{ header(\"X-Foo\") }}{{ header(name) }}{{ substring(\"a\", 1) }}");
+  EXPECT_THAT(dependencies.literalArguments("header"),
+              UnorderedElementsAre("X-Foo"));
+  EXPECT_TRUE(dependencies.literalArguments("substring").empty());
+  EXPECT_TRUE(dependencies.literalArguments("request_header").empty());
+  EXPECT_TRUE(dependencies.callsWithDynamicArguments("header"));
+  EXPECT_TRUE(dependencies.callsWithDynamicArguments("substring"));
+  EXPECT_FALSE(dependencies.callsWithDynamicArguments("request_header"));
+}
+
+TEST(TemplateDependencies, Merge) {
+  auto dependencies = TemplateDependencies::analyze("{{ a }}");
+  dependencies.merge(TemplateDependencies::analyze("{{ body() }}"));
+  EXPECT_THAT(dependencies.variables(), UnorderedElementsAre("a"));
+  EXPECT_TRUE(dependencies.callsFunction("body"));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
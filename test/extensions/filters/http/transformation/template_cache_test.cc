@@ -0,0 +1,67 @@
+#include "source/extensions/filters/http/transformation/template_cache.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::UnorderedElementsAre;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(TemplateCache, SharesIdenticalTemplates) {
+  TemplateCache &cache = TemplateCache::get();
+  const size_t initial_size = cache.size();
+
+  auto first = cache.parse("{{ a.b }}", false);
+  auto second = cache.parse("{{ a.b }}", false);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(initial_size + 1, cache.size());
+  EXPECT_THAT(first->dependencies_.variables(), UnorderedElementsAre("a.b"));
+
+  // the same text in the other notation is parsed separately.
+  auto pointer = cache.parse("{{ a.b }}", true);
+  EXPECT_NE(first.get(), pointer.get());
+  EXPECT_EQ(initial_size + 2, cache.size());
+}
+
+TEST(TemplateCache, ReleasesUnusedTemplates) {
+  TemplateCache &cache = TemplateCache::get();
+  const size_t initial_size = cache.size();
+
+  auto entry = cache.parse("{{ released }}", false);
+  EXPECT_EQ(initial_size + 1, cache.size());
+  entry.reset();
+  EXPECT_EQ(initial_size, cache.size());
+
+  // it is parsed again when needed.
+  entry = cache.parse("{{ released }}", false);
+  EXPECT_NE(nullptr, entry);
+  EXPECT_EQ(initial_size + 1, cache.size());
+}
+
+TEST(TemplateCache, KeepsTheTextOfItsKeys) {
+  TemplateCache &cache = TemplateCache::get();
+
+  // the text the template was parsed from goes away before the lookup.
+  auto text = std::make_unique<std::string>("{{ kept }}");
+  auto entry = cache.parse(*text, false);
+  text.reset();
+
+  EXPECT_EQ("{{ kept }}", entry->text_);
+  EXPECT_EQ(entry.get(), cache.parse(std::string("{{ kept }}"), false).get());
+}
+
+TEST(TemplateCache, DoesNotCacheInvalidTemplates) {
+  TemplateCache &cache = TemplateCache::get();
+  const size_t initial_size = cache.size();
+
+  EXPECT_THROW(cache.parse("{{ not closed", false), std::exception);
+  EXPECT_EQ(initial_size, cache.size());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
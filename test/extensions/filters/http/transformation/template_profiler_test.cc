@@ -0,0 +1,97 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/template_profiler.h"
+
+#include "gtest/gtest.h"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+class TemplateProfilerTest : public testing::Test {
+public:
+  TemplateProfilerTest() : profiler_(TemplateProfiler::get()) {
+    profiler_.disable();
+    profiler_.reset();
+  }
+  ~TemplateProfilerTest() override {
+    profiler_.disable();
+    profiler_.reset();
+  }
+
+  TemplateProfiler &profiler_;
+};
+
+TEST_F(TemplateProfilerTest, Sampling) {
+  EXPECT_FALSE(profiler_.shouldSample(0));
+
+  profiler_.enable(10);
+  EXPECT_TRUE(profiler_.shouldSample(0));
+  EXPECT_FALSE(profiler_.shouldSample(1));
+  EXPECT_TRUE(profiler_.shouldSample(20));
+
+  profiler_.disable();
+  EXPECT_FALSE(profiler_.shouldSample(20));
+}
+
+TEST_F(TemplateProfilerTest, RecordsRenders) {
+  TemplateProfiler::RenderProfile profile;
+  profile.addCallback("header", std::chrono::microseconds(3));
+  profile.addCallback("header", std::chrono::microseconds(5));
+  profile.addCallback("body", std::chrono::microseconds(1));
+  profiler_.record("{{ header(\"x\") }}", std::chrono::microseconds(20),
+                   profile);
+  profiler_.record("{{ header(\"x\") }}", std::chrono::microseconds(10),
+                   TemplateProfiler::RenderProfile());
+
+  json dump = json::parse(profiler_.dump());
+  ASSERT_EQ(1, dump["templates"].size());
+  EXPECT_EQ("{{ header(\"x\") }}", dump["templates"][0]["template"]);
+  EXPECT_EQ(2, dump["templates"][0]["count"]);
+  EXPECT_EQ(30, dump["templates"][0]["total_us"]);
+  EXPECT_EQ(15, dump["templates"][0]["mean_us"]);
+
+  // the most expensive callback comes first.
+  ASSERT_EQ(2, dump["callbacks"].size());
+  EXPECT_EQ("header", dump["callbacks"][0]["callback"]);
+  EXPECT_EQ(2, dump["callbacks"][0]["count"]);
+  EXPECT_EQ(8, dump["callbacks"][0]["total_us"]);
+  EXPECT_EQ("body", dump["callbacks"][1]["callback"]);
+
+  profiler_.reset();
+  dump = json::parse(profiler_.dump());
+  EXPECT_TRUE(dump["templates"].empty());
+  EXPECT_TRUE(dump["callbacks"].empty());
+}
+
+TEST_F(TemplateProfilerTest, Config) {
+  Buffer::OwnedImpl response;
+  EXPECT_EQ(Http::Code::OK,
+            profiler_.handleConfig("/transformation/profile/config?enable=5",
+                                   response));
+  EXPECT_EQ(5, json::parse(profiler_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::OK,
+            profiler_.handleConfig("/transformation/profile/config?enable",
+                                   response));
+  EXPECT_EQ(100, json::parse(profiler_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::OK,
+            profiler_.handleConfig("/transformation/profile/config?disable",
+                                   response));
+  EXPECT_EQ(0, json::parse(profiler_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::BadRequest,
+            profiler_.handleConfig("/transformation/profile/config?enable=0",
+                                   response));
+  EXPECT_EQ(Http::Code::BadRequest,
+            profiler_.handleConfig("/transformation/profile/config", response));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
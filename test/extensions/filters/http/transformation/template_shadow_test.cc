@@ -0,0 +1,91 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/template_shadow.h"
+
+#include "gtest/gtest.h"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+class TemplateShadowTest : public testing::Test {
+public:
+  TemplateShadowTest() : shadow_(TemplateShadow::get()) {
+    shadow_.disable();
+    shadow_.reset();
+  }
+  ~TemplateShadowTest() override {
+    shadow_.disable();
+    shadow_.reset();
+  }
+
+  TemplateShadow &shadow_;
+};
+
+TEST_F(TemplateShadowTest, Sampling) {
+  EXPECT_FALSE(shadow_.shouldSample(0));
+
+  shadow_.enable(10);
+  EXPECT_TRUE(shadow_.shouldSample(0));
+  EXPECT_FALSE(shadow_.shouldSample(1));
+  EXPECT_TRUE(shadow_.shouldSample(20));
+
+  shadow_.disable();
+  EXPECT_FALSE(shadow_.shouldSample(20));
+}
+
+TEST_F(TemplateShadowTest, RecordsComparisons) {
+  shadow_.record("{{ a }}", true, std::chrono::nanoseconds(10),
+                 std::chrono::nanoseconds(50));
+  shadow_.record("{{ a }}", true, std::chrono::nanoseconds(20),
+                 std::chrono::nanoseconds(70));
+  shadow_.record("{{ b }}", false, std::chrono::nanoseconds(10),
+                 std::chrono::nanoseconds(10));
+
+  json dump = json::parse(shadow_.dump());
+  ASSERT_EQ(2, dump["templates"].size());
+  // the templates that don't match come first.
+  EXPECT_EQ("{{ b }}", dump["templates"][0]["template"]);
+  EXPECT_EQ(1, dump["templates"][0]["mismatches"]);
+  EXPECT_EQ("{{ a }}", dump["templates"][1]["template"]);
+  EXPECT_EQ(2, dump["templates"][1]["count"]);
+  EXPECT_EQ(0, dump["templates"][1]["mismatches"]);
+  EXPECT_EQ(15, dump["templates"][1]["compiled_mean_ns"]);
+  EXPECT_EQ(60, dump["templates"][1]["inja_mean_ns"]);
+
+  shadow_.reset();
+  dump = json::parse(shadow_.dump());
+  EXPECT_TRUE(dump["templates"].empty());
+}
+
+TEST_F(TemplateShadowTest, Config) {
+  Buffer::OwnedImpl response;
+  EXPECT_EQ(Http::Code::OK,
+            shadow_.handleConfig("/transformation/shadow/config?enable=5",
+                                 response));
+  EXPECT_EQ(5, json::parse(shadow_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::OK,
+            shadow_.handleConfig("/transformation/shadow/config?enable",
+                                 response));
+  EXPECT_EQ(100, json::parse(shadow_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::OK,
+            shadow_.handleConfig("/transformation/shadow/config?disable",
+                                 response));
+  EXPECT_EQ(0, json::parse(shadow_.dump())["sample_rate"]);
+
+  EXPECT_EQ(Http::Code::BadRequest,
+            shadow_.handleConfig("/transformation/shadow/config?enable=0",
+                                 response));
+  EXPECT_EQ(Http::Code::BadRequest,
+            shadow_.handleConfig("/transformation/shadow/config", response));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
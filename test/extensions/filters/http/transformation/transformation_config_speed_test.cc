@@ -0,0 +1,127 @@
+#include "source/common/memory/stats.h"
+#include "source/extensions/filters/http/transformation/transformation_filter_config.h"
+
+#include "test/mocks/server/mocks.h"
+
+#include "absl/types/optional.h"
+#include "benchmark/benchmark.h"
+#include "fmt/format.h"
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+// the transformations of a synthetic route, different from those of the
+// other routes so that they share no templates.
+void setRouteTransformations(
+    envoy::api::v2::filter::http::TransformationRule_Transformations
+        &transformations,
+    int route) {
+  auto &request = *transformations.mutable_request_transformation()
+                       ->mutable_transformation_template();
+  auto &extractor = (*request.mutable_extractors())["id"];
+  extractor.set_header(":path");
+  extractor.set_regex(fmt::format("/route-{}/users/(\\d+)", route));
+  extractor.set_subgroup(1);
+  (*request.mutable_headers())["x-route"].set_text(
+      fmt::format("route-{} {{{{ extraction(\"id\") }}}}", route));
+  request.mutable_body()->set_text(fmt::format(
+      "{{\"route\": {}, \"user\": \"{{{{ user.name }}}}\"}}", route));
+  auto &response = *transformations.mutable_response_transformation()
+                        ->mutable_transformation_template();
+  (*response.mutable_headers())["x-route"].set_text(
+      fmt::format("route-{} {{{{ header(\":status\") }}}}", route));
+  response.mutable_passthrough();
+}
+
+void setCounters(benchmark::State &state, uint64_t allocated_before,
+                 uint64_t allocated_after) {
+  const int64_t routes = state.range(0);
+  state.counters["routes_per_second"] = benchmark::Counter(
+      routes, benchmark::Counter::kIsIterationInvariantRate);
+  // only known when built with tcmalloc.
+  state.counters["bytes_per_route"] =
+      (static_cast<double>(allocated_after) - allocated_before) / routes;
+}
+
+} // namespace
+
+// a listener config with as many transformation rules as routes.
+static void BM_FilterConfig(benchmark::State &state) {
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  TransformationConfigProto proto_config;
+  for (int route = 0; route < state.range(0); route++) {
+    auto &rule = *proto_config.add_transformations();
+    rule.mutable_match()->set_prefix(fmt::format("/route-{}", route));
+    setRouteTransformations(*rule.mutable_route_transformations(), route);
+  }
+
+  uint64_t allocated_before = 0;
+  uint64_t allocated_after = 0;
+  absl::optional<TransformationFilterConfig> config;
+  for (auto _ : state) {
+    allocated_before = Memory::Stats::totalCurrentlyAllocated();
+    config.emplace(proto_config, "bench.", factory_context);
+    state.PauseTiming();
+    allocated_after = Memory::Stats::totalCurrentlyAllocated();
+    config.reset();
+    state.ResumeTiming();
+  }
+  setCounters(state, allocated_before, allocated_after);
+}
+BENCHMARK(BM_FilterConfig)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+// as many route configs as routes, as a route table configures them.
+static void BM_RouteConfigs(benchmark::State &state) {
+  NiceMock<Server::Configuration::MockServerFactoryContext>
+      server_factory_context;
+  std::vector<RouteTransformationConfigProto> protos(state.range(0));
+  for (int route = 0; route < state.range(0); route++) {
+    envoy::api::v2::filter::http::TransformationRule_Transformations
+        transformations;
+    setRouteTransformations(transformations, route);
+    *protos[route].mutable_request_transformation() =
+        transformations.request_transformation();
+    *protos[route].mutable_response_transformation() =
+        transformations.response_transformation();
+  }
+
+  uint64_t allocated_before = 0;
+  uint64_t allocated_after = 0;
+  std::vector<std::shared_ptr<RouteTransformationFilterConfig>> configs;
+  configs.reserve(protos.size());
+  for (auto _ : state) {
+    allocated_before = Memory::Stats::totalCurrentlyAllocated();
+    for (const auto &proto : protos) {
+      configs.push_back(std::make_shared<RouteTransformationFilterConfig>(
+          proto, server_factory_context));
+    }
+    state.PauseTiming();
+    allocated_after = Memory::Stats::totalCurrentlyAllocated();
+    configs.clear();
+    state.ResumeTiming();
+  }
+  setCounters(state, allocated_before, allocated_after);
+}
+BENCHMARK(BM_RouteConfigs)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -3,9 +3,12 @@
 #include "test/test_common/utility.h"
 #include "source/common/config/utility.h"
 #include "test/mocks/server/mocks.h"
+#include "test/mocks/stream_info/mocks.h"
 #include "source/common/protobuf/protobuf.h"
 #include "source/common/protobuf/utility.h"
 
+#include "absl/strings/str_cat.h"
+
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -54,7 +57,218 @@ TEST(Transformation, TestGetTransformer){
   EXPECT_NE(fakeTransformer, nullptr);
 }
 
+TEST(TransformationFilterConfig, ReusesUnchangedRules) {
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  TransformationConfigProto proto_config;
+  for (const std::string prefix : {"/a", "/b"}) {
+    auto *rule = proto_config.add_transformations();
+    rule->mutable_match()->set_prefix(prefix);
+    rule->mutable_route_transformations()
+        ->mutable_request_transformation()
+        ->mutable_transformation_template()
+        ->mutable_body()
+        ->set_text(prefix);
+  }
+  TransformationFilterConfig first(proto_config, "", factory_context);
+
+  // an update that only changes the second rule.
+  proto_config.mutable_transformations(1)
+      ->mutable_route_transformations()
+      ->mutable_request_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("changed");
+  TransformationFilterConfig second(proto_config, "", factory_context);
+
+  const auto &first_pairs = first.transformerPairs();
+  const auto &second_pairs = second.transformerPairs();
+  ASSERT_EQ(2, second_pairs.size());
+  EXPECT_EQ(first_pairs[0].matcher(), second_pairs[0].matcher());
+  EXPECT_EQ(first_pairs[0].transformer_pair()->getRequestTranformation(),
+            second_pairs[0].transformer_pair()->getRequestTranformation());
+  EXPECT_EQ(first_pairs[1].matcher(), second_pairs[1].matcher());
+  EXPECT_NE(first_pairs[1].transformer_pair()->getRequestTranformation(),
+            second_pairs[1].transformer_pair()->getRequestTranformation());
+}
+
+TEST(TransformationFilterConfig, KeepsTheRulesOfEachStatsPrefixApart) {
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  TransformationConfigProto proto_config;
+  auto *rule = proto_config.add_transformations();
+  rule->mutable_match()->set_prefix("/");
+  rule->mutable_route_transformations()
+      ->mutable_request_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("{{ a }}");
+  TransformationFilterConfig first(proto_config, "first.", factory_context);
+  TransformationFilterConfig again(proto_config, "first.", factory_context);
+  TransformationFilterConfig second(proto_config, "second.", factory_context);
+
+  // the transformers record their timings under the prefix of the filter.
+  auto request_transformation = [](const TransformationFilterConfig &config) {
+    return config.transformerPairs()[0]
+        .transformer_pair()
+        ->getRequestTranformation();
+  };
+  EXPECT_EQ(request_transformation(first), request_transformation(again));
+  EXPECT_NE(request_transformation(first), request_transformation(second));
+}
+
+TEST(TransformationFilterConfig, ParsesTemplatesOnLoadThreads) {
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  TransformationConfigProto proto_config;
+  proto_config.set_config_load_threads(4);
+  for (int i = 0; i < 8; i++) {
+    auto *rule = proto_config.add_transformations();
+    rule->mutable_match()->set_prefix(absl::StrCat("/", i));
+    auto *transformation_template =
+        rule->mutable_route_transformations()
+            ->mutable_request_transformation()
+            ->mutable_transformation_template();
+    (*transformation_template->mutable_headers())["x-load"].set_text(
+        absl::StrCat("{{ header(\"x-", i, "\") }}"));
+    transformation_template->mutable_body()->set_text(
+        absl::StrCat("{{ body", i, " }}"));
+  }
+  TransformationFilterConfig config(proto_config, "", factory_context);
+  EXPECT_EQ(8, config.transformerPairs().size());
+
+  // templates that fail to parse are reported as when they are parsed on the
+  // main thread.
+  (*proto_config.mutable_transformations(3)
+        ->mutable_route_transformations()
+        ->mutable_request_transformation()
+        ->mutable_transformation_template()
+        ->mutable_headers())["x-load"]
+      .set_text("{{ not closed");
+  EXPECT_THROW_WITH_REGEX(
+      TransformationFilterConfig(proto_config, "", factory_context),
+      EnvoyException, "Failed to parse header template 'x-load'");
+}
+
+TEST(RouteTransformationFilterConfig, SharesTheBodyParsedByTwoStages) {
+  NiceMock<Server::Configuration::MockServerFactoryContext> factory_context;
+  RouteTransformationConfigProto proto_config;
+  auto add_stage = [&proto_config](uint32_t stage, bool parse) {
+    auto *transformation = proto_config.add_transformations();
+    transformation->set_stage(stage);
+    auto *transformation_template =
+        transformation->mutable_request_match()
+            ->mutable_request_transformation()
+            ->mutable_transformation_template();
+    transformation_template->mutable_body()->set_text("{{ a }}");
+    if (!parse) {
+      transformation_template->set_parse_body_behavior(
+          envoy::api::v2::filter::http::TransformationTemplate::DontParse);
+    }
+  };
+
+  add_stage(0, true);
+  add_stage(1, false);
+  EXPECT_FALSE(RouteTransformationFilterConfig(proto_config, factory_context)
+                   .sharesParsedBody());
+
+  add_stage(2, true);
+  EXPECT_TRUE(RouteTransformationFilterConfig(proto_config, factory_context)
+                  .sharesParsedBody());
+}
+
+TEST(ResponseMatcherIndex, FindsTheFirstMatchingRule) {
+  auto matcher = [](const std::string &yaml) {
+    envoy::api::v2::filter::http::ResponseMatcher match;
+    TestUtility::loadFromYaml(yaml, match);
+    return ResponseMatcher::create(match);
+  };
+  auto transformer = []() {
+    return std::make_shared<Envoy::Extensions::Transformer::Fake::FakeTransformer>();
+  };
+  TransformerConstSharedPtr status_200 = transformer();
+  TransformerConstSharedPtr regex_5xx = transformer();
+  TransformerConstSharedPtr status_500 = transformer();
+  TransformerConstSharedPtr header = transformer();
+  TransformerConstSharedPtr details = transformer();
+  TransformerConstSharedPtr any = transformer();
+
+  ResponseMatcherIndex index;
+  index.add(matcher(R"EOF(
+  headers:
+  - name: ":status"
+    exact_match: "200"
+  )EOF"), status_200);
+  index.add(matcher(R"EOF(
+  headers:
+  - name: ":status"
+    safe_regex_match: {google_re2: {}, regex: "5.."}
+  )EOF"), regex_5xx);
+  index.add(matcher(R"EOF(
+  headers:
+  - name: "x-header"
+    exact_match: "value"
+  - name: ":status"
+    string_match: {exact: "500"}
+  )EOF"), status_500);
+  index.add(matcher(R"EOF(
+  headers:
+  - name: "x-header"
+    string_match: {exact: "value"}
+  )EOF"), header);
+  index.add(matcher(R"EOF(
+  response_code_details: {exact: "local"}
+  )EOF"), details);
+  index.add(nullptr, any);
+  EXPECT_EQ(6, index.size());
+
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  EXPECT_EQ(status_200,
+            index.findFirst(Http::TestResponseHeaderMapImpl{{":status", "200"}},
+                            stream_info));
+  // the unindexed regex rule comes before the indexed rule for 500.
+  EXPECT_EQ(regex_5xx,
+            index.findFirst(Http::TestResponseHeaderMapImpl{
+                                {":status", "500"}, {"x-header", "value"}},
+                            stream_info));
+  EXPECT_EQ(header, index.findFirst(Http::TestResponseHeaderMapImpl{
+                                        {":status", "404"},
+                                        {"x-header", "value"}},
+                                    stream_info));
+  // header matchers see all the values of a header, joined with commas.
+  EXPECT_EQ(any, index.findFirst(Http::TestResponseHeaderMapImpl{
+                                     {":status", "404"},
+                                     {"x-header", "value"},
+                                     {"x-header", "other"}},
+                                 stream_info));
+
+  stream_info.response_code_details_ = "local";
+  EXPECT_EQ(details,
+            index.findFirst(Http::TestResponseHeaderMapImpl{{":status", "404"}},
+                            stream_info));
+  stream_info.response_code_details_ = "";
+  EXPECT_EQ(any,
+            index.findFirst(Http::TestResponseHeaderMapImpl{{":status", "404"}},
+                            stream_info));
+}
+
+TEST(ResponseMatcher, MatchesEmptyResponseCodeDetails) {
+  envoy::api::v2::filter::http::ResponseMatcher match;
+  match.mutable_response_code_details()->mutable_safe_regex()->set_regex(".*");
+  match.mutable_response_code_details()
+      ->mutable_safe_regex()
+      ->mutable_google_re2();
+  ResponseMatcherConstPtr matcher = ResponseMatcher::create(match);
+  EXPECT_FALSE(matcher->headerRequirement().has_value());
+
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  Http::TestResponseHeaderMapImpl headers{{":status", "200"}};
+  stream_info.response_code_details_ = absl::nullopt;
+  EXPECT_FALSE(matcher->matches(headers, stream_info));
+  stream_info.response_code_details_ = "";
+  EXPECT_TRUE(matcher->matches(headers, stream_info));
+  stream_info.response_code_details_ = "via_upstream";
+  EXPECT_TRUE(matcher->matches(headers, stream_info));
+}
+
+}
 }
 }
 }
-}
\ No newline at end of file
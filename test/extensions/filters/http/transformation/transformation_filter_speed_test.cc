@@ -0,0 +1,90 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/transformation_filter.h"
+
+#include "test/extensions/filters/http/transformation/json_body_test_utility.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/server/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "benchmark/benchmark.h"
+
+using testing::Return;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+void setTemplates(envoy::api::v2::filter::http::TransformationTemplate
+                      &transformation) {
+  (*transformation.mutable_headers())["x-user"].set_text("{{ user.name }}");
+  (*transformation.mutable_headers())["x-path"].set_text(
+      "{{ request_header(\":path\") }}");
+  transformation.mutable_body()->set_text(
+      "{\"id\": {{ user.id }}, \"name\": \"{{ user.name }}\"}");
+}
+
+} // namespace
+
+// a request and a response transformed through the filter, with the
+// transformations configured on the route.
+static void BM_FilterRequestAndResponse(benchmark::State &state) {
+  NiceMock<Server::Configuration::MockFactoryContext> factory_context;
+  NiceMock<Server::Configuration::MockServerFactoryContext>
+      server_factory_context;
+
+  RouteTransformationConfigProto route_proto;
+  setTemplates(*route_proto.mutable_request_transformation()
+                    ->mutable_transformation_template());
+  setTemplates(*route_proto.mutable_response_transformation()
+                    ->mutable_transformation_template());
+  auto route_config = std::make_shared<RouteTransformationFilterConfig>(
+      route_proto, server_factory_context);
+  auto config = std::make_shared<TransformationFilterConfig>(
+      TransformationConfigProto(), "bench_", factory_context);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> decoder_callbacks;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> encoder_callbacks;
+  ON_CALL(decoder_callbacks, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(route_config.get()));
+  ON_CALL(encoder_callbacks, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(route_config.get()));
+
+  const std::string input = jsonBody(state.range(0));
+  for (auto _ : state) {
+    TransformationFilter filter(config);
+    filter.setDecoderFilterCallbacks(decoder_callbacks);
+    filter.setEncoderFilterCallbacks(encoder_callbacks);
+
+    Http::TestRequestHeaderMapImpl request_headers{
+        {":method", "POST"},
+        {":authority", "www.solo.io"},
+        {":path", "/users/123"},
+        {"content-type", "application/json"}};
+    Buffer::OwnedImpl request_body(input);
+    filter.decodeHeaders(request_headers, false);
+    filter.decodeData(request_body, true);
+
+    Http::TestResponseHeaderMapImpl response_headers{
+        {":status", "200"}, {"content-type", "application/json"}};
+    Buffer::OwnedImpl response_body(input);
+    filter.encodeHeaders(response_headers, false);
+    filter.encodeData(response_body, true);
+    filter.onDestroy();
+  }
+  state.SetBytesProcessed(state.iterations() * input.size() * 2);
+}
+BENCHMARK(BM_FilterRequestAndResponse)
+    ->RangeMultiplier(8)
+    ->Range(1 << 10, 1 << 20);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -1,3 +1,5 @@
+#include "source/common/buffer/body_budget.h"
+#include "source/common/common/cleanup.h"
 #include "source/extensions/filters/http/solo_well_known_names.h"
 #include "source/extensions/filters/http/transformation/transformation_filter.h"
 
@@ -5,6 +7,7 @@
 #include "test/mocks/server/mocks.h"
 #include "test/mocks/upstream/mocks.h"
 
+#include "absl/synchronization/notification.h"
 #include "fmt/format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -277,15 +280,14 @@ public:
     auto resheaders = filter_->decodeHeaders(headers_, false);
     ASSERT_EQ(Http::FilterHeadersStatus::StopIteration, resheaders);
 
-    std::string upstream_body;
-    EXPECT_CALL(filter_callbacks_, addDecodedData(_, false))
-        .WillOnce(Invoke(
-            [&](Buffer::Instance &b, bool) { upstream_body = b.toString(); }));
+    // the body is transformed in the buffer of the stream.
+    filter_callbacks_.buffer_.reset();
+    EXPECT_CALL(filter_callbacks_, addDecodedData(_, false));
 
     Buffer::OwnedImpl downstream_body("{\"a\":\"b\"}");
     auto res = filter_->decodeData(downstream_body, true);
     EXPECT_EQ(Http::FilterDataStatus::Continue, res);
-    EXPECT_EQ("b", upstream_body);
+    EXPECT_EQ("b", filter_callbacks_.buffer_->toString());
     EXPECT_EQ(val, config_->stats().request_body_transformations_.value());
   }
 
@@ -652,6 +654,385 @@ TEST_F(TransformationFilterTest, HappyPathWithBody) {
   happyPathWithBody(TransformationFilterTest::ConfigType::Listener, 3U);
 }
 
+TEST_F(TransformationFilterTest, CountsTransformedBytes) {
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl downstream_body("{\"a\":\"b\"}");
+  filter_->decodeData(downstream_body, true);
+  EXPECT_EQ(9U, config_->stats().request_bytes_in_.value());
+  EXPECT_EQ(1U, config_->stats().request_bytes_out_.value());
+  EXPECT_EQ(0U, config_->stats().response_bytes_in_.value());
+}
+
+TEST_F(TransformationFilterTest, TransformsLargeBodiesOnWorkerPool) {
+  listener_config_.mutable_async_pool()->set_threads(1);
+  listener_config_.mutable_async_pool()->set_max_pending(1);
+  auto &transformation = *route_config_.mutable_request_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_body()->set_text("{{a}}");
+  transformation.set_async_body_threshold(16);
+  initFilter();
+
+  // bodies under the threshold are transformed inline.
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, false));
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl small_body("{\"a\":\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(small_body, true));
+
+  absl::Notification posted;
+  Event::PostCb completion;
+  EXPECT_CALL(filter_callbacks_.dispatcher_, post(_))
+      .WillOnce(Invoke([&](Event::PostCb cb) {
+        completion = std::move(cb);
+        posted.Notify();
+      }));
+
+  filter_ = std::make_unique<TransformationFilter>(config_);
+  filter_->setDecoderFilterCallbacks(filter_callbacks_);
+  filter_callbacks_.buffer_.reset();
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl downstream_body("{\"a\":\"b\",\"c\":\"d\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(downstream_body, true));
+  posted.WaitForNotification();
+
+  // the task completes into the buffer of the stream it took the body from.
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, _)).Times(0);
+  EXPECT_CALL(filter_callbacks_, continueDecoding());
+  completion();
+  EXPECT_EQ("b", filter_callbacks_.buffer_->toString());
+  EXPECT_EQ(26U, config_->stats().request_bytes_in_.value());
+  EXPECT_EQ(2U, config_->stats().request_bytes_out_.value());
+  // the pool counts the task once it returns, which is after it posted the
+  // completion, and before it runs the next task.
+  WorkerPool &pool = *config_->workerPool();
+  absl::Notification counted;
+  uint64_t tasks_completed{};
+  ASSERT_TRUE(pool.post([&pool, &counted, &tasks_completed] {
+    tasks_completed = pool.stats().tasks_completed_.value();
+    counted.Notify();
+  }));
+  counted.WaitForNotification();
+  EXPECT_EQ(1U, tasks_completed);
+}
+
+TEST_F(TransformationFilterTest, DoesNotContinueDestroyedStreamsFromWorkerPool) {
+  listener_config_.mutable_async_pool()->set_threads(1);
+  listener_config_.mutable_async_pool()->set_max_pending(1);
+  auto &transformation = *route_config_.mutable_request_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_body()->set_text("{{a}}");
+  transformation.set_async_body_threshold(1);
+  initFilter();
+
+  absl::Notification posted;
+  Event::PostCb completion;
+  EXPECT_CALL(filter_callbacks_.dispatcher_, post(_))
+      .WillOnce(Invoke([&](Event::PostCb cb) {
+        completion = std::move(cb);
+        posted.Notify();
+      }));
+
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl downstream_body("{\"a\":\"b\"}");
+  filter_->decodeData(downstream_body, true);
+  posted.WaitForNotification();
+
+  filter_->onDestroy();
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, _)).Times(0);
+  EXPECT_CALL(filter_callbacks_, continueDecoding()).Times(0);
+  completion();
+}
+
+TEST_F(TransformationFilterTest, ReleasesCancelledTasksOnTheWorker) {
+  listener_config_.mutable_async_pool()->set_threads(1);
+  listener_config_.mutable_async_pool()->set_max_pending(2);
+  auto &transformation = *route_config_.mutable_request_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_body()->set_text("{{a}}");
+  transformation.set_async_body_threshold(1);
+  initFilter();
+
+  // the stream is destroyed before the task runs.
+  absl::Notification unblock;
+  ASSERT_TRUE(config_->workerPool()->post(
+      [&unblock] { unblock.WaitForNotification(); }));
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl downstream_body("{\"a\":\"b\"}");
+  filter_->decodeData(downstream_body, true);
+  filter_->onDestroy();
+
+  // the task is still posted back, for the worker to release it.
+  absl::Notification posted;
+  Event::PostCb release;
+  EXPECT_CALL(filter_callbacks_.dispatcher_, post(_))
+      .WillOnce(Invoke([&](Event::PostCb cb) {
+        release = std::move(cb);
+        posted.Notify();
+      }));
+  unblock.Notify();
+  posted.WaitForNotification();
+  EXPECT_CALL(filter_callbacks_, continueDecoding()).Times(0);
+  release();
+}
+
+TEST_F(TransformationFilterTest, KeepsTheTransformerOfATaskOutlivingItsConfig) {
+  listener_config_.mutable_async_pool()->set_threads(1);
+  listener_config_.mutable_async_pool()->set_max_pending(3);
+  auto &transformation = *route_config_.mutable_request_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_body()->set_text("{{a}}");
+  transformation.set_async_body_threshold(1);
+  initFilter();
+  // another listener shares the pool, which outlives the config of the stream.
+  TransformationFilterConfig other_config(listener_config_, "other_",
+                                          factory_context_);
+  WorkerPool &pool = *other_config.workerPool();
+
+  // the pool thread is held until the stream and its route config are gone.
+  absl::Notification unblock;
+  ASSERT_TRUE(pool.post([&unblock] { unblock.WaitForNotification(); }));
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl downstream_body("{\"a\":\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(downstream_body, true));
+  filter_->onDestroy();
+  filter_.reset();
+  config_.reset();
+  route_config_wrapper_.reset();
+
+  // the task still runs on its transformer.
+  absl::Notification ran;
+  ASSERT_TRUE(pool.post([&ran] { ran.Notify(); }));
+  unblock.Notify();
+  ran.WaitForNotification();
+}
+
+TEST_F(TransformationFilterTest, TransformsBufferedBodyInPlace) {
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  filter_->decodeHeaders(headers_, false);
+  // the stream buffers the body until it is complete, as it would for the
+  // filter manager.
+  filter_callbacks_.buffer_ = std::make_unique<Buffer::OwnedImpl>();
+  Buffer::OwnedImpl first("{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationAndBuffer,
+            filter_->decodeData(first, false));
+  filter_callbacks_.buffer_->move(first);
+
+  Buffer::OwnedImpl second("\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationAndBuffer,
+            filter_->decodeData(second, false));
+  filter_callbacks_.buffer_->move(second);
+
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, _)).Times(0);
+  Http::TestRequestTrailerMapImpl trailers;
+  EXPECT_EQ(Http::FilterTrailersStatus::Continue,
+            filter_->decodeTrailers(trailers));
+  EXPECT_EQ("b", filter_callbacks_.buffer_->toString());
+  EXPECT_EQ(9U, config_->stats().request_bytes_in_.value());
+}
+
+TEST_F(TransformationFilterTest, ErrorOnBufferedBodyOverLimit) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(8));
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  filter_->decodeHeaders(headers_, false);
+  filter_callbacks_.buffer_ = std::make_unique<Buffer::OwnedImpl>("{\"a\":");
+
+  std::string status;
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, _))
+      .WillOnce(Invoke([&](Http::ResponseHeaderMap &headers, bool) {
+        status = std::string(headers.getStatusValue());
+      }));
+  Buffer::OwnedImpl rest("\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(rest, false));
+  EXPECT_EQ("413", status);
+}
+
+TEST_F(TransformationFilterTest, ErrorOnBufferedBodyOverBudget) {
+  Buffer::BodyBudget &budget = Buffer::BodyBudget::get();
+  budget.setLimit(8);
+  Cleanup reset_limit([&budget]() { budget.setLimit(0); });
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  filter_->decodeHeaders(headers_, false);
+  filter_callbacks_.buffer_ = std::make_unique<Buffer::OwnedImpl>();
+  Buffer::OwnedImpl first("{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationAndBuffer,
+            filter_->decodeData(first, false));
+  EXPECT_EQ(5U, budget.used());
+  filter_callbacks_.buffer_->move(first);
+
+  std::string status;
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, _))
+      .WillOnce(Invoke([&](Http::ResponseHeaderMap &headers, bool) {
+        status = std::string(headers.getStatusValue());
+      }));
+  Buffer::OwnedImpl rest("\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(rest, false));
+  EXPECT_EQ("503", status);
+  EXPECT_EQ(1U, config_->stats().body_budget_exhausted_.value());
+  EXPECT_EQ(0U, budget.used());
+}
+
+TEST_F(TransformationFilterTest, ReleasesTheBudgetOnceTransformed) {
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  filter_->decodeHeaders(headers_, false);
+  filter_callbacks_.buffer_ = std::make_unique<Buffer::OwnedImpl>();
+  Buffer::OwnedImpl first("{\"a\":");
+  filter_->decodeData(first, false);
+  filter_callbacks_.buffer_->move(first);
+  Buffer::OwnedImpl second("\"b\"}");
+  filter_->decodeData(second, false);
+  filter_callbacks_.buffer_->move(second);
+  EXPECT_EQ(9U, Buffer::BodyBudget::get().used());
+
+  Http::TestRequestTrailerMapImpl trailers;
+  EXPECT_EQ(Http::FilterTrailersStatus::Continue,
+            filter_->decodeTrailers(trailers));
+  EXPECT_EQ(0U, Buffer::BodyBudget::get().used());
+}
+
+TEST_F(TransformationFilterTest, RecordsTheTimeOfTheFilter) {
+  listener_config_.set_record_filter_time(true);
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Route,
+                             "solo");
+
+  filter_->decodeHeaders(headers_, true);
+
+  const auto *time =
+      filter_callbacks_.streamInfo().filterState()->getDataReadOnly<
+          Http::FilterTime>("io.solo.transformation.time");
+  ASSERT_NE(nullptr, time);
+  EXPECT_TRUE(time->serializeAsString().has_value());
+}
+
+TEST_F(TransformationFilterTest, DoesNotRecordTheTimeByDefault) {
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Route,
+                             "solo");
+
+  filter_->decodeHeaders(headers_, true);
+
+  EXPECT_FALSE(filter_callbacks_.streamInfo().filterState()->hasDataWithName(
+      "io.solo.transformation.time"));
+}
+
+TEST_F(TransformationFilterTest, ErrorOnContentLengthOverLimit) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(8));
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Listener,
+                             "{{a}}");
+
+  // the body is rejected before any of it is buffered.
+  std::string status;
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, _))
+      .WillOnce(Invoke([&](Http::ResponseHeaderMap &headers, bool) {
+        status = std::string(headers.getStatusValue());
+      }));
+  headers_.setContentLength(9);
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers_, false));
+  EXPECT_EQ("413", status);
+
+  Buffer::OwnedImpl body("{\"a\":\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->decodeData(body, true));
+  EXPECT_EQ(0U, config_->stats().request_body_transformations_.value());
+}
+
+TEST_F(TransformationFilterTest, TransformsBodyPrefix) {
+  auto &transformation = *route_config_.mutable_request_transformation()
+                              ->mutable_transformation_template();
+  envoy::api::v2::filter::http::Extraction extractor;
+  extractor.mutable_body();
+  extractor.set_regex("id=(\\w+)");
+  extractor.set_subgroup(1);
+  (*transformation.mutable_extractors())["id"] = extractor;
+  (*transformation.mutable_headers())["x-id"].set_text("{{id}}");
+  transformation.set_parse_body_behavior(
+      envoy::api::v2::filter::http::TransformationTemplate::DontParse);
+  transformation.set_body_prefix_bytes(8);
+  initFilter();
+
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl first("id=ab");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(first, false));
+
+  // the prefix is transformed, and the rest of the data continues after it.
+  std::string upstream_prefix;
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { upstream_prefix = b.toString(); }));
+  Buffer::OwnedImpl second("cdef-rest");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(second, false));
+  EXPECT_EQ("id=abcde", upstream_prefix);
+  EXPECT_EQ("f-rest", second.toString());
+  EXPECT_EQ("abcde", headers_.get_("x-id"));
+
+  Buffer::OwnedImpl last("-end");
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->decodeData(last, true));
+  EXPECT_EQ("-end", last.toString());
+  EXPECT_EQ(1U, config_->stats().request_body_transformations_.value());
+}
+
+TEST_F(TransformationFilterTest, StreamsResponseBody) {
+  auto &transformation = *route_config_.mutable_response_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_streaming_body()->set_format(
+      envoy::api::v2::filter::http::StreamingBody::NEWLINE_DELIMITED_JSON);
+  transformation.mutable_body()->set_text("{{a}}");
+  initFilter();
+
+  filter_->decodeHeaders(headers_, true);
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, false));
+
+  // every chunk continues with the records it completes.
+  EXPECT_CALL(encoder_filter_callbacks_, addEncodedData(_, _)).Times(0);
+  Buffer::OwnedImpl first("{\"a\":\"b\"}\n{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->encodeData(first, false));
+  EXPECT_EQ("b\n", first.toString());
+
+  Buffer::OwnedImpl last("\"c\"}");
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(last, true));
+  EXPECT_EQ("c\n", last.toString());
+  EXPECT_EQ(1U, config_->stats().response_header_transformations_.value());
+  EXPECT_EQ(1U, config_->stats().response_body_transformations_.value());
+}
+
+TEST_F(TransformationFilterTest, ResetsStreamsWithInvalidRecords) {
+  auto &transformation = *route_config_.mutable_response_transformation()
+                              ->mutable_transformation_template();
+  transformation.mutable_streaming_body()->set_format(
+      envoy::api::v2::filter::http::StreamingBody::NEWLINE_DELIMITED_JSON);
+  transformation.mutable_body()->set_text("{{a}}");
+  initFilter();
+
+  filter_->decodeHeaders(headers_, true);
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  filter_->encodeHeaders(response_headers, false);
+
+  EXPECT_CALL(encoder_filter_callbacks_, resetStream());
+  Buffer::OwnedImpl data("not json\n");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->encodeData(data, false));
+  EXPECT_EQ(0U, data.length());
+  EXPECT_EQ(1U, config_->stats().response_error_.value());
+}
+
 TEST_F(TransformationFilterTest, HappyPathWithBodyPassthrough) {
   happyPathWithBodyPassthrough(TransformationFilterTest::ConfigType::Both, 1U);
   happyPathWithBodyPassthrough(TransformationFilterTest::ConfigType::Route, 2U);
@@ -727,6 +1108,29 @@ TEST_F(TransformationFilterTest, WithoutResponseHeaderOnStreamComplete) {
   EXPECT_EQ(0U, config_->stats().on_stream_complete_error_.value());
 }
 
+TEST_F(TransformationFilterTest, ClearsEmptyResponseHeadersOnStreamComplete) {
+  auto &transformation =
+      *transformation_rule_.mutable_route_transformations()
+           ->mutable_on_stream_completion_transformation()
+           ->mutable_transformation_template();
+  // the metadata is rendered before the header is added.
+  auto *dynamic_meta = transformation.add_dynamic_metadata_values();
+  dynamic_meta->set_key("previous");
+  dynamic_meta->mutable_value()->set_text("{{header(\"added-header\")}}");
+  initOnStreamCompleteTransformHeader();
+
+  EXPECT_CALL(encoder_filter_callbacks_.stream_info_, setDynamicMetadata(_, _))
+      .Times(0);
+  for (int i = 0; i < 2; i++) {
+    filter_ = std::make_unique<TransformationFilter>(config_);
+    filter_->setDecoderFilterCallbacks(filter_callbacks_);
+    filter_->setEncoderFilterCallbacks(encoder_filter_callbacks_);
+    filter_->decodeHeaders(headers_, true);
+    filter_->onStreamComplete();
+  }
+  EXPECT_EQ(0U, config_->stats().on_stream_complete_error_.value());
+}
+
 TEST_F(TransformationFilterTest, ErroredOnStreamComplete) {
   initOnStreamCompleteTransformHeader();
 
@@ -0,0 +1,55 @@
+#include "source/common/stats/isolated_store_impl.h"
+#include "source/extensions/filters/http/transformation/worker_pool.h"
+
+#include "test/test_common/utility.h"
+
+#include "absl/synchronization/notification.h"
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+class WorkerPoolTest : public testing::Test {
+public:
+  Api::ApiPtr api_{Api::createApiForTest()};
+  Stats::IsolatedStoreImpl store_;
+};
+
+TEST_F(WorkerPoolTest, RunsTasks) {
+  WorkerPool pool(2, 10, api_->threadFactory(), store_);
+  absl::Notification first;
+  absl::Notification second;
+  EXPECT_TRUE(pool.post([&first]() { first.Notify(); }));
+  EXPECT_TRUE(pool.post([&second]() { second.Notify(); }));
+  first.WaitForNotification();
+  second.WaitForNotification();
+}
+
+TEST_F(WorkerPoolTest, RejectsTasksWhenFull) {
+  WorkerPool pool(1, 1, api_->threadFactory(), store_);
+  absl::Notification started;
+  absl::Notification release;
+  EXPECT_TRUE(pool.post([&]() {
+    started.Notify();
+    release.WaitForNotification();
+  }));
+  started.WaitForNotification();
+
+  // the only thread is busy, so one task can wait for it.
+  absl::Notification ran;
+  EXPECT_TRUE(pool.post([&ran]() { ran.Notify(); }));
+  EXPECT_EQ(1U, pool.stats().tasks_pending_.value());
+  EXPECT_FALSE(pool.post([]() {}));
+  EXPECT_EQ(1U, pool.stats().tasks_rejected_.value());
+
+  release.Notify();
+  ran.WaitForNotification();
+  EXPECT_EQ(0U, pool.stats().tasks_pending_.value());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
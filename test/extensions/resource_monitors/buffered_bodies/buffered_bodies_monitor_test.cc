@@ -0,0 +1,46 @@
+#include "source/common/buffer/body_budget.h"
+#include "source/extensions/resource_monitors/buffered_bodies/buffered_bodies_monitor.h"
+
+#include "absl/types/optional.h"
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ResourceMonitors {
+namespace BufferedBodies {
+namespace {
+
+class ResourcePressure : public Server::ResourceMonitor::Callbacks {
+public:
+  void onSuccess(const Server::ResourceUsage &usage) override {
+    pressure_ = usage.resource_pressure_;
+  }
+  void onFailure(const EnvoyException &) override { pressure_.reset(); }
+
+  absl::optional<double> pressure_;
+};
+
+TEST(BufferedBodiesMonitorTest, ReportsThePressureOfTheBudget) {
+  envoy::config::resource_monitor::buffered_bodies::v2::BufferedBodiesConfig
+      config;
+  config.set_max_buffered_bytes(200);
+  {
+    BufferedBodiesMonitor monitor(config);
+    EXPECT_EQ(200, Buffer::BodyBudget::get().limit());
+
+    Buffer::BodyBudget::Reservation reservation;
+    ASSERT_TRUE(reservation.reserveTo(50));
+    ResourcePressure resource;
+    monitor.updateResourceUsage(resource);
+    ASSERT_TRUE(resource.pressure_.has_value());
+    EXPECT_DOUBLE_EQ(0.25, resource.pressure_.value());
+  }
+  // the budget has no limit without the monitor.
+  EXPECT_EQ(0, Buffer::BodyBudget::get().limit());
+}
+
+} // namespace
+} // namespace BufferedBodies
+} // namespace ResourceMonitors
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "source/common/common/logger.h"
+#include "source/common/common/thread.h"
+#include "source/common/event/libevent.h"
+#include "source/common/memory/stats.h"
+
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+#include "test/integration/http_integration.h"
+#include "test/test_common/environment.h"
+
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+
+namespace {
+
+const std::string TRANSFORMATION_FILTER =
+    R"EOF(
+name: io.solo.transformation
+typed_config:
+  "@type": type.googleapis.com/envoy.api.v2.filter.http.FilterTransformations
+  transformations:
+  - match:
+      prefix: /
+    route_transformations:
+      request_transformation:
+        transformation_template:
+          extractors:
+            id:
+              header: :path
+              regex: /users/(\d+)
+              subgroup: 1
+          headers:
+            x-user-id:
+              text: '{{ extraction("id") }}'
+          body:
+            text: '{"id": "{{ extraction("id") }}", "name": "{{ name }}", "data": "{{ data }}"}'
+      response_transformation:
+        transformation_template:
+          headers:
+            x-upstream-status:
+              text: '{{ header(":status") }}'
+          passthrough: {}
+)EOF";
+
+const std::string LAMBDA_FILTER =
+    R"EOF(
+name: io.solo.aws_lambda
+)EOF";
+
+// a real envoy with the gloo filters, between a client and a fake upstream on
+// the same process. The requests are sent one at a time on a single
+// connection, so the latencies are those of the whole path through the proxy.
+class GlooFilterChain : public HttpIntegrationTest {
+public:
+  explicit GlooFilterChain(bool with_lambda)
+      : HttpIntegrationTest(Http::CodecClient::Type::HTTP1,
+                            TestEnvironment::getIpVersionsForTest().front()) {
+    if (with_lambda) {
+      addLambda();
+    }
+    // prepended last, so that the transformation runs first.
+    config_helper_.prependFilter(TRANSFORMATION_FILTER);
+  }
+
+  void start() {
+    initialize();
+    codec_client_ =
+        makeHttpConnection(makeClientConnection(lookupPort("http")));
+  }
+
+  void roundTrip(const Http::TestRequestHeaderMapImpl &request_headers,
+                 const std::string &request_body,
+                 const std::string &response_body) {
+    IntegrationStreamDecoderPtr response =
+        codec_client_->makeRequestWithBody(request_headers, request_body);
+    waitForNextUpstreamRequest();
+    upstream_request_->encodeHeaders(default_response_headers_, false);
+    upstream_request_->encodeData(response_body, true);
+    RELEASE_ASSERT(response->waitForEndStream(), "no response");
+    RELEASE_ASSERT(response->headers().getStatusValue() == "200",
+                   "unexpected status");
+    upstream_request_.reset();
+  }
+
+private:
+  void addLambda() {
+    config_helper_.prependFilter(LAMBDA_FILTER);
+    config_helper_.addConfigModifier(
+        [](envoy::config::bootstrap::v3::Bootstrap &bootstrap) {
+          envoy::config::filter::http::aws_lambda::v2::
+              AWSLambdaProtocolExtension protocol_options;
+          protocol_options.set_host("lambda.us-east-1.amazonaws.com");
+          protocol_options.set_region("us-east-1");
+          protocol_options.set_access_key("access key");
+          protocol_options.set_secret_key("secret key");
+          auto &cluster =
+              *bootstrap.mutable_static_resources()->mutable_clusters(0);
+          (*cluster.mutable_typed_extension_protocol_options())
+              [Extensions::HttpFilters::SoloHttpFilterNames::get().AwsLambda]
+                  .PackFrom(protocol_options);
+        });
+    config_helper_.addConfigModifier(
+        [](envoy::extensions::filters::network::http_connection_manager::v3::
+               HttpConnectionManager &hcm) {
+          envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute
+              route_config;
+          route_config.set_name("FunctionName");
+          route_config.set_qualifier("v1");
+          (*hcm.mutable_route_config()
+                ->mutable_virtual_hosts(0)
+                ->mutable_routes(0)
+                ->mutable_typed_per_filter_config())
+              [Extensions::HttpFilters::SoloHttpFilterNames::get().AwsLambda]
+                  .PackFrom(route_config);
+        });
+  }
+};
+
+double percentile(std::vector<double> &samples, double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  auto nth = samples.begin() + static_cast<size_t>(fraction *
+                                                   (samples.size() - 1));
+  std::nth_element(samples.begin(), nth, samples.end());
+  return *nth;
+}
+
+} // namespace
+
+// requests through the transformation filter (0), or through the
+// transformation and then the aws_lambda filter (1), with as many bytes of
+// data in the json body as the second argument.
+static void BM_FilterChainRoundTrip(benchmark::State &state) {
+  const bool with_lambda = state.range(0) != 0;
+  const std::string request_body = "{\"name\": \"solo\", \"data\": \"" +
+                                   std::string(state.range(1), 'a') + "\"}";
+  const std::string response_body(state.range(1), 'b');
+  const Http::TestRequestHeaderMapImpl request_headers{
+      {":method", "POST"},
+      {":authority", "www.solo.io"},
+      {":path", "/users/123"},
+      {"content-type", "application/json"}};
+
+  GlooFilterChain chain(with_lambda);
+  chain.start();
+  // the first request sets up the upstream connection.
+  chain.roundTrip(request_headers, request_body, response_body);
+
+  std::vector<double> latencies_us;
+  const uint64_t allocated_before = Memory::Stats::totalCurrentlyAllocated();
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    chain.roundTrip(request_headers, request_body, response_body);
+    latencies_us.push_back(std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+  }
+  const uint64_t allocated_after = Memory::Stats::totalCurrentlyAllocated();
+
+  state.counters["rps"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["p50_us"] = percentile(latencies_us, 0.5);
+  state.counters["p99_us"] = percentile(latencies_us, 0.99);
+  // what the requests left allocated in the proxy, the client and the fake
+  // upstream together. Only known when built with tcmalloc.
+  state.counters["retained_bytes_per_request"] =
+      (static_cast<double>(allocated_after) - allocated_before) /
+      state.iterations();
+  state.SetBytesProcessed(state.iterations() *
+                          (request_body.size() + response_body.size()));
+}
+BENCHMARK(BM_FilterChainRoundTrip)
+    ->ArgsProduct({{0, 1}, {0, 1 << 10, 64 << 10}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace Envoy
+
+// the integration framework needs the test environment, the logger and
+// libevent, which the test main sets up for the other integration tests.
+int main(int argc, char **argv) {
+  Envoy::TestEnvironment::initializeTestMain(argv[0]);
+  benchmark::Initialize(&argc, argv);
+  Envoy::TestEnvironment::initializeOptions(argc, argv);
+  Envoy::Thread::MutexBasicLockable lock;
+  Envoy::Logger::Context logging_context(
+      spdlog::level::warn, Envoy::Logger::Logger::DEFAULT_LOG_FORMAT, lock,
+      false);
+  Envoy::Event::Libevent::Global::initialize();
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -4,7 +4,13 @@ namespace Envoy {
 namespace Nats {
 
 bool operator==(const Message &lhs, const Message &rhs) {
-  return lhs.asString() == rhs.asString();
+  if (lhs.asString() != rhs.asString()) {
+    return false;
+  }
+  if (lhs.payload() == nullptr || rhs.payload() == nullptr) {
+    return lhs.payload() == rhs.payload();
+  }
+  return lhs.payload()->toString() == rhs.payload()->toString();
 }
 
 namespace ConnPoolNats {
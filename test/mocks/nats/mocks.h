@@ -23,6 +23,7 @@ public:
 
   MOCK_METHOD2(makeRequest,
                void(const std::string &hash_key, const Message &request));
+  MOCK_METHOD0(clusterInfo, Upstream::ClusterInfoConstSharedPtr());
 };
 
 } // namespace ConnPoolNats
@@ -12,6 +12,9 @@ namespace Streaming {
 MockPublishCallbacks::MockPublishCallbacks() {}
 MockPublishCallbacks::~MockPublishCallbacks() {}
 
+MockPublishRequest::MockPublishRequest() {}
+MockPublishRequest::~MockPublishRequest() {}
+
 MockClient::MockClient() {
   ON_CALL(*this, makeRequest_(_, _, _, _, _))
       .WillByDefault(Invoke(
@@ -33,9 +36,10 @@ MockClient::~MockClient() {}
 PublishRequestPtr MockClient::makeRequest(const std::string &subject,
                                           const std::string &cluster_id,
                                           const std::string &discover_prefix,
-                                          std::string &&payload,
+                                          Buffer::InstancePtr &&payload,
                                           PublishCallbacks &callbacks) {
-  return makeRequest_(subject, cluster_id, discover_prefix, payload, callbacks);
+  return makeRequest_(subject, cluster_id, discover_prefix, payload->toString(),
+                      callbacks);
 }
 
 } // namespace Streaming
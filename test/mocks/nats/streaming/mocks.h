@@ -14,8 +14,21 @@ public:
   ~MockPublishCallbacks();
 
   MOCK_METHOD0(onResponse, void());
+  void onReply(Buffer::InstancePtr &&reply) override {
+    onReply_(reply->toString());
+  }
+  MOCK_METHOD1(onReply_, void(const std::string &));
   MOCK_METHOD0(onFailure, void());
   MOCK_METHOD0(onTimeout, void());
+  MOCK_METHOD0(onOverflow, void());
+};
+
+class MockPublishRequest : public PublishRequest {
+public:
+  MockPublishRequest();
+  ~MockPublishRequest();
+
+  MOCK_METHOD0(cancel, void());
 };
 
 class MockClient : public Client {
@@ -26,7 +39,7 @@ public:
   PublishRequestPtr makeRequest(const std::string &subject,
                                 const std::string &cluster_id,
                                 const std::string &discover_prefix,
-                                std::string &&payload,
+                                Buffer::InstancePtr &&payload,
                                 PublishCallbacks &callbacks) override;
 
   MOCK_METHOD5(makeRequest_,
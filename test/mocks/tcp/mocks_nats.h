@@ -80,6 +80,8 @@ public:
 
   MOCK_METHOD1(onResponse_, void(TPtr &value));
   MOCK_METHOD0(onClose, void());
+  MOCK_METHOD0(onAboveWriteBufferHighWatermark, void());
+  MOCK_METHOD0(onBelowWriteBufferLowWatermark, void());
 };
 
 class MockInstance : public Instance<T> {
@@ -89,6 +91,7 @@ public:
 
   MOCK_METHOD2(makeRequest,
                void(const std::string &hash_key, const T &request));
+  MOCK_METHOD0(clusterInfo, Upstream::ClusterInfoConstSharedPtr());
 };
 
 } // namespace ConnPoolNats